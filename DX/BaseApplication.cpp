@@ -2,6 +2,9 @@
 // Base application functionality for inheritnace.
 #include "BaseApplication.h"
 #include "Texture.h"
+#include "name_interner.h"
+#include "material_table.h"
+#include "state_cache.h"
 #include <imgui.h>
 #include <imgui_impl_dx11.h>
 
@@ -51,6 +54,12 @@ BaseApplication::~BaseApplication()
   // Release the textures manager
   Texture::ResetInst();
 
+  // Release the material constants
+  sz::MaterialTable::ResetInst();
+
+  // Release the resource names
+  sz::NameInterner::ResetInst();
+
   // Release the Direct3D object.
   if (m_Direct3D)
   {
@@ -58,6 +67,9 @@ BaseApplication::~BaseApplication()
     m_Direct3D = 0;
   }
 
+  // Release the interned state objects
+  sz::StateCache::ResetInst();
+
   // Cleanup ImGui data
   ImGui_ImplDX11_Shutdown();
 }
@@ -2,7 +2,9 @@
 // Base mesh class, for inheriting base mesh functionality.
 
 #include "basemesh.h"
+#include "state_cache.h"
 #include "Texture.h"
+#include "mesh_bounds.h"
 #include <glm/glm.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
@@ -11,7 +13,11 @@
 BaseMesh::BaseMesh() :
   transform_(),
   m_vertexBuffer(nullptr),
-  m_indexBuffer(nullptr)
+  m_indexBuffer(nullptr),
+  centre_(0.f, 0.f, 0.f),
+  extents_(-1.f, -1.f, -1.f),
+  cull_index_(sz::kNoMeshBounds),
+  instance_params_(1.f, 1.f, 1.f, 1.f)
 {
 }
 
@@ -50,13 +56,16 @@ void BaseMesh::SendData(ID3D11DeviceContext* deviceContext) {
   offset = 0;
 
   // Set the vertex buffer to active in the input assembler so it can be rendered.
-  deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
+  sz::StateCache::Inst()->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride,
+    &offset);
 
   // Set the index buffer to active in the input assembler so it can be rendered.
-  deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+  sz::StateCache::Inst()->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT,
+    0);
 
   // Set the type of primitive that should be rendered from this vertex buffer, in this case triangles.
-  deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  sz::StateCache::Inst()->IASetPrimitiveTopology(
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 }
   
 int BaseMesh::GetIndexCount() {
@@ -87,6 +96,21 @@ void BaseMesh::InitBuffers(std::vector<VertexType> &vertices,
 
   indices.insert(indices.end(), indices_.begin(), indices_.end());
 
+  // Bounding box, used to cull meshes and to sort draws by depth
+  if (!vertices_.empty()) {
+    XMVECTOR min_pos = XMLoadFloat3(&vertices[vertex_offset_].position);
+    XMVECTOR max_pos = min_pos;
+    for (size_t i = vertex_offset_; i < vertex_offset_ + vertices_.size(); ++i) {
+      XMVECTOR p = XMLoadFloat3(&vertices[i].position);
+      min_pos = XMVectorMin(min_pos, p);
+      max_pos = XMVectorMax(max_pos, p);
+    }
+    XMStoreFloat3(&centre_, XMVectorScale(XMVectorAdd(min_pos, max_pos), 0.5f));
+    XMStoreFloat3(&extents_,
+      XMVectorScale(XMVectorSubtract(max_pos, min_pos), 0.5f));
+  }
+
+
 }
 
 void BaseMesh::CalcTangentArray(std::vector<VertexType> &vertices, 
@@ -10,6 +10,7 @@
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/string.hpp>
 #include <boost/serialization/serialization.hpp>
+#include "abertay_framework.h"
 
 using namespace DirectX;
 
@@ -82,10 +83,50 @@ public:
     return mat_id_;
   }
 
+  // Centre of the bounding box of the vertices, in model space
+  inline const XMFLOAT3 &centre() const {
+    return centre_;
+  }
+  // Half extents of the bounding box; negative if the mesh has no bounds
+  inline const XMFLOAT3 &extents() const {
+    return extents_;
+  }
+  inline bool has_bounds() const {
+    return extents_.x >= 0.f;
+  }
+  inline void set_bounds(const XMFLOAT3 &centre, const XMFLOAT3 &extents) {
+    centre_ = centre;
+    extents_ = extents;
+  }
+
+  // Index of the mesh's bounds in the renderer's culling data
+  inline UInt32 cull_index() const {
+    return cull_index_;
+  }
+  inline void set_cull_index(UInt32 index) {
+    cull_index_ = index;
+  }
+
   inline void set_transform(const XMMATRIX &v) {
     XMStoreFloat4x4A(&transform_, v);
   }
 
+  // Per-instance parameters, when the mesh is drawn instanced
+  inline const XMFLOAT4 &instance_params() const {
+    return instance_params_;
+  }
+  inline void set_instance_params(const XMFLOAT4 &params) {
+    instance_params_ = params;
+  }
+
+  // Meshes with the same buffers can be drawn as instances of each other
+  inline ID3D11Buffer *vertex_buffer() const {
+    return m_vertexBuffer;
+  }
+  inline ID3D11Buffer *index_buffer() const {
+    return m_indexBuffer;
+  }
+
   inline void set_mat_id(int id) {
     mat_id_ = id;
   }
@@ -93,6 +134,14 @@ public:
   inline void set_vertices(const std::vector<ModelType> &val) {
     vertices_ = val;
   }
+  // As loaded; positions have z flipped by InitBuffers
+  inline const std::vector<ModelType> &vertices() const {
+    return vertices_;
+  }
+
+  inline const std::vector<unsigned int> &indices() const {
+    return indices_;
+  }
 
   inline void set_indices(const std::vector<unsigned int> &val) {
     indices_ = val;
@@ -138,6 +187,11 @@ protected:
   // The id of the material to be used; it is the index
   // in the array of materials of the model.
   int mat_id_;
+  // Computed from the vertices by InitBuffers; not serialised
+  XMFLOAT3 centre_;
+  XMFLOAT3 extents_;
+  UInt32 cull_index_;
+  XMFLOAT4 instance_params_;
  
   friend class boost::serialization::access;
 
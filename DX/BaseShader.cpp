@@ -1,26 +1,35 @@
 // base shader.cpp
 #include "baseshader.h"
+#include "state_cache.h"
 #include "Texture.h"
 #include "Camera.h"
 #include "Light.h"
 #include "RenderTexture.h"
+#include "material_table.h"
+#include "transform_batch.h"
 #include <locale>
 #include <codecvt>
 #include <string>
+#include <cstring>
 #include <d3d11.h>
 
+const XMFLOAT4X4 *BaseShader::light_transforms_ = nullptr;
+
 BaseShader::BaseShader(ID3D11Device* device, HWND hwnd) :
   m_vertexShader(nullptr),
   vertexshader_standard(nullptr),
   vertexshader_tessellation(nullptr),
+  vertexshader_instanced(nullptr),
   m_pixelShader(nullptr),
   m_hullShader(nullptr),
   m_domainShader(nullptr),
   m_geometryShader(nullptr),
   m_layout(nullptr),
+  layout_instanced(nullptr),
   m_matrixBuffer(nullptr),
   m_sampleState(nullptr),
-  tessellate_(false) {
+  tessellate_(false),
+  draw_transforms_(nullptr) {
   m_device = device;
   m_hwnd = hwnd;
 }
@@ -52,6 +61,16 @@ BaseShader::~BaseShader()
     vertexshader_tessellation->Release();
     vertexshader_tessellation = 0;
   }
+  if (vertexshader_instanced)
+  {
+    vertexshader_instanced->Release();
+    vertexshader_instanced = 0;
+  }
+  if (layout_instanced)
+  {
+    layout_instanced->Release();
+    layout_instanced = 0;
+  }
 
   // Release the hull shader.
   if (m_hullShader)
@@ -165,6 +184,48 @@ vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(),
   vertexShaderBuffer = 0;
 }
 
+void BaseShader::loadInstancedVertexShader(
+  const D3D11_INPUT_ELEMENT_DESC *layout, size_t num_elements,
+  WCHAR* filename) {
+  HRESULT result;
+  ID3DBlob* errorMessage;
+  ID3DBlob* vertexShaderBuffer;
+
+  // Initialize the pointers this function will use to null.
+  errorMessage = 0;
+  vertexShaderBuffer = 0;
+
+  // Compile the vertex shader code.
+  result = D3DCompileFromFile(filename, NULL, NULL, "main", "vs_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &vertexShaderBuffer, &errorMessage);
+  if (FAILED(result))
+  {
+    if (errorMessage)
+    {
+      OutputShaderErrorMessage(errorMessage, m_hwnd, filename);
+    }
+    else
+    {
+      MessageBox(m_hwnd, filename, L"Missing Shader File", MB_OK);
+    }
+    exit(0);
+  }
+
+  // Without both, the shader is only drawn one mesh at a time
+  result = m_device->CreateVertexShader(vertexShaderBuffer->GetBufferPointer(), vertexShaderBuffer->GetBufferSize(), NULL, &vertexshader_instanced);
+  if (SUCCEEDED(result)) {
+    result = m_device->CreateInputLayout(layout, num_elements,
+      vertexShaderBuffer->GetBufferPointer(),
+      vertexShaderBuffer->GetBufferSize(), &layout_instanced);
+  }
+  if (FAILED(result) && vertexshader_instanced != nullptr) {
+    vertexshader_instanced->Release();
+    vertexshader_instanced = nullptr;
+  }
+
+  vertexShaderBuffer->Release();
+  vertexShaderBuffer = 0;
+}
+
 #ifdef _DEBUG
 void SetDebugName(ID3D11DeviceChild* child, const std::string& name)
 {
@@ -179,8 +240,10 @@ void BaseShader::loadPixelShader(WCHAR* filename)
   ID3DBlob* errorMessage;
   ID3DBlob* pixelShaderBuffer;
   
-  // Compile the pixel shader code.
-  result = D3DCompileFromFile(filename, NULL, NULL, "main", "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &pixelShaderBuffer, &errorMessage);
+  // Compile the pixel shader code; shaders may include files relative to
+  // their own directory
+  result = D3DCompileFromFile(filename, NULL,
+    D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", "ps_5_0", D3DCOMPILE_ENABLE_STRICTNESS, 0, &pixelShaderBuffer, &errorMessage);
   if (FAILED(result))
   {
     // If the shader failed to compile it should have writen something to the error message.
@@ -341,14 +404,18 @@ void BaseShader::OutputShaderErrorMessage(ID3D10Blob* errorMessage, HWND hwnd, W
 void BaseShader::Render(ID3D11DeviceContext* deviceContext, size_t index_count,
     size_t index_start, size_t base_vertex) {
 
-  deviceContext->DrawIndexed(index_count, index_start, base_vertex);
+  sz::StateCache::Inst()->DrawIndexed(index_count, index_start, base_vertex);
 }
-void BaseShader::CleanupTextures(ID3D11DeviceContext* deviceContext) {
-  ID3D11ShaderResourceView * texture[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT - 1]
-    = { NULL };
 
-  deviceContext->PSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT - 1,
-    texture);
+void BaseShader::RenderInstanced(ID3D11DeviceContext* deviceContext,
+    size_t index_count, size_t instance_count, size_t instance_start,
+    size_t index_start, size_t base_vertex) {
+  sz::StateCache::Inst()->DrawIndexedInstanced(index_count, instance_count,
+    index_start, base_vertex, instance_start);
+}
+void BaseShader::CleanupTextures(ID3D11DeviceContext* deviceContext) {
+  // Only the slots which may be bound are cleared
+  sz::StateCache::Inst()->PSUnbindShaderResources();
 }
 
 void BaseShader::ActivateTessellation(ID3D11DeviceContext* deviceContext) {
@@ -368,30 +435,79 @@ void BaseShader::DeactivateTessellation(ID3D11DeviceContext* deviceContext) {
 
 void BaseShader::SetInputLayoutAndShaders(ID3D11DeviceContext* deviceContext) {
   // Set the vertex input layout.
-  deviceContext->IASetInputLayout(m_layout);
+  sz::StateCache::Inst()->IASetInputLayout(m_layout);
+
+  // Set the vertex shader; the others follow.
+  sz::StateCache::Inst()->VSSetShader(m_vertexShader);
 
-  // Set the vertex and pixel shaders that will be used to render.
-  deviceContext->VSSetShader(m_vertexShader, NULL, 0);
-  deviceContext->PSSetShader(m_pixelShader, NULL, 0);
+  SetOtherShaders(tessellate_);
+}
+
+void BaseShader::SetInstancedInputLayoutAndShaders(
+  ID3D11DeviceContext* deviceContext) {
+  sz::StateCache::Inst()->IASetInputLayout(layout_instanced);
+  sz::StateCache::Inst()->VSSetShader(vertexshader_instanced);
+
+  // The instanced vertex shader does not feed tessellation
+  SetOtherShaders(false);
+}
+
+void BaseShader::SetOtherShaders(bool tessellate) {
+  sz::StateCache::Inst()->PSSetShader(m_pixelShader);
 
   // if Hull shader is not null then set HS and DS
-  if (m_hullShader && tessellate_) {
-    deviceContext->HSSetShader(m_hullShader, NULL, 0);
-    deviceContext->DSSetShader(m_domainShader, NULL, 0);
+  if (m_hullShader && tessellate) {
+    sz::StateCache::Inst()->HSSetShader(m_hullShader);
+    sz::StateCache::Inst()->DSSetShader(m_domainShader);
   }
   else {
-    deviceContext->HSSetShader(NULL, NULL, 0);
-    deviceContext->DSSetShader(NULL, NULL, 0);
+    sz::StateCache::Inst()->HSSetShader(NULL);
+    sz::StateCache::Inst()->DSSetShader(NULL);
   }
 
   // if geometry shader is not null then set GS
   if (m_geometryShader) {
-    deviceContext->GSSetShader(m_geometryShader, NULL, 0);
+    sz::StateCache::Inst()->GSSetShader(m_geometryShader);
   }
   else {
-    deviceContext->GSSetShader(NULL, NULL, 0);
+    sz::StateCache::Inst()->GSSetShader(NULL);
+  }
+
+}
+
+void BaseShader::WriteMatrixConstants(ID3D11Buffer *buffer,
+  const XMMATRIX &world, const XMMATRIX &view, const XMMATRIX &projection) {
+  D3D11_MAPPED_SUBRESOURCE mapped_resource;
+  sz::StateCache::Inst()->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0,
+    &mapped_resource);
+  sz::MatrixBufferType *data_ptr =
+    static_cast<sz::MatrixBufferType *>(mapped_resource.pData);
+  if (draw_transforms_ != nullptr) {
+    memcpy(data_ptr, draw_transforms_, sizeof(sz::MatrixBufferType));
+  }
+  else {
+    sz::TransformBatch::ComputeEntry(world, view, projection,
+      light_transforms_, *data_ptr);
+  }
+  sz::StateCache::Inst()->Unmap(buffer, 0);
+}
+
+void BaseShader::SetMaterialConstants(ID3D11Buffer *buffer,
+  const sz::Material &mat) {
+  if (mat.table_index != sz::kNoMaterialTableIndex) {
+    ID3D11Buffer *table_buffer =
+      sz::MaterialTable::Inst()->buffer(mat.table_index);
+    sz::StateCache::Inst()->PSSetConstantBuffers(1, 1, &table_buffer);
+    return;
   }
 
+  D3D11_MAPPED_SUBRESOURCE mapped_resource;
+  sz::StateCache::Inst()->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0,
+    &mapped_resource);
+  sz::MaterialTable::Pack(mat.info(),
+    *static_cast<sz::MaterialBufferType *>(mapped_resource.pData));
+  sz::StateCache::Inst()->Unmap(buffer, 0);
+  sz::StateCache::Inst()->PSSetConstantBuffers(1, 1, &buffer);
 }
 
 void BaseShader::SetShaderParameters(ID3D11DeviceContext* deviceContext, 
@@ -41,6 +41,24 @@ public:
   // Set the DX shaders and the input layout for this shader class
   void SetInputLayoutAndShaders(ID3D11DeviceContext* deviceContext);
 
+  // Whether the shader has an instanced variant, which reads the world
+  // matrix of each instance from the second vertex buffer
+  inline bool has_instancing() const {
+    return vertexshader_instanced != nullptr;
+  }
+
+  // Set the DX shaders and the input layout of the instanced variant
+  void SetInstancedInputLayoutAndShaders(ID3D11DeviceContext* deviceContext);
+
+  // Draw instance_count instances, starting from instance_start in the
+  // instance buffer
+  virtual void RenderInstanced(ID3D11DeviceContext* deviceContext,
+    size_t index_count,
+    size_t instance_count,
+    size_t instance_start,
+    size_t index_start = 0,
+    size_t base_vertex = 0);
+
   // Set samplers for the shaders
   virtual void SetSamplers(ID3D11DeviceContext* deviceContext) {};
 
@@ -50,6 +68,20 @@ public:
     const XMMATRIX &world, const XMMATRIX &view, const XMMATRIX &projection,
     const sz::Material &mat);
 
+  // Matrices of the next draws, worked out by a TransformBatch, which
+  // SetShaderParameters copies instead of the matrices it is given;
+  // nullptr goes back to the given matrices
+  inline void set_draw_transforms(const sz::MatrixBufferType *transforms) {
+    draw_transforms_ = transforms;
+  }
+
+  // View times projection of each light this frame, shared by all the
+  // shaders, for the draws whose matrices are not worked out by a
+  // TransformBatch; nullptr for identity matrices
+  static inline void set_light_transforms(const XMFLOAT4X4 *transforms) {
+    light_transforms_ = transforms;
+  }
+
   void CleanupTextures(ID3D11DeviceContext* deviceContext);
 
   // Activate tessellation on this shader
@@ -67,6 +99,18 @@ protected:
   void loadVertexShader(const D3D11_INPUT_ELEMENT_DESC *layout,
     size_t num_elements, WCHAR* filename);
   void loadVertexShader(WCHAR* filename, ID3D11VertexShader **shader);
+  void loadInstancedVertexShader(const D3D11_INPUT_ELEMENT_DESC *layout,
+    size_t num_elements, WCHAR* filename);
+  // Bind the shaders after the vertex shader
+  void SetOtherShaders(bool tessellate);
+  // Write the matrices of a draw to the given matrix buffer: the entry set
+  // with set_draw_transforms, or those worked out from the given ones
+  void WriteMatrixConstants(ID3D11Buffer *buffer, const XMMATRIX &world,
+    const XMMATRIX &view, const XMMATRIX &projection);
+  // Bind the constants of a material to b1 of the pixel shader: the buffer
+  // of its MaterialTable entry, or the given one, written with them, if it
+  // has none
+  void SetMaterialConstants(ID3D11Buffer *buffer, const sz::Material &mat);
   void loadHullShader(WCHAR* filename);
   void loadDomainShader(WCHAR* filename);
   void loadGeometryShader(WCHAR* filename);
@@ -79,15 +123,19 @@ protected:
   ID3D11VertexShader* m_vertexShader;
   ID3D11VertexShader* vertexshader_standard;
   ID3D11VertexShader* vertexshader_tessellation;
+  ID3D11VertexShader* vertexshader_instanced;
   ID3D11PixelShader* m_pixelShader;
   ID3D11HullShader* m_hullShader;
   ID3D11DomainShader* m_domainShader;
   ID3D11GeometryShader* m_geometryShader;
   ID3D11InputLayout* m_layout;
+  ID3D11InputLayout* layout_instanced;
   ID3D11Buffer* m_matrixBuffer;
   ID3D11SamplerState* m_sampleState;
 
   bool tessellate_;
+  const sz::MatrixBufferType *draw_transforms_;
+  static const XMFLOAT4X4 *light_transforms_;
   
  // ID3D11Buffer* m_matrixBuffer;
   //ID3D11SamplerState* m_sampleState;
@@ -1,5 +1,6 @@
 // texture shader.cpp
 #include "colourshader.h"
+#include "state_cache.h"
 
 
 ColourShader::ColourShader(ID3D11Device* device, HWND hwnd) : BaseShader(device, hwnd)
@@ -65,7 +66,8 @@ void ColourShader::SetShaderParameters(ID3D11DeviceContext* deviceContext, const
   tproj = XMMatrixTranspose(projectionMatrix);
 
   // Lock the constant buffer so it can be written to.
-  result = deviceContext->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+  result = sz::StateCache::Inst()->Map(m_matrixBuffer, 0,
+    D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
 
   // Get a pointer to the data in the constant buffer.
   dataPtr = (MatrixBufferType*)mappedResource.pData;
@@ -76,13 +78,14 @@ void ColourShader::SetShaderParameters(ID3D11DeviceContext* deviceContext, const
   dataPtr->projection = tproj;
 
   // Unlock the constant buffer.
-  deviceContext->Unmap(m_matrixBuffer, 0);
+  sz::StateCache::Inst()->Unmap(m_matrixBuffer, 0);
 
   // Set the position of the constant buffer in the vertex shader.
   bufferNumber = 0;
 
   // Now set the constant buffer in the vertex shader with the updated values.
-  deviceContext->VSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
+  sz::StateCache::Inst()->VSSetConstantBuffers(bufferNumber, 1,
+    &m_matrixBuffer);
 }
 
 void ColourShader::Render(ID3D11DeviceContext* deviceContext,
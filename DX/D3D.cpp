@@ -1,9 +1,12 @@
 // D3D.cpp
 // Direct3D setup
 #include "d3d.h"
+#include "state_cache.h"
+#include "d3d11_backend.h"
 
 D3D::D3D(int screenWidth, int screenHeight, bool vsync, HWND hwnd, bool fullscreen, float screenDepth, float screenNear) :
-    wireframe_enabled_(false)
+    wireframe_enabled_(false),
+    backend_(nullptr)
 {
   IDXGIFactory* factory;
   IDXGIAdapter* adapter;
@@ -142,6 +145,10 @@ D3D::D3D(int screenWidth, int screenHeight, bool vsync, HWND hwnd, bool fullscre
 
   // Create the swap chain, Direct3D device, and Direct3D device context.
   D3D11CreateDeviceAndSwapChain(NULL, D3D_DRIVER_TYPE_HARDWARE, NULL, D3D11_CREATE_DEVICE_DEBUG, &featureLevel, 1, D3D11_SDK_VERSION, &swapChainDesc, &m_swapChain, &m_device, NULL, &m_deviceContext);
+
+  // Send the frame's commands to the device context
+  backend_ = new sz::D3D11Backend(m_deviceContext);
+  sz::StateCache::Inst()->set_backend(backend_);
   
   // Get the pointer to the back buffer.
   m_swapChain->GetBuffer(0, __uuidof(ID3D11Texture2D), (LPVOID*)&backBufferPtr);
@@ -200,7 +207,7 @@ D3D::D3D(int screenWidth, int screenHeight, bool vsync, HWND hwnd, bool fullscre
   m_device->CreateDepthStencilState(&depthStencilDesc, &m_depthStencilState);
   
   // Set the depth stencil state.
-  m_deviceContext->OMSetDepthStencilState(m_depthStencilState, 1);
+  sz::StateCache::Inst()->OMSetDepthStencilState(m_depthStencilState, 1);
 
   // Initialize the depth stencil view.
   ZeroMemory(&depthStencilViewDesc, sizeof(depthStencilViewDesc));
@@ -214,7 +221,8 @@ D3D::D3D(int screenWidth, int screenHeight, bool vsync, HWND hwnd, bool fullscre
   m_device->CreateDepthStencilView(m_depthStencilBuffer, &depthStencilViewDesc, &m_depthStencilView);
   
   // Bind the render target view and depth stencil buffer to the output render pipeline.
-  m_deviceContext->OMSetRenderTargets(1, &m_renderTargetView, m_depthStencilView);
+  sz::StateCache::Inst()->OMSetRenderTargets(1, &m_renderTargetView,
+    m_depthStencilView);
 
   // Setup the raster description which will determine how and what polygons will be drawn.
   rasterDesc.AntialiasedLineEnable = false;
@@ -229,14 +237,16 @@ D3D::D3D(int screenWidth, int screenHeight, bool vsync, HWND hwnd, bool fullscre
   rasterDesc.SlopeScaledDepthBias = 0.0f;
 
   // Create the rasterizer state from the description we just filled out.
-  m_device->CreateRasterizerState(&rasterDesc, &m_rasterState);
+  m_rasterState = sz::StateCache::Inst()->GetRasterizerState(m_device,
+    rasterDesc);
   
   // Now set the rasterizer state.
-  m_deviceContext->RSSetState(m_rasterState);
+  sz::StateCache::Inst()->RSSetState(m_rasterState);
 
   //create raster state with wireframe enabled
   rasterDesc.FillMode = D3D11_FILL_WIREFRAME;
-  m_device->CreateRasterizerState(&rasterDesc, &m_rasterStateWF);
+  m_rasterStateWF = sz::StateCache::Inst()->GetRasterizerState(m_device,
+    rasterDesc);
 
   // Setup the viewport for rendering.
   viewport.Width = (float)screenWidth;
@@ -247,7 +257,7 @@ D3D::D3D(int screenWidth, int screenHeight, bool vsync, HWND hwnd, bool fullscre
   viewport.TopLeftY = 0.0f;
 
   // Create the viewport.
-  m_deviceContext->RSSetViewports(1, &viewport);
+  sz::StateCache::Inst()->RSSetViewports(1, &viewport);
 
   // Setup the projection matrix.
   fieldOfView = (float)XM_PI / 4.0f;
@@ -309,13 +319,15 @@ D3D::D3D(int screenWidth, int screenHeight, bool vsync, HWND hwnd, bool fullscre
   //blendStateDescription.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
   
   // Create the blend state using the description.
-  m_device->CreateBlendState(&blendStateDescription, &m_alphaEnableBlendingState);
+  m_alphaEnableBlendingState = sz::StateCache::Inst()->GetBlendState(
+    m_device, blendStateDescription);
   
   // Modify the description to create an alpha disabled blend state description.
   blendStateDescription.RenderTarget[0].BlendEnable = FALSE;
 
   // Create the second blend state using the description.
-  m_device->CreateBlendState(&blendStateDescription, &m_alphaDisableBlendingState);
+  m_alphaDisableBlendingState = sz::StateCache::Inst()->GetBlendState(
+    m_device, blendStateDescription);
 }
 
 D3D::~D3D()
@@ -374,6 +386,10 @@ D3D::~D3D()
     m_renderTargetView = 0;
   }
 
+  // Release the backend, which uses the device context
+  sz::StateCache::Inst()->set_backend(nullptr);
+  DeleteNull(backend_);
+
   if (m_deviceContext)
   {
     m_deviceContext->Release();
@@ -405,10 +421,11 @@ void D3D::BeginScene(float red, float green, float blue, float alpha)
   color[3] = alpha;
 
   // Clear the back buffer.
-  m_deviceContext->ClearRenderTargetView(m_renderTargetView, color);
+  sz::StateCache::Inst()->ClearRenderTargetView(m_renderTargetView, color);
 
   // Clear the depth buffer.
-  m_deviceContext->ClearDepthStencilView(m_depthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+  sz::StateCache::Inst()->ClearDepthStencilView(m_depthStencilView,
+    D3D11_CLEAR_DEPTH, 1.0f, 0);
 
   return;
 }
@@ -475,14 +492,15 @@ void D3D::GetVideoCardInfo(char* cardName, int& memory)
 
 void D3D::TurnZBufferOn()
 {
-  m_deviceContext->OMSetDepthStencilState(m_depthStencilState, 1);
+  sz::StateCache::Inst()->OMSetDepthStencilState(m_depthStencilState, 1);
   return;
 }
 
 
 void D3D::TurnZBufferOff()
 {
-  m_deviceContext->OMSetDepthStencilState(m_depthDisabledStencilState, 1);
+  sz::StateCache::Inst()->OMSetDepthStencilState(m_depthDisabledStencilState,
+    1);
   return;
 }
 
@@ -499,7 +517,8 @@ void D3D::TurnOnAlphaBlending()
   blendFactor[3] = 0.0f;
 
   // Turn on the alpha blending.
-  m_deviceContext->OMSetBlendState(m_alphaEnableBlendingState, blendFactor, 0xffffffff);
+  sz::StateCache::Inst()->OMSetBlendState(m_alphaEnableBlendingState,
+    blendFactor, 0xffffffff);
 
   return;
 }
@@ -517,7 +536,8 @@ void D3D::TurnOffAlphaBlending()
   blendFactor[3] = 0.0f;
 
   // Turn off the alpha blending.
-  m_deviceContext->OMSetBlendState(m_alphaDisableBlendingState, blendFactor, 0xffffffff);
+  sz::StateCache::Inst()->OMSetBlendState(m_alphaDisableBlendingState,
+    blendFactor, 0xffffffff);
 
   return;
 }
@@ -525,7 +545,8 @@ void D3D::TurnOffAlphaBlending()
 void D3D::SetBackBufferRenderTarget()
 {
   // Bind the render target view and depth stencil buffer to the output render pipeline.
-  m_deviceContext->OMSetRenderTargets(1, &m_renderTargetView, m_depthStencilView);
+  sz::StateCache::Inst()->OMSetRenderTargets(1, &m_renderTargetView,
+    m_depthStencilView);
 
   return;
 }
@@ -534,22 +555,22 @@ void D3D::SetBackBufferRenderTarget()
 void D3D::ResetViewport()
 {
   // Set the viewport.
-  m_deviceContext->RSSetViewports(1, &viewport);
+  sz::StateCache::Inst()->RSSetViewports(1, &viewport);
 
   return;
 }
 void D3D::TurnOnWireframe()
 {
   // Now set the rasterizer state.
-  m_deviceContext->RSSetState(m_rasterStateWF);
+  sz::StateCache::Inst()->RSSetState(m_rasterStateWF);
 }
 
 void D3D::ToggleWireFrame() {
   if (wireframe_enabled_) {
-    m_deviceContext->RSSetState(m_rasterState);
+    sz::StateCache::Inst()->RSSetState(m_rasterState);
   }
   else {
-    m_deviceContext->RSSetState(m_rasterStateWF);
+    sz::StateCache::Inst()->RSSetState(m_rasterStateWF);
   }
 
   wireframe_enabled_ = !wireframe_enabled_;
@@ -557,14 +578,14 @@ void D3D::ToggleWireFrame() {
 
 void D3D::TurnOffWireframe() {
   // Now set the rasterizer state.
-  m_deviceContext->RSSetState(m_rasterState);
+  sz::StateCache::Inst()->RSSetState(m_rasterState);
 }
 
 void D3D::SetDefaultRasterizerState() {
   if (wireframe_enabled_) {
-    m_deviceContext->RSSetState(m_rasterStateWF);
+    sz::StateCache::Inst()->RSSetState(m_rasterStateWF);
   }
   else {
-    m_deviceContext->RSSetState(m_rasterState);
+    sz::StateCache::Inst()->RSSetState(m_rasterState);
   }
 }
\ No newline at end of file
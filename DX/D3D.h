@@ -10,6 +10,10 @@
 
 using namespace DirectX;
 
+namespace sz {
+  class D3D11Backend;
+}
+
 class D3D
 {
 public:
@@ -57,6 +61,7 @@ public:
 private:
   bool m_vsync_enabled;
   bool wireframe_enabled_;
+  sz::D3D11Backend *backend_;
   int m_videoCardMemory;
   char m_videoCardDescription[128];
   IDXGISwapChain* m_swapChain;
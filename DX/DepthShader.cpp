@@ -1,12 +1,16 @@
 // depth shader.cpp
 #include "depthshader.h"
+#include "state_cache.h"
 #include "buffer_resource_manager.h"
 #include "Material.h"
 #include "RenderTexture.h"
+#include <cstring>
 
 DepthShader::DepthShader(ID3D11Device* device, HWND hwnd,
-    sz::ConstBufManager &buf_man) : BaseShader(device, hwnd) {
-  InitShader(buf_man, L"../shaders/depth_vs.hlsl", L"../shaders/depth_ps.hlsl");
+    sz::ConstBufManager &buf_man) : BaseShader(device, hwnd),
+    clear_vs_(nullptr),
+    clear_depth_state_(nullptr) {
+  InitShader(buf_man, L"../shaders/depth_vs.hlsl");
 }
 
 
@@ -18,6 +22,15 @@ DepthShader::~DepthShader() {
   //  m_matrixBuffer = 0;
   //}
 
+  if (clear_depth_state_ != nullptr) {
+    clear_depth_state_->Release();
+    clear_depth_state_ = nullptr;
+  }
+  if (clear_vs_ != nullptr) {
+    clear_vs_->Release();
+    clear_vs_ = nullptr;
+  }
+
   // Release the layout.
   if (m_layout)
   {
@@ -30,8 +43,8 @@ DepthShader::~DepthShader() {
 }
 
 
-void DepthShader::InitShader(sz::ConstBufManager &buf_man, WCHAR* vsFilename,
-  WCHAR* psFilename) {
+void DepthShader::InitShader(sz::ConstBufManager &buf_man,
+  WCHAR* vsFilename) {
   D3D11_BUFFER_DESC matrixBufferDesc;
   D3D11_INPUT_ELEMENT_DESC polygon_layout[1];
 
@@ -45,9 +58,9 @@ void DepthShader::InitShader(sz::ConstBufManager &buf_man, WCHAR* vsFilename,
   polygon_layout[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
   polygon_layout[0].InstanceDataStepRate = 0;
 
-  // Load (+ compile) shader files
+  // Load (+ compile) shader files; shadow maps are depth only targets, so
+  // no pixel shader runs
   loadVertexShader(polygon_layout, 1, vsFilename);
-  loadPixelShader(psFilename);
 
   // Setup the description of the dynamic matrix constant buffer that is in the vertex shader.
   matrixBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -62,6 +75,15 @@ void DepthShader::InitShader(sz::ConstBufManager &buf_man, WCHAR* vsFilename,
     matrixBufferDesc, m_device);
   assert(m_matrixBuffer != nullptr);
 
+  // The clear reads no vertices, and passes the depth test everywhere
+  loadVertexShader(L"../shaders/depth_clear_vs.hlsl", &clear_vs_);
+  D3D11_DEPTH_STENCIL_DESC clear_desc;
+  ZeroMemory(&clear_desc, sizeof(clear_desc));
+  clear_desc.DepthEnable = true;
+  clear_desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+  clear_desc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+  clear_desc.StencilEnable = false;
+  m_device->CreateDepthStencilState(&clear_desc, &clear_depth_state_);
 }
 
 
@@ -70,34 +92,28 @@ void DepthShader::SetShaderParameters(ID3D11DeviceContext* deviceContext,
     const sz::Material &mat) {
   HRESULT result;
   D3D11_MAPPED_SUBRESOURCE mapped_resource;
-  sz::MatrixBufferType* data_ptr;
   unsigned int bufferNumber;
-  XMMATRIX tworld, tview, tproj;
-
-  // Transpose the matrices to prepare them for the shader.
-  tworld = XMMatrixTranspose(world);
-  tview = XMMatrixTranspose(view);
-  tproj = XMMatrixTranspose(projection);
-
-  // Lock the constant buffer so it can be written to.
-  result = deviceContext->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-
-  // Get a pointer to the data in the constant buffer.
-  data_ptr = (sz::MatrixBufferType*)mapped_resource.pData;
-
-  // Copy the matrices into the constant buffer.
-  data_ptr->world = tworld;// worldMatrix;
-  data_ptr->view = tview;
-  data_ptr->projection = tproj;
 
-  // Unlock the constant buffer.
-  deviceContext->Unmap(m_matrixBuffer, 0);
+  // Write the matrices, or the entry of the draw in its transform batch
+  WriteMatrixConstants(m_matrixBuffer, world, view, projection);
 
   // Set the position of the constant buffer in the vertex shader.
   bufferNumber = 0;
 
   // Now set the constant buffer in the vertex shader with the updated values.
-  deviceContext->VSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
+  sz::StateCache::Inst()->VSSetConstantBuffers(bufferNumber, 1,
+    &m_matrixBuffer);
+}
+
+void DepthShader::SetDrawTransforms(ID3D11DeviceContext* deviceContext,
+  const sz::MatrixBufferType &transforms) {
+  D3D11_MAPPED_SUBRESOURCE mapped_resource;
+  sz::StateCache::Inst()->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0,
+    &mapped_resource);
+  memcpy(mapped_resource.pData, &transforms, sizeof(transforms));
+  sz::StateCache::Inst()->Unmap(m_matrixBuffer, 0);
+
+  sz::StateCache::Inst()->VSSetConstantBuffers(0, 1, &m_matrixBuffer);
 }
 
 void DepthShader::Render(ID3D11DeviceContext* deviceContext,
@@ -108,5 +124,20 @@ void DepthShader::Render(ID3D11DeviceContext* deviceContext,
   BaseShader::Render(deviceContext, index_count, index_start, base_vertex);
 }
 
+void DepthShader::ClearViewport(ID3D11DeviceContext* deviceContext) {
+  sz::StateCache::Inst()->OMSetDepthStencilState(clear_depth_state_, 1);
+  sz::StateCache::Inst()->IASetInputLayout(nullptr);
+  sz::StateCache::Inst()->IASetPrimitiveTopology(
+    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+  sz::StateCache::Inst()->VSSetShader(clear_vs_);
+  sz::StateCache::Inst()->HSSetShader(nullptr);
+  sz::StateCache::Inst()->DSSetShader(nullptr);
+  sz::StateCache::Inst()->GSSetShader(nullptr);
+  sz::StateCache::Inst()->PSSetShader(nullptr);
+
+  // One triangle over the whole viewport
+  sz::StateCache::Inst()->Draw(3, 0);
+}
+
 
 
@@ -26,16 +26,30 @@ public:
     const XMMATRIX &world, const XMMATRIX &view, const XMMATRIX &projection,
     const sz::Material &mat);
 
+  // Write the matrices of a draw from its entry of a TransformBatch, and
+  // bind them. Unlike set_draw_transforms, the shader is left as it was, so
+  // that lists recorded on other threads may use it at the same time.
+  void SetDrawTransforms(ID3D11DeviceContext* deviceContext,
+    const sz::MatrixBufferType &transforms);
+
   void Render(ID3D11DeviceContext* deviceContext,
     size_t index_count,
     size_t index_start = 0,
     size_t base_vertex = 0);
 
+  // Clear the depth of the viewport to the far plane, by drawing over it;
+  // clears of the depth target would take all of it. Leaves the depth test
+  // off, and the shaders of the clear bound.
+  void ClearViewport(ID3D11DeviceContext* deviceContext);
+
 private:
-  void InitShader(sz::ConstBufManager &buf_man, WCHAR*, WCHAR*);
+  void InitShader(sz::ConstBufManager &buf_man, WCHAR*);
 
 private:
   ID3D11Buffer* m_matrixBuffer;
+  // Draw at the far plane over the viewport, whatever the depth there
+  ID3D11VertexShader* clear_vs_;
+  ID3D11DepthStencilState* clear_depth_state_;
 
 }; // class DepthShader
 
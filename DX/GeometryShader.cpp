@@ -1,5 +1,6 @@
 // geometry shader.cpp
 #include "geometryshader.h"
+#include "state_cache.h"
 #include "buffer_types.h"
 #include "buffer_resource_manager.h"
 #include "Material.h"
@@ -9,6 +10,7 @@ GeometryBoxShader::GeometryBoxShader(ID3D11Device* device, HWND hwnd,
   sz::ConstBufManager &buf_man) : BaseShader(device, hwnd)
 {
   InitShader(L"../shaders/geometrybox_vs.hlsl",
+    L"../shaders/geometrybox_instanced_vs.hlsl",
     L"../shaders/geometrybox_gs.hlsl", L"../shaders/geometrybox_ps.hlsl",
     buf_man);
 }
@@ -26,11 +28,12 @@ GeometryBoxShader::~GeometryBoxShader() {
   BaseShader::~BaseShader();
 }
 
-void GeometryBoxShader::InitShader(WCHAR* vsFilename, WCHAR* gsFilename,
-    WCHAR* psFilename,
+void GeometryBoxShader::InitShader(WCHAR* vsFilename,
+    WCHAR* instanced_vs_filename, WCHAR* gsFilename, WCHAR* psFilename,
     sz::ConstBufManager &buf_man) {
   D3D11_BUFFER_DESC matrix_buffer_desc;
   D3D11_INPUT_ELEMENT_DESC polygon_layout[1];
+  D3D11_INPUT_ELEMENT_DESC instanced_layout[6];
 
   // Create the vertex input layout description.
   // This setup needs to match the VertexType stucture in the MeshClass and in the shader.
@@ -42,8 +45,23 @@ void GeometryBoxShader::InitShader(WCHAR* vsFilename, WCHAR* gsFilename,
   polygon_layout[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
   polygon_layout[0].InstanceDataStepRate = 0;
 
+  // The instanced variant reads the rows of the world matrix and the tint
+  // of each box from the second buffer, laid out as sz::InstanceType
+  instanced_layout[0] = polygon_layout[0];
+  for (UINT i = 0; i < 5; ++i) {
+    D3D11_INPUT_ELEMENT_DESC &element = instanced_layout[i + 1];
+    element.SemanticName = i < 4 ? "INSTANCE_WORLD" : "INSTANCE_PARAMS";
+    element.SemanticIndex = i < 4 ? i : 0;
+    element.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    element.InputSlot = 1;
+    element.AlignedByteOffset = i * 16;
+    element.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
+    element.InstanceDataStepRate = 1;
+  }
+
   // Load (+ compile) shader files
   loadVertexShader(polygon_layout, 1, vsFilename);
+  loadInstancedVertexShader(instanced_layout, 6, instanced_vs_filename);
   loadGeometryShader(gsFilename);
   loadPixelShader(psFilename);
 
@@ -77,7 +95,8 @@ void GeometryBoxShader::SetShaderParameters(ID3D11DeviceContext* deviceContext,
   tproj = DirectX::XMMatrixTranspose(projectionMatrix);
 
   // Lock the constant buffer so it can be written to.
-  result = deviceContext->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+  result = sz::StateCache::Inst()->Map(m_matrixBuffer, 0,
+    D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
 
   // Get a pointer to the data in the constant buffer.
   dataPtr = (sz::MatrixBufferType*)mappedResource.pData;
@@ -88,13 +107,18 @@ void GeometryBoxShader::SetShaderParameters(ID3D11DeviceContext* deviceContext,
   dataPtr->projection = tproj;
 
   // Unlock the constant buffer.
-  deviceContext->Unmap(m_matrixBuffer, 0);
+  sz::StateCache::Inst()->Unmap(m_matrixBuffer, 0);
 
   // Set the position of the constant buffer in the vertex shader.
   bufferNumber = 0;
 
-  // Now set the constant buffer in the vertex shader with the updated values.
-  deviceContext->GSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
+  // Now set the constant buffer in the vertex shader with the updated values;
+  // the geometry shader takes the world matrix from the vertex shader, and
+  // the view and projection from the buffer.
+  sz::StateCache::Inst()->VSSetConstantBuffers(bufferNumber, 1,
+    &m_matrixBuffer);
+  sz::StateCache::Inst()->GSSetConstantBuffers(bufferNumber, 1,
+    &m_matrixBuffer);
 
 }
 
@@ -27,8 +27,8 @@ public:
     size_t base_vertex);
 
 private:
-  void InitShader(WCHAR* vsFilename, WCHAR* gsFilename, WCHAR* psFilename,
-    sz::ConstBufManager &buf_man);
+  void InitShader(WCHAR* vsFilename, WCHAR* instanced_vs_filename,
+    WCHAR* gsFilename, WCHAR* psFilename, sz::ConstBufManager &buf_man);
 
 private:
   ID3D11Buffer* m_matrixBuffer;
@@ -16,6 +16,9 @@ Light::Light() :
   m_position(),
   m_viewMatrix(),
   m_projectionMatrix(),
+  m_fieldOfView((float)XM_PI / 2.0f),
+  m_screenNear(0.1f),
+  m_screenFar(1.f),
   m_lookAt(),
   m_attenuation(0.f, 0.f, 0.f),
   m_range(0.f),
@@ -79,6 +82,28 @@ void Light::GenerateProjectionMatrix(float screenNear, float screenFar)
   XMMATRIX proj = XMMatrixPerspectiveFovLH(fieldOfView,
     screenAspect, screenNear, screenFar);
   XMStoreFloat4x4A(&m_projectionMatrix, proj);
+
+  m_fieldOfView = fieldOfView;
+  m_screenNear = screenNear;
+  m_screenFar = screenFar;
+}
+
+XMMATRIX Light::GetInfluenceProjectionMatrix() const {
+  // Nothing is lit beyond the range
+  float far_plane = m_screenFar;
+  if (m_range > m_screenNear && m_range < far_plane) {
+    far_plane = m_range;
+  }
+
+  // Nor outside of the cone, when it is narrower than the projection
+  float field_of_view = m_fieldOfView;
+  if (spot_cutoff_ < static_cast<float>(M_PI) &&
+    2.f * spot_cutoff_ < field_of_view) {
+    field_of_view = 2.f * spot_cutoff_;
+  }
+
+  return XMMatrixPerspectiveFovLH(field_of_view, 1.f, m_screenNear,
+    far_plane);
 }
 
 void Light::SetAmbientColour(float red, float green, float blue, float alpha)
@@ -203,6 +228,11 @@ float Light::spot_exponent() const {
   return spot_exponent_;
 }
 
+bool Light::casts_shadows() const {
+  // Shaders only sample the shadow maps of point lights with a cone
+  return m_position.w == 0.f && spot_cutoff_ != static_cast<float>(M_PI);
+}
+
 
 
 void Light::set_active(bool v) {
@@ -54,6 +54,9 @@ public:
   XMVECTOR GetPosVector();
   XMMATRIX GetViewMatrix();
   XMMATRIX GetProjectionMatrix();
+  // Projection narrowed to where the light reaches: its range, and the cone
+  // of spotlights; used to cull what it lights
+  XMMATRIX GetInfluenceProjectionMatrix() const;
   const XMFLOAT3A &GetAttenuation() const;
   float GetRange();
 
@@ -61,6 +64,10 @@ public:
   float spot_cutoff() const;
   float spot_exponent() const;
 
+  // Whether shaders use the light's shadow map; only spotlights are
+  // shadowed
+  bool casts_shadows() const;
+
 protected:
   XMFLOAT4A m_ambientColour;
   XMFLOAT4A m_diffuseColour;
@@ -70,6 +77,10 @@ protected:
   XMFLOAT4A m_position;
   XMFLOAT4X4A m_viewMatrix;
   XMFLOAT4X4A m_projectionMatrix;
+  // Parameters of the projection matrix
+  float m_fieldOfView;
+  float m_screenNear;
+  float m_screenFar;
   XMFLOAT4A m_lookAt;
   XMFLOAT3A m_attenuation;
   float m_range;
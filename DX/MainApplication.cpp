@@ -11,11 +11,36 @@
 #include "gaussian_blur.h"
 #include "renderer.h"
 #include "forward_renderer.h"
+#include "state_cache.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <imgui.h>
 #include <imgui_impl_dx11.h>
 
+// Lights of the scene: the first kNumLights may have shadow maps, the others
+// are small coloured point lights spread over the floors of the model, off
+// until turned on in the debug tools
+const UInt32 kSceneLights = 256;
+// Texels of the side of the shadow atlas, which holds the maps of all the
+// lights; as much memory as four maps of 1024x1024
+const UInt32 kShadowAtlasSize = 2048;
+// Share textures whose files differ but which decode to the same pixels,
+// e.g. re-saved copies in the model's folder; costs a hash over the pixels
+// of each texture at load time
+const bool kDedupTexturePixels = true;
+// Cook the diffuse textures of the model into virtual textures at load time,
+// and stream in the pages the frame samples, instead of keeping all of them
+// on the GPU
+const bool kVirtualTexturing = true;
+// Name of the material of the boxes which mark the lights, hashed at compile
+// time
+static ABFW_CONSTEXPR_VAR UInt32 kLightMeshesMaterialCrc =
+  abfw::CRC::ConstICRC("light_meshes_material");
+const float kSceneLightColours[6][3] = {
+  { 1.f, 0.4f, 0.3f }, { 1.f, 0.8f, 0.3f }, { 0.4f, 1.f, 0.3f },
+  { 0.3f, 0.9f, 1.f }, { 0.4f, 0.4f, 1.f }, { 1.f, 0.4f, 0.9f }
+};
+
 MainApplication::MainApplication(HINSTANCE hinstance, HWND hwnd, int screenWidth, int screenHeight,
   Input *in) :
   BaseApplication(hinstance, hwnd, screenWidth, screenHeight, in),
@@ -27,7 +52,7 @@ MainApplication::MainApplication(HINSTANCE hinstance, HWND hwnd, int screenWidth
   lights_pt_meshes_(),
   geometrybox_shader_(nullptr),
   lights_pt_meshes_materials_(),
-  lights_(kNumLights),
+  lights_(kSceneLights, SCREEN_NEAR, SCREEN_DEPTH),
   buf_manager_(nullptr),
   sha_manager_(nullptr),
   waves_shader_(nullptr),
@@ -39,9 +64,12 @@ MainApplication::MainApplication(HINSTANCE hinstance, HWND hwnd, int screenWidth
   prev_time_(0.f),
   show_debug_imgui_(true),
   use_wireframe_mode_(false),
-  prev_use_wireframe_mode_(false) {
+  prev_use_wireframe_mode_(false),
+  use_demo_lights_(false),
+  prev_use_demo_lights_(false) {
   // Create Mesh object
   m_Mesh = new SphereMesh(m_Direct3D->GetDevice(), L"../res/DefaultDiffuse.png");
+  Texture::Inst()->set_dedup_pixels(kDedupTexturePixels);
   Texture::Inst()->LoadTexture(m_Direct3D->GetDevice(),
     m_Direct3D->GetDeviceContext(), "../res/DefaultDiffuse.png");
   Texture::Inst()->LoadTexture(m_Direct3D->GetDevice(),
@@ -73,66 +101,83 @@ MainApplication::MainApplication(HINSTANCE hinstance, HWND hwnd, int screenWidth
   // No need to check for duplicates, geometrybox shaders are only created here
   sha_manager_->AddShader("geometrybox_shader", geometrybox_shader_);
   sz::Material lights_pt_meshes_material;
-  lights_pt_meshes_material.shader_name = "geometrybox_shader";
-  lights_pt_meshes_material.name = "light_meshes_material";
-  lights_pt_meshes_material.name_crc = abfw::CRC::GetICRC("light_meshes_material");
+  lights_pt_meshes_material.info().shader_name = "geometrybox_shader";
+  lights_pt_meshes_material.info().name = "light_meshes_material";
+  lights_pt_meshes_material.name_crc = kLightMeshesMaterialCrc;
+  lights_pt_meshes_material.ResolveIds();
+  // Geometry boxes only mark where the lights are
+  lights_pt_meshes_material.flags |= sz::kMaterialNoShadowCast;
   lights_pt_meshes_materials_.push_back(lights_pt_meshes_material);
 
   // Setup lights
-  for (size_t i = 0; i < kNumLights; i++) {
+  for (UInt32 i = 0; i < lights_.count(); i++) {
     //lights_.push_back(Light());
     //lights_[i].SetPosition(0.f, 7.f, 0.f, 0.f);
     // Set the light values
-    lights_[i].SetDiffuseColour(1.f, 1.f, 1.f, 1.f);
-    lights_[i].SetSpecularColour(1.f, 1.f, 1.f, 1.f);
-    lights_[i].SetSpecularPower(4.f);
-    lights_[i].SetAttenuation(0.95f, 0.f, 0.f);
-    lights_[i].SetRange(300.f);
-    lights_[i].set_active(false);
-    lights_[i].SetDirection(1.f, -0.3f, -0.1f);
+    lights_.SetDiffuseColour(i, 1.f, 1.f, 1.f, 1.f);
+    lights_.SetSpecularColour(i, 1.f, 1.f, 1.f, 1.f);
+    lights_.SetSpecularPower(i, 4.f);
+    lights_.SetAttenuation(i, 0.95f, 0.f, 0.f);
+    lights_.SetRange(i, 300.f);
+    lights_.set_active(i, false);
+    lights_.SetDirection(i, 1.f, -0.3f, -0.1f);
     // Set ambient for one light only 
     if (i == 0) {
-      lights_[i].SetAmbientColour(0.1f, 0.1f, 0.1f, 1.f);
-      lights_[i].SetPosition(-60.f, 60.f, 0.f, 0.f);
-      lights_[i].SetDiffuseColour(1.f, 1.f, 1.f, 1.f);
-      lights_[i].SetDirection(1.f, 0.3f, -0.6f);
-      lights_[i].set_spot_cutoff(static_cast<float>(M_PI_4 * 1.3));
-      lights_[i].set_spot_exponent(2.f);
-      lights_[i].set_active(true);
+      lights_.SetAmbientColour(i, 0.1f, 0.1f, 0.1f, 1.f);
+      lights_.SetPosition(i, -60.f, 60.f, 0.f, 0.f);
+      lights_.SetDiffuseColour(i, 1.f, 1.f, 1.f, 1.f);
+      lights_.SetDirection(i, 1.f, 0.3f, -0.6f);
+      lights_.set_spot_cutoff(i, static_cast<float>(M_PI_4 * 1.3));
+      lights_.set_spot_exponent(i, 2.f);
+      lights_.set_active(i, true);
     }
     if (i == 1) {
-      lights_[i].SetAmbientColour(0.1f, 0.1f, 0.1f, 1.f);
-      lights_[i].SetPosition(-60.f, 60.f, 10.f, 0.f);
-      lights_[i].SetDiffuseColour(1.f, 1.f, 1.f, 1.f);
-      lights_[i].SetDirection(1.f, 0.f, 0.6f);
-      lights_[i].set_spot_cutoff(static_cast<float>(M_PI_4 * 1.3));
-      lights_[i].set_spot_exponent(2.f);
-      lights_[i].set_active(true);
+      lights_.SetAmbientColour(i, 0.1f, 0.1f, 0.1f, 1.f);
+      lights_.SetPosition(i, -60.f, 60.f, 10.f, 0.f);
+      lights_.SetDiffuseColour(i, 1.f, 1.f, 1.f, 1.f);
+      lights_.SetDirection(i, 1.f, 0.f, 0.6f);
+      lights_.set_spot_cutoff(i, static_cast<float>(M_PI_4 * 1.3));
+      lights_.set_spot_exponent(i, 2.f);
+      lights_.set_active(i, true);
     }
     if (i == 2) {
-      lights_[i].SetAmbientColour(0.1f, 0.1f, 0.1f, 1.f);
-      lights_[i].SetPosition(40.f, 50.f, 0.f, 0.f);
-      lights_[i].SetDiffuseColour(1.f, 1.f, 1.f, 1.f);
-      lights_[i].set_active(true);
-      lights_[i].SetAttenuation(0.5f, 0.03f, 0.f);
-      lights_[i].SetDirection(-1.f, -0.5f, 0.0f);
-      lights_[i].set_spot_cutoff(static_cast<float>(M_PI_4 * 1.2));
-      lights_[i].set_spot_exponent(2.f);
+      lights_.SetAmbientColour(i, 0.1f, 0.1f, 0.1f, 1.f);
+      lights_.SetPosition(i, 40.f, 50.f, 0.f, 0.f);
+      lights_.SetDiffuseColour(i, 1.f, 1.f, 1.f, 1.f);
+      lights_.set_active(i, true);
+      lights_.SetAttenuation(i, 0.5f, 0.03f, 0.f);
+      lights_.SetDirection(i, -1.f, -0.5f, 0.0f);
+      lights_.set_spot_cutoff(i, static_cast<float>(M_PI_4 * 1.2));
+      lights_.set_spot_exponent(i, 2.f);
     }
     if (i == 3) {
-      lights_[i].SetAmbientColour(0.5f, 0.5f, 0.5f, 1.f);
-      lights_[i].SetPosition(0.f, 0.f, 0.f, 0.f);
-      lights_[i].SetDiffuseColour(0.5f, 0.5f, 0.5f, 1.f);
-      lights_[i].set_active(true);
-      lights_[i].SetAttenuation(0.4f, 0.155f, 0.f);
+      lights_.SetAmbientColour(i, 0.5f, 0.5f, 0.5f, 1.f);
+      lights_.SetPosition(i, 0.f, 0.f, 0.f, 0.f);
+      lights_.SetDiffuseColour(i, 0.5f, 0.5f, 0.5f, 1.f);
+      lights_.set_active(i, true);
+      lights_.SetAttenuation(i, 0.4f, 0.155f, 0.f);
+    }
+    if (i >= kNumLights) {
+      // Rows along the nave, on the ground floor and the gallery
+      size_t n = i - kNumLights;
+      float x = -120.f + 16.f * static_cast<float>(n % 16);
+      float z = -40.f + 11.5f * static_cast<float>((n / 16) % 8);
+      float y = n < 128 ? 5.f : 45.f;
+      const float *colour = kSceneLightColours[n % 6];
+      lights_.SetAmbientColour(i, 0.f, 0.f, 0.f, 1.f);
+      lights_.SetDiffuseColour(i, colour[0], colour[1], colour[2], 1.f);
+      lights_.SetSpecularColour(i, colour[0], colour[1], colour[2], 1.f);
+      lights_.SetPosition(i, x, y, z, 0.f);
+      lights_.SetAttenuation(i, 1.f, 0.f, 0.01f);
+      lights_.SetRange(i, 20.f);
     }
 
     // Create the lights point meshes
     lights_pt_meshes_.push_back(new PointMesh(m_Direct3D->GetDevice()));
     lights_pt_meshes_[i]->set_transform(DirectX::XMMatrixTranslation(
-      lights_[i].GetPosition3().x,
-      lights_[i].GetPosition3().y,
-      lights_[i].GetPosition3().z
+      lights_.position(i).x,
+      lights_.position(i).y,
+      lights_.position(i).z
       ));
     lights_pt_meshes_[i]->set_mat_id(0);
   }
@@ -151,9 +196,14 @@ MainApplication::MainApplication(HINSTANCE hinstance, HWND hwnd, int screenWidth
 
   renderer_ = new sz::ForwardRenderer(screenHeight, screenWidth,
     SCREEN_DEPTH, SCREEN_NEAR, m_Direct3D->GetDevice(),
-    hwnd, buf_manager_, sha_manager_, kNumLights, *m_Timer);
+    hwnd, buf_manager_, sha_manager_, kNumLights, kShadowAtlasSize,
+    *m_Timer);
   //renderer_->AddMeshesAndMaterials(model_->meshes_, model_->materials_);
   renderer_->AddModel(model_);
+  if (kVirtualTexturing) {
+    renderer_->UseVirtualTextures(m_Direct3D->GetDevice(),
+      m_Direct3D->GetDeviceContext());
+  }
   renderer_->AddMeshesAndMaterials(lights_pt_meshes_,
     lights_pt_meshes_materials_);
 
@@ -229,12 +279,32 @@ bool MainApplication::Frame() {
   ImGui::Begin("Debug Tools", &show_debug_imgui_);
   ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
     1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+  ImGui::Text("State binds: %u issued, %u filtered",
+    sz::StateCache::Inst()->frame_stats().issued,
+    sz::StateCache::Inst()->frame_stats().filtered);
+  {
+    // Of all the textures the models asked for since start
+    const TextureDedupStats &dedup = Texture::Inst()->dedup_stats();
+    ImGui::Text("Textures: %u resident, %u files and %u images shared, "
+      "%u KB saved",
+      static_cast<UInt32>(Texture::Inst()->resident_texture_count()),
+      dedup.file_duplicates, dedup.pixel_duplicates,
+      static_cast<UInt32>(dedup.bytes_saved / 1024));
+  }
   ImGui::Checkbox("Wireframe mode", &use_wireframe_mode_);
   if (use_wireframe_mode_ != prev_use_wireframe_mode_) {
     m_Direct3D->ToggleWireFrame();
 
     prev_use_wireframe_mode_ = use_wireframe_mode_;
   }
+  ImGui::Checkbox("Demo lights", &use_demo_lights_);
+  if (use_demo_lights_ != prev_use_demo_lights_) {
+    for (UInt32 i = kNumLights; i < kSceneLights; ++i) {
+      lights_.set_active(i, use_demo_lights_);
+    }
+
+    prev_use_demo_lights_ = use_demo_lights_;
+  }
   ImGui::SliderFloat("Tessellation factor", &renderer_->tessellation_value,
     1.f, 10.f);
   ImGui::SliderFloat("Tessellation distance", &renderer_->tessellation_distance,
@@ -243,15 +313,19 @@ bool MainApplication::Frame() {
   // Update camera
   m_Camera->Update();
 
-  // Update lights
-  for (size_t i = 0; i < lights_.size(); i++) {
-    lights_[i].GenerateProjectionMatrix(SCREEN_NEAR, SCREEN_DEPTH);
-    lights_[i].GenerateViewMatrixFromDirection();
-    lights_pt_meshes_[i]->set_transform(XMMatrixTranslation(
-      lights_[i].GetPosition3().x,
-      lights_[i].GetPosition3().y,
-      lights_[i].GetPosition3().z
-      ));
+  // Update lights; only those which moved have their matrices generated
+  // again, and their meshes moved
+  if (lights_.Update()) {
+    for (UInt32 i = 0; i < lights_.count(); i++) {
+      if ((lights_.changed(i) & sz::kLightDirtyView) == 0) {
+        continue;
+      }
+      lights_pt_meshes_[i]->set_transform(XMMatrixTranslation(
+        lights_.position(i).x,
+        lights_.position(i).y,
+        lights_.position(i).z
+        ));
+    }
   }
 
 
@@ -280,6 +354,8 @@ bool MainApplication::Frame() {
 }
 
 bool MainApplication::Render() {
+  sz::StateCache::Inst()->BeginFrame();
+
   renderer_->Render(m_Direct3D, m_Camera, &lights_);
   m_Direct3D->SetBackBufferRenderTarget();
 
@@ -299,6 +375,9 @@ bool MainApplication::Render() {
   ImGui::End();
   ImGui::Render();
 
+  // ImGui binds its own state behind the cache's back
+  sz::StateCache::Inst()->Invalidate();
+
   m_Direct3D->TurnZBufferOn();
   m_Direct3D->TurnOffAlphaBlending();
   m_Direct3D->SetDefaultRasterizerState();
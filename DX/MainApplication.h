@@ -8,7 +8,7 @@
 #include "SphereMesh.h"
 #include "CubeMesh.h"
 #include "LightShader.h"
-#include "Light.h"
+#include "light_system.h"
 #include <vector>
 #include "Model.h"
 #include "buffer_resource_manager.h"
@@ -56,7 +56,7 @@ private:
   std::vector<BaseMesh *> lights_pt_meshes_;
   GeometryBoxShader *geometrybox_shader_;
   std::vector<sz::Material> lights_pt_meshes_materials_;
-  std::vector<Light> lights_;
+  sz::LightSystem lights_;
   sz::ConstBufManager *buf_manager_;
   sz::ShaderManager *sha_manager_;
   WavesVertexDeformShader *waves_shader_;
@@ -76,6 +76,9 @@ private:
 
   bool use_wireframe_mode_;
   bool prev_use_wireframe_mode_;
+  // Point lights spread over the model, to load the clustered lighting
+  bool use_demo_lights_;
+  bool prev_use_demo_lights_;
 };
 
 #endif
\ No newline at end of file
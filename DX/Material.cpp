@@ -1,15 +1,90 @@
-
 #include "Material.h"
 
 namespace sz {
 
-  Material::Material(const std::string &mat_name):
-    name(mat_name),
+  MaterialInfo::MaterialInfo() :
     shininess(0.f),
     ior(0.f),
     dissolve(0.f),
-    illum(2) {
+    illum(2),
+    ambient_texname_crc(0),
+    diffuse_texname_crc(0),
+    specular_texname_crc(0),
+    specular_highlight_texname_crc(0),
+    bump_texname_crc(0),
+    displacement_texname_crc(0),
+    alpha_texname_crc(0) {
+    for (int c = 0; c < 3; ++c) {
+      ambient[c] = 0.f;
+      diffuse[c] = 0.f;
+      specular[c] = 0.f;
+      transmittance[c] = 0.f;
+      emission[c] = 0.f;
+    }
+  }
+
+  Material::Material() :
+    flags(0),
+    shader_id(kInvalidNameId),
+    name_crc(0),
+    table_index(kNoMaterialTableIndex),
+    info_(new MaterialInfo()) {
+  }
+
+  Material::Material(const std::string &mat_name):
+    flags(0),
+    shader_id(kInvalidNameId),
+    name_crc(0),
+    table_index(kNoMaterialTableIndex),
+    info_(new MaterialInfo()) {
+    info_->name = mat_name;
+  }
+
+  Material::Material(const Material &other) :
+    flags(other.flags),
+    shader_id(other.shader_id),
+    name_crc(other.name_crc),
+    table_index(other.table_index),
+    ambient_texture(other.ambient_texture),
+    diffuse_texture(other.diffuse_texture),
+    specular_texture(other.specular_texture),
+    specular_highlight_texture(other.specular_highlight_texture),
+    bump_texture(other.bump_texture),
+    displacement_texture(other.displacement_texture),
+    alpha_texture(other.alpha_texture),
+    info_(new MaterialInfo(*other.info_)) {
+  }
+
+  Material &Material::operator=(const Material &other) {
+    if (this != &other) {
+      flags = other.flags;
+      shader_id = other.shader_id;
+      name_crc = other.name_crc;
+      table_index = other.table_index;
+      ambient_texture = other.ambient_texture;
+      diffuse_texture = other.diffuse_texture;
+      specular_texture = other.specular_texture;
+      specular_highlight_texture = other.specular_highlight_texture;
+      bump_texture = other.bump_texture;
+      displacement_texture = other.displacement_texture;
+      alpha_texture = other.alpha_texture;
+      *info_ = *other.info_;
+    }
+
+    return *this;
+  }
+
+  void Material::ResolveIds() {
+    shader_id = info_->shader_name != "" ?
+      NameInterner::Inst()->Intern(info_->shader_name) : kInvalidNameId;
+
+    if (info_->alpha_texname != "") {
+      flags |= kMaterialAlphaMapped;
+    }
+    else {
+      flags &= ~kMaterialAlphaMapped;
+    }
   }
 
 
-} // namespace sz
\ No newline at end of file
+} // namespace sz
@@ -1,23 +1,43 @@
+//  Materials
+//  * A Material is the compact record read while rendering: flags, shader,
+//    textures and where its constants are in the MaterialTable
+//  * Names, paths and lighting properties live in a MaterialInfo which the
+//    Material points to; they are only read when loading, and the properties
+//    reach the GPU through the table, packed once
+
 #ifndef _MATERIAL_H
 #define _MATERIAL_H
 
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <fstream>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/serialization/string.hpp>
 #include <boost/serialization/array.hpp>
 #include "abertay_framework.h"
+#include "texture_handle.h"
+#include "name_interner.h"
 
 namespace sz {
 
-class Material {
-public:
+// Properties of a material which per-frame code tests
+enum MaterialFlags {
+  // The material has an alpha map and is rendered with blending
+  kMaterialAlphaMapped = 1 << 0,
+  // Meshes using the material are not rendered into shadow maps
+  kMaterialNoShadowCast = 1 << 1
+};
+
+// Index of a material which is not in the MaterialTable
+const UInt32 kNoMaterialTableIndex = 0xFFFFFFFF;
+
+// Data of a material which is only needed to load it
+struct MaterialInfo {
   // Name of material
   std::string name;
-  UInt32 name_crc;
 
   float ambient[3];
   float diffuse[3];
@@ -47,34 +67,79 @@ public:
 
   std::string shader_name;
 
+  MaterialInfo();
+};
+
+class Material {
+public:
+  // Resolved from the info by ResolveIds(); not serialised
+  UInt32 flags;
+  NameId shader_id;
+  // CRC of the name, which batches meshes by material
+  UInt32 name_crc;
+  // Entry of the material in the MaterialTable, or kNoMaterialTableIndex if
+  // its constants are written when it is drawn; not serialised
+  UInt32 table_index;
+
+  // Handles of the textures, resolved when they are loaded; not serialised
+  TextureHandle ambient_texture;
+  TextureHandle diffuse_texture;
+  TextureHandle specular_texture;
+  TextureHandle specular_highlight_texture;
+  TextureHandle bump_texture;
+  TextureHandle displacement_texture;
+  TextureHandle alpha_texture;
+
   // Default Ctor
-  Material() {};
+  Material();
   Material(const std::string &mat_name);
+  // Copies own their info
+  Material(const Material &other);
+  Material &operator=(const Material &other);
+
+  // Intern shader_name and derive the flags, so that per-frame code does not
+  // compare strings
+  void ResolveIds();
+
+  inline bool HasFlag(MaterialFlags flag) const {
+    return (flags & flag) != 0;
+  }
+
+  inline MaterialInfo &info() {
+    return *info_;
+  }
+  inline const MaterialInfo &info() const {
+    return *info_;
+  }
 
 private:
+  std::unique_ptr<MaterialInfo> info_;
+
   friend class boost::serialization::access;
 
-  // Allow serialisation
+  // Allow serialisation; the layout is that of the archives written before
+  // the info was split out
   template<class Archive>
   void serialize(Archive & ar, const unsigned int version) {
-    ar & name & name_crc;
-    ar & ambient & diffuse & specular & transmittance & emission;
-    ar & shininess & ior & dissolve & illum;
-    ar & ambient_texname &
-      diffuse_texname &
-      specular_texname &
-      specular_highlight_texname &
-      bump_texname &
-      displacement_texname &
-      alpha_texname;
-    ar &              // map_d
-      ambient_texname_crc &            // map_Ka
-      diffuse_texname_crc &            // map_Kd
-      specular_texname_crc &           // map_Ks
-      specular_highlight_texname_crc & // map_Ns
-      bump_texname_crc &               // map_bump, bump
-      displacement_texname_crc &       // disp
-      alpha_texname_crc;         // map_d
+    MaterialInfo &i = *info_;
+    ar & i.name & name_crc;
+    ar & i.ambient & i.diffuse & i.specular & i.transmittance & i.emission;
+    ar & i.shininess & i.ior & i.dissolve & i.illum;
+    ar & i.ambient_texname &
+      i.diffuse_texname &
+      i.specular_texname &
+      i.specular_highlight_texname &
+      i.bump_texname &
+      i.displacement_texname &
+      i.alpha_texname;
+    ar &
+      i.ambient_texname_crc &            // map_Ka
+      i.diffuse_texname_crc &            // map_Kd
+      i.specular_texname_crc &           // map_Ks
+      i.specular_highlight_texname_crc & // map_Ns
+      i.bump_texname_crc &               // map_bump, bump
+      i.displacement_texname_crc &       // disp
+      i.alpha_texname_crc;               // map_d
   }
 
 }; // class Material
@@ -82,4 +147,4 @@ private:
 } // namespace sz
 
 
-#endif
\ No newline at end of file
+#endif
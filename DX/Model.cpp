@@ -1,9 +1,11 @@
 // Model mesh and load
 // Loads a .obj and creates a mesh object from the data
 #include "model.h"
+#include "state_cache.h"
 #include <locale>
 #include <codecvt>
 #include <string>
+#include <iostream>
 #include "Texture.h"
 #include "LightShader.h"
 #include "normal_mapping_shader.h"
@@ -16,6 +18,7 @@
 #include "abertay_framework.h"
 #include "crc.h"
 #include "Material.h"
+#include "material_table.h"
 #include "shader_resource_manager.h"
 #include <omp.h>
 
@@ -37,6 +40,13 @@ void Model::Init(ID3D11Device* device, ID3D11DeviceContext *dev_context,
   // Load necessary shaders
   LoadShaders_(device, hwnd, buf_man, lights_num, shad_man);
 
+  // Pack the constants of the materials, which the shaders then bind
+  // instead of writing them on every draw
+  for (sz::Material &material : materials_) {
+    material.table_index =
+      sz::MaterialTable::Inst()->Add(device, material.info());
+  }
+
   AddMeshesAndMaterials(meshes_, materials_);
 }
 
@@ -86,74 +96,85 @@ void Model::LoadTextures_(ID3D11Device* device,
     std::string path_suffix = "../res/" + model_name_ + "/";
     std::string full_path;
     UInt32 full_path_crc = 0;
+    sz::MaterialInfo &info = materials_[i].info();
 
-    if (materials_[i].ambient_texname != "") {
+    if (info.ambient_texname != "") {
       // Check if the texture name uses // as parenthesis and if so, fix it
-      FindReplace(materials_[i].ambient_texname, "\\", "\/");
-      //FindReplace(materials_[i].ambient_texname, ".tga", ".png");
+      FindReplace(info.ambient_texname, "\\", "\/");
+      //FindReplace(info.ambient_texname, ".tga", ".png");
 
-      full_path = path_suffix + materials_[i].ambient_texname;
+      full_path = path_suffix + info.ambient_texname;
 
-      Texture::Inst()->LoadTexture(device, dev_context, full_path);
-      materials_[i].ambient_texname = full_path;
-      materials_[i].ambient_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      info.ambient_texname = full_path;
+      info.ambient_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      // Textures with identical content resolve to the same handle
+      materials_[i].ambient_texture =
+        Texture::Inst()->LoadTexture(device, dev_context, full_path);
     }
 
-    if (materials_[i].diffuse_texname != "") {
+    if (info.diffuse_texname != "") {
       // Check if the texture name uses // as parenthesis and if so, fix it
-      FindReplace(materials_[i].diffuse_texname, "\\", "\/");
-      //FindReplace(materials_[i].ambient_texname, ".tga", ".png");
+      FindReplace(info.diffuse_texname, "\\", "\/");
+      //FindReplace(info.ambient_texname, ".tga", ".png");
       
-      //full_path = converter.from_bytes(path_suffix + materials_[i].diffuse_texname);
-      full_path = path_suffix + materials_[i].diffuse_texname;
-
-      Texture::Inst()->LoadTexture(device, dev_context, full_path);
-      materials_[i].diffuse_texname = full_path;
-      materials_[i].diffuse_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      //full_path = converter.from_bytes(path_suffix + info.diffuse_texname);
+      full_path = path_suffix + info.diffuse_texname;
+
+      info.diffuse_texname = full_path;
+      info.diffuse_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      // Textures with identical content resolve to the same handle
+      materials_[i].diffuse_texture =
+        Texture::Inst()->LoadTexture(device, dev_context, full_path);
     }
 
-    if (materials_[i].specular_texname != "") {
+    if (info.specular_texname != "") {
       // Check if the texture name uses // as parenthesis and if so, fix it
-      FindReplace(materials_[i].specular_texname, "\\", "\/");
-      //FindReplace(materials_[i].ambient_texname, ".tga", ".png");
+      FindReplace(info.specular_texname, "\\", "\/");
+      //FindReplace(info.ambient_texname, ".tga", ".png");
       
-      //full_path = converter.from_bytes(path_suffix + materials_[i].specular_texname);
-      full_path = path_suffix + materials_[i].specular_texname;
-
-      Texture::Inst()->LoadTexture(device, dev_context, full_path);
-      materials_[i].specular_texname = full_path;
-      materials_[i].specular_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      //full_path = converter.from_bytes(path_suffix + info.specular_texname);
+      full_path = path_suffix + info.specular_texname;
+
+      info.specular_texname = full_path;
+      info.specular_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      // Textures with identical content resolve to the same handle
+      materials_[i].specular_texture =
+        Texture::Inst()->LoadTexture(device, dev_context, full_path);
     }
 
 
     std::string specular_highlight_texname; // map_Ns
 
-    if (materials_[i].bump_texname != "") {
+    if (info.bump_texname != "") {
       // Check if the texture name uses // as parenthesis and if so, fix it
-      FindReplace(materials_[i].bump_texname, "\\", "\/");
-      //FindReplace(materials_[i].ambient_texname, ".tga", ".png");
+      FindReplace(info.bump_texname, "\\", "\/");
+      //FindReplace(info.ambient_texname, ".tga", ".png");
      
-      //full_path = converter.from_bytes(path_suffix + materials_[i].bump_texname);
-      full_path = path_suffix + materials_[i].bump_texname;
-
-      Texture::Inst()->LoadTexture(device, dev_context, full_path);
-      materials_[i].bump_texname = full_path;
-      materials_[i].bump_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      //full_path = converter.from_bytes(path_suffix + info.bump_texname);
+      full_path = path_suffix + info.bump_texname;
+
+      info.bump_texname = full_path;
+      info.bump_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      // Textures with identical content resolve to the same handle
+      materials_[i].bump_texture =
+        Texture::Inst()->LoadTexture(device, dev_context, full_path);
     }
 
     std::string displacement_texname;       // disp
 
-    if (materials_[i].alpha_texname != "") {
+    if (info.alpha_texname != "") {
       // Check if the texture name uses // as parenthesis and if so, fix it
-      FindReplace(materials_[i].alpha_texname, "\\", "\/");
-      //FindReplace(materials_[i].ambient_texname, ".tga", ".png");
+      FindReplace(info.alpha_texname, "\\", "\/");
+      //FindReplace(info.ambient_texname, ".tga", ".png");
       
-      //full_path = converter.from_bytes(path_suffix + materials_[i].alpha_texname);
-      full_path = path_suffix + materials_[i].alpha_texname;
-
-      Texture::Inst()->LoadTexture(device, dev_context, full_path);
-      materials_[i].alpha_texname = full_path;
-      materials_[i].alpha_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      //full_path = converter.from_bytes(path_suffix + info.alpha_texname);
+      full_path = path_suffix + info.alpha_texname;
+
+      info.alpha_texname = full_path;
+      info.alpha_texname_crc = abfw::CRC::GetICRC(full_path.c_str());
+      // Textures with identical content resolve to the same handle
+      materials_[i].alpha_texture =
+        Texture::Inst()->LoadTexture(device, dev_context, full_path);
     }
   }
 }
@@ -163,9 +184,11 @@ void Model::LoadShaders_(ID3D11Device* device, HWND hwnd,
   sz::ShaderManager &shad_man) {
   // For each material
   for (unsigned int i = 0; i < materials_.size(); ++i) {
+    sz::MaterialInfo &info = materials_[i].info();
+
     // Determine which shader to instantiate
-    if (materials_[i].diffuse_texname != "" && materials_[i].bump_texname != "" &&
-      materials_[i].alpha_texname != "" && materials_[i].specular_texname != "") {
+    if (info.diffuse_texname != "" && info.bump_texname != "" &&
+      info.alpha_texname != "" && info.specular_texname != "") {
       NormalAlphaSpecMapShader *shader =
         new NormalAlphaSpecMapShader(device, hwnd, buf_man, lights_num);
       if (!shad_man.AddShader("normal_alpha_spec_map_shader", shader)) {
@@ -173,10 +196,10 @@ void Model::LoadShaders_(ID3D11Device* device, HWND hwnd,
         shader = nullptr;
       }
 
-      materials_[i].shader_name = "normal_alpha_spec_map_shader";
+      info.shader_name = "normal_alpha_spec_map_shader";
     }
-    else if (materials_[i].diffuse_texname != "" && materials_[i].bump_texname != "" &&
-      materials_[i].alpha_texname != "") {
+    else if (info.diffuse_texname != "" && info.bump_texname != "" &&
+      info.alpha_texname != "") {
       NormalAlphaMapShader *shader =
         new NormalAlphaMapShader(device, hwnd, buf_man, lights_num);
       if (!shad_man.AddShader("normal_alpha_map_shader", shader)) {
@@ -184,10 +207,10 @@ void Model::LoadShaders_(ID3D11Device* device, HWND hwnd,
         shader = nullptr;
       }
 
-      materials_[i].shader_name = "normal_alpha_map_shader";
+      info.shader_name = "normal_alpha_map_shader";
     }
-    else if (materials_[i].diffuse_texname != "" && materials_[i].bump_texname != "" &&
-      materials_[i].specular_texname != "") {
+    else if (info.diffuse_texname != "" && info.bump_texname != "" &&
+      info.specular_texname != "") {
       NormalSpecMapShader *shader =
         new NormalSpecMapShader(device, hwnd, buf_man, lights_num);
       if (!shad_man.AddShader("normal_spec_map_shader", shader)) {
@@ -195,9 +218,9 @@ void Model::LoadShaders_(ID3D11Device* device, HWND hwnd,
         shader = nullptr;
       }
 
-      materials_[i].shader_name = "normal_spec_map_shader";
+      info.shader_name = "normal_spec_map_shader";
     }
-    else if (materials_[i].diffuse_texname != "" && materials_[i].bump_texname != "") {
+    else if (info.diffuse_texname != "" && info.bump_texname != "") {
       NormalMappingShader *shader =
         new NormalMappingShader(device, hwnd, buf_man, lights_num);
       if (!shad_man.AddShader("normal_mapping_shader", shader)) {
@@ -205,49 +228,52 @@ void Model::LoadShaders_(ID3D11Device* device, HWND hwnd,
         shader = nullptr;
       }
 
-      materials_[i].shader_name = "normal_mapping_shader";
+      info.shader_name = "normal_mapping_shader";
     }
-    else if (materials_[i].diffuse_texname != "" && materials_[i].alpha_texname != "" &&
-      materials_[i].specular_texname != "") {
+    else if (info.diffuse_texname != "" && info.alpha_texname != "" &&
+      info.specular_texname != "") {
       LightAlphaSpecMapShader *shader =
         new LightAlphaSpecMapShader(device, hwnd, buf_man, lights_num);
       if (!shad_man.AddShader("light_alpha_spec_map_shader", shader)) {
         delete shader;
         shader = nullptr;
       }
-      materials_[i].shader_name = "light_alpha_spec_map_shader";
+      info.shader_name = "light_alpha_spec_map_shader";
 
     }
-    else if (materials_[i].diffuse_texname != "" && materials_[i].alpha_texname != "") {
+    else if (info.diffuse_texname != "" && info.alpha_texname != "") {
       LightAlphaMapShader *shader =
         new LightAlphaMapShader(device, hwnd, buf_man, lights_num);
       if (!shad_man.AddShader("light_alpha_map_shader", shader)) {
         delete shader;
         shader = nullptr;
       }
-      materials_[i].shader_name = "light_alpha_map_shader";
+      info.shader_name = "light_alpha_map_shader";
 
     }
-    else if (materials_[i].diffuse_texname != "" && materials_[i].specular_texname != "") {
+    else if (info.diffuse_texname != "" && info.specular_texname != "") {
       LightSpecMapShader *shader =
         new LightSpecMapShader(device, hwnd, buf_man, lights_num);
       if (!shad_man.AddShader("light_spec_map_shader", shader)) {
         delete shader;
         shader = nullptr;
       }
-      materials_[i].shader_name = "light_spec_map_shader";
+      info.shader_name = "light_spec_map_shader";
 
     }
-    else if (materials_[i].diffuse_texname != "") {
+    else if (info.diffuse_texname != "") {
       LightShader *shader =
         new LightShader(device, hwnd, buf_man, lights_num);
       if (!shad_man.AddShader("light_shader", shader)) {
         delete shader;
         shader = nullptr;
       }
-      materials_[i].shader_name = "light_shader";
+      info.shader_name = "light_shader";
 
     }
+
+    // Resolve the shader name and flags used when rendering
+    materials_[i].ResolveIds();
   }
 }
 
@@ -311,17 +337,20 @@ void Model::SendData(ID3D11DeviceContext* dev_context, bool tessellate) {
   offset = 0;
 
   // Set the vertex buffer to active in the input assembler so it can be rendered.
-  dev_context->IASetVertexBuffers(0, 1, &vertex_buf_, &stride, &offset);
+  sz::StateCache::Inst()->IASetVertexBuffers(0, 1, &vertex_buf_, &stride,
+    &offset);
 
   // Set the index buffer to active in the input assembler so it can be rendered.
-  dev_context->IASetIndexBuffer(index_buf_, DXGI_FORMAT_R32_UINT, 0);
+  sz::StateCache::Inst()->IASetIndexBuffer(index_buf_, DXGI_FORMAT_R32_UINT, 0);
 
   // Set the type of primitive that should be rendered from this vertex buffer, in this case triangles.
   if (tessellate) {
-    dev_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
+    sz::StateCache::Inst()->IASetPrimitiveTopology(
+      D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
   }
   else {
-    dev_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    sz::StateCache::Inst()->IASetPrimitiveTopology(
+      D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
   }
 }
 
@@ -353,8 +382,7 @@ void Model::AddMeshesAndMaterials(std::vector<BaseMesh> &meshes,
 void Model::SetTessellation(ID3D11DeviceContext* deviceContext,
   sz::ShaderManager *sha_man, bool tessellate) {
   for (sz::Material &material : materials_) {
-    BaseShader *shader = sha_man->GetShader(
-      material.shader_name);
+    BaseShader *shader = sha_man->GetShader(material.shader_id);
     if (shader == nullptr) {
       continue;
     }
@@ -1,5 +1,17 @@
 // Mesh.cpp
 #include "pointmesh.h"
+#include "state_cache.h"
+
+namespace {
+
+// Every point mesh is the same point, so they share one pair of buffers and
+// can be drawn as instances of each other
+const XMFLOAT3 kPointPosition(0.0f, 1.0f, 0.0f);
+ID3D11Buffer *shared_vertex_buffer = nullptr;
+ID3D11Buffer *shared_index_buffer = nullptr;
+UInt32 point_mesh_count = 0;
+
+}
 
 PointMesh::PointMesh(ID3D11Device* device) :
   BaseMesh() {
@@ -9,6 +21,12 @@ PointMesh::PointMesh(ID3D11Device* device) :
 
 
 PointMesh::~PointMesh() {
+  // The last one forgets the buffers, which it releases with its own
+  if (--point_mesh_count == 0) {
+    shared_vertex_buffer = nullptr;
+    shared_index_buffer = nullptr;
+  }
+
   // Run parent deconstructor
   BaseMesh::~BaseMesh();
 }
@@ -26,6 +44,16 @@ void PointMesh::InitBuffers(ID3D11Device* device) {
   // Set the number of indices in the index array.
   m_indexCount = 1;
 
+  ++point_mesh_count;
+  if (shared_vertex_buffer != nullptr) {
+    m_vertexBuffer = shared_vertex_buffer;
+    m_vertexBuffer->AddRef();
+    m_indexBuffer = shared_index_buffer;
+    m_indexBuffer->AddRef();
+    set_bounds(kPointPosition, XMFLOAT3(0.f, 0.f, 0.f));
+    return;
+  }
+
   // Create the vertex array.
   vertices = new VertexType[m_vertexCount];
 
@@ -33,13 +61,16 @@ void PointMesh::InitBuffers(ID3D11Device* device) {
   indices = new unsigned long[m_indexCount];
 
   // Load the vertex array with data.
-  vertices[0].position = XMFLOAT3(0.0f, 1.0f, 0.0f);  // Top.
+  vertices[0].position = kPointPosition;  // Top.
   vertices[0].texture = XMFLOAT2(0.0f, 1.0f);
   vertices[0].normal = XMFLOAT3(0.0f, 0.0f, -1.0f);
 
   // Load the index array with data.
   indices[0] = 0;  // Top/
 
+  // The bounds are the point itself
+  set_bounds(vertices[0].position, XMFLOAT3(0.f, 0.f, 0.f));
+
   // Set up the description of the static vertex buffer.
   vertexBufferDesc.Usage = D3D11_USAGE_DEFAULT;
   vertexBufferDesc.ByteWidth = sizeof(VertexType)* m_vertexCount;
@@ -72,6 +103,9 @@ void PointMesh::InitBuffers(ID3D11Device* device) {
   // Create the index buffer.
   device->CreateBuffer(&indexBufferDesc, &indexData, &m_indexBuffer);
 
+  shared_vertex_buffer = m_vertexBuffer;
+  shared_index_buffer = m_indexBuffer;
+
   // Release the arrays now that the vertex and index buffers have been created and loaded.
   delete[] vertices;
   vertices = 0;
@@ -89,12 +123,15 @@ void PointMesh::SendData(ID3D11DeviceContext* deviceContext) {
   offset = 0;
 
   // Set the vertex buffer to active in the input assembler so it can be rendered.
-  deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
+  sz::StateCache::Inst()->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride,
+    &offset);
 
   // Set the index buffer to active in the input assembler so it can be rendered.
-  deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+  sz::StateCache::Inst()->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT,
+    0);
 
   // Set the type of primitive that should be rendered from this vertex buffer, in this case control patch for tessellation.
-  deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
+  sz::StateCache::Inst()->IASetPrimitiveTopology(
+    D3D11_PRIMITIVE_TOPOLOGY_POINTLIST);
 }
 
@@ -1,14 +1,47 @@
 // render texture
 // alternative render target
 #include "rendertexture.h"
+#include "state_cache.h"
 #include "Texture.h"
 #include "crc.h"
 
-RenderTexture::RenderTexture(ID3D11Device* device, int textureWidth, 
-  int textureHeight,   float screenNear, float screenFar,
+namespace {
+
+// Format of the texture under a depth buffer which shaders sample
+DXGI_FORMAT TypelessDepthFormat(DXGI_FORMAT depth_format) {
+  switch (depth_format) {
+  case DXGI_FORMAT_D32_FLOAT:
+    return DXGI_FORMAT_R32_TYPELESS;
+  case DXGI_FORMAT_D24_UNORM_S8_UINT:
+    return DXGI_FORMAT_R24G8_TYPELESS;
+  case DXGI_FORMAT_D16_UNORM:
+    return DXGI_FORMAT_R16_TYPELESS;
+  default:
+    return depth_format;
+  }
+}
+
+// Format through which shaders read the depth of a depth buffer
+DXGI_FORMAT SampledDepthFormat(DXGI_FORMAT depth_format) {
+  switch (depth_format) {
+  case DXGI_FORMAT_D32_FLOAT:
+    return DXGI_FORMAT_R32_FLOAT;
+  case DXGI_FORMAT_D24_UNORM_S8_UINT:
+    return DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+  case DXGI_FORMAT_D16_UNORM:
+    return DXGI_FORMAT_R16_UNORM;
+  default:
+    return depth_format;
+  }
+}
+
+} // namespace
+
+RenderTexture::RenderTexture(ID3D11Device* device,
+  const RenderTextureDesc &desc, float screenNear, float screenFar,
   const std::string &name) :
-    m_textureWidth(textureWidth),
-    m_textureHeight(textureHeight),
+    m_textureWidth(desc.width),
+    m_textureHeight(desc.height),
     m_renderTargetTexture(nullptr),
     m_renderTargetView(nullptr),
     m_shaderResourceView(nullptr),
@@ -17,8 +50,10 @@ RenderTexture::RenderTexture(ID3D11Device* device, int textureWidth,
     m_viewport(),
     m_projectionMatrix(),
     m_orthoMatrix(),
+    desc_(desc),
     name_(name),
-    name_crc_(0) {
+    name_crc_(0),
+    texture_handle_() {
 
   name_crc_ = abfw::CRC::GetICRC(name.c_str());
 
@@ -29,94 +64,114 @@ RenderTexture::RenderTexture(ID3D11Device* device, int textureWidth,
   D3D11_TEXTURE2D_DESC depthBufferDesc;
   D3D11_DEPTH_STENCIL_VIEW_DESC depthStencilViewDesc;
 
-
-  // Store the width and height of the render texture.
-  m_textureWidth = textureWidth;
-  m_textureHeight = textureHeight;
-
-  // Initialize the render target texture description.
-  ZeroMemory(&textureDesc, sizeof(textureDesc));
-
-  // Setup the render target texture description.
-  textureDesc.Width = textureWidth;
-  textureDesc.Height = textureHeight;
-  textureDesc.MipLevels = 1;
-  textureDesc.ArraySize = 1;
-  textureDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-  textureDesc.SampleDesc.Count = 1;
-  textureDesc.Usage = D3D11_USAGE_DEFAULT;
-  textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-  textureDesc.CPUAccessFlags = 0;
-  textureDesc.MiscFlags = 0;
-
-  //// Create the render target texture.
-  //result = device->CreateTexture2D(&textureDesc, NULL, &m_renderTargetTexture);
-  
-  // Setup the description of the render target view.
-  renderTargetViewDesc.Format = textureDesc.Format;
-  renderTargetViewDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-  renderTargetViewDesc.Texture2D.MipSlice = 0;
-
-  
-  // Setup the description of the shader resource view.
-  shaderResourceViewDesc.Format = textureDesc.Format;
+  // The texture which shaders sample is registered with the textures
+  // manager, under the name of the target
+  ZeroMemory(&shaderResourceViewDesc, sizeof(shaderResourceViewDesc));
   shaderResourceViewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
   shaderResourceViewDesc.Texture2D.MostDetailedMip = 0;
   shaderResourceViewDesc.Texture2D.MipLevels = 1;
 
-  // Create the shader resource view.
-  //result = device->CreateShaderResourceView(m_renderTargetTexture, &shaderResourceViewDesc, &m_shaderResourceView);
-
-  // Create the render target texture and the resource view
-  m_renderTargetTexture = Texture::Inst()->CreateTexture2D(
-    device, textureDesc, shaderResourceViewDesc, name);
-
-  // Create the render target view.
-  result = device->CreateRenderTargetView(m_renderTargetTexture, &renderTargetViewDesc, &m_renderTargetView);
-  
-  // Initialize the description of the depth buffer.
-  ZeroMemory(&depthBufferDesc, sizeof(depthBufferDesc));
-
-  // Set up the description of the depth buffer.
-  depthBufferDesc.Width = textureWidth;
-  depthBufferDesc.Height = textureHeight;
-  depthBufferDesc.MipLevels = 1;
-  depthBufferDesc.ArraySize = 1;
-  depthBufferDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-  depthBufferDesc.SampleDesc.Count = 1;
-  depthBufferDesc.SampleDesc.Quality = 0;
-  depthBufferDesc.Usage = D3D11_USAGE_DEFAULT;
-  depthBufferDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-  depthBufferDesc.CPUAccessFlags = 0;
-  depthBufferDesc.MiscFlags = 0;
-
-  // Create the texture for the depth buffer using the filled out description.
-  result = device->CreateTexture2D(&depthBufferDesc, NULL, &m_depthStencilBuffer);
-  
-  // Initialize the depth stencil view.
-  ZeroMemory(&depthStencilViewDesc, sizeof(depthStencilViewDesc));
-
-  // Set up the depth stencil view description.
-  depthStencilViewDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-  depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-  depthStencilViewDesc.Texture2D.MipSlice = 0;
-
-  // Create the depth stencil view.
-  result = device->CreateDepthStencilView(m_depthStencilBuffer, &depthStencilViewDesc, &m_depthStencilView);
-  
+  if (desc.colour_format != DXGI_FORMAT_UNKNOWN) {
+    // Initialize the render target texture description.
+    ZeroMemory(&textureDesc, sizeof(textureDesc));
+
+    // Setup the render target texture description.
+    textureDesc.Width = desc.width;
+    textureDesc.Height = desc.height;
+    textureDesc.MipLevels = 1;
+    textureDesc.ArraySize = 1;
+    textureDesc.Format = desc.colour_format;
+    textureDesc.SampleDesc.Count = 1;
+    textureDesc.Usage = D3D11_USAGE_DEFAULT;
+    textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET;
+    textureDesc.CPUAccessFlags = 0;
+    textureDesc.MiscFlags = 0;
+
+    // Setup the description of the render target view.
+    renderTargetViewDesc.Format = textureDesc.Format;
+    renderTargetViewDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
+    renderTargetViewDesc.Texture2D.MipSlice = 0;
+
+    // Create the render target texture and the resource view
+    if (!desc.sample_depth) {
+      textureDesc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+      shaderResourceViewDesc.Format = textureDesc.Format;
+      m_renderTargetTexture = Texture::Inst()->CreateTexture2D(
+        device, textureDesc, shaderResourceViewDesc, name);
+    }
+    else {
+      result = device->CreateTexture2D(&textureDesc, NULL,
+        &m_renderTargetTexture);
+    }
+
+    // Create the render target view.
+    if (m_renderTargetTexture != nullptr) {
+      result = device->CreateRenderTargetView(m_renderTargetTexture,
+        &renderTargetViewDesc, &m_renderTargetView);
+    }
+  }
+
+  if (desc.depth_format != DXGI_FORMAT_UNKNOWN) {
+    // Initialize the description of the depth buffer.
+    ZeroMemory(&depthBufferDesc, sizeof(depthBufferDesc));
+
+    // Set up the description of the depth buffer.
+    depthBufferDesc.Width = desc.width;
+    depthBufferDesc.Height = desc.height;
+    depthBufferDesc.MipLevels = 1;
+    depthBufferDesc.ArraySize = 1;
+    depthBufferDesc.Format = desc.depth_format;
+    depthBufferDesc.SampleDesc.Count = 1;
+    depthBufferDesc.SampleDesc.Quality = 0;
+    depthBufferDesc.Usage = D3D11_USAGE_DEFAULT;
+    depthBufferDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+    depthBufferDesc.CPUAccessFlags = 0;
+    depthBufferDesc.MiscFlags = 0;
+
+    // A depth buffer which shaders sample is typeless, so that it can be
+    // seen both as depth and as a plain texture
+    if (desc.sample_depth) {
+      depthBufferDesc.Format = TypelessDepthFormat(desc.depth_format);
+      depthBufferDesc.BindFlags |= D3D11_BIND_SHADER_RESOURCE;
+      shaderResourceViewDesc.Format = SampledDepthFormat(desc.depth_format);
+      m_depthStencilBuffer = Texture::Inst()->CreateTexture2D(
+        device, depthBufferDesc, shaderResourceViewDesc, name);
+    }
+    else {
+      result = device->CreateTexture2D(&depthBufferDesc, NULL,
+        &m_depthStencilBuffer);
+    }
+
+    // Initialize the depth stencil view.
+    ZeroMemory(&depthStencilViewDesc, sizeof(depthStencilViewDesc));
+
+    // Set up the depth stencil view description.
+    depthStencilViewDesc.Format = desc.depth_format;
+    depthStencilViewDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+    depthStencilViewDesc.Texture2D.MipSlice = 0;
+
+    // Create the depth stencil view.
+    if (m_depthStencilBuffer != nullptr) {
+      result = device->CreateDepthStencilView(m_depthStencilBuffer,
+        &depthStencilViewDesc, &m_depthStencilView);
+    }
+  }
+
+  texture_handle_ = Texture::Inst()->GetHandle(name_crc_);
+
   // Setup the viewport for rendering.
-  m_viewport.Width = (float)textureWidth;
-  m_viewport.Height = (float)textureHeight;
+  m_viewport.Width = (float)desc.width;
+  m_viewport.Height = (float)desc.height;
   m_viewport.MinDepth = 0.0f;
   m_viewport.MaxDepth = 1.0f;
   m_viewport.TopLeftX = 0.0f;
   m_viewport.TopLeftY = 0.0f;
 
   // Setup the projection matrix.
-  m_projectionMatrix = XMMatrixPerspectiveFovLH(((float)XM_PI / 4.0f), ((float)textureWidth / (float)textureHeight), screenNear, screenFar);
+  m_projectionMatrix = XMMatrixPerspectiveFovLH(((float)XM_PI / 4.0f), ((float)desc.width / (float)desc.height), screenNear, screenFar);
 
   // Create an orthographic projection matrix for 2D rendering.
-  m_orthoMatrix = XMMatrixOrthographicLH((float)textureWidth, (float)textureHeight, screenNear, screenFar);
+  m_orthoMatrix = XMMatrixOrthographicLH((float)desc.width, (float)desc.height, screenNear, screenFar);
 }
 
 RenderTexture::~RenderTexture()
@@ -147,16 +202,27 @@ RenderTexture::~RenderTexture()
     m_renderTargetView = 0;
   }
 
+  // The view kept by the textures manager holds its own reference
+  if (m_renderTargetTexture)
+  {
+    m_renderTargetTexture->Release();
+    m_renderTargetTexture = 0;
+  }
+
 }
 
 
 void RenderTexture::SetRenderTarget(ID3D11DeviceContext* deviceContext)
 {
   // Bind the render target view and depth stencil buffer to the output render pipeline.
-  deviceContext->OMSetRenderTargets(1, &m_renderTargetView, m_depthStencilView);
+  // Depth only targets bind no colour.
+  sz::StateCache::Inst()->OMSetRenderTargets(
+    m_renderTargetView != nullptr ? 1 : 0,
+    m_renderTargetView != nullptr ? &m_renderTargetView : nullptr,
+    m_depthStencilView);
 
   // Set the viewport.
-  deviceContext->RSSetViewports(1, &m_viewport);
+  sz::StateCache::Inst()->RSSetViewports(1, &m_viewport);
 
   return;
 }
@@ -173,10 +239,15 @@ void RenderTexture::ClearRenderTarget(ID3D11DeviceContext* deviceContext, float
   color[3] = alpha;
 
   // Clear the back buffer.
-  deviceContext->ClearRenderTargetView(m_renderTargetView, color);
+  if (m_renderTargetView != nullptr) {
+    sz::StateCache::Inst()->ClearRenderTargetView(m_renderTargetView, color);
+  }
 
   // Clear the depth buffer.
-  deviceContext->ClearDepthStencilView(m_depthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0);
+  if (m_depthStencilView != nullptr) {
+    sz::StateCache::Inst()->ClearDepthStencilView(m_depthStencilView,
+      D3D11_CLEAR_DEPTH, 1.0f, 0);
+  }
 
   return;
 }
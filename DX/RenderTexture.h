@@ -5,9 +5,72 @@
 #include <directxmath.h>
 #include <string>
 #include "abertay_framework.h"
+#include "texture_handle.h"
 
 using namespace DirectX;
 
+// Memory of a texel of the formats render targets are created with
+inline UInt32 RenderTargetFormatBytes(DXGI_FORMAT format) {
+  switch (format) {
+  case DXGI_FORMAT_R32G32B32A32_FLOAT:
+    return 16;
+  case DXGI_FORMAT_R16G16B16A16_FLOAT:
+    return 8;
+  case DXGI_FORMAT_R11G11B10_FLOAT:
+  case DXGI_FORMAT_R8G8B8A8_UNORM:
+  case DXGI_FORMAT_D32_FLOAT:
+  case DXGI_FORMAT_D24_UNORM_S8_UINT:
+    return 4;
+  case DXGI_FORMAT_D16_UNORM:
+    return 2;
+  default:
+    return 0;
+  }
+}
+
+// What a RenderTexture holds, and in which formats
+struct RenderTextureDesc {
+  int width;
+  int height;
+  // Format of the colour target, or DXGI_FORMAT_UNKNOWN for a target which
+  // only has a depth buffer
+  DXGI_FORMAT colour_format;
+  // Format of the depth buffer, one of the D formats, or
+  // DXGI_FORMAT_UNKNOWN for none
+  DXGI_FORMAT depth_format;
+  // Whether shaders sample the depth buffer rather than the colour target
+  bool sample_depth;
+
+  RenderTextureDesc() :
+    width(0),
+    height(0),
+    colour_format(DXGI_FORMAT_UNKNOWN),
+    depth_format(DXGI_FORMAT_UNKNOWN),
+    sample_depth(false) {}
+
+  RenderTextureDesc(int w, int h, DXGI_FORMAT colour, DXGI_FORMAT depth,
+    bool sample) :
+    width(w),
+    height(h),
+    colour_format(colour),
+    depth_format(depth),
+    sample_depth(sample) {}
+
+  inline bool operator==(const RenderTextureDesc &other) const {
+    return width == other.width && height == other.height &&
+      colour_format == other.colour_format &&
+      depth_format == other.depth_format &&
+      sample_depth == other.sample_depth;
+  }
+
+  // Memory of the colour target and of the depth buffer
+  inline UInt64 memory_bytes() const {
+    return static_cast<UInt64>(width) * height *
+      (RenderTargetFormatBytes(colour_format) +
+      RenderTargetFormatBytes(depth_format));
+  }
+};
+
 class RenderTexture
 {
 public:
@@ -21,7 +84,7 @@ public:
     _mm_free(p);
   }
 
-  RenderTexture(ID3D11Device* device, int textureWidth, int textureHeight,
+  RenderTexture(ID3D11Device* device, const RenderTextureDesc &desc,
     float screenNear, float screenDepth, const std::string &name);
   ~RenderTexture();
 
@@ -35,6 +98,13 @@ public:
   int GetTextureWidth() const;
   int GetTextureHeight() const;
 
+  inline const RenderTextureDesc &desc() const {
+    return desc_;
+  }
+  inline UInt64 memory_bytes() const {
+    return desc_.memory_bytes();
+  }
+
   inline const std::string &name() const {
     return name_;
   }
@@ -44,6 +114,9 @@ public:
   inline void SetNameCrc(UInt32 crc) {
     name_crc_ = crc;
   }
+  inline TextureHandle texture_handle() const {
+    return texture_handle_;
+  }
 
 private:
   int m_textureWidth, m_textureHeight;
@@ -56,11 +129,17 @@ private:
   XMMATRIX m_projectionMatrix;
   XMMATRIX m_orthoMatrix;
 
+  // Size and formats the target was created with
+  RenderTextureDesc desc_;
+
   // Name of the texture managed
   std::string name_;
 
   // CRC version of the name of the texture
   UInt32 name_crc_;
+
+  // Handle to the shader resource view of the texture
+  TextureHandle texture_handle_;
 };
 
 #endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 // Mesh.cpp
 #include "tessellationmesh.h"
+#include "state_cache.h"
 
 TessellationMesh::TessellationMesh(ID3D11Device* device, WCHAR* textureFilename)
 {
@@ -106,12 +107,15 @@ void TessellationMesh::SendData(ID3D11DeviceContext* deviceContext)
   offset = 0;
 
   // Set the vertex buffer to active in the input assembler so it can be rendered.
-  deviceContext->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride, &offset);
+  sz::StateCache::Inst()->IASetVertexBuffers(0, 1, &m_vertexBuffer, &stride,
+    &offset);
 
   // Set the index buffer to active in the input assembler so it can be rendered.
-  deviceContext->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+  sz::StateCache::Inst()->IASetIndexBuffer(m_indexBuffer, DXGI_FORMAT_R32_UINT,
+    0);
 
   // Set the type of primitive that should be rendered from this vertex buffer, in this case control patch for tessellation.
-  deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
+  sz::StateCache::Inst()->IASetPrimitiveTopology(
+    D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST);
 }
 
@@ -1,6 +1,7 @@
 // texture.cpp
 #include "texture.h"
 #include <algorithm>
+#include <iostream>
 #include <lodepng.h>
 #include <locale>
 #include <codecvt>
@@ -9,7 +10,14 @@
 
 Texture *Texture::single_instance_ = nullptr;
 
-Texture::Texture() {};
+Texture::Texture() :
+  slots_(),
+  free_slots_(),
+  textures_(),
+  content_to_texture_(),
+  dedup_pixels_(false),
+  dedup_stats_() {
+}
 
 Texture *Texture::Inst() {
   // If instance doen't exist
@@ -25,9 +33,9 @@ void Texture::ResetInst() {
   // If an instance exists
   if (single_instance_ != nullptr) {
     // Run through every element and free them
-    std::for_each(single_instance_->textures_.begin(), single_instance_->textures_.end(),
-      [&](std::pair<const UInt32, ID3D11ShaderResourceView *> &n) {
-        n.second->Release();
+    std::for_each(single_instance_->slots_.begin(), single_instance_->slots_.end(),
+      [&](TextureSlot &n) {
+        ReleaseNull(n.view);
     });
 
     // Delete the single instance
@@ -108,34 +116,167 @@ std::wstring Texture::ConvertToWide(const std::string &x) {
   return wide;
 }
 
-void Texture::LoadTexture(ID3D11Device* device, ID3D11DeviceContext *dev_context,
-  const std::string &filename) {
+// Size in bytes of a RGBA8 texture with the given number of mips
+static size_t GetTextureMemorySize(std::uint32_t width, std::uint32_t height,
+  std::uint32_t mip_levels) {
+  size_t size = 0;
+  for (std::uint32_t i = 0; i < mip_levels; ++i) {
+    size += static_cast<size_t>(width) * height * 4;
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+
+  return size;
+}
+
+// Build a content key out of a hash and the size of the data hashed, so that
+// a hash collision alone is not enough to share two textures
+static UInt64 MakeContentKey(UInt32 crc, size_t size) {
+  return (static_cast<UInt64>(crc) << 32) ^ static_cast<UInt64>(size);
+}
+
+void Texture::ResetDedupStats() {
+  dedup_stats_ = TextureDedupStats();
+}
+
+TextureHandle Texture::AddTexture(ID3D11ShaderResourceView *view,
+  UInt32 crc_val, const std::string &path, size_t bytes) {
+  UInt32 index = 0;
+  if (free_slots_.empty()) {
+    index = static_cast<UInt32>(slots_.size());
+    TextureSlot slot = {};
+    // Start from 1 so that a zeroed handle never resolves
+    slot.generation = 1;
+    slots_.push_back(slot);
+  }
+  else {
+    index = free_slots_.back();
+    free_slots_.pop_back();
+  }
+
+  TextureSlot &slot = slots_[index];
+  slot.view = view;
+  slot.name_refs = 1;
+  slot.file_key = 0;
+  slot.pixel_key = 0;
+  slot.path = path;
+  slot.bytes = bytes;
+
+  TextureHandle handle(index, slot.generation);
+  textures_[crc_val] = handle;
+
+  return handle;
+}
+
+bool Texture::ShareResident(UInt64 content_key, UInt32 alias_crc,
+  const std::vector<std::uint8_t> &file_data,
+  const std::vector<std::uint8_t> *pixels, std::uint32_t width,
+  std::uint32_t height, TextureHandle &handle) {
+  std::unordered_map<UInt64, TextureHandle>::const_iterator it =
+    content_to_texture_.find(content_key);
+  if (it == content_to_texture_.end()) {
+    return false;
+  }
+
+  // Content keys recorded for other names may outlive the texture itself
+  if (GetTexture(it->second) == nullptr) {
+    content_to_texture_.erase(it);
+    return false;
+  }
+
+  // Keys only match on a CRC and a size, which different content can share;
+  // a match is rare, so the resident file is read again to be sure
+  std::vector<std::uint8_t> resident;
+  lodepng::load_file(resident, slots_[it->second.index].path);
+  if (pixels == nullptr) {
+    if (resident != file_data) {
+      return false;
+    }
+  }
+  else {
+    std::vector<std::uint8_t> resident_pixels;
+    std::uint32_t resident_width = 0, resident_height = 0;
+    if (lodepng::decode(resident_pixels, resident_width, resident_height,
+      resident) != 0 || resident_width != width ||
+      resident_height != height || resident_pixels != *pixels) {
+      return false;
+    }
+  }
+
+  handle = it->second;
+  textures_[alias_crc] = handle;
+  ++slots_[handle.index].name_refs;
+
+  return true;
+}
+
+TextureHandle Texture::LoadTexture(ID3D11Device* device,
+  ID3D11DeviceContext *dev_context, const std::string &filename) {
   HRESULT result = S_OK;
 
   // Convert name to uint
   UInt32 crc_val = abfw::CRC::GetICRC(filename.c_str());
 
   // Check if this texture has already been loaded
-  std::unordered_map<UInt32, ID3D11ShaderResourceView *>::const_iterator it =
+  std::unordered_map<UInt32, TextureHandle>::const_iterator it =
     textures_.find(crc_val);
   // If the texture already exists 
   if (it != textures_.end()) {
-    return;
+    return it->second;
+  }
+
+  ++dedup_stats_.requests;
+
+  // Load the file and check whether a byte-identical one is resident
+  std::vector<std::uint8_t> file_data;
+  lodepng::load_file(file_data, filename);
+  UInt64 file_key = MakeContentKey(
+    abfw::CRC::GetCRC(file_data.data(), file_data.size()), file_data.size());
+  TextureHandle handle;
+  if (!file_data.empty() && ShareResident(file_key, crc_val, file_data,
+    nullptr, 0, 0, handle)) {
+    ++dedup_stats_.file_duplicates;
+    dedup_stats_.bytes_saved += slots_[handle.index].bytes;
+    return handle;
   }
 
   // Use LodePNG to load the texture
   std::vector<std::uint8_t> image; //the raw pixels
-  std::uint32_t width, height;
+  std::uint32_t width = 0, height = 0;
   const size_t bytes_per_pixel = 4; // LodePNG outputs this type
 
   // Decode the image using LodePNG
-  std::uint32_t error = lodepng::decode(image, width, height, filename);
+  std::uint32_t error = lodepng::decode(image, width, height, file_data);
 
   //if there's an error, display it
   if (error) {
     std::cout << "decoder error " << error
       << ": " << lodepng_error_text(error) << std::endl;
   }
+  // Whether the texture holds the file's pixels, and so may be shared
+  bool loaded = !file_data.empty() && !error;
+
+  // Optionally check whether the same pixels are resident under a file with
+  // different bytes
+  UInt64 pixel_key = 0;
+  if (dedup_pixels_ && !error) {
+    // Hash the dimensions too, so that a 2x8 and a 4x4 image differ
+    std::uint32_t dims[2] = { width, height };
+    image.insert(image.end(), reinterpret_cast<std::uint8_t *>(dims),
+      reinterpret_cast<std::uint8_t *>(dims) + sizeof(dims));
+    pixel_key = MakeContentKey(
+      abfw::CRC::GetCRC(image.data(), image.size()), image.size());
+    image.resize(image.size() - sizeof(dims));
+
+    if (ShareResident(pixel_key, crc_val, file_data, &image, width, height,
+      handle)) {
+      ++dedup_stats_.pixel_duplicates;
+      dedup_stats_.bytes_saved += slots_[handle.index].bytes;
+      return handle;
+    }
+  }
+
+  ++dedup_stats_.uploads;
 
   D3D11_TEXTURE2D_DESC TextureDescription;
   ZeroMemory(&TextureDescription, sizeof(TextureDescription));
@@ -160,6 +301,7 @@ void Texture::LoadTexture(ID3D11Device* device, ID3D11DeviceContext *dev_context
   result = device->CreateTexture2D(&TextureDescription, nullptr, &texture_resource);
   if (FAILED(result)) {
     MessageBox(NULL, L"Texture 2D creation error", L"ERROR", MB_OK);
+    loaded = false;
   }
 
   dev_context->UpdateSubresource(texture_resource, 0, nullptr, image.data(),
@@ -179,6 +321,7 @@ void Texture::LoadTexture(ID3D11Device* device, ID3D11DeviceContext *dev_context
     &ViewDescription, &texture_resource_view);
   if (FAILED(result)) {
     MessageBox(NULL, L"Texture Resource View creation error", L"ERROR", MB_OK);
+    loaded = false;
   }
 
   dev_context->GenerateMips(texture_resource_view);
@@ -239,33 +382,76 @@ void Texture::LoadTexture(ID3D11Device* device, ID3D11DeviceContext *dev_context
   //}
 
   // Add texture to the map
-  textures_[crc_val] = texture_resource_view;
+  handle = AddTexture(texture_resource_view, crc_val, filename,
+    GetTextureMemorySize(width, height, TextureDescription.MipLevels));
+
+  // Register its content so that copies of it share this texture, unless
+  // it failed to load; a key already taken by other content stays with it
+  if (loaded) {
+    TextureSlot &slot = slots_[handle.index];
+    if (content_to_texture_.emplace(file_key, handle).second) {
+      slot.file_key = file_key;
+    }
+    if (pixel_key != 0 &&
+      content_to_texture_.emplace(pixel_key, handle).second) {
+      slot.pixel_key = pixel_key;
+    }
+  }
 
+  return handle;
 }
 
 void Texture::FreeTexture(const std::string &tx_name) {
-  // NOTE
-  // Should check if a texture is being used by more than once and delete only
-  // when the last one has to be deleted; this would require a more 
-  // sophisticated approach, which will be implemented in the future.
-  // So far, when a texture is deleted, its correspondant resource is also
-  // released.
-
-  // Release the texture resource.
-  
   // Convert name to uint
-  UInt32 crc_val = abfw::CRC::GetICRC(tx_name.c_str());
- 
+  FreeTexture(abfw::CRC::GetICRC(tx_name.c_str()));
+}
+
+void Texture::FreeTexture(const UInt32 crc_val) {
+  // Names which share a texture because of identical content all refer to
+  // the same slot, so releasing one of them leaves the others valid; the
+  // resource is destroyed once the last name is freed.
+
   // Check that the texture exists
-  std::unordered_map<UInt32, ID3D11ShaderResourceView *>::iterator it =
+  std::unordered_map<UInt32, TextureHandle>::iterator it =
     textures_.find(crc_val);
+  if (it == textures_.end()) {
+    return;
+  }
 
-  if (it != textures_.end()) {
-    it->second->Release();
-    textures_.erase(it);
+  TextureHandle handle = it->second;
+  textures_.erase(it);
+
+  TextureSlot &slot = slots_[handle.index];
+  if (slot.generation != handle.generation || --slot.name_refs > 0) {
+    return;
+  }
+
+  // Forget the content of the texture and invalidate handles to it
+  if (slot.file_key != 0) {
+    content_to_texture_.erase(slot.file_key);
+  }
+  if (slot.pixel_key != 0) {
+    content_to_texture_.erase(slot.pixel_key);
   }
+  ReleaseNull(slot.view);
+  ++slot.generation;
+  free_slots_.push_back(handle.index);
 }
 
+TextureHandle Texture::GetHandle(const std::string &tx_name) const {
+  return GetHandle(abfw::CRC::GetICRC(tx_name.c_str()));
+}
+
+TextureHandle Texture::GetHandle(const UInt32 crc_val) const {
+  std::unordered_map<UInt32, TextureHandle>::const_iterator it =
+    textures_.find(crc_val);
+
+  if (it != textures_.end()) {
+    return it->second;
+  }
+
+  return TextureHandle();
+}
 
 ID3D11ShaderResourceView* Texture::GetTexture(const std::wstring &tx_name)
 {
@@ -279,34 +465,13 @@ ID3D11ShaderResourceView* Texture::GetTexture(const std::wstring &tx_name)
 }
 
 ID3D11ShaderResourceView* Texture::GetTexture(const std::string &tx_name) {
-  // Convert name to uint
-  UInt32 crc_val = abfw::CRC::GetICRC(tx_name.c_str());
-
-  std::unordered_map<UInt32,
-    ID3D11ShaderResourceView *>::iterator it = textures_.find(crc_val);
-
-  if (it != textures_.end()) {
-    return it->second;
-  }
-
-  return nullptr;
+  return GetTexture(GetHandle(tx_name));
 }
   
 ID3D11ShaderResourceView *Texture::GetTexture(const UInt32 crc_val) {
-  std::unordered_map<UInt32,
-    ID3D11ShaderResourceView *>::iterator it = textures_.find(crc_val);
-
-  if (it != textures_.end()) {
-    return it->second;
-  }
-
-  return nullptr;
+  return GetTexture(GetHandle(crc_val));
 }
 
-bool Texture::does_file_exist(const WCHAR *fname) {
-  std::ifstream infile(fname);
-  return infile.good();
-}
 bool Texture::does_file_exist(const char *fname) {
   std::ifstream infile(fname);
   return infile.good();
@@ -392,8 +557,11 @@ create texture 2D", L"ERROR", MB_OK);
   // Convert name to uint
   UInt32 crc_val = abfw::CRC::GetICRC(name.c_str());
 
+  // Replace any texture previously created with the same name
+  FreeTexture(crc_val);
+
   // Add res view to the map
-  textures_[crc_val] = shad_res_view;
+  AddTexture(shad_res_view, crc_val, name, 0);
 
   return texture;
 }
\ No newline at end of file
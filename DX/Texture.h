@@ -3,16 +3,35 @@
 #define _TEXTURE_H_
 
 #include <d3d11.h>
+#include <directxmath.h>
 #include <WICtextureloader.h>
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <unordered_map>
-#include "Model.h"
+#include <vector>
 #include "abertay_framework.h"
 #include "crc.h"
+#include "texture_handle.h"
 
 using namespace DirectX;
 
+class Model;
+
+// Counters describing how much work content deduplication saved
+struct TextureDedupStats {
+  // Number of LoadTexture requests made for not yet loaded paths
+  UInt32 requests;
+  // Number of textures actually decoded and uploaded to the GPU
+  UInt32 uploads;
+  // Requests resolved to an already resident, byte-identical file
+  UInt32 file_duplicates;
+  // Requests resolved to an already resident, pixel-identical image
+  UInt32 pixel_duplicates;
+  // GPU memory which would have been used by the duplicates
+  size_t bytes_saved;
+};
+
 class Texture
 {
 public:
@@ -26,9 +45,30 @@ public:
   void LoadTexture(ID3D11Device* device, ID3D11DeviceContext *dev_context, 
     WCHAR* filename);
 
-  void LoadTexture(ID3D11Device* device, ID3D11DeviceContext *dev_context, 
+  // Load a texture in memory and return a handle to it. If a texture with the
+  // same content has already been loaded under a different name, the
+  // resident one is shared and both names resolve to the same handle.
+  TextureHandle LoadTexture(ID3D11Device* device, ID3D11DeviceContext *dev_context, 
     const std::string &filename);
 
+  // Whether to also share textures whose files differ but which decode to the
+  // same pixels (e.g. re-saved copies); costs a hash over the pixels. Only
+  // affects textures loaded afterwards.
+  inline void set_dedup_pixels(bool v) {
+    dedup_pixels_ = v;
+  }
+
+  // Deduplication counters since the last reset
+  inline const TextureDedupStats &dedup_stats() const {
+    return dedup_stats_;
+  }
+  void ResetDedupStats();
+
+  // Number of distinct textures resident on the GPU
+  inline size_t resident_texture_count() const {
+    return slots_.size() - free_slots_.size();
+  }
+
   // Load a texture in memory from a descriptor and return the created
   // 2D texture
   ID3D11Texture2D *CreateTexture2D(ID3D11Device* device, 
@@ -39,6 +79,22 @@ public:
   // Delete a texture from memory
   void FreeTexture(const std::string &tx_name);
 
+  // Retrieve the handle of a texture from its name; resolve it once and keep
+  // it, rather than looking up names every frame
+  TextureHandle GetHandle(const std::string &tx_name) const;
+  TextureHandle GetHandle(const UInt32 crc_val) const;
+
+  // Retrieve a texture from its handle; returns nullptr if the texture the
+  // handle refers to has been freed
+  inline ID3D11ShaderResourceView *GetTexture(const TextureHandle handle) const {
+    if (handle.index < slots_.size() &&
+      slots_[handle.index].generation == handle.generation) {
+      return slots_[handle.index].view;
+    }
+
+    return nullptr;
+  }
+
   // Retrieve a texture from its name
   ID3D11ShaderResourceView *GetTexture(const std::wstring &tx_name);
   ID3D11ShaderResourceView *GetTexture(const std::string &tx_name);
@@ -52,13 +108,57 @@ private:
 
   Texture();
   
-  bool does_file_exist(const WCHAR *fileName);
   bool does_file_exist(const char *fileName);
   
   std::wstring ConvertToWide(const std::string &x);
 
-  // Have textures be loaded only ONCE in memory
-  std::unordered_map<UInt32, ID3D11ShaderResourceView *> textures_;
+  // Entry of the dense texture array
+  struct TextureSlot {
+    ID3D11ShaderResourceView *view;
+    // Bumped when the slot is freed, invalidating handles to it
+    UInt32 generation;
+    // Number of names resolving to this slot
+    UInt32 name_refs;
+    // Content keys (hash and size of the file and of the decoded pixels)
+    // the texture was registered under, 0 if none
+    UInt64 file_key;
+    UInt64 pixel_key;
+    // File the texture was loaded from, read again to tell content which
+    // only shares its key from the same content
+    std::string path;
+    // GPU memory used by the texture, including mips
+    size_t bytes;
+  };
+
+  // Textures, addressed by handles; free slots are reused
+  std::vector<TextureSlot> slots_;
+  std::vector<UInt32> free_slots_;
+
+  // Have textures be loaded only ONCE in memory; names which resolved to
+  // the same content map to the same handle
+  std::unordered_map<UInt32, TextureHandle> textures_;
+
+  // Content key to the texture which was loaded with that content
+  std::unordered_map<UInt64, TextureHandle> content_to_texture_;
+
+  bool dedup_pixels_;
+  TextureDedupStats dedup_stats_;
+
+  // Store a view in a free slot and register it under the given name
+  TextureHandle AddTexture(ID3D11ShaderResourceView *view, UInt32 crc_val,
+    const std::string &path, size_t bytes);
+
+  // Remove a name; the texture is released when no name refers to it
+  void FreeTexture(const UInt32 crc_val);
+
+  // If a texture with the given content key is resident, and its file holds
+  // the same bytes (or, given pixels, decodes to the same width x height
+  // pixels), register alias_crc as a further name for it and return its
+  // handle in handle
+  bool ShareResident(UInt64 content_key, UInt32 alias_crc,
+    const std::vector<std::uint8_t> &file_data,
+    const std::vector<std::uint8_t> *pixels, std::uint32_t width,
+    std::uint32_t height, TextureHandle &handle);
 
   // Ptr to single global instance
   static Texture *single_instance_;
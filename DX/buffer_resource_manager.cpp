@@ -12,9 +12,8 @@ ConstBufManager::ConstBufManager() :
 ConstBufManager::~ConstBufManager() {
   // Run through every element and free them
   std::for_each(buffers_.begin(), buffers_.end(),
-    [&](std::pair<const std::string, ID3D11Buffer *> &n) {
-      n.second->Release();
-      n.second = 0;
+    [&](ID3D11Buffer *&n) {
+      ReleaseNull(n);
   });
 }
 
@@ -26,12 +25,22 @@ ID3D11Buffer *ConstBufManager::CreateD3D11ConstBuffer(const std::string &name,
     return nullptr;
   }
 
-  // Look up the map to check if the buffer has already been created
-  std::map<std::string, ID3D11Buffer *>::const_iterator it = buffers_.find(name);
+  return CreateD3D11ConstBuffer(NameInterner::Inst()->Intern(name), desc,
+    device);
+}
+
+ID3D11Buffer *ConstBufManager::CreateD3D11ConstBuffer(NameId id,
+  const D3D11_BUFFER_DESC &desc,
+  ID3D11Device* device) {
+  if (id == kInvalidNameId) {
+    return nullptr;
+  }
+
   // If the buffer already exists 
-  if (it != buffers_.end()) {
+  ID3D11Buffer *existing_buf = GetBuffer(id);
+  if (existing_buf != nullptr) {
     // Return the pointer of the buffer
-    return it->second;
+    return existing_buf;
   }
 
   // Create a buffer pointer
@@ -44,7 +53,10 @@ ID3D11Buffer *ConstBufManager::CreateD3D11ConstBuffer(const std::string &name,
   }
 
   // Add buffer to list
-  buffers_[name] = buf_;
+  if (id >= buffers_.size()) {
+    buffers_.resize(id + 1, nullptr);
+  }
+  buffers_[id] = buf_;
 
   return buf_;
 }
@@ -1,7 +1,8 @@
 //  A buffer manager class which manages the constant buffers needed by shaders
 //  * Shaders are passed this class
 //  * They ask this class for the buffer with a given name (string)
-//  * The class looks up for the buffer with that name
+//  * The name is interned to a NameId, which indexes the buffers
+//  * The class looks up for the buffer with that ID
 //    * If already created, return the handle
 //    * If not created, create it and return the handle
 
@@ -13,14 +14,16 @@
 #include <D3Dcompiler.h>
 #include <DirectXMath.h>
 #include <string>
-#include <map>
+#include <vector>
+#include "name_interner.h"
 
 namespace sz {
   
 class ConstBufManager {
 private:
-  // The map of buffers relatively to their assigned name
-  std::map<std::string, ID3D11Buffer *> buffers_;
+  // The buffers indexed by the ID of their assigned name; IDs of names
+  // which are not buffers hold nullptr
+  std::vector<ID3D11Buffer *> buffers_;
 
 public:
   // Ctor
@@ -37,6 +40,18 @@ public:
   ID3D11Buffer *CreateD3D11ConstBuffer(const std::string &name,
     const D3D11_BUFFER_DESC &desc,
     ID3D11Device* device);
+  ID3D11Buffer *CreateD3D11ConstBuffer(NameId id,
+    const D3D11_BUFFER_DESC &desc,
+    ID3D11Device* device);
+
+  // Get a buffer which has already been created
+  inline ID3D11Buffer *GetBuffer(NameId id) const {
+    if (id < buffers_.size()) {
+      return buffers_[id];
+    }
+
+    return nullptr;
+  }
   
 }; // class ConstBufManager
 
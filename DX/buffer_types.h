@@ -3,7 +3,16 @@
 
 #include <DirectXMath.h>
 
+// Lights which may have a shadow map: the first kNumLights of the scene.
+// Shaders keep a map and a position in the light's space for each of them.
 const unsigned int kNumLights = 4;
+// Lights of the scene at most, with a shadow map or not
+const unsigned int kMaxLights = 1024;
+// Lights a draw may be given its own list of, in place of those of the
+// clusters it covers; a multiple of 4
+const unsigned int kMaxDrawLights = 8;
+// Count of the draws which read the lists of their clusters
+const unsigned int kNoDrawLights = 0xFFFFFFFF;
 
 namespace sz {
 
@@ -13,8 +22,10 @@ struct MatrixBufferType {
   XMMATRIX world;
   XMMATRIX view;
   XMMATRIX projection;
-  XMMATRIX lights_view[kNumLights];
-  XMMATRIX lights_proj[kNumLights];
+  // Products of the matrices above and of those of the lights, so that
+  // vertex shaders transform each vertex once per space
+  XMMATRIX world_view_projection;
+  XMMATRIX world_lights_view_projection[kNumLights];
 };
 
 struct ScreenSizeBufferType {
@@ -38,11 +49,71 @@ struct LightBufferType {
   // [0.f, 90.f] = spotlight
   float spot_cutoff;
   float spot_exponent;
-  XMFLOAT3 padding;
+  // Whether the shadow map of the light was rendered this frame
+  unsigned int shadow_map;
+  XMFLOAT2 padding;
   XMMATRIX view;
   XMMATRIX proj;
 };
 
+// Light as the lighting shaders loop over it, in the lists of the clusters
+struct ClusterLightType {
+  XMFLOAT4 diffuse;
+  XMFLOAT4 ambient;
+  XMFLOAT4 specular;
+  XMFLOAT3 position;
+  float range;
+  // Normalised
+  XMFLOAT3 direction;
+  // Cosine of the half angle of the cone of spot lights
+  float spot_cos_cutoff;
+  XMFLOAT3 attenuation;
+  float spot_exponent;
+  // One of ClusterLightKind
+  unsigned int kind;
+  // Shadow map of the light, or kNumLights if it has none
+  unsigned int shadow_slot;
+  XMFLOAT2 padding;
+};
+
+enum ClusterLightKind {
+  kClusterLightDirectional = 0,
+  kClusterLightPoint = 1,
+  kClusterLightSpot = 2
+};
+
+// How pixel shaders find the cluster of a pixel
+struct ClusterBufferType {
+  // 1 / size of the tiles in pixels
+  float tile_scale;
+  // slice = log(depth) * slice_scale + slice_bias
+  float slice_scale;
+  float slice_bias;
+  unsigned int slice_count;
+  unsigned int tiles_x;
+  unsigned int tiles_y;
+  // View space depth of a pixel = depth_a / (depth_b - depth in the buffer)
+  float depth_a;
+  float depth_b;
+};
+
+// Lights picked for a draw, as indices into the lights of the clusters
+struct DrawLightBufferType {
+  // Number of indices, or kNoDrawLights
+  unsigned int count;
+  unsigned int padding[3];
+  // Read as uint4s by the shaders, as HLSL pads each element of an array
+  // to a whole constant
+  unsigned int indices[kMaxDrawLights];
+};
+
+// Tile of the shadow map of each light in the atlas: x is the size of the
+// tile over that of the atlas, yz its top left corner in the atlas, and w
+// half a texel of the tile, in the coordinates of the tile
+struct ShadowAtlasBufferType {
+  XMFLOAT4 tiles[kNumLights];
+};
+
 struct CamBufferType {
   XMFLOAT3 camPos;
   float padding;
@@ -73,6 +144,26 @@ struct TimeBufferType {
   float padding;
 };
 
+// Data of each instance of instanced draws, in the second vertex buffer
+struct InstanceType {
+  // Rows of the world matrix, as DirectXMath keeps them
+  XMFLOAT4X4 world;
+  // Up to the shader; geometry boxes are tinted with it
+  XMFLOAT4 params;
+};
+
+struct VirtualTextureBufferType {
+  // Size of mip 0 in tiles, and number of mips
+  XMFLOAT2 tiles;
+  float mip_count;
+  // Texture ID + 1, as written in the feedback
+  unsigned int feedback_id;
+  // Size of the physical cache in texels
+  XMFLOAT2 cache_size;
+  float mip_bias;
+  float padding;
+};
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "command_list.h"
+#include "abertay_framework.h"
+#include "gfx_backend.h"
+#include "state_cache.h"
+
+namespace sz {
+
+CommandList::CommandList(GfxBackend *main) :
+    main_(main),
+    deferred_(nullptr),
+    cache_(nullptr),
+    ring_(nullptr) {
+  deferred_ = main_->CreateDeferred();
+  if (deferred_ == nullptr) {
+    return;
+  }
+
+  cache_ = new StateCache();
+  cache_->set_backend(deferred_);
+}
+
+CommandList::~CommandList() {
+  DeleteNull(cache_);
+  DeleteNull(deferred_);
+}
+
+void CommandList::Begin() {
+  // Deferred backends start from the default state
+  cache_->Invalidate();
+  cache_->set_constant_ring(ring_);
+  StateCache::SetThreadInst(cache_);
+}
+
+void CommandList::End() {
+  StateCache::SetThreadInst(nullptr);
+}
+
+void CommandList::Execute() {
+  main_->ExecuteDeferred(deferred_);
+
+  StateCache *main_cache = StateCache::Inst();
+  main_cache->Invalidate();
+  main_cache->MergeStats(cache_);
+}
+
+} // namespace sz
@@ -0,0 +1,67 @@
+//  A list of commands recorded on one thread and executed on another
+//  * Recording goes through a StateCache of the list's own, in front of a
+//    deferred backend. Between Begin and End, StateCache::Inst() returns it
+//    on the recording thread, so the same code records and renders.
+//  * Lists are executed on the main thread in the order in which their
+//    commands have to reach the GPU, whichever order they were recorded in,
+//    so the command stream does not depend on the threads
+//  * Resources still have to be created on the main thread
+//  * Lists can write their constant buffers to a shared ConstantRing, which
+//    has to be uploaded before they are executed
+
+#ifndef _COMMAND_LIST_H
+#define _COMMAND_LIST_H
+
+namespace sz {
+  class ConstantRing;
+  class GfxBackend;
+  class StateCache;
+}
+
+namespace sz {
+
+class CommandList {
+public:
+  // Ctor; the list is executed on main, which is not owned
+  explicit CommandList(GfxBackend *main);
+
+  // Dtor
+  ~CommandList();
+
+  // Whether the backend supports recording lists
+  inline bool valid() const {
+    return deferred_ != nullptr;
+  }
+
+  // Ring the constant buffers of the next recordings are written to, or
+  // nullptr to map them as usual; not owned
+  inline void set_constant_ring(ConstantRing *ring) {
+    ring_ = ring;
+  }
+
+  // Start recording on the calling thread
+  void Begin();
+
+  // Stop recording on the calling thread
+  void End();
+
+  // Execute the recorded commands on the main backend, on the main thread,
+  // and start over. The main StateCache forgets its bound state, and counts
+  // the binds of the list.
+  void Execute();
+
+  // Disable ctors
+  CommandList(const CommandList &) = delete;
+  CommandList &operator=(const CommandList &) = delete;
+
+private:
+  GfxBackend *main_;
+  GfxBackend *deferred_;
+  StateCache *cache_;
+  ConstantRing *ring_;
+
+}; // class CommandList
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,82 @@
+#include "constant_ring.h"
+#include <cstring>
+#include <xmmintrin.h>
+#include "gfx_backend.h"
+
+namespace sz {
+
+// Allocation sizes, rounded up to the alignment
+static inline UInt32 AlignConstantSize(UInt32 size) {
+  return (size + kConstantRingAlignment - 1) & ~(kConstantRingAlignment - 1);
+}
+
+ConstantRing::ConstantRing(ID3D11Device *device, UInt32 size) :
+    memory_(nullptr),
+    size_(AlignConstantSize(size)),
+    head_(0),
+    failed_count_(0),
+    buffer_(nullptr) {
+  memory_ = static_cast<UInt8 *>(_mm_malloc(size_, kConstantRingAlignment));
+
+  if (device != nullptr) {
+    D3D11_BUFFER_DESC desc;
+    desc.Usage = D3D11_USAGE_DYNAMIC;
+    desc.ByteWidth = size_;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    desc.MiscFlags = 0;
+    desc.StructureByteStride = 0;
+    device->CreateBuffer(&desc, nullptr, &buffer_);
+  }
+}
+
+ConstantRing::~ConstantRing() {
+  ReleaseNull(buffer_);
+  if (memory_ != nullptr) {
+    _mm_free(memory_);
+    memory_ = nullptr;
+  }
+}
+
+void ConstantRing::Reset() {
+  head_.store(0, std::memory_order_relaxed);
+  failed_count_.store(0, std::memory_order_relaxed);
+}
+
+UInt32 ConstantRing::Allocate(UInt32 size) {
+  UInt32 aligned = AlignConstantSize(size);
+
+  // The head only grows within a frame, so once past the end all the
+  // later allocations fail too; it would take gigabytes of them to wrap it
+  // around
+  UInt32 offset = head_.fetch_add(aligned, std::memory_order_relaxed);
+  if (offset + aligned > size_) {
+    failed_count_.fetch_add(1, std::memory_order_relaxed);
+    return kNoConstantRingOffset;
+  }
+
+  return offset;
+}
+
+bool ConstantRing::Free(UInt32 offset, UInt32 size) {
+  UInt32 end = offset + AlignConstantSize(size);
+  return head_.compare_exchange_strong(end, offset,
+    std::memory_order_relaxed);
+}
+
+void ConstantRing::Upload(GfxBackend *backend) {
+  UInt32 bytes = used();
+  if (buffer_ == nullptr || bytes == 0) {
+    return;
+  }
+
+  D3D11_MAPPED_SUBRESOURCE mapped;
+  if (FAILED(backend->Map(buffer_, 0, D3D11_MAP_WRITE_DISCARD, 0,
+    &mapped))) {
+    return;
+  }
+  memcpy(mapped.pData, memory_, bytes);
+  backend->Unmap(buffer_, 0);
+}
+
+} // namespace sz
@@ -0,0 +1,94 @@
+//  Ring of constant data for a frame
+//  * Constant buffers written while passes are recorded are sub-allocated
+//    from one large block instead of being mapped one by one; the block is
+//    copied to a single constant buffer with one map, and draws bind ranges
+//    of it by offset
+//  * Allocations are 256 byte aligned, as constant buffer offsets have to
+//    be multiples of 16 constants
+//  * Allocating is lock-free, so that all the recording threads share the
+//    ring; memory is written where it is, in cached memory, and only
+//    reaches the GPU with the upload
+//  * The ring starts empty every frame. It is uploaded once all the passes
+//    using it were recorded, and before any of them is executed.
+//  * A full ring fails allocations, and callers fall back to mapping their
+//    own buffers
+
+#ifndef _CONSTANT_RING_H
+#define _CONSTANT_RING_H
+
+#include <atomic>
+#include <d3d11.h>
+#include "abertay_framework.h"
+
+namespace sz {
+  class GfxBackend;
+}
+
+namespace sz {
+
+// Alignment of allocations, in bytes
+const UInt32 kConstantRingAlignment = 256;
+
+// Returned by failed allocations
+const UInt32 kNoConstantRingOffset = 0xFFFFFFFF;
+
+class ConstantRing {
+public:
+  // Ctor; the size is rounded up to the alignment. Without a device there
+  // is no buffer, and the ring only allocates.
+  ConstantRing(ID3D11Device *device, UInt32 size);
+
+  // Dtor
+  ~ConstantRing();
+
+  // Start a new frame, forgetting all the allocations; not while any are
+  // being made
+  void Reset();
+
+  // Reserve size bytes, rounded up to the alignment; kNoConstantRingOffset
+  // if the ring is full. Safe from any number of threads.
+  UInt32 Allocate(UInt32 size);
+
+  // Give back an allocation, if nothing was allocated after it; returns
+  // whether it was given back
+  bool Free(UInt32 offset, UInt32 size);
+
+  // Copy what was allocated to the buffer, with one map on backend
+  void Upload(GfxBackend *backend);
+
+  // Memory of an allocation
+  inline void *data(UInt32 offset) const {
+    return memory_ + offset;
+  }
+  inline ID3D11Buffer *buffer() const {
+    return buffer_;
+  }
+  inline UInt32 size() const {
+    return size_;
+  }
+  // Bytes allocated this frame, and allocations which failed
+  inline UInt32 used() const {
+    UInt32 head = head_.load(std::memory_order_relaxed);
+    return head < size_ ? head : size_;
+  }
+  inline UInt32 failed_count() const {
+    return failed_count_.load(std::memory_order_relaxed);
+  }
+
+  // Disable ctors
+  ConstantRing(const ConstantRing &) = delete;
+  ConstantRing &operator=(const ConstantRing &) = delete;
+
+private:
+  UInt8 *memory_;
+  UInt32 size_;
+  // Offset of the next allocation; may run past the size when full
+  std::atomic<UInt32> head_;
+  std::atomic<UInt32> failed_count_;
+  ID3D11Buffer *buffer_;
+
+}; // class ConstantRing
+
+} // namespace sz
+
+#endif
@@ -1,9 +1,44 @@
 #include "crc.h"
 #include <string.h>
-#include <cctype>
 
 namespace abfw
 {
+  namespace
+  {
+    // Lookup tables for slice-by-8: crc_tables[0] is the classic byte at a
+    // time table, crc_tables[k] advances a byte followed by k zero bytes.
+    // Built at start up, before any name is hashed at run time.
+    struct CRCTables
+    {
+      UInt32 crc[8][256];
+      UInt8 upper[256];
+
+      CRCTables()
+      {
+        for (int i = 0; i < 256; ++i)
+        {
+          // Same as clocking in 8 zero bits with Clk()
+          UInt32 r = i;
+          for (int bitcnt = 0; bitcnt < 8; bitcnt++)
+            r = (r >> 1) ^ ((r & 1) ? 0xEDB88320 : 0);
+          crc[0][i] = r;
+          // Only a-z are changed, as std::toupper does in the "C" locale
+          upper[i] = static_cast<UInt8>((i >= 'a' && i <= 'z') ? i - 'a' + 'A' : i);
+        }
+        for (int i = 0; i < 256; ++i)
+        {
+          for (int k = 1; k < 8; ++k)
+          {
+            UInt32 prev = crc[k - 1][i];
+            crc[k][i] = (prev >> 8) ^ crc[0][prev & 0xFF];
+          }
+        }
+      }
+    };
+
+    const CRCTables crc_tables;
+  }
+
   UInt32 CRC::GetCRC(const char* string)
   {
     CRC crc;
@@ -30,6 +65,23 @@ namespace abfw
     return crc.GetU32();
   }
 
+  UInt32 CRC::GetCRC(const void* buffer, size_t length)
+  {
+    CRC crc;
+    const char *bytes = static_cast<const char *>(buffer);
+
+    // Update() takes an int length, so feed large buffers in chunks
+    while (bytes != nullptr && length > 0)
+    {
+      int chunk = length > 0x40000000 ? 0x40000000 : static_cast<int>(length);
+      crc.Update(bytes, chunk);
+      bytes += chunk;
+      length -= chunk;
+    }
+
+    return crc.GetU32();
+  }
+
 
   CRC::CRC(UInt32 _r) : r(_r)
   {
@@ -60,20 +112,41 @@ namespace abfw
       r >>= 1;
   }
 
-  // This does a byte at a time by calculating the
-  // crc bit by bit, lsb first. Slow, but clear.
+  // Slice-by-8: eight bytes are folded into the residual per step, using
+  // one table lookup per byte. Same result as clocking in each bit, lsb first.
   void CRC::Update(const char *buffer, int len, bool toUpper)
   {
-    while (len--)
+    const UInt8 *bytes = reinterpret_cast<const UInt8 *>(buffer);
+    const UInt32 (*t)[256] = crc_tables.crc;
+    const UInt8 *upper = crc_tables.upper;
+    UInt8 b[8];
+
+    while (len >= 8)
     {
-      int bitcnt, byte = *buffer++;
-      if(toUpper)
-        byte = std::toupper(byte);
-      for (bitcnt=0; bitcnt < 8; bitcnt++)
+      if (toUpper)
+      {
+        for (int i = 0; i < 8; ++i)
+          b[i] = upper[bytes[i]];
+      }
+      else
       {
-        Clk(byte & 1);
-        byte >>= 1;
+        memcpy(b, bytes, 8);
       }
+
+      UInt32 lo = r ^ (b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24));
+      r = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^
+        t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+        t[3][b[4]] ^ t[2][b[5]] ^ t[1][b[6]] ^ t[0][b[7]];
+
+      bytes += 8;
+      len -= 8;
+    }
+
+    while (len-- > 0)
+    {
+      UInt8 byte = toUpper ? upper[*bytes] : *bytes;
+      r = (r >> 8) ^ t[0][(r ^ byte) & 0xFF];
+      ++bytes;
     }
   }
 }
@@ -2,6 +2,17 @@
 #define _ABFW_CRC_H
 
 #include "abertay_framework.h"
+#include <cstddef>
+
+// VS2013 does not support constexpr; there the compile-time versions fall
+// back to inline functions evaluated at run time, with the same result
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define ABFW_CONSTEXPR inline
+#define ABFW_CONSTEXPR_VAR const
+#else
+#define ABFW_CONSTEXPR constexpr
+#define ABFW_CONSTEXPR_VAR constexpr
+#endif
 
 namespace abfw
 {
@@ -12,6 +23,22 @@ namespace abfw
   public:
     static UInt32 GetCRC(const char* _pString);
     static UInt32 GetICRC(const char* _pString);
+    // CRC of an arbitrary block of memory, e.g. the contents of a file
+    static UInt32 GetCRC(const void* _pBuffer, size_t _length);
+
+    // Compile-time versions of GetCRC and GetICRC, for literal names; only
+    // hashed at compile time when the result initialises a constant, e.g.
+    // static ABFW_CONSTEXPR_VAR UInt32 kName =
+    //   CRC::ConstICRC("texture_shader");
+    static ABFW_CONSTEXPR UInt32 ConstCRC(const char* _pString)
+    {
+      return _pString ? ~ConstUpdate(_pString, 0xFFFFFFFF, false) : 0;
+    }
+    static ABFW_CONSTEXPR UInt32 ConstICRC(const char* _pString)
+    {
+      return _pString ? ~ConstUpdate(_pString, 0xFFFFFFFF, true) : 0;
+    }
+
     CRC(UInt32 _r=~0);
   private:
     void Update(const char *pbuf, int len, bool toUpper = false); // update crc residual 
@@ -22,6 +49,28 @@ namespace abfw
 
     enum{gf=0xdb710641};  // This is the generator
     UInt32 r;                // residual, polynomial mod gf
+
+    // Clk() applied to a whole byte is the reflected CRC-32 step with
+    // polynomial 0xEDB88320; these are single-return so they can be
+    // constexpr in C++11
+    static ABFW_CONSTEXPR UInt32 ConstClk(UInt32 _r, int _bits)
+    {
+      return _bits == 0 ? _r :
+        ConstClk((_r >> 1) ^ ((_r & 1) ? 0xEDB88320 : 0), _bits - 1);
+    }
+    // Only a-z are changed, as std::toupper does in the "C" locale
+    static ABFW_CONSTEXPR UInt8 ConstToUpper(UInt8 _c)
+    {
+      return (_c >= 'a' && _c <= 'z') ? static_cast<UInt8>(_c - 'a' + 'A') : _c;
+    }
+    static ABFW_CONSTEXPR UInt32 ConstUpdate(const char* _pString, UInt32 _r,
+      bool _toUpper)
+    {
+      return *_pString == 0 ? _r :
+        ConstUpdate(_pString + 1, ConstClk(_r ^ (_toUpper ?
+          ConstToUpper(static_cast<UInt8>(*_pString)) :
+          static_cast<UInt8>(*_pString)), 8), _toUpper);
+    }
   };
 }
 #endif // _CRC_H
\ No newline at end of file
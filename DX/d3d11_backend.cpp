@@ -0,0 +1,266 @@
+#include "d3d11_backend.h"
+#include "abertay_framework.h"
+
+namespace sz {
+
+D3D11Backend::D3D11Backend(ID3D11DeviceContext *context) :
+    context_(context),
+    context1_(nullptr),
+    owns_context_(false) {
+  ID3D11Device *device = nullptr;
+  context_->GetDevice(&device);
+
+  D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+  if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS,
+    &options, sizeof(options))) && options.ConstantBufferOffsetting) {
+    context_->QueryInterface(__uuidof(ID3D11DeviceContext1),
+      reinterpret_cast<void **>(&context1_));
+  }
+  device->Release();
+}
+
+D3D11Backend::~D3D11Backend() {
+  ReleaseNull(context1_);
+  if (owns_context_) {
+    ReleaseNull(context_);
+  }
+}
+
+GfxBackend *D3D11Backend::CreateDeferred() {
+  ID3D11Device *device = nullptr;
+  context_->GetDevice(&device);
+
+  ID3D11DeviceContext *deferred_context = nullptr;
+  HRESULT result = device->CreateDeferredContext(0, &deferred_context);
+  device->Release();
+  if (FAILED(result)) {
+    return nullptr;
+  }
+
+  D3D11Backend *deferred = new D3D11Backend(deferred_context);
+  deferred->owns_context_ = true;
+
+  return deferred;
+}
+
+void D3D11Backend::ExecuteDeferred(GfxBackend *deferred) {
+  ID3D11DeviceContext *deferred_context =
+    static_cast<D3D11Backend *>(deferred)->context_;
+
+  // Neither context keeps its state, which is cheaper
+  ID3D11CommandList *command_list = nullptr;
+  if (FAILED(deferred_context->FinishCommandList(FALSE, &command_list))) {
+    return;
+  }
+  context_->ExecuteCommandList(command_list, FALSE);
+  command_list->Release();
+}
+
+bool D3D11Backend::SupportsConstantBufferOffsets() const {
+  return context1_ != nullptr;
+}
+
+void D3D11Backend::IASetInputLayout(ID3D11InputLayout *layout) {
+  context_->IASetInputLayout(layout);
+}
+
+void D3D11Backend::IASetPrimitiveTopology(
+  D3D11_PRIMITIVE_TOPOLOGY topology) {
+  context_->IASetPrimitiveTopology(topology);
+}
+
+void D3D11Backend::IASetVertexBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *strides, const UINT *offsets) {
+  context_->IASetVertexBuffers(start, count, buffers, strides, offsets);
+}
+
+void D3D11Backend::IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format,
+  UINT offset) {
+  context_->IASetIndexBuffer(buffer, format, offset);
+}
+
+void D3D11Backend::VSSetShader(ID3D11VertexShader *shader) {
+  context_->VSSetShader(shader, nullptr, 0);
+}
+
+void D3D11Backend::HSSetShader(ID3D11HullShader *shader) {
+  context_->HSSetShader(shader, nullptr, 0);
+}
+
+void D3D11Backend::DSSetShader(ID3D11DomainShader *shader) {
+  context_->DSSetShader(shader, nullptr, 0);
+}
+
+void D3D11Backend::GSSetShader(ID3D11GeometryShader *shader) {
+  context_->GSSetShader(shader, nullptr, 0);
+}
+
+void D3D11Backend::PSSetShader(ID3D11PixelShader *shader) {
+  context_->PSSetShader(shader, nullptr, 0);
+}
+
+void D3D11Backend::VSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  context_->VSSetConstantBuffers(start, count, buffers);
+}
+
+void D3D11Backend::HSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  context_->HSSetConstantBuffers(start, count, buffers);
+}
+
+void D3D11Backend::DSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  context_->DSSetConstantBuffers(start, count, buffers);
+}
+
+void D3D11Backend::GSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  context_->GSSetConstantBuffers(start, count, buffers);
+}
+
+void D3D11Backend::PSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  context_->PSSetConstantBuffers(start, count, buffers);
+}
+
+void D3D11Backend::VSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  context1_->VSSetConstantBuffers1(start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void D3D11Backend::HSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  context1_->HSSetConstantBuffers1(start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void D3D11Backend::DSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  context1_->DSSetConstantBuffers1(start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void D3D11Backend::GSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  context1_->GSSetConstantBuffers1(start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void D3D11Backend::PSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  context1_->PSSetConstantBuffers1(start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void D3D11Backend::VSSetShaderResources(UINT start, UINT count,
+  ID3D11ShaderResourceView *const *views) {
+  context_->VSSetShaderResources(start, count, views);
+}
+
+void D3D11Backend::DSSetShaderResources(UINT start, UINT count,
+  ID3D11ShaderResourceView *const *views) {
+  context_->DSSetShaderResources(start, count, views);
+}
+
+void D3D11Backend::PSSetShaderResources(UINT start, UINT count,
+  ID3D11ShaderResourceView *const *views) {
+  context_->PSSetShaderResources(start, count, views);
+}
+
+void D3D11Backend::VSSetSamplers(UINT start, UINT count,
+  ID3D11SamplerState *const *samplers) {
+  context_->VSSetSamplers(start, count, samplers);
+}
+
+void D3D11Backend::DSSetSamplers(UINT start, UINT count,
+  ID3D11SamplerState *const *samplers) {
+  context_->DSSetSamplers(start, count, samplers);
+}
+
+void D3D11Backend::PSSetSamplers(UINT start, UINT count,
+  ID3D11SamplerState *const *samplers) {
+  context_->PSSetSamplers(start, count, samplers);
+}
+
+void D3D11Backend::OMSetBlendState(ID3D11BlendState *state,
+  const FLOAT blend_factor[4], UINT sample_mask) {
+  context_->OMSetBlendState(state, blend_factor, sample_mask);
+}
+
+void D3D11Backend::OMSetDepthStencilState(ID3D11DepthStencilState *state,
+  UINT stencil_ref) {
+  context_->OMSetDepthStencilState(state, stencil_ref);
+}
+
+void D3D11Backend::OMSetRenderTargets(UINT count,
+  ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depth) {
+  context_->OMSetRenderTargets(count, views, depth);
+}
+
+void D3D11Backend::RSSetState(ID3D11RasterizerState *state) {
+  context_->RSSetState(state);
+}
+
+void D3D11Backend::RSSetViewports(UINT count,
+  const D3D11_VIEWPORT *viewports) {
+  context_->RSSetViewports(count, viewports);
+}
+
+HRESULT D3D11Backend::Map(ID3D11Resource *resource, UINT subresource,
+  D3D11_MAP type, UINT flags, D3D11_MAPPED_SUBRESOURCE *mapped) {
+  return context_->Map(resource, subresource, type, flags, mapped);
+}
+
+void D3D11Backend::Unmap(ID3D11Resource *resource, UINT subresource) {
+  context_->Unmap(resource, subresource);
+}
+
+void D3D11Backend::UpdateSubresource(ID3D11Resource *resource,
+  UINT subresource, const D3D11_BOX *box, const void *data, UINT row_pitch,
+  UINT depth_pitch) {
+  context_->UpdateSubresource(resource, subresource, box, data, row_pitch,
+    depth_pitch);
+}
+
+void D3D11Backend::CopyResource(ID3D11Resource *dst, ID3D11Resource *src) {
+  context_->CopyResource(dst, src);
+}
+
+void D3D11Backend::GenerateMips(ID3D11ShaderResourceView *view) {
+  context_->GenerateMips(view);
+}
+
+void D3D11Backend::ClearRenderTargetView(ID3D11RenderTargetView *view,
+  const FLOAT colour[4]) {
+  context_->ClearRenderTargetView(view, colour);
+}
+
+void D3D11Backend::ClearDepthStencilView(ID3D11DepthStencilView *view,
+  UINT flags, FLOAT depth, UINT8 stencil) {
+  context_->ClearDepthStencilView(view, flags, depth, stencil);
+}
+
+void D3D11Backend::Draw(UINT vertex_count, UINT start_vertex) {
+  context_->Draw(vertex_count, start_vertex);
+}
+
+void D3D11Backend::DrawIndexed(UINT index_count, UINT start_index,
+  INT base_vertex) {
+  context_->DrawIndexed(index_count, start_index, base_vertex);
+}
+
+void D3D11Backend::DrawIndexedInstanced(UINT index_count,
+  UINT instance_count, UINT start_index, INT base_vertex,
+  UINT start_instance) {
+  context_->DrawIndexedInstanced(index_count, instance_count, start_index,
+    base_vertex, start_instance);
+}
+
+} // namespace sz
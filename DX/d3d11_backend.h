@@ -0,0 +1,123 @@
+#ifndef _D3D11_BACKEND_H
+#define _D3D11_BACKEND_H
+
+#include <d3d11_1.h>
+#include "gfx_backend.h"
+
+namespace sz {
+
+// Backend which sends the commands to a D3D11 device context
+class D3D11Backend : public GfxBackend {
+public:
+  // Ctor; the context is not owned
+  explicit D3D11Backend(ID3D11DeviceContext *context);
+
+  // Dtor; releases the context of deferred backends
+  ~D3D11Backend();
+
+  inline ID3D11DeviceContext *context() const {
+    return context_;
+  }
+
+  // Deferred backends use deferred contexts, which are turned into command
+  // lists when executed
+  GfxBackend *CreateDeferred();
+  void ExecuteDeferred(GfxBackend *deferred);
+
+  // When the runtime is D3D11.1 and the driver supports it
+  bool SupportsConstantBufferOffsets() const;
+
+  void IASetInputLayout(ID3D11InputLayout *layout);
+  void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+  void IASetVertexBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *strides,
+    const UINT *offsets);
+  void IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format,
+    UINT offset);
+
+  void VSSetShader(ID3D11VertexShader *shader);
+  void HSSetShader(ID3D11HullShader *shader);
+  void DSSetShader(ID3D11DomainShader *shader);
+  void GSSetShader(ID3D11GeometryShader *shader);
+  void PSSetShader(ID3D11PixelShader *shader);
+
+  void VSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void HSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void DSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void GSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void PSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void VSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+  void HSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+  void DSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+  void GSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+  void PSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+
+  void VSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views);
+  void DSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views);
+  void PSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views);
+
+  void VSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers);
+  void DSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers);
+  void PSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers);
+
+  void OMSetBlendState(ID3D11BlendState *state, const FLOAT blend_factor[4],
+    UINT sample_mask);
+  void OMSetDepthStencilState(ID3D11DepthStencilState *state,
+    UINT stencil_ref);
+  void OMSetRenderTargets(UINT count, ID3D11RenderTargetView *const *views,
+    ID3D11DepthStencilView *depth);
+  void RSSetState(ID3D11RasterizerState *state);
+  void RSSetViewports(UINT count, const D3D11_VIEWPORT *viewports);
+
+  HRESULT Map(ID3D11Resource *resource, UINT subresource, D3D11_MAP type,
+    UINT flags, D3D11_MAPPED_SUBRESOURCE *mapped);
+  void Unmap(ID3D11Resource *resource, UINT subresource);
+  void UpdateSubresource(ID3D11Resource *resource, UINT subresource,
+    const D3D11_BOX *box, const void *data, UINT row_pitch,
+    UINT depth_pitch);
+  void CopyResource(ID3D11Resource *dst, ID3D11Resource *src);
+  void GenerateMips(ID3D11ShaderResourceView *view);
+
+  void ClearRenderTargetView(ID3D11RenderTargetView *view,
+    const FLOAT colour[4]);
+  void ClearDepthStencilView(ID3D11DepthStencilView *view, UINT flags,
+    FLOAT depth, UINT8 stencil);
+  void Draw(UINT vertex_count, UINT start_vertex);
+  void DrawIndexed(UINT index_count, UINT start_index,
+    INT base_vertex);
+  void DrawIndexedInstanced(UINT index_count, UINT instance_count,
+    UINT start_index, INT base_vertex, UINT start_instance);
+
+private:
+  ID3D11DeviceContext *context_;
+  // The same context, if the runtime is D3D11.1 and constant buffers can
+  // be bound from an offset
+  ID3D11DeviceContext1 *context1_;
+  bool owns_context_;
+
+}; // class D3D11Backend
+
+} // namespace sz
+
+#endif
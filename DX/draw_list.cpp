@@ -0,0 +1,87 @@
+#include "draw_list.h"
+#include <cstring>
+
+namespace sz {
+
+namespace {
+
+// Draws are added in index order, so the low bits are already sorted; the
+// rest is sorted in digits of 11 bits, which take 4 passes and keep the
+// histograms in cache
+const UInt32 kSortFirstBit = kDrawKeyIndexBits;
+const UInt32 kSortDigitBits = 11;
+const UInt32 kSortDigits = 4;
+const UInt32 kSortRadix = 1 << kSortDigitBits;
+
+} // namespace
+
+DrawList::DrawList() :
+    items_(),
+    keys_(),
+    scratch_() {
+}
+
+void DrawList::Reserve(size_t n) {
+  items_.reserve(n);
+  keys_.reserve(n);
+  scratch_.reserve(n);
+}
+
+void DrawList::Clear() {
+  items_.clear();
+  keys_.clear();
+}
+
+void DrawList::Sort() {
+  const size_t n = keys_.size();
+  if (n < 2) {
+    return;
+  }
+  scratch_.resize(n);
+
+  // Histograms of all the digits of the keys, in a single pass
+  UInt32 counts[kSortDigits][kSortRadix];
+  memset(counts, 0, sizeof(counts));
+  for (size_t i = 0; i < n; ++i) {
+    DrawKey key = keys_[i] >> kSortFirstBit;
+    for (UInt32 d = 0; d < kSortDigits; ++d) {
+      ++counts[d][(key >> (d * kSortDigitBits)) & (kSortRadix - 1)];
+    }
+  }
+
+  // One stable counting pass per digit, least significant first
+  DrawKey *src = keys_.data();
+  DrawKey *dst = scratch_.data();
+  for (UInt32 d = 0; d < kSortDigits; ++d) {
+    const UInt32 shift = kSortFirstBit + d * kSortDigitBits;
+
+    // Skip digits which are the same in all keys
+    UInt32 *count = counts[d];
+    if (count[(src[0] >> shift) & (kSortRadix - 1)] == n) {
+      continue;
+    }
+
+    // Turn counts into offsets
+    UInt32 sum = 0;
+    for (UInt32 v = 0; v < kSortRadix; ++v) {
+      UInt32 c = count[v];
+      count[v] = sum;
+      sum += c;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      dst[count[(src[i] >> shift) & (kSortRadix - 1)]++] = src[i];
+    }
+
+    DrawKey *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  // Make sure the result is in keys_
+  if (src != keys_.data()) {
+    keys_.swap(scratch_);
+  }
+}
+
+} // namespace sz
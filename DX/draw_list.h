@@ -0,0 +1,135 @@
+//  A list of draws, ordered by 64 bit sort keys
+//  * Draws are added with a key encoding pass, state and depth
+//  * The list is ordered with a radix sort, which is linear in the number
+//    of draws
+//  * Storage is kept between frames, so that building the list does not
+//    allocate once it has grown to the size of the scene
+
+#ifndef _DRAW_LIST_H
+#define _DRAW_LIST_H
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include "abertay_framework.h"
+
+class BaseMesh;
+class BaseShader;
+class Model;
+
+namespace sz {
+
+class Material;
+
+// Passes, in the order they are drawn
+enum DrawPass {
+  kDrawPassOpaque = 0,
+  kDrawPassAlpha = 1
+};
+
+// Sort key of a draw. From the most significant bit:
+//  * opaque: pass (2) | shader (10) | material (14) | depth (16) | 0 (22);
+//    draws are grouped by state, then front to back within a group
+//  * alpha: pass (2) | inverted depth (16) | shader (10) | material (14) |
+//    0 (22); draws are back to front, as blending needs
+// The low bits are filled in by the draw list with the index of the draw,
+// so that sorting moves 8 bytes per draw.
+typedef UInt64 DrawKey;
+
+const UInt32 kDrawKeyShaderBits = 10;
+const UInt32 kDrawKeyMaterialBits = 14;
+const UInt32 kDrawKeyDepthBits = 16;
+const UInt32 kDrawKeyIndexBits = 22;
+
+// Quantise a view space depth so that the order of keys is the order of
+// depths; depths behind the camera count as 0
+inline UInt32 QuantiseDrawDepth(float view_z) {
+  union {
+    float f;
+    UInt32 u;
+  } bits;
+  bits.f = view_z > 0.f ? view_z : 0.f;
+  // The bits of positive floats sort like the floats themselves; keep the
+  // exponent and the top of the mantissa, which is plenty to order draws
+  return bits.u >> (32 - 1 - kDrawKeyDepthBits);
+}
+
+inline DrawKey MakeOpaqueDrawKey(UInt32 shader, UInt32 material,
+  float view_z) {
+  return (static_cast<DrawKey>(kDrawPassOpaque) << 62) |
+    (static_cast<DrawKey>(shader & 0x3FF) << 52) |
+    (static_cast<DrawKey>(material & 0x3FFF) << 38) |
+    (static_cast<DrawKey>(QuantiseDrawDepth(view_z) & 0xFFFF) << 22);
+}
+
+inline DrawKey MakeAlphaDrawKey(UInt32 shader, UInt32 material,
+  float view_z) {
+  UInt32 depth = 0xFFFF - (QuantiseDrawDepth(view_z) & 0xFFFF);
+  return (static_cast<DrawKey>(kDrawPassAlpha) << 62) |
+    (static_cast<DrawKey>(depth) << 46) |
+    (static_cast<DrawKey>(shader & 0x3FF) << 36) |
+    (static_cast<DrawKey>(material & 0x3FFF) << 22);
+}
+
+inline DrawPass GetDrawPass(DrawKey key) {
+  return static_cast<DrawPass>(key >> 62);
+}
+
+// What a draw needs to be issued
+struct DrawItem {
+  const Material *material;
+  BaseShader *shader;
+  BaseMesh *mesh;
+  // Model whose buffers hold the mesh, or nullptr if the mesh owns its
+  // buffers and transform
+  Model *model;
+  // Range of the instance buffer drawn with the geometry of mesh; a count
+  // of 0 draws the mesh on its own
+  UInt32 instance_start;
+  UInt32 instance_count;
+};
+
+class DrawList {
+public:
+  DrawList();
+
+  // Make room for n draws
+  void Reserve(size_t n);
+
+  // Remove all draws, keeping the storage
+  void Clear();
+
+  // Add a draw; at most 1 << kDrawKeyIndexBits draws fit in a list
+  inline void Add(DrawKey key, const DrawItem &item) {
+    assert(items_.size() < (1 << kDrawKeyIndexBits));
+    keys_.push_back(key | items_.size());
+    items_.push_back(item);
+  }
+
+  // Order draws by key; draws with equal keys keep the order they were
+  // added in
+  void Sort();
+
+  inline size_t size() const {
+    return keys_.size();
+  }
+  // Draws and their keys, in sorted order after Sort()
+  inline const DrawItem &item(size_t i) const {
+    return items_[keys_[i] & ((1 << kDrawKeyIndexBits) - 1)];
+  }
+  inline DrawKey key(size_t i) const {
+    return keys_[i] & ~static_cast<DrawKey>((1 << kDrawKeyIndexBits) - 1);
+  }
+
+private:
+  std::vector<DrawItem> items_;
+  // Keys, with the index of their draw in the low bits
+  std::vector<DrawKey> keys_;
+  // Ping-pong buffer of the sort
+  std::vector<DrawKey> scratch_;
+
+}; // class DrawList
+
+} // namespace sz
+
+#endif
@@ -1,6 +1,7 @@
 
 #include "forward_renderer.h"
 #include <d3d11.h>
+#include <cstring>
 #include <directxmath.h>
 #include "shader_resource_manager.h"
 #include "buffer_resource_manager.h"
@@ -8,68 +9,361 @@
 #include "OrthoMesh.h"
 #include "d3d.h"
 #include "BaseShader.h"
+#include "DepthShader.h"
 #include "normal_mapping_shader.h"
 #include "Model.h"
+#include "Texture.h"
 #include "buffer_types.h"
 #include <cassert>
 #include <imgui.h>
 #include "gaussian_blur.h"
 #include "Timer.h"
-#include <stack>
+#include "virtual_texture_system.h"
+#include "vt_feedback_shader.h"
+#include "state_cache.h"
+#include "command_list.h"
+#include "constant_ring.h"
+#include "worker_pool.h"
+#include "pipeline_stats.h"
 #include <vector>
+#include <thread>
 
 namespace sz {
 
+// Size of the constant ring, enough for the constant buffers of all the
+// passes of a frame
+const UInt32 kConstantRingSize = 4 * 1024 * 1024;
+
 ForwardRenderer::ForwardRenderer(const unsigned int scr_height, 
   const unsigned int scr_width,
   const float scr_depth, const float scr_near, ID3D11Device* device,
   HWND hwnd, ConstBufManager *buf_man, ShaderManager *sha_man,
-  const size_t lights_num, const Timer &timer) :
+  const size_t lights_num, const UInt32 shadow_atlas_size,
+  const Timer &timer) :
   Renderer(scr_height, scr_width, scr_depth, scr_near, device, hwnd, buf_man,
-  sha_man, lights_num, timer)
+  sha_man, lights_num, shadow_atlas_size, timer),
+  model_transform_(),
+  vt_system_(nullptr),
+  virtual_texturing_(false),
+  vt_feedback_shader_id_(NameInterner::Inst()->Intern("vt_feedback_shader")),
+  scene_target_(0),
+  workers_(nullptr),
+  command_lists_(),
+  mt_recording_check_(false),
+  constant_ring_(nullptr),
+  constant_ring_check_(true),
+  depth_prepass_check_(false),
+  depth_equal_state_(nullptr),
+  prepass_draw_count_(0),
+  prepass_triangle_count_(0),
+  main_pass_stats_(nullptr)
 {
+  // The models are drawn at a tenth of their size
+  XMStoreFloat4x4(&model_transform_, XMMatrixScaling(0.1f, 0.1f, 0.1f));
+
+  // Feedback is rendered at 1/8 of the screen size
+  vt_system_ = new VirtualTextureSystem(device, hwnd, *buf_man, sha_man,
+    scr_width / 8, scr_height / 8);
+  vt_system_->set_mip_bias(-3.f);
+
+  // The main thread records too
+  UInt32 cores = std::thread::hardware_concurrency();
+  workers_ = new WorkerPool(cores > 1 ? cores - 1 : 1);
+
+  GfxBackend *backend = StateCache::Inst()->backend();
+  for (size_t i = 0; i < lights_num + 1; ++i) {
+    command_lists_.push_back(new CommandList(backend));
+  }
+
+  if (backend->SupportsConstantBufferOffsets()) {
+    constant_ring_ = new ConstantRing(device, kConstantRingSize);
+  }
+
+  // Draws whose depth is in the pre-pass only pass where it is theirs
+  D3D11_DEPTH_STENCIL_DESC depth_equal_desc;
+  ZeroMemory(&depth_equal_desc, sizeof(depth_equal_desc));
+  depth_equal_desc.DepthEnable = true;
+  depth_equal_desc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+  depth_equal_desc.DepthFunc = D3D11_COMPARISON_EQUAL;
+  depth_equal_desc.StencilEnable = false;
+  device->CreateDepthStencilState(&depth_equal_desc, &depth_equal_state_);
+
+  main_pass_stats_ = new PipelineStats(device);
+}
+
+ForwardRenderer::~ForwardRenderer() {
+  if (vt_system_ != nullptr) {
+    delete vt_system_;
+    vt_system_ = nullptr;
+  }
+
+  for (CommandList *list : command_lists_) {
+    delete list;
+  }
+  command_lists_.clear();
+
+  if (constant_ring_ != nullptr) {
+    delete constant_ring_;
+    constant_ring_ = nullptr;
+  }
+
+  ReleaseNull(depth_equal_state_);
+  if (main_pass_stats_ != nullptr) {
+    delete main_pass_stats_;
+    main_pass_stats_ = nullptr;
+  }
+
+  if (workers_ != nullptr) {
+    delete workers_;
+    workers_ = nullptr;
+  }
 }
 
 void ForwardRenderer::Render(D3D *d3d, Camera *cam,
-  std::vector<Light> *lights) {
+  LightSystem *lights) {
   sha_man_->CleanupShaderResources(d3d->GetDeviceContext());
 
-  // Render scene from the lights' point of view
-  for (size_t i = 0; i < lights->size(); ++i) {
-    RenderSceneDepthFromLight(*(render_targets_depth_[i]), d3d, (&(*lights)[i]));
+  // Before the passes, which may be recorded at the same time
+  UpdateMeshBounds();
+  XMMATRIX model_transform = XMLoadFloat4x4(&model_transform_);
+  SelectShadowLights(*lights, cam, model_transform);
+  UpdateLightClusters(*lights, cam, workers_);
+  {
+    XMMATRIX view_matrix;
+    cam->GetViewMatrix(view_matrix);
+    RenderOccluders(model_transform,
+      XMMatrixMultiply(view_matrix, XMLoadFloat4x4(&screen_projection_)),
+      workers_);
   }
 
-  // Render scene to a target
-  RenderToTexture(*render_target_main_, d3d, cam, lights);
+  ImGui::Checkbox("Multithreaded draw recording", &mt_recording_check_);
+  const bool record_lists = mt_recording_check_ &&
+    command_lists_.back()->valid() &&
+    shadow_light_count(*lights) < command_lists_.size();
 
+  // The passes are declared before they are recorded, so that the targets
+  // they render to are known
   ImGui::Checkbox("Apply post processing", &use_post_process_);
+  BuildFrameGraph(d3d, cam, lights, record_lists);
+  bool compiled = frame_graph_->Compile();
+  assert(compiled);
+
+  if (record_lists) {
+    // Constants of all the passes go to the ring, which is uploaded once
+    // they were all recorded
+    ConstantRing *ring = constant_ring_check_ ? constant_ring_ : nullptr;
+    if (ring != nullptr) {
+      ring->Reset();
+    }
+    for (CommandList *list : command_lists_) {
+      list->set_constant_ring(ring);
+    }
+
+    RecordPasses(d3d, cam, lights);
+
+    if (ring != nullptr) {
+      ring->Upload(StateCache::Inst()->backend());
+    }
+  }
+
+  if (constant_ring_ != nullptr) {
+    ImGui::Checkbox("Constant upload ring", &constant_ring_check_);
+    ImGui::Text("Constants: %u KB in the ring, %u written, %u unchanged, "
+      "%u did not fit", constant_ring_->used() / 1024,
+      StateCache::Inst()->frame_stats().ring_written,
+      StateCache::Inst()->frame_stats().ring_unchanged,
+      constant_ring_->failed_count());
+  }
+
+  // Feedback of the pages, shadow maps, scene, post processing and back
+  // buffer
+  if (compiled) {
+    frame_graph_->Execute();
+  }
+
+  ImGui::Text("Frame graph: %u passes, %u culled; %u targets in %u, "
+    "%u KB instead of %u KB, %u KB pooled", frame_graph_->pass_count(),
+    frame_graph_->culled_count(), frame_graph_->transient_count(),
+    frame_graph_->physical_count(),
+    static_cast<UInt32>(frame_graph_->physical_bytes() / 1024),
+    static_cast<UInt32>(frame_graph_->transient_bytes() / 1024),
+    static_cast<UInt32>(frame_graph_->pooled_bytes() / 1024));
+  for (FrameResource r = 0; r < frame_graph_->resource_count(); ++r) {
+    const RenderTexture *target = frame_graph_->target(r);
+    if (target == nullptr) {
+      continue;
+    }
+
+    // Targets which were given the texture of an earlier one add nothing
+    FrameResource shared = r;
+    for (FrameResource other = 0; other < r; ++other) {
+      if (frame_graph_->target(other) == target) {
+        shared = other;
+        break;
+      }
+    }
+    if (shared != r) {
+      ImGui::Text("  %s: in %s", frame_graph_->name(r).c_str(),
+        frame_graph_->name(shared).c_str());
+    }
+    else {
+      ImGui::Text("  %s: %dx%d, %u KB", frame_graph_->name(r).c_str(),
+        target->GetTextureWidth(), target->GetTextureHeight(),
+        static_cast<UInt32>(target->memory_bytes() / 1024));
+    }
+  }
+
   ImGui::Checkbox("Apply vertex manipulation", &vertex_manip_check_);
   ImGui::Checkbox("Apply tessellation", &tessellate_check_);
 
-  if (use_post_process_) {
-    sha_man_->CleanupShaderResources(d3d->GetDeviceContext());
-    XMMATRIX base_view;
-    cam->GetBaseViewMatrix(base_view);
-    post_processer_->ApplyPostProcess(
-      *render_target_main_,
-      d3d,
-      base_view,
-      XMMatrixIdentity()
-      );
-  }
-
-  d3d->BeginScene(0.39f, 0.58f, 0.92f, 1.0f);
-  // Render the main target on the back buffer
-  XMMATRIX base_view_matrix;
-  cam->GetBaseViewMatrix(base_view_matrix);
-  RenderToBackBuffer(*render_target_main_, d3d, base_view_matrix);
+  ImGui::SliderInt("Shadow maps per frame", &shadow_budget_, 1,
+    static_cast<int>(shadow_light_count(*lights)));
+  ImGui::Text("Shadows: %u rendered, %u reused, %u waiting",
+    shadow_cache_.rendered_count(), shadow_cache_.reused_count(),
+    shadow_cache_.waiting_count());
+  ImGui::Checkbox("Fit shadow frustums", &shadow_fit_check_);
+  ImGui::Text("Shadow fit: %.1fx texels on what the maps hold",
+    shadow_fit_gain_);
+  // Window of each fitted map, as tangents at a distance of 1 from the
+  // light, and its planes
+  for (size_t i = 0; i < shadow_lights_.size(); ++i) {
+    if (!shadow_fitted_[i]) {
+      continue;
+    }
+    const ShadowFrustum &frustum = shadow_frusta_[i];
+    ImGui::Text("  light %u: x %.2f to %.2f, y %.2f to %.2f, "
+      "z %.1f to %.1f, %.1fx", static_cast<UInt32>(i), frustum.left,
+      frustum.right, frustum.bottom, frustum.top, frustum.near_z,
+      frustum.far_z, shadow_fit_gains_[i]);
+  }
+  ImGui::Text("Shadow atlas: %ux%u, %.0f%% used, %u moved, %u dropped%s",
+    shadow_atlas_.size(), shadow_atlas_.size(),
+    100.0 * static_cast<double>(shadow_atlas_.used_texels()) /
+    (static_cast<double>(shadow_atlas_.size()) * shadow_atlas_.size()),
+    shadow_moved_count_, shadow_atlas_.dropped_count(),
+    shadow_atlas_.repacked() ? ", repacked" : "");
+
+  ImGui::Checkbox("Frustum culling", &cull_check_);
+  ImGui::Checkbox("Occlusion culling", &occlusion_check_);
+  UInt32 light_visible = 0, light_culled = 0;
+  for (size_t i = 0; i < shadow_light_count(*lights); ++i) {
+    light_visible += light_culls_[i].visible_count;
+    light_culled += light_culls_[i].culled_count;
+  }
+  ImGui::Text("Culling: camera %u visible, %u culled, %u occluded",
+    camera_cull_.visible_count, camera_cull_.culled_count,
+    camera_cull_.occluded_count);
+  ImGui::Text("Culling: lights %u visible, %u culled", light_visible,
+    light_culled);
+
+  ImGui::Text("Clustered lights: %u in %ux%ux%u clusters, %u indices, "
+    "at most %u in a cluster, %u did not fit",
+    static_cast<UInt32>(cluster_lights_.size()), light_clusters_->tiles_x(),
+    light_clusters_->tiles_y(), kClusterSlices,
+    light_clusters_->index_count(), light_clusters_->max_cluster_count(),
+    light_clusters_->overflow_count());
+  ImGui::Checkbox("Per-draw lights", &draw_lights_check_);
+  ImGui::Text("Per-draw lights: %u draws, %u reached by more than %u",
+    draw_lights_count_, draw_lights_truncated_, kMaxDrawLights);
+
+  ImGui::Checkbox("Depth pre-pass", &depth_prepass_check_);
+  ImGui::Text("Depth pre-pass: %u draws, %u triangles", prepass_draw_count_,
+    prepass_triangle_count_);
+  ImGui::Text("Main pass: %llu pixels shaded, %llu primitives",
+    main_pass_stats_->ps_invocations(), main_pass_stats_->primitives());
+
+  ImGui::Checkbox("Instanced drawing", &instancing_check_);
+  ImGui::Text("Instancing: %u meshes in %u draws", instanced_mesh_count_,
+    instanced_draw_count_);
 
   // Present the rendered final frame to the screen.
   //d3d->EndScene();
 }
 
+void ForwardRenderer::BuildFrameGraph(D3D *d3d, Camera *cam,
+  LightSystem *lights, bool record_lists) {
+  FrameGraph &graph = *frame_graph_;
+  graph.Reset();
+
+  scene_target_ = graph.CreateTarget("scene", screen_target_desc_);
+  FrameResource back_buffer = graph.ImportTarget("back_buffer", nullptr);
+
+  // The pages the main pass samples stream in from the feedback of earlier
+  // frames. Its target belongs to the VT system, and is imported so that
+  // the pass is kept; it runs on the main thread, after the lists of the
+  // other passes were recorded.
+  if (virtual_texturing_) {
+    FrameResource feedback = graph.ImportTarget("vt_feedback", nullptr);
+    FramePass pass = graph.AddPass("vt_feedback", [this, d3d, cam] {
+      RenderVirtualTextureFeedback(d3d, cam);
+    });
+    graph.Write(pass, feedback);
+  }
+
+  // The main pass reads all the maps, whether they are rendered again this
+  // frame or kept from an earlier one
+  FrameResource shadow_atlas = graph.ImportTarget(
+    shadow_atlas_target_->name(), shadow_atlas_target_);
+
+  // The maps rendered this frame are tiles of the one atlas, so that a
+  // single pass renders them all, one after the other; recorded maps only
+  // execute their list
+  FramePass pass = graph.AddPass("shadows",
+    [this, d3d, lights, record_lists] {
+    for (size_t i = 0; i < shadow_light_count(*lights); ++i) {
+      if (!shadow_lights_[i]) {
+        continue;
+      }
+      if (record_lists) {
+        command_lists_[i]->Execute();
+      }
+      else {
+        RenderSceneDepthFromLight(*shadow_atlas_target_, d3d, *lights,
+          static_cast<UInt32>(i), light_culls_[i]);
+      }
+    }
+  });
+  graph.Write(pass, shadow_atlas);
+
+  CommandList *main_list = record_lists ? command_lists_.back() : nullptr;
+  FrameResource scene = scene_target_;
+  pass = graph.AddPass("main",
+    [this, main_list, scene, d3d, cam, lights] {
+    main_pass_stats_->Begin(d3d->GetDeviceContext());
+    if (main_list != nullptr) {
+      main_list->Execute();
+    }
+    else {
+      RenderToTexture(*frame_graph_->target(scene), d3d, cam, lights);
+    }
+    main_pass_stats_->End(d3d->GetDeviceContext());
+  });
+  graph.Read(pass, shadow_atlas);
+  graph.Write(pass, scene);
+
+  XMMATRIX base_view_matrix;
+  cam->GetBaseViewMatrix(base_view_matrix);
+
+  FrameResource final_target = scene;
+  if (use_post_process_) {
+    final_target = post_processer_->AddPasses(graph, scene, d3d,
+      base_view_matrix, XMMatrixIdentity());
+  }
+
+  // Render the final target on the back buffer
+  XMFLOAT4X4 base_view;
+  XMStoreFloat4x4(&base_view, base_view_matrix);
+  pass = graph.AddPass("back_buffer", [this, final_target, d3d, base_view] {
+    d3d->BeginScene(0.39f, 0.58f, 0.92f, 1.0f);
+    RenderToBackBuffer(*frame_graph_->target(final_target), d3d,
+      XMLoadFloat4x4(&base_view));
+  });
+  graph.Read(pass, final_target);
+  graph.Write(pass, back_buffer);
+}
+
 void ForwardRenderer::RenderToTexture(RenderTexture &target, D3D *d3d,
-  Camera *cam, std::vector<Light> *lights) {
+  Camera *cam, LightSystem *lights) {
   // Set the render target to be the main render target
   target.SetRenderTarget(d3d->GetDeviceContext());
 
@@ -78,7 +372,6 @@ void ForwardRenderer::RenderToTexture(RenderTexture &target, D3D *d3d,
     0.0f, 0.0f, 0.0f, 1.0f);
 
   XMMATRIX world_matrix, view_matrix, projection_matrix;
-  std::stack<size_t, std::vector<size_t>> alpha_blended_meshes;
 
   // Set per-frame shader paramters
   SetFrameParameters(d3d->GetDeviceContext(), *lights, cam);
@@ -88,120 +381,230 @@ void ForwardRenderer::RenderToTexture(RenderTexture &target, D3D *d3d,
   cam->GetViewMatrix(view_matrix);
   projection_matrix = target.GetProjectionMatrix();
 
-  XMMATRIX model_transform = XMMatrixScaling(0.1f, 0.1f, 0.1f) /**
-    XMMatrixTranslation(10.f, -20.f, 0.f)*/;
-  // Create a base shader
-  BaseShader *shader = nullptr;
-  BaseShader *prev_shader = nullptr;
+  XMMATRIX model_transform = XMLoadFloat4x4(&model_transform_);
+
+  XMMATRIX view_proj = XMMatrixMultiply(view_matrix, projection_matrix);
+  CullMeshes(model_transform, view_proj, camera_cull_);
+  OccludeMeshes(model_transform, view_proj, camera_cull_);
+
+  // Opaque draws grouped by state and front to back, then alpha-mapped
+  // ones back to front
+  BuildDrawList(model_transform, view_matrix, camera_cull_);
+  draw_list_.Sort();
+  UploadInstances();
+
+  // Matrices of all the draws, worked out together; instances carry their
+  // own world matrices, and the meshes of a model share its transform
+  transform_batch_.Begin(view_matrix, projection_matrix);
+  draw_transforms_.resize(draw_list_.size());
+  for (size_t i = 0; i < draw_list_.size(); ++i) {
+    const DrawItem &draw = draw_list_.item(i);
+    if (draw.instance_count > 0) {
+      draw_transforms_[i] = transform_batch_.Add(XMMatrixIdentity());
+    }
+    else if (draw.model != nullptr) {
+      draw_transforms_[i] = transform_batch_.Add(model_transform);
+    }
+    else {
+      draw_transforms_[i] = transform_batch_.Add(draw.mesh->transform());
+    }
+  }
+  transform_batch_.Compute();
+
+  // Depth of the opaque meshes of the models first, so that the lit shaders
+  // only run for the pixels which are seen. Tessellation and waves move
+  // vertices where the depth shader would not. In recorded frames it goes
+  // to the list of the main pass; the depth shader writes the matrices of
+  // its draws through the cache of the recording thread, so the shadow
+  // passes recorded with it on other threads are unaffected.
+  const bool depth_prepass = depth_prepass_check_ && !tessellate_ &&
+    !manip_vertices_;
+  prepass_draw_count_ = 0;
+  prepass_triangle_count_ = 0;
+  if (depth_prepass) {
+    RenderDepthPrePass(d3d);
+  }
 
-  // For all the models
-  for (Model *model : models_) {
-    model->SendData(d3d->GetDeviceContext(), tessellate_);
+  // Lights of each draw, or the lists of the clusters for all of them
+  SelectDrawLights(model_transform);
+  if (draw_lights_.empty()) {
+    DrawLightBufferType cluster_lights;
+    memset(&cluster_lights, 0, sizeof(cluster_lights));
+    cluster_lights.count = kNoDrawLights;
+    SetDrawLights(cluster_lights);
+  }
 
-    // For all the meshes in the model
-    //std::stack<size_t> alpha_blended_meshes;
-    // For all the entries in the map
-    for (auto map_pair : model->meshes_by_material()) {
-      MatMeshPair &pair = map_pair.second;
+  const Material *prev_material = nullptr;
+  BaseShader *prev_shader = nullptr;
+  Model *prev_model = nullptr;
+  bool prev_instanced = false;
+  bool blending = false;
+  bool depth_equal = false;
+  UInt32 prev_virtual = kNoVirtualTexture;
+  if (virtual_texturing_) {
+    SetVirtualTexture(d3d, kNoVirtualTexture);
+  }
 
-      if (pair.first->alpha_texname != "") {
-        continue;
+  for (size_t i = 0; i < draw_list_.size(); ++i) {
+    const DrawItem &draw = draw_list_.item(i);
+    const MatrixBufferType *transforms =
+      &transform_batch_.entry(draw_transforms_[i]);
+
+    // Materials whose diffuse texture was cooked sample its virtual one
+    if (virtual_texturing_) {
+      UInt32 texture = vt_system_->GetTexture(
+        draw.material->info().diffuse_texname_crc);
+      if (texture != prev_virtual) {
+        SetVirtualTexture(d3d, texture);
+        prev_virtual = texture;
       }
+    }
 
-      // Get the shader associated
-      shader = sha_man_->GetShader(
-        pair.first->shader_name);
-      if (shader == nullptr) {
-        continue;
-      }
+    if (!blending && GetDrawPass(draw_list_.key(i)) == kDrawPassAlpha) {
+      d3d->TurnOnAlphaBlending();
+      blending = true;
+    }
 
-      if (shader != prev_shader) {
-        shader->SetInputLayoutAndShaders(d3d->GetDeviceContext());
-        shader->SetSamplers(d3d->GetDeviceContext());
-      }
-      // Set the parameters for this shader
-      shader->SetShaderParameters(d3d->GetDeviceContext(),
-        model_transform, view_matrix, projection_matrix,
-        *(pair.first));
-      // Set DX shaders and input layout
+    if (!draw_lights_.empty()) {
+      SetDrawLights(draw_lights_[i]);
+    }
 
-      // For all the meshes associated with it
-      for (BaseMesh *mesh : pair.second) {
-        shader->Render(d3d->GetDeviceContext(),
-          mesh->GetIndicesSize(), mesh->index_offset(),
-          mesh->vertex_offset());
+    // The others are tested and write their depth as usual, so that alpha
+    // mapped meshes blend over what is behind them
+    bool in_prepass = depth_prepass && InDepthPrePass(i);
+    if (in_prepass != depth_equal) {
+      if (in_prepass) {
+        StateCache::Inst()->OMSetDepthStencilState(depth_equal_state_, 1);
       }
-
-      prev_shader = shader;
+      else {
+        d3d->TurnZBufferOn();
+      }
+      depth_equal = in_prepass;
     }
-    // Render alpha-mapped shapes
-    d3d->TurnOnAlphaBlending();
-    for (auto map_pair : model->meshes_by_material()) {
-      MatMeshPair &pair = map_pair.second;
 
-      if (pair.first->alpha_texname == "") {
-        continue;
+    // Set DX shaders and input layout
+    bool instanced = draw.instance_count > 0;
+    if (draw.shader != prev_shader || instanced != prev_instanced) {
+      if (instanced) {
+        draw.shader->SetInstancedInputLayoutAndShaders(
+          d3d->GetDeviceContext());
       }
-
-      // Get the shader associated
-      shader = sha_man_->GetShader(
-        pair.first->shader_name);
-      if (shader == nullptr) {
-        continue;
+      else {
+        draw.shader->SetInputLayoutAndShaders(d3d->GetDeviceContext());
       }
+      draw.shader->SetSamplers(d3d->GetDeviceContext());
+      prev_material = nullptr;
+    }
 
-      if (shader != prev_shader) {
-        shader->SetInputLayoutAndShaders(d3d->GetDeviceContext());
-        shader->SetSamplers(d3d->GetDeviceContext());
+    if (instanced) {
+      // The transforms come with the instances, next to the geometry of
+      // the first mesh
+      draw.shader->set_draw_transforms(transforms);
+      draw.shader->SetShaderParameters(d3d->GetDeviceContext(),
+        XMMatrixIdentity(), view_matrix, projection_matrix,
+        *(draw.material));
+      draw.shader->set_draw_transforms(nullptr);
+      draw.mesh->SendData(d3d->GetDeviceContext());
+
+      UINT stride = sizeof(InstanceType);
+      UINT offset = 0;
+      StateCache::Inst()->IASetVertexBuffers(1, 1, &instance_buf_, &stride,
+        &offset);
+      draw.shader->RenderInstanced(d3d->GetDeviceContext(),
+        draw.mesh->GetIndexCount(), draw.instance_count,
+        draw.instance_start);
+
+      prev_model = nullptr;
+      prev_material = nullptr;
+    }
+    else if (draw.model != nullptr) {
+      // Meshes of a model share its buffers and transform
+      if (draw.model != prev_model) {
+        draw.model->SendData(d3d->GetDeviceContext(), tessellate_);
+        prev_model = draw.model;
       }
-      // Set the parameters for this shader
-      shader->SetShaderParameters(d3d->GetDeviceContext(),
-        model_transform, view_matrix, projection_matrix,
-        *(pair.first));
-      // Set DX shaders and input layout
 
-      // For all the meshes associated with it
-      for (BaseMesh *mesh : pair.second) {
-        shader->Render(d3d->GetDeviceContext(),
-          mesh->GetIndicesSize(), mesh->index_offset(),
-          mesh->vertex_offset());
+      // Set the parameters for this shader
+      if (draw.material != prev_material) {
+        draw.shader->set_draw_transforms(transforms);
+        draw.shader->SetShaderParameters(d3d->GetDeviceContext(),
+          model_transform, view_matrix, projection_matrix,
+          *(draw.material));
+        draw.shader->set_draw_transforms(nullptr);
+        prev_material = draw.material;
       }
 
-      prev_shader = shader;
+      draw.shader->Render(d3d->GetDeviceContext(),
+        draw.mesh->GetIndicesSize(), draw.mesh->index_offset(),
+        draw.mesh->vertex_offset());
+    }
+    else {
+      // Meshes which do not belong to a model have their own buffers and
+      // transform
+      draw.shader->set_draw_transforms(transforms);
+      draw.shader->SetShaderParameters(d3d->GetDeviceContext(),
+        draw.mesh->transform(), view_matrix, projection_matrix,
+        *(draw.material));
+      draw.shader->set_draw_transforms(nullptr);
+      draw.mesh->SendData(d3d->GetDeviceContext());
+      draw.shader->Render(d3d->GetDeviceContext(),
+        draw.mesh->GetIndexCount());
+
+      prev_model = nullptr;
+      prev_material = nullptr;
     }
+
+    prev_shader = draw.shader;
+    prev_instanced = instanced;
+  }
+
+  if (blending) {
     d3d->TurnOffAlphaBlending();
   }
+  if (depth_equal) {
+    d3d->TurnZBufferOn();
+  }
+}
 
-  // For all the meshes which do not belong to a model
-  //std::stack<size_t> alpha_blended_meshes;
-   //For all the entries in the map
-  for (auto map_pair : meshes_by_material_) {
-    MatMeshPair &pair = map_pair.second;
+void ForwardRenderer::RenderDepthPrePass(D3D *d3d) {
+  BaseShader *shader = sha_man_->GetShader(depth_shader_id_);
+  if (shader == nullptr) {
+    return;
+  }
+
+  // Positions only, from the same vertices, and no pixel shader
+  shader->SetInputLayoutAndShaders(d3d->GetDeviceContext());
 
-    // Get the shader associated
-    shader = sha_man_->GetShader(
-      pair.first->shader_name);
-    if (shader == nullptr) {
+  Model *prev_model = nullptr;
+  for (size_t i = 0; i < draw_list_.size(); ++i) {
+    if (!InDepthPrePass(i)) {
       continue;
     }
 
-    // Set the parameters for this shader
-    // Set DX shaders and input layout
-    shader->SetSamplers(d3d->GetDeviceContext());
-    shader->SetInputLayoutAndShaders(d3d->GetDeviceContext());
-
-    // For all the meshes associated with it
-    for (BaseMesh *mesh : pair.second) {
-      shader->SetShaderParameters(d3d->GetDeviceContext(),
-        mesh->transform(), view_matrix, projection_matrix,
-        *(pair.first));
-      mesh->SendData(d3d->GetDeviceContext());
-      shader->Render(d3d->GetDeviceContext(),
-        mesh->GetIndexCount());
-
+    // Meshes of a model share its buffers and transform; the matrices are
+    // those of the main pass, so that the depths come out the same. The
+    // shadow passes use the same shader, so it is given them directly.
+    const DrawItem &draw = draw_list_.item(i);
+    if (draw.model != prev_model) {
+      draw.model->SendData(d3d->GetDeviceContext(), false);
+      static_cast<DepthShader *>(shader)->SetDrawTransforms(
+        d3d->GetDeviceContext(), transform_batch_.entry(draw_transforms_[i]));
+      prev_model = draw.model;
     }
+
+    shader->Render(d3d->GetDeviceContext(),
+      draw.mesh->GetIndicesSize(), draw.mesh->index_offset(),
+      draw.mesh->vertex_offset());
+    ++prepass_draw_count_;
+    prepass_triangle_count_ +=
+      static_cast<UInt32>(draw.mesh->GetIndicesSize() / 3);
   }
+}
 
+bool ForwardRenderer::InDepthPrePass(size_t i) const {
+  const DrawItem &draw = draw_list_.item(i);
+  return GetDrawPass(draw_list_.key(i)) == kDrawPassOpaque &&
+    draw.model != nullptr && draw.instance_count == 0;
 }
 
 void ForwardRenderer::UpdateTessellation(ID3D11DeviceContext* deviceContext) {
@@ -234,25 +637,41 @@ void ForwardRenderer::UpdateVertexManipulation(ID3D11DeviceContext *deviceContex
 
 }
 void ForwardRenderer::RenderSceneDepthFromLight(RenderTexture &target, D3D *d3d,
-  Light *light) {
+  const LightSystem &lights, UInt32 light, CullResult &cull) {
   target.SetRenderTarget(d3d->GetDeviceContext());
 
-  // Clear the render to texture.
-  target.ClearRenderTarget(d3d->GetDeviceContext(),
-    0.0f, 0.0f, 0.0f, 1.0f);
-
-  XMMATRIX world_matrix, view_matrix, projection_matrix;
-  view_matrix = light->GetViewMatrix();
-  projection_matrix = light->GetProjectionMatrix();
-  d3d->GetWorldMatrix(world_matrix);
+  // Render to the tile of the light alone, and clear it by drawing; a
+  // clear of the view would wipe the maps of the other lights
+  const ShadowTile &tile = shadow_atlas_.tile(light);
+  D3D11_VIEWPORT viewport;
+  viewport.TopLeftX = static_cast<float>(tile.x);
+  viewport.TopLeftY = static_cast<float>(tile.y);
+  viewport.Width = static_cast<float>(tile.size);
+  viewport.Height = static_cast<float>(tile.size);
+  viewport.MinDepth = 0.f;
+  viewport.MaxDepth = 1.f;
+  StateCache::Inst()->RSSetViewports(1, &viewport);
 
-  XMMATRIX model_transform = XMMatrixScaling(0.1f, 0.1f, 0.1f) /**
-    XMMatrixTranslation(10.f, -20.f, 0.f)*/;
   // Create a base shader
-  BaseShader *shader = sha_man_->GetShader("depth_shader");
+  BaseShader *shader = sha_man_->GetShader(depth_shader_id_);
   if (shader == nullptr) {
     return;
   }
+  static_cast<DepthShader *>(shader)->ClearViewport(d3d->GetDeviceContext());
+  d3d->TurnZBufferOn();
+
+  XMMATRIX world_matrix, view_matrix, projection_matrix;
+  view_matrix = XMLoadFloat4x4(&lights.view(light));
+  projection_matrix = XMLoadFloat4x4(&shadow_projections_[light]);
+  d3d->GetWorldMatrix(world_matrix);
+
+  XMMATRIX model_transform = XMLoadFloat4x4(&model_transform_);
+
+  // Casters out of the light's reach cannot shadow anything it lights; a
+  // fitted frustum lies within it, and holds all that shadows what is seen
+  CullMeshes(model_transform, XMMatrixMultiply(view_matrix,
+    shadow_fitted_[light] ? projection_matrix :
+    lights.influence_projection(light)), cull);
 
   // Set shaders parameters
   shader->SetShaderParameters(d3d->GetDeviceContext(),
@@ -268,14 +687,19 @@ void ForwardRenderer::RenderSceneDepthFromLight(RenderTexture &target, D3D *d3d,
     model->SendData(d3d->GetDeviceContext());
 
     // For all the entries in the map
-    for (auto map_pair : model->meshes_by_material()) {
-      MatMeshPair &pair = map_pair.second;
+    for (const MeshesMatMap::value_type &map_pair :
+      model->meshes_by_material()) {
+      const MatMeshPair &pair = map_pair.second;
 
     //shader->Render(d3d->GetDeviceContext(),
     //  pair.second[0]->GetIndicesSize(), pair.second[0]->index_offset(),
     //  pair.second[0]->vertex_offset());
       // For all the meshes associated with it
       for (BaseMesh *mesh : pair.second) {
+        if (!IsVisible(*mesh, cull)) {
+          continue;
+        }
+
         shader->Render(d3d->GetDeviceContext(),
           mesh->GetIndicesSize(), mesh->index_offset(),
           mesh->vertex_offset());
@@ -286,11 +710,11 @@ void ForwardRenderer::RenderSceneDepthFromLight(RenderTexture &target, D3D *d3d,
   // For all the meshes which do not belong to a model
   //std::stack<size_t> alpha_blended_meshes;
    //For all the entries in the map
-  for (auto map_pair : meshes_by_material_) {
-    MatMeshPair &pair = map_pair.second;
+  for (const MeshesMatMap::value_type &map_pair : meshes_by_material_) {
+    const MatMeshPair &pair = map_pair.second;
 
     // Skip rendering of depth of geometry positional boxes
-    if (pair.first->shader_name == "geometrybox_shader") {
+    if (pair.first->HasFlag(kMaterialNoShadowCast)) {
       continue;
     }
 
@@ -301,6 +725,10 @@ void ForwardRenderer::RenderSceneDepthFromLight(RenderTexture &target, D3D *d3d,
 
     // For all the meshes associated with it
     for (BaseMesh *mesh : pair.second) {
+      if (!IsVisible(*mesh, cull)) {
+        continue;
+      }
+
       shader->SetShaderParameters(d3d->GetDeviceContext(),
         mesh->transform(), view_matrix, projection_matrix,
         *(pair.first));
@@ -313,4 +741,120 @@ void ForwardRenderer::RenderSceneDepthFromLight(RenderTexture &target, D3D *d3d,
 }
 
 
+void ForwardRenderer::UseVirtualTextures(ID3D11Device *device,
+  ID3D11DeviceContext *dev_context) {
+  // Cooking is slow, so it is done while loading rather than in a frame
+  for (Model *model : models_) {
+    vt_system_->AddModelTextures(device, dev_context, *model);
+  }
+  virtual_texturing_ = true;
+}
+
+void ForwardRenderer::RenderVirtualTextureFeedback(D3D *d3d, Camera *cam) {
+  VtFeedbackShader *shader = static_cast<VtFeedbackShader *>(
+    sha_man_->GetShader(vt_feedback_shader_id_));
+  if (shader == nullptr) {
+    return;
+  }
+
+  vt_system_->BeginFeedbackPass(d3d->GetDeviceContext());
+
+  XMMATRIX view_matrix, projection_matrix;
+  cam->GetViewMatrix(view_matrix);
+  projection_matrix = XMLoadFloat4x4(&screen_projection_);
+
+  XMMATRIX model_transform = XMLoadFloat4x4(&model_transform_);
+
+  shader->SetInputLayoutAndShaders(d3d->GetDeviceContext());
+  shader->SetShaderParameters(d3d->GetDeviceContext(),
+    model_transform, view_matrix, projection_matrix, sz::Material());
+
+  VirtualTextureBufferType vt_params;
+  for (Model *model : models_) {
+    model->SendData(d3d->GetDeviceContext());
+
+    for (const MeshesMatMap::value_type &map_pair :
+      model->meshes_by_material()) {
+      const MatMeshPair &pair = map_pair.second;
+
+      UInt32 texture = vt_system_->GetTexture(pair.first->info().diffuse_texname_crc);
+      if (texture == kNoVirtualTexture) {
+        continue;
+      }
+
+      vt_system_->GetShaderParameters(texture, true, vt_params);
+      shader->SetVirtualTexture(d3d->GetDeviceContext(), vt_params);
+
+      for (BaseMesh *mesh : pair.second) {
+        shader->Render(d3d->GetDeviceContext(),
+          mesh->GetIndicesSize(), mesh->index_offset(),
+          mesh->vertex_offset());
+      }
+    }
+  }
+
+  vt_system_->EndFeedbackPass(d3d->GetDeviceContext());
+  vt_system_->Update(d3d->GetDeviceContext());
+
+  const VtStats &stats = vt_system_->stats();
+  ImGui::Text("VT: %u textures, %u pages requested, %u resident",
+    vt_system_->texture_count(), stats.pages_requested,
+    stats.pages_resident);
+  ImGui::Text("VT: %u loaded, %u evicted, %u deferred",
+    stats.pages_loaded, stats.pages_evicted, stats.pages_deferred);
+}
+
+void ForwardRenderer::SetVirtualTexture(D3D *d3d, UInt32 texture) {
+  // The VirtualTextureBuffer belongs to the feedback shader
+  VtFeedbackShader *shader = static_cast<VtFeedbackShader *>(
+    sha_man_->GetShader(vt_feedback_shader_id_));
+  if (shader == nullptr) {
+    return;
+  }
+
+  VirtualTextureBufferType vt_params;
+  vt_system_->GetShaderParameters(texture, false, vt_params);
+  shader->SetVirtualTexture(d3d->GetDeviceContext(), vt_params);
+
+  // Same slots as vt_indirection and vt_cache in virtual_texture.hlsl
+  ID3D11ShaderResourceView *views[2] = {
+    texture != kNoVirtualTexture ? vt_system_->indirection_view(texture) :
+      nullptr,
+    Texture::Inst()->GetTexture(vt_system_->cache_texture())
+  };
+  StateCache::Inst()->PSSetShaderResources(5, 2, views);
+}
+
+void ForwardRenderer::RecordPasses(D3D *d3d, Camera *cam,
+  LightSystem *lights) {
+  std::vector<WorkerPool::Task> tasks;
+  tasks.reserve(shadow_light_count(*lights) + 1);
+
+  // The main pass takes longest, so it is picked first
+  CommandList *main_list = command_lists_.back();
+  tasks.push_back([this, main_list, d3d, cam, lights] {
+    main_list->Begin();
+    RenderToTexture(*frame_graph_->target(scene_target_), d3d, cam, lights);
+    main_list->End();
+  });
+
+  for (size_t i = 0; i < shadow_light_count(*lights); ++i) {
+    if (!shadow_lights_[i]) {
+      continue;
+    }
+
+    CommandList *list = command_lists_[i];
+    RenderTexture *target = shadow_atlas_target_;
+    UInt32 light = static_cast<UInt32>(i);
+    CullResult *cull = &light_culls_[i];
+    tasks.push_back([this, list, target, d3d, lights, light, cull] {
+      list->Begin();
+      RenderSceneDepthFromLight(*target, d3d, *lights, light, *cull);
+      list->End();
+    });
+  }
+
+  workers_->Run(tasks);
+}
+
 } // namespace sz
\ No newline at end of file
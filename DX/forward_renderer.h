@@ -8,6 +8,11 @@ struct ID3D11Device;
 namespace sz {
   class ConstBufManager;
   class ShaderManager;
+  class VirtualTextureSystem;
+  class WorkerPool;
+  class CommandList;
+  class ConstantRing;
+  class PipelineStats;
 }
 
 #include "renderer.h"
@@ -20,25 +25,90 @@ public:
   ForwardRenderer(const unsigned int scr_height, const unsigned int scr_width,
     const float scr_depth, const float scr_near, ID3D11Device* device,
     HWND hwnd, ConstBufManager *buf_man, ShaderManager *sha_man,
-    const size_t lights_num, const class Timer &timer);
+    const size_t lights_num, const UInt32 shadow_atlas_size,
+    const class Timer &timer);
 
   // Dtor
-  ~ForwardRenderer() {};
+  ~ForwardRenderer();
 
-  void Render(D3D *d3d, Camera *cam, std::vector<Light> *lights);
+  void Render(D3D *d3d, Camera *cam, LightSystem *lights);
 
   void UpdateTessellation(ID3D11DeviceContext* deviceContext);
   void UpdateVertexManipulation(ID3D11DeviceContext *deviceContext);
+  void UseVirtualTextures(ID3D11Device *device,
+    ID3D11DeviceContext *dev_context);
 
 private:
 
-  // Render the scene to a texture target
+  // Render the scene to a texture target, directly or into a command list
+  // recorded while the shadow passes are
   void RenderToTexture(RenderTexture &target, D3D *d3d,
-    Camera *cam, std::vector<Light> *lights);
+    Camera *cam, LightSystem *lights);
+
+  // Draw the depth of the draws of the list which are in the pre-pass, for
+  // the main pass to test its own against
+  void RenderDepthPrePass(D3D *d3d);
+
+  // Whether draw i of the list has its depth drawn by the pre-pass: opaque
+  // meshes of the models, which the depth shader draws where the lit
+  // shaders do
+  bool InDepthPrePass(size_t i) const;
 
   // Render the scene's depth to a target from a given
-  // light's perspective
-  void RenderSceneDepthFromLight(RenderTexture &target, D3D *d3d, Light *light);
+  // light's perspective; meshes are culled against its frustum into cull
+  void RenderSceneDepthFromLight(RenderTexture &target, D3D *d3d,
+    const LightSystem &lights, UInt32 light, CullResult &cull);
+
+  // Render which pages of the virtual textures the scene needs and stream
+  // them in
+  void RenderVirtualTextureFeedback(D3D *d3d, Camera *cam);
+
+  // Bind the virtual texture the lit shaders sample diffuse colours from,
+  // or kNoVirtualTexture for them to sample the texture of the material
+  void SetVirtualTexture(D3D *d3d, UInt32 texture);
+
+  // Declare the passes of the frame: the shadow maps which are rendered
+  // this frame, the scene, post processing and the back buffer. Passes
+  // which were recorded execute their command list.
+  void BuildFrameGraph(D3D *d3d, Camera *cam, LightSystem *lights,
+    bool record_lists);
+
+  // Record the shadow passes and the main pass into command lists, on the
+  // worker threads
+  void RecordPasses(D3D *d3d, Camera *cam, LightSystem *lights);
+
+  // Transform of the models to the world, the same in every pass
+  XMFLOAT4X4 model_transform_;
+
+  // Virtual texturing of the diffuse textures of models, once they were
+  // cooked
+  VirtualTextureSystem *vt_system_;
+  bool virtual_texturing_;
+  const NameId vt_feedback_shader_id_;
+
+  // Target of the scene in the frame graph of the current frame
+  FrameResource scene_target_;
+
+  // Draw recording on worker threads: one command list per shadow pass,
+  // then one for the main pass
+  WorkerPool *workers_;
+  std::vector<CommandList *> command_lists_;
+  bool mt_recording_check_;
+  // Constant buffers of the recorded passes are written to one ring, and
+  // uploaded with a single map before the lists are executed; nullptr if
+  // the backend cannot bind constant buffers from an offset
+  ConstantRing *constant_ring_;
+  bool constant_ring_check_;
+
+  // Depth pre-pass, after which the main pass only shades the pixels which
+  // are seen: whether it is drawn, the state which tests for equal depth
+  // without writing it, and the draws and triangles it cost
+  bool depth_prepass_check_;
+  ID3D11DepthStencilState *depth_equal_state_;
+  UInt32 prepass_draw_count_;
+  UInt32 prepass_triangle_count_;
+  // What the main pass cost the GPU, to weigh against the pre-pass
+  PipelineStats *main_pass_stats_;
 
 }; // class ForwardRenderer
 
@@ -0,0 +1,303 @@
+#include "frame_graph.h"
+#include <cassert>
+
+namespace sz {
+
+// Busy position of a pooled target which no target of the frame uses
+const UInt32 kPoolFree = 0xFFFFFFFF;
+
+// Frames after which a pooled target which no frame needed is released, so
+// that toggling a pass does not create and release targets every time
+const UInt32 kPoolIdleFrames = 60;
+
+FrameGraph::FrameGraph(const CreateFunc &create, const DestroyFunc &destroy) :
+    resources_(),
+    passes_(),
+    order_(),
+    pool_(),
+    create_(create),
+    destroy_(destroy),
+    created_count_(0),
+    valid_(true),
+    compiled_(false),
+    transient_count_(0),
+    physical_count_(0),
+    transient_bytes_(0),
+    physical_bytes_(0) {
+}
+
+FrameGraph::~FrameGraph() {
+  for (PooledTarget &pooled : pool_) {
+    destroy_(pooled.target);
+  }
+  pool_.clear();
+}
+
+void FrameGraph::Reset() {
+  resources_.clear();
+  passes_.clear();
+  order_.clear();
+  valid_ = true;
+  compiled_ = false;
+}
+
+FrameResource FrameGraph::CreateTarget(const std::string &name,
+  const RenderTextureDesc &desc) {
+  Resource resource;
+  resource.name = name;
+  resource.desc = desc;
+  resource.target = nullptr;
+  resource.imported = false;
+  resource.writer = kNoFramePass;
+  resource.first_use = 0;
+  resource.last_use = 0;
+  resources_.push_back(resource);
+
+  return static_cast<FrameResource>(resources_.size() - 1);
+}
+
+FrameResource FrameGraph::ImportTarget(const std::string &name,
+  RenderTexture *target) {
+  Resource resource;
+  resource.name = name;
+  resource.desc = target != nullptr ? target->desc() : RenderTextureDesc();
+  resource.target = target;
+  resource.imported = true;
+  resource.writer = kNoFramePass;
+  resource.first_use = 0;
+  resource.last_use = 0;
+  resources_.push_back(resource);
+
+  return static_cast<FrameResource>(resources_.size() - 1);
+}
+
+FramePass FrameGraph::AddPass(const std::string &name,
+  const PassFunc &execute) {
+  Pass pass;
+  pass.name = name;
+  pass.execute = execute;
+  pass.kept = false;
+  passes_.push_back(pass);
+
+  return static_cast<FramePass>(passes_.size() - 1);
+}
+
+void FrameGraph::Read(FramePass pass, FrameResource resource) {
+  passes_[pass].reads.push_back(resource);
+}
+
+void FrameGraph::Write(FramePass pass, FrameResource resource) {
+  if (resources_[resource].writer != kNoFramePass) {
+    valid_ = false;
+  }
+  resources_[resource].writer = pass;
+  passes_[pass].writes.push_back(resource);
+}
+
+bool FrameGraph::Compile() {
+  compiled_ = false;
+  order_.clear();
+  transient_count_ = 0;
+  physical_count_ = 0;
+  transient_bytes_ = 0;
+  physical_bytes_ = 0;
+
+  if (!valid_) {
+    return false;
+  }
+
+  // Transient targets have no content until a pass of the frame writes them
+  for (const Pass &pass : passes_) {
+    for (FrameResource r : pass.reads) {
+      if (!resources_[r].imported && resources_[r].writer == kNoFramePass) {
+        return false;
+      }
+    }
+  }
+
+  Cull();
+  if (!Sort()) {
+    order_.clear();
+    return false;
+  }
+  Allocate();
+
+  compiled_ = true;
+  return true;
+}
+
+void FrameGraph::Execute() {
+  assert(compiled_);
+
+  for (FramePass p : order_) {
+    passes_[p].execute();
+  }
+}
+
+UInt64 FrameGraph::pooled_bytes() const {
+  UInt64 bytes = 0;
+  for (const PooledTarget &pooled : pool_) {
+    bytes += pooled.desc.memory_bytes();
+  }
+
+  return bytes;
+}
+
+void FrameGraph::Cull() {
+  // Walk back from the passes which write imported targets, through the
+  // writers of what the kept passes read
+  std::vector<FramePass> stack;
+  for (size_t p = 0; p < passes_.size(); ++p) {
+    passes_[p].kept = false;
+    for (FrameResource r : passes_[p].writes) {
+      if (resources_[r].imported) {
+        passes_[p].kept = true;
+      }
+    }
+    if (passes_[p].kept) {
+      stack.push_back(static_cast<FramePass>(p));
+    }
+  }
+
+  while (!stack.empty()) {
+    FramePass p = stack.back();
+    stack.pop_back();
+    for (FrameResource r : passes_[p].reads) {
+      FramePass writer = resources_[r].writer;
+      if (writer != kNoFramePass && !passes_[writer].kept) {
+        passes_[writer].kept = true;
+        stack.push_back(writer);
+      }
+    }
+  }
+}
+
+bool FrameGraph::Sort() {
+  // A pass waits for the writers of what it reads; of the passes which are
+  // ready, the first declared goes first. Graphs have a few tens of passes
+  // at most, so the passes are simply scanned again for each one placed.
+  std::vector<UInt32> waiting(passes_.size(), 0);
+  std::vector<UInt8> placed(passes_.size(), 0);
+  size_t kept_count = 0;
+  for (size_t p = 0; p < passes_.size(); ++p) {
+    if (!passes_[p].kept) {
+      continue;
+    }
+    ++kept_count;
+    for (FrameResource r : passes_[p].reads) {
+      FramePass writer = resources_[r].writer;
+      if (writer != kNoFramePass && writer != p) {
+        ++waiting[p];
+      }
+    }
+  }
+
+  while (order_.size() < kept_count) {
+    size_t next = passes_.size();
+    for (size_t p = 0; p < passes_.size(); ++p) {
+      if (passes_[p].kept && !placed[p] && waiting[p] == 0) {
+        next = p;
+        break;
+      }
+    }
+    if (next == passes_.size()) {
+      return false;
+    }
+
+    placed[next] = 1;
+    order_.push_back(static_cast<FramePass>(next));
+    for (size_t p = 0; p < passes_.size(); ++p) {
+      if (!passes_[p].kept || p == next) {
+        continue;
+      }
+      for (FrameResource r : passes_[p].reads) {
+        if (resources_[r].writer == next) {
+          --waiting[p];
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+void FrameGraph::Allocate() {
+  // Lives of the transient targets, as positions in the order
+  for (UInt32 pos = 0; pos < order_.size(); ++pos) {
+    const Pass &pass = passes_[order_[pos]];
+    for (FrameResource r : pass.writes) {
+      resources_[r].first_use = pos;
+      if (resources_[r].last_use < pos) {
+        resources_[r].last_use = pos;
+      }
+    }
+    for (FrameResource r : pass.reads) {
+      if (resources_[r].last_use < pos) {
+        resources_[r].last_use = pos;
+      }
+    }
+  }
+
+  for (PooledTarget &pooled : pool_) {
+    pooled.busy_until = kPoolFree;
+  }
+
+  // Targets are given a RenderTexture in the order they are first written,
+  // taking any pooled one of their size which is free by then
+  for (FramePass p : order_) {
+    for (FrameResource r : passes_[p].writes) {
+      Resource &resource = resources_[r];
+      if (resource.imported) {
+        continue;
+      }
+
+      PooledTarget *found = nullptr;
+      for (PooledTarget &pooled : pool_) {
+        if (pooled.desc == resource.desc &&
+          (pooled.busy_until == kPoolFree ||
+          pooled.busy_until < resource.first_use)) {
+          found = &pooled;
+          break;
+        }
+      }
+
+      if (found == nullptr) {
+        PooledTarget pooled;
+        pooled.desc = resource.desc;
+        pooled.target = create_(resource.desc, created_count_++);
+        pooled.busy_until = kPoolFree;
+        pooled.idle_frames = 0;
+        pool_.push_back(pooled);
+        found = &pool_.back();
+      }
+
+      if (found->busy_until == kPoolFree) {
+        ++physical_count_;
+        physical_bytes_ += found->desc.memory_bytes();
+      }
+      found->busy_until = resource.last_use;
+      resource.target = found->target;
+      ++transient_count_;
+      transient_bytes_ += resource.desc.memory_bytes();
+    }
+  }
+
+  // Release the targets which were not needed for a while
+  for (size_t i = 0; i < pool_.size();) {
+    PooledTarget &pooled = pool_[i];
+    if (pooled.busy_until != kPoolFree) {
+      pooled.idle_frames = 0;
+      ++i;
+    }
+    else if (++pooled.idle_frames >= kPoolIdleFrames) {
+      destroy_(pooled.target);
+      pool_[i] = pool_.back();
+      pool_.pop_back();
+    }
+    else {
+      ++i;
+    }
+  }
+}
+
+} // namespace sz
@@ -0,0 +1,191 @@
+//  Frame graph
+//  * The passes of a frame are declared every frame, with the targets each
+//    of them reads and writes, and run once the graph was compiled
+//  * Passes whose results nothing uses are culled. A pass is kept if it
+//    writes an imported target, e.g. a cached shadow map or the back
+//    buffer, or a target which a kept pass reads.
+//  * Passes run after those which write what they read, in the order they
+//    were declared otherwise
+//  * Transient targets only live within the frame, from the pass which
+//    writes them to the last which reads them; targets of the same size and
+//    formats whose lives do not overlap share one RenderTexture
+//  * RenderTextures of transient targets are pooled across frames, and
+//    released when no frame needed them for a while
+
+#ifndef _FRAME_GRAPH_H
+#define _FRAME_GRAPH_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "abertay_framework.h"
+#include "RenderTexture.h"
+
+namespace sz {
+
+typedef UInt32 FrameResource;
+typedef UInt32 FramePass;
+
+// Writer of a target which no pass writes
+const FramePass kNoFramePass = 0xFFFFFFFF;
+
+class FrameGraph {
+public:
+  typedef std::function<void()> PassFunc;
+  // Create the RenderTexture of a pooled target; serial is different for
+  // each target the graph creates
+  typedef std::function<RenderTexture *(const RenderTextureDesc &desc,
+    UInt32 serial)> CreateFunc;
+  typedef std::function<void(RenderTexture *target)> DestroyFunc;
+
+  // Ctor
+  FrameGraph(const CreateFunc &create, const DestroyFunc &destroy);
+
+  // Dtor; destroys the pooled targets
+  ~FrameGraph();
+
+  // Forget the passes and targets of the last frame; pooled targets are kept
+  void Reset();
+
+  // Declare a target which only lives within the frame
+  FrameResource CreateTarget(const std::string &name,
+    const RenderTextureDesc &desc);
+
+  // Declare a target which is owned outside of the graph, and may be read
+  // before the graph writes it; target may be nullptr, e.g. for the back
+  // buffer
+  FrameResource ImportTarget(const std::string &name, RenderTexture *target);
+
+  // Declare a pass, and what it reads and writes. Each target is written by
+  // one pass at most.
+  FramePass AddPass(const std::string &name, const PassFunc &execute);
+  void Read(FramePass pass, FrameResource resource);
+  void Write(FramePass pass, FrameResource resource);
+
+  // Cull and order the passes, and give the transient targets their
+  // RenderTextures. Returns false if the graph is invalid: a transient target
+  // is read but never written, a target is written twice, or passes depend
+  // on each other in a loop.
+  bool Compile();
+
+  // Run the passes which were kept, in order
+  void Execute();
+
+  // RenderTexture of a target, once the graph was compiled; nullptr for
+  // transient targets of culled passes
+  inline RenderTexture *target(FrameResource resource) const {
+    return resources_[resource].target;
+  }
+
+  // Size and formats of a target
+  inline const RenderTextureDesc &desc(FrameResource resource) const {
+    return resources_[resource].desc;
+  }
+
+  inline UInt32 resource_count() const {
+    return static_cast<UInt32>(resources_.size());
+  }
+  inline const std::string &name(FrameResource resource) const {
+    return resources_[resource].name;
+  }
+
+  // Whether a pass was culled by the last Compile
+  inline bool culled(FramePass pass) const {
+    return !passes_[pass].kept;
+  }
+
+  // Passes kept by the last Compile, in the order they run
+  inline const std::vector<FramePass> &order() const {
+    return order_;
+  }
+
+  inline UInt32 pass_count() const {
+    return static_cast<UInt32>(passes_.size());
+  }
+  inline UInt32 culled_count() const {
+    return static_cast<UInt32>(passes_.size() - order_.size());
+  }
+  // Transient targets used by the kept passes, and the RenderTextures they
+  // were given
+  inline UInt32 transient_count() const {
+    return transient_count_;
+  }
+  inline UInt32 physical_count() const {
+    return physical_count_;
+  }
+  // Memory the transient targets would take each on their own, and that of
+  // the RenderTextures they share
+  inline UInt64 transient_bytes() const {
+    return transient_bytes_;
+  }
+  inline UInt64 physical_bytes() const {
+    return physical_bytes_;
+  }
+  // Memory of all the pooled RenderTextures, including those kept for later
+  // frames
+  UInt64 pooled_bytes() const;
+
+  // Disable ctors
+  FrameGraph(const FrameGraph &) = delete;
+  FrameGraph &operator=(const FrameGraph &) = delete;
+
+private:
+  struct Resource {
+    std::string name;
+    RenderTextureDesc desc;
+    RenderTexture *target;
+    bool imported;
+    // Pass which writes the target, or kNoFramePass
+    FramePass writer;
+    // First and last position in the order at which it is used
+    UInt32 first_use;
+    UInt32 last_use;
+  };
+
+  struct Pass {
+    std::string name;
+    PassFunc execute;
+    std::vector<FrameResource> reads;
+    std::vector<FrameResource> writes;
+    bool kept;
+  };
+
+  struct PooledTarget {
+    RenderTextureDesc desc;
+    RenderTexture *target;
+    // Position in the order after which it is free this frame, or
+    // kPoolFree if no target of this frame uses it
+    UInt32 busy_until;
+    // Frames since a target last used it
+    UInt32 idle_frames;
+  };
+
+  // Mark the passes which the roots need
+  void Cull();
+  // Sort the kept passes; false if they depend on each other in a loop
+  bool Sort();
+  // Give the transient targets of the kept passes their RenderTextures
+  void Allocate();
+
+  std::vector<Resource> resources_;
+  std::vector<Pass> passes_;
+  std::vector<FramePass> order_;
+  std::vector<PooledTarget> pool_;
+
+  CreateFunc create_;
+  DestroyFunc destroy_;
+  UInt32 created_count_;
+  // Whether no target was written twice since the last Reset
+  bool valid_;
+  bool compiled_;
+
+  UInt32 transient_count_;
+  UInt32 physical_count_;
+  UInt64 transient_bytes_;
+  UInt64 physical_bytes_;
+
+}; // class FrameGraph
+
+} // namespace sz
+
+#endif
@@ -1,4 +1,5 @@
 #include "gauss_blur_h_shader.h"
+#include "state_cache.h"
 #include "Texture.h"
 #include "buffer_types.h"
 
@@ -107,8 +108,10 @@ void GaussBlurHShader::InitShader(sz::ConstBufManager &buf_man,
     screensize_buffer_desc, m_device);
   assert(screensize_buf_ != nullptr);
 
-  // Create the texture sampler state.
-  m_device->CreateSamplerState(&samplerDesc, &m_sampleState);
+  // Get the texture sampler state; shaders with the same description
+  // share it
+  m_sampleState = sz::StateCache::Inst()->GetSamplerState(m_device,
+    samplerDesc);
 
 }
 
@@ -130,7 +133,8 @@ void GaussBlurHShader::SetShaderParameters(ID3D11DeviceContext* deviceContext,
   tproj = XMMatrixTranspose(projectionMatrix);
 
   // Lock the constant buffer so it can be written to.
-  result = deviceContext->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
+  result = sz::StateCache::Inst()->Map(m_matrixBuffer, 0,
+    D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
 
   // Get a pointer to the data in the constant buffer.
   dataPtr = (sz::MatrixBufferType*)mapped_resource.pData;
@@ -141,27 +145,29 @@ void GaussBlurHShader::SetShaderParameters(ID3D11DeviceContext* deviceContext,
   dataPtr->projection = tproj;
 
   // Unlock the constant buffer.
-  deviceContext->Unmap(m_matrixBuffer, 0);
+  sz::StateCache::Inst()->Unmap(m_matrixBuffer, 0);
 
   // Set the position of the constant buffer in the vertex shader.
   bufferNumber = 0;
 
   // Now set the constant buffer in the vertex shader with the updated values.
-  deviceContext->VSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
-  deviceContext->DSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
+  sz::StateCache::Inst()->VSSetConstantBuffers(bufferNumber, 1,
+    &m_matrixBuffer);
+  sz::StateCache::Inst()->DSSetConstantBuffers(bufferNumber, 1,
+    &m_matrixBuffer);
 
   // Send size data
-  deviceContext->Map(screensize_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0,
+  sz::StateCache::Inst()->Map(screensize_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0,
     &mapped_resource);
   screensize_ptr = (sz::ScreenSizeBufferType *)mapped_resource.pData;
   screensize_ptr->screen_size = screensize;
-  deviceContext->Unmap(screensize_buf_, 0);
-  deviceContext->VSSetConstantBuffers(1, 1, &screensize_buf_);
-  deviceContext->DSSetConstantBuffers(1, 1, &screensize_buf_);
+  sz::StateCache::Inst()->Unmap(screensize_buf_, 0);
+  sz::StateCache::Inst()->VSSetConstantBuffers(1, 1, &screensize_buf_);
+  sz::StateCache::Inst()->DSSetConstantBuffers(1, 1, &screensize_buf_);
 
-  ID3D11ShaderResourceView * texture = Texture::Inst()->GetTexture(mat.diffuse_texname_crc);
+  ID3D11ShaderResourceView * texture = Texture::Inst()->GetTexture(mat.diffuse_texture);
   // Set shader texture resource in the pixel shader.
-  deviceContext->PSSetShaderResources(0, 1, &texture);
+  sz::StateCache::Inst()->PSSetShaderResources(0, 1, &texture);
 }
 
 void GaussBlurHShader::Render(ID3D11DeviceContext* deviceContext,
@@ -170,7 +176,7 @@ void GaussBlurHShader::Render(ID3D11DeviceContext* deviceContext,
     size_t base_vertex)
 {
   // Set the sampler state in the pixel shader.
-  deviceContext->PSSetSamplers(0, 1, &m_sampleState);
+  sz::StateCache::Inst()->PSSetSamplers(0, 1, &m_sampleState);
 
   // Base render function.
   BaseShader::Render(deviceContext, index_count, index_start, base_vertex);
@@ -15,19 +15,13 @@ GaussBlur::GaussBlur(const unsigned int scr_height, const unsigned int scr_width
   const float scr_depth, const float scr_near, ID3D11Device* device,
   HWND hwnd, ConstBufManager &buf_man, ShaderManager *sha_man) :
     PostProcess(scr_height, scr_width, scr_depth, scr_near),
-    render_target_downsample0_(nullptr),
-    render_target_downsample1_(nullptr),
     ortho_mesh_downsample_(nullptr),
     ortho_mesh_upsample_(nullptr),
-    sha_man_(sha_man) 
+    sha_man_(sha_man),
+    texture_shader_id_(NameInterner::Inst()->Intern("texture_shader")),
+    blur_h_shader_id_(NameInterner::Inst()->Intern("gauss_blur_h_shader")),
+    blur_v_shader_id_(NameInterner::Inst()->Intern("gauss_blur_v_shader"))
 {
-  render_target_downsample0_ = new RenderTexture(device,
-    scr_width / 2, scr_height / 2, scr_near, scr_depth,
-    "target_downsample0");
-  render_target_downsample1_ = new RenderTexture(device,
-    scr_width / 2, scr_height / 2, scr_near, scr_depth,
-    "target_downsample1");
-
   // Create the ortho mesh
   ortho_mesh_upsample_ = new OrthoMesh(device,
     scr_width, scr_height, 0, 0);
@@ -73,37 +67,34 @@ GaussBlur::~GaussBlur() {
     delete ortho_mesh_upsample_;
     ortho_mesh_upsample_ = nullptr;
   }
-
-  if (render_target_downsample1_ != nullptr) {
-    delete render_target_downsample1_;
-    render_target_downsample1_ = nullptr;
-  }
-  if (render_target_downsample0_ != nullptr) {
-    delete render_target_downsample0_;
-    render_target_downsample0_ = nullptr;
-  }
-
 }
 
-void GaussBlur::DownSample(RenderTexture &target, D3D *direct3D,
+void GaussBlur::DownSample(const RenderTexture &source,
+  RenderTexture &target, D3D *direct3D,
   const DirectX::XMMATRIX &base_view_matrix,
   const DirectX::XMMATRIX &world_matrix) {
+  // The source may still be bound from the pass which wrote it
+  sha_man_->CleanupShaderResources(direct3D->GetDeviceContext());
+
+  // Turn off the Z buffer to begin all 2D rendering.
+  direct3D->TurnZBufferOff();
+
   // Set the render target to be the downscaling render target
-  render_target_downsample0_->SetRenderTarget(direct3D->GetDeviceContext());
+  target.SetRenderTarget(direct3D->GetDeviceContext());
 
   // Clear the render to texture.
-  render_target_downsample0_->ClearRenderTarget(direct3D->GetDeviceContext(),
+  target.ClearRenderTarget(direct3D->GetDeviceContext(),
     0.0f, 0.0f, 0.0f, 1.0f);
 
   XMMATRIX ortho_matrix =
-    render_target_downsample0_->GetOrthoMatrix();// ortho matrix for 2D rendering
+    target.GetOrthoMatrix();// ortho matrix for 2D rendering
 
   // Create a mock material
   sz::Material mock_material;
 
-  mock_material.diffuse_texname_crc = target.name_crc();
+  mock_material.diffuse_texture = source.texture_handle();
   ortho_mesh_downsample_->SendData(direct3D->GetDeviceContext());
-  BaseShader *shader = sha_man_->GetShader("texture_shader");
+  BaseShader *shader = sha_man_->GetShader(texture_shader_id_);
   TextureShader *texture_shader = static_cast<TextureShader *>(shader);
   if (texture_shader != nullptr) {
     shader->SetInputLayoutAndShaders(direct3D->GetDeviceContext());
@@ -114,12 +105,16 @@ void GaussBlur::DownSample(RenderTexture &target, D3D *direct3D,
       ortho_mesh_downsample_->GetIndexCount(), 0);
   }
 
+  direct3D->TurnZBufferOn();
 }
 
-void GaussBlur::UpSample(RenderTexture &target, D3D *direct3D,
+void GaussBlur::UpSample(const RenderTexture &source,
+    RenderTexture &target, D3D *direct3D,
     const DirectX::XMMATRIX &base_view_matrix,
     const DirectX::XMMATRIX &world_matrix) {
-  // Set the render target to be the main render target
+  direct3D->TurnZBufferOff();
+
+  // Set the render target to be the full size render target
   target.SetRenderTarget(direct3D->GetDeviceContext());
 
   // Clear the render to texture.
@@ -132,9 +127,9 @@ void GaussBlur::UpSample(RenderTexture &target, D3D *direct3D,
   // Create a mock material
   sz::Material mock_material;
 
-  mock_material.diffuse_texname_crc = render_target_downsample0_->name_crc();
+  mock_material.diffuse_texture = source.texture_handle();
   ortho_mesh_upsample_->SendData(direct3D->GetDeviceContext());
-  BaseShader *shader = sha_man_->GetShader("texture_shader");
+  BaseShader *shader = sha_man_->GetShader(texture_shader_id_);
   TextureShader *texture_shader = static_cast<TextureShader *>(shader);
   if (texture_shader != nullptr) {
     shader->SetInputLayoutAndShaders(direct3D->GetDeviceContext());
@@ -145,27 +140,32 @@ void GaussBlur::UpSample(RenderTexture &target, D3D *direct3D,
       ortho_mesh_upsample_->GetIndexCount(), 0);
     shader->CleanupTextures(direct3D->GetDeviceContext());
   }
+
+  direct3D->TurnZBufferOn();
 }
 
-void GaussBlur::HorizontalBlur(RenderTexture &target, D3D *direct3D,
+void GaussBlur::HorizontalBlur(const RenderTexture &source,
+    RenderTexture &target, D3D *direct3D,
     const DirectX::XMMATRIX &base_view_matrix,
     const DirectX::XMMATRIX &world_matrix) {
+  direct3D->TurnZBufferOff();
+
   // Set the render target
-  render_target_downsample1_->SetRenderTarget(direct3D->GetDeviceContext());
+  target.SetRenderTarget(direct3D->GetDeviceContext());
 
   // Clear the render to texture.
-  render_target_downsample1_->ClearRenderTarget(direct3D->GetDeviceContext(),
+  target.ClearRenderTarget(direct3D->GetDeviceContext(),
     0.0f, 0.0f, 0.0f, 1.0f);
 
   XMMATRIX ortho_matrix =
-    render_target_downsample1_->GetOrthoMatrix();// ortho matrix for 2D rendering
+    target.GetOrthoMatrix();// ortho matrix for 2D rendering
 
   // Create a mock material
   sz::Material mock_material;
 
-  mock_material.diffuse_texname_crc = render_target_downsample0_->name_crc();
+  mock_material.diffuse_texture = source.texture_handle();
   ortho_mesh_downsample_->SendData(direct3D->GetDeviceContext());
-  BaseShader *shader = sha_man_->GetShader("gauss_blur_h_shader");
+  BaseShader *shader = sha_man_->GetShader(blur_h_shader_id_);
   if (shader != nullptr) {
     GaussBlurHShader *gauss_shader = static_cast<GaussBlurHShader *>(shader);
     shader->SetInputLayoutAndShaders(direct3D->GetDeviceContext());
@@ -177,27 +177,31 @@ void GaussBlur::HorizontalBlur(RenderTexture &target, D3D *direct3D,
     shader->CleanupTextures(direct3D->GetDeviceContext());
   }
 
+  direct3D->TurnZBufferOn();
 }
 
-void GaussBlur::VerticalBlur(RenderTexture &target, D3D *direct3D,
+void GaussBlur::VerticalBlur(const RenderTexture &source,
+    RenderTexture &target, D3D *direct3D,
     const DirectX::XMMATRIX &base_view_matrix,
     const DirectX::XMMATRIX &world_matrix) {
+  direct3D->TurnZBufferOff();
+
   // Set the render target
-  render_target_downsample0_->SetRenderTarget(direct3D->GetDeviceContext());
+  target.SetRenderTarget(direct3D->GetDeviceContext());
 
   // Clear the render to texture.
-  render_target_downsample0_->ClearRenderTarget(direct3D->GetDeviceContext(),
+  target.ClearRenderTarget(direct3D->GetDeviceContext(),
     0.0f, 0.0f, 0.0f, 1.0f);
 
   XMMATRIX ortho_matrix =
-    render_target_downsample0_->GetOrthoMatrix();// ortho matrix for 2D rendering
+    target.GetOrthoMatrix();// ortho matrix for 2D rendering
 
   // Create a mock material
   sz::Material mock_material;
 
-  mock_material.diffuse_texname_crc = render_target_downsample1_->name_crc();
+  mock_material.diffuse_texture = source.texture_handle();
   ortho_mesh_downsample_->SendData(direct3D->GetDeviceContext());
-  BaseShader *shader = sha_man_->GetShader("gauss_blur_v_shader");
+  BaseShader *shader = sha_man_->GetShader(blur_v_shader_id_);
   if (shader != nullptr) {
     GaussBlurVShader *gauss_shader = static_cast<GaussBlurVShader *>(shader);
     shader->SetInputLayoutAndShaders(direct3D->GetDeviceContext());
@@ -209,27 +213,69 @@ void GaussBlur::VerticalBlur(RenderTexture &target, D3D *direct3D,
     shader->CleanupTextures(direct3D->GetDeviceContext());
   }
 
+  direct3D->TurnZBufferOn();
 }
 
 // Post process function. Functionality explained in header
-void GaussBlur::ApplyPostProcess(RenderTexture &target, D3D *direct3D,
-  const DirectX::XMMATRIX &base_view_matrix,
+FrameResource GaussBlur::AddPasses(FrameGraph &graph, FrameResource source,
+  D3D *direct3D, const DirectX::XMMATRIX &base_view_matrix,
   const DirectX::XMMATRIX &world_matrix) {
-
-  // Turn off the Z buffer to begin all 2D rendering.
-  direct3D->TurnZBufferOff();
-
-  // Downsample the texture
-  DownSample(target, direct3D, base_view_matrix, world_matrix);
-
-  HorizontalBlur(target, direct3D, base_view_matrix, world_matrix);
-  VerticalBlur(target, direct3D, base_view_matrix, world_matrix);
-  
-  UpSample(target, direct3D, base_view_matrix, world_matrix);
-
-  direct3D->TurnZBufferOn();
-
+  // The blur needs no depth; the result has the formats of the source
+  RenderTextureDesc half_desc = graph.desc(source);
+  half_desc.width /= 2;
+  half_desc.height /= 2;
+  half_desc.depth_format = DXGI_FORMAT_UNKNOWN;
+  RenderTextureDesc full_desc = graph.desc(source);
+
+  // The first and the third target live apart, and so do the source and
+  // the last one, so that the graph gives each pair one texture
+  FrameResource downsampled = graph.CreateTarget("blur_downsampled",
+    half_desc);
+  FrameResource blurred_h = graph.CreateTarget("blur_horizontal", half_desc);
+  FrameResource blurred_v = graph.CreateTarget("blur_vertical", half_desc);
+  FrameResource upsampled = graph.CreateTarget("blur_upsampled", full_desc);
+
+  // The passes are kept by std::function, which does not align what it
+  // allocates
+  XMFLOAT4X4 view, world;
+  XMStoreFloat4x4(&view, base_view_matrix);
+  XMStoreFloat4x4(&world, world_matrix);
+  FrameGraph *g = &graph;
+
+  FramePass pass = graph.AddPass("blur_downsample",
+    [this, g, source, downsampled, direct3D, view, world] {
+    DownSample(*g->target(source), *g->target(downsampled), direct3D,
+      XMLoadFloat4x4(&view), XMLoadFloat4x4(&world));
+  });
+  graph.Read(pass, source);
+  graph.Write(pass, downsampled);
+
+  pass = graph.AddPass("blur_horizontal",
+    [this, g, downsampled, blurred_h, direct3D, view, world] {
+    HorizontalBlur(*g->target(downsampled), *g->target(blurred_h), direct3D,
+      XMLoadFloat4x4(&view), XMLoadFloat4x4(&world));
+  });
+  graph.Read(pass, downsampled);
+  graph.Write(pass, blurred_h);
+
+  pass = graph.AddPass("blur_vertical",
+    [this, g, blurred_h, blurred_v, direct3D, view, world] {
+    VerticalBlur(*g->target(blurred_h), *g->target(blurred_v), direct3D,
+      XMLoadFloat4x4(&view), XMLoadFloat4x4(&world));
+  });
+  graph.Read(pass, blurred_h);
+  graph.Write(pass, blurred_v);
+
+  pass = graph.AddPass("blur_upsample",
+    [this, g, blurred_v, upsampled, direct3D, view, world] {
+    UpSample(*g->target(blurred_v), *g->target(upsampled), direct3D,
+      XMLoadFloat4x4(&view), XMLoadFloat4x4(&world));
+  });
+  graph.Read(pass, blurred_v);
+  graph.Write(pass, upsampled);
+
+  return upsampled;
 }
 
 
-} // namespace sz
\ No newline at end of file
+} // namespace sz
@@ -4,6 +4,7 @@
 #include <d3d11.h>
 #include <directxmath.h>
 #include "post_process.h"
+#include "name_interner.h"
 
 // Forward declarations
 class RenderTexture;
@@ -38,36 +39,34 @@ public:
   // Dtor
   ~GaussBlur();
 
-  // Post process function. Functionality explained in header
-  void ApplyPostProcess(RenderTexture &target, D3D *direct3D,
-    const DirectX::XMMATRIX &base_view_matrix,
+  // Post process function. Functionality explained in header. The image
+  // is downsampled, blurred horizontally then vertically, and upsampled
+  // again, each step in a pass of its own into a transient target.
+  FrameResource AddPasses(FrameGraph &graph, FrameResource source,
+    D3D *direct3D, const DirectX::XMMATRIX &base_view_matrix,
     const DirectX::XMMATRIX &world_matrix);
 
 private:
-  // Render the target to a smaller render target, hence downsampling
-  void DownSample(RenderTexture &target, D3D *direct3D,
-    const DirectX::XMMATRIX &base_view_matrix,
+  // Render the source to a smaller render target, hence downsampling
+  void DownSample(const RenderTexture &source, RenderTexture &target,
+    D3D *direct3D, const DirectX::XMMATRIX &base_view_matrix,
     const DirectX::XMMATRIX &world_matrix);
 
-  // Render the smaller target to a bigger render target, hence upsampling
-  void UpSample(RenderTexture &target, D3D *direct3D,
-    const DirectX::XMMATRIX &base_view_matrix,
+  // Render the smaller source to a bigger render target, hence upsampling
+  void UpSample(const RenderTexture &source, RenderTexture &target,
+    D3D *direct3D, const DirectX::XMMATRIX &base_view_matrix,
     const DirectX::XMMATRIX &world_matrix);
 
   // Perform horizontal blurring for Gaussian blur
-  void HorizontalBlur(RenderTexture &target, D3D *direct3D,
-    const DirectX::XMMATRIX &base_view_matrix,
+  void HorizontalBlur(const RenderTexture &source, RenderTexture &target,
+    D3D *direct3D, const DirectX::XMMATRIX &base_view_matrix,
     const DirectX::XMMATRIX &world_matrix);
 
-  // Perform horizontal blurring for Gaussian blur
-  void VerticalBlur(RenderTexture &target, D3D *direct3D,
-    const DirectX::XMMATRIX &base_view_matrix,
+  // Perform vertical blurring for Gaussian blur
+  void VerticalBlur(const RenderTexture &source, RenderTexture &target,
+    D3D *direct3D, const DirectX::XMMATRIX &base_view_matrix,
     const DirectX::XMMATRIX &world_matrix);
 
-  // Render targets for blurring
-  RenderTexture *render_target_downsample0_;
-  RenderTexture *render_target_downsample1_;
-
   // Ortho meshes for post processing
   OrthoMesh *ortho_mesh_downsample_;
   OrthoMesh *ortho_mesh_upsample_;
@@ -75,6 +74,11 @@ private:
   // Reference to the shaders manager
   ShaderManager *sha_man_;
 
+  // IDs of the shaders used by the blur passes
+  const NameId texture_shader_id_;
+  const NameId blur_h_shader_id_;
+  const NameId blur_v_shader_id_;
+
 }; // class GaussBlur
 
 } // namespace sz
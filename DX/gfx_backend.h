@@ -0,0 +1,137 @@
+//  Graphics backend
+//  * The command stream of a frame: binds, resource updates, clears and
+//    draws, in the vocabulary of D3D11
+//  * The renderer issues commands through the StateCache, which filters
+//    the binds and forwards everything to the current backend
+//  * D3D11Backend sends them to a device context; RecordingBackend keeps
+//    and counts them, so that the CPU side of a frame can run without a GPU
+//  * A backend can make deferred ones, which record commands on another
+//    thread for it to execute later (D3D11 deferred contexts, or recordings
+//    which are replayed)
+//  * Resources are still created on the device
+
+#ifndef _GFX_BACKEND_H
+#define _GFX_BACKEND_H
+
+#include <d3d11.h>
+
+namespace sz {
+
+class GfxBackend {
+public:
+  virtual ~GfxBackend() {}
+
+  // Create a backend recording commands, usually on another thread, for
+  // this one to execute later; nullptr if not supported. It starts with the
+  // default state, and is owned by the caller.
+  virtual GfxBackend *CreateDeferred() = 0;
+
+  // Execute the commands recorded by a backend made by CreateDeferred on
+  // this one, and start a new recording on it. Afterwards the bound state
+  // of both has to be treated as unknown.
+  virtual void ExecuteDeferred(GfxBackend *deferred) = 0;
+
+  // Whether constant buffers can be bound from an offset, with the
+  // *SetConstantBuffers1 calls (D3D11.1); deferred backends support it when
+  // the backend which made them does
+  virtual bool SupportsConstantBufferOffsets() const = 0;
+
+  // Input assembler
+  virtual void IASetInputLayout(ID3D11InputLayout *layout) = 0;
+  virtual void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) = 0;
+  virtual void IASetVertexBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *strides,
+    const UINT *offsets) = 0;
+  virtual void IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format,
+    UINT offset) = 0;
+
+  // Shaders
+  virtual void VSSetShader(ID3D11VertexShader *shader) = 0;
+  virtual void HSSetShader(ID3D11HullShader *shader) = 0;
+  virtual void DSSetShader(ID3D11DomainShader *shader) = 0;
+  virtual void GSSetShader(ID3D11GeometryShader *shader) = 0;
+  virtual void PSSetShader(ID3D11PixelShader *shader) = 0;
+
+  // Constant buffers
+  virtual void VSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers) = 0;
+  virtual void HSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers) = 0;
+  virtual void DSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers) = 0;
+  virtual void GSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers) = 0;
+  virtual void PSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers) = 0;
+
+  // Constant buffers bound from an offset, both in constants of 16 bytes
+  // and multiples of 16 constants; only if supported
+  virtual void VSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts) = 0;
+  virtual void HSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts) = 0;
+  virtual void DSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts) = 0;
+  virtual void GSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts) = 0;
+  virtual void PSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts) = 0;
+
+  // Shader resources
+  virtual void VSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views) = 0;
+  virtual void DSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views) = 0;
+  virtual void PSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views) = 0;
+
+  // Samplers
+  virtual void VSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers) = 0;
+  virtual void DSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers) = 0;
+  virtual void PSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers) = 0;
+
+  // Output merger and rasteriser
+  virtual void OMSetBlendState(ID3D11BlendState *state,
+    const FLOAT blend_factor[4], UINT sample_mask) = 0;
+  virtual void OMSetDepthStencilState(ID3D11DepthStencilState *state,
+    UINT stencil_ref) = 0;
+  virtual void OMSetRenderTargets(UINT count,
+    ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depth) = 0;
+  virtual void RSSetState(ID3D11RasterizerState *state) = 0;
+  virtual void RSSetViewports(UINT count,
+    const D3D11_VIEWPORT *viewports) = 0;
+
+  // Resource updates
+  virtual HRESULT Map(ID3D11Resource *resource, UINT subresource,
+    D3D11_MAP type, UINT flags, D3D11_MAPPED_SUBRESOURCE *mapped) = 0;
+  virtual void Unmap(ID3D11Resource *resource, UINT subresource) = 0;
+  virtual void UpdateSubresource(ID3D11Resource *resource, UINT subresource,
+    const D3D11_BOX *box, const void *data, UINT row_pitch,
+    UINT depth_pitch) = 0;
+  virtual void CopyResource(ID3D11Resource *dst, ID3D11Resource *src) = 0;
+  virtual void GenerateMips(ID3D11ShaderResourceView *view) = 0;
+
+  // Clears and draws
+  virtual void ClearRenderTargetView(ID3D11RenderTargetView *view,
+    const FLOAT colour[4]) = 0;
+  virtual void ClearDepthStencilView(ID3D11DepthStencilView *view,
+    UINT flags, FLOAT depth, UINT8 stencil) = 0;
+  virtual void Draw(UINT vertex_count, UINT start_vertex) = 0;
+  virtual void DrawIndexed(UINT index_count, UINT start_index,
+    INT base_vertex) = 0;
+  virtual void DrawIndexedInstanced(UINT index_count, UINT instance_count,
+    UINT start_index, INT base_vertex, UINT start_instance) = 0;
+
+}; // class GfxBackend
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,273 @@
+#include "light_clusters.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <xmmintrin.h>
+#include "worker_pool.h"
+
+namespace sz {
+
+// Boxes are made this much deeper than their slice, so that pixels which
+// land on the border of two slices find their lights in either
+const float kClusterDepthPadding = 1e-4f;
+
+LightClusters::LightClusters(UInt32 screen_width, UInt32 screen_height,
+  UInt32 max_indices) :
+    screen_width_(screen_width),
+    screen_height_(screen_height),
+    tiles_x_((screen_width + kClusterTileSize - 1) / kClusterTileSize),
+    tiles_y_((screen_height + kClusterTileSize - 1) / kClusterTileSize),
+    row_stride_((tiles_x_ + 3) & ~3u),
+    max_indices_(max_indices),
+    scale_x_(1.f),
+    scale_y_(1.f),
+    slice_scale_(0.f),
+    slice_bias_(0.f),
+    min_x_(),
+    min_y_(),
+    min_z_(),
+    max_x_(),
+    max_y_(),
+    max_z_(),
+    slice_bins_(kClusterSlices),
+    grid_(),
+    indices_(max_indices, 0),
+    index_count_(0),
+    max_cluster_count_(0),
+    overflow_count_(0) {
+  // Lights are packed with the cluster within the slice in 16 bits
+  assert(tiles_x_ * tiles_y_ <= 0x10000);
+
+  grid_.assign(cluster_count() * 2, 0);
+
+  // Padding tiles keep empty boxes, which no sphere touches
+  const float inf = std::numeric_limits<float>::infinity();
+  const size_t box_count = kClusterSlices * tiles_y_ * row_stride_;
+  min_x_.assign(box_count, inf);
+  min_y_.assign(box_count, inf);
+  min_z_.assign(box_count, inf);
+  max_x_.assign(box_count, -inf);
+  max_y_.assign(box_count, -inf);
+  max_z_.assign(box_count, -inf);
+
+  for (SliceBins &bins : slice_bins_) {
+    bins.counts.assign(tiles_x_ * tiles_y_, 0);
+    bins.cursors.assign(tiles_x_ * tiles_y_, 0);
+  }
+}
+
+void LightClusters::SetProjection(float scale_x, float scale_y,
+  float near_z, float far_z) {
+  scale_x_ = scale_x;
+  scale_y_ = scale_y;
+
+  // The first slice ends where the others start growing from
+  float split = std::max(kClusterNearDepth, near_z);
+  if (far_z <= split) {
+    split = near_z;
+  }
+  slice_scale_ = static_cast<float>(kClusterSlices - 1) /
+    std::log(far_z / split);
+  slice_bias_ = 1.f - std::log(split) * slice_scale_;
+
+  for (UInt32 s = 0; s < kClusterSlices; ++s) {
+    slice_near_[s] = s == 0 ? near_z :
+      std::exp((static_cast<float>(s) - slice_bias_) / slice_scale_);
+    slice_far_[s] = s == kClusterSlices - 1 ? far_z :
+      std::exp((static_cast<float>(s + 1) - slice_bias_) / slice_scale_);
+  }
+
+  // Boxes of the clusters. The x of a point on a tile's side grows with
+  // its depth, so a box spans the side at both ends of the slice.
+  for (UInt32 s = 0; s < kClusterSlices; ++s) {
+    float z0 = slice_near_[s] * (1.f - kClusterDepthPadding);
+    float z1 = slice_far_[s] * (1.f + kClusterDepthPadding);
+    for (UInt32 ty = 0; ty < tiles_y_; ++ty) {
+      float ndc_top = 1.f - 2.f * static_cast<float>(ty * kClusterTileSize) /
+        static_cast<float>(screen_height_);
+      float ndc_bottom = 1.f - 2.f *
+        static_cast<float>((ty + 1) * kClusterTileSize) /
+        static_cast<float>(screen_height_);
+      for (UInt32 tx = 0; tx < tiles_x_; ++tx) {
+        float ndc_left = 2.f * static_cast<float>(tx * kClusterTileSize) /
+          static_cast<float>(screen_width_) - 1.f;
+        float ndc_right = 2.f *
+          static_cast<float>((tx + 1) * kClusterTileSize) /
+          static_cast<float>(screen_width_) - 1.f;
+
+        size_t box = (s * tiles_y_ + ty) * row_stride_ + tx;
+        min_x_[box] = std::min(ndc_left * z0, ndc_left * z1) / scale_x_;
+        max_x_[box] = std::max(ndc_right * z0, ndc_right * z1) / scale_x_;
+        min_y_[box] = std::min(ndc_bottom * z0, ndc_bottom * z1) / scale_y_;
+        max_y_[box] = std::max(ndc_top * z0, ndc_top * z1) / scale_y_;
+        min_z_[box] = z0;
+        max_z_[box] = z1;
+      }
+    }
+  }
+}
+
+void LightClusters::Build(const ClusterSphere *spheres, UInt32 count,
+  WorkerPool *workers) {
+  assert(count <= 0x10000);
+
+  if (workers != nullptr) {
+    std::vector<WorkerPool::Task> tasks;
+    tasks.reserve(kClusterSlices);
+    for (UInt32 s = 0; s < kClusterSlices; ++s) {
+      tasks.push_back(std::bind(&LightClusters::BinSlice, this, s, spheres,
+        count));
+    }
+    workers->Run(tasks);
+  }
+  else {
+    for (UInt32 s = 0; s < kClusterSlices; ++s) {
+      BinSlice(s, spheres, count);
+    }
+  }
+
+  // Pack the lists of all the slices one after the other
+  const UInt32 slice_clusters = tiles_x_ * tiles_y_;
+  UInt32 offset = 0;
+  max_cluster_count_ = 0;
+  overflow_count_ = 0;
+  for (UInt32 s = 0; s < kClusterSlices; ++s) {
+    const SliceBins &bins = slice_bins_[s];
+    UInt32 begin = 0;
+    for (UInt32 c = 0; c < slice_clusters; ++c) {
+      UInt32 cluster = s * slice_clusters + c;
+      UInt32 found = bins.counts[c];
+      UInt32 fit = std::min(found, max_indices_ - offset);
+      grid_[cluster * 2] = offset;
+      grid_[cluster * 2 + 1] = fit;
+      if (fit > 0) {
+        memcpy(&indices_[offset], &bins.lights[begin], fit * sizeof(UInt32));
+      }
+      offset += fit;
+      begin += found;
+      overflow_count_ += found - fit;
+      max_cluster_count_ = std::max(max_cluster_count_, found);
+    }
+  }
+  index_count_ = offset;
+}
+
+UInt32 LightClusters::slice_of(float z) const {
+  float slice = std::log(z) * slice_scale_ + slice_bias_;
+  if (!(slice > 0.f)) {
+    return 0;
+  }
+
+  return std::min(static_cast<UInt32>(slice), kClusterSlices - 1);
+}
+
+void LightClusters::BinSlice(UInt32 slice, const ClusterSphere *spheres,
+  UInt32 count) {
+  SliceBins &bins = slice_bins_[slice];
+  bins.hits.clear();
+
+  const float z0 = slice_near_[slice] * (1.f - kClusterDepthPadding);
+  const float z1 = slice_far_[slice] * (1.f + kClusterDepthPadding);
+  const __m128 zero = _mm_setzero_ps();
+
+  for (UInt32 l = 0; l < count; ++l) {
+    const ClusterSphere &sphere = spheres[l];
+
+    if (sphere.radius < 0.f) {
+      for (UInt32 c = 0; c < tiles_x_ * tiles_y_; ++c) {
+        bins.hits.push_back((c << 16) | l);
+      }
+      continue;
+    }
+
+    if (sphere.z + sphere.radius < z0 || sphere.z - sphere.radius > z1) {
+      continue;
+    }
+
+    // Tiles the sphere may cover: its bounds in x and y, projected at the
+    // nearest and farthest depth it has in the slice
+    float near_z = std::max(z0, sphere.z - sphere.radius);
+    float far_z = std::min(z1, sphere.z + sphere.radius);
+    float left = sphere.x - sphere.radius;
+    float right = sphere.x + sphere.radius;
+    float bottom = sphere.y - sphere.radius;
+    float top = sphere.y + sphere.radius;
+    float ndc_left = std::min(left / near_z, left / far_z) * scale_x_;
+    float ndc_right = std::max(right / near_z, right / far_z) * scale_x_;
+    float ndc_bottom = std::min(bottom / near_z, bottom / far_z) * scale_y_;
+    float ndc_top = std::max(top / near_z, top / far_z) * scale_y_;
+
+    int tx0 = std::max(tile_x_of(ndc_left), 0);
+    int tx1 = std::min(tile_x_of(ndc_right), static_cast<int>(tiles_x_) - 1);
+    int ty0 = std::max(tile_y_of(ndc_top), 0);
+    int ty1 = std::min(tile_y_of(ndc_bottom), static_cast<int>(tiles_y_) - 1);
+
+    // Distance from the centre to each box, four boxes at a time
+    const __m128 cx = _mm_set1_ps(sphere.x);
+    const __m128 cy = _mm_set1_ps(sphere.y);
+    const __m128 cz = _mm_set1_ps(sphere.z);
+    const __m128 radius_sq = _mm_set1_ps(sphere.radius * sphere.radius);
+    for (int ty = ty0; ty <= ty1; ++ty) {
+      const size_t row = (slice * tiles_y_ + ty) * row_stride_;
+      for (int tx = tx0 & ~3; tx <= tx1; tx += 4) {
+        const size_t box = row + tx;
+        __m128 dx = _mm_max_ps(_mm_max_ps(
+          _mm_sub_ps(_mm_loadu_ps(&min_x_[box]), cx),
+          _mm_sub_ps(cx, _mm_loadu_ps(&max_x_[box]))), zero);
+        __m128 dy = _mm_max_ps(_mm_max_ps(
+          _mm_sub_ps(_mm_loadu_ps(&min_y_[box]), cy),
+          _mm_sub_ps(cy, _mm_loadu_ps(&max_y_[box]))), zero);
+        __m128 dz = _mm_max_ps(_mm_max_ps(
+          _mm_sub_ps(_mm_loadu_ps(&min_z_[box]), cz),
+          _mm_sub_ps(cz, _mm_loadu_ps(&max_z_[box]))), zero);
+        __m128 dist_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+          _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        int inside = _mm_movemask_ps(_mm_cmple_ps(dist_sq, radius_sq));
+
+        for (int k = 0; k < 4 && inside != 0; ++k, inside >>= 1) {
+          int x = tx + k;
+          if ((inside & 1) != 0 && x >= tx0 && x <= tx1) {
+            UInt32 c = ty * tiles_x_ + x;
+            bins.hits.push_back((c << 16) | l);
+          }
+        }
+      }
+    }
+  }
+
+  // Group the lights by cluster; each list keeps the order of the lights
+  const UInt32 slice_clusters = tiles_x_ * tiles_y_;
+  std::fill(bins.counts.begin(), bins.counts.end(), 0);
+  for (UInt32 hit : bins.hits) {
+    ++bins.counts[hit >> 16];
+  }
+  UInt32 offset = 0;
+  for (UInt32 c = 0; c < slice_clusters; ++c) {
+    bins.cursors[c] = offset;
+    offset += bins.counts[c];
+  }
+  bins.lights.resize(bins.hits.size());
+  for (UInt32 hit : bins.hits) {
+    bins.lights[bins.cursors[hit >> 16]++] = hit & 0xFFFF;
+  }
+}
+
+int LightClusters::tile_x_of(float ndc_x) const {
+  float tile = std::floor((ndc_x + 1.f) * 0.5f *
+    static_cast<float>(screen_width_) / static_cast<float>(kClusterTileSize));
+  return static_cast<int>(std::min(std::max(tile, -1.f),
+    static_cast<float>(tiles_x_)));
+}
+
+int LightClusters::tile_y_of(float ndc_y) const {
+  float tile = std::floor((1.f - ndc_y) * 0.5f *
+    static_cast<float>(screen_height_) /
+    static_cast<float>(kClusterTileSize));
+  return static_cast<int>(std::min(std::max(tile, -1.f),
+    static_cast<float>(tiles_y_)));
+}
+
+} // namespace sz
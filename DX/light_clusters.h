@@ -0,0 +1,174 @@
+//  Clustered lights
+//  * The view frustum is split into a grid of clusters: square tiles of the
+//    screen, and slices in depth whose thickness grows with the distance,
+//    so that clusters far away are not much longer than they are wide
+//  * Lights are binned into the clusters their sphere of influence touches
+//    every frame; each cluster then has a compact list of the lights which
+//    can reach it, and shaders only loop over the list of their pixel
+//  * Slices are binned at the same time on the worker threads. For each
+//    light, the tiles its sphere may cover are found from its projected
+//    bounds, and tested four at a time against the boxes of the clusters
+//    with SSE
+//  * Lights are listed in the order they were given in, so that the lists
+//    are the same whatever the threads did first
+//  * Lists are packed in one array of indices, which has a fixed capacity;
+//    clusters which do not fit lose the lights at the end of their list
+
+#ifndef _LIGHT_CLUSTERS_H
+#define _LIGHT_CLUSTERS_H
+
+#include <vector>
+#include "abertay_framework.h"
+
+namespace sz {
+  class WorkerPool;
+}
+
+namespace sz {
+
+// Size of the tiles of the clusters, in pixels
+const UInt32 kClusterTileSize = 64;
+
+// Slices of the clusters in depth
+const UInt32 kClusterSlices = 24;
+
+// Depth at which the second slice starts; the first slice takes everything
+// nearer, so that the many thin slices close to the camera are not wasted
+// on the few metres in front of it
+const float kClusterNearDepth = 5.f;
+
+// Sphere of influence of a light, in view space. Lights with a negative
+// radius, i.e. directional ones, reach every cluster.
+struct ClusterSphere {
+  float x;
+  float y;
+  float z;
+  float radius;
+};
+
+class LightClusters {
+public:
+  // Ctor; the grid covers a screen of the given size in pixels. The lists
+  // hold at most max_indices lights in all.
+  LightClusters(UInt32 screen_width, UInt32 screen_height,
+    UInt32 max_indices);
+
+  // Set the projection which the clusters divide: the scales of x and y,
+  // as in _11 and _22 of a perspective matrix, and the depths of its planes
+  void SetProjection(float scale_x, float scale_y, float near_z,
+    float far_z);
+
+  // Bin the lights into the clusters; the work is shared with the workers,
+  // if given. There are at most 65536 lights.
+  void Build(const ClusterSphere *spheres, UInt32 count,
+    WorkerPool *workers);
+
+  // Index of the cluster of a tile and slice, in the grid
+  inline UInt32 cluster_index(UInt32 tile_x, UInt32 tile_y,
+    UInt32 slice) const {
+    return (slice * tiles_y_ + tile_y) * tiles_x_ + tile_x;
+  }
+
+  // Slice of a view space depth, as shaders work it out
+  UInt32 slice_of(float z) const;
+
+  // Offset of the list of each cluster in the indices, then the number of
+  // lights in it
+  inline const std::vector<UInt32> &grid() const {
+    return grid_;
+  }
+  inline const std::vector<UInt32> &indices() const {
+    return indices_;
+  }
+  inline UInt32 index_count() const {
+    return index_count_;
+  }
+
+  inline UInt32 tiles_x() const {
+    return tiles_x_;
+  }
+  inline UInt32 tiles_y() const {
+    return tiles_y_;
+  }
+  inline UInt32 cluster_count() const {
+    return tiles_x_ * tiles_y_ * kClusterSlices;
+  }
+  // slice = log(z) * slice_scale + slice_bias, for depths beyond
+  // kClusterNearDepth
+  inline float slice_scale() const {
+    return slice_scale_;
+  }
+  inline float slice_bias() const {
+    return slice_bias_;
+  }
+
+  // Of the last Build: the most lights in one cluster, and how many did not
+  // fit in the indices
+  inline UInt32 max_cluster_count() const {
+    return max_cluster_count_;
+  }
+  inline UInt32 overflow_count() const {
+    return overflow_count_;
+  }
+
+  // Disable ctors
+  LightClusters(const LightClusters &) = delete;
+  LightClusters &operator=(const LightClusters &) = delete;
+
+private:
+  // Lights found in the clusters of a slice, packed as the cluster within
+  // the slice in the high 16 bits and the light in the low ones, then
+  // grouped by cluster; cursors are where the next light of each cluster
+  // goes while grouping
+  struct SliceBins {
+    std::vector<UInt32> hits;
+    std::vector<UInt32> counts;
+    std::vector<UInt32> cursors;
+    std::vector<UInt32> lights;
+  };
+
+  // Bin the lights into the clusters of one slice
+  void BinSlice(UInt32 slice, const ClusterSphere *spheres, UInt32 count);
+
+  // Tile of a point on the screen, from its x or y in NDC; -1 or the
+  // number of tiles for points off the grid
+  int tile_x_of(float ndc_x) const;
+  int tile_y_of(float ndc_y) const;
+
+  const UInt32 screen_width_;
+  const UInt32 screen_height_;
+  const UInt32 tiles_x_;
+  const UInt32 tiles_y_;
+  // Tiles of a row of boxes, rounded up to a multiple of 4
+  const UInt32 row_stride_;
+  const UInt32 max_indices_;
+
+  float scale_x_;
+  float scale_y_;
+  float slice_scale_;
+  float slice_bias_;
+  // Depths between which each slice lies
+  float slice_near_[kClusterSlices];
+  float slice_far_[kClusterSlices];
+
+  // View space boxes of the clusters, by slice, row and tile; the tiles
+  // which pad the rows have empty boxes
+  std::vector<float> min_x_;
+  std::vector<float> min_y_;
+  std::vector<float> min_z_;
+  std::vector<float> max_x_;
+  std::vector<float> max_y_;
+  std::vector<float> max_z_;
+
+  std::vector<SliceBins> slice_bins_;
+  std::vector<UInt32> grid_;
+  std::vector<UInt32> indices_;
+  UInt32 index_count_;
+  UInt32 max_cluster_count_;
+  UInt32 overflow_count_;
+
+}; // class LightClusters
+
+} // namespace sz
+
+#endif
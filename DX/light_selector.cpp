@@ -0,0 +1,201 @@
+#include "light_selector.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <xmmintrin.h>
+
+namespace sz {
+
+// Least attenuation a light is ranked with, so that lights whose factors
+// add up to nothing do not divide by zero
+const float kMinSelectorFalloff = 1e-6f;
+
+LightSelector::LightSelector() :
+    position_x_(),
+    position_y_(),
+    position_z_(),
+    range_(),
+    direction_x_(),
+    direction_y_(),
+    direction_z_(),
+    cos_cutoff_(),
+    sin_cutoff_(),
+    spot_(),
+    attenuation_0_(),
+    attenuation_1_(),
+    attenuation_2_(),
+    intensity_(),
+    count_(0) {
+}
+
+void LightSelector::SetLights(const ClusterLightType *lights, UInt32 count) {
+  count_ = count;
+  const size_t padded = (count + 3) & ~3u;
+  std::vector<float> *arrays[] = { &position_x_, &position_y_,
+    &position_z_, &range_, &direction_x_, &direction_y_, &direction_z_,
+    &cos_cutoff_, &sin_cutoff_, &spot_, &attenuation_0_, &attenuation_1_,
+    &attenuation_2_, &intensity_ };
+  for (std::vector<float> *array : arrays) {
+    array->assign(padded, 0.f);
+  }
+
+  for (UInt32 i = 0; i < count; ++i) {
+    const ClusterLightType &light = lights[i];
+
+    // The brightest channel of all that the light adds
+    intensity_[i] = std::max(std::max(
+      light.diffuse.x + light.ambient.x + light.specular.x,
+      light.diffuse.y + light.ambient.y + light.specular.y),
+      light.diffuse.z + light.ambient.z + light.specular.z);
+
+    if (light.kind == kClusterLightDirectional) {
+      range_[i] = std::numeric_limits<float>::infinity();
+      attenuation_0_[i] = 1.f;
+      continue;
+    }
+
+    position_x_[i] = light.position.x;
+    position_y_[i] = light.position.y;
+    position_z_[i] = light.position.z;
+    range_[i] = light.range;
+    attenuation_0_[i] = light.attenuation.x;
+    attenuation_1_[i] = light.attenuation.y;
+    attenuation_2_[i] = light.attenuation.z;
+
+    // The cone is widened by the angle a box takes from the light, which
+    // only holds while the sum stays below a whole turn
+    if (light.kind == kClusterLightSpot && light.spot_cos_cutoff >= 0.f) {
+      direction_x_[i] = light.direction.x;
+      direction_y_[i] = light.direction.y;
+      direction_z_[i] = light.direction.z;
+      cos_cutoff_[i] = light.spot_cos_cutoff;
+      sin_cutoff_[i] = sqrtf(std::max(1.f -
+        light.spot_cos_cutoff * light.spot_cos_cutoff, 0.f));
+      spot_[i] = 1.f;
+    }
+  }
+}
+
+UInt32 LightSelector::Select(const XMFLOAT3 &centre, const XMFLOAT3 &extents,
+  UInt32 *indices, UInt32 *reached) const {
+  // Best lights so far, strongest first, and the score to beat to be one
+  float best_scores[kMaxDrawLights];
+  UInt32 best_lights[kMaxDrawLights];
+  UInt32 best_count = 0;
+  float threshold = 0.f;
+  UInt32 reached_count = 0;
+
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 sign = _mm_set1_ps(-0.f);
+  const __m128 min_falloff = _mm_set1_ps(kMinSelectorFalloff);
+  const __m128 cx = _mm_set1_ps(centre.x);
+  const __m128 cy = _mm_set1_ps(centre.y);
+  const __m128 cz = _mm_set1_ps(centre.z);
+  const __m128 ex = _mm_set1_ps(extents.x);
+  const __m128 ey = _mm_set1_ps(extents.y);
+  const __m128 ez = _mm_set1_ps(extents.z);
+  // Sphere around the box
+  const float radius_sq_1 = extents.x * extents.x + extents.y * extents.y +
+    extents.z * extents.z;
+  const __m128 radius_sq = _mm_set1_ps(radius_sq_1);
+  const __m128 radius = _mm_set1_ps(sqrtf(radius_sq_1));
+
+  for (UInt32 group = 0; group < count_; group += 4) {
+    __m128 px = _mm_loadu_ps(&position_x_[group]);
+    __m128 py = _mm_loadu_ps(&position_y_[group]);
+    __m128 pz = _mm_loadu_ps(&position_z_[group]);
+
+    // Distance from the lights to the nearest point of the box
+    __m128 vx = _mm_sub_ps(cx, px);
+    __m128 vy = _mm_sub_ps(cy, py);
+    __m128 vz = _mm_sub_ps(cz, pz);
+    __m128 dx = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(sign, vx), ex), zero);
+    __m128 dy = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(sign, vy), ey), zero);
+    __m128 dz = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(sign, vz), ez), zero);
+    __m128 dist_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+      _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    __m128 dist = _mm_sqrt_ps(dist_sq);
+    __m128 in_range = _mm_cmple_ps(dist, _mm_loadu_ps(&range_[group]));
+
+    // Intensity over the attenuation there, as the shaders work it out
+    __m128 falloff = _mm_add_ps(_mm_add_ps(
+      _mm_loadu_ps(&attenuation_0_[group]),
+      _mm_mul_ps(_mm_loadu_ps(&attenuation_1_[group]), dist)),
+      _mm_mul_ps(_mm_loadu_ps(&attenuation_2_[group]), dist_sq));
+    __m128 score = _mm_div_ps(_mm_loadu_ps(&intensity_[group]),
+      _mm_max_ps(falloff, min_falloff));
+
+    // Spot cones, widened by the angle the sphere around the box takes
+    // from the light: the angle to the centre is within the cutoff plus
+    // that angle if proj >= cos(cutoff) * tangent - sin(cutoff) * radius,
+    // where tangent is the distance to the sphere's outline
+    __m128 length_sq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx),
+      _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+    __m128 proj = _mm_add_ps(_mm_add_ps(
+      _mm_mul_ps(vx, _mm_loadu_ps(&direction_x_[group])),
+      _mm_mul_ps(vy, _mm_loadu_ps(&direction_y_[group]))),
+      _mm_mul_ps(vz, _mm_loadu_ps(&direction_z_[group])));
+    __m128 tangent = _mm_sqrt_ps(_mm_max_ps(
+      _mm_sub_ps(length_sq, radius_sq), zero));
+    __m128 in_cone = _mm_cmpge_ps(proj, _mm_sub_ps(
+      _mm_mul_ps(_mm_loadu_ps(&cos_cutoff_[group]), tangent),
+      _mm_mul_ps(_mm_loadu_ps(&sin_cutoff_[group]), radius)));
+    in_cone = _mm_or_ps(in_cone, _mm_cmple_ps(length_sq, radius_sq));
+    in_cone = _mm_or_ps(in_cone,
+      _mm_cmpeq_ps(_mm_loadu_ps(&spot_[group]), zero));
+
+    __m128 reach = _mm_and_ps(_mm_and_ps(in_range, in_cone),
+      _mm_cmpgt_ps(score, zero));
+    int reach_mask = _mm_movemask_ps(reach);
+    if (reach_mask == 0) {
+      continue;
+    }
+    for (int mask = reach_mask; mask != 0; mask &= mask - 1) {
+      ++reached_count;
+    }
+
+    score = _mm_and_ps(score, reach);
+    int beat = _mm_movemask_ps(_mm_cmpgt_ps(score, _mm_set1_ps(threshold)));
+    if (beat == 0) {
+      continue;
+    }
+
+    float scores[4];
+    _mm_storeu_ps(scores, score);
+    for (UInt32 k = 0; k < 4; ++k, beat >>= 1) {
+      // The threshold may have risen with the lights before in the group
+      if ((beat & 1) == 0 || !(scores[k] > threshold)) {
+        continue;
+      }
+
+      // After the lights as strong, so that ties go to the first light
+      UInt32 slot = 0;
+      while (slot < best_count && best_scores[slot] >= scores[k]) {
+        ++slot;
+      }
+      if (best_count < kMaxDrawLights) {
+        ++best_count;
+      }
+      for (UInt32 j = best_count - 1; j > slot; --j) {
+        best_scores[j] = best_scores[j - 1];
+        best_lights[j] = best_lights[j - 1];
+      }
+      best_scores[slot] = scores[k];
+      best_lights[slot] = group + k;
+
+      if (best_count == kMaxDrawLights) {
+        threshold = best_scores[kMaxDrawLights - 1];
+      }
+    }
+  }
+
+  std::copy(best_lights, best_lights + best_count, indices);
+  std::sort(indices, indices + best_count);
+  if (reached != nullptr) {
+    *reached = reached_count;
+  }
+
+  return best_count;
+}
+
+} // namespace sz
@@ -0,0 +1,72 @@
+//  Per-draw light selection
+//  * Lights are ranked for each draw by how much they may add at its
+//    bounds: their intensity over their attenuation at the nearest point of
+//    the box, or nothing if the box is out of their range or spot cone
+//  * Lights are kept as structure of arrays and ranked four at a time with
+//    SSE; only those which beat the weakest of the best so far are inserted
+//    into the ranking
+//  * The best kMaxDrawLights are given in the order of the lights, which is
+//    the order of the lists of the clusters, so that a draw whose lights
+//    all fit is lit as its clusters would light it
+
+#ifndef _LIGHT_SELECTOR_H
+#define _LIGHT_SELECTOR_H
+
+#include <vector>
+#include <directxmath.h>
+#include "abertay_framework.h"
+#include "buffer_types.h"
+
+namespace sz {
+
+using namespace DirectX;
+
+class LightSelector {
+public:
+  // Ctor
+  LightSelector();
+
+  // Take the lights to rank, as they are given to the shaders
+  void SetLights(const ClusterLightType *lights, UInt32 count);
+
+  // Pick the lights of a box in world space, given by centre and half
+  // extents. At most kMaxDrawLights indices of lights are written, in
+  // increasing order, and their number returned; reached is set to how many
+  // lights may reach the box at all.
+  UInt32 Select(const XMFLOAT3 &centre, const XMFLOAT3 &extents,
+    UInt32 *indices, UInt32 *reached) const;
+
+  inline UInt32 light_count() const {
+    return count_;
+  }
+
+  // Disable ctors
+  LightSelector(const LightSelector &) = delete;
+  LightSelector &operator=(const LightSelector &) = delete;
+
+private:
+  // Padded with lights of no intensity to a multiple of 4. Directional
+  // lights have an infinite range and no attenuation; lights which are not
+  // spot lights, or whose cone is wider than a half sphere, have no cone.
+  std::vector<float> position_x_;
+  std::vector<float> position_y_;
+  std::vector<float> position_z_;
+  std::vector<float> range_;
+  std::vector<float> direction_x_;
+  std::vector<float> direction_y_;
+  std::vector<float> direction_z_;
+  // Cosine and sine of the half angle of the cone, and 1 for spot lights
+  std::vector<float> cos_cutoff_;
+  std::vector<float> sin_cutoff_;
+  std::vector<float> spot_;
+  std::vector<float> attenuation_0_;
+  std::vector<float> attenuation_1_;
+  std::vector<float> attenuation_2_;
+  std::vector<float> intensity_;
+  UInt32 count_;
+
+}; // class LightSelector
+
+} // namespace sz
+
+#endif
@@ -1,4 +1,5 @@
 #include "light_spec_map_shader.h"
+#include "state_cache.h"
 #include "Texture.h"
 #include "RenderTexture.h"
 #include <sstream>
@@ -111,8 +112,10 @@ void LightSpecMapShader::InitShader(sz::ConstBufManager &buf_man,
   samplerDesc.MinLOD = 0;
   samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
-  // Create the texture sampler state.
-  m_device->CreateSamplerState(&samplerDesc, &m_sampleState);
+  // Get the texture sampler state; shaders with the same description
+  // share it
+  m_sampleState = sz::StateCache::Inst()->GetSamplerState(m_device,
+    samplerDesc);
 
 
   // Create the constant buffer for materials
@@ -137,72 +140,34 @@ void LightSpecMapShader::SetShaderParameters(ID3D11DeviceContext* deviceContext,
   const XMMATRIX &projectionMatrix, const sz::Material &mat) {
   HRESULT result;
   D3D11_MAPPED_SUBRESOURCE mapped_resource;
-  sz::MatrixBufferType* data_ptr;
   unsigned int bufferNumber;
-  XMMATRIX tworld, tview, tproj;
 
 
-  // Transpose the matrices to prepare them for the shader.
-  tworld = XMMatrixTranspose(worldMatrix);
-  tview = XMMatrixTranspose(viewMatrix);
-  tproj = XMMatrixTranspose(projectionMatrix);
-
-  // Lock the constant buffer so it can be written to.
-  result = deviceContext->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-
-  // Get a pointer to the data in the constant buffer.
-  data_ptr = (sz::MatrixBufferType*)mapped_resource.pData;
-
-  // Copy the matrices into the constant buffer.
-  data_ptr->world = tworld;// worldMatrix;
-  data_ptr->view = tview;
-  data_ptr->projection = tproj;
-
-  // Unlock the constant buffer.
-  deviceContext->Unmap(m_matrixBuffer, 0);
+  // Write the matrices, or the entry of the draw in its transform batch
+  WriteMatrixConstants(m_matrixBuffer, worldMatrix, viewMatrix,
+    projectionMatrix);
 
   // Set the position of the constant buffer in the vertex shader.
   bufferNumber = 0;
 
   // Now set the constant buffer in the vertex shader with the updated values.
-  deviceContext->VSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
-  deviceContext->DSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
-
-  // Assign the material data
-  sz::MaterialBufferType *mat_buff_ptr;
-  result = deviceContext->Map(material_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0,
-    &mapped_resource);
-  // Get a ptr to the data in the constant buffer
-  mat_buff_ptr = (sz::MaterialBufferType *)mapped_resource.pData;
-  // Set its data
-  mat_buff_ptr->ambient = XMFLOAT4(mat.ambient[0], mat.ambient[1],
-    mat.ambient[2], mat.dissolve);
-  mat_buff_ptr->diffuse = XMFLOAT4(mat.diffuse[0], mat.diffuse[1],
-    mat.diffuse[2], mat.dissolve);
-  mat_buff_ptr->specular = XMFLOAT4(mat.specular[0], mat.specular[1],
-    mat.specular[2], mat.dissolve);
-  mat_buff_ptr->transmittance = XMFLOAT4(mat.transmittance[0], 
-    mat.transmittance[1], mat.transmittance[2], 1.f);
-  mat_buff_ptr->emission = XMFLOAT4(mat.emission[0], mat.emission[1],
-    mat.emission[2], mat.dissolve);
-  mat_buff_ptr->shininess = mat.shininess;
-  mat_buff_ptr->ior = mat.ior;
-  mat_buff_ptr->dissolve = mat.dissolve;
-  mat_buff_ptr->illum = mat.illum;
-  // Unlock the constant buffer
-  deviceContext->Unmap(material_buf_, 0);
-  // Set the constant buffer index in the pixel shader
-  deviceContext->PSSetConstantBuffers(1, 1, &material_buf_);
+  sz::StateCache::Inst()->VSSetConstantBuffers(bufferNumber, 1,
+    &m_matrixBuffer);
+  sz::StateCache::Inst()->DSSetConstantBuffers(bufferNumber, 1,
+    &m_matrixBuffer);
+
+  // Bind the constants of the material
+  SetMaterialConstants(material_buf_, mat);
 
   // Set shader resources for shadow maps
 
   ID3D11ShaderResourceView * texture =
-    Texture::Inst()->GetTexture(mat.diffuse_texname_crc);
+    Texture::Inst()->GetTexture(mat.diffuse_texture);
   ID3D11ShaderResourceView * texture_spec = 
-    Texture::Inst()->GetTexture(mat.specular_texname_crc);
+    Texture::Inst()->GetTexture(mat.specular_texture);
   // Set shader texture resource in the pixel shader.
-  deviceContext->PSSetShaderResources(0, 1, &texture);
-  deviceContext->PSSetShaderResources(1, 1, &texture_spec);
+  sz::StateCache::Inst()->PSSetShaderResources(0, 1, &texture);
+  sz::StateCache::Inst()->PSSetShaderResources(1, 1, &texture_spec);
 }
 
 void LightSpecMapShader::SetShaderFrameParameters(ID3D11DeviceContext* deviceContext, std::vector<Light> &lights, Camera *cam) {
@@ -213,7 +178,8 @@ void LightSpecMapShader::SetShaderFrameParameters(ID3D11DeviceContext* deviceCon
   unsigned int bufferNumber;
   
   // Send light data to pixel shader
-  result = deviceContext->Map(m_lightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
+  result = sz::StateCache::Inst()->Map(m_lightBuffer, 0,
+    D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
   light_ptr = (sz::LightBufferType*)mapped_resource.pData;
   for (unsigned int i = 0; i < lights.size(); i++) {
     light_ptr[i].diffuse = lights[i].GetDiffuseColour();
@@ -230,11 +196,11 @@ void LightSpecMapShader::SetShaderFrameParameters(ID3D11DeviceContext* deviceCon
     light_ptr[i].spot_cutoff = lights[i].spot_cutoff();
     light_ptr[i].spot_exponent = lights[i].spot_exponent();
   }
-  deviceContext->Unmap(m_lightBuffer, 0);
+  sz::StateCache::Inst()->Unmap(m_lightBuffer, 0);
   bufferNumber = 0;
-  deviceContext->PSSetConstantBuffers(bufferNumber, 1, &m_lightBuffer);
-  deviceContext->VSSetConstantBuffers(2, 1, &m_lightBuffer);
-  deviceContext->DSSetConstantBuffers(2, 1, &m_lightBuffer);
+  sz::StateCache::Inst()->PSSetConstantBuffers(bufferNumber, 1, &m_lightBuffer);
+  sz::StateCache::Inst()->VSSetConstantBuffers(2, 1, &m_lightBuffer);
+  sz::StateCache::Inst()->DSSetConstantBuffers(2, 1, &m_lightBuffer);
 
 }
 
@@ -244,7 +210,7 @@ void LightSpecMapShader::SetShaderFrameParameters(ID3D11DeviceContext* deviceCon
     size_t base_vertex)
 {
   // Set the sampler state in the pixel shader.
-  deviceContext->PSSetSamplers(0, 1, &m_sampleState);
+  sz::StateCache::Inst()->PSSetSamplers(0, 1, &m_sampleState);
 
   // Base render function.
   BaseShader::Render(deviceContext, index_count, index_start, base_vertex);
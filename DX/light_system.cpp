@@ -0,0 +1,274 @@
+#include "light_system.h"
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+namespace sz {
+
+// Field of view of the projections of the lights, which are square
+const float kLightFieldOfView = XM_PIDIV2;
+
+LightSystem::LightSystem(UInt32 count, float near_z, float far_z) :
+    position_x_(count, 0.f),
+    position_y_(count, 0.f),
+    position_z_(count, 0.f),
+    position_w_(count, 0.f),
+    direction_x_(count, 0.f),
+    direction_y_(count, 0.f),
+    direction_z_(count, 1.f),
+    ambient_(count, XMFLOAT4(0.f, 0.f, 0.f, 0.f)),
+    diffuse_(count, XMFLOAT4(0.f, 0.f, 0.f, 0.f)),
+    specular_(count, XMFLOAT4(0.f, 0.f, 0.f, 0.f)),
+    specular_power_(count, 0.f),
+    attenuation_(count, XMFLOAT3(0.f, 0.f, 0.f)),
+    range_(count, 0.f),
+    spot_cutoff_(count, XM_PI),
+    spot_exponent_(count, 1.f),
+    active_(count, 0),
+    near_(count, near_z),
+    far_(count, far_z),
+    views_(count),
+    projections_(count),
+    dirty_(count, kLightDirtyView | kLightDirtyProjection | kLightDirtyData),
+    changed_(count, 0),
+    batch_(),
+    version_(0) {
+  batch_.reserve(count);
+}
+
+void LightSystem::SetPosition(UInt32 light, float x, float y, float z,
+  float w) {
+  if (position_x_[light] == x && position_y_[light] == y &&
+    position_z_[light] == z && position_w_[light] == w) {
+    return;
+  }
+  position_x_[light] = x;
+  position_y_[light] = y;
+  position_z_[light] = z;
+  position_w_[light] = w;
+  MarkDirty(light, kLightDirtyView | kLightDirtyData);
+}
+
+void LightSystem::SetDirection(UInt32 light, float x, float y, float z) {
+  float magnitude = sqrtf(x * x + y * y + z * z);
+  if (magnitude == 0.f) {
+    return;
+  }
+  x /= magnitude;
+  y /= magnitude;
+  z /= magnitude;
+  if (direction_x_[light] == x && direction_y_[light] == y &&
+    direction_z_[light] == z) {
+    return;
+  }
+  direction_x_[light] = x;
+  direction_y_[light] = y;
+  direction_z_[light] = z;
+  MarkDirty(light, kLightDirtyView | kLightDirtyData);
+}
+
+// Set a value of a light; returns whether it changed
+template<typename T>
+static bool Assign(T &value, const T &v) {
+  if (memcmp(&value, &v, sizeof(T)) == 0) {
+    return false;
+  }
+  value = v;
+  return true;
+}
+
+void LightSystem::SetAmbientColour(UInt32 light, float r, float g, float b,
+  float a) {
+  if (Assign(ambient_[light], XMFLOAT4(r, g, b, a))) {
+    MarkDirty(light, kLightDirtyData);
+  }
+}
+
+void LightSystem::SetDiffuseColour(UInt32 light, float r, float g, float b,
+  float a) {
+  if (Assign(diffuse_[light], XMFLOAT4(r, g, b, a))) {
+    MarkDirty(light, kLightDirtyData);
+  }
+}
+
+void LightSystem::SetSpecularColour(UInt32 light, float r, float g, float b,
+  float a) {
+  if (Assign(specular_[light], XMFLOAT4(r, g, b, a))) {
+    MarkDirty(light, kLightDirtyData);
+  }
+}
+
+void LightSystem::SetSpecularPower(UInt32 light, float power) {
+  if (Assign(specular_power_[light], power)) {
+    MarkDirty(light, kLightDirtyData);
+  }
+}
+
+void LightSystem::SetAttenuation(UInt32 light, float constant, float linear,
+  float quadratic) {
+  if (Assign(attenuation_[light], XMFLOAT3(constant, linear, quadratic))) {
+    MarkDirty(light, kLightDirtyData);
+  }
+}
+
+void LightSystem::SetRange(UInt32 light, float range) {
+  if (Assign(range_[light], range)) {
+    MarkDirty(light, kLightDirtyData);
+  }
+}
+
+void LightSystem::SetProjection(UInt32 light, float near_z, float far_z) {
+  bool changed = Assign(near_[light], near_z);
+  changed = Assign(far_[light], far_z) || changed;
+  if (changed) {
+    MarkDirty(light, kLightDirtyProjection | kLightDirtyData);
+  }
+}
+
+void LightSystem::set_active(UInt32 light, bool active) {
+  if (Assign(active_[light], static_cast<UInt8>(active ? 1 : 0))) {
+    MarkDirty(light, kLightDirtyData);
+  }
+}
+
+void LightSystem::set_spot_cutoff(UInt32 light, float cutoff) {
+  if (Assign(spot_cutoff_[light], cutoff)) {
+    MarkDirty(light, kLightDirtyData);
+  }
+}
+
+void LightSystem::set_spot_exponent(UInt32 light, float exponent) {
+  if (Assign(spot_exponent_[light], exponent)) {
+    MarkDirty(light, kLightDirtyData);
+  }
+}
+
+bool LightSystem::Update() {
+  bool any_changed = false;
+  batch_.clear();
+  for (UInt32 i = 0; i < count(); ++i) {
+    UInt8 dirty = dirty_[i];
+    changed_[i] = dirty;
+    if (dirty == 0) {
+      continue;
+    }
+    any_changed = true;
+    dirty_[i] = 0;
+
+    if (dirty & kLightDirtyView) {
+      batch_.push_back(i);
+    }
+    // Rare enough not to be worth a batch of their own
+    if (dirty & kLightDirtyProjection) {
+      XMStoreFloat4x4(&projections_[i], XMMatrixPerspectiveFovLH(
+        kLightFieldOfView, 1.f, near_[i], far_[i]));
+    }
+  }
+
+  GenerateViews();
+  if (any_changed) {
+    ++version_;
+  }
+
+  return any_changed;
+}
+
+// Values of four lights of an array, one per lane
+static inline __m128 Gather(const std::vector<float> &values,
+  const UInt32 *lights) {
+  return _mm_setr_ps(values[lights[0]], values[lights[1]], values[lights[2]],
+    values[lights[3]]);
+}
+
+void LightSystem::GenerateViews() {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 sign = _mm_set1_ps(-0.f);
+  // Below which the direction is taken to be along up
+  const __m128 min_length_sq = _mm_set1_ps(1e-12f);
+
+  const size_t count = batch_.size();
+  for (size_t group = 0; group < count; group += 4) {
+    // The last group is padded with its last light, which is written again
+    // with the same values
+    UInt32 lights[4];
+    for (size_t k = 0; k < 4; ++k) {
+      lights[k] = batch_[group + k < count ? group + k : count - 1];
+    }
+
+    __m128 px = Gather(position_x_, lights);
+    __m128 py = Gather(position_y_, lights);
+    __m128 pz = Gather(position_z_, lights);
+    __m128 zx = Gather(direction_x_, lights);
+    __m128 zy = Gather(direction_y_, lights);
+    __m128 zz = Gather(direction_z_, lights);
+
+    // As XMMatrixLookToLH with up along y: x = normalise(up x z), which is
+    // (z.z, 0, -z.x). Lights which look straight up or down take x as
+    // their right instead of a degenerate basis.
+    __m128 length_sq = _mm_add_ps(_mm_mul_ps(zz, zz), _mm_mul_ps(zx, zx));
+    __m128 along_up = _mm_cmplt_ps(length_sq, min_length_sq);
+    __m128 inv_length = _mm_div_ps(one,
+      _mm_sqrt_ps(_mm_max_ps(length_sq, min_length_sq)));
+    __m128 xx = _mm_or_ps(_mm_andnot_ps(along_up,
+      _mm_mul_ps(zz, inv_length)), _mm_and_ps(along_up, one));
+    __m128 xz = _mm_andnot_ps(along_up,
+      _mm_xor_ps(_mm_mul_ps(zx, inv_length), sign));
+    __m128 xy = zero;
+
+    // y = z x x
+    __m128 yx = _mm_sub_ps(_mm_mul_ps(zy, xz), _mm_mul_ps(zz, xy));
+    __m128 yy = _mm_sub_ps(_mm_mul_ps(zz, xx), _mm_mul_ps(zx, xz));
+    __m128 yz = _mm_sub_ps(_mm_mul_ps(zx, xy), _mm_mul_ps(zy, xx));
+
+    // Translation: the position projected on each axis, negated
+    __m128 tx = _mm_xor_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(xx, px),
+      _mm_mul_ps(xy, py)), _mm_mul_ps(xz, pz)), sign);
+    __m128 ty = _mm_xor_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(yx, px),
+      _mm_mul_ps(yy, py)), _mm_mul_ps(yz, pz)), sign);
+    __m128 tz = _mm_xor_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(zx, px),
+      _mm_mul_ps(zy, py)), _mm_mul_ps(zz, pz)), sign);
+
+    // The axes are the columns; each row holds one element of the four
+    // lights, so that transposing it gives that row of each light
+    __m128 rows[4][4] = {
+      { xx, yx, zx, zero },
+      { xy, yy, zy, zero },
+      { xz, yz, zz, zero },
+      { tx, ty, tz, one },
+    };
+    for (size_t r = 0; r < 4; ++r) {
+      _MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+      for (size_t k = 0; k < 4; ++k) {
+        _mm_storeu_ps(views_[lights[k]].m[r], rows[r][k]);
+      }
+    }
+  }
+}
+
+XMMATRIX LightSystem::influence_projection(UInt32 light) const {
+  float field_of_view, near_plane, far_plane;
+  InfluenceFrustum(light, &field_of_view, &near_plane, &far_plane);
+
+  return XMMatrixPerspectiveFovLH(field_of_view, 1.f, near_plane,
+    far_plane);
+}
+
+void LightSystem::InfluenceFrustum(UInt32 light, float *field_of_view,
+  float *near_z, float *far_z) const {
+  // Nothing is lit beyond the range
+  *near_z = near_[light];
+  *far_z = far_[light];
+  if (range_[light] > near_[light] && range_[light] < *far_z) {
+    *far_z = range_[light];
+  }
+
+  // Nor outside of the cone, when it is narrower than the projection
+  *field_of_view = kLightFieldOfView;
+  if (spot_cutoff_[light] < XM_PI &&
+    2.f * spot_cutoff_[light] < *field_of_view) {
+    *field_of_view = 2.f * spot_cutoff_[light];
+  }
+}
+
+} // namespace sz
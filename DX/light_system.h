@@ -0,0 +1,179 @@
+//  Lights of the scene
+//  * Lights are kept as structure of arrays, one array per field, and
+//    addressed by index; the first kNumLights may have shadow maps
+//  * Setters only mark a light dirty, and only if the value changed; the
+//    lights which did not change cost nothing in later frames
+//  * Update regenerates the view matrices of the lights which moved four at
+//    a time with SSE, and the projections of those whose planes changed
+//  * Every Update which found a change moves the version on, so that what is
+//    built from the lights, e.g. the buffers of the shaders, is only built
+//    again when it differs
+
+#ifndef _LIGHT_SYSTEM_H
+#define _LIGHT_SYSTEM_H
+
+#include <vector>
+#include <directxmath.h>
+#include "abertay_framework.h"
+
+namespace sz {
+
+using namespace DirectX;
+
+// What changed about a light: its position or direction, the planes of its
+// projection, or any other of its values
+const UInt8 kLightDirtyView = 1;
+const UInt8 kLightDirtyProjection = 2;
+const UInt8 kLightDirtyData = 4;
+
+class LightSystem {
+public:
+  // Ctor; count inactive lights, with no colour, pointing along z, whose
+  // projections lie between the given planes
+  LightSystem(UInt32 count, float near_z, float far_z);
+
+  // Setters. w of the position is above 0 for directional lights, 0 for
+  // point and spot lights; directions are normalised.
+  void SetPosition(UInt32 light, float x, float y, float z, float w);
+  void SetDirection(UInt32 light, float x, float y, float z);
+  void SetAmbientColour(UInt32 light, float r, float g, float b, float a);
+  void SetDiffuseColour(UInt32 light, float r, float g, float b, float a);
+  void SetSpecularColour(UInt32 light, float r, float g, float b, float a);
+  void SetSpecularPower(UInt32 light, float power);
+  void SetAttenuation(UInt32 light, float constant, float linear,
+    float quadratic);
+  void SetRange(UInt32 light, float range);
+  void SetProjection(UInt32 light, float near_z, float far_z);
+  void set_active(UInt32 light, bool active);
+  // Half angle of the cone, or XM_PI for lights which are not spot lights
+  void set_spot_cutoff(UInt32 light, float cutoff);
+  void set_spot_exponent(UInt32 light, float exponent);
+
+  // Regenerate the matrices of the dirty lights, and make them clean.
+  // Returns whether any light changed.
+  bool Update();
+
+  // Projection narrowed to where a light reaches: its range, and the cone
+  // of spot lights; used to cull what it lights
+  XMMATRIX influence_projection(UInt32 light) const;
+  // Field of view and planes of influence_projection
+  void InfluenceFrustum(UInt32 light, float *field_of_view, float *near_z,
+    float *far_z) const;
+
+  inline UInt32 count() const {
+    return static_cast<UInt32>(active_.size());
+  }
+  // Moves on with every Update which found a change
+  inline UInt32 version() const {
+    return version_;
+  }
+  // Dirty bits a light had at the last Update
+  inline UInt8 changed(UInt32 light) const {
+    return changed_[light];
+  }
+
+  inline XMFLOAT3 position(UInt32 light) const {
+    return XMFLOAT3(position_x_[light], position_y_[light],
+      position_z_[light]);
+  }
+  inline XMFLOAT4 position4(UInt32 light) const {
+    return XMFLOAT4(position_x_[light], position_y_[light],
+      position_z_[light], position_w_[light]);
+  }
+  inline XMFLOAT3 direction(UInt32 light) const {
+    return XMFLOAT3(direction_x_[light], direction_y_[light],
+      direction_z_[light]);
+  }
+  inline const XMFLOAT4 &ambient(UInt32 light) const {
+    return ambient_[light];
+  }
+  inline const XMFLOAT4 &diffuse(UInt32 light) const {
+    return diffuse_[light];
+  }
+  inline const XMFLOAT4 &specular(UInt32 light) const {
+    return specular_[light];
+  }
+  inline float specular_power(UInt32 light) const {
+    return specular_power_[light];
+  }
+  inline const XMFLOAT3 &attenuation(UInt32 light) const {
+    return attenuation_[light];
+  }
+  inline float range(UInt32 light) const {
+    return range_[light];
+  }
+  inline bool active(UInt32 light) const {
+    return active_[light] != 0;
+  }
+  inline float spot_cutoff(UInt32 light) const {
+    return spot_cutoff_[light];
+  }
+  inline float spot_exponent(UInt32 light) const {
+    return spot_exponent_[light];
+  }
+  inline bool directional(UInt32 light) const {
+    return position_w_[light] > 0.f;
+  }
+  inline bool spot(UInt32 light) const {
+    return !directional(light) && spot_cutoff_[light] != XM_PI;
+  }
+  // Whether shaders use the light's shadow map; only spot lights are
+  // shadowed
+  inline bool casts_shadows(UInt32 light) const {
+    return position_w_[light] == 0.f && spot_cutoff_[light] != XM_PI;
+  }
+
+  // As of the last Update
+  inline const XMFLOAT4X4 &view(UInt32 light) const {
+    return views_[light];
+  }
+  inline const XMFLOAT4X4 &projection(UInt32 light) const {
+    return projections_[light];
+  }
+
+  // Disable ctors
+  LightSystem(const LightSystem &) = delete;
+  LightSystem &operator=(const LightSystem &) = delete;
+
+private:
+  // Regenerate the view matrices of the lights in batch_
+  void GenerateViews();
+
+  inline void MarkDirty(UInt32 light, UInt8 bits) {
+    dirty_[light] |= bits;
+  }
+
+  std::vector<float> position_x_;
+  std::vector<float> position_y_;
+  std::vector<float> position_z_;
+  std::vector<float> position_w_;
+  std::vector<float> direction_x_;
+  std::vector<float> direction_y_;
+  std::vector<float> direction_z_;
+  std::vector<XMFLOAT4> ambient_;
+  std::vector<XMFLOAT4> diffuse_;
+  std::vector<XMFLOAT4> specular_;
+  std::vector<float> specular_power_;
+  std::vector<XMFLOAT3> attenuation_;
+  std::vector<float> range_;
+  std::vector<float> spot_cutoff_;
+  std::vector<float> spot_exponent_;
+  std::vector<UInt8> active_;
+  // Planes of the projections
+  std::vector<float> near_;
+  std::vector<float> far_;
+
+  std::vector<XMFLOAT4X4> views_;
+  std::vector<XMFLOAT4X4> projections_;
+
+  std::vector<UInt8> dirty_;
+  std::vector<UInt8> changed_;
+  // Lights whose view is generated by the current Update
+  std::vector<UInt32> batch_;
+  UInt32 version_;
+
+}; // class LightSystem
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,92 @@
+#include "material_table.h"
+#include <cstring>
+
+namespace sz {
+
+MaterialTable *MaterialTable::single_instance_ = nullptr;
+
+MaterialTable::MaterialTable() :
+    constants_(),
+    buffers_() {
+}
+
+MaterialTable::~MaterialTable() {
+  for (ID3D11Buffer *buffer : buffers_) {
+    ReleaseNull(buffer);
+  }
+}
+
+MaterialTable *MaterialTable::Inst() {
+  // If instance doen't exist
+  if (single_instance_ == nullptr) {
+    // Create it
+    single_instance_ = new MaterialTable();
+  }
+
+  return single_instance_;
+}
+
+void MaterialTable::ResetInst() {
+  if (single_instance_ != nullptr) {
+    delete single_instance_;
+    single_instance_ = nullptr;
+  }
+}
+
+void MaterialTable::Pack(const MaterialInfo &info,
+  MaterialBufferType &constants) {
+  // Zeroed first, so that entries can be compared bytewise
+  memset(&constants, 0, sizeof(MaterialBufferType));
+
+  constants.ambient = XMFLOAT4(info.ambient[0], info.ambient[1],
+    info.ambient[2], info.dissolve);
+  constants.diffuse = XMFLOAT4(info.diffuse[0], info.diffuse[1],
+    info.diffuse[2], info.dissolve);
+  constants.specular = XMFLOAT4(info.specular[0], info.specular[1],
+    info.specular[2], info.dissolve);
+  constants.transmittance = XMFLOAT4(info.transmittance[0],
+    info.transmittance[1], info.transmittance[2], 1.f);
+  constants.emission = XMFLOAT4(info.emission[0], info.emission[1],
+    info.emission[2], info.dissolve);
+  constants.shininess = info.shininess;
+  constants.ior = info.ior;
+  constants.dissolve = info.dissolve;
+  constants.illum = info.illum;
+}
+
+UInt32 MaterialTable::Add(ID3D11Device *device, const MaterialInfo &info) {
+  MaterialBufferType constants;
+  Pack(info, constants);
+
+  // Only done when loading, for at most a few hundred materials
+  for (size_t i = 0; i < constants_.size(); ++i) {
+    if (memcmp(&constants_[i], &constants, sizeof(MaterialBufferType)) == 0) {
+      return static_cast<UInt32>(i);
+    }
+  }
+
+  D3D11_BUFFER_DESC desc;
+  desc.Usage = D3D11_USAGE_IMMUTABLE;
+  desc.ByteWidth = sizeof(MaterialBufferType);
+  desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  desc.CPUAccessFlags = 0;
+  desc.MiscFlags = 0;
+  desc.StructureByteStride = 0;
+
+  D3D11_SUBRESOURCE_DATA data;
+  data.pSysMem = &constants;
+  data.SysMemPitch = 0;
+  data.SysMemSlicePitch = 0;
+
+  ID3D11Buffer *buffer = nullptr;
+  if (FAILED(device->CreateBuffer(&desc, &data, &buffer))) {
+    return kNoMaterialTableIndex;
+  }
+
+  constants_.push_back(constants);
+  buffers_.push_back(buffer);
+
+  return static_cast<UInt32>(buffers_.size() - 1);
+}
+
+} // namespace sz
@@ -0,0 +1,64 @@
+//  Table of the constants of all the materials
+//  * Materials do not change once they are loaded, so their constants are
+//    packed once, when they are added, into immutable constant buffers
+//  * A Material keeps the index of its entry, and drawing it binds the
+//    buffer of the entry; nothing is written per draw
+//  * Materials with the same constants share an entry, so that consecutive
+//    draws with them leave the binding as it is
+
+#ifndef _MATERIAL_TABLE_H
+#define _MATERIAL_TABLE_H
+
+#include <vector>
+#include <d3d11.h>
+#include "abertay_framework.h"
+#include "buffer_types.h"
+#include "Material.h"
+
+namespace sz {
+
+class MaterialTable {
+public:
+  // Retrieve instance of singleton
+  static MaterialTable *Inst();
+
+  // Resets singleton to not having an instance, releasing the buffers
+  static void ResetInst();
+
+  // Pack the constants of a material and return the index of their entry,
+  // creating it if no entry has the same constants. Returns
+  // kNoMaterialTableIndex if the buffer could not be created.
+  UInt32 Add(ID3D11Device *device, const MaterialInfo &info);
+
+  // Write the constants of a material as the pixel shaders read them
+  static void Pack(const MaterialInfo &info, MaterialBufferType &constants);
+
+  inline ID3D11Buffer *buffer(UInt32 index) const {
+    return buffers_[index];
+  }
+  inline const MaterialBufferType &constants(UInt32 index) const {
+    return constants_[index];
+  }
+  inline size_t size() const {
+    return buffers_.size();
+  }
+
+  // Disable ctors
+  MaterialTable(const MaterialTable &) = delete;
+  MaterialTable &operator=(const MaterialTable &) = delete;
+
+private:
+  MaterialTable();
+  ~MaterialTable();
+
+  std::vector<MaterialBufferType> constants_;
+  std::vector<ID3D11Buffer *> buffers_;
+
+  // Ptr to single global instance
+  static MaterialTable *single_instance_;
+
+}; // class MaterialTable
+
+} // namespace sz
+
+#endif
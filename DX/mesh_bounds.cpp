@@ -0,0 +1,240 @@
+#include "mesh_bounds.h"
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace sz {
+
+void TransformBox(const XMFLOAT3 &centre, const XMFLOAT3 &extents,
+  const XMMATRIX &transform, XMFLOAT3 &out_centre, XMFLOAT3 &out_extents) {
+  XMStoreFloat3(&out_centre,
+    XMVector3Transform(XMLoadFloat3(&centre), transform));
+
+  // Each extent of the result is the sum of the extents along the
+  // transformed axes
+  XMVECTOR e = XMLoadFloat3(&extents);
+  XMVECTOR x = XMVectorAbs(transform.r[0]);
+  XMVECTOR y = XMVectorAbs(transform.r[1]);
+  XMVECTOR z = XMVectorAbs(transform.r[2]);
+  XMVECTOR result = XMVectorMultiply(XMVectorSplatX(e), x);
+  result = XMVectorMultiplyAdd(XMVectorSplatY(e), y, result);
+  result = XMVectorMultiplyAdd(XMVectorSplatZ(e), z, result);
+  XMStoreFloat3(&out_extents, result);
+}
+
+void ExtractFrustumPlanes(const XMMATRIX &to_clip, XMVECTOR planes[6]) {
+  // From the columns of the matrix; D3D clip space has 0 <= z <= w
+  XMMATRIX columns = XMMatrixTranspose(to_clip);
+  planes[0] = XMVectorAdd(columns.r[3], columns.r[0]);
+  planes[1] = XMVectorSubtract(columns.r[3], columns.r[0]);
+  planes[2] = XMVectorAdd(columns.r[3], columns.r[1]);
+  planes[3] = XMVectorSubtract(columns.r[3], columns.r[1]);
+  planes[4] = columns.r[2];
+  planes[5] = XMVectorSubtract(columns.r[3], columns.r[2]);
+
+  for (int p = 0; p < 6; ++p) {
+    planes[p] = XMPlaneNormalize(planes[p]);
+  }
+}
+
+bool SphereInFrustum(const XMMATRIX &to_clip, const XMFLOAT3 &centre,
+  float radius) {
+  XMVECTOR planes[6];
+  ExtractFrustumPlanes(to_clip, planes);
+
+  XMVECTOR c = XMVectorSetW(XMLoadFloat3(&centre), 1.f);
+  for (int p = 0; p < 6; ++p) {
+    if (XMVectorGetX(XMVector4Dot(planes[p], c)) < -radius) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool FrustumInFrustum(const XMMATRIX &to_clip,
+  const XMMATRIX &volume_to_clip) {
+  XMVECTOR planes[6];
+  ExtractFrustumPlanes(to_clip, planes);
+
+  // Corners of the volume, from the corners of its clip space
+  XMMATRIX from_clip = XMMatrixInverse(nullptr, volume_to_clip);
+  XMVECTOR corners[8];
+  for (int i = 0; i < 8; ++i) {
+    corners[i] = XMVector3TransformCoord(XMVectorSet(
+      (i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : 0.f, 1.f),
+      from_clip);
+    corners[i] = XMVectorSetW(corners[i], 1.f);
+  }
+
+  for (int p = 0; p < 6; ++p) {
+    int behind = 0;
+    for (int i = 0; i < 8; ++i) {
+      if (XMVectorGetX(XMVector4Dot(planes[p], corners[i])) < 0.f) {
+        ++behind;
+      }
+    }
+    if (behind == 8) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool BoxInFrustum(const XMMATRIX &to_clip, const XMFLOAT3 &centre,
+  const XMFLOAT3 &extents) {
+  XMVECTOR planes[6];
+  ExtractFrustumPlanes(to_clip, planes);
+
+  XMVECTOR c = XMVectorSetW(XMLoadFloat3(&centre), 1.f);
+  XMVECTOR e = XMLoadFloat3(&extents);
+  for (int p = 0; p < 6; ++p) {
+    // Distance of the centre against how far the box reaches along the
+    // normal
+    XMVECTOR n = XMVectorSetW(XMVectorAbs(planes[p]), 0.f);
+    if (XMVectorGetX(XMVector4Dot(planes[p], c)) <
+      -XMVectorGetX(XMVector4Dot(n, e))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+MeshBounds::MeshBounds() :
+    centre_x_(),
+    centre_y_(),
+    centre_z_(),
+    extent_x_(),
+    extent_y_(),
+    extent_z_(),
+    radius_(),
+    count_(0) {
+}
+
+UInt32 MeshBounds::Add(const XMFLOAT3 &centre, const XMFLOAT3 &extents) {
+  if ((count_ & 3) == 0) {
+    size_t padded = count_ + 4;
+    centre_x_.resize(padded, 0.f);
+    centre_y_.resize(padded, 0.f);
+    centre_z_.resize(padded, 0.f);
+    extent_x_.resize(padded, 0.f);
+    extent_y_.resize(padded, 0.f);
+    extent_z_.resize(padded, 0.f);
+    radius_.resize(padded, 0.f);
+  }
+
+  UInt32 index = count_++;
+  Set(index, centre, extents);
+
+  return index;
+}
+
+void MeshBounds::Set(UInt32 index, const XMFLOAT3 &centre,
+  const XMFLOAT3 &extents) {
+  centre_x_[index] = centre.x;
+  centre_y_[index] = centre.y;
+  centre_z_[index] = centre.z;
+  extent_x_[index] = extents.x;
+  extent_y_[index] = extents.y;
+  extent_z_[index] = extents.z;
+  radius_[index] = sqrtf(extents.x * extents.x + extents.y * extents.y +
+    extents.z * extents.z);
+}
+
+void MeshBounds::Get(UInt32 index, XMFLOAT3 &centre,
+  XMFLOAT3 &extents) const {
+  centre = XMFLOAT3(centre_x_[index], centre_y_[index], centre_z_[index]);
+  extents = XMFLOAT3(extent_x_[index], extent_y_[index], extent_z_[index]);
+}
+
+void MeshBounds::Clear() {
+  centre_x_.clear();
+  centre_y_.clear();
+  centre_z_.clear();
+  extent_x_.clear();
+  extent_y_.clear();
+  extent_z_.clear();
+  radius_.clear();
+  count_ = 0;
+}
+
+UInt32 MeshBounds::Cull(const XMMATRIX &to_clip, UInt32 begin, UInt32 end,
+  UInt8 *visible) const {
+  if (end > count_) {
+    end = count_;
+  }
+  if (begin >= end) {
+    return 0;
+  }
+
+  // Normalised, so that the distances can be compared with the radii
+  XMVECTOR planes[6];
+  ExtractFrustumPlanes(to_clip, planes);
+
+  // Each plane splatted, and the absolute values of its normal
+  __m128 nx[6], ny[6], nz[6], d[6], ax[6], ay[6], az[6];
+  for (int p = 0; p < 6; ++p) {
+    XMFLOAT4A plane;
+    XMStoreFloat4A(&plane, planes[p]);
+    nx[p] = _mm_set1_ps(plane.x);
+    ny[p] = _mm_set1_ps(plane.y);
+    nz[p] = _mm_set1_ps(plane.z);
+    d[p] = _mm_set1_ps(plane.w);
+    ax[p] = _mm_set1_ps(fabsf(plane.x));
+    ay[p] = _mm_set1_ps(fabsf(plane.y));
+    az[p] = _mm_set1_ps(fabsf(plane.z));
+  }
+
+  UInt32 visible_count = 0;
+  for (UInt32 group = begin & ~3u; group < end; group += 4) {
+    __m128 cx = _mm_loadu_ps(&centre_x_[group]);
+    __m128 cy = _mm_loadu_ps(&centre_y_[group]);
+    __m128 cz = _mm_loadu_ps(&centre_z_[group]);
+
+    // Distances of the centres to the planes
+    __m128 dist[6];
+    for (int p = 0; p < 6; ++p) {
+      dist[p] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx),
+        _mm_mul_ps(ny[p], cy)), _mm_add_ps(_mm_mul_ps(nz[p], cz), d[p]));
+    }
+
+    // Spheres wholly behind a plane
+    __m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(),
+      _mm_loadu_ps(&radius_[group]));
+    __m128 outside = _mm_setzero_ps();
+    for (int p = 0; p < 6; ++p) {
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(dist[p], neg_radius));
+    }
+
+    int outside_mask = _mm_movemask_ps(outside);
+    if (outside_mask != 0xF) {
+      // Boxes wholly behind a plane: their radius along the normal is the
+      // sum of the extents along each axis
+      __m128 ex = _mm_loadu_ps(&extent_x_[group]);
+      __m128 ey = _mm_loadu_ps(&extent_y_[group]);
+      __m128 ez = _mm_loadu_ps(&extent_z_[group]);
+      for (int p = 0; p < 6; ++p) {
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex),
+          _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+        outside = _mm_or_ps(outside,
+          _mm_cmplt_ps(_mm_add_ps(dist[p], r), _mm_setzero_ps()));
+      }
+      outside_mask = _mm_movemask_ps(outside);
+    }
+
+    for (UInt32 k = 0; k < 4; ++k) {
+      UInt32 i = group + k;
+      if (i < begin || i >= end) {
+        continue;
+      }
+      UInt8 in = static_cast<UInt8>(((outside_mask >> k) & 1) ^ 1);
+      visible[i] = in;
+      visible_count += in;
+    }
+  }
+
+  return visible_count;
+}
+
+} // namespace sz
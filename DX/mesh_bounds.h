@@ -0,0 +1,90 @@
+//  Bounding volumes of meshes, for culling
+//  * Boxes (centre and half extents) and the spheres around them are kept
+//    as structure of arrays, so that four of them are tested against a
+//    frustum at once with SSE
+//  * Spheres reject groups of four which are wholly outside first; the
+//    boxes decide for the others, as they are tighter
+//  * Bounds are in whichever space the meshes are drawn from; the matrix
+//    given to Cull takes them to clip space, so that the planes are moved
+//    rather than the boxes
+
+#ifndef _MESH_BOUNDS_H
+#define _MESH_BOUNDS_H
+
+#include <vector>
+#include <directxmath.h>
+#include "abertay_framework.h"
+
+namespace sz {
+
+using namespace DirectX;
+
+// Mark of meshes which have no bounds, and are never culled
+const UInt32 kNoMeshBounds = 0xFFFFFFFF;
+
+// Bounds of a box after a transform, given by centre and half extents
+void TransformBox(const XMFLOAT3 &centre, const XMFLOAT3 &extents,
+  const XMMATRIX &transform, XMFLOAT3 &out_centre, XMFLOAT3 &out_extents);
+
+// Planes of the frustum of a matrix which takes points to clip space: left,
+// right, bottom, top, near and far, facing inwards and normalised
+void ExtractFrustumPlanes(const XMMATRIX &to_clip, XMVECTOR planes[6]);
+
+// Whether a sphere may be inside the frustum of to_clip
+bool SphereInFrustum(const XMMATRIX &to_clip, const XMFLOAT3 &centre,
+  float radius);
+
+// Whether the frustum of volume_to_clip may overlap the frustum of to_clip;
+// false only if all its corners are behind one of the planes
+bool FrustumInFrustum(const XMMATRIX &to_clip,
+  const XMMATRIX &volume_to_clip);
+
+// Whether a box, given by centre and half extents, may be inside the
+// frustum of to_clip
+bool BoxInFrustum(const XMMATRIX &to_clip, const XMFLOAT3 &centre,
+  const XMFLOAT3 &extents);
+
+class MeshBounds {
+public:
+  // Ctor
+  MeshBounds();
+
+  // Add a box, returning its index
+  UInt32 Add(const XMFLOAT3 &centre, const XMFLOAT3 &extents);
+
+  // Replace a box, e.g. after the mesh moved
+  void Set(UInt32 index, const XMFLOAT3 &centre, const XMFLOAT3 &extents);
+
+  // Read a box back
+  void Get(UInt32 index, XMFLOAT3 &centre, XMFLOAT3 &extents) const;
+
+  void Clear();
+
+  inline UInt32 size() const {
+    return count_;
+  }
+
+  // Test the boxes in [begin, end) against the frustum of a matrix which
+  // takes them to clip space. visible[i] is set to 1 for the boxes which
+  // may be seen and to 0 for the others; the number of visible ones is
+  // returned.
+  UInt32 Cull(const XMMATRIX &to_clip, UInt32 begin, UInt32 end,
+    UInt8 *visible) const;
+
+private:
+  // Padded with empty boxes to a multiple of 4, so that groups can always
+  // be loaded whole
+  std::vector<float> centre_x_;
+  std::vector<float> centre_y_;
+  std::vector<float> centre_z_;
+  std::vector<float> extent_x_;
+  std::vector<float> extent_y_;
+  std::vector<float> extent_z_;
+  std::vector<float> radius_;
+  UInt32 count_;
+
+}; // class MeshBounds
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,62 @@
+#include "name_interner.h"
+
+namespace sz {
+
+NameInterner *NameInterner::single_instance_ = nullptr;
+
+NameInterner::NameInterner() :
+    ids_(),
+    names_() {
+}
+
+NameInterner *NameInterner::Inst() {
+  // If instance doen't exist
+  if (single_instance_ == nullptr) {
+    // Create it
+    single_instance_ = new NameInterner();
+  }
+
+  return single_instance_;
+}
+
+void NameInterner::ResetInst() {
+  if (single_instance_ != nullptr) {
+    delete single_instance_;
+    single_instance_ = nullptr;
+  }
+}
+
+NameId NameInterner::Intern(const std::string &name) {
+  // Look up the map to check if the name has already been interned
+  std::unordered_map<std::string, NameId>::const_iterator it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  // Assign the next ID
+  NameId id = static_cast<NameId>(names_.size());
+  names_.push_back(name);
+  ids_[name] = id;
+
+  return id;
+}
+
+NameId NameInterner::Find(const std::string &name) const {
+  std::unordered_map<std::string, NameId>::const_iterator it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+
+  return kInvalidNameId;
+}
+
+const std::string &NameInterner::GetName(NameId id) const {
+  static const std::string empty_name;
+  if (id >= names_.size()) {
+    return empty_name;
+  }
+
+  return names_[id];
+}
+
+} // namespace sz
@@ -0,0 +1,60 @@
+//  A name interner which maps resource names to small, stable integer IDs
+//  * Names are interned once, when resources are created or loaded
+//  * Managers index their resources by ID in plain arrays
+//  * Per-frame code only deals with IDs, never with strings
+
+#ifndef _NAME_INTERNER_H
+#define _NAME_INTERNER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "abertay_framework.h"
+
+namespace sz {
+
+// ID of an interned name; IDs are dense and start from 0
+typedef UInt32 NameId;
+const NameId kInvalidNameId = 0xFFFFFFFF;
+
+class NameInterner {
+public:
+  // Retrieve instance of singleton
+  static NameInterner *Inst();
+
+  // Resets singleton to not having an instance
+  static void ResetInst();
+
+  // Return the ID of a name, assigning the next free one if the name has
+  // not been seen before
+  NameId Intern(const std::string &name);
+
+  // Return the ID of a name, or kInvalidNameId if it was never interned
+  NameId Find(const std::string &name) const;
+
+  // Retrieve the name an ID was assigned to
+  const std::string &GetName(NameId id) const;
+
+  // Number of names interned so far
+  inline size_t size() const {
+    return names_.size();
+  }
+
+  // Disable ctors
+  NameInterner(const NameInterner &) = delete;
+  NameInterner &operator=(const NameInterner &) = delete;
+
+private:
+  NameInterner();
+
+  std::unordered_map<std::string, NameId> ids_;
+  std::vector<std::string> names_;
+
+  // Ptr to single global instance
+  static NameInterner *single_instance_;
+
+}; // class NameInterner
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,340 @@
+#include "occlusion_culler.h"
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <xmmintrin.h>
+#include "worker_pool.h"
+
+namespace sz {
+
+// Rows of the depth buffer rasterised by one task
+const UInt32 kOcclusionBandHeight = 16;
+// Vertices taken to the screen by one task
+const UInt32 kOcclusionVertexBatch = 4096;
+// How much farther than the occluders a box has to be, relative to their
+// distance, not to be hidden by rounding, e.g. behind its own mesh
+const float kOcclusionDepthBias = 1e-3f;
+
+OcclusionCuller::OcclusionCuller(UInt32 width, UInt32 height) :
+    positions_(),
+    indices_(),
+    screen_x_(),
+    screen_y_(),
+    inv_w_(),
+    levels_(),
+    band_count_(0),
+    band_height_(kOcclusionBandHeight) {
+  Level level;
+  level.width = (width + 3) & ~3u;
+  level.height = height > 0 ? height : 1;
+  for (;;) {
+    level.depth = static_cast<float *>(
+      _mm_malloc(level.width * level.height * sizeof(float), 16));
+    memset(level.depth, 0, level.width * level.height * sizeof(float));
+    levels_.push_back(level);
+
+    if (level.width == 1 && level.height == 1) {
+      break;
+    }
+    level.width = (level.width + 1) / 2;
+    level.height = (level.height + 1) / 2;
+  }
+
+  band_count_ = (levels_[0].height + band_height_ - 1) / band_height_;
+}
+
+OcclusionCuller::~OcclusionCuller() {
+  for (Level &level : levels_) {
+    _mm_free(level.depth);
+  }
+  levels_.clear();
+}
+
+void OcclusionCuller::AddOccluder(const XMFLOAT3 *positions,
+  UInt32 vertex_count, const UInt32 *indices, UInt32 index_count) {
+  UInt32 base = static_cast<UInt32>(positions_.size());
+  positions_.insert(positions_.end(), positions, positions + vertex_count);
+
+  for (UInt32 i = 0; i + 2 < index_count; i += 3) {
+    // Triangles with indices out of the occluder are left out
+    if (indices[i] >= vertex_count || indices[i + 1] >= vertex_count ||
+      indices[i + 2] >= vertex_count) {
+      continue;
+    }
+    indices_.push_back(base + indices[i]);
+    indices_.push_back(base + indices[i + 1]);
+    indices_.push_back(base + indices[i + 2]);
+  }
+}
+
+void OcclusionCuller::ClearOccluders() {
+  positions_.clear();
+  indices_.clear();
+}
+
+void OcclusionCuller::Render(const XMMATRIX &to_clip, WorkerPool *workers) {
+  UInt32 vertex_count = static_cast<UInt32>(positions_.size());
+  screen_x_.resize(vertex_count);
+  screen_y_.resize(vertex_count);
+  inv_w_.resize(vertex_count);
+
+  if (workers != nullptr) {
+    // Vertices are shared by the bands, so they are all transformed first
+    std::vector<WorkerPool::Task> tasks;
+    for (UInt32 begin = 0; begin < vertex_count;
+      begin += kOcclusionVertexBatch) {
+      UInt32 end = begin + kOcclusionVertexBatch < vertex_count ?
+        begin + kOcclusionVertexBatch : vertex_count;
+      tasks.push_back([this, &to_clip, begin, end] {
+        TransformVertices(to_clip, begin, end);
+      });
+    }
+    workers->Run(tasks);
+
+    tasks.clear();
+    for (UInt32 band = 0; band < band_count_; ++band) {
+      tasks.push_back(std::bind(&OcclusionCuller::RasterizeBand, this, band));
+    }
+    workers->Run(tasks);
+  }
+  else {
+    TransformVertices(to_clip, 0, vertex_count);
+    for (UInt32 band = 0; band < band_count_; ++band) {
+      RasterizeBand(band);
+    }
+  }
+
+  BuildHierarchy();
+}
+
+void OcclusionCuller::TransformVertices(const XMMATRIX &to_clip,
+  UInt32 begin, UInt32 end) {
+  const float half_width = 0.5f * static_cast<float>(levels_[0].width);
+  const float half_height = 0.5f * static_cast<float>(levels_[0].height);
+
+  XMFLOAT4 clip;
+  for (UInt32 i = begin; i < end; ++i) {
+    XMStoreFloat4(&clip, XMVector4Transform(
+      XMVectorSetW(XMLoadFloat3(&positions_[i]), 1.f), to_clip));
+
+    // In front of the near plane
+    if (clip.z < 0.f) {
+      inv_w_[i] = -1.f;
+      continue;
+    }
+
+    float inv_w = 1.f / clip.w;
+    screen_x_[i] = (clip.x * inv_w + 1.f) * half_width;
+    screen_y_[i] = (1.f - clip.y * inv_w) * half_height;
+    inv_w_[i] = inv_w;
+  }
+}
+
+void OcclusionCuller::RasterizeBand(UInt32 band) {
+  const Level &buffer = levels_[0];
+  const int row_begin = static_cast<int>(band * band_height_);
+  const int row_end = static_cast<int>(
+    row_begin + band_height_ < buffer.height ?
+    row_begin + band_height_ : buffer.height);
+  const int last_column = static_cast<int>(buffer.width) - 1;
+
+  memset(buffer.depth + row_begin * buffer.width, 0,
+    (row_end - row_begin) * buffer.width * sizeof(float));
+
+  const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+
+  for (size_t t = 0; t < indices_.size(); t += 3) {
+    UInt32 i0 = indices_[t], i1 = indices_[t + 1], i2 = indices_[t + 2];
+    float z0 = inv_w_[i0], z1 = inv_w_[i1], z2 = inv_w_[i2];
+    if (z0 < 0.f || z1 < 0.f || z2 < 0.f) {
+      continue;
+    }
+
+    float x0 = screen_x_[i0], x1 = screen_x_[i1], x2 = screen_x_[i2];
+    float y0 = screen_y_[i0], y1 = screen_y_[i1], y2 = screen_y_[i2];
+
+    // Rows and columns whose pixel centres may be covered
+    float min_y = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+    float max_y = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+    float min_x = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+    float max_x = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+    if (max_y < row_begin || min_y > row_end ||
+      max_x < 0.f || min_x > buffer.width) {
+      continue;
+    }
+    int first_row = static_cast<int>(ceilf(min_y - 0.5f));
+    int last_row = static_cast<int>(floorf(max_y - 0.5f));
+    int first_column = static_cast<int>(ceilf(min_x - 0.5f));
+    int last_column_tri = static_cast<int>(floorf(max_x - 0.5f));
+    first_row = first_row > row_begin ? first_row : row_begin;
+    last_row = last_row < row_end - 1 ? last_row : row_end - 1;
+    first_column = first_column > 0 ? first_column : 0;
+    last_column_tri = last_column_tri < last_column ?
+      last_column_tri : last_column;
+    if (first_row > last_row || first_column > last_column_tri) {
+      continue;
+    }
+
+    // Either winding is drawn, as occluders need not be closed
+    float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+    if (area == 0.f) {
+      continue;
+    }
+    if (area < 0.f) {
+      float swap = x1; x1 = x2; x2 = swap;
+      swap = y1; y1 = y2; y2 = swap;
+      swap = z1; z1 = z2; z2 = swap;
+      area = -area;
+    }
+
+    // Edge functions a * x + b * y + c, positive inside; each one is the
+    // weight of the opposite vertex, times the area
+    float a12 = y1 - y2, b12 = x2 - x1, c12 = -(a12 * x1 + b12 * y1);
+    float a20 = y2 - y0, b20 = x0 - x2, c20 = -(a20 * x2 + b20 * y2);
+    float a01 = y0 - y1, b01 = x1 - x0, c01 = -(a01 * x0 + b01 * y0);
+
+    // Plane of 1/w over the screen
+    float inv_area = 1.f / area;
+    float za = (a12 * z0 + a20 * z1 + a01 * z2) * inv_area;
+    float zb = (b12 * z0 + b20 * z1 + b01 * z2) * inv_area;
+    float zc = (c12 * z0 + c20 * z1 + c01 * z2) * inv_area;
+
+    const __m128 step_e12 = _mm_set1_ps(4.f * a12);
+    const __m128 step_e20 = _mm_set1_ps(4.f * a20);
+    const __m128 step_e01 = _mm_set1_ps(4.f * a01);
+    const __m128 step_z = _mm_set1_ps(4.f * za);
+
+    // Groups of 4 start on aligned columns
+    int start_column = first_column & ~3;
+    __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(start_column)),
+      lane_offsets);
+
+    for (int y = first_row; y <= last_row; ++y) {
+      float py = static_cast<float>(y) + 0.5f;
+      __m128 e12 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a12), px),
+        _mm_set1_ps(b12 * py + c12));
+      __m128 e20 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a20), px),
+        _mm_set1_ps(b20 * py + c20));
+      __m128 e01 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a01), px),
+        _mm_set1_ps(b01 * py + c01));
+      __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px),
+        _mm_set1_ps(zb * py + zc));
+
+      float *row = buffer.depth + y * buffer.width;
+      for (int x = start_column; x <= last_column_tri; x += 4) {
+        __m128 inside = _mm_and_ps(_mm_and_ps(
+          _mm_cmpge_ps(e12, zero), _mm_cmpge_ps(e20, zero)),
+          _mm_cmpge_ps(e01, zero));
+
+        if (_mm_movemask_ps(inside) != 0) {
+          // Keep the nearest, i.e. the largest 1/w
+          __m128 old_z = _mm_load_ps(row + x);
+          __m128 new_z = _mm_max_ps(old_z, z);
+          _mm_store_ps(row + x, _mm_or_ps(_mm_and_ps(inside, new_z),
+            _mm_andnot_ps(inside, old_z)));
+        }
+
+        e12 = _mm_add_ps(e12, step_e12);
+        e20 = _mm_add_ps(e20, step_e20);
+        e01 = _mm_add_ps(e01, step_e01);
+        z = _mm_add_ps(z, step_z);
+      }
+    }
+  }
+}
+
+void OcclusionCuller::BuildHierarchy() {
+  for (size_t l = 1; l < levels_.size(); ++l) {
+    const Level &below = levels_[l - 1];
+    const Level &level = levels_[l];
+
+    for (UInt32 y = 0; y < level.height; ++y) {
+      UInt32 y0 = y * 2;
+      UInt32 y1 = y0 + 1 < below.height ? y0 + 1 : y0;
+      for (UInt32 x = 0; x < level.width; ++x) {
+        UInt32 x0 = x * 2;
+        UInt32 x1 = x0 + 1 < below.width ? x0 + 1 : x0;
+
+        // Farthest, i.e. smallest 1/w
+        float d = below.depth[y0 * below.width + x0];
+        float d1 = below.depth[y0 * below.width + x1];
+        float d2 = below.depth[y1 * below.width + x0];
+        float d3 = below.depth[y1 * below.width + x1];
+        d = d < d1 ? d : d1;
+        d = d < d2 ? d : d2;
+        d = d < d3 ? d : d3;
+        level.depth[y * level.width + x] = d;
+      }
+    }
+  }
+}
+
+bool OcclusionCuller::IsOccluded(const XMMATRIX &to_clip,
+  const XMFLOAT3 &centre, const XMFLOAT3 &extents) const {
+  const Level &buffer = levels_[0];
+  const float half_width = 0.5f * static_cast<float>(buffer.width);
+  const float half_height = 0.5f * static_cast<float>(buffer.height);
+
+  // Rectangle of the box on the screen, and its nearest 1/w, which is at
+  // one of the corners
+  float min_x = 1e30f, max_x = -1e30f, min_y = 1e30f, max_y = -1e30f;
+  float nearest = 0.f;
+  XMFLOAT4 clip;
+  for (int i = 0; i < 8; ++i) {
+    XMVECTOR corner = XMVectorSet(
+      centre.x + ((i & 1) ? extents.x : -extents.x),
+      centre.y + ((i & 2) ? extents.y : -extents.y),
+      centre.z + ((i & 4) ? extents.z : -extents.z), 1.f);
+    XMStoreFloat4(&clip, XMVector4Transform(corner, to_clip));
+    if (clip.z < 0.f) {
+      return false;
+    }
+
+    float inv_w = 1.f / clip.w;
+    float x = (clip.x * inv_w + 1.f) * half_width;
+    float y = (1.f - clip.y * inv_w) * half_height;
+    min_x = x < min_x ? x : min_x;
+    max_x = x > max_x ? x : max_x;
+    min_y = y < min_y ? y : min_y;
+    max_y = y > max_y ? y : max_y;
+    nearest = inv_w > nearest ? inv_w : nearest;
+  }
+
+  if (max_x < 0.f || min_x >= buffer.width ||
+    max_y < 0.f || min_y >= buffer.height) {
+    return false;
+  }
+
+  // One texel more on each side, as occluders only cover the texels whose
+  // centres they cover
+  int x0 = static_cast<int>(floorf(min_x)) - 1;
+  int x1 = static_cast<int>(floorf(max_x)) + 1;
+  int y0 = static_cast<int>(floorf(min_y)) - 1;
+  int y1 = static_cast<int>(floorf(max_y)) + 1;
+  x0 = x0 > 0 ? x0 : 0;
+  y0 = y0 > 0 ? y0 : 0;
+  x1 = x1 < static_cast<int>(buffer.width) - 1 ? x1 : buffer.width - 1;
+  y1 = y1 < static_cast<int>(buffer.height) - 1 ? y1 : buffer.height - 1;
+
+  // Coarsest level at which the rectangle spans at most 4x4 texels
+  UInt32 l = 0;
+  while (l + 1 < levels_.size() &&
+    ((x1 >> l) - (x0 >> l) >= 4 || (y1 >> l) - (y0 >> l) >= 4)) {
+    ++l;
+  }
+
+  const float threshold = nearest * (1.f + kOcclusionDepthBias);
+  const Level &level = levels_[l];
+  for (int y = y0 >> l; y <= (y1 >> l); ++y) {
+    for (int x = x0 >> l; x <= (x1 >> l); ++x) {
+      if (level.depth[y * level.width + x] <= threshold) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+} // namespace sz
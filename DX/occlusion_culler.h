@@ -0,0 +1,113 @@
+//  Software occlusion culling
+//  * A few large, opaque meshes are picked as occluders, and their
+//    triangles are rasterised on the CPU into a small depth buffer
+//  * The buffer is split in bands of rows which are rasterised at the same
+//    time on the worker threads, four pixels at a time with SSE
+//  * Depths are kept as 1/w, which is linear in screen space and as precise
+//    far away as it is near; larger is nearer, and 0 is empty
+//  * A hierarchy keeps the farthest depth of each 2x2 block of the level
+//    below, so that a box is tested against a handful of texels whatever
+//    its size on screen
+//  * Triangles which cross the near plane are left out, and boxes which do
+//    are never occluded, so that they cannot hide anything wrongly
+//  * Occluders cover the pixels whose centres they cover, so a box seen
+//    only through a gap between occluders narrower than a pixel may be
+//    culled
+
+#ifndef _OCCLUSION_CULLER_H
+#define _OCCLUSION_CULLER_H
+
+#include <vector>
+#include <directxmath.h>
+#include "abertay_framework.h"
+
+namespace sz {
+  class WorkerPool;
+}
+
+namespace sz {
+
+using namespace DirectX;
+
+class OcclusionCuller {
+public:
+  // Ctor; the width is rounded up to a multiple of 4
+  OcclusionCuller(UInt32 width, UInt32 height);
+
+  // Dtor
+  ~OcclusionCuller();
+
+  // Add the triangles of an occluder. Positions are in the space which the
+  // matrix given to Render takes to clip space.
+  void AddOccluder(const XMFLOAT3 *positions, UInt32 vertex_count,
+    const UInt32 *indices, UInt32 index_count);
+
+  void ClearOccluders();
+
+  // Rasterise the occluders seen through to_clip and build the hierarchy;
+  // the work is shared with the workers, if given
+  void Render(const XMMATRIX &to_clip, WorkerPool *workers);
+
+  // Whether a box, given by centre and half extents and taken to clip space
+  // by to_clip, is hidden behind the occluders of the last Render. Boxes
+  // off the screen are not, as that is for frustum culling to decide.
+  bool IsOccluded(const XMMATRIX &to_clip, const XMFLOAT3 &centre,
+    const XMFLOAT3 &extents) const;
+
+  inline UInt32 width() const {
+    return levels_[0].width;
+  }
+  inline UInt32 height() const {
+    return levels_[0].height;
+  }
+  inline UInt32 level_count() const {
+    return static_cast<UInt32>(levels_.size());
+  }
+  inline UInt32 triangle_count() const {
+    return static_cast<UInt32>(indices_.size() / 3);
+  }
+
+  // Depth of a texel of a level, as 1/w; the farthest of those it covers
+  inline float depth(UInt32 level, UInt32 x, UInt32 y) const {
+    return levels_[level].depth[y * levels_[level].width + x];
+  }
+
+  // Disable ctors
+  OcclusionCuller(const OcclusionCuller &) = delete;
+  OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+private:
+  // Take the vertices in [begin, end) to the screen
+  void TransformVertices(const XMMATRIX &to_clip, UInt32 begin, UInt32 end);
+
+  // Rasterise all the triangles, within the rows of a band
+  void RasterizeBand(UInt32 band);
+
+  // Fill the levels above the first
+  void BuildHierarchy();
+
+  // Occluders, as one indexed triangle list
+  std::vector<XMFLOAT3> positions_;
+  std::vector<UInt32> indices_;
+
+  // Vertices in pixels, and their 1/w; negative 1/w marks those in front
+  // of the near plane
+  std::vector<float> screen_x_;
+  std::vector<float> screen_y_;
+  std::vector<float> inv_w_;
+
+  // The first level is the depth buffer; 16 byte aligned
+  struct Level {
+    float *depth;
+    UInt32 width;
+    UInt32 height;
+  };
+  std::vector<Level> levels_;
+  UInt32 band_count_;
+  UInt32 band_height_;
+
+}; // class OcclusionCuller
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,62 @@
+#include "pipeline_stats.h"
+
+namespace sz {
+
+PipelineStats::PipelineStats(ID3D11Device *device) :
+    current_(0),
+    ps_invocations_(0),
+    primitives_(0) {
+  for (UInt32 i = 0; i < kPipelineStatsLatency; ++i) {
+    queries_[i] = nullptr;
+    issued_[i] = false;
+    if (device == nullptr) {
+      continue;
+    }
+
+    D3D11_QUERY_DESC desc;
+    desc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+    desc.MiscFlags = 0;
+    if (FAILED(device->CreateQuery(&desc, &queries_[i]))) {
+      queries_[i] = nullptr;
+    }
+  }
+}
+
+PipelineStats::~PipelineStats() {
+  for (UInt32 i = 0; i < kPipelineStatsLatency; ++i) {
+    ReleaseNull(queries_[i]);
+  }
+}
+
+void PipelineStats::Begin(ID3D11DeviceContext *context) {
+  ID3D11Query *query = queries_[current_];
+  if (query == nullptr) {
+    return;
+  }
+
+  // The query is reused once its results were read, or given up on if the
+  // GPU is still that far behind
+  if (issued_[current_]) {
+    D3D11_QUERY_DATA_PIPELINE_STATISTICS stats;
+    if (context->GetData(query, &stats, sizeof(stats),
+      D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK) {
+      ps_invocations_ = stats.PSInvocations;
+      primitives_ = stats.CPrimitives;
+    }
+    issued_[current_] = false;
+  }
+  context->Begin(query);
+}
+
+void PipelineStats::End(ID3D11DeviceContext *context) {
+  ID3D11Query *query = queries_[current_];
+  if (query == nullptr) {
+    return;
+  }
+
+  context->End(query);
+  issued_[current_] = true;
+  current_ = (current_ + 1) % kPipelineStatsLatency;
+}
+
+} // namespace sz
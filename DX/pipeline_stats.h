@@ -0,0 +1,59 @@
+//  Pipeline statistics of a pass
+//  * The GPU counts what a pass cost it, e.g. how many pixels were shaded,
+//    between Begin and End on the immediate context
+//  * Results are read back a few frames late, from a ring of queries, so
+//    that the CPU never waits for the GPU; a query which is not done yet is
+//    skipped, and the last results are kept
+//  * Queries are not pipeline state, so they go to the context directly
+//    rather than through the state cache
+
+#ifndef _PIPELINE_STATS_H
+#define _PIPELINE_STATS_H
+
+#include <d3d11.h>
+#include "abertay_framework.h"
+
+namespace sz {
+
+// Frames a query is given before its results are read
+const UInt32 kPipelineStatsLatency = 4;
+
+class PipelineStats {
+public:
+  // Ctor; without a device, or if queries cannot be made, nothing is
+  // counted and the results stay 0
+  PipelineStats(ID3D11Device *device);
+
+  // Dtor
+  ~PipelineStats();
+
+  // Count what is executed on the immediate context between the two
+  void Begin(ID3D11DeviceContext *context);
+  void End(ID3D11DeviceContext *context);
+
+  // Of the last pass whose results arrived
+  inline UInt64 ps_invocations() const {
+    return ps_invocations_;
+  }
+  inline UInt64 primitives() const {
+    return primitives_;
+  }
+
+  // Disable ctors
+  PipelineStats(const PipelineStats &) = delete;
+  PipelineStats &operator=(const PipelineStats &) = delete;
+
+private:
+  ID3D11Query *queries_[kPipelineStatsLatency];
+  // Query of the current pass, and whether each holds results to read
+  UInt32 current_;
+  bool issued_[kPipelineStatsLatency];
+
+  UInt64 ps_invocations_;
+  UInt64 primitives_;
+
+}; // class PipelineStats
+
+} // namespace sz
+
+#endif
@@ -2,8 +2,9 @@
 // effects.
 // Inherit from it to create a new post process effect.
 //
-// Its main function accepts a render target by reference,
-// and returns it after applying the post processing.
+// Its main function adds the passes of the effect to the frame
+// graph, reading a target, and returns the target which holds
+// the result.
 
 #ifndef _POST_PROCESS_H
 #define _POST_PROCESS_H
@@ -11,6 +12,7 @@
 #include <d3d11.h>
 #include <directxmath.h>
 #include <string>
+#include "frame_graph.h"
 
 // Forward declarations
 class RenderTexture;
@@ -41,8 +43,8 @@ public:
   virtual ~PostProcess() {};
 
   // Post process function. Functionality explained in header
-  virtual void ApplyPostProcess(RenderTexture &target, D3D *direct3D,
-    const DirectX::XMMATRIX &base_view_matrix,
+  virtual FrameResource AddPasses(FrameGraph &graph, FrameResource source,
+    D3D *direct3D, const DirectX::XMMATRIX &base_view_matrix,
     const DirectX::XMMATRIX &world_matrix) = 0;
 
 protected:
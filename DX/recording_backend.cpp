@@ -0,0 +1,652 @@
+#include "recording_backend.h"
+#include <cstring>
+#include <xmmintrin.h>
+
+namespace sz {
+
+// Largest constant buffer, in bytes
+const size_t kScratchSize = D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT * 16;
+// Size of the payload blocks, in bytes; larger payloads get their own
+const size_t kPayloadBlockSize = 64 * 1024;
+
+const char *GfxCommandName(GfxCommandType type) {
+  static const char *const names[kGfxCommandTypeCount] = {
+    "SetInputLayout",
+    "SetPrimitiveTopology",
+    "SetVertexBuffers",
+    "SetIndexBuffer",
+    "SetShader",
+    "SetConstantBuffers",
+    "SetShaderResources",
+    "SetSamplers",
+    "SetBlendState",
+    "SetDepthStencilState",
+    "SetRenderTargets",
+    "SetRasterizerState",
+    "SetViewports",
+    "Map",
+    "Unmap",
+    "UpdateSubresource",
+    "CopyResource",
+    "GenerateMips",
+    "ClearRenderTarget",
+    "ClearDepthStencil",
+    "Draw",
+    "DrawIndexed",
+    "DrawIndexedInstanced"
+  };
+
+  return type < kGfxCommandTypeCount ? names[type] : "Unknown";
+}
+
+RecordingBackend::RecordingBackend() :
+    commands_(),
+    vertex_count_(0),
+    keep_commands_(true),
+    deferred_(false),
+    blocks_(),
+    block_(0),
+    block_used_(0),
+    scratch_(nullptr) {
+  scratch_ = static_cast<UInt8 *>(_mm_malloc(kScratchSize, 16));
+  memset(scratch_, 0, kScratchSize);
+  Reset();
+}
+
+RecordingBackend::~RecordingBackend() {
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    _mm_free(blocks_[i].data);
+  }
+  _mm_free(scratch_);
+}
+
+void RecordingBackend::Reset() {
+  commands_.clear();
+  memset(counts_, 0, sizeof(counts_));
+  vertex_count_ = 0;
+  // The blocks are kept for the next recording
+  block_ = 0;
+  block_used_ = 0;
+}
+
+GfxBackend *RecordingBackend::CreateDeferred() {
+  RecordingBackend *deferred = new RecordingBackend();
+  deferred->deferred_ = true;
+  deferred->keep_commands_ = true;
+
+  return deferred;
+}
+
+void RecordingBackend::ExecuteDeferred(GfxBackend *deferred) {
+  RecordingBackend *recording = static_cast<RecordingBackend *>(deferred);
+  recording->Replay(*this);
+  recording->Reset();
+}
+
+bool RecordingBackend::SupportsConstantBufferOffsets() const {
+  return true;
+}
+
+GfxCommand *RecordingBackend::Record(GfxCommandType type, UInt32 stage,
+  void *object, UInt32 a, UInt32 b) {
+  ++counts_[type];
+
+  if (!keep_commands_) {
+    return nullptr;
+  }
+
+  GfxCommand command = { type, stage, object, nullptr, a, b, 0, nullptr, 0 };
+  commands_.push_back(command);
+
+  return &commands_.back();
+}
+
+UInt8 *RecordingBackend::Allocate(size_t size) {
+  size = (size + 15) & ~static_cast<size_t>(15);
+
+  // Move on to the first block with enough room left
+  while (block_ < blocks_.size() &&
+    block_used_ + size > blocks_[block_].size) {
+    ++block_;
+    block_used_ = 0;
+  }
+
+  if (block_ == blocks_.size()) {
+    PayloadBlock block;
+    block.size = size > kPayloadBlockSize ? size : kPayloadBlockSize;
+    block.data = static_cast<UInt8 *>(_mm_malloc(block.size, 16));
+    blocks_.push_back(block);
+  }
+
+  UInt8 *data = blocks_[block_].data + block_used_;
+  block_used_ += size;
+
+  return data;
+}
+
+void RecordingBackend::Store(GfxCommand *command, const void *data,
+  size_t size) {
+  if (command == nullptr || data == nullptr || size == 0) {
+    return;
+  }
+
+  // Arrays of a command are stored back to back
+  UInt8 *stored = Allocate(command->payload_size + size);
+  if (command->payload_size > 0) {
+    memcpy(stored, command->payload, command->payload_size);
+  }
+  memcpy(stored + command->payload_size, data, size);
+  command->payload = stored;
+  command->payload_size += static_cast<UInt32>(size);
+}
+
+void RecordingBackend::RecordConstantBuffers1(UInt32 stage, UINT start,
+  UINT count, ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  GfxCommand *command = Record(kGfxSetConstantBuffers, stage,
+    count > 0 ? buffers[0] : nullptr, start, count);
+  if (command == nullptr) {
+    return;
+  }
+  command->c = 1;
+  Store(command, buffers, count * sizeof(ID3D11Buffer *));
+  Store(command, first_constants, count * sizeof(UINT));
+  Store(command, constant_counts, count * sizeof(UINT));
+}
+
+void RecordingBackend::Replay(GfxBackend &target) const {
+  for (size_t i = 0; i < commands_.size(); ++i) {
+    const GfxCommand &command = commands_[i];
+    const UInt8 *payload = command.payload;
+
+    switch (command.type) {
+    case kGfxSetInputLayout:
+      target.IASetInputLayout(
+        static_cast<ID3D11InputLayout *>(command.object));
+      break;
+    case kGfxSetPrimitiveTopology:
+      target.IASetPrimitiveTopology(
+        static_cast<D3D11_PRIMITIVE_TOPOLOGY>(command.a));
+      break;
+    case kGfxSetVertexBuffers: {
+      // Buffers, strides and offsets
+      const UInt32 count = command.b;
+      const UInt8 *strides = payload + count * sizeof(ID3D11Buffer *);
+      target.IASetVertexBuffers(command.a, count,
+        reinterpret_cast<ID3D11Buffer *const *>(payload),
+        reinterpret_cast<const UINT *>(strides),
+        reinterpret_cast<const UINT *>(strides + count * sizeof(UINT)));
+      break;
+    }
+    case kGfxSetIndexBuffer:
+      target.IASetIndexBuffer(static_cast<ID3D11Buffer *>(command.object),
+        static_cast<DXGI_FORMAT>(command.a), command.b);
+      break;
+    case kGfxSetShader:
+      switch (command.stage) {
+      case 0:
+        target.VSSetShader(static_cast<ID3D11VertexShader *>(command.object));
+        break;
+      case 1:
+        target.HSSetShader(static_cast<ID3D11HullShader *>(command.object));
+        break;
+      case 2:
+        target.DSSetShader(static_cast<ID3D11DomainShader *>(command.object));
+        break;
+      case 3:
+        target.GSSetShader(
+          static_cast<ID3D11GeometryShader *>(command.object));
+        break;
+      default:
+        target.PSSetShader(static_cast<ID3D11PixelShader *>(command.object));
+        break;
+      }
+      break;
+    case kGfxSetConstantBuffers: {
+      ID3D11Buffer *const *buffers =
+        reinterpret_cast<ID3D11Buffer *const *>(payload);
+      if (command.c == 1) {
+        const UINT *firsts = reinterpret_cast<const UINT *>(
+          payload + command.b * sizeof(ID3D11Buffer *));
+        const UINT *counts = firsts + command.b;
+        switch (command.stage) {
+        case 0:
+          target.VSSetConstantBuffers1(command.a, command.b, buffers, firsts,
+            counts);
+          break;
+        case 1:
+          target.HSSetConstantBuffers1(command.a, command.b, buffers, firsts,
+            counts);
+          break;
+        case 2:
+          target.DSSetConstantBuffers1(command.a, command.b, buffers, firsts,
+            counts);
+          break;
+        case 3:
+          target.GSSetConstantBuffers1(command.a, command.b, buffers, firsts,
+            counts);
+          break;
+        default:
+          target.PSSetConstantBuffers1(command.a, command.b, buffers, firsts,
+            counts);
+          break;
+        }
+        break;
+      }
+      switch (command.stage) {
+      case 0:
+        target.VSSetConstantBuffers(command.a, command.b, buffers);
+        break;
+      case 1:
+        target.HSSetConstantBuffers(command.a, command.b, buffers);
+        break;
+      case 2:
+        target.DSSetConstantBuffers(command.a, command.b, buffers);
+        break;
+      case 3:
+        target.GSSetConstantBuffers(command.a, command.b, buffers);
+        break;
+      default:
+        target.PSSetConstantBuffers(command.a, command.b, buffers);
+        break;
+      }
+      break;
+    }
+    case kGfxSetShaderResources: {
+      ID3D11ShaderResourceView *const *views =
+        reinterpret_cast<ID3D11ShaderResourceView *const *>(payload);
+      switch (command.stage) {
+      case 0:
+        target.VSSetShaderResources(command.a, command.b, views);
+        break;
+      case 2:
+        target.DSSetShaderResources(command.a, command.b, views);
+        break;
+      default:
+        target.PSSetShaderResources(command.a, command.b, views);
+        break;
+      }
+      break;
+    }
+    case kGfxSetSamplers: {
+      ID3D11SamplerState *const *samplers =
+        reinterpret_cast<ID3D11SamplerState *const *>(payload);
+      switch (command.stage) {
+      case 0:
+        target.VSSetSamplers(command.a, command.b, samplers);
+        break;
+      case 2:
+        target.DSSetSamplers(command.a, command.b, samplers);
+        break;
+      default:
+        target.PSSetSamplers(command.a, command.b, samplers);
+        break;
+      }
+      break;
+    }
+    case kGfxSetBlendState:
+      target.OMSetBlendState(static_cast<ID3D11BlendState *>(command.object),
+        reinterpret_cast<const FLOAT *>(payload), command.a);
+      break;
+    case kGfxSetDepthStencilState:
+      target.OMSetDepthStencilState(
+        static_cast<ID3D11DepthStencilState *>(command.object), command.a);
+      break;
+    case kGfxSetRenderTargets:
+      target.OMSetRenderTargets(command.b,
+        reinterpret_cast<ID3D11RenderTargetView *const *>(payload),
+        static_cast<ID3D11DepthStencilView *>(
+          const_cast<void *>(command.object2)));
+      break;
+    case kGfxSetRasterizerState:
+      target.RSSetState(static_cast<ID3D11RasterizerState *>(command.object));
+      break;
+    case kGfxSetViewports:
+      target.RSSetViewports(command.b,
+        reinterpret_cast<const D3D11_VIEWPORT *>(payload));
+      break;
+    case kGfxMap: {
+      // Only discarded buffers are kept, see Map
+      D3D11_MAPPED_SUBRESOURCE mapped;
+      if (SUCCEEDED(target.Map(static_cast<ID3D11Resource *>(command.object),
+        command.a, static_cast<D3D11_MAP>(command.b), command.c, &mapped)) &&
+        payload != nullptr) {
+        memcpy(mapped.pData, payload, command.payload_size);
+      }
+      break;
+    }
+    case kGfxUnmap:
+      target.Unmap(static_cast<ID3D11Resource *>(command.object), command.a);
+      break;
+    case kGfxUpdateSubresource:
+      target.UpdateSubresource(static_cast<ID3D11Resource *>(command.object),
+        command.a, reinterpret_cast<const D3D11_BOX *>(payload),
+        command.object2, command.b, command.c);
+      break;
+    case kGfxCopyResource:
+      target.CopyResource(static_cast<ID3D11Resource *>(command.object),
+        static_cast<ID3D11Resource *>(const_cast<void *>(command.object2)));
+      break;
+    case kGfxGenerateMips:
+      target.GenerateMips(
+        static_cast<ID3D11ShaderResourceView *>(command.object));
+      break;
+    case kGfxClearRenderTarget:
+      target.ClearRenderTargetView(
+        static_cast<ID3D11RenderTargetView *>(command.object),
+        reinterpret_cast<const FLOAT *>(payload));
+      break;
+    case kGfxClearDepthStencil: {
+      FLOAT depth;
+      memcpy(&depth, &command.c, sizeof(depth));
+      target.ClearDepthStencilView(
+        static_cast<ID3D11DepthStencilView *>(command.object), command.a,
+        depth, static_cast<UINT8>(command.b));
+      break;
+    }
+    case kGfxDraw:
+      target.Draw(command.a, command.b);
+      break;
+    case kGfxDrawIndexed:
+      target.DrawIndexed(command.a, command.b,
+        static_cast<INT>(command.c));
+      break;
+    case kGfxDrawIndexedInstanced: {
+      const UInt32 *starts = reinterpret_cast<const UInt32 *>(payload);
+      target.DrawIndexedInstanced(command.a, command.b, command.c,
+        static_cast<INT>(starts[0]), starts[1]);
+      break;
+    }
+    default:
+      break;
+    }
+  }
+}
+
+void RecordingBackend::IASetInputLayout(ID3D11InputLayout *layout) {
+  Record(kGfxSetInputLayout, 0, layout, 0, 0);
+}
+
+void RecordingBackend::IASetPrimitiveTopology(
+  D3D11_PRIMITIVE_TOPOLOGY topology) {
+  Record(kGfxSetPrimitiveTopology, 0, nullptr, topology, 0);
+}
+
+void RecordingBackend::IASetVertexBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *strides, const UINT *offsets) {
+  GfxCommand *command = Record(kGfxSetVertexBuffers, 0,
+    count > 0 ? buffers[0] : nullptr, start, count);
+  Store(command, buffers, count * sizeof(ID3D11Buffer *));
+  Store(command, strides, count * sizeof(UINT));
+  Store(command, offsets, count * sizeof(UINT));
+}
+
+void RecordingBackend::IASetIndexBuffer(ID3D11Buffer *buffer,
+  DXGI_FORMAT format, UINT offset) {
+  Record(kGfxSetIndexBuffer, 0, buffer, format, offset);
+}
+
+void RecordingBackend::VSSetShader(ID3D11VertexShader *shader) {
+  Record(kGfxSetShader, 0, shader, 0, 0);
+}
+
+void RecordingBackend::HSSetShader(ID3D11HullShader *shader) {
+  Record(kGfxSetShader, 1, shader, 0, 0);
+}
+
+void RecordingBackend::DSSetShader(ID3D11DomainShader *shader) {
+  Record(kGfxSetShader, 2, shader, 0, 0);
+}
+
+void RecordingBackend::GSSetShader(ID3D11GeometryShader *shader) {
+  Record(kGfxSetShader, 3, shader, 0, 0);
+}
+
+void RecordingBackend::PSSetShader(ID3D11PixelShader *shader) {
+  Record(kGfxSetShader, 4, shader, 0, 0);
+}
+
+void RecordingBackend::VSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  Store(Record(kGfxSetConstantBuffers, 0, count > 0 ? buffers[0] : nullptr,
+    start, count), buffers, count * sizeof(ID3D11Buffer *));
+}
+
+void RecordingBackend::HSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  Store(Record(kGfxSetConstantBuffers, 1, count > 0 ? buffers[0] : nullptr,
+    start, count), buffers, count * sizeof(ID3D11Buffer *));
+}
+
+void RecordingBackend::DSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  Store(Record(kGfxSetConstantBuffers, 2, count > 0 ? buffers[0] : nullptr,
+    start, count), buffers, count * sizeof(ID3D11Buffer *));
+}
+
+void RecordingBackend::GSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  Store(Record(kGfxSetConstantBuffers, 3, count > 0 ? buffers[0] : nullptr,
+    start, count), buffers, count * sizeof(ID3D11Buffer *));
+}
+
+void RecordingBackend::PSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  Store(Record(kGfxSetConstantBuffers, 4, count > 0 ? buffers[0] : nullptr,
+    start, count), buffers, count * sizeof(ID3D11Buffer *));
+}
+
+void RecordingBackend::VSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  RecordConstantBuffers1(0, start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void RecordingBackend::HSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  RecordConstantBuffers1(1, start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void RecordingBackend::DSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  RecordConstantBuffers1(2, start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void RecordingBackend::GSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  RecordConstantBuffers1(3, start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void RecordingBackend::PSSetConstantBuffers1(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *first_constants,
+  const UINT *constant_counts) {
+  RecordConstantBuffers1(4, start, count, buffers, first_constants,
+    constant_counts);
+}
+
+void RecordingBackend::VSSetShaderResources(UINT start, UINT count,
+  ID3D11ShaderResourceView *const *views) {
+  Store(Record(kGfxSetShaderResources, 0, count > 0 ? views[0] : nullptr,
+    start, count), views, count * sizeof(ID3D11ShaderResourceView *));
+}
+
+void RecordingBackend::DSSetShaderResources(UINT start, UINT count,
+  ID3D11ShaderResourceView *const *views) {
+  Store(Record(kGfxSetShaderResources, 2, count > 0 ? views[0] : nullptr,
+    start, count), views, count * sizeof(ID3D11ShaderResourceView *));
+}
+
+void RecordingBackend::PSSetShaderResources(UINT start, UINT count,
+  ID3D11ShaderResourceView *const *views) {
+  Store(Record(kGfxSetShaderResources, 4, count > 0 ? views[0] : nullptr,
+    start, count), views, count * sizeof(ID3D11ShaderResourceView *));
+}
+
+void RecordingBackend::VSSetSamplers(UINT start, UINT count,
+  ID3D11SamplerState *const *samplers) {
+  Store(Record(kGfxSetSamplers, 0, count > 0 ? samplers[0] : nullptr, start,
+    count), samplers, count * sizeof(ID3D11SamplerState *));
+}
+
+void RecordingBackend::DSSetSamplers(UINT start, UINT count,
+  ID3D11SamplerState *const *samplers) {
+  Store(Record(kGfxSetSamplers, 2, count > 0 ? samplers[0] : nullptr, start,
+    count), samplers, count * sizeof(ID3D11SamplerState *));
+}
+
+void RecordingBackend::PSSetSamplers(UINT start, UINT count,
+  ID3D11SamplerState *const *samplers) {
+  Store(Record(kGfxSetSamplers, 4, count > 0 ? samplers[0] : nullptr, start,
+    count), samplers, count * sizeof(ID3D11SamplerState *));
+}
+
+void RecordingBackend::OMSetBlendState(ID3D11BlendState *state,
+  const FLOAT blend_factor[4], UINT sample_mask) {
+  Store(Record(kGfxSetBlendState, 0, state, sample_mask, 0), blend_factor,
+    4 * sizeof(FLOAT));
+}
+
+void RecordingBackend::OMSetDepthStencilState(
+  ID3D11DepthStencilState *state, UINT stencil_ref) {
+  Record(kGfxSetDepthStencilState, 0, state, stencil_ref, 0);
+}
+
+void RecordingBackend::OMSetRenderTargets(UINT count,
+  ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depth) {
+  GfxCommand *command = Record(kGfxSetRenderTargets, 0,
+    count > 0 ? static_cast<void *>(views[0]) : depth, 0, count);
+  if (command != nullptr) {
+    command->object2 = depth;
+  }
+  Store(command, views, count * sizeof(ID3D11RenderTargetView *));
+}
+
+void RecordingBackend::RSSetState(ID3D11RasterizerState *state) {
+  Record(kGfxSetRasterizerState, 0, state, 0, 0);
+}
+
+void RecordingBackend::RSSetViewports(UINT count,
+  const D3D11_VIEWPORT *viewports) {
+  Store(Record(kGfxSetViewports, 0, nullptr, 0, count), viewports,
+    count * sizeof(D3D11_VIEWPORT));
+}
+
+HRESULT RecordingBackend::Map(ID3D11Resource *resource, UINT subresource,
+  D3D11_MAP type, UINT flags, D3D11_MAPPED_SUBRESOURCE *mapped) {
+  mapped->RowPitch = 0;
+  mapped->DepthPitch = 0;
+
+  if (deferred_) {
+    // What is written has to be replayed: only whole buffers can be mapped,
+    // as on D3D11 deferred contexts
+    if (type != D3D11_MAP_WRITE_DISCARD) {
+      return E_FAIL;
+    }
+
+    D3D11_BUFFER_DESC desc;
+    static_cast<ID3D11Buffer *>(resource)->GetDesc(&desc);
+
+    GfxCommand *command = Record(kGfxMap, 0, resource, subresource, type);
+    command->c = flags;
+    UInt8 *data = Allocate(desc.ByteWidth);
+    memset(data, 0, desc.ByteWidth);
+    command->payload = data;
+    command->payload_size = desc.ByteWidth;
+    mapped->pData = data;
+
+    return S_OK;
+  }
+
+  GfxCommand *command = Record(kGfxMap, 0, resource, subresource, type);
+  if (command != nullptr) {
+    command->c = flags;
+  }
+
+  // Whatever was written by earlier maps must not be read back
+  if (type == D3D11_MAP_READ || type == D3D11_MAP_READ_WRITE) {
+    memset(scratch_, 0, kScratchSize);
+  }
+  mapped->pData = scratch_;
+
+  return S_OK;
+}
+
+void RecordingBackend::Unmap(ID3D11Resource *resource, UINT subresource) {
+  Record(kGfxUnmap, 0, resource, subresource, 0);
+}
+
+void RecordingBackend::UpdateSubresource(ID3D11Resource *resource,
+  UINT subresource, const D3D11_BOX *box, const void *data, UINT row_pitch,
+  UINT depth_pitch) {
+  GfxCommand *command = Record(kGfxUpdateSubresource, 0, resource,
+    subresource, row_pitch);
+  if (command != nullptr) {
+    command->object2 = data;
+    command->c = depth_pitch;
+  }
+  Store(command, box, sizeof(D3D11_BOX));
+}
+
+void RecordingBackend::CopyResource(ID3D11Resource *dst,
+  ID3D11Resource *src) {
+  GfxCommand *command = Record(kGfxCopyResource, 0, dst, 0, 0);
+  if (command != nullptr) {
+    command->object2 = src;
+  }
+}
+
+void RecordingBackend::GenerateMips(ID3D11ShaderResourceView *view) {
+  Record(kGfxGenerateMips, 0, view, 0, 0);
+}
+
+void RecordingBackend::ClearRenderTargetView(ID3D11RenderTargetView *view,
+  const FLOAT colour[4]) {
+  Store(Record(kGfxClearRenderTarget, 0, view, 0, 0), colour,
+    4 * sizeof(FLOAT));
+}
+
+void RecordingBackend::ClearDepthStencilView(ID3D11DepthStencilView *view,
+  UINT flags, FLOAT depth, UINT8 stencil) {
+  GfxCommand *command = Record(kGfxClearDepthStencil, 0, view, flags,
+    stencil);
+  if (command != nullptr) {
+    memcpy(&command->c, &depth, sizeof(depth));
+  }
+}
+
+void RecordingBackend::Draw(UINT vertex_count, UINT start_vertex) {
+  Record(kGfxDraw, 0, nullptr, vertex_count, start_vertex);
+  vertex_count_ += vertex_count;
+}
+
+void RecordingBackend::DrawIndexed(UINT index_count, UINT start_index,
+  INT base_vertex) {
+  GfxCommand *command = Record(kGfxDrawIndexed, 0, nullptr, index_count,
+    start_index);
+  if (command != nullptr) {
+    command->c = static_cast<UInt32>(base_vertex);
+  }
+  vertex_count_ += index_count;
+}
+
+void RecordingBackend::DrawIndexedInstanced(UINT index_count,
+  UINT instance_count, UINT start_index, INT base_vertex,
+  UINT start_instance) {
+  GfxCommand *command = Record(kGfxDrawIndexedInstanced, 0, nullptr,
+    index_count, instance_count);
+  if (command != nullptr) {
+    command->c = start_index;
+    UInt32 starts[2] = { static_cast<UInt32>(base_vertex), start_instance };
+    Store(command, starts, sizeof(starts));
+  }
+  vertex_count_ += static_cast<UInt64>(index_count) * instance_count;
+}
+
+} // namespace sz
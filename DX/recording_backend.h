@@ -0,0 +1,233 @@
+#ifndef _RECORDING_BACKEND_H
+#define _RECORDING_BACKEND_H
+
+#include <cstddef>
+#include <vector>
+#include "abertay_framework.h"
+#include "gfx_backend.h"
+
+namespace sz {
+
+enum GfxCommandType {
+  kGfxSetInputLayout = 0,
+  kGfxSetPrimitiveTopology,
+  kGfxSetVertexBuffers,
+  kGfxSetIndexBuffer,
+  kGfxSetShader,
+  kGfxSetConstantBuffers,
+  kGfxSetShaderResources,
+  kGfxSetSamplers,
+  kGfxSetBlendState,
+  kGfxSetDepthStencilState,
+  kGfxSetRenderTargets,
+  kGfxSetRasterizerState,
+  kGfxSetViewports,
+  kGfxMap,
+  kGfxUnmap,
+  kGfxUpdateSubresource,
+  kGfxCopyResource,
+  kGfxGenerateMips,
+  kGfxClearRenderTarget,
+  kGfxClearDepthStencil,
+  kGfxDraw,
+  kGfxDrawIndexed,
+  kGfxDrawIndexedInstanced,
+  kGfxCommandTypeCount
+};
+
+// Name of a command type, for reports
+const char *GfxCommandName(GfxCommandType type);
+
+// A recorded command
+struct GfxCommand {
+  GfxCommandType type;
+  // Shader stage of stage commands, 0 (VS) to 4 (PS)
+  UInt32 stage;
+  // Object the command is about: the shader, the first buffer or view
+  // bound, the resource updated, the target cleared, etc.
+  void *object;
+  // Depth view of render target binds, source of copies, data of updates
+  const void *object2;
+  // Start slot and count of binds, index/vertex count and start of draws,
+  // subresource, map type and flags of maps, etc.; see Replay. c is 1 for
+  // constant buffers bound from an offset.
+  UInt32 a;
+  UInt32 b;
+  UInt32 c;
+  // Arrays, colours, box or mapped bytes of the command, kept with it
+  const UInt8 *payload;
+  UInt32 payload_size;
+};
+
+// Backend which records the commands in memory and counts them, instead of
+// sending them to a GPU. Maps hand out scratch memory large enough for any
+// constant buffer, with row and depth pitches of 0; it reads as zeros. The
+// arrays passed to binds are copied, so they can be compared afterwards.
+//
+// Deferred recording backends keep what is written to mapped buffers too,
+// so that their commands can be replayed on another backend. As on D3D11
+// deferred contexts, only buffers mapped with WRITE_DISCARD are supported
+// there. UpdateSubresource keeps a pointer to its data, which has to stay
+// valid until the commands are replayed.
+class RecordingBackend : public GfxBackend {
+public:
+  RecordingBackend();
+  ~RecordingBackend();
+
+  // Forget the recorded commands and reset the counters
+  void Reset();
+
+  // Send the recorded commands to another backend, in order
+  void Replay(GfxBackend &target) const;
+
+  inline const std::vector<GfxCommand> &commands() const {
+    return commands_;
+  }
+  inline UInt32 count(GfxCommandType type) const {
+    return counts_[type];
+  }
+  // Total number of indices and vertices drawn, over all instances
+  inline UInt64 primitive_vertex_count() const {
+    return vertex_count_;
+  }
+
+  // Whether commands are kept, or only counted; deferred backends always
+  // keep them
+  inline void set_keep_commands(bool keep) {
+    keep_commands_ = keep || deferred_;
+  }
+
+  // Deferred backends are recording backends too, replayed when executed
+  GfxBackend *CreateDeferred();
+  void ExecuteDeferred(GfxBackend *deferred);
+
+  // Always, as they are only recorded
+  bool SupportsConstantBufferOffsets() const;
+
+  void IASetInputLayout(ID3D11InputLayout *layout);
+  void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+  void IASetVertexBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *strides,
+    const UINT *offsets);
+  void IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format,
+    UINT offset);
+
+  void VSSetShader(ID3D11VertexShader *shader);
+  void HSSetShader(ID3D11HullShader *shader);
+  void DSSetShader(ID3D11DomainShader *shader);
+  void GSSetShader(ID3D11GeometryShader *shader);
+  void PSSetShader(ID3D11PixelShader *shader);
+
+  void VSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void HSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void DSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void GSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void PSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void VSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+  void HSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+  void DSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+  void GSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+  void PSSetConstantBuffers1(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+
+  void VSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views);
+  void DSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views);
+  void PSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views);
+
+  void VSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers);
+  void DSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers);
+  void PSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers);
+
+  void OMSetBlendState(ID3D11BlendState *state, const FLOAT blend_factor[4],
+    UINT sample_mask);
+  void OMSetDepthStencilState(ID3D11DepthStencilState *state,
+    UINT stencil_ref);
+  void OMSetRenderTargets(UINT count, ID3D11RenderTargetView *const *views,
+    ID3D11DepthStencilView *depth);
+  void RSSetState(ID3D11RasterizerState *state);
+  void RSSetViewports(UINT count, const D3D11_VIEWPORT *viewports);
+
+  HRESULT Map(ID3D11Resource *resource, UINT subresource, D3D11_MAP type,
+    UINT flags, D3D11_MAPPED_SUBRESOURCE *mapped);
+  void Unmap(ID3D11Resource *resource, UINT subresource);
+  void UpdateSubresource(ID3D11Resource *resource, UINT subresource,
+    const D3D11_BOX *box, const void *data, UINT row_pitch,
+    UINT depth_pitch);
+  void CopyResource(ID3D11Resource *dst, ID3D11Resource *src);
+  void GenerateMips(ID3D11ShaderResourceView *view);
+
+  void ClearRenderTargetView(ID3D11RenderTargetView *view,
+    const FLOAT colour[4]);
+  void ClearDepthStencilView(ID3D11DepthStencilView *view, UINT flags,
+    FLOAT depth, UINT8 stencil);
+  void Draw(UINT vertex_count, UINT start_vertex);
+  void DrawIndexed(UINT index_count, UINT start_index,
+    INT base_vertex);
+  void DrawIndexedInstanced(UINT index_count, UINT instance_count,
+    UINT start_index, INT base_vertex, UINT start_instance);
+
+  // Disable ctors
+  RecordingBackend(const RecordingBackend &) = delete;
+  RecordingBackend &operator=(const RecordingBackend &) = delete;
+
+private:
+  // Count a command, and return it if commands are kept
+  GfxCommand *Record(GfxCommandType type, UInt32 stage, void *object,
+    UInt32 a, UInt32 b);
+
+  // Reserve size bytes of payload, 16 byte aligned. They stay where they
+  // are until Reset, so that mapped memory can be written while more
+  // commands are recorded.
+  UInt8 *Allocate(size_t size);
+  // Append data to the payload of a command, if commands are kept
+  void Store(GfxCommand *command, const void *data, size_t size);
+
+  // Record constant buffers bound from an offset: the buffers, then the
+  // first constants, then the constant counts
+  void RecordConstantBuffers1(UInt32 stage, UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *first_constants,
+    const UINT *constant_counts);
+
+  // Block of payload memory
+  struct PayloadBlock {
+    UInt8 *data;
+    size_t size;
+  };
+
+  std::vector<GfxCommand> commands_;
+  UInt32 counts_[kGfxCommandTypeCount];
+  UInt64 vertex_count_;
+  bool keep_commands_;
+  bool deferred_;
+  // Aligned, so that mapped memory can hold XMMATRIX
+  std::vector<PayloadBlock> blocks_;
+  size_t block_;
+  size_t block_used_;
+  // Handed out by Map when the data is not kept
+  UInt8 *scratch_;
+
+}; // class RecordingBackend
+
+} // namespace sz
+
+#endif
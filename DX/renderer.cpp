@@ -1,5 +1,6 @@
 
 #include "renderer.h"
+#include "state_cache.h"
 #include <d3d11.h>
 #include "shader_resource_manager.h"
 #include "buffer_resource_manager.h"
@@ -12,19 +13,79 @@
 #include "TextureShader.h"
 #include "DepthShader.h"
 #include "Model.h"
-#include "Light.h"
+#include <cstring>
 #include <sstream>
 #include <string>
 #include "gaussian_blur.h"
 #include "Texture.h"
 #include "Timer.h"
+#include "occlusion_culler.h"
+#include <algorithm>
+#include <cfloat>
 
 namespace sz {
 
+// Size of the occlusion depth buffer; its height follows the screen's
+const UInt32 kOcclusionBufferWidth = 256;
+// Most triangles rasterised as occluders
+const UInt32 kOccluderTriangleBudget = 8192;
+
+// Most instances drawn in a frame
+const UInt32 kMaxInstances = 16384;
+
+// Entries of the lists of lights of all the clusters
+const UInt32 kMaxClusterIndices = 256 * 1024;
+
+// Colour of the scene and of its post processing: lighting does not go
+// below 0, and nothing reads alpha back
+const DXGI_FORMAT kSceneColourFormat = DXGI_FORMAT_R11G11B10_FLOAT;
+// Shadow maps only keep depth, which the lit shaders sample; 32 bits as the
+// colour maps had
+const DXGI_FORMAT kShadowMapFormat = DXGI_FORMAT_D32_FLOAT;
+
+// Sizes of the tiles of the shadow atlas: the smallest is the atlas over
+// this, the largest the whole atlas
+const UInt32 kShadowAtlasSteps = 16;
+
+// Texels a shadow map would like for each pixel of the screen the reach of
+// its light may cover; more than one, as the map sees the scene from
+// elsewhere
+const float kShadowTexelsPerPixel = 2.f;
+
+// Create a buffer which the CPU writes every frame and pixel shaders read
+// through a view: a structured buffer if the format is unknown, a typed one
+// otherwise
+static void CreateShaderBuffer(ID3D11Device *device, UInt32 stride,
+  UInt32 count, DXGI_FORMAT format, ID3D11Buffer **buffer,
+  ID3D11ShaderResourceView **view) {
+  D3D11_BUFFER_DESC desc;
+  desc.Usage = D3D11_USAGE_DYNAMIC;
+  desc.ByteWidth = stride * count;
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+  desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+  desc.MiscFlags = format == DXGI_FORMAT_UNKNOWN ?
+    D3D11_RESOURCE_MISC_BUFFER_STRUCTURED : 0;
+  desc.StructureByteStride = format == DXGI_FORMAT_UNKNOWN ? stride : 0;
+  if (FAILED(device->CreateBuffer(&desc, nullptr, buffer))) {
+    *buffer = nullptr;
+    return;
+  }
+
+  D3D11_SHADER_RESOURCE_VIEW_DESC view_desc;
+  view_desc.Format = format;
+  view_desc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+  view_desc.Buffer.FirstElement = 0;
+  view_desc.Buffer.NumElements = count;
+  if (FAILED(device->CreateShaderResourceView(*buffer, &view_desc, view))) {
+    *view = nullptr;
+  }
+}
+
   Renderer::Renderer(const unsigned int scr_height, const unsigned int scr_width,
     const float scr_depth, const float scr_near, ID3D11Device* device,
     HWND hwnd, ConstBufManager *buf_man, ShaderManager *sha_man,
-    const size_t lights_num, const Timer &timer) :
+    const size_t lights_num, const UInt32 shadow_atlas_size,
+    const Timer &timer) :
     tessellation_value(1.f),
     tessellation_distance(100.f),
     waves_amplitude(1.f),
@@ -39,35 +100,116 @@ namespace sz {
     prev_vertex_manip_check_value_(false),
     manip_vertices_(false),
     models_(),
-    render_target_main_(nullptr),
+    draw_list_(),
+    mesh_bounds_(),
+    bounds_ranges_(),
+    cull_check_(true),
+    camera_cull_(),
+    light_culls_(lights_num),
+    occlusion_culler_(nullptr),
+    occlusion_check_(true),
+    occlusion_ready_(false),
+    instancing_check_(true),
+    instance_buf_(nullptr),
+    instances_(),
+    instance_scratch_(),
+    instanced_mesh_count_(0),
+    instanced_draw_count_(0),
+    transform_batch_(),
+    draw_transforms_(),
+    shadow_lights_(lights_num, 0),
+    shadow_cache_(lights_num),
+    shadow_budget_(2),
+    shadow_candidates_(lights_num, 0),
+    shadow_priorities_(lights_num, 0.f),
+    moved_casters_(),
+    shadows_manip_(false),
+    shadow_atlas_(shadow_atlas_size, shadow_atlas_size / kShadowAtlasSteps,
+      lights_num),
+    shadow_wanted_(lights_num, 0.f),
+    shadow_moved_count_(0),
+    shadow_fit_check_(true),
+    shadow_fitter_(),
+    shadow_projections_(lights_num),
+    shadow_fitted_(lights_num, 0),
+    fit_camera_cull_(),
+    fit_light_cull_(),
+    shadow_fit_gain_(1.f),
+    shadow_frusta_(lights_num),
+    shadow_fit_gains_(lights_num, 1.f),
+    shadow_atlas_buf_(nullptr),
+    shadow_atlas_data_(),
+    light_clusters_(nullptr),
+    cluster_spheres_(),
+    cluster_lights_(),
+    cluster_world_spheres_(),
+    cluster_lights_version_(0),
+    cluster_lights_valid_(false),
+    cluster_light_buf_(nullptr),
+    cluster_grid_buf_(nullptr),
+    cluster_index_buf_(nullptr),
+    cluster_light_view_(nullptr),
+    cluster_grid_view_(nullptr),
+    cluster_index_view_(nullptr),
+    cluster_buf_(nullptr),
+    cluster_light_data_(),
+    light_selector_(),
+    draw_lights_check_(false),
+    draw_lights_(),
+    draw_light_buf_(nullptr),
+    draw_lights_count_(0),
+    draw_lights_truncated_(0),
+    frame_graph_(nullptr),
+    screen_target_desc_(),
+    screen_projection_(),
     render_target_depth_(nullptr),
-    render_targets_depth_(lights_num),
-    depth_target_w_(1024),
-    depth_target_h_(1024),
+    shadow_atlas_target_(nullptr),
     ortho_mesh_screen_(nullptr),
     render_target_main_mat_(nullptr),
     sha_man_(sha_man),
     buf_man_(buf_man),
+    texture_shader_id_(NameInterner::Inst()->Intern("texture_shader")),
+    depth_shader_id_(NameInterner::Inst()->Intern("depth_shader")),
     light_buff_(nullptr),
     camera_buff_(nullptr),
     tessellation_buf_(nullptr),
     time_buf_(nullptr),
+    tessellation_data_(),
+    camera_data_(),
+    time_data_(),
+    frame_data_valid_(false),
+    light_data_(),
+    light_data_version_(0),
     timer_(timer)
 {
-  // Create render targets 
-  render_target_main_ = new RenderTexture(device,
-    scr_width, scr_height, scr_near, scr_depth,
-    "target_main");
-
-    for (size_t i = 0; i < render_targets_depth_.size(); ++i) {
-      std::string name;
+  // Transient targets are created by the graph when a frame first needs
+  // them; their textures are registered under a name of their own
+  frame_graph_ = new FrameGraph(
+    [device, scr_near, scr_depth](const RenderTextureDesc &desc,
+      UInt32 serial) {
       std::stringstream ss;
-      ss << "target_depth_" << i;
-      name = ss.str();
-      render_targets_depth_[i] = new RenderTexture(device,
-        depth_target_w_, depth_target_h_, scr_near, scr_depth,
-        name.c_str());
-    }
+      ss << "frame_target_" << serial;
+      return new RenderTexture(device, desc, scr_near, scr_depth, ss.str());
+    },
+    [](RenderTexture *target) {
+      // The views of the target may still be bound, and another target may
+      // be created at the same address
+      Texture::Inst()->FreeTexture(target->name());
+      StateCache::Inst()->Invalidate();
+      delete target;
+    });
+  screen_target_desc_ = RenderTextureDesc(scr_width, scr_height,
+    kSceneColourFormat, DXGI_FORMAT_D24_UNORM_S8_UINT, false);
+  // As that of the RenderTextures
+  XMStoreFloat4x4(&screen_projection_, XMMatrixPerspectiveFovLH(
+    XM_PI / 4.0f, (float)scr_width / (float)scr_height, scr_near,
+    scr_depth));
+
+  // Create render targets 
+  shadow_atlas_target_ = new RenderTexture(device,
+    RenderTextureDesc(shadow_atlas_size, shadow_atlas_size,
+    DXGI_FORMAT_UNKNOWN, kShadowMapFormat, true),
+    scr_near, scr_depth, "shadow_atlas");
 
   // Create the ortho mesh
   ortho_mesh_screen_ = new OrthoMesh(device,
@@ -97,12 +239,77 @@ namespace sz {
 
   SetupPerFrameBuffers(device, buf_man, lights_num);
 
+  // Instances are written by the CPU every frame
+  D3D11_BUFFER_DESC instance_buf_desc;
+  instance_buf_desc.Usage = D3D11_USAGE_DYNAMIC;
+  instance_buf_desc.ByteWidth = sizeof(InstanceType) * kMaxInstances;
+  instance_buf_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+  instance_buf_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+  instance_buf_desc.MiscFlags = 0;
+  instance_buf_desc.StructureByteStride = 0;
+  device->CreateBuffer(&instance_buf_desc, nullptr, &instance_buf_);
+  instances_.reserve(kMaxInstances);
+
+  occlusion_culler_ = new OcclusionCuller(kOcclusionBufferWidth,
+    kOcclusionBufferWidth * scr_height / scr_width);
+
+  // The clusters divide the projection of the camera, which does not change
+  light_clusters_ = new LightClusters(scr_width, scr_height,
+    kMaxClusterIndices);
+  light_clusters_->SetProjection(screen_projection_._11,
+    screen_projection_._22, scr_near, scr_depth);
+  cluster_spheres_.reserve(kMaxLights);
+  cluster_lights_.reserve(kMaxLights);
+  cluster_world_spheres_.reserve(kMaxLights);
+  cluster_light_data_.reserve(kMaxLights);
+  CreateShaderBuffer(device, sizeof(ClusterLightType), kMaxLights,
+    DXGI_FORMAT_UNKNOWN, &cluster_light_buf_, &cluster_light_view_);
+  CreateShaderBuffer(device, 2 * sizeof(UInt32),
+    light_clusters_->cluster_count(), DXGI_FORMAT_R32G32_UINT,
+    &cluster_grid_buf_, &cluster_grid_view_);
+  CreateShaderBuffer(device, sizeof(UInt32), kMaxClusterIndices,
+    DXGI_FORMAT_R32_UINT, &cluster_index_buf_, &cluster_index_view_);
+
   post_processer_ = new sz::GaussBlur(scr_height, scr_width,
     scr_depth, scr_near, device, 
     hwnd, *buf_man_, sha_man_);
 }
 
 Renderer::~Renderer() {
+  // The light matrices the shaders read are those of the batch
+  BaseShader::set_light_transforms(nullptr);
+
+  if (instance_buf_ != nullptr) {
+    instance_buf_->Release();
+    instance_buf_ = nullptr;
+  }
+
+  if (occlusion_culler_ != nullptr) {
+    delete occlusion_culler_;
+    occlusion_culler_ = nullptr;
+  }
+
+  if (light_clusters_ != nullptr) {
+    delete light_clusters_;
+    light_clusters_ = nullptr;
+  }
+  ID3D11ShaderResourceView **views[] = { &cluster_light_view_,
+    &cluster_grid_view_, &cluster_index_view_ };
+  for (ID3D11ShaderResourceView **view : views) {
+    if (*view != nullptr) {
+      (*view)->Release();
+      *view = nullptr;
+    }
+  }
+  ID3D11Buffer **buffers[] = { &cluster_light_buf_, &cluster_grid_buf_,
+    &cluster_index_buf_ };
+  for (ID3D11Buffer **buffer : buffers) {
+    if (*buffer != nullptr) {
+      (*buffer)->Release();
+      *buffer = nullptr;
+    }
+  }
+
   if (post_processer_ != nullptr) {
     delete post_processer_;
     post_processer_ = nullptr;
@@ -113,18 +320,15 @@ Renderer::~Renderer() {
     ortho_mesh_screen_ = nullptr;
   }
 
-  if (render_target_main_!= nullptr) {
-    delete render_target_main_;
-    render_target_main_ = nullptr;
+  if (frame_graph_ != nullptr) {
+    delete frame_graph_;
+    frame_graph_ = nullptr;
   }
 
-  for (RenderTexture *target : render_targets_depth_) {
-    if (target != nullptr) {
-      delete target;
-      target = nullptr;
-    }
+  if (shadow_atlas_target_ != nullptr) {
+    delete shadow_atlas_target_;
+    shadow_atlas_target_ = nullptr;
   }
-  render_targets_depth_.clear();
 }
 
 void Renderer::AddMeshesAndMaterials(std::vector<BaseMesh> &meshes,
@@ -149,7 +353,11 @@ void Renderer::AddMeshesAndMaterials(std::vector<BaseMesh> &meshes,
 
       meshes_by_material_[m_crc] = pair;
     }
+
+    AddMeshBounds(meshes[i], false);
   }
+
+  ReserveDrawList();
 }
 
 void Renderer::AddMeshesAndMaterials(std::vector<BaseMesh *> &meshes,
@@ -174,11 +382,25 @@ void Renderer::AddMeshesAndMaterials(std::vector<BaseMesh *> &meshes,
 
       meshes_by_material_[m_crc] = pair;
     }
+
+    AddMeshBounds(*meshes[i], false);
   }
+
+  ReserveDrawList();
 }
 
 void Renderer::AddModel(Model *model) {
   models_.push_back(model);
+
+  for (const MeshesMatMap::value_type &map_pair :
+    model->meshes_by_material()) {
+    for (BaseMesh *mesh : map_pair.second.second) {
+      AddMeshBounds(*mesh, true);
+    }
+  }
+  AddOccluders(*model);
+
+  ReserveDrawList();
 }
 
 void Renderer::AddMeshAndMaterial(BaseMesh &mesh,
@@ -202,6 +424,679 @@ void Renderer::AddMeshAndMaterial(BaseMesh &mesh,
 
     meshes_by_material_[m_crc] = pair;
   }
+
+  AddMeshBounds(mesh, false);
+  ReserveDrawList();
+}
+
+void Renderer::ReserveDrawList() {
+  size_t draws = 0;
+  for (Model *model : models_) {
+    for (const MeshesMatMap::value_type &map_pair :
+      model->meshes_by_material()) {
+      draws += map_pair.second.second.size();
+    }
+  }
+  for (const MeshesMatMap::value_type &map_pair : meshes_by_material_) {
+    draws += map_pair.second.second.size();
+  }
+
+  draw_list_.Reserve(draws);
+}
+
+// Depth in view space of the centre of a mesh
+static float MeshViewDepth(const BaseMesh &mesh, const XMMATRIX &model_view) {
+  return XMVectorGetZ(XMVector3Transform(XMLoadFloat3(&mesh.centre()),
+    model_view));
+}
+
+void Renderer::AddMeshBounds(BaseMesh &mesh, bool model_space) {
+  // New geometry may cast shadows anywhere
+  shadow_cache_.InvalidateAll();
+
+  if (!mesh.has_bounds()) {
+    return;
+  }
+
+  XMFLOAT3 centre = mesh.centre(), extents = mesh.extents();
+  if (!model_space) {
+    TransformBox(mesh.centre(), mesh.extents(), mesh.transform(), centre,
+      extents);
+  }
+  UInt32 index = mesh_bounds_.Add(centre, extents);
+  mesh.set_cull_index(index);
+
+  // Consecutive meshes of the same space are culled together
+  if (!bounds_ranges_.empty() &&
+    bounds_ranges_.back().model_space == model_space &&
+    bounds_ranges_.back().end == index) {
+    ++bounds_ranges_.back().end;
+  }
+  else {
+    BoundsRange range = { index, index + 1, model_space };
+    bounds_ranges_.push_back(range);
+  }
+}
+
+void Renderer::UpdateMeshBounds() {
+  moved_casters_.clear();
+
+  XMFLOAT3 centre, extents;
+  MovedBox prev;
+  for (const MeshesMatMap::value_type &map_pair : meshes_by_material_) {
+    bool casts_shadow =
+      !map_pair.second.first->HasFlag(kMaterialNoShadowCast);
+
+    for (BaseMesh *mesh : map_pair.second.second) {
+      if (mesh->cull_index() == kNoMeshBounds) {
+        continue;
+      }
+
+      TransformBox(mesh->centre(), mesh->extents(), mesh->transform(),
+        centre, extents);
+      mesh_bounds_.Get(mesh->cull_index(), prev.centre, prev.extents);
+
+      // Shadows change both where the caster was and where it is now
+      if (casts_shadow && (memcmp(&centre, &prev.centre, sizeof(XMFLOAT3)) ||
+        memcmp(&extents, &prev.extents, sizeof(XMFLOAT3)))) {
+        moved_casters_.push_back(prev);
+        MovedBox now = { centre, extents };
+        moved_casters_.push_back(now);
+      }
+
+      mesh_bounds_.Set(mesh->cull_index(), centre, extents);
+    }
+  }
+}
+
+void Renderer::CullMeshes(const XMMATRIX &model_transform,
+  const XMMATRIX &view_proj, CullResult &result) const {
+  result.visible.resize(mesh_bounds_.size());
+  result.visible_count = 0;
+  result.culled_count = 0;
+
+  // Manipulated vertices may leave the bounds they were loaded with
+  if (!cull_check_ || manip_vertices_) {
+    if (!result.visible.empty()) {
+      memset(&result.visible[0], 1, result.visible.size());
+    }
+    result.visible_count = mesh_bounds_.size();
+    return;
+  }
+
+  XMMATRIX model_view_proj = XMMatrixMultiply(model_transform, view_proj);
+  for (const BoundsRange &range : bounds_ranges_) {
+    result.visible_count += mesh_bounds_.Cull(
+      range.model_space ? model_view_proj : view_proj, range.begin,
+      range.end, &result.visible[0]);
+  }
+  result.culled_count = mesh_bounds_.size() - result.visible_count;
+}
+
+void Renderer::AddOccluders(Model &model) {
+  // Alpha-mapped meshes have holes, so only opaque ones can hide others.
+  // Large boxes drawn with few triangles hide the most for their cost.
+  std::vector<std::pair<float, BaseMesh *>> candidates;
+  for (const MeshesMatMap::value_type &map_pair :
+    model.meshes_by_material()) {
+    if (map_pair.second.first->HasFlag(kMaterialAlphaMapped)) {
+      continue;
+    }
+
+    for (BaseMesh *mesh : map_pair.second.second) {
+      if (!mesh->has_bounds() || mesh->GetIndicesSize() < 3) {
+        continue;
+      }
+
+      const XMFLOAT3 &e = mesh->extents();
+      float area = e.x * e.y + e.y * e.z + e.z * e.x;
+      candidates.push_back(std::make_pair(
+        area / static_cast<float>(mesh->GetIndicesSize() / 3), mesh));
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+    [](const std::pair<float, BaseMesh *> &a,
+      const std::pair<float, BaseMesh *> &b) {
+    return a.first > b.first;
+  });
+
+  UInt32 triangles = occlusion_culler_->triangle_count();
+  std::vector<XMFLOAT3> positions;
+  for (const std::pair<float, BaseMesh *> &candidate : candidates) {
+    const BaseMesh &mesh = *candidate.second;
+    UInt32 mesh_triangles = static_cast<UInt32>(mesh.GetIndicesSize() / 3);
+    if (triangles + mesh_triangles > kOccluderTriangleBudget) {
+      continue;
+    }
+    triangles += mesh_triangles;
+
+    // Flipped as when the buffers were made
+    positions.clear();
+    for (const ModelType &v : mesh.vertices()) {
+      positions.push_back(XMFLOAT3(v.x, v.y, -v.z));
+    }
+    occlusion_culler_->AddOccluder(&positions[0],
+      static_cast<UInt32>(positions.size()), &mesh.indices()[0],
+      static_cast<UInt32>(mesh.indices().size()));
+  }
+}
+
+void Renderer::RenderOccluders(const XMMATRIX &model_transform,
+  const XMMATRIX &view_proj, WorkerPool *workers) {
+  // Manipulated vertices may leave where the occluders were loaded
+  occlusion_ready_ = occlusion_check_ && cull_check_ && !manip_vertices_ &&
+    occlusion_culler_->triangle_count() > 0;
+  if (!occlusion_ready_) {
+    return;
+  }
+
+  occlusion_culler_->Render(XMMatrixMultiply(model_transform, view_proj),
+    workers);
+}
+
+void Renderer::OccludeMeshes(const XMMATRIX &model_transform,
+  const XMMATRIX &view_proj, CullResult &result) const {
+  result.occluded_count = 0;
+  if (!occlusion_ready_) {
+    return;
+  }
+
+  XMMATRIX model_view_proj = XMMatrixMultiply(model_transform, view_proj);
+  XMFLOAT3 centre, extents;
+  for (const BoundsRange &range : bounds_ranges_) {
+    const XMMATRIX &to_clip = range.model_space ? model_view_proj : view_proj;
+    for (UInt32 i = range.begin; i < range.end; ++i) {
+      if (!result.visible[i]) {
+        continue;
+      }
+
+      mesh_bounds_.Get(i, centre, extents);
+      if (occlusion_culler_->IsOccluded(to_clip, centre, extents)) {
+        result.visible[i] = 0;
+        ++result.occluded_count;
+      }
+    }
+  }
+  result.visible_count -= result.occluded_count;
+}
+
+void Renderer::SelectShadowLights(const LightSystem &lights, Camera *cam,
+  const XMMATRIX &model_transform) {
+  XMMATRIX view_matrix;
+  cam->GetViewMatrix(view_matrix);
+  XMMATRIX view_proj = XMMatrixMultiply(view_matrix,
+    XMLoadFloat4x4(&screen_projection_));
+
+  // Waves move the geometry out of its bounds, so the maps keep the whole
+  // reach of their lights then
+  const bool fit_shadows = shadow_fit_check_ && !manip_vertices_;
+  if (fit_shadows) {
+    CullMeshes(model_transform, view_proj, fit_camera_cull_);
+  }
+  float fit_gain_sum = 0.f;
+  UInt32 fit_gain_count = 0;
+
+  XMFLOAT3 cam_position = cam->GetPosition();
+
+  // Waves move the geometry every frame, and it has to be drawn again once
+  // they stop
+  if (manip_vertices_ || manip_vertices_ != shadows_manip_) {
+    shadow_cache_.InvalidateAll();
+    shadows_manip_ = manip_vertices_;
+  }
+
+  for (size_t i = 0; i < shadow_lights_.size(); ++i) {
+    shadow_candidates_[i] = 0;
+    shadow_priorities_[i] = 0.f;
+    shadow_wanted_[i] = 0.f;
+    light_culls_[i].visible_count = 0;
+    light_culls_[i].culled_count = 0;
+
+    const UInt32 light = static_cast<UInt32>(i);
+    if (light >= lights.count() || !lights.casts_shadows(light)) {
+      continue;
+    }
+
+    // Maps of inactive lights are kept up to date too, so that they are
+    // right when the lights are turned back on
+    XMMATRIX light_view = XMLoadFloat4x4(&lights.view(light));
+    XMMATRIX influence = XMMatrixMultiply(light_view,
+      lights.influence_projection(light));
+    float fit_gain = 1.f;
+    if (fit_shadows) {
+      fit_gain = FitShadowFrustum(lights, light, model_transform);
+    }
+    else {
+      shadow_projections_[i] = lights.projection(light);
+      shadow_fitted_[i] = 0;
+    }
+    shadow_cache_.Update(i, light_view,
+      XMLoadFloat4x4(&shadow_projections_[i]));
+    for (const MovedBox &box : moved_casters_) {
+      if (BoxInFrustum(influence, box.centre, box.extents)) {
+        shadow_cache_.Invalidate(i);
+        break;
+      }
+    }
+
+    if (!lights.active(light)) {
+      continue;
+    }
+    fit_gain_sum += fit_gain;
+    ++fit_gain_count;
+
+    XMFLOAT3 position = lights.position(light);
+    float range = lights.range(light);
+    float dx = position.x - cam_position.x;
+    float dy = position.y - cam_position.y;
+    float dz = position.z - cam_position.z;
+    float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+    // The texels of the map follow the height of the screen the sphere of
+    // the light may cover; lights just out of view keep a tile too, so that
+    // their maps are still there when they come back
+    float coverage = 1.f;
+    if (distance > range) {
+      coverage = range * screen_projection_._22 / distance;
+      if (coverage > 1.f) {
+        coverage = 1.f;
+      }
+    }
+    shadow_wanted_[i] = coverage *
+      static_cast<float>(screen_target_desc_.height) * kShadowTexelsPerPixel;
+
+    // Lights which reach nothing in view cast no shadow that can be seen
+    if (cull_check_) {
+      if (!SphereInFrustum(view_proj, position, range) ||
+        !FrustumInFrustum(view_proj, influence)) {
+        continue;
+      }
+    }
+
+    // Closer lights, and those which reach further, cover more of the
+    // screen
+    shadow_candidates_[i] = 1;
+    shadow_priorities_[i] = range / (distance + range + 1.f);
+  }
+
+  shadow_fit_gain_ = fit_gain_count > 0 ?
+    fit_gain_sum / static_cast<float>(fit_gain_count) : 1.f;
+
+  // Maps whose tile moved are gone; lights left without a tile are not
+  // rendered
+  shadow_moved_count_ = 0;
+  if (!shadow_lights_.empty()) {
+    shadow_moved_count_ = shadow_atlas_.Allocate(&shadow_wanted_[0]);
+  }
+  for (size_t i = 0; i < shadow_lights_.size(); ++i) {
+    if (shadow_atlas_.moved(i)) {
+      shadow_cache_.Discard(i);
+    }
+    if (shadow_atlas_.tile(i).size == 0) {
+      shadow_candidates_[i] = 0;
+    }
+  }
+
+  if (!shadow_lights_.empty()) {
+    shadow_cache_.Schedule(&shadow_candidates_[0], &shadow_priorities_[0],
+      static_cast<UInt32>(shadow_budget_), &shadow_lights_[0]);
+  }
+}
+
+float Renderer::FitShadowFrustum(const LightSystem &lights, UInt32 light,
+  const XMMATRIX &model_transform) {
+  float field_of_view, near_z, far_z;
+  lights.InfluenceFrustum(light, &field_of_view, &near_z, &far_z);
+  const float tan_half_fov = tanf(field_of_view * 0.5f);
+
+  // Only the meshes in the reach of the light are shadowed by it
+  CullMeshes(model_transform, XMMatrixMultiply(
+    XMLoadFloat4x4(&lights.view(light)), lights.influence_projection(light)),
+    fit_light_cull_);
+
+  shadow_fitter_.Begin(lights.view(light), tan_half_fov, near_z, far_z);
+  XMFLOAT3 centre, extents, world_centre, world_extents;
+  for (const BoundsRange &range : bounds_ranges_) {
+    for (UInt32 i = range.begin; i < range.end; ++i) {
+      if (!fit_light_cull_.visible[i]) {
+        continue;
+      }
+
+      mesh_bounds_.Get(i, centre, extents);
+      if (range.model_space) {
+        TransformBox(centre, extents, model_transform, world_centre,
+          world_extents);
+      }
+      else {
+        world_centre = centre;
+        world_extents = extents;
+      }
+
+      if (fit_camera_cull_.visible[i]) {
+        shadow_fitter_.AddReceiver(world_centre, world_extents);
+      }
+      shadow_fitter_.AddCaster(world_centre, world_extents);
+    }
+  }
+
+  ShadowFrustum frustum;
+  if (shadow_fitter_.End(&frustum)) {
+    XMStoreFloat4x4(&shadow_projections_[light],
+      XMMatrixPerspectiveOffCenterLH(frustum.left * frustum.near_z,
+      frustum.right * frustum.near_z, frustum.bottom * frustum.near_z,
+      frustum.top * frustum.near_z, frustum.near_z, frustum.far_z));
+    shadow_fitted_[light] = 1;
+    shadow_frusta_[light] = frustum;
+    shadow_fit_gains_[light] = ShadowFitter::TexelGain(frustum,
+      tan_half_fov);
+    return shadow_fit_gains_[light];
+  }
+
+  // Nothing the light reaches is in view, so its map is not sampled; a
+  // fitted frustum is kept rather than rendering the map again for nothing
+  if (!shadow_fitted_[light]) {
+    shadow_projections_[light] = lights.projection(light);
+  }
+  return 1.f;
+}
+
+void Renderer::GatherClusterLights(const LightSystem &lights) {
+  // Spheres of influence of the active lights in world space. That of a
+  // spot light is the smallest around its cone: through its tip and the rim
+  // of its base if the cone is narrow, around the base otherwise.
+  cluster_world_spheres_.clear();
+  cluster_lights_.clear();
+  for (UInt32 i = 0; i < lights.count() &&
+    cluster_lights_.size() < kMaxLights; ++i) {
+    if (!lights.active(i)) {
+      continue;
+    }
+
+    ClusterSphere sphere = { 0.f, 0.f, 0.f, -1.f };
+    if (!lights.directional(i)) {
+      XMFLOAT3 position = lights.position(i);
+      float range = lights.range(i);
+      float cutoff = lights.spot_cutoff(i);
+      sphere.x = position.x;
+      sphere.y = position.y;
+      sphere.z = position.z;
+      sphere.radius = range;
+      if (cutoff < XM_PIDIV2) {
+        XMFLOAT3 axis = lights.direction(i);
+        float to_centre = range * cosf(cutoff);
+        sphere.radius = range * sinf(cutoff);
+        if (cutoff < XM_PIDIV4) {
+          to_centre = range / (2.f * cosf(cutoff));
+          sphere.radius = to_centre;
+        }
+        sphere.x += axis.x * to_centre;
+        sphere.y += axis.y * to_centre;
+        sphere.z += axis.z * to_centre;
+      }
+    }
+    cluster_world_spheres_.push_back(sphere);
+    cluster_lights_.push_back(i);
+  }
+
+  // Lights, in the order of the lists; kept for the selection of the lights
+  // of each draw
+  cluster_light_data_.resize(cluster_lights_.size());
+  for (size_t c = 0; c < cluster_lights_.size(); ++c) {
+    UInt32 i = cluster_lights_[c];
+    ClusterLightType &data = cluster_light_data_[c];
+    data.diffuse = lights.diffuse(i);
+    data.ambient = lights.ambient(i);
+    data.specular = lights.specular(i);
+    data.position = lights.position(i);
+    data.range = lights.range(i);
+    data.direction = lights.direction(i);
+    data.spot_cos_cutoff = cosf(lights.spot_cutoff(i));
+    data.attenuation = lights.attenuation(i);
+    data.spot_exponent = lights.spot_exponent(i);
+    if (lights.directional(i)) {
+      data.kind = kClusterLightDirectional;
+    }
+    else if (lights.spot(i)) {
+      data.kind = kClusterLightSpot;
+    }
+    else {
+      data.kind = kClusterLightPoint;
+    }
+    // Whether the map was rendered is up to the lights' constant buffer
+    data.shadow_slot = i < shadow_light_count(lights) &&
+      lights.casts_shadows(i) ? i : kNumLights;
+    data.padding = XMFLOAT2(0.f, 0.f);
+  }
+  light_selector_.SetLights(cluster_light_data_.empty() ? nullptr :
+    &cluster_light_data_[0], static_cast<UInt32>(cluster_light_data_.size()));
+
+  D3D11_MAPPED_SUBRESOURCE mapped_resource;
+  if (cluster_light_buf_ != nullptr && !cluster_light_data_.empty() &&
+    SUCCEEDED(StateCache::Inst()->Map(cluster_light_buf_, 0,
+    D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource))) {
+    memcpy(mapped_resource.pData, &cluster_light_data_[0],
+      cluster_light_data_.size() * sizeof(ClusterLightType));
+    StateCache::Inst()->Unmap(cluster_light_buf_, 0);
+  }
+}
+
+void Renderer::UpdateLightClusters(const LightSystem &lights, Camera *cam,
+  WorkerPool *workers) {
+  // The lights are gathered, and uploaded, only when they changed
+  if (!cluster_lights_valid_ || cluster_lights_version_ != lights.version()) {
+    GatherClusterLights(lights);
+    cluster_lights_version_ = lights.version();
+    cluster_lights_valid_ = true;
+  }
+
+  // Spheres of influence of the lights in view space
+  XMMATRIX view_matrix;
+  cam->GetViewMatrix(view_matrix);
+  cluster_spheres_.resize(cluster_world_spheres_.size());
+  for (size_t c = 0; c < cluster_world_spheres_.size(); ++c) {
+    const ClusterSphere &world = cluster_world_spheres_[c];
+    ClusterSphere &sphere = cluster_spheres_[c];
+    sphere = world;
+    if (world.radius >= 0.f) {
+      XMFLOAT3 view_centre;
+      XMStoreFloat3(&view_centre, XMVector3TransformCoord(
+        XMVectorSet(world.x, world.y, world.z, 1.f), view_matrix));
+      sphere.x = view_centre.x;
+      sphere.y = view_centre.y;
+      sphere.z = view_centre.z;
+    }
+  }
+
+  light_clusters_->Build(cluster_spheres_.empty() ? nullptr :
+    &cluster_spheres_[0], static_cast<UInt32>(cluster_spheres_.size()),
+    workers);
+
+  D3D11_MAPPED_SUBRESOURCE mapped_resource;
+  // Offset and count of the list of each cluster, then the lists
+  const std::vector<UInt32> &grid = light_clusters_->grid();
+  if (cluster_grid_buf_ != nullptr && SUCCEEDED(StateCache::Inst()->Map(
+    cluster_grid_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource))) {
+    memcpy(mapped_resource.pData, &grid[0], grid.size() * sizeof(UInt32));
+    StateCache::Inst()->Unmap(cluster_grid_buf_, 0);
+  }
+  UInt32 index_count = light_clusters_->index_count();
+  if (cluster_index_buf_ != nullptr && SUCCEEDED(StateCache::Inst()->Map(
+    cluster_index_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource))) {
+    if (index_count > 0) {
+      memcpy(mapped_resource.pData, &light_clusters_->indices()[0],
+        index_count * sizeof(UInt32));
+    }
+    StateCache::Inst()->Unmap(cluster_index_buf_, 0);
+  }
+
+  ClusterBufferType cluster_data;
+  memset(&cluster_data, 0, sizeof(cluster_data));
+  cluster_data.tile_scale = 1.f / static_cast<float>(kClusterTileSize);
+  cluster_data.slice_scale = light_clusters_->slice_scale();
+  cluster_data.slice_bias = light_clusters_->slice_bias();
+  cluster_data.slice_count = kClusterSlices;
+  cluster_data.tiles_x = light_clusters_->tiles_x();
+  cluster_data.tiles_y = light_clusters_->tiles_y();
+  cluster_data.depth_a = -screen_projection_._43;
+  cluster_data.depth_b = screen_projection_._33;
+  if (SUCCEEDED(StateCache::Inst()->Map(cluster_buf_, 0,
+    D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource))) {
+    memcpy(mapped_resource.pData, &cluster_data, sizeof(cluster_data));
+    StateCache::Inst()->Unmap(cluster_buf_, 0);
+  }
+}
+
+void Renderer::BuildDrawList(const XMMATRIX &model_transform,
+  const XMMATRIX &view, const CullResult &cull) {
+  draw_list_.Clear();
+  instances_.clear();
+  instanced_mesh_count_ = 0;
+  instanced_draw_count_ = 0;
+
+  // Materials are numbered in the order they are found, which is stable
+  // between frames
+  UInt32 material_sort_id = 0;
+
+  XMMATRIX model_view = XMMatrixMultiply(model_transform, view);
+  for (Model *model : models_) {
+    for (const MeshesMatMap::value_type &map_pair :
+      model->meshes_by_material()) {
+      const MatMeshPair &pair = map_pair.second;
+      const Material *mat = pair.first;
+      UInt32 material_id = material_sort_id++;
+
+      BaseShader *shader = sha_man_->GetShader(mat->shader_id);
+      if (shader == nullptr) {
+        continue;
+      }
+
+      bool alpha = mat->HasFlag(kMaterialAlphaMapped);
+      for (BaseMesh *mesh : pair.second) {
+        if (!IsVisible(*mesh, cull)) {
+          continue;
+        }
+
+        float view_z = MeshViewDepth(*mesh, model_view);
+        DrawItem item = { mat, shader, mesh, model };
+        draw_list_.Add(alpha ?
+          MakeAlphaDrawKey(mat->shader_id, material_id, view_z) :
+          MakeOpaqueDrawKey(mat->shader_id, material_id, view_z), item);
+      }
+    }
+  }
+
+  for (const MeshesMatMap::value_type &map_pair : meshes_by_material_) {
+    const MatMeshPair &pair = map_pair.second;
+    const Material *mat = pair.first;
+    UInt32 material_id = material_sort_id++;
+
+    BaseShader *shader = sha_man_->GetShader(mat->shader_id);
+    if (shader == nullptr) {
+      continue;
+    }
+
+    bool alpha = mat->HasFlag(kMaterialAlphaMapped);
+    // Blended meshes have to stay in depth order, one by one
+    bool instanced = instancing_check_ && !alpha && instance_buf_ != nullptr &&
+      shader->has_instancing();
+    instance_scratch_.clear();
+    for (BaseMesh *mesh : pair.second) {
+      if (!IsVisible(*mesh, cull)) {
+        continue;
+      }
+      if (instanced) {
+        instance_scratch_.push_back(mesh);
+        continue;
+      }
+
+      float view_z = MeshViewDepth(*mesh,
+        XMMatrixMultiply(mesh->transform(), view));
+      DrawItem item = { mat, shader, mesh, nullptr };
+      draw_list_.Add(alpha ?
+        MakeAlphaDrawKey(mat->shader_id, material_id, view_z) :
+        MakeOpaqueDrawKey(mat->shader_id, material_id, view_z), item);
+    }
+
+    if (instanced) {
+      AddInstancedDraws(mat, shader, material_id, view);
+    }
+  }
+}
+
+void Renderer::AddInstancedDraws(const Material *mat, BaseShader *shader,
+  UInt32 material_id, const XMMATRIX &view) {
+  // Meshes which share their buffers next to each other
+  std::sort(instance_scratch_.begin(), instance_scratch_.end(),
+    [](BaseMesh *a, BaseMesh *b) {
+    return std::make_tuple(a->vertex_buffer(), a->index_buffer(),
+      a->GetIndexCount()) < std::make_tuple(b->vertex_buffer(),
+      b->index_buffer(), b->GetIndexCount());
+  });
+
+  size_t begin = 0;
+  while (begin < instance_scratch_.size()) {
+    BaseMesh *first = instance_scratch_[begin];
+    size_t end = begin + 1;
+    while (end < instance_scratch_.size() &&
+      instance_scratch_[end]->vertex_buffer() == first->vertex_buffer() &&
+      instance_scratch_[end]->index_buffer() == first->index_buffer() &&
+      instance_scratch_[end]->GetIndexCount() == first->GetIndexCount()) {
+      ++end;
+    }
+
+    UInt32 count = static_cast<UInt32>(end - begin);
+    if (count > 1 && instances_.size() + count <= kMaxInstances) {
+      // The set is sorted as its nearest mesh
+      UInt32 start = static_cast<UInt32>(instances_.size());
+      float view_z = FLT_MAX;
+      for (size_t i = begin; i < end; ++i) {
+        BaseMesh *mesh = instance_scratch_[i];
+        XMMATRIX world = mesh->transform();
+        view_z = std::min(view_z,
+          MeshViewDepth(*mesh, XMMatrixMultiply(world, view)));
+
+        InstanceType instance;
+        XMStoreFloat4x4(&instance.world, world);
+        instance.params = mesh->instance_params();
+        instances_.push_back(instance);
+      }
+
+      DrawItem item = { mat, shader, instance_scratch_[begin], nullptr,
+        start, count };
+      draw_list_.Add(MakeOpaqueDrawKey(mat->shader_id, material_id, view_z),
+        item);
+      instanced_mesh_count_ += count;
+      ++instanced_draw_count_;
+    }
+    else {
+      for (size_t i = begin; i < end; ++i) {
+        BaseMesh *mesh = instance_scratch_[i];
+        float view_z = MeshViewDepth(*mesh,
+          XMMatrixMultiply(mesh->transform(), view));
+        DrawItem item = { mat, shader, mesh, nullptr };
+        draw_list_.Add(MakeOpaqueDrawKey(mat->shader_id, material_id,
+          view_z), item);
+      }
+    }
+
+    begin = end;
+  }
+}
+
+void Renderer::UploadInstances() {
+  if (instances_.empty()) {
+    return;
+  }
+
+  D3D11_MAPPED_SUBRESOURCE mapped_resource;
+  HRESULT result = sz::StateCache::Inst()->Map(instance_buf_, 0,
+    D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
+  if (FAILED(result)) {
+    return;
+  }
+  memcpy(mapped_resource.pData, instances_.data(),
+    sizeof(InstanceType) * instances_.size());
+  sz::StateCache::Inst()->Unmap(instance_buf_, 0);
 }
 
 void Renderer::RenderToBackBuffer(const RenderTexture &source, D3D *d3d,
@@ -221,11 +1116,9 @@ void Renderer::RenderToBackBuffer(const RenderTexture &source, D3D *d3d,
     d3d->ToggleWireFrame();
   }
 
-  render_target_main_mat_->diffuse_texname = source.name();
-  render_target_main_mat_->diffuse_texname_crc =
-    abfw::CRC::GetICRC(render_target_main_mat_->diffuse_texname.c_str());
+  render_target_main_mat_->diffuse_texture = source.texture_handle();
   ortho_mesh_screen_->SendData(d3d->GetDeviceContext());
-  BaseShader *shader = sha_man_->GetShader("texture_shader");
+  BaseShader *shader = sha_man_->GetShader(texture_shader_id_);
   TextureShader *texture_shader = static_cast<TextureShader *>(shader);
   if (texture_shader != nullptr) {
     shader->SetInputLayoutAndShaders(d3d->GetDeviceContext());
@@ -308,81 +1201,246 @@ void Renderer::SetupPerFrameBuffers(ID3D11Device *dev, ConstBufManager *buf_man,
   time_buf_ = buf_man->CreateD3D11ConstBuffer("time_buffer",
     time_buffer_desc, dev);
   assert(time_buf_ != nullptr);
+
+  // Setup clusters buffer
+  D3D11_BUFFER_DESC cluster_buffer_desc;
+  cluster_buffer_desc.Usage = D3D11_USAGE_DYNAMIC;
+  cluster_buffer_desc.ByteWidth = sizeof(sz::ClusterBufferType);
+  cluster_buffer_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  cluster_buffer_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+  cluster_buffer_desc.MiscFlags = 0;
+  cluster_buffer_desc.StructureByteStride = 0;
+  cluster_buf_ = buf_man->CreateD3D11ConstBuffer("cluster_buffer",
+    cluster_buffer_desc, dev);
+  assert(cluster_buf_ != nullptr);
+
+  // Setup the buffer of the lights of each draw
+  D3D11_BUFFER_DESC draw_light_buffer_desc;
+  draw_light_buffer_desc.Usage = D3D11_USAGE_DYNAMIC;
+  draw_light_buffer_desc.ByteWidth = sizeof(sz::DrawLightBufferType);
+  draw_light_buffer_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  draw_light_buffer_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+  draw_light_buffer_desc.MiscFlags = 0;
+  draw_light_buffer_desc.StructureByteStride = 0;
+  draw_light_buf_ = buf_man->CreateD3D11ConstBuffer("draw_light_buffer",
+    draw_light_buffer_desc, dev);
+  assert(draw_light_buf_ != nullptr);
+
+  // Setup the buffer of the tiles of the shadow maps
+  D3D11_BUFFER_DESC shadow_atlas_buffer_desc;
+  shadow_atlas_buffer_desc.Usage = D3D11_USAGE_DYNAMIC;
+  shadow_atlas_buffer_desc.ByteWidth = sizeof(sz::ShadowAtlasBufferType);
+  shadow_atlas_buffer_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  shadow_atlas_buffer_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+  shadow_atlas_buffer_desc.MiscFlags = 0;
+  shadow_atlas_buffer_desc.StructureByteStride = 0;
+  shadow_atlas_buf_ = buf_man->CreateD3D11ConstBuffer("shadow_atlas_buffer",
+    shadow_atlas_buffer_desc, dev);
+  assert(shadow_atlas_buf_ != nullptr);
 }
 
-void Renderer::SetFrameParameters(ID3D11DeviceContext* deviceContext,
-    std::vector<Light> &lights, Camera *cam) {
-  HRESULT result;
+// Write data to a dynamic constant buffer
+template <typename T>
+static void WriteConstantBuffer(ID3D11Buffer *buffer, const T &data) {
   D3D11_MAPPED_SUBRESOURCE mapped_resource;
-  sz::LightBufferType* light_ptr;
-  sz::CamBufferType* camPtr;
+  if (SUCCEEDED(sz::StateCache::Inst()->Map(buffer, 0,
+    D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource))) {
+    memcpy(mapped_resource.pData, &data, sizeof(T));
+    sz::StateCache::Inst()->Unmap(buffer, 0);
+  }
+}
+
+void Renderer::SelectDrawLights(const XMMATRIX &model_transform) {
+  draw_lights_count_ = 0;
+  draw_lights_truncated_ = 0;
+  if (!draw_lights_check_) {
+    draw_lights_.clear();
+    return;
+  }
+
+  draw_lights_.resize(draw_list_.size());
+  for (size_t i = 0; i < draw_list_.size(); ++i) {
+    const DrawItem &draw = draw_list_.item(i);
+    DrawLightBufferType &data = draw_lights_[i];
+    memset(&data, 0, sizeof(data));
+    data.count = kNoDrawLights;
+
+    // Instances are spread over their meshes, and meshes without bounds
+    // may be anywhere; both keep the lists of their clusters
+    if (draw.instance_count > 0 || draw.mesh->cull_index() == kNoMeshBounds) {
+      continue;
+    }
+
+    XMFLOAT3 centre, extents;
+    mesh_bounds_.Get(draw.mesh->cull_index(), centre, extents);
+    if (draw.model != nullptr) {
+      XMFLOAT3 model_centre = centre;
+      XMFLOAT3 model_extents = extents;
+      TransformBox(model_centre, model_extents, model_transform, centre,
+        extents);
+    }
+
+    UInt32 reached = 0;
+    data.count = light_selector_.Select(centre, extents, data.indices,
+      &reached);
+    ++draw_lights_count_;
+    if (reached > data.count) {
+      ++draw_lights_truncated_;
+    }
+  }
+}
+
+void Renderer::SetDrawLights(const DrawLightBufferType &draw_lights) {
+  WriteConstantBuffer(draw_light_buf_, draw_lights);
+  sz::StateCache::Inst()->PSSetConstantBuffers(3, 1, &draw_light_buf_);
+}
+
+void Renderer::SetFrameParameters(ID3D11DeviceContext* deviceContext,
+    const LightSystem &lights, Camera *cam) {
   unsigned int bufferNumber;
 
-  // Send light data to pixel and vertex shader
-  result = deviceContext->Map(light_buff_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-  light_ptr = (sz::LightBufferType*)mapped_resource.pData;
-  for (unsigned int i = 0; i < lights.size(); i++) {
-    light_ptr[i].diffuse = lights[i].GetDiffuseColour();
-    light_ptr[i].ambient = lights[i].GetAmbientColour();
-    light_ptr[i].direction = XMFLOAT4(lights[i].GetDirection().x, 
-      lights[i].GetDirection().y, lights[i].GetDirection().z, 0.f);
-    light_ptr[i].specular = lights[i].GetSpecularColour();
-    light_ptr[i].specular_power = lights[i].GetSpecularPower();
-    light_ptr[i].attenuation = XMFLOAT4(lights[i].GetAttenuation().x, 
-      lights[i].GetAttenuation().y, lights[i].GetAttenuation().z, 1.0);
-    light_ptr[i].range = lights[i].GetRange();
-    light_ptr[i].position = lights[i].GetPosition4();
-    light_ptr[i].active = static_cast<unsigned int>(lights[i].active());
-    light_ptr[i].spot_cutoff = lights[i].spot_cutoff();
-    light_ptr[i].spot_exponent = lights[i].spot_exponent();
-    light_ptr[i].view = XMMatrixTranspose(lights[i].GetViewMatrix());
-    light_ptr[i].proj = XMMatrixTranspose(lights[i].GetProjectionMatrix());
-  }
-  deviceContext->Unmap(light_buff_, 0);
+  // The buffers are only written when their values changed. Writes which go
+  // to a constant ring always happen, as it starts empty every frame, and
+  // leave the buffers themselves out of date.
+  bool to_ring = sz::StateCache::Inst()->constant_ring() != nullptr;
+
+  // Send light data to pixel and vertex shader. The values of the lights
+  // are only gathered again when they changed; which maps are sampled, and
+  // with which matrices, may change every frame.
+  sz::LightBufferType light_data[kNumLights];
+  if (light_data_.size() != sizeof(light_data) ||
+    light_data_version_ != lights.version()) {
+    memset(light_data, 0, sizeof(light_data));
+    for (UInt32 i = 0; i < shadow_light_count(lights); i++) {
+      const XMFLOAT3 direction = lights.direction(i);
+      const XMFLOAT3 &attenuation = lights.attenuation(i);
+      light_data[i].diffuse = lights.diffuse(i);
+      light_data[i].ambient = lights.ambient(i);
+      light_data[i].direction = XMFLOAT4(direction.x, direction.y,
+        direction.z, 0.f);
+      light_data[i].specular = lights.specular(i);
+      light_data[i].specular_power = lights.specular_power(i);
+      light_data[i].attenuation = XMFLOAT4(attenuation.x, attenuation.y,
+        attenuation.z, 1.f);
+      light_data[i].range = lights.range(i);
+      light_data[i].position = lights.position4(i);
+      light_data[i].active = static_cast<unsigned int>(lights.active(i));
+      light_data[i].spot_cutoff = lights.spot_cutoff(i);
+      light_data[i].spot_exponent = lights.spot_exponent(i);
+    }
+    light_data_version_ = lights.version();
+  }
+  else {
+    memcpy(light_data, &light_data_[0], sizeof(light_data));
+  }
+  for (UInt32 i = 0; i < shadow_light_count(lights); i++) {
+    // Maps which are waiting for their turn are sampled as they were
+    // rendered
+    XMMATRIX view, proj;
+    if (i < shadow_lights_.size() && shadow_cache_.valid(i) &&
+      lights.casts_shadows(i)) {
+      light_data[i].shadow_map = 1;
+      view = XMLoadFloat4x4(&shadow_cache_.view(i));
+      proj = XMLoadFloat4x4(&shadow_cache_.proj(i));
+    }
+    else {
+      light_data[i].shadow_map = 0;
+      view = XMLoadFloat4x4(&lights.view(i));
+      proj = XMLoadFloat4x4(&lights.projection(i));
+    }
+    light_data[i].view = XMMatrixTranspose(view);
+    light_data[i].proj = XMMatrixTranspose(proj);
+    // Vertex shaders read the product with the world matrix of each draw
+    transform_batch_.SetLight(i, view, proj);
+  }
+  // And so do the draws outside the batch
+  BaseShader::set_light_transforms(
+    transform_batch_.lights_view_projection());
+  if (to_ring || !frame_data_valid_ || light_data_.size() !=
+    sizeof(light_data) || memcmp(light_data, &light_data_[0],
+    sizeof(light_data)) != 0) {
+    WriteConstantBuffer(light_buff_, light_data);
+    const UInt8 *bytes = reinterpret_cast<const UInt8 *>(light_data);
+    light_data_.assign(bytes, bytes + sizeof(light_data));
+  }
   bufferNumber = 0;
-  deviceContext->PSSetConstantBuffers(bufferNumber, 1, &light_buff_);
-  deviceContext->VSSetConstantBuffers(2, 1, &light_buff_);
-  deviceContext->DSSetConstantBuffers(2, 1, &light_buff_);
+  sz::StateCache::Inst()->PSSetConstantBuffers(bufferNumber, 1, &light_buff_);
+  sz::StateCache::Inst()->VSSetConstantBuffers(2, 1, &light_buff_);
+  sz::StateCache::Inst()->DSSetConstantBuffers(2, 1, &light_buff_);
 
+  // Lights of the clusters, as uploaded by UpdateLightClusters
+  sz::StateCache::Inst()->PSSetConstantBuffers(2, 1, &cluster_buf_);
+  ID3D11ShaderResourceView *cluster_views[] = { cluster_light_view_,
+    cluster_grid_view_, cluster_index_view_ };
+  sz::StateCache::Inst()->PSSetShaderResources(8, 3, cluster_views);
 
   // Tessellation buffer
-  result = deviceContext->Map(tessellation_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0,
-    &mapped_resource);
-  sz::TessellationFactorBufferType *tes_ptr =
-    (sz::TessellationFactorBufferType *)mapped_resource.pData;
-  tes_ptr->max_tessellation_factor = tessellation_value;
-  tes_ptr->tessellation_distance = tessellation_distance;
-  deviceContext->Unmap(tessellation_buf_, 0);
+  sz::TessellationFactorBufferType tessellation_data;
+  memset(&tessellation_data, 0, sizeof(tessellation_data));
+  tessellation_data.max_tessellation_factor = tessellation_value;
+  tessellation_data.tessellation_distance = tessellation_distance;
+  if (to_ring || !frame_data_valid_ || memcmp(&tessellation_data,
+    &tessellation_data_, sizeof(tessellation_data)) != 0) {
+    WriteConstantBuffer(tessellation_buf_, tessellation_data);
+    tessellation_data_ = tessellation_data;
+  }
   
   // Send camera data 
-  result = deviceContext->Map(camera_buff_, 0, D3D11_MAP_WRITE_DISCARD, 0,
-    &mapped_resource);
-  camPtr = (sz::CamBufferType*)mapped_resource.pData;
-  camPtr->camPos = cam->GetPosition();
-  deviceContext->Unmap(camera_buff_, 0);
+  sz::CamBufferType camera_data;
+  memset(&camera_data, 0, sizeof(camera_data));
+  camera_data.camPos = cam->GetPosition();
+  if (to_ring || !frame_data_valid_ ||
+    memcmp(&camera_data, &camera_data_, sizeof(camera_data)) != 0) {
+    WriteConstantBuffer(camera_buff_, camera_data);
+    camera_data_ = camera_data;
+  }
   bufferNumber = 1;
-  deviceContext->VSSetConstantBuffers(bufferNumber, 1, &camera_buff_);
-  deviceContext->DSSetConstantBuffers(bufferNumber, 1, &camera_buff_);
-  deviceContext->HSSetConstantBuffers(0, 1, &camera_buff_);
-  deviceContext->HSSetConstantBuffers(1, 1, &tessellation_buf_);
+  sz::StateCache::Inst()->VSSetConstantBuffers(bufferNumber, 1, &camera_buff_);
+  sz::StateCache::Inst()->DSSetConstantBuffers(bufferNumber, 1, &camera_buff_);
+  sz::StateCache::Inst()->HSSetConstantBuffers(0, 1, &camera_buff_);
+  sz::StateCache::Inst()->HSSetConstantBuffers(1, 1, &tessellation_buf_);
 
   // Time buffer
-  result = deviceContext->Map(time_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0,
-    &mapped_resource);
-  sz::TimeBufferType  *time_ptr =
-    (sz::TimeBufferType*)mapped_resource.pData;
-  time_ptr->time = timer_.GetCurrTime() * 0.00001;
-  time_ptr->amplitude = waves_amplitude;
-  time_ptr->speed = waves_frequency;
-  deviceContext->Unmap(time_buf_, 0);
-  deviceContext->VSSetConstantBuffers(3, 1, &time_buf_);
-
-  // Set shader resources for shadow maps
-  for (size_t i = 0; i < kNumLights; ++i) {
-    ID3D11ShaderResourceView * texture = 
-      Texture::Inst()->GetTexture(render_targets_depth_[i]->name_crc());
-    deviceContext->PSSetShaderResources(4 + i, 1, &texture);
+  sz::TimeBufferType time_data;
+  memset(&time_data, 0, sizeof(time_data));
+  time_data.time = timer_.GetCurrTime() * 0.00001;
+  time_data.amplitude = waves_amplitude;
+  time_data.speed = waves_frequency;
+  if (to_ring || !frame_data_valid_ ||
+    memcmp(&time_data, &time_data_, sizeof(time_data)) != 0) {
+    WriteConstantBuffer(time_buf_, time_data);
+    time_data_ = time_data;
+  }
+  sz::StateCache::Inst()->VSSetConstantBuffers(3, 1, &time_buf_);
+
+  // Tiles of the shadow maps in the atlas, as scale, offset and the half
+  // texel their samples keep away from the edges
+  sz::ShadowAtlasBufferType shadow_atlas_data;
+  memset(&shadow_atlas_data, 0, sizeof(shadow_atlas_data));
+  const float atlas_size = static_cast<float>(shadow_atlas_.size());
+  for (size_t i = 0; i < kNumLights && i < shadow_lights_.size(); ++i) {
+    const ShadowTile &tile = shadow_atlas_.tile(i);
+    if (tile.size == 0) {
+      continue;
+    }
+    shadow_atlas_data.tiles[i] = XMFLOAT4(
+      static_cast<float>(tile.size) / atlas_size,
+      static_cast<float>(tile.x) / atlas_size,
+      static_cast<float>(tile.y) / atlas_size,
+      0.5f / static_cast<float>(tile.size));
   }
+  if (to_ring || !frame_data_valid_ || memcmp(&shadow_atlas_data,
+    &shadow_atlas_data_, sizeof(shadow_atlas_data)) != 0) {
+    WriteConstantBuffer(shadow_atlas_buf_, shadow_atlas_data);
+    shadow_atlas_data_ = shadow_atlas_data;
+  }
+  sz::StateCache::Inst()->PSSetConstantBuffers(5, 1, &shadow_atlas_buf_);
+  frame_data_valid_ = !to_ring;
+
+  // Set shader resource for the shadow maps
+  ID3D11ShaderResourceView *shadow_atlas_view = Texture::Inst()->GetTexture(
+    shadow_atlas_target_->texture_handle());
+  sz::StateCache::Inst()->PSSetShaderResources(4, 1, &shadow_atlas_view);
 }
 
 } // namespace sz
\ No newline at end of file
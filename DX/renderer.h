@@ -11,6 +11,17 @@
 #include "Material.h"
 #include "BaseMesh.h"
 #include "abertay_framework.h"
+#include "buffer_types.h"
+#include "draw_list.h"
+#include "mesh_bounds.h"
+#include "shadow_cache.h"
+#include "shadow_atlas.h"
+#include "shadow_fit.h"
+#include "transform_batch.h"
+#include "frame_graph.h"
+#include "light_clusters.h"
+#include "light_selector.h"
+#include "light_system.h"
 #include <directxmath.h>
 
 class RenderTexture;
@@ -18,24 +29,43 @@ class OrthoMesh;
 class D3D;
 class Camera;
 struct ID3D11Device;
-class Light;
+struct ID3D11ShaderResourceView;
 class Model;
 class Timer;
 namespace sz {
   class ConstBufManager;
   class ShaderManager;
   class PostProcess;
+  class OcclusionCuller;
+  class WorkerPool;
 }
 
 namespace sz{
 
+// Meshes of a pass which passed culling
+struct CullResult {
+  // 1 for each mesh which may be visible, by cull index
+  std::vector<UInt8> visible;
+  UInt32 visible_count;
+  UInt32 culled_count;
+  // Of those in the frustum, how many were hidden by occluders
+  UInt32 occluded_count;
+
+  CullResult() :
+    visible(),
+    visible_count(0),
+    culled_count(0),
+    occluded_count(0) {}
+};
+
 class Renderer {
 public:
   // Ctor
   Renderer(const unsigned int scr_height, const unsigned int scr_width,
     const float scr_depth, const float scr_near, ID3D11Device* device,
     HWND hwnd, ConstBufManager *buf_man, ShaderManager *sha_man,
-    const size_t lights_num, const Timer &timer);
+    const size_t lights_num, const UInt32 shadow_atlas_size,
+    const Timer &timer);
 
   // Dtor
   virtual ~Renderer();
@@ -46,11 +76,16 @@ public:
   void AddModel(Model *model);
   void AddMeshesAndMaterials(std::vector<BaseMesh *> &meshes,
     const std::vector<Material> &materials);
-  virtual void Render(D3D *d3d, Camera *cam, std::vector<Light> *lights) = 0;
+  virtual void Render(D3D *d3d, Camera *cam, LightSystem *lights) = 0;
 
   // Called when it's necessary to switch to using tessellation
   virtual void UpdateTessellation(ID3D11DeviceContext* deviceContext) {};
   virtual void UpdateVertexManipulation(ID3D11DeviceContext *deviceContext) {};
+
+  // Cook the diffuse textures of the models added so far into virtual
+  // textures, which the lit shaders sample instead of the full ones
+  virtual void UseVirtualTextures(ID3D11Device *device,
+    ID3D11DeviceContext *dev_context) {};
   inline bool IsChangeTessellationNecessary() const {
     return prev_tessellate_check_value_ != tessellate_check_;
   }
@@ -88,11 +123,138 @@ protected:
   // Models batch meshes by material internally
   std::vector<Model *> models_;
 
+  // Draws of the current frame, rebuilt and sorted every frame
+  DrawList draw_list_;
+
+  // Bounds of all the meshes: those of models in model space, the others in
+  // world space. Ranges of the same space are culled together.
+  struct BoundsRange {
+    UInt32 begin;
+    UInt32 end;
+    bool model_space;
+  };
+  MeshBounds mesh_bounds_;
+  std::vector<BoundsRange> bounds_ranges_;
+
+  // Whether to skip the meshes outside of the frustums
+  bool cull_check_;
+  // Culling of the main pass, and of the depth pass of each light; kept
+  // apart so that passes can be recorded at the same time
+  CullResult camera_cull_;
+  std::vector<CullResult> light_culls_;
+  // Occlusion culling of the main pass, against the largest opaque meshes
+  // of the models; ready once the occluders were rendered this frame
+  OcclusionCuller *occlusion_culler_;
+  bool occlusion_check_;
+  bool occlusion_ready_;
+
+  // Meshes added on their own which share buffers, material and shader are
+  // drawn as instances, from a buffer rewritten every frame
+  bool instancing_check_;
+  ID3D11Buffer *instance_buf_;
+  std::vector<InstanceType> instances_;
+  std::vector<BaseMesh *> instance_scratch_;
+  UInt32 instanced_mesh_count_;
+  UInt32 instanced_draw_count_;
+
+  // Matrices of the draws of the main pass, worked out together once the
+  // draws are sorted; the entry of each draw, in draw list order
+  TransformBatch transform_batch_;
+  std::vector<UInt32> draw_transforms_;
+
+  // Whether each light renders its shadow map this frame
+  std::vector<UInt8> shadow_lights_;
+
+  // Shadow maps are kept between frames, and only the dirty ones are
+  // rendered, at most shadow_budget_ of them per frame
+  ShadowCache shadow_cache_;
+  int shadow_budget_;
+  // Of the lights which may render their map, by how much they matter
+  std::vector<UInt8> shadow_candidates_;
+  std::vector<float> shadow_priorities_;
+  // Where casters which moved this frame were and are, in world space
+  struct MovedBox {
+    XMFLOAT3 centre;
+    XMFLOAT3 extents;
+  };
+  std::vector<MovedBox> moved_casters_;
+  // Whether the maps were rendered with manipulated vertices
+  bool shadows_manip_;
+
+  // The maps are tiles of one atlas, sized every frame by how much of the
+  // screen each light may cover; the texels each light would like
+  ShadowAtlas shadow_atlas_;
+  std::vector<float> shadow_wanted_;
+  // Lights whose tile moved in the last frame
+  UInt32 shadow_moved_count_;
+
+  // Whether the frustums of the maps are fitted to what the camera sees;
+  // projections the maps are rendered with, and whether each was fitted
+  bool shadow_fit_check_;
+  ShadowFitter shadow_fitter_;
+  std::vector<XMFLOAT4X4> shadow_projections_;
+  std::vector<UInt8> shadow_fitted_;
+  // Meshes the camera may see, and those in the reach of the light being
+  // fitted, by cull index
+  CullResult fit_camera_cull_;
+  CullResult fit_light_cull_;
+  // Mean of how many times more texels cover what the fitted maps hold
+  float shadow_fit_gain_;
+  // Frustum each map was last fitted to, and its gain, for the UI
+  std::vector<ShadowFrustum> shadow_frusta_;
+  std::vector<float> shadow_fit_gains_;
+  // Tile of each light, as read by the pixel shaders
+  ID3D11Buffer *shadow_atlas_buf_;
+  ShadowAtlasBufferType shadow_atlas_data_;
+
+  // Active lights are binned into clusters of the view every frame, and the
+  // lighting shaders only loop over the lights of their pixel's cluster
+  LightClusters *light_clusters_;
+  std::vector<ClusterSphere> cluster_spheres_;
+  // Scene index of each binned light, and its sphere in world space; both
+  // are only gathered again when the lights changed, and the spheres moved
+  // into view every frame
+  std::vector<UInt32> cluster_lights_;
+  std::vector<ClusterSphere> cluster_world_spheres_;
+  // Version of the lights the lights of the clusters were gathered from
+  UInt32 cluster_lights_version_;
+  bool cluster_lights_valid_;
+  // Lights, offset and count of the list of each cluster, and the lists,
+  // read by the pixel shaders through views
+  ID3D11Buffer *cluster_light_buf_;
+  ID3D11Buffer *cluster_grid_buf_;
+  ID3D11Buffer *cluster_index_buf_;
+  ID3D11ShaderResourceView *cluster_light_view_;
+  ID3D11ShaderResourceView *cluster_grid_view_;
+  ID3D11ShaderResourceView *cluster_index_view_;
+  ID3D11Buffer *cluster_buf_;
+  // Lights as they were uploaded, in the order of the lists
+  std::vector<ClusterLightType> cluster_light_data_;
+
+  // Draws of the main pass may instead be given the few lights which add
+  // the most at their bounds, so that they only pay for those; the lights
+  // of each draw, in draw list order
+  LightSelector light_selector_;
+  bool draw_lights_check_;
+  std::vector<DrawLightBufferType> draw_lights_;
+  ID3D11Buffer *draw_light_buf_;
+  // Of the last main pass, draws given their own lights, and those which
+  // were reached by more lights than fit
+  UInt32 draw_lights_count_;
+  UInt32 draw_lights_truncated_;
+
+  // Passes of the frame, declared again every frame. The targets of the
+  // scene and of post processing are transient, and are taken from the
+  // graph's pool; shadow maps are kept between frames, so they are imported.
+  FrameGraph *frame_graph_;
+  // Size, formats and projection of the full screen targets
+  RenderTextureDesc screen_target_desc_;
+  XMFLOAT4X4 screen_projection_;
+
   // Shared by all the rendering modes
-  RenderTexture *render_target_main_;
   RenderTexture *render_target_depth_;
-  std::vector<RenderTexture *> render_targets_depth_;
-  const size_t depth_target_w_, depth_target_h_;
+  // Shadow maps of all the lights
+  RenderTexture *shadow_atlas_target_;
   OrthoMesh *ortho_mesh_screen_;
   Material *render_target_main_mat_;
 
@@ -100,11 +262,25 @@ protected:
   ShaderManager *sha_man_;
   ConstBufManager *buf_man_;
 
+  // IDs of the shaders used by the renderer itself
+  const NameId texture_shader_id_;
+  const NameId depth_shader_id_;
+
   // Per-frame buffers
   ID3D11Buffer* light_buff_;
   ID3D11Buffer* camera_buff_;
   ID3D11Buffer* tessellation_buf_;
   ID3D11Buffer* time_buf_;
+  // What the buffers above hold, if valid, so that unchanged values are not
+  // written again
+  TessellationFactorBufferType tessellation_data_;
+  CamBufferType camera_data_;
+  TimeBufferType time_data_;
+  bool frame_data_valid_;
+  // What the buffer of the lights holds, as bytes, as XMMATRIX is not
+  // aligned on the heap; and the version of the lights it was gathered from
+  std::vector<UInt8> light_data_;
+  UInt32 light_data_version_;
 
   // Reference to the app timer
   const Timer &timer_;
@@ -117,9 +293,96 @@ protected:
   void SetupPerFrameBuffers(ID3D11Device *dev, ConstBufManager *buf_man,
     size_t lights_num);
 
+  // Fill the draw list with the meshes of all the models, drawn with
+  // model_transform, and of all the meshes added on their own which passed
+  // culling; depths are taken from view
+  void BuildDrawList(const XMMATRIX &model_transform, const XMMATRIX &view,
+    const CullResult &cull);
+
+  // Add draws for the meshes in instance_scratch_, one for each set of
+  // meshes which share their buffers; meshes alone in their set, or which
+  // do not fit in the instance buffer, are drawn on their own
+  void AddInstancedDraws(const Material *mat, BaseShader *shader,
+    UInt32 material_id, const XMMATRIX &view);
+
+  // Copy the instances of the draw list to the instance buffer
+  void UploadInstances();
+
+  // Add the bounds of a mesh, if it has any
+  void AddMeshBounds(BaseMesh &mesh, bool model_space);
+
+  // Move the bounds of the meshes which do not belong to a model to where
+  // their transforms put them, and note the casters which moved
+  void UpdateMeshBounds();
+
+  // Test all the meshes against the frustum of view_proj; those of models
+  // are drawn with model_transform
+  void CullMeshes(const XMMATRIX &model_transform, const XMMATRIX &view_proj,
+    CullResult &result) const;
+
+  // Pick the simplest large opaque meshes of a model as occluders, within a
+  // budget of triangles
+  void AddOccluders(Model &model);
+
+  // Rasterise the occluders as seen by the camera, on the workers if given
+  void RenderOccluders(const XMMATRIX &model_transform,
+    const XMMATRIX &view_proj, WorkerPool *workers);
+
+  // Mark the meshes which passed culling but are hidden behind the
+  // occluders as not visible; does nothing if the occluders were not
+  // rendered this frame
+  void OccludeMeshes(const XMMATRIX &model_transform,
+    const XMMATRIX &view_proj, CullResult &result) const;
+
+  // Pick the lights which render shadow maps this frame: active ones with a
+  // shadow, which reach into the view of the camera and whose cached map is
+  // dirty, within the budget. The frustums of their maps are fitted to what
+  // the camera sees of their reach first.
+  void SelectShadowLights(const LightSystem &lights, Camera *cam,
+    const XMMATRIX &model_transform);
+
+  // Fit the frustum of the map of a light to the meshes the camera sees in
+  // its reach, and to those in front of them, into shadow_projections_.
+  // Returns how many times more texels cover the fitted frustum.
+  float FitShadowFrustum(const LightSystem &lights, UInt32 light,
+    const XMMATRIX &model_transform);
+
+  // Gather the active lights and their spheres in world space, and upload
+  // them
+  void GatherClusterLights(const LightSystem &lights);
+
+  // Bin the active lights into the clusters of the camera's view, on the
+  // workers if given, and upload the lists; the lights themselves are only
+  // uploaded when they changed
+  void UpdateLightClusters(const LightSystem &lights, Camera *cam,
+    WorkerPool *workers);
+
+  // Pick the lights of each draw of the draw list, from the lights of the
+  // clusters, if draw_lights_check_ is set; meshes of models are drawn with
+  // model_transform
+  void SelectDrawLights(const XMMATRIX &model_transform);
+
+  // Bind the lights of a draw to b3 of the pixel shader
+  void SetDrawLights(const DrawLightBufferType &draw_lights);
+
+  // Lights which may have a shadow map
+  inline size_t shadow_light_count(const LightSystem &lights) const {
+    return lights.count() < shadow_lights_.size() ?
+      lights.count() : shadow_lights_.size();
+  }
+
+  // Whether a mesh passed culling; meshes without bounds always do
+  inline bool IsVisible(const BaseMesh &mesh, const CullResult &cull) const {
+    return mesh.cull_index() == kNoMeshBounds ||
+      cull.visible[mesh.cull_index()] != 0;
+  }
+
+  // Make room in the draw list for all the meshes added so far
+  void ReserveDrawList();
+
   // Set per-frame parameters of shaders
   void SetFrameParameters(ID3D11DeviceContext* deviceContext,
-    std::vector<Light> &lights, Camera *cam);
+    const LightSystem &lights, Camera *cam);
 
 }; // class Renderer
 
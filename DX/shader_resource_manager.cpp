@@ -1,5 +1,6 @@
 
 #include "shader_resource_manager.h"
+#include "state_cache.h"
 #include <algorithm>
 
 
@@ -12,21 +13,24 @@ ShaderManager::ShaderManager() :
 ShaderManager::~ShaderManager() {
   // Run through every element and free them
   std::for_each(shaders_.begin(), shaders_.end(),
-    [&](std::pair<const std::string, BaseShader *> &n) {
-      delete n.second;
-      n.second = nullptr;
+    [&](BaseShader *&n) {
+      delete n;
+      n = nullptr;
   });
 }
 
 void ShaderManager::SetVertexManipulation(ID3D11DeviceContext* deviceContext,
   bool manipulate) {
   std::for_each(shaders_.begin(), shaders_.end(),
-    [&](std::pair<const std::string, BaseShader *> &n) {
+    [&](BaseShader *n) {
+    if (n == nullptr) {
+      return;
+    }
     if (manipulate) {
-      n.second->ActivateWavesDeformation(deviceContext);
+      n->ActivateWavesDeformation(deviceContext);
     }
     else {
-      n.second->DeactivateWavesDeformation(deviceContext);
+      n->DeactivateWavesDeformation(deviceContext);
     }
   });
 
@@ -43,16 +47,19 @@ bool ShaderManager::AddShader(const std::string &name, BaseShader *s) {
     return false;
   }
 
-  // Look up the map to check if the shader has already been created
-  std::unordered_map<std::string, BaseShader *>::const_iterator it = shaders_.find(name);
-  // If the buffer already exists 
-  if (it != shaders_.end()) {
+  NameId id = NameInterner::Inst()->Intern(name);
+
+  // Check if the shader has already been created
+  if (id < shaders_.size() && shaders_[id] != nullptr) {
     // Inform that the operation didn' work out
     return false;
   }
 
-  // Add buffer to list
-  shaders_[name] = s;
+  // Add shader to list
+  if (id >= shaders_.size()) {
+    shaders_.resize(id + 1, nullptr);
+  }
+  shaders_[id] = s;
 
   return true;
 }
@@ -64,21 +71,13 @@ BaseShader *ShaderManager::GetShader(const std::string &name) {
     return nullptr;
   }
   
-  // Look up the map to check if the shader has already been created
-  std::unordered_map<std::string, BaseShader *>::const_iterator it = shaders_.find(name);
-  // If the buffer already exists 
-  if (it != shaders_.end()) {
-    return it->second;
-  }
-
-  return nullptr;
+  return GetShader(NameInterner::Inst()->Find(name));
 
 }
 
 void ShaderManager::CleanupShaderResources(ID3D11DeviceContext* deviceContext) {
-  for (auto shader : shaders_) {
-    shader.second->CleanupTextures(deviceContext);
-  }
+  // Resources are bound to the context, not to the shaders, so once is enough
+  StateCache::Inst()->PSUnbindShaderResources();
 }
 
 } // namespace sz
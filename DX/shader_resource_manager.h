@@ -1,9 +1,7 @@
 //  A shader manager class which manages the shaders needed by materials 
 //  * Shaders are passed this class
-//  * They ask this class for the buffer with a given name (string)
-//  * The class looks up for the buffer with that name
-//    * If already created, return the handle
-//    * If not created, create it and return the handle
+//  * Shaders are added with a name, which is interned to a NameId
+//  * Per-frame code retrieves shaders by NameId, an index into an array
 
 #ifndef _SHADER_RESOURCE_MANAGER_H
 #define _SHADER_RESOURCE_MANAGER_H
@@ -13,15 +11,17 @@
 #include <D3Dcompiler.h>
 #include <DirectXMath.h>
 #include <string>
-#include <unordered_map>
+#include <vector>
 #include "BaseShader.h"
+#include "name_interner.h"
 
 namespace sz {
   
 class ShaderManager {
 private:
-  // The map of shaders relatively to their assigned name
-  std::unordered_map<std::string, BaseShader*> shaders_;
+  // The shaders indexed by the ID of their assigned name; IDs of names
+  // which are not shaders hold nullptr
+  std::vector<BaseShader *> shaders_;
 
 public:
   // Ctor
@@ -37,8 +37,16 @@ public:
   // Add a new shader
   bool AddShader(const std::string &name, BaseShader *s);
 
-  // Get ref to a shader
+  // Get ref to a shader; resolve names to IDs once and use the ID version
+  // in per-frame code
   BaseShader *GetShader(const std::string &name);
+  inline BaseShader *GetShader(NameId id) const {
+    if (id < shaders_.size()) {
+      return shaders_[id];
+    }
+
+    return nullptr;
+  }
 
   void CleanupShaderResources(ID3D11DeviceContext* deviceContext);
   void SetVertexManipulation(ID3D11DeviceContext* deviceContext, bool manipulate);
@@ -0,0 +1,274 @@
+#include "shadow_atlas.h"
+#include <algorithm>
+#include <cassert>
+
+namespace sz {
+
+// A tile only shrinks once the light wants at most this much of its size;
+// it would be halved at 0.5 otherwise
+const float kShadowTileShrink = 0.35f;
+
+static UInt32 PackBlock(UInt32 x, UInt32 y) {
+  return (x << 16) | y;
+}
+
+static UInt32 LevelCount(UInt32 size, UInt32 min_tile) {
+  UInt32 count = 1;
+  while (min_tile < size) {
+    min_tile <<= 1;
+    ++count;
+  }
+  return count;
+}
+
+ShadowAtlas::ShadowAtlas(UInt32 size, UInt32 min_tile, size_t lights_num) :
+    size_(size),
+    min_tile_(min_tile),
+    level_count_(LevelCount(size, min_tile)),
+    free_blocks_(level_count_),
+    tiles_(lights_num),
+    prev_tiles_(lights_num),
+    sizes_(lights_num, 0),
+    moved_(lights_num, 0),
+    order_(),
+    used_texels_(0),
+    dropped_count_(0),
+    repacked_(false) {
+  // Blocks are packed in 16 bits per coordinate
+  assert(size_ <= 0x10000 && min_tile_ > 0 && min_tile_ <= size_);
+  for (ShadowTile &tile : tiles_) {
+    tile.x = 0;
+    tile.y = 0;
+    tile.size = 0;
+  }
+  order_.reserve(lights_num);
+  ResetBlocks();
+}
+
+UInt32 ShadowAtlas::level_of(UInt32 tile_size) const {
+  UInt32 level = 0;
+  while ((size_ >> level) > tile_size) {
+    ++level;
+  }
+  return level;
+}
+
+void ShadowAtlas::ResetBlocks() {
+  for (std::vector<UInt32> &blocks : free_blocks_) {
+    blocks.clear();
+  }
+  free_blocks_[0].push_back(PackBlock(0, 0));
+}
+
+bool ShadowAtlas::AllocBlock(UInt32 level, UInt32 *x, UInt32 *y) {
+  // The smallest free block which is large enough
+  UInt32 from = level + 1;
+  while (from > 0 && free_blocks_[from - 1].empty()) {
+    --from;
+  }
+  if (from == 0) {
+    return false;
+  }
+  --from;
+
+  // Of those, the one nearest the top left, so that tiles stay together
+  std::vector<UInt32> &blocks = free_blocks_[from];
+  std::vector<UInt32>::iterator first = std::min_element(blocks.begin(),
+    blocks.end(), [](UInt32 a, UInt32 b) {
+    return (a & 0xFFFF) != (b & 0xFFFF) ? (a & 0xFFFF) < (b & 0xFFFF) :
+      a < b;
+  });
+  UInt32 bx = *first >> 16;
+  UInt32 by = *first & 0xFFFF;
+  blocks.erase(first);
+
+  // Split it down to the level, freeing all but the top left quarter
+  for (UInt32 l = from; l < level; ++l) {
+    UInt32 half = size_ >> (l + 1);
+    free_blocks_[l + 1].push_back(PackBlock(bx + half, by));
+    free_blocks_[l + 1].push_back(PackBlock(bx, by + half));
+    free_blocks_[l + 1].push_back(PackBlock(bx + half, by + half));
+  }
+
+  *x = bx;
+  *y = by;
+  return true;
+}
+
+void ShadowAtlas::FreeBlock(UInt32 level, UInt32 x, UInt32 y) {
+  while (level > 0) {
+    UInt32 block = size_ >> level;
+    UInt32 px = x - x % (block * 2);
+    UInt32 py = y - y % (block * 2);
+    UInt32 siblings[4] = { PackBlock(px, py), PackBlock(px + block, py),
+      PackBlock(px, py + block), PackBlock(px + block, py + block) };
+
+    // Merged with the other three quarters of its parent, if they are free
+    std::vector<UInt32> &blocks = free_blocks_[level];
+    UInt32 free_count = 0;
+    for (UInt32 sibling : siblings) {
+      if (sibling != PackBlock(x, y) &&
+        std::find(blocks.begin(), blocks.end(), sibling) != blocks.end()) {
+        ++free_count;
+      }
+    }
+    if (free_count < 3) {
+      break;
+    }
+    for (UInt32 sibling : siblings) {
+      std::vector<UInt32>::iterator found = std::find(blocks.begin(),
+        blocks.end(), sibling);
+      if (found != blocks.end()) {
+        blocks.erase(found);
+      }
+    }
+
+    x = px;
+    y = py;
+    --level;
+  }
+
+  free_blocks_[level].push_back(PackBlock(x, y));
+}
+
+void ShadowAtlas::FitSizes(const float *wanted) {
+  UInt64 area = 0;
+  for (size_t i = 0; i < tiles_.size(); ++i) {
+    sizes_[i] = 0;
+    if (!(wanted[i] > 0.f)) {
+      continue;
+    }
+
+    UInt32 tile_size = min_tile_;
+    while (tile_size < size_ && static_cast<float>(tile_size) < wanted[i]) {
+      tile_size <<= 1;
+    }
+
+    // Lights which only want a little less keep their tile
+    UInt32 current = tiles_[i].size;
+    if (tile_size < current &&
+      wanted[i] > kShadowTileShrink * static_cast<float>(current)) {
+      tile_size = current;
+    }
+
+    sizes_[i] = tile_size;
+    area += static_cast<UInt64>(tile_size) * tile_size;
+  }
+
+  // Halve the largest tile until they fit; of tiles as large, that of the
+  // light which wants the least, then the last
+  const UInt64 capacity = static_cast<UInt64>(size_) * size_;
+  while (area > capacity) {
+    size_t largest = tiles_.size();
+    for (size_t i = 0; i < tiles_.size(); ++i) {
+      if (sizes_[i] <= min_tile_) {
+        continue;
+      }
+      if (largest == tiles_.size() || sizes_[i] > sizes_[largest] ||
+        (sizes_[i] == sizes_[largest] && wanted[i] <= wanted[largest])) {
+        largest = i;
+      }
+    }
+    if (largest == tiles_.size()) {
+      break;
+    }
+
+    UInt64 tile_area = static_cast<UInt64>(sizes_[largest]) *
+      sizes_[largest];
+    area -= tile_area - tile_area / 4;
+    sizes_[largest] >>= 1;
+  }
+
+  // All tiles are as small as they get; the lights which want the least go
+  // without
+  while (area > capacity) {
+    size_t least = tiles_.size();
+    for (size_t i = 0; i < tiles_.size(); ++i) {
+      if (sizes_[i] != 0 &&
+        (least == tiles_.size() || wanted[i] <= wanted[least])) {
+        least = i;
+      }
+    }
+    area -= static_cast<UInt64>(sizes_[least]) * sizes_[least];
+    sizes_[least] = 0;
+    ++dropped_count_;
+  }
+
+  used_texels_ = area;
+}
+
+UInt32 ShadowAtlas::Allocate(const float *wanted) {
+  dropped_count_ = 0;
+  repacked_ = false;
+  prev_tiles_ = tiles_;
+
+  FitSizes(wanted);
+
+  // Tiles whose size changed are given back first, so that their room can
+  // be used by the others
+  order_.clear();
+  for (size_t i = 0; i < tiles_.size(); ++i) {
+    ShadowTile &tile = tiles_[i];
+    if (tile.size == sizes_[i]) {
+      continue;
+    }
+    if (tile.size != 0) {
+      FreeBlock(level_of(tile.size), tile.x, tile.y);
+      tile.size = 0;
+    }
+    if (sizes_[i] != 0) {
+      order_.push_back(static_cast<UInt32>(i));
+    }
+  }
+
+  // Largest first, so that small tiles do not split the blocks large ones
+  // need
+  std::stable_sort(order_.begin(), order_.end(),
+    [this](UInt32 a, UInt32 b) {
+    return sizes_[a] > sizes_[b];
+  });
+  for (UInt32 light : order_) {
+    ShadowTile &tile = tiles_[light];
+    if (!AllocBlock(level_of(sizes_[light]), &tile.x, &tile.y)) {
+      repacked_ = true;
+      break;
+    }
+    tile.size = sizes_[light];
+  }
+
+  // The free room is split up; all the tiles are placed again, which
+  // always succeeds as they fit and are placed largest first
+  if (repacked_) {
+    ResetBlocks();
+    order_.clear();
+    for (size_t i = 0; i < tiles_.size(); ++i) {
+      tiles_[i].size = 0;
+      if (sizes_[i] != 0) {
+        order_.push_back(static_cast<UInt32>(i));
+      }
+    }
+    std::stable_sort(order_.begin(), order_.end(),
+      [this](UInt32 a, UInt32 b) {
+      return sizes_[a] > sizes_[b];
+    });
+    for (UInt32 light : order_) {
+      ShadowTile &tile = tiles_[light];
+      bool placed = AllocBlock(level_of(sizes_[light]), &tile.x, &tile.y);
+      assert(placed);
+      tile.size = placed ? sizes_[light] : 0;
+    }
+  }
+
+  UInt32 moved_count = 0;
+  for (size_t i = 0; i < tiles_.size(); ++i) {
+    const ShadowTile &tile = tiles_[i];
+    const ShadowTile &prev = prev_tiles_[i];
+    moved_[i] = tile.size != prev.size ||
+      (tile.size != 0 && (tile.x != prev.x || tile.y != prev.y)) ? 1 : 0;
+    moved_count += moved_[i];
+  }
+
+  return moved_count;
+}
+
+} // namespace sz
@@ -0,0 +1,117 @@
+//  Shadow atlas
+//  * All shadow maps are square tiles of one depth texture, so that the
+//    memory of the shadows is fixed whatever the number of lights
+//  * Each frame, lights ask for the texels they would like, from how much
+//    of the screen they may cover; tiles are that rounded up to a power of
+//    two, between a minimum and the whole atlas
+//  * When the tiles do not fit, the largest one is halved until they do;
+//    if even the smallest tiles do not fit, the lights which asked for the
+//    least are left without one
+//  * Tiles only shrink once they are well too large, so that lights on the
+//    edge of a size do not go back and forth; lights whose size did not
+//    change keep their tile
+//  * Tiles are placed in a quadtree of free blocks, and the others are
+//    repacked, largest first, when a new tile does not fit anywhere; square
+//    tiles of powers of two always fit that way if their area does
+
+#ifndef _SHADOW_ATLAS_H
+#define _SHADOW_ATLAS_H
+
+#include <cstddef>
+#include <vector>
+#include "abertay_framework.h"
+
+namespace sz {
+
+// Where a tile lies in the atlas, in texels; lights without a tile have a
+// size of 0
+struct ShadowTile {
+  UInt32 x;
+  UInt32 y;
+  UInt32 size;
+};
+
+class ShadowAtlas {
+public:
+  // Ctor; the atlas is size texels wide and high, and its tiles no smaller
+  // than min_tile, both powers of two
+  ShadowAtlas(UInt32 size, UInt32 min_tile, size_t lights_num);
+
+  // Give each light a tile for the texels it would like, wanted[i]; lights
+  // which want 0 have no tile. Returns how many lights had their tile moved,
+  // resized or taken away, whose maps are lost.
+  UInt32 Allocate(const float *wanted);
+
+  inline const ShadowTile &tile(size_t light) const {
+    return tiles_[light];
+  }
+  // Whether the tile of a light changed in the last Allocate
+  inline bool moved(size_t light) const {
+    return moved_[light] != 0;
+  }
+
+  inline UInt32 size() const {
+    return size_;
+  }
+  inline UInt32 min_tile() const {
+    return min_tile_;
+  }
+
+  // Of the last Allocate: texels given to tiles, lights left without a
+  // tile for want of room, and whether all tiles were packed again
+  inline UInt64 used_texels() const {
+    return used_texels_;
+  }
+  inline UInt32 dropped_count() const {
+    return dropped_count_;
+  }
+  inline bool repacked() const {
+    return repacked_;
+  }
+
+  // Disable ctors
+  ShadowAtlas(const ShadowAtlas &) = delete;
+  ShadowAtlas &operator=(const ShadowAtlas &) = delete;
+
+private:
+  // Level of the blocks of a size: 0 for the whole atlas, one more for each
+  // halving
+  UInt32 level_of(UInt32 tile_size) const;
+
+  // Take a free block of a level, splitting a larger one if needed; returns
+  // false if there is none
+  bool AllocBlock(UInt32 level, UInt32 *x, UInt32 *y);
+
+  // Give a block back, merging it with its siblings when they are all free
+  void FreeBlock(UInt32 level, UInt32 x, UInt32 y);
+
+  // Make the whole atlas one free block
+  void ResetBlocks();
+
+  // Sizes of the tiles of the lights, given what they want and the tiles
+  // they have
+  void FitSizes(const float *wanted);
+
+  const UInt32 size_;
+  const UInt32 min_tile_;
+  const UInt32 level_count_;
+
+  // Free blocks of each level, as x and y packed in the high and low 16 bits
+  std::vector<std::vector<UInt32> > free_blocks_;
+
+  std::vector<ShadowTile> tiles_;
+  std::vector<ShadowTile> prev_tiles_;
+  std::vector<UInt32> sizes_;
+  std::vector<UInt8> moved_;
+  // Lights to place, largest tile first
+  std::vector<UInt32> order_;
+
+  UInt64 used_texels_;
+  UInt32 dropped_count_;
+  bool repacked_;
+
+}; // class ShadowAtlas
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,113 @@
+#include "shadow_cache.h"
+#include <cstring>
+
+namespace sz {
+
+ShadowCache::ShadowCache(size_t lights_num) :
+    entries_(lights_num),
+    rendered_count_(0),
+    reused_count_(0),
+    waiting_count_(0) {
+  for (Entry &entry : entries_) {
+    XMStoreFloat4x4(&entry.view, XMMatrixIdentity());
+    XMStoreFloat4x4(&entry.proj, XMMatrixIdentity());
+    entry.next_view = entry.view;
+    entry.next_proj = entry.proj;
+    entry.frames_waiting = 0;
+    entry.valid = false;
+    entry.dirty = true;
+  }
+}
+
+void ShadowCache::Update(size_t light, const XMMATRIX &view,
+  const XMMATRIX &proj) {
+  Entry &entry = entries_[light];
+  XMStoreFloat4x4(&entry.next_view, view);
+  XMStoreFloat4x4(&entry.next_proj, proj);
+
+  // Lights are set up again every frame, with the same results when
+  // nothing changed, so an exact comparison is enough
+  if (memcmp(&entry.next_view, &entry.view, sizeof(XMFLOAT4X4)) != 0 ||
+    memcmp(&entry.next_proj, &entry.proj, sizeof(XMFLOAT4X4)) != 0) {
+    entry.dirty = true;
+  }
+}
+
+void ShadowCache::Invalidate(size_t light) {
+  entries_[light].dirty = true;
+}
+
+void ShadowCache::Discard(size_t light) {
+  entries_[light].valid = false;
+  entries_[light].dirty = true;
+}
+
+void ShadowCache::InvalidateAll() {
+  for (Entry &entry : entries_) {
+    entry.dirty = true;
+  }
+}
+
+void ShadowCache::Schedule(const UInt8 *candidates, const float *priorities,
+  UInt32 budget, UInt8 *render) {
+  rendered_count_ = 0;
+  reused_count_ = 0;
+  waiting_count_ = 0;
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    render[i] = 0;
+  }
+
+  // There are only a few lights, so the best one left is picked each time
+  for (UInt32 n = 0; n < budget; ++n) {
+    size_t best = entries_.size();
+    bool best_valid = true;
+    float best_score = -1.f;
+
+    for (size_t i = 0; i < entries_.size(); ++i) {
+      const Entry &entry = entries_[i];
+      if (!candidates[i] || !entry.dirty || render[i]) {
+        continue;
+      }
+
+      float score = priorities[i] *
+        static_cast<float>(entry.frames_waiting + 1);
+      if ((best_valid && !entry.valid) ||
+        (best_valid == entry.valid && score > best_score)) {
+        best = i;
+        best_valid = entry.valid;
+        best_score = score;
+      }
+    }
+
+    if (best == entries_.size()) {
+      break;
+    }
+    render[best] = 1;
+  }
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (!candidates[i]) {
+      continue;
+    }
+
+    Entry &entry = entries_[i];
+    if (render[i]) {
+      entry.view = entry.next_view;
+      entry.proj = entry.next_proj;
+      entry.frames_waiting = 0;
+      entry.valid = true;
+      entry.dirty = false;
+      ++rendered_count_;
+    }
+    else if (entry.dirty) {
+      ++entry.frames_waiting;
+      ++waiting_count_;
+    }
+    else {
+      ++reused_count_;
+    }
+  }
+}
+
+} // namespace sz
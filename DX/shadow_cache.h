@@ -0,0 +1,99 @@
+//  Cache of shadow maps
+//  * Remembers the view and projection each shadow map was rendered with,
+//    so that a map is only rendered again when it would come out different
+//  * A map is dirty when its light moved or changed projection, or when a
+//    caster moved within the reach of the light
+//  * Dirty maps are refreshed within a budget of maps per frame, most
+//    important first. The others keep their last map, together with the
+//    matrices it was rendered with, so that their shadows lag behind
+//    rather than being wrong.
+//  * Lights which wait grow in priority every frame, so that all of them
+//    get their turn
+
+#ifndef _SHADOW_CACHE_H
+#define _SHADOW_CACHE_H
+
+#include <vector>
+#include <directxmath.h>
+#include "abertay_framework.h"
+
+namespace sz {
+
+using namespace DirectX;
+
+class ShadowCache {
+public:
+  // Ctor
+  explicit ShadowCache(size_t lights_num);
+
+  // Compare the current matrices of a light with those its map was
+  // rendered with; the map is dirty if they differ
+  void Update(size_t light, const XMMATRIX &view, const XMMATRIX &proj);
+
+  // Mark the map of a light dirty, e.g. after a caster moved in its reach
+  void Invalidate(size_t light);
+
+  // Mark all the maps dirty, e.g. after the geometry changed everywhere
+  void InvalidateAll();
+
+  // Forget the map of a light, e.g. after it lost its room in the atlas; it
+  // is not sampled until it is rendered again
+  void Discard(size_t light);
+
+  // Choose which lights render their map this frame: the candidates whose
+  // map is dirty, at most budget of them. Lights without a map come first,
+  // then the others by priority times the frames they waited. render[i] is
+  // set to 1 for the chosen lights and to 0 for the others. The chosen maps
+  // are taken to be rendered with the matrices given to Update, so the
+  // caller has to render them.
+  void Schedule(const UInt8 *candidates, const float *priorities,
+    UInt32 budget, UInt8 *render);
+
+  // Whether a light has a map which can be sampled
+  inline bool valid(size_t light) const {
+    return entries_[light].valid;
+  }
+  // Matrices the map of a light was rendered with
+  inline const XMFLOAT4X4 &view(size_t light) const {
+    return entries_[light].view;
+  }
+  inline const XMFLOAT4X4 &proj(size_t light) const {
+    return entries_[light].proj;
+  }
+
+  // Of the last Schedule: candidates rendered, those which kept an up to
+  // date map, and dirty ones left for later frames
+  inline UInt32 rendered_count() const {
+    return rendered_count_;
+  }
+  inline UInt32 reused_count() const {
+    return reused_count_;
+  }
+  inline UInt32 waiting_count() const {
+    return waiting_count_;
+  }
+
+private:
+  struct Entry {
+    // Of the map
+    XMFLOAT4X4 view;
+    XMFLOAT4X4 proj;
+    // Of the light, as last given to Update
+    XMFLOAT4X4 next_view;
+    XMFLOAT4X4 next_proj;
+    // Frames a dirty map was left for later
+    UInt32 frames_waiting;
+    bool valid;
+    bool dirty;
+  };
+  std::vector<Entry> entries_;
+
+  UInt32 rendered_count_;
+  UInt32 reused_count_;
+  UInt32 waiting_count_;
+
+}; // class ShadowCache
+
+} // namespace sz
+
+#endif
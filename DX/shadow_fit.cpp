@@ -0,0 +1,188 @@
+#include "shadow_fit.h"
+#include <cmath>
+
+namespace sz {
+
+// Steps the window is snapped to, across the width of the cone
+const int kShadowFitSteps = 32;
+// Steps of the far plane across the depth range of the light
+const int kShadowFitDepthSteps = 64;
+// Steps of the near plane per doubling of its distance, as precision
+// depends on its ratio to the far plane
+const float kShadowFitNearSteps = 4.f;
+
+ShadowFitter::ShadowFitter() :
+    view_(),
+    tan_half_fov_(1.f),
+    near_z_(0.f),
+    far_z_(0.f),
+    receivers_(),
+    has_receivers_(false),
+    casters_() {
+}
+
+void ShadowFitter::Begin(const XMFLOAT4X4 &view, float tan_half_fov,
+  float near_z, float far_z) {
+  view_ = view;
+  tan_half_fov_ = tan_half_fov;
+  near_z_ = near_z;
+  far_z_ = far_z;
+  has_receivers_ = false;
+  casters_.clear();
+}
+
+bool ShadowFitter::Measure(const XMFLOAT3 &centre, const XMFLOAT3 &extents,
+  Extent *extent) const {
+  // The box around the box in view space
+  float c[3], e[3];
+  for (int j = 0; j < 3; ++j) {
+    c[j] = centre.x * view_.m[0][j] + centre.y * view_.m[1][j] +
+      centre.z * view_.m[2][j] + view_.m[3][j];
+    e[j] = extents.x * fabsf(view_.m[0][j]) +
+      extents.y * fabsf(view_.m[1][j]) + extents.z * fabsf(view_.m[2][j]);
+  }
+  float min_x = c[0] - e[0], max_x = c[0] + e[0];
+  float min_y = c[1] - e[1], max_y = c[1] + e[1];
+  float min_z = c[2] - e[2], max_z = c[2] + e[2];
+  if (min_z >= far_z_) {
+    return false;
+  }
+
+  const float t = tan_half_fov_;
+  extent->far_z = max_z < far_z_ ? max_z : far_z_;
+  if (min_z <= near_z_) {
+    extent->left = -t;
+    extent->right = t;
+    extent->bottom = -t;
+    extent->top = t;
+    extent->near_z = near_z_;
+    return true;
+  }
+
+  // The widest tangents are on the nearest face for corners away from the
+  // axis, and on the furthest for those across it
+  extent->left = min_x / (min_x < 0.f ? min_z : max_z);
+  extent->right = max_x / (max_x > 0.f ? min_z : max_z);
+  extent->bottom = min_y / (min_y < 0.f ? min_z : max_z);
+  extent->top = max_y / (max_y > 0.f ? min_z : max_z);
+  extent->near_z = min_z;
+  if (extent->left >= t || extent->right <= -t || extent->bottom >= t ||
+    extent->top <= -t) {
+    return false;
+  }
+
+  extent->left = extent->left > -t ? extent->left : -t;
+  extent->right = extent->right < t ? extent->right : t;
+  extent->bottom = extent->bottom > -t ? extent->bottom : -t;
+  extent->top = extent->top < t ? extent->top : t;
+  return true;
+}
+
+void ShadowFitter::AddReceiver(const XMFLOAT3 &centre,
+  const XMFLOAT3 &extents) {
+  Extent extent;
+  if (!Measure(centre, extents, &extent)) {
+    return;
+  }
+
+  if (!has_receivers_) {
+    receivers_ = extent;
+    has_receivers_ = true;
+    return;
+  }
+  receivers_.left = extent.left < receivers_.left ?
+    extent.left : receivers_.left;
+  receivers_.right = extent.right > receivers_.right ?
+    extent.right : receivers_.right;
+  receivers_.bottom = extent.bottom < receivers_.bottom ?
+    extent.bottom : receivers_.bottom;
+  receivers_.top = extent.top > receivers_.top ? extent.top : receivers_.top;
+  receivers_.near_z = extent.near_z < receivers_.near_z ?
+    extent.near_z : receivers_.near_z;
+  receivers_.far_z = extent.far_z > receivers_.far_z ?
+    extent.far_z : receivers_.far_z;
+}
+
+void ShadowFitter::AddCaster(const XMFLOAT3 &centre,
+  const XMFLOAT3 &extents) {
+  Extent extent;
+  if (Measure(centre, extents, &extent)) {
+    casters_.push_back(extent);
+  }
+}
+
+// Snap [low, high] outwards to the steps of [origin, origin + steps *
+// step], keeping it at least a step wide
+static void SnapRange(float origin, float step, int steps, float *low,
+  float *high) {
+  int first = static_cast<int>(floorf((*low - origin) / step));
+  int last = static_cast<int>(ceilf((*high - origin) / step));
+  first = first > 0 ? first : 0;
+  last = last < steps ? last : steps;
+  if (last <= first) {
+    if (first < steps) {
+      last = first + 1;
+    }
+    else {
+      first = last - 1;
+    }
+  }
+  *low = origin + static_cast<float>(first) * step;
+  *high = origin + static_cast<float>(last) * step;
+}
+
+bool ShadowFitter::End(ShadowFrustum *frustum) {
+  if (!has_receivers_) {
+    return false;
+  }
+
+  ShadowFrustum fit;
+  fit.left = receivers_.left;
+  fit.right = receivers_.right;
+  fit.bottom = receivers_.bottom;
+  fit.top = receivers_.top;
+  fit.far_z = receivers_.far_z;
+
+  // Only the casters in front of the receivers' window can shadow them
+  fit.near_z = receivers_.near_z;
+  for (const Extent &caster : casters_) {
+    if (caster.left < fit.right && caster.right > fit.left &&
+      caster.bottom < fit.top && caster.top > fit.bottom &&
+      caster.near_z < fit.near_z) {
+      fit.near_z = caster.near_z;
+    }
+  }
+
+  const float t = tan_half_fov_;
+  const float step = 2.f * t / static_cast<float>(kShadowFitSteps);
+  SnapRange(-t, step, kShadowFitSteps, &fit.left, &fit.right);
+  SnapRange(-t, step, kShadowFitSteps, &fit.bottom, &fit.top);
+
+  const float depth_step = (far_z_ - near_z_) /
+    static_cast<float>(kShadowFitDepthSteps);
+  float far_low = fit.far_z;
+  SnapRange(near_z_, depth_step, kShadowFitDepthSteps, &far_low,
+    &fit.far_z);
+
+  // The near plane snaps down to steps of its ratio to the light's
+  float near_step = floorf(log2f(fit.near_z / near_z_) * kShadowFitNearSteps);
+  fit.near_z = near_z_ * exp2f(near_step / kShadowFitNearSteps);
+  if (fit.near_z >= fit.far_z) {
+    fit.near_z = near_z_;
+  }
+
+  *frustum = fit;
+  return true;
+}
+
+float ShadowFitter::TexelGain(const ShadowFrustum &frustum,
+  float tan_half_fov) {
+  float width = frustum.right - frustum.left;
+  float height = frustum.top - frustum.bottom;
+  if (width <= 0.f || height <= 0.f) {
+    return 1.f;
+  }
+  return 4.f * tan_half_fov * tan_half_fov / (width * height);
+}
+
+} // namespace sz
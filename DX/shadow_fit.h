@@ -0,0 +1,97 @@
+//  Fitting of the frustums of shadow maps
+//  * The map of a light only needs to hold the geometry the camera sees lit
+//    by it, the receivers, and what lies between them and the light, the
+//    casters; the rest of its cone is wasted texels and depth range
+//  * Boxes are taken to the view space of the light, where each covers a
+//    window of tangents, x / z and y / z, and a range of depths
+//  * The window of the frustum is that of the receivers, inside the cone of
+//    the light; its far plane lies behind the last receiver, and its near
+//    plane before the first caster which overlaps the window
+//  * Boxes which reach behind the near plane of the light may cover any
+//    direction, and keep the whole cone and the light's near plane
+//  * The result is snapped outwards to steps of the cone and of the depth
+//    range, so that it only changes, and the map is only rendered again,
+//    once the view moved by a step
+//  * Plain scalar arithmetic, so that the same boxes always give the same
+//    frustum
+
+#ifndef _SHADOW_FIT_H
+#define _SHADOW_FIT_H
+
+#include <vector>
+#include <directxmath.h>
+#include "abertay_framework.h"
+
+namespace sz {
+
+using namespace DirectX;
+
+// Frustum of a shadow map: the window as tangents at a distance of 1 from
+// the light, and the planes
+struct ShadowFrustum {
+  float left;
+  float right;
+  float bottom;
+  float top;
+  float near_z;
+  float far_z;
+};
+
+class ShadowFitter {
+public:
+  // Ctor
+  ShadowFitter();
+
+  // Start fitting inside the reach of a light: its view matrix, the tangent
+  // of half the angle of its cone and its planes
+  void Begin(const XMFLOAT4X4 &view, float tan_half_fov, float near_z,
+    float far_z);
+
+  // Boxes in world space, by centre and half extents: one the camera may
+  // see lit by the light, and one which may shadow those
+  void AddReceiver(const XMFLOAT3 &centre, const XMFLOAT3 &extents);
+  void AddCaster(const XMFLOAT3 &centre, const XMFLOAT3 &extents);
+
+  // Fit the frustum to the boxes added since Begin. Returns false if no
+  // receiver lies in the reach of the light, leaving frustum as it was.
+  bool End(ShadowFrustum *frustum);
+
+  // How many times more texels of the map cover the fitted frustum than
+  // the whole cone
+  static float TexelGain(const ShadowFrustum &frustum, float tan_half_fov);
+
+  // Disable ctors
+  ShadowFitter(const ShadowFitter &) = delete;
+  ShadowFitter &operator=(const ShadowFitter &) = delete;
+
+private:
+  // Window and depths a box covers in the view space of the light
+  struct Extent {
+    float left;
+    float right;
+    float bottom;
+    float top;
+    float near_z;
+    float far_z;
+  };
+
+  // The extent of a box, clamped to the cone; false if it lies wholly
+  // beyond the far plane or outside of the cone
+  bool Measure(const XMFLOAT3 &centre, const XMFLOAT3 &extents,
+    Extent *extent) const;
+
+  XMFLOAT4X4 view_;
+  float tan_half_fov_;
+  float near_z_;
+  float far_z_;
+
+  // Union of the receivers
+  Extent receivers_;
+  bool has_receivers_;
+  std::vector<Extent> casters_;
+
+}; // class ShadowFitter
+
+} // namespace sz
+
+#endif
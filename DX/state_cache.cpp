@@ -0,0 +1,616 @@
+#include "state_cache.h"
+#include <cstring>
+#include "constant_ring.h"
+
+// Thread local storage; VS2013 has no thread_local
+#if defined(_MSC_VER)
+#define SZ_THREAD_LOCAL __declspec(thread)
+#else
+#define SZ_THREAD_LOCAL __thread
+#endif
+
+namespace sz {
+
+StateCache *StateCache::single_instance_ = nullptr;
+
+// Cache of the command list being recorded by this thread, if any
+static SZ_THREAD_LOCAL StateCache *thread_instance = nullptr;
+
+StateCache::StateCache() :
+    backend_(nullptr),
+    input_layout_(),
+    topology_(),
+    vertex_buffers_(),
+    index_buffer_(),
+    blend_(),
+    depth_stencil_(),
+    rasterizer_(),
+    ring_(nullptr),
+    ring_ranges_(),
+    ring_maps_(),
+    samplers_(),
+    blend_states_(),
+    raster_states_() {
+  memset(&stats_, 0, sizeof(stats_));
+  memset(&frame_stats_, 0, sizeof(frame_stats_));
+}
+
+StateCache::~StateCache() {
+  for (auto &sampler : samplers_) {
+    ReleaseNull(sampler.second);
+  }
+  for (auto &blend : blend_states_) {
+    ReleaseNull(blend.second);
+  }
+  for (auto &raster : raster_states_) {
+    ReleaseNull(raster.second);
+  }
+}
+
+StateCache *StateCache::Inst() {
+  if (thread_instance != nullptr) {
+    return thread_instance;
+  }
+
+  // If instance doen't exist
+  if (single_instance_ == nullptr) {
+    // Create it
+    single_instance_ = new StateCache();
+  }
+
+  return single_instance_;
+}
+
+void StateCache::ResetInst() {
+  if (single_instance_ != nullptr) {
+    delete single_instance_;
+    single_instance_ = nullptr;
+  }
+}
+
+void StateCache::SetThreadInst(StateCache *cache) {
+  thread_instance = cache;
+}
+
+void StateCache::MergeStats(StateCache *other) {
+  stats_.issued += other->stats_.issued;
+  stats_.filtered += other->stats_.filtered;
+  stats_.ring_written += other->stats_.ring_written;
+  stats_.ring_unchanged += other->stats_.ring_unchanged;
+  memset(&other->stats_, 0, sizeof(other->stats_));
+}
+
+void StateCache::set_backend(GfxBackend *backend) {
+  backend_ = backend;
+
+  Invalidate();
+}
+
+void StateCache::set_constant_ring(ConstantRing *ring) {
+  ring_ = ring;
+  if (ring_ != nullptr && (ring_->buffer() == nullptr ||
+    !backend_->SupportsConstantBufferOffsets())) {
+    ring_ = nullptr;
+  }
+  ring_ranges_.clear();
+  ring_maps_.clear();
+
+  // Slots may still be bound to ranges of the last frame
+  for (Stage &stage : stages_) {
+    stage.constant_buffers.Invalidate();
+  }
+}
+
+void StateCache::BeginFrame() {
+  frame_stats_ = stats_;
+  memset(&stats_, 0, sizeof(stats_));
+
+  Invalidate();
+}
+
+void StateCache::Invalidate() {
+  input_layout_.Invalidate();
+  topology_.Invalidate();
+  vertex_buffers_.Invalidate();
+  index_buffer_.Invalidate();
+  for (Stage &stage : stages_) {
+    stage.shader.Invalidate();
+    stage.constant_buffers.Invalidate();
+    stage.resources.Invalidate();
+    stage.samplers.Invalidate();
+  }
+  blend_.Invalidate();
+  depth_stencil_.Invalidate();
+  rasterizer_.Invalidate();
+}
+
+ID3D11SamplerState *StateCache::GetSamplerState(ID3D11Device *device,
+  const D3D11_SAMPLER_DESC &desc) {
+  // Sampler descriptions have no padding, so they can be compared as bytes
+  for (auto &sampler : samplers_) {
+    if (memcmp(&sampler.first, &desc, sizeof(desc)) == 0) {
+      sampler.second->AddRef();
+      return sampler.second;
+    }
+  }
+
+  ID3D11SamplerState *state = nullptr;
+  if (FAILED(device->CreateSamplerState(&desc, &state))) {
+    return nullptr;
+  }
+  samplers_.push_back(std::make_pair(desc, state));
+
+  state->AddRef();
+  return state;
+}
+
+ID3D11BlendState *StateCache::GetBlendState(ID3D11Device *device,
+  const D3D11_BLEND_DESC &desc) {
+  // The render target descriptions are padded; copy them field by field so
+  // that the padding of the key is always 0
+  D3D11_BLEND_DESC key;
+  memset(&key, 0, sizeof(key));
+  key.AlphaToCoverageEnable = desc.AlphaToCoverageEnable;
+  key.IndependentBlendEnable = desc.IndependentBlendEnable;
+  for (UInt32 i = 0; i < 8; ++i) {
+    const D3D11_RENDER_TARGET_BLEND_DESC &src = desc.RenderTarget[i];
+    D3D11_RENDER_TARGET_BLEND_DESC &dst = key.RenderTarget[i];
+    dst.BlendEnable = src.BlendEnable;
+    dst.SrcBlend = src.SrcBlend;
+    dst.DestBlend = src.DestBlend;
+    dst.BlendOp = src.BlendOp;
+    dst.SrcBlendAlpha = src.SrcBlendAlpha;
+    dst.DestBlendAlpha = src.DestBlendAlpha;
+    dst.BlendOpAlpha = src.BlendOpAlpha;
+    dst.RenderTargetWriteMask = src.RenderTargetWriteMask;
+  }
+
+  for (auto &blend : blend_states_) {
+    if (memcmp(&blend.first, &key, sizeof(key)) == 0) {
+      blend.second->AddRef();
+      return blend.second;
+    }
+  }
+
+  ID3D11BlendState *state = nullptr;
+  if (FAILED(device->CreateBlendState(&desc, &state))) {
+    return nullptr;
+  }
+  blend_states_.push_back(std::make_pair(key, state));
+
+  state->AddRef();
+  return state;
+}
+
+ID3D11RasterizerState *StateCache::GetRasterizerState(ID3D11Device *device,
+  const D3D11_RASTERIZER_DESC &desc) {
+  // Rasterizer descriptions have no padding either
+  for (auto &raster : raster_states_) {
+    if (memcmp(&raster.first, &desc, sizeof(desc)) == 0) {
+      raster.second->AddRef();
+      return raster.second;
+    }
+  }
+
+  ID3D11RasterizerState *state = nullptr;
+  if (FAILED(device->CreateRasterizerState(&desc, &state))) {
+    return nullptr;
+  }
+  raster_states_.push_back(std::make_pair(desc, state));
+
+  state->AddRef();
+  return state;
+}
+
+void StateCache::IASetInputLayout(ID3D11InputLayout *layout) {
+  if (Count(input_layout_.Set(layout))) {
+    backend_->IASetInputLayout(layout);
+  }
+}
+
+void StateCache::IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology) {
+  if (Count(topology_.Set(topology))) {
+    backend_->IASetPrimitiveTopology(topology);
+  }
+}
+
+void StateCache::IASetVertexBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers, const UINT *strides, const UINT *offsets) {
+  VertexBufferBinding bindings[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+  if (count > D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT) {
+    count = D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT;
+  }
+  for (UINT i = 0; i < count; ++i) {
+    bindings[i].buffer = buffers[i];
+    bindings[i].stride = strides[i];
+    bindings[i].offset = offsets[i];
+  }
+
+  UInt32 first, changed;
+  if (Count(vertex_buffers_.Set(start, count, bindings, first, changed))) {
+    backend_->IASetVertexBuffers(first, changed, buffers + (first - start),
+      strides + (first - start), offsets + (first - start));
+  }
+}
+
+void StateCache::IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format,
+  UINT offset) {
+  IndexBufferBinding binding;
+  binding.buffer = buffer;
+  binding.format = format;
+  binding.offset = offset;
+
+  if (Count(index_buffer_.Set(binding))) {
+    backend_->IASetIndexBuffer(buffer, format, offset);
+  }
+}
+
+bool StateCache::SetShader(ShaderStage stage, ID3D11DeviceChild *shader) {
+  return Count(stages_[stage].shader.Set(shader));
+}
+
+void StateCache::VSSetShader(ID3D11VertexShader *shader) {
+  if (SetShader(kStageVS, shader)) {
+    backend_->VSSetShader(shader);
+  }
+}
+
+void StateCache::HSSetShader(ID3D11HullShader *shader) {
+  if (SetShader(kStageHS, shader)) {
+    backend_->HSSetShader(shader);
+  }
+}
+
+void StateCache::DSSetShader(ID3D11DomainShader *shader) {
+  if (SetShader(kStageDS, shader)) {
+    backend_->DSSetShader(shader);
+  }
+}
+
+void StateCache::GSSetShader(ID3D11GeometryShader *shader) {
+  if (SetShader(kStageGS, shader)) {
+    backend_->GSSetShader(shader);
+  }
+}
+
+void StateCache::PSSetShader(ID3D11PixelShader *shader) {
+  if (SetShader(kStagePS, shader)) {
+    backend_->PSSetShader(shader);
+  }
+}
+
+void StateCache::VSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  UInt32 first, changed;
+  if (Count(stages_[kStageVS].constant_buffers.Set(start, count, buffers,
+    first, changed))) {
+    IssueConstantBuffers(kStageVS, first, changed,
+      buffers + (first - start));
+  }
+}
+
+void StateCache::HSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  UInt32 first, changed;
+  if (Count(stages_[kStageHS].constant_buffers.Set(start, count, buffers,
+    first, changed))) {
+    IssueConstantBuffers(kStageHS, first, changed,
+      buffers + (first - start));
+  }
+}
+
+void StateCache::DSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  UInt32 first, changed;
+  if (Count(stages_[kStageDS].constant_buffers.Set(start, count, buffers,
+    first, changed))) {
+    IssueConstantBuffers(kStageDS, first, changed,
+      buffers + (first - start));
+  }
+}
+
+void StateCache::GSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  UInt32 first, changed;
+  if (Count(stages_[kStageGS].constant_buffers.Set(start, count, buffers,
+    first, changed))) {
+    IssueConstantBuffers(kStageGS, first, changed,
+      buffers + (first - start));
+  }
+}
+
+void StateCache::PSSetConstantBuffers(UINT start, UINT count,
+  ID3D11Buffer *const *buffers) {
+  UInt32 first, changed;
+  if (Count(stages_[kStagePS].constant_buffers.Set(start, count, buffers,
+    first, changed))) {
+    IssueConstantBuffers(kStagePS, first, changed,
+      buffers + (first - start));
+  }
+}
+
+const StateCache::RingRange *StateCache::FindRingRange(
+  ID3D11Buffer *buffer) const {
+  for (const RingRange &range : ring_ranges_) {
+    if (range.buffer == buffer) {
+      return &range;
+    }
+  }
+
+  return nullptr;
+}
+
+void StateCache::IssueConstantBuffers(ShaderStage stage, UINT start,
+  UINT count, ID3D11Buffer *const *buffers) {
+  // Ranges of the ring are bound one slot at a time, the other buffers in
+  // runs between them
+  UINT run = 0;
+  for (UINT i = 0; i <= count; ++i) {
+    const RingRange *range = i < count && !ring_ranges_.empty() ?
+      FindRingRange(buffers[i]) : nullptr;
+    if (i < count && range == nullptr) {
+      continue;
+    }
+
+    if (run < i) {
+      switch (stage) {
+      case kStageVS:
+        backend_->VSSetConstantBuffers(start + run, i - run, buffers + run);
+        break;
+      case kStageHS:
+        backend_->HSSetConstantBuffers(start + run, i - run, buffers + run);
+        break;
+      case kStageDS:
+        backend_->DSSetConstantBuffers(start + run, i - run, buffers + run);
+        break;
+      case kStageGS:
+        backend_->GSSetConstantBuffers(start + run, i - run, buffers + run);
+        break;
+      default:
+        backend_->PSSetConstantBuffers(start + run, i - run, buffers + run);
+        break;
+      }
+    }
+    run = i + 1;
+
+    if (range == nullptr) {
+      continue;
+    }
+
+    ID3D11Buffer *ring_buffer = ring_->buffer();
+    UINT first = range->offset / 16;
+    UINT constants = ((range->size + kConstantRingAlignment - 1) &
+      ~(kConstantRingAlignment - 1)) / 16;
+    switch (stage) {
+    case kStageVS:
+      backend_->VSSetConstantBuffers1(start + i, 1, &ring_buffer, &first,
+        &constants);
+      break;
+    case kStageHS:
+      backend_->HSSetConstantBuffers1(start + i, 1, &ring_buffer, &first,
+        &constants);
+      break;
+    case kStageDS:
+      backend_->DSSetConstantBuffers1(start + i, 1, &ring_buffer, &first,
+        &constants);
+      break;
+    case kStageGS:
+      backend_->GSSetConstantBuffers1(start + i, 1, &ring_buffer, &first,
+        &constants);
+      break;
+    default:
+      backend_->PSSetConstantBuffers1(start + i, 1, &ring_buffer, &first,
+        &constants);
+      break;
+    }
+  }
+}
+
+void StateCache::RebindConstantBuffer(ID3D11Buffer *buffer) {
+  for (UInt32 s = 0; s < kStageCount; ++s) {
+    for (UInt32 slot = 0;
+      slot < D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT; ++slot) {
+      if (stages_[s].constant_buffers.value(slot) == buffer) {
+        Count(true);
+        IssueConstantBuffers(static_cast<ShaderStage>(s), slot, 1, &buffer);
+      }
+    }
+  }
+}
+
+HRESULT StateCache::Map(ID3D11Resource *resource, UINT subresource,
+  D3D11_MAP type, UINT flags, D3D11_MAPPED_SUBRESOURCE *mapped) {
+  if (ring_ == nullptr || type != D3D11_MAP_WRITE_DISCARD) {
+    return backend_->Map(resource, subresource, type, flags, mapped);
+  }
+
+  // Only constant buffers small enough to be bound as one range
+  D3D11_RESOURCE_DIMENSION dimension;
+  resource->GetType(&dimension);
+  if (dimension != D3D11_RESOURCE_DIMENSION_BUFFER) {
+    return backend_->Map(resource, subresource, type, flags, mapped);
+  }
+  ID3D11Buffer *buffer = static_cast<ID3D11Buffer *>(resource);
+  D3D11_BUFFER_DESC desc;
+  buffer->GetDesc(&desc);
+  if (desc.BindFlags != D3D11_BIND_CONSTANT_BUFFER ||
+    desc.ByteWidth > D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT * 16) {
+    return backend_->Map(resource, subresource, type, flags, mapped);
+  }
+
+  RingRange range = { buffer, ring_->Allocate(desc.ByteWidth),
+    desc.ByteWidth };
+  ring_maps_.push_back(range);
+  if (range.offset == kNoConstantRingOffset) {
+    return backend_->Map(resource, subresource, type, flags, mapped);
+  }
+
+  // Zeroed, so that what is left unwritten compares equal
+  mapped->pData = ring_->data(range.offset);
+  mapped->RowPitch = desc.ByteWidth;
+  mapped->DepthPitch = desc.ByteWidth;
+  memset(mapped->pData, 0, desc.ByteWidth);
+
+  return S_OK;
+}
+
+void StateCache::Unmap(ID3D11Resource *resource, UINT subresource) {
+  size_t i = 0;
+  while (i < ring_maps_.size() && ring_maps_[i].buffer != resource) {
+    ++i;
+  }
+  if (i == ring_maps_.size()) {
+    backend_->Unmap(resource, subresource);
+    return;
+  }
+
+  RingRange range = ring_maps_[i];
+  ring_maps_.erase(ring_maps_.begin() + i);
+
+  size_t previous = 0;
+  while (previous < ring_ranges_.size() &&
+    ring_ranges_[previous].buffer != range.buffer) {
+    ++previous;
+  }
+
+  if (range.offset == kNoConstantRingOffset) {
+    // The ring was full, so the buffer itself was written and is bound
+    // whole from now on
+    backend_->Unmap(resource, subresource);
+    if (previous < ring_ranges_.size()) {
+      ring_ranges_.erase(ring_ranges_.begin() + previous);
+      RebindConstantBuffer(range.buffer);
+    }
+    return;
+  }
+
+  if (previous < ring_ranges_.size() &&
+    memcmp(ring_->data(ring_ranges_[previous].offset),
+    ring_->data(range.offset), range.size) == 0) {
+    // Nothing changed: the range already bound is kept, and the new one is
+    // given back if nothing was allocated after it
+    ring_->Free(range.offset, range.size);
+    ++stats_.ring_unchanged;
+    return;
+  }
+
+  ++stats_.ring_written;
+  if (previous < ring_ranges_.size()) {
+    ring_ranges_[previous].offset = range.offset;
+  }
+  else {
+    ring_ranges_.push_back(range);
+  }
+  RebindConstantBuffer(range.buffer);
+}
+
+void StateCache::VSSetShaderResources(UINT start, UINT count,
+  ID3D11ShaderResourceView *const *views) {
+  UInt32 first, changed;
+  if (Count(stages_[kStageVS].resources.Set(start, count, views,
+    first, changed))) {
+    backend_->VSSetShaderResources(first, changed, views + (first - start));
+  }
+}
+
+void StateCache::DSSetShaderResources(UINT start, UINT count,
+  ID3D11ShaderResourceView *const *views) {
+  UInt32 first, changed;
+  if (Count(stages_[kStageDS].resources.Set(start, count, views,
+    first, changed))) {
+    backend_->DSSetShaderResources(first, changed, views + (first - start));
+  }
+}
+
+void StateCache::PSSetShaderResources(UINT start, UINT count,
+  ID3D11ShaderResourceView *const *views) {
+  UInt32 first, changed;
+  if (Count(stages_[kStagePS].resources.Set(start, count, views,
+    first, changed))) {
+    backend_->PSSetShaderResources(first, changed, views + (first - start));
+  }
+}
+
+void StateCache::PSUnbindShaderResources() {
+  static ID3D11ShaderResourceView *const
+    null_views[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = { nullptr };
+
+  UInt32 end = stages_[kStagePS].resources.BoundEnd();
+  if (end == 0) {
+    Count(false);
+    return;
+  }
+
+  PSSetShaderResources(0, end, null_views);
+}
+
+void StateCache::VSSetSamplers(UINT start, UINT count,
+  ID3D11SamplerState *const *samplers) {
+  UInt32 first, changed;
+  if (Count(stages_[kStageVS].samplers.Set(start, count, samplers,
+    first, changed))) {
+    backend_->VSSetSamplers(first, changed, samplers + (first - start));
+  }
+}
+
+void StateCache::DSSetSamplers(UINT start, UINT count,
+  ID3D11SamplerState *const *samplers) {
+  UInt32 first, changed;
+  if (Count(stages_[kStageDS].samplers.Set(start, count, samplers,
+    first, changed))) {
+    backend_->DSSetSamplers(first, changed, samplers + (first - start));
+  }
+}
+
+void StateCache::PSSetSamplers(UINT start, UINT count,
+  ID3D11SamplerState *const *samplers) {
+  UInt32 first, changed;
+  if (Count(stages_[kStagePS].samplers.Set(start, count, samplers,
+    first, changed))) {
+    backend_->PSSetSamplers(first, changed, samplers + (first - start));
+  }
+}
+
+void StateCache::OMSetBlendState(ID3D11BlendState *state,
+  const FLOAT blend_factor[4], UINT sample_mask) {
+  BlendBinding binding;
+  binding.state = state;
+  for (UInt32 i = 0; i < 4; ++i) {
+    // A null factor means all 1s
+    binding.factor[i] = blend_factor != nullptr ? blend_factor[i] : 1.f;
+  }
+  binding.sample_mask = sample_mask;
+
+  if (Count(blend_.Set(binding))) {
+    backend_->OMSetBlendState(state, blend_factor, sample_mask);
+  }
+}
+
+void StateCache::OMSetDepthStencilState(ID3D11DepthStencilState *state,
+  UINT stencil_ref) {
+  DepthStencilBinding binding;
+  binding.state = state;
+  binding.stencil_ref = stencil_ref;
+
+  if (Count(depth_stencil_.Set(binding))) {
+    backend_->OMSetDepthStencilState(state, stencil_ref);
+  }
+}
+
+void StateCache::RSSetState(ID3D11RasterizerState *state) {
+  if (Count(rasterizer_.Set(state))) {
+    backend_->RSSetState(state);
+  }
+}
+
+void StateCache::OMSetRenderTargets(UINT count,
+  ID3D11RenderTargetView *const *views, ID3D11DepthStencilView *depth) {
+  Count(true);
+  backend_->OMSetRenderTargets(count, views, depth);
+
+  for (Stage &stage : stages_) {
+    stage.resources.InvalidateBound();
+  }
+}
+
+} // namespace sz
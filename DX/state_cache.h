@@ -0,0 +1,368 @@
+//  A state cache in front of the graphics backend
+//  * Binds go through the cache, which skips those that would not change
+//    the state of the pipeline
+//  * Commands which carry no state (updates, clears, draws) are passed
+//    straight to the backend, so that the whole command stream of a frame
+//    goes through the cache
+//  * Sampler, blend and rasterizer states are interned by description, so
+//    that identical ones are created once
+//  * Counts issued and filtered binds per frame
+//  * State is assumed unknown at the start of each frame and whenever code
+//    outside of the cache (e.g. ImGui) touched the context
+//  * Threads recording a CommandList get a cache of their own from Inst(),
+//    in front of the list's deferred backend. State objects are still
+//    created and interned by the global one, on the main thread.
+//  * While a list is recorded, constant buffers mapped with WRITE_DISCARD
+//    can be written to a ConstantRing instead, and bound as ranges of it.
+//    Code mapping and binding its buffers does not change; a buffer written
+//    with the same contents as before keeps its range.
+
+#ifndef _STATE_CACHE_H
+#define _STATE_CACHE_H
+
+#include <d3d11.h>
+#include <vector>
+#include "abertay_framework.h"
+#include "state_filter.h"
+#include "gfx_backend.h"
+
+namespace sz {
+  class ConstantRing;
+}
+
+namespace sz {
+
+// Binds made through the cache
+struct StateCacheStats {
+  // Sent to the backend
+  UInt32 issued;
+  // Skipped as they would not change anything
+  UInt32 filtered;
+  // Constant buffers written to the ring, and those which were written with
+  // what they already held, so took no room
+  UInt32 ring_written;
+  UInt32 ring_unchanged;
+};
+
+class StateCache {
+public:
+  // Retrieve instance of singleton, or the cache of the command list the
+  // calling thread is recording
+  static StateCache *Inst();
+
+  // Resets singleton to not having an instance
+  static void ResetInst();
+
+  // Backend the commands are sent to; not owned
+  inline GfxBackend *backend() const {
+    return backend_;
+  }
+  // Switch to a different backend; the bound state is forgotten
+  void set_backend(GfxBackend *backend);
+
+  // Start counting a new frame, and forget the bound state
+  void BeginFrame();
+
+  // Forget the bound state, after code outside of the cache used the
+  // backend's device context
+  void Invalidate();
+
+  // Write the constant buffers mapped with WRITE_DISCARD to a ring, and
+  // bind them by offset into it; nullptr maps them as usual. The ring has to
+  // be uploaded before the commands are executed, so it only suits caches
+  // of command lists, and backends which support offsets. What was written
+  // before is forgotten.
+  void set_constant_ring(ConstantRing *ring);
+  inline ConstantRing *constant_ring() const {
+    return ring_;
+  }
+
+  // Counters of the last complete frame
+  inline const StateCacheStats &frame_stats() const {
+    return frame_stats_;
+  }
+
+  // Return a state object matching a description, creating it the first
+  // time. The caller gets a reference of its own, and has to release it.
+  ID3D11SamplerState *GetSamplerState(ID3D11Device *device,
+    const D3D11_SAMPLER_DESC &desc);
+  ID3D11BlendState *GetBlendState(ID3D11Device *device,
+    const D3D11_BLEND_DESC &desc);
+  ID3D11RasterizerState *GetRasterizerState(ID3D11Device *device,
+    const D3D11_RASTERIZER_DESC &desc);
+
+  // Number of distinct state objects created
+  inline size_t interned_state_count() const {
+    return samplers_.size() + blend_states_.size() + raster_states_.size();
+  }
+
+  // Input assembler
+  void IASetInputLayout(ID3D11InputLayout *layout);
+  void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+  void IASetVertexBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers, const UINT *strides, const UINT *offsets);
+  void IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format,
+    UINT offset);
+
+  // Shaders
+  void VSSetShader(ID3D11VertexShader *shader);
+  void HSSetShader(ID3D11HullShader *shader);
+  void DSSetShader(ID3D11DomainShader *shader);
+  void GSSetShader(ID3D11GeometryShader *shader);
+  void PSSetShader(ID3D11PixelShader *shader);
+
+  // Constant buffers
+  void VSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void HSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void DSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void GSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+  void PSSetConstantBuffers(UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+
+  // Shader resources
+  void VSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views);
+  void DSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views);
+  void PSSetShaderResources(UINT start, UINT count,
+    ID3D11ShaderResourceView *const *views);
+
+  // Unbind the pixel shader resources, e.g. so that render targets can be
+  // bound; only slots which may be bound are touched
+  void PSUnbindShaderResources();
+
+  // Samplers
+  void VSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers);
+  void DSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers);
+  void PSSetSamplers(UINT start, UINT count,
+    ID3D11SamplerState *const *samplers);
+
+  // Output merger and rasteriser
+  void OMSetBlendState(ID3D11BlendState *state, const FLOAT blend_factor[4],
+    UINT sample_mask);
+  void OMSetDepthStencilState(ID3D11DepthStencilState *state,
+    UINT stencil_ref);
+  void RSSetState(ID3D11RasterizerState *state);
+
+  // Always issued; shader resources bound to the new targets are unbound by
+  // the device, so bound ones are forgotten
+  void OMSetRenderTargets(UINT count, ID3D11RenderTargetView *const *views,
+    ID3D11DepthStencilView *depth);
+
+  // Go to the constant ring if there is one and it has room, see
+  // set_constant_ring; passed through to the backend otherwise
+  HRESULT Map(ID3D11Resource *resource, UINT subresource, D3D11_MAP type,
+    UINT flags, D3D11_MAPPED_SUBRESOURCE *mapped);
+  void Unmap(ID3D11Resource *resource, UINT subresource);
+
+  // Passed through to the backend
+  inline void RSSetViewports(UINT count, const D3D11_VIEWPORT *viewports) {
+    backend_->RSSetViewports(count, viewports);
+  }
+  inline void UpdateSubresource(ID3D11Resource *resource, UINT subresource,
+    const D3D11_BOX *box, const void *data, UINT row_pitch,
+    UINT depth_pitch) {
+    backend_->UpdateSubresource(resource, subresource, box, data, row_pitch,
+      depth_pitch);
+  }
+  inline void CopyResource(ID3D11Resource *dst, ID3D11Resource *src) {
+    backend_->CopyResource(dst, src);
+  }
+  inline void GenerateMips(ID3D11ShaderResourceView *view) {
+    backend_->GenerateMips(view);
+  }
+  inline void ClearRenderTargetView(ID3D11RenderTargetView *view,
+    const FLOAT colour[4]) {
+    backend_->ClearRenderTargetView(view, colour);
+  }
+  inline void ClearDepthStencilView(ID3D11DepthStencilView *view, UINT flags,
+    FLOAT depth, UINT8 stencil) {
+    backend_->ClearDepthStencilView(view, flags, depth, stencil);
+  }
+  inline void Draw(UINT vertex_count, UINT start_vertex) {
+    backend_->Draw(vertex_count, start_vertex);
+  }
+  inline void DrawIndexed(UINT index_count, UINT start_index,
+    INT base_vertex) {
+    backend_->DrawIndexed(index_count, start_index, base_vertex);
+  }
+  inline void DrawIndexedInstanced(UINT index_count, UINT instance_count,
+    UINT start_index, INT base_vertex, UINT start_instance) {
+    backend_->DrawIndexedInstanced(index_count, instance_count, start_index,
+      base_vertex, start_instance);
+  }
+
+  // Disable ctors
+  StateCache(const StateCache &) = delete;
+  StateCache &operator=(const StateCache &) = delete;
+
+private:
+  friend class CommandList;
+
+  StateCache();
+  ~StateCache();
+
+  // Make Inst() return a cache on the calling thread; nullptr goes back to
+  // the global instance
+  static void SetThreadInst(StateCache *cache);
+
+  // Add the binds counted by another cache to this one's, and reset them
+  void MergeStats(StateCache *other);
+
+  enum ShaderStage {
+    kStageVS = 0,
+    kStageHS,
+    kStageDS,
+    kStageGS,
+    kStagePS,
+    kStageCount
+  };
+
+  // Bindings of a shader stage
+  struct Stage {
+    ValueFilter<ID3D11DeviceChild *> shader;
+    SlotFilter<ID3D11Buffer *,
+      D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT> constant_buffers;
+    SlotFilter<ID3D11ShaderResourceView *,
+      D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT> resources;
+    SlotFilter<ID3D11SamplerState *,
+      D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT> samplers;
+  };
+
+  struct VertexBufferBinding {
+    ID3D11Buffer *buffer;
+    UINT stride;
+    UINT offset;
+
+    VertexBufferBinding() :
+      buffer(nullptr),
+      stride(0),
+      offset(0) {}
+
+    inline bool operator==(const VertexBufferBinding &other) const {
+      return buffer == other.buffer && stride == other.stride &&
+        offset == other.offset;
+    }
+  };
+
+  struct IndexBufferBinding {
+    ID3D11Buffer *buffer;
+    DXGI_FORMAT format;
+    UINT offset;
+
+    IndexBufferBinding() :
+      buffer(nullptr),
+      format(DXGI_FORMAT_UNKNOWN),
+      offset(0) {}
+
+    inline bool operator==(const IndexBufferBinding &other) const {
+      return buffer == other.buffer && format == other.format &&
+        offset == other.offset;
+    }
+  };
+
+  struct BlendBinding {
+    ID3D11BlendState *state;
+    FLOAT factor[4];
+    UINT sample_mask;
+
+    BlendBinding() :
+      state(nullptr),
+      sample_mask(0) {
+      factor[0] = factor[1] = factor[2] = factor[3] = 0.f;
+    }
+
+    inline bool operator==(const BlendBinding &other) const {
+      return state == other.state && sample_mask == other.sample_mask &&
+        factor[0] == other.factor[0] && factor[1] == other.factor[1] &&
+        factor[2] == other.factor[2] && factor[3] == other.factor[3];
+    }
+  };
+
+  struct DepthStencilBinding {
+    ID3D11DepthStencilState *state;
+    UINT stencil_ref;
+
+    DepthStencilBinding() :
+      state(nullptr),
+      stencil_ref(0) {}
+
+    inline bool operator==(const DepthStencilBinding &other) const {
+      return state == other.state && stencil_ref == other.stencil_ref;
+    }
+  };
+
+  // Count a bind and return whether to issue it
+  inline bool Count(bool issue) {
+    if (issue) {
+      ++stats_.issued;
+    }
+    else {
+      ++stats_.filtered;
+    }
+    return issue;
+  }
+
+  bool SetShader(ShaderStage stage, ID3D11DeviceChild *shader);
+
+  // Where the contents of a constant buffer are in the ring
+  struct RingRange {
+    ID3D11Buffer *buffer;
+    UInt32 offset;
+    UInt32 size;
+  };
+
+  // Range of a buffer in the ring, or nullptr if it is bound whole
+  const RingRange *FindRingRange(ID3D11Buffer *buffer) const;
+
+  // Send constant buffer binds to the backend, as ranges of the ring for
+  // the buffers which are in it
+  void IssueConstantBuffers(ShaderStage stage, UINT start, UINT count,
+    ID3D11Buffer *const *buffers);
+
+  // Bind a buffer again wherever it is bound, after it moved in or out of
+  // the ring
+  void RebindConstantBuffer(ID3D11Buffer *buffer);
+
+  GfxBackend *backend_;
+
+  ValueFilter<ID3D11InputLayout *> input_layout_;
+  ValueFilter<D3D11_PRIMITIVE_TOPOLOGY> topology_;
+  SlotFilter<VertexBufferBinding,
+    D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT> vertex_buffers_;
+  ValueFilter<IndexBufferBinding> index_buffer_;
+  Stage stages_[kStageCount];
+  ValueFilter<BlendBinding> blend_;
+  ValueFilter<DepthStencilBinding> depth_stencil_;
+  ValueFilter<ID3D11RasterizerState *> rasterizer_;
+
+  // Not owned
+  ConstantRing *ring_;
+  // Buffers written to the ring since it was set, and those mapped to it
+  // which were not unmapped yet; a failed allocation has no offset
+  std::vector<RingRange> ring_ranges_;
+  std::vector<RingRange> ring_maps_;
+
+  StateCacheStats stats_;
+  StateCacheStats frame_stats_;
+
+  // Interned state objects, with the descriptions they were created from
+  std::vector<std::pair<D3D11_SAMPLER_DESC, ID3D11SamplerState *>> samplers_;
+  std::vector<std::pair<D3D11_BLEND_DESC, ID3D11BlendState *>> blend_states_;
+  std::vector<std::pair<D3D11_RASTERIZER_DESC, ID3D11RasterizerState *>>
+    raster_states_;
+
+  // Ptr to single global instance
+  static StateCache *single_instance_;
+
+}; // class StateCache
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,134 @@
+//  Redundant state filters
+//  * Remember the value last bound to a piece of pipeline state
+//  * Report whether a new bind changes anything, and which slots of a range
+//    actually changed, so that only those are sent to the device
+//  * State starts out unknown, so that the first bind is always issued
+
+#ifndef _STATE_FILTER_H
+#define _STATE_FILTER_H
+
+#include "abertay_framework.h"
+
+namespace sz {
+
+// A single piece of state, e.g. the bound pixel shader
+template <typename T>
+class ValueFilter {
+public:
+  ValueFilter() :
+    value_(),
+    known_(false) {
+  }
+
+  // Forget the bound value; the next Set is issued whatever its value
+  inline void Invalidate() {
+    known_ = false;
+  }
+
+  // Record a bind; returns whether it has to be issued
+  inline bool Set(const T &value) {
+    if (known_ && value_ == value) {
+      return false;
+    }
+
+    value_ = value;
+    known_ = true;
+    return true;
+  }
+
+  inline const T &value() const {
+    return value_;
+  }
+  inline bool known() const {
+    return known_;
+  }
+
+private:
+  T value_;
+  bool known_;
+
+}; // class ValueFilter
+
+// An array of N slots, e.g. the shader resources of a stage. T() is the
+// unbound value.
+template <typename T, UInt32 N>
+class SlotFilter {
+public:
+  SlotFilter() {
+    Invalidate();
+  }
+
+  // Forget all the bound values
+  inline void Invalidate() {
+    for (UInt32 i = 0; i < N; ++i) {
+      values_[i] = T();
+      known_[i] = false;
+    }
+  }
+
+  // Forget the slots which are bound to something; used when the device may
+  // have unbound them on its own, e.g. when their resource became a render
+  // target. Slots known to be unbound stay known.
+  inline void InvalidateBound() {
+    for (UInt32 i = 0; i < N; ++i) {
+      if (!(values_[i] == T())) {
+        known_[i] = false;
+      }
+    }
+  }
+
+  // Record a bind of count values from slot start. Returns whether it has
+  // to be issued, and if so the smallest range of slots which covers all
+  // the changes, in first and changed_count.
+  inline bool Set(UInt32 start, UInt32 count, const T *values,
+    UInt32 &first, UInt32 &changed_count) {
+    UInt32 lo = N, hi = 0;
+    for (UInt32 i = 0; i < count && start + i < N; ++i) {
+      UInt32 slot = start + i;
+      if (!known_[slot] || !(values_[slot] == values[i])) {
+        values_[slot] = values[i];
+        known_[slot] = true;
+        if (lo == N) {
+          lo = slot;
+        }
+        hi = slot + 1;
+      }
+    }
+
+    if (lo == N) {
+      return false;
+    }
+
+    first = lo;
+    changed_count = hi - lo;
+    return true;
+  }
+
+  // One past the last slot which may be bound to something, 0 if all of
+  // them are known to be unbound
+  inline UInt32 BoundEnd() const {
+    for (UInt32 i = N; i > 0; --i) {
+      if (!known_[i - 1] || !(values_[i - 1] == T())) {
+        return i;
+      }
+    }
+
+    return 0;
+  }
+
+  inline const T &value(UInt32 slot) const {
+    return values_[slot];
+  }
+  inline bool known(UInt32 slot) const {
+    return known_[slot];
+  }
+
+private:
+  T values_[N];
+  bool known_[N];
+
+}; // class SlotFilter
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _TEXTURE_HANDLE_H
+#define _TEXTURE_HANDLE_H
+
+#include "abertay_framework.h"
+
+// Small handle to a texture owned by the Texture manager.
+// The index addresses a dense array of slots; the generation is bumped every
+// time a slot is freed, so that handles to a freed texture are detected
+// instead of silently resolving to whatever reused the slot.
+struct TextureHandle {
+  static const UInt32 kInvalidIndex = 0xFFFFFFFF;
+
+  UInt32 index;
+  UInt32 generation;
+
+  TextureHandle() :
+    index(kInvalidIndex),
+    generation(0) {}
+  TextureHandle(UInt32 idx, UInt32 gen) :
+    index(idx),
+    generation(gen) {}
+
+  inline bool valid() const {
+    return index != kInvalidIndex;
+  }
+
+  inline bool operator==(const TextureHandle &other) const {
+    return index == other.index && generation == other.generation;
+  }
+  inline bool operator!=(const TextureHandle &other) const {
+    return !(*this == other);
+  }
+};
+
+#endif
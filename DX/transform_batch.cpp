@@ -0,0 +1,144 @@
+#include "transform_batch.h"
+#include <cstring>
+#include <xmmintrin.h>
+
+namespace sz {
+
+namespace {
+
+// A matrix with each element splat across a register
+struct SplatMatrix {
+  __m128 m[4][4];
+};
+
+void Splat(const XMMATRIX &matrix, SplatMatrix &splat) {
+  XMFLOAT4X4 f;
+  XMStoreFloat4x4(&f, matrix);
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      splat.m[r][c] = _mm_set1_ps(f.m[r][c]);
+    }
+  }
+}
+
+// Transpose of world times b, from the transpose of world: row c of it is
+// the columns of world weighted by column c of b, so that it takes no
+// shuffles
+inline XMMATRIX MultiplyTransposed(const XMMATRIX &world_t,
+  const SplatMatrix &b) {
+  XMMATRIX result;
+  for (int c = 0; c < 4; ++c) {
+    result.r[c] = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(world_t.r[0], b.m[0][c]),
+        _mm_mul_ps(world_t.r[1], b.m[1][c])),
+      _mm_add_ps(_mm_mul_ps(world_t.r[2], b.m[2][c]),
+        _mm_mul_ps(world_t.r[3], b.m[3][c])));
+  }
+
+  return result;
+}
+
+} // namespace
+
+TransformBatch::TransformBatch() :
+    worlds_(),
+    entries_(nullptr),
+    capacity_(0) {
+  XMStoreFloat4x4(&view_, XMMatrixIdentity());
+  XMStoreFloat4x4(&projection_, XMMatrixIdentity());
+  for (UInt32 l = 0; l < kNumLights; ++l) {
+    XMStoreFloat4x4(&lights_view_projection_[l], XMMatrixIdentity());
+  }
+}
+
+TransformBatch::~TransformBatch() {
+  if (entries_ != nullptr) {
+    _mm_free(entries_);
+    entries_ = nullptr;
+  }
+}
+
+void TransformBatch::SetLight(UInt32 light, const XMMATRIX &view,
+  const XMMATRIX &projection) {
+  if (light < kNumLights) {
+    XMStoreFloat4x4(&lights_view_projection_[light],
+      XMMatrixMultiply(view, projection));
+  }
+}
+
+void TransformBatch::Begin(const XMMATRIX &view, const XMMATRIX &projection) {
+  XMStoreFloat4x4(&view_, view);
+  XMStoreFloat4x4(&projection_, projection);
+  worlds_.clear();
+}
+
+UInt32 TransformBatch::Add(const XMMATRIX &world) {
+  XMFLOAT4X4 w;
+  XMStoreFloat4x4(&w, world);
+
+  if (!worlds_.empty() &&
+    memcmp(&worlds_.back(), &w, sizeof(XMFLOAT4X4)) == 0) {
+    return static_cast<UInt32>(worlds_.size() - 1);
+  }
+
+  worlds_.push_back(w);
+
+  return static_cast<UInt32>(worlds_.size() - 1);
+}
+
+void TransformBatch::Compute() {
+  UInt32 count = size();
+  if (count > capacity_) {
+    if (entries_ != nullptr) {
+      _mm_free(entries_);
+    }
+    capacity_ = count > 2 * capacity_ ? count : 2 * capacity_;
+    entries_ = static_cast<MatrixBufferType *>(
+      _mm_malloc(sizeof(MatrixBufferType) * capacity_, 16));
+  }
+
+  // What is the same for all the draws is loaded and transposed once
+  XMMATRIX view = XMLoadFloat4x4(&view_);
+  XMMATRIX projection = XMLoadFloat4x4(&projection_);
+  XMMATRIX view_t = XMMatrixTranspose(view);
+  XMMATRIX projection_t = XMMatrixTranspose(projection);
+  // Splat, as the products are worked out from the transposed world
+  // matrices
+  SplatMatrix view_projection;
+  Splat(XMMatrixMultiply(view, projection), view_projection);
+  SplatMatrix lights[kNumLights];
+  for (UInt32 l = 0; l < kNumLights; ++l) {
+    Splat(XMLoadFloat4x4(&lights_view_projection_[l]), lights[l]);
+  }
+
+  for (UInt32 i = 0; i < count; ++i) {
+    XMMATRIX world_t = XMMatrixTranspose(XMLoadFloat4x4(&worlds_[i]));
+    MatrixBufferType &entry = entries_[i];
+    entry.world = world_t;
+    entry.view = view_t;
+    entry.projection = projection_t;
+    entry.world_view_projection =
+      MultiplyTransposed(world_t, view_projection);
+    for (UInt32 l = 0; l < kNumLights; ++l) {
+      entry.world_lights_view_projection[l] =
+        MultiplyTransposed(world_t, lights[l]);
+    }
+  }
+}
+
+void TransformBatch::ComputeEntry(const XMMATRIX &world,
+  const XMMATRIX &view, const XMMATRIX &projection,
+  const XMFLOAT4X4 *lights_view_projection, MatrixBufferType &entry) {
+  entry.world = XMMatrixTranspose(world);
+  entry.view = XMMatrixTranspose(view);
+  entry.projection = XMMatrixTranspose(projection);
+  entry.world_view_projection = XMMatrixMultiplyTranspose(world,
+    XMMatrixMultiply(view, projection));
+  for (UInt32 l = 0; l < kNumLights; ++l) {
+    entry.world_lights_view_projection[l] = lights_view_projection !=
+      nullptr ? XMMatrixMultiplyTranspose(world,
+        XMLoadFloat4x4(&lights_view_projection[l])) : entry.world;
+  }
+}
+
+} // namespace sz
@@ -0,0 +1,93 @@
+//  Batched transforms of the draws of a pass
+//  * The matrices the shaders of each draw read are worked out for all the
+//    draws in one go, into one contiguous array, rather than in every
+//    SetShaderParameters
+//  * Entries are laid out as MatrixBufferType and already transposed, so
+//    that a draw only copies its entry into the constant buffer
+//  * Besides world, view and projection, an entry holds world times view
+//    times projection, and world times the view and projection of each
+//    light, so that vertex shaders do one product per space instead of
+//    two or three
+//  * Products are worked out from the transposed world matrix, against
+//    the elements of the other splat once per batch, so that they take no
+//    shuffles; the cost is mostly in writing the entries
+//  * Draws in a row with the same world matrix share an entry, as the
+//    meshes of a model do
+
+#ifndef _TRANSFORM_BATCH_H
+#define _TRANSFORM_BATCH_H
+
+#include <vector>
+#include <directxmath.h>
+#include "abertay_framework.h"
+#include "buffer_types.h"
+
+namespace sz {
+
+using namespace DirectX;
+
+class TransformBatch {
+public:
+  // Ctor
+  TransformBatch();
+
+  // Dtor
+  ~TransformBatch();
+
+  // Set the matrices of a light for the batches which follow; lights which
+  // were never set have identity matrices
+  void SetLight(UInt32 light, const XMMATRIX &view,
+    const XMMATRIX &projection);
+
+  // Start a batch of draws seen through view and projection, dropping the
+  // draws of the last one
+  void Begin(const XMMATRIX &view, const XMMATRIX &projection);
+
+  // Queue the world matrix of a draw and return the index of its entry
+  UInt32 Add(const XMMATRIX &world);
+
+  // Work out the entries of all the queued draws
+  void Compute();
+
+  // Work out the entry of a single draw, for the draws which are not part
+  // of a batch; lights_view_projection holds the view times projection of
+  // each light, as lights_view_projection() does, or is nullptr for
+  // identity matrices
+  static void ComputeEntry(const XMMATRIX &world, const XMMATRIX &view,
+    const XMMATRIX &projection, const XMFLOAT4X4 *lights_view_projection,
+    MatrixBufferType &entry);
+
+  inline const MatrixBufferType &entry(UInt32 index) const {
+    return entries_[index];
+  }
+  // View times projection of each light, kNumLights of them
+  inline const XMFLOAT4X4 *lights_view_projection() const {
+    return lights_view_projection_;
+  }
+  inline UInt32 size() const {
+    return static_cast<UInt32>(worlds_.size());
+  }
+
+  // Disable ctors
+  TransformBatch(const TransformBatch &) = delete;
+  TransformBatch &operator=(const TransformBatch &) = delete;
+
+private:
+  // Kept unaligned, as the batch may live in memory which is not 16 byte
+  // aligned
+  XMFLOAT4X4 view_;
+  XMFLOAT4X4 projection_;
+  XMFLOAT4X4 lights_view_projection_[kNumLights];
+
+  // World matrices of the queued draws
+  std::vector<XMFLOAT4X4> worlds_;
+
+  // Entries of the draws; 16 byte aligned
+  MatrixBufferType *entries_;
+  UInt32 capacity_;
+
+}; // class TransformBatch
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,271 @@
+#include "virtual_texture_cache.h"
+#include <algorithm>
+
+namespace sz {
+
+VtPageTable::VtPageTable(UInt32 slots_w, UInt32 slots_h) :
+    slots_w_(slots_w),
+    slots_h_(slots_h),
+    slots_(slots_w * slots_h),
+    free_slots_(),
+    lru_slots_(),
+    textures_() {
+  // Hand out slots in order, starting from the first one
+  free_slots_.reserve(slots_.size());
+  for (size_t i = slots_.size(); i > 0; --i) {
+    Slot &slot = slots_[i - 1];
+    slot.page = kVtNoPage;
+    slot.last_used = 0;
+    slot.locked = false;
+    free_slots_.push_back(static_cast<UInt32>(i - 1));
+  }
+}
+
+UInt32 VtPageTable::AddTexture(UInt32 tiles_w, UInt32 tiles_h) {
+  if (textures_.size() >= kVtMaxTextures || tiles_w == 0 || tiles_h == 0 ||
+    tiles_w > kVtMaxTiles || tiles_h > kVtMaxTiles) {
+    return kNoVirtualTexture;
+  }
+
+  VirtualTexture texture;
+  texture.tiles_w = tiles_w;
+  texture.tiles_h = tiles_h;
+  texture.dirty = true;
+
+  // Halve down to a single tile
+  texture.mip_count = 1;
+  size_t entries = 0;
+  for (UInt32 w = tiles_w, h = tiles_h; ; w = std::max(w >> 1, 1u),
+    h = std::max(h >> 1, 1u)) {
+    texture.mip_offsets.push_back(entries);
+    entries += w * h;
+    if (w == 1 && h == 1) {
+      break;
+    }
+    ++texture.mip_count;
+  }
+  texture.indirection.assign(entries, 0);
+  texture.page_slots.assign(entries, 0);
+
+  textures_.push_back(texture);
+
+  return static_cast<UInt32>(textures_.size() - 1);
+}
+
+void VtPageTable::MapPage(VtPage page, UInt32 slot, UInt32 frame,
+  VtPageLoad &load) {
+  slots_[slot].page = page;
+  slots_[slot].last_used = frame;
+  PageSlot(page) = slot + 1;
+  textures_[VtPageTexture(page)].dirty = true;
+
+  load.page = page;
+  load.slot_x = slot % slots_w_;
+  load.slot_y = slot / slots_w_;
+}
+
+bool VtPageTable::LockPage(VtPage page, VtPageLoad &load) {
+  if (IsResident(page) || free_slots_.empty()) {
+    return false;
+  }
+
+  UInt32 slot = free_slots_.back();
+  free_slots_.pop_back();
+  MapPage(page, slot, 0, load);
+  slots_[slot].locked = true;
+
+  return true;
+}
+
+bool VtPageTable::AcquireSlot(UInt32 frame, UInt32 &slot, VtStats &stats) {
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    return true;
+  }
+
+  while (!lru_slots_.empty()) {
+    slot = lru_slots_.back();
+    lru_slots_.pop_back();
+
+    // Skip slots which were refilled or used since the list was built
+    Slot &candidate = slots_[slot];
+    if (candidate.locked || candidate.last_used >= frame) {
+      continue;
+    }
+
+    // Evict the page it holds
+    if (candidate.page != kVtNoPage) {
+      PageSlot(candidate.page) = 0;
+      textures_[VtPageTexture(candidate.page)].dirty = true;
+      candidate.page = kVtNoPage;
+      ++stats.pages_evicted;
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+void VtPageTable::Update(const std::vector<VtPageRequest> &requests,
+  UInt32 frame, UInt32 max_loads, std::vector<VtPageLoad> &loads,
+  VtStats &stats) {
+  loads.clear();
+
+  // Mark resident pages first, so that none of them is picked for eviction
+  for (const VtPageRequest &request : requests) {
+    UInt32 slot = PageSlot(request.page);
+    if (slot != 0) {
+      slots_[slot - 1].last_used = frame;
+      ++stats.pages_resident;
+    }
+  }
+
+  // Eviction candidates, least recently used last
+  lru_slots_.clear();
+  if (free_slots_.size() < requests.size()) {
+    for (UInt32 i = 0; i < slots_.size(); ++i) {
+      if (!slots_[i].locked && slots_[i].last_used < frame) {
+        lru_slots_.push_back(i);
+      }
+    }
+    std::sort(lru_slots_.begin(), lru_slots_.end(),
+      [&](UInt32 a, UInt32 b) {
+        return slots_[a].last_used > slots_[b].last_used;
+    });
+  }
+
+  // Then map the missing ones, in order of priority
+  for (const VtPageRequest &request : requests) {
+    if (IsResident(request.page)) {
+      continue;
+    }
+
+    UInt32 slot = 0;
+    if (loads.size() >= max_loads || !AcquireSlot(frame, slot, stats)) {
+      ++stats.pages_deferred;
+      continue;
+    }
+
+    VtPageLoad load;
+    MapPage(request.page, slot, frame, load);
+    loads.push_back(load);
+    ++stats.pages_loaded;
+  }
+}
+
+void VtPageTable::BuildIndirection(UInt32 texture) {
+  VirtualTexture &tex = textures_[texture];
+
+  // From the coarsest mip down, so that unmapped pages can inherit the
+  // entry of their parent
+  for (UInt32 mip = tex.mip_count; mip > 0; --mip) {
+    UInt32 m = mip - 1;
+    UInt32 w = tiles_w(texture, m), h = tiles_h(texture, m);
+    UInt32 *entries = &tex.indirection[tex.mip_offsets[m]];
+    const UInt32 *page_slots = &tex.page_slots[tex.mip_offsets[m]];
+
+    for (UInt32 y = 0; y < h; ++y) {
+      for (UInt32 x = 0; x < w; ++x) {
+        UInt32 entry = 0;
+
+        UInt32 slot = page_slots[y * w + x];
+        if (slot != 0) {
+          --slot;
+          entry = (slot % slots_w_) | ((slot / slots_w_) << 8) |
+            (m << 16) | (1 << 24);
+        }
+        else if (m + 1 < tex.mip_count) {
+          UInt32 parent_w = tiles_w(texture, m + 1);
+          UInt32 parent_x = std::min(x >> 1, parent_w - 1);
+          UInt32 parent_y = std::min(y >> 1, tiles_h(texture, m + 1) - 1);
+          entry = tex.indirection[tex.mip_offsets[m + 1] +
+            parent_y * parent_w + parent_x];
+        }
+
+        entries[y * w + x] = entry;
+      }
+    }
+  }
+
+  tex.dirty = false;
+}
+
+VtFeedbackAnalyser::VtFeedbackAnalyser() :
+    runs_(),
+    counts_() {
+}
+
+void VtFeedbackAnalyser::Analyse(const VtPage *feedback, size_t count,
+  const VtPageTable &table, std::vector<VtPageRequest> &requests,
+  VtStats &stats) {
+  requests.clear();
+  counts_.clear();
+  stats.feedback_texels += static_cast<UInt32>(count);
+
+  // Neighbouring texels mostly want the same page, so runs are collapsed
+  // before sorting; each keeps the number of texels it stood for
+  runs_.clear();
+  for (size_t i = 0; i < count; ) {
+    VtPage page = feedback[i];
+    size_t end = i + 1;
+    while (end < count && feedback[end] == page) {
+      ++end;
+    }
+    if (page != kVtNoPage) {
+      runs_.push_back(std::make_pair(page, static_cast<UInt32>(end - i)));
+    }
+    i = end;
+  }
+  std::sort(runs_.begin(), runs_.end());
+
+  for (size_t i = 0; i < runs_.size(); ) {
+    VtPage page = runs_[i].first;
+    UInt32 page_count = 0;
+    while (i < runs_.size() && runs_[i].first == page) {
+      page_count += runs_[i].second;
+      ++i;
+    }
+
+    // Drop pages which do not exist, e.g. from stale feedback
+    UInt32 texture = VtPageTexture(page);
+    UInt32 mip = VtPageMip(page);
+    if (texture >= table.texture_count() || mip >= table.mip_count(texture) ||
+      VtPageX(page) >= table.tiles_w(texture, mip) ||
+      VtPageY(page) >= table.tiles_h(texture, mip)) {
+      continue;
+    }
+
+    // The page and all of its ancestors are wanted
+    for (;;) {
+      counts_[page] += page_count;
+      if (VtPageMip(page) + 1 >= table.mip_count(texture)) {
+        break;
+      }
+      page = VtParentPage(page);
+    }
+  }
+
+  requests.reserve(counts_.size());
+  for (const std::pair<const VtPage, UInt32> &n : counts_) {
+    VtPageRequest request = { n.first, n.second };
+    requests.push_back(request);
+  }
+
+  // Coarser mips first, then the most wanted; ties by page for determinism
+  std::sort(requests.begin(), requests.end(),
+    [](const VtPageRequest &a, const VtPageRequest &b) {
+      if (VtPageMip(a.page) != VtPageMip(b.page)) {
+        return VtPageMip(a.page) > VtPageMip(b.page);
+      }
+      if (a.count != b.count) {
+        return a.count > b.count;
+      }
+      return a.page < b.page;
+  });
+
+  stats.pages_requested += static_cast<UInt32>(requests.size());
+}
+
+} // namespace sz
@@ -0,0 +1,207 @@
+//  Virtual texturing, CPU side
+//  * Virtual textures are split in fixed-size tiles (pages), for every mip
+//  * A physical cache holds a limited number of pages, in slots
+//  * Every virtual texture has an indirection table, mapping each of its
+//    pages to the slot holding it, or to the slot of the closest coarser mip
+//    which is resident
+//  * Each frame the GPU writes which pages it wanted in a feedback buffer;
+//    the analyser turns it into prioritised requests and the page table
+//    turns those into loads and evictions
+
+#ifndef _VIRTUAL_TEXTURE_CACHE_H
+#define _VIRTUAL_TEXTURE_CACHE_H
+
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include "abertay_framework.h"
+
+namespace sz {
+
+// Size of the tiles, in texels, excluding borders
+const UInt32 kVtTileSize = 128;
+// Texels replicated around each tile so that filtering does not bleed
+const UInt32 kVtTileBorder = 4;
+const UInt32 kVtPaddedTileSize = kVtTileSize + 2 * kVtTileBorder;
+// Limits of the packed page ID
+const UInt32 kVtMaxTiles = 256;
+const UInt32 kVtMaxMips = 9;
+const UInt32 kVtMaxTextures = 4095;
+// ID of no virtual texture
+const UInt32 kNoVirtualTexture = 0xFFFFFFFF;
+
+// A page is packed in 32 bits, the same way the feedback shader writes it:
+// bits 0-7 tile x, 8-15 tile y, 16-19 mip, 20-31 texture ID + 1.
+// 0 means no page, which is what the feedback buffer is cleared to.
+typedef UInt32 VtPage;
+const VtPage kVtNoPage = 0;
+
+inline VtPage PackVtPage(UInt32 texture, UInt32 mip, UInt32 x, UInt32 y) {
+  return ((texture + 1) << 20) | (mip << 16) | (y << 8) | x;
+}
+inline UInt32 VtPageTexture(VtPage page) {
+  return (page >> 20) - 1;
+}
+inline UInt32 VtPageMip(VtPage page) {
+  return (page >> 16) & 0xF;
+}
+inline UInt32 VtPageX(VtPage page) {
+  return page & 0xFF;
+}
+inline UInt32 VtPageY(VtPage page) {
+  return (page >> 8) & 0xFF;
+}
+// Page covering the same area at the next coarser mip
+inline VtPage VtParentPage(VtPage page) {
+  return PackVtPage(VtPageTexture(page), VtPageMip(page) + 1,
+    VtPageX(page) >> 1, VtPageY(page) >> 1);
+}
+
+// A page wanted by the GPU
+struct VtPageRequest {
+  VtPage page;
+  // Number of feedback texels which asked for it
+  UInt32 count;
+};
+
+// A page to copy from its source into a slot of the physical cache
+struct VtPageLoad {
+  VtPage page;
+  UInt32 slot_x;
+  UInt32 slot_y;
+};
+
+// Counters of the last update
+struct VtStats {
+  UInt32 feedback_texels;
+  UInt32 pages_requested;
+  UInt32 pages_resident;
+  UInt32 pages_loaded;
+  UInt32 pages_evicted;
+  // Requests which did not fit in the budget or in the cache
+  UInt32 pages_deferred;
+};
+
+class VtPageTable {
+public:
+  // Ctor; the cache holds slots_w * slots_h pages
+  VtPageTable(UInt32 slots_w, UInt32 slots_h);
+
+  // Register a virtual texture of the given size in tiles at mip 0 (powers
+  // of 2, at most kVtMaxTiles) and return its ID
+  UInt32 AddTexture(UInt32 tiles_w, UInt32 tiles_h);
+
+  // Number of mips of a virtual texture; the last one is a single tile
+  inline UInt32 mip_count(UInt32 texture) const {
+    return textures_[texture].mip_count;
+  }
+  inline UInt32 tiles_w(UInt32 texture, UInt32 mip) const {
+    UInt32 w = textures_[texture].tiles_w >> mip;
+    return w > 0 ? w : 1;
+  }
+  inline UInt32 tiles_h(UInt32 texture, UInt32 mip) const {
+    UInt32 h = textures_[texture].tiles_h >> mip;
+    return h > 0 ? h : 1;
+  }
+  inline UInt32 texture_count() const {
+    return static_cast<UInt32>(textures_.size());
+  }
+  inline UInt32 slot_count() const {
+    return static_cast<UInt32>(slots_.size());
+  }
+
+  inline bool IsResident(VtPage page) const {
+    return textures_[VtPageTexture(page)].page_slots[PageIndex(page)] != 0;
+  }
+
+  // Map a page to a free slot and keep it there; used for the coarsest mip
+  // of every texture, so that sampling always has a fallback.
+  // Returns false if no slot is free.
+  bool LockPage(VtPage page, VtPageLoad &load);
+
+  // Mark resident pages as used in this frame and map missing ones to free
+  // or least recently used slots, in the order given, up to max_loads.
+  // Pages used in this frame are never evicted.
+  void Update(const std::vector<VtPageRequest> &requests, UInt32 frame,
+    UInt32 max_loads, std::vector<VtPageLoad> &loads, VtStats &stats);
+
+  // Whether the indirection table of a texture changed since last built
+  inline bool IsDirty(UInt32 texture) const {
+    return textures_[texture].dirty;
+  }
+
+  // Rebuild the indirection table of a texture. Each entry is a texel of a
+  // R8G8B8A8_UINT texture: slot x, slot y, mip of the mapped page, and 1
+  // if mapped. Entries are stored mip after mip, rows of tiles_w.
+  void BuildIndirection(UInt32 texture);
+  inline const std::vector<UInt32> &indirection(UInt32 texture) const {
+    return textures_[texture].indirection;
+  }
+  // Offset of a mip within the indirection table
+  inline size_t indirection_offset(UInt32 texture, UInt32 mip) const {
+    return textures_[texture].mip_offsets[mip];
+  }
+
+private:
+  struct Slot {
+    VtPage page;
+    UInt32 last_used;
+    bool locked;
+  };
+
+  struct VirtualTexture {
+    UInt32 tiles_w, tiles_h;
+    UInt32 mip_count;
+    std::vector<size_t> mip_offsets;
+    std::vector<UInt32> indirection;
+    // Slot + 1 of each page, 0 if not resident; same layout as indirection
+    std::vector<UInt32> page_slots;
+    bool dirty;
+  };
+
+  // Index of a page within the tables of its texture
+  inline size_t PageIndex(VtPage page) const {
+    UInt32 texture = VtPageTexture(page), mip = VtPageMip(page);
+    return textures_[texture].mip_offsets[mip] +
+      VtPageY(page) * tiles_w(texture, mip) + VtPageX(page);
+  }
+  inline UInt32 &PageSlot(VtPage page) {
+    return textures_[VtPageTexture(page)].page_slots[PageIndex(page)];
+  }
+
+  // Find a slot for a new page; returns false if all are in use
+  bool AcquireSlot(UInt32 frame, UInt32 &slot, VtStats &stats);
+  void MapPage(VtPage page, UInt32 slot, UInt32 frame, VtPageLoad &load);
+
+  UInt32 slots_w_, slots_h_;
+  std::vector<Slot> slots_;
+  std::vector<UInt32> free_slots_;
+  // Eviction candidates of the current update, least recently used last
+  std::vector<UInt32> lru_slots_;
+  std::vector<VirtualTexture> textures_;
+
+}; // class VtPageTable
+
+class VtFeedbackAnalyser {
+public:
+  VtFeedbackAnalyser();
+
+  // Turn a feedback buffer into page requests, coarser mips first and then
+  // the most wanted ones; ancestors of the pages asked for are requested
+  // too, so that they are resident before their children.
+  void Analyse(const VtPage *feedback, size_t count,
+    const VtPageTable &table, std::vector<VtPageRequest> &requests,
+    VtStats &stats);
+
+private:
+  // Runs of texels which want the same page, and their lengths; reused
+  // between frames to avoid allocations
+  std::vector<std::pair<VtPage, UInt32>> runs_;
+  std::unordered_map<VtPage, UInt32> counts_;
+
+}; // class VtFeedbackAnalyser
+
+} // namespace sz
+
+#endif
@@ -0,0 +1,166 @@
+#include "virtual_texture_cook.h"
+#include <algorithm>
+#include <cstring>
+
+namespace sz {
+
+namespace {
+
+// Smallest power of 2 not less than v
+UInt32 NextPow2(UInt32 v) {
+  UInt32 p = 1;
+  while (p < v) {
+    p <<= 1;
+  }
+  return p;
+}
+
+// Bilinear resize of an RGBA8 image
+void Resize(const UInt8 *src, UInt32 src_w, UInt32 src_h,
+  std::vector<UInt8> &dst, UInt32 dst_w, UInt32 dst_h) {
+  dst.resize(static_cast<size_t>(dst_w) * dst_h * 4);
+  float scale_x = static_cast<float>(src_w) / dst_w;
+  float scale_y = static_cast<float>(src_h) / dst_h;
+
+  for (UInt32 y = 0; y < dst_h; ++y) {
+    float fy = std::max((y + 0.5f) * scale_y - 0.5f, 0.f);
+    UInt32 y0 = std::min(static_cast<UInt32>(fy), src_h - 1);
+    UInt32 y1 = std::min(y0 + 1, src_h - 1);
+    float ty = fy - y0;
+
+    for (UInt32 x = 0; x < dst_w; ++x) {
+      float fx = std::max((x + 0.5f) * scale_x - 0.5f, 0.f);
+      UInt32 x0 = std::min(static_cast<UInt32>(fx), src_w - 1);
+      UInt32 x1 = std::min(x0 + 1, src_w - 1);
+      float tx = fx - x0;
+
+      for (UInt32 c = 0; c < 4; ++c) {
+        float top = src[(y0 * src_w + x0) * 4 + c] * (1.f - tx) +
+          src[(y0 * src_w + x1) * 4 + c] * tx;
+        float bottom = src[(y1 * src_w + x0) * 4 + c] * (1.f - tx) +
+          src[(y1 * src_w + x1) * 4 + c] * tx;
+        dst[(static_cast<size_t>(y) * dst_w + x) * 4 + c] =
+          static_cast<UInt8>(top * (1.f - ty) + bottom * ty + 0.5f);
+      }
+    }
+  }
+}
+
+// Box filter to the next mip; a side already 1 tile wide is kept as it is
+void Downsample(const std::vector<UInt8> &src, UInt32 src_w, UInt32 src_h,
+  std::vector<UInt8> &dst, UInt32 dst_w, UInt32 dst_h) {
+  dst.resize(static_cast<size_t>(dst_w) * dst_h * 4);
+  UInt32 step_x = src_w / dst_w, step_y = src_h / dst_h;
+
+  for (UInt32 y = 0; y < dst_h; ++y) {
+    for (UInt32 x = 0; x < dst_w; ++x) {
+      for (UInt32 c = 0; c < 4; ++c) {
+        UInt32 sum = 0;
+        for (UInt32 sy = 0; sy < step_y; ++sy) {
+          for (UInt32 sx = 0; sx < step_x; ++sx) {
+            sum += src[((static_cast<size_t>(y) * step_y + sy) * src_w +
+              x * step_x + sx) * 4 + c];
+          }
+        }
+        dst[(static_cast<size_t>(y) * dst_w + x) * 4 + c] =
+          static_cast<UInt8>((sum + step_x * step_y / 2) / (step_x * step_y));
+      }
+    }
+  }
+}
+
+} // namespace
+
+VtTileSource::VtTileSource() :
+    tiles_w_(0),
+    tiles_h_(0),
+    mip_offsets_(),
+    tiles_() {
+}
+
+bool VtTileSource::Cook(const UInt8 *rgba, UInt32 width, UInt32 height) {
+  mip_offsets_.clear();
+  tiles_.clear();
+
+  if (rgba == nullptr || width == 0 || height == 0) {
+    return false;
+  }
+
+  tiles_w_ = NextPow2((width + kVtTileSize - 1) / kVtTileSize);
+  tiles_h_ = NextPow2((height + kVtTileSize - 1) / kVtTileSize);
+  if (tiles_w_ > kVtMaxTiles || tiles_h_ > kVtMaxTiles) {
+    return false;
+  }
+
+  // Mip 0, stretched to whole tiles so that UVs still cover [0, 1]
+  UInt32 w = tiles_w_ * kVtTileSize, h = tiles_h_ * kVtTileSize;
+  std::vector<UInt8> image, next_image;
+  if (w == width && h == height) {
+    image.assign(rgba, rgba + static_cast<size_t>(width) * height * 4);
+  }
+  else {
+    Resize(rgba, width, height, image, w, h);
+  }
+
+  // Count the tiles of all the mips
+  size_t tile_count = 0;
+  for (UInt32 tw = tiles_w_, th = tiles_h_; ; tw = std::max(tw >> 1, 1u),
+    th = std::max(th >> 1, 1u)) {
+    mip_offsets_.push_back(tile_count);
+    tile_count += tw * th;
+    if (tw == 1 && th == 1) {
+      break;
+    }
+  }
+  tiles_.resize(tile_count * kTileBytes);
+
+  for (UInt32 mip = 0; mip < mip_count(); ++mip) {
+    UInt32 tw = w / kVtTileSize, th = h / kVtTileSize;
+
+    // Cut the mip in tiles, clamping the borders at the edges of the image
+    for (UInt32 ty = 0; ty < th; ++ty) {
+      for (UInt32 tx = 0; tx < tw; ++tx) {
+        UInt8 *tile = &tiles_[(mip_offsets_[mip] + ty * tw + tx) * kTileBytes];
+        for (UInt32 y = 0; y < kVtPaddedTileSize; ++y) {
+          Int32 src_y = static_cast<Int32>(ty * kVtTileSize + y) -
+            static_cast<Int32>(kVtTileBorder);
+          src_y = std::min(std::max(src_y, 0), static_cast<Int32>(h) - 1);
+          for (UInt32 x = 0; x < kVtPaddedTileSize; ++x) {
+            Int32 src_x = static_cast<Int32>(tx * kVtTileSize + x) -
+              static_cast<Int32>(kVtTileBorder);
+            src_x = std::min(std::max(src_x, 0), static_cast<Int32>(w) - 1);
+            memcpy(tile + (y * kVtPaddedTileSize + x) * 4,
+              &image[(static_cast<size_t>(src_y) * w + src_x) * 4], 4);
+          }
+        }
+      }
+    }
+
+    if (mip + 1 < mip_count()) {
+      UInt32 next_w = std::max(w >> 1, kVtTileSize);
+      UInt32 next_h = std::max(h >> 1, kVtTileSize);
+      Downsample(image, w, h, next_image, next_w, next_h);
+      image.swap(next_image);
+      w = next_w;
+      h = next_h;
+    }
+  }
+
+  return true;
+}
+
+const UInt8 *VtTileSource::GetTile(UInt32 mip, UInt32 x, UInt32 y) const {
+  if (mip >= mip_count()) {
+    return nullptr;
+  }
+
+  UInt32 tw = std::max(tiles_w_ >> mip, 1u);
+  UInt32 th = std::max(tiles_h_ >> mip, 1u);
+  if (x >= tw || y >= th) {
+    return nullptr;
+  }
+
+  return &tiles_[(mip_offsets_[mip] + y * tw + x) * kTileBytes];
+}
+
+} // namespace sz
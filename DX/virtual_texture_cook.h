@@ -0,0 +1,52 @@
+//  Tile cooking for virtual textures
+//  * An RGBA8 image is resized to a power of 2 number of tiles per side
+//  * Its mip chain is built down to a single tile
+//  * Every mip is cut into tiles with replicated borders, stored one after
+//    the other, so that streaming a page in is a single copy
+
+#ifndef _VIRTUAL_TEXTURE_COOK_H
+#define _VIRTUAL_TEXTURE_COOK_H
+
+#include <cstddef>
+#include <vector>
+#include "abertay_framework.h"
+#include "virtual_texture_cache.h"
+
+namespace sz {
+
+class VtTileSource {
+public:
+  VtTileSource();
+
+  // Cook an RGBA8 image; returns false if it is too big to be virtualised
+  bool Cook(const UInt8 *rgba, UInt32 width, UInt32 height);
+
+  // Size of mip 0 in tiles
+  inline UInt32 tiles_w() const {
+    return tiles_w_;
+  }
+  inline UInt32 tiles_h() const {
+    return tiles_h_;
+  }
+  inline UInt32 mip_count() const {
+    return static_cast<UInt32>(mip_offsets_.size());
+  }
+
+  // Padded RGBA8 tile, kVtPaddedTileSize texels per side
+  const UInt8 *GetTile(UInt32 mip, UInt32 x, UInt32 y) const;
+
+  // Bytes of a padded tile
+  static const size_t kTileBytes =
+    kVtPaddedTileSize * kVtPaddedTileSize * 4;
+
+private:
+  UInt32 tiles_w_, tiles_h_;
+  // Index of the first tile of each mip
+  std::vector<size_t> mip_offsets_;
+  std::vector<UInt8> tiles_;
+
+}; // class VtTileSource
+
+} // namespace sz
+
+#endif
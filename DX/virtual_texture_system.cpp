@@ -0,0 +1,362 @@
+#include "virtual_texture_system.h"
+#include "state_cache.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <lodepng.h>
+#include "Model.h"
+#include "Material.h"
+#include "Texture.h"
+#include "crc.h"
+#include "shader_resource_manager.h"
+#include "vt_feedback_shader.h"
+
+namespace sz {
+
+VirtualTextureSystem::VirtualTextureSystem(ID3D11Device *device, HWND hwnd,
+  ConstBufManager &buf_man, ShaderManager *sha_man,
+  UInt32 feedback_w, UInt32 feedback_h) :
+    page_table_(kCacheSlots, kCacheSlots),
+    analyser_(),
+    textures_(),
+    texture_ids_(),
+    cache_(nullptr),
+    cache_handle_(),
+    feedback_w_(feedback_w),
+    feedback_h_(feedback_h),
+    feedback_(nullptr),
+    feedback_view_(nullptr),
+    feedback_depth_(nullptr),
+    feedback_depth_view_(nullptr),
+    feedback_viewport_(),
+    staging_next_(0),
+    feedback_data_(),
+    requests_(),
+    loads_(),
+    frame_(1),
+    max_loads_(16),
+    mip_bias_(0.0f),
+    stats_() {
+  HRESULT result;
+
+  // Physical cache, registered with the texture manager so that shaders can
+  // find it like any other texture
+  D3D11_TEXTURE2D_DESC cache_desc;
+  ZeroMemory(&cache_desc, sizeof(cache_desc));
+  cache_desc.Width = kCacheSlots * kVtPaddedTileSize;
+  cache_desc.Height = kCacheSlots * kVtPaddedTileSize;
+  cache_desc.MipLevels = 1;
+  cache_desc.ArraySize = 1;
+  cache_desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+  cache_desc.SampleDesc.Count = 1;
+  cache_desc.Usage = D3D11_USAGE_DEFAULT;
+  cache_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+  D3D11_SHADER_RESOURCE_VIEW_DESC cache_view_desc;
+  ZeroMemory(&cache_view_desc, sizeof(cache_view_desc));
+  cache_view_desc.Format = cache_desc.Format;
+  cache_view_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+  cache_view_desc.Texture2D.MostDetailedMip = 0;
+  cache_view_desc.Texture2D.MipLevels = 1;
+
+  cache_ = Texture::Inst()->CreateTexture2D(device, cache_desc,
+    cache_view_desc, "vt_physical_cache");
+  cache_handle_ = Texture::Inst()->GetHandle("vt_physical_cache");
+  assert(cache_ != nullptr);
+
+  // Feedback target; cleared to 0, which is no page
+  D3D11_TEXTURE2D_DESC feedback_desc;
+  ZeroMemory(&feedback_desc, sizeof(feedback_desc));
+  feedback_desc.Width = feedback_w_;
+  feedback_desc.Height = feedback_h_;
+  feedback_desc.MipLevels = 1;
+  feedback_desc.ArraySize = 1;
+  feedback_desc.Format = DXGI_FORMAT_R32_UINT;
+  feedback_desc.SampleDesc.Count = 1;
+  feedback_desc.Usage = D3D11_USAGE_DEFAULT;
+  feedback_desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+
+  result = device->CreateTexture2D(&feedback_desc, NULL, &feedback_);
+  assert(SUCCEEDED(result));
+  result = device->CreateRenderTargetView(feedback_, NULL, &feedback_view_);
+  assert(SUCCEEDED(result));
+
+  D3D11_TEXTURE2D_DESC depth_desc = feedback_desc;
+  depth_desc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+  depth_desc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+
+  result = device->CreateTexture2D(&depth_desc, NULL, &feedback_depth_);
+  assert(SUCCEEDED(result));
+  result = device->CreateDepthStencilView(feedback_depth_, NULL,
+    &feedback_depth_view_);
+  assert(SUCCEEDED(result));
+
+  feedback_viewport_.Width = static_cast<float>(feedback_w_);
+  feedback_viewport_.Height = static_cast<float>(feedback_h_);
+  feedback_viewport_.MinDepth = 0.0f;
+  feedback_viewport_.MaxDepth = 1.0f;
+  feedback_viewport_.TopLeftX = 0.0f;
+  feedback_viewport_.TopLeftY = 0.0f;
+
+  // Read back ring
+  D3D11_TEXTURE2D_DESC staging_desc = feedback_desc;
+  staging_desc.Usage = D3D11_USAGE_STAGING;
+  staging_desc.BindFlags = 0;
+  staging_desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+  for (UInt32 i = 0; i < kReadbackLatency; ++i) {
+    staging_[i] = nullptr;
+    staging_pending_[i] = false;
+    result = device->CreateTexture2D(&staging_desc, NULL, &staging_[i]);
+    assert(SUCCEEDED(result));
+  }
+
+  feedback_data_.resize(feedback_w_ * feedback_h_);
+
+  if (sha_man != nullptr) {
+    VtFeedbackShader *shader = new VtFeedbackShader(device, hwnd, buf_man);
+    if (!sha_man->AddShader("vt_feedback_shader", shader)) {
+      delete shader;
+      shader = nullptr;
+    }
+  }
+}
+
+VirtualTextureSystem::~VirtualTextureSystem() {
+  for (TextureData &data : textures_) {
+    ReleaseNull(data.indirection_view);
+    ReleaseNull(data.indirection);
+  }
+  for (UInt32 i = 0; i < kReadbackLatency; ++i) {
+    ReleaseNull(staging_[i]);
+  }
+  ReleaseNull(feedback_depth_view_);
+  ReleaseNull(feedback_depth_);
+  ReleaseNull(feedback_view_);
+  ReleaseNull(feedback_);
+  // The view of the cache is owned by the texture manager
+  ReleaseNull(cache_);
+}
+
+UInt32 VirtualTextureSystem::AddTexture(ID3D11Device *device,
+  ID3D11DeviceContext *dev_context, const std::string &filename) {
+  UInt32 name_crc = abfw::CRC::GetICRC(filename.c_str());
+  std::unordered_map<UInt32, UInt32>::const_iterator it =
+    texture_ids_.find(name_crc);
+  if (it != texture_ids_.end()) {
+    return it->second;
+  }
+
+  std::vector<UInt8> image;
+  unsigned int width, height;
+  unsigned int error = lodepng::decode(image, width, height, filename);
+  if (error) {
+    std::cout << "Virtual texture " << filename << ": decoder error "
+      << error << ": " << lodepng_error_text(error) << std::endl;
+    return kNoVirtualTexture;
+  }
+
+  // Cook in place, as the tiles are too big to copy around
+  textures_.push_back(TextureData());
+  TextureData &data = textures_.back();
+  data.name_crc = name_crc;
+  data.indirection = nullptr;
+  data.indirection_view = nullptr;
+  if (!data.source.Cook(image.data(), width, height)) {
+    std::cout << "Virtual texture " << filename << ": too big" << std::endl;
+    textures_.pop_back();
+    return kNoVirtualTexture;
+  }
+
+  UInt32 texture = page_table_.AddTexture(data.source.tiles_w(),
+    data.source.tiles_h());
+  if (texture == kNoVirtualTexture) {
+    textures_.pop_back();
+    return kNoVirtualTexture;
+  }
+  assert(texture == textures_.size() - 1);
+  assert(page_table_.mip_count(texture) == data.source.mip_count());
+
+  // Indirection table, one texel per page, with the same mips
+  D3D11_TEXTURE2D_DESC desc;
+  ZeroMemory(&desc, sizeof(desc));
+  desc.Width = data.source.tiles_w();
+  desc.Height = data.source.tiles_h();
+  desc.MipLevels = data.source.mip_count();
+  desc.ArraySize = 1;
+  desc.Format = DXGI_FORMAT_R8G8B8A8_UINT;
+  desc.SampleDesc.Count = 1;
+  desc.Usage = D3D11_USAGE_DEFAULT;
+  desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+  HRESULT result = device->CreateTexture2D(&desc, NULL, &data.indirection);
+  assert(SUCCEEDED(result));
+  result = device->CreateShaderResourceView(data.indirection, NULL,
+    &data.indirection_view);
+  assert(SUCCEEDED(result));
+
+  texture_ids_[name_crc] = texture;
+
+  // Keep the coarsest page resident, so that sampling always has a fallback
+  std::vector<VtPageLoad> loads(1);
+  if (page_table_.LockPage(PackVtPage(texture,
+    page_table_.mip_count(texture) - 1, 0, 0), loads[0])) {
+    UploadPages(dev_context, loads);
+  }
+  else {
+    std::cout << "Virtual texture " << filename <<
+      ": no room in the cache for its coarsest mip" << std::endl;
+  }
+  UploadIndirection(dev_context);
+
+  return texture;
+}
+
+void VirtualTextureSystem::AddModelTextures(ID3D11Device *device,
+  ID3D11DeviceContext *dev_context, Model &model) {
+  // Textures the materials use for other maps than the diffuse one have to
+  // stay resident
+  std::vector<TextureHandle> other_maps;
+  for (const MeshesMatMap::value_type &map_pair : model.meshes_by_material()) {
+    const Material *mat = map_pair.second.first;
+    other_maps.push_back(mat->ambient_texture);
+    other_maps.push_back(mat->specular_texture);
+    other_maps.push_back(mat->bump_texture);
+    other_maps.push_back(mat->alpha_texture);
+  }
+
+  for (const MeshesMatMap::value_type &map_pair : model.meshes_by_material()) {
+    const Material *mat = map_pair.second.first;
+    if (mat->info().diffuse_texname == "") {
+      continue;
+    }
+
+    UInt32 texture = AddTexture(device, dev_context,
+      mat->info().diffuse_texname);
+    if (texture != kNoVirtualTexture &&
+      std::find(other_maps.begin(), other_maps.end(),
+      mat->diffuse_texture) == other_maps.end()) {
+      Texture::Inst()->FreeTexture(mat->info().diffuse_texname);
+    }
+  }
+}
+
+UInt32 VirtualTextureSystem::GetTexture(UInt32 name_crc) const {
+  std::unordered_map<UInt32, UInt32>::const_iterator it =
+    texture_ids_.find(name_crc);
+  if (it != texture_ids_.end()) {
+    return it->second;
+  }
+
+  return kNoVirtualTexture;
+}
+
+void VirtualTextureSystem::GetShaderParameters(UInt32 texture, bool feedback,
+  VirtualTextureBufferType &params) const {
+  if (texture == kNoVirtualTexture) {
+    memset(&params, 0, sizeof(params));
+    return;
+  }
+
+  params.tiles = XMFLOAT2(static_cast<float>(page_table_.tiles_w(texture, 0)),
+    static_cast<float>(page_table_.tiles_h(texture, 0)));
+  params.mip_count = static_cast<float>(page_table_.mip_count(texture));
+  params.feedback_id = texture + 1;
+  params.cache_size = XMFLOAT2(
+    static_cast<float>(kCacheSlots * kVtPaddedTileSize),
+    static_cast<float>(kCacheSlots * kVtPaddedTileSize));
+  // Sampling is at the resolution of the screen
+  params.mip_bias = feedback ? mip_bias_ : 0.0f;
+  params.padding = 0.0f;
+}
+
+void VirtualTextureSystem::BeginFeedbackPass(
+  ID3D11DeviceContext *dev_context) {
+  sz::StateCache::Inst()->OMSetRenderTargets(1, &feedback_view_,
+    feedback_depth_view_);
+  sz::StateCache::Inst()->RSSetViewports(1, &feedback_viewport_);
+
+  const float clear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  sz::StateCache::Inst()->ClearRenderTargetView(feedback_view_, clear);
+  sz::StateCache::Inst()->ClearDepthStencilView(feedback_depth_view_,
+    D3D11_CLEAR_DEPTH, 1.0f, 0);
+}
+
+void VirtualTextureSystem::EndFeedbackPass(ID3D11DeviceContext *dev_context) {
+  // Overwrite the oldest copy, even if it was never read
+  sz::StateCache::Inst()->CopyResource(staging_[staging_next_], feedback_);
+  staging_pending_[staging_next_] = true;
+  staging_next_ = (staging_next_ + 1) % kReadbackLatency;
+}
+
+void VirtualTextureSystem::Update(ID3D11DeviceContext *dev_context) {
+  // The oldest copy is the one which will be overwritten next
+  UInt32 oldest = staging_next_;
+  if (!staging_pending_[oldest]) {
+    return;
+  }
+
+  // Never wait for the GPU; try again next frame
+  D3D11_MAPPED_SUBRESOURCE mapped;
+  HRESULT result = sz::StateCache::Inst()->Map(staging_[oldest], 0,
+    D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+  if (result == DXGI_ERROR_WAS_STILL_DRAWING || FAILED(result)) {
+    return;
+  }
+
+  const UInt8 *src = static_cast<const UInt8 *>(mapped.pData);
+  for (UInt32 y = 0; y < feedback_h_; ++y) {
+    memcpy(&feedback_data_[y * feedback_w_], src + y * mapped.RowPitch,
+      feedback_w_ * sizeof(VtPage));
+  }
+  sz::StateCache::Inst()->Unmap(staging_[oldest], 0);
+  staging_pending_[oldest] = false;
+
+  memset(&stats_, 0, sizeof(stats_));
+  analyser_.Analyse(feedback_data_.data(), feedback_data_.size(),
+    page_table_, requests_, stats_);
+  page_table_.Update(requests_, frame_, max_loads_, loads_, stats_);
+  ++frame_;
+
+  UploadPages(dev_context, loads_);
+  UploadIndirection(dev_context);
+}
+
+void VirtualTextureSystem::UploadPages(ID3D11DeviceContext *dev_context,
+  const std::vector<VtPageLoad> &loads) {
+  for (const VtPageLoad &load : loads) {
+    const VtTileSource &source = textures_[VtPageTexture(load.page)].source;
+
+    D3D11_BOX box;
+    box.left = load.slot_x * kVtPaddedTileSize;
+    box.top = load.slot_y * kVtPaddedTileSize;
+    box.front = 0;
+    box.right = box.left + kVtPaddedTileSize;
+    box.bottom = box.top + kVtPaddedTileSize;
+    box.back = 1;
+
+    sz::StateCache::Inst()->UpdateSubresource(cache_, 0, &box,
+      source.GetTile(VtPageMip(load.page), VtPageX(load.page),
+      VtPageY(load.page)), kVtPaddedTileSize * 4, 0);
+  }
+}
+
+void VirtualTextureSystem::UploadIndirection(
+  ID3D11DeviceContext *dev_context) {
+  for (UInt32 texture = 0; texture < textures_.size(); ++texture) {
+    if (!page_table_.IsDirty(texture)) {
+      continue;
+    }
+
+    page_table_.BuildIndirection(texture);
+    const std::vector<UInt32> &entries = page_table_.indirection(texture);
+    for (UInt32 mip = 0; mip < page_table_.mip_count(texture); ++mip) {
+      sz::StateCache::Inst()->UpdateSubresource(textures_[texture].indirection,
+        mip, NULL, &entries[page_table_.indirection_offset(texture, mip)],
+        page_table_.tiles_w(texture, mip) * sizeof(UInt32), 0);
+    }
+  }
+}
+
+} // namespace sz
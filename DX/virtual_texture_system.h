@@ -0,0 +1,172 @@
+//  Virtual texturing, GPU side
+//  * Owns the physical page cache, the indirection textures and the
+//    feedback target
+//  * Textures are cooked into tiles when added; only the coarsest mip is
+//    uploaded straight away
+//  * Each frame the feedback target is rendered, copied to a staging
+//    texture and read back a few frames later, without stalling, to stream
+//    in the pages the GPU asked for
+
+#ifndef _VIRTUAL_TEXTURE_SYSTEM_H
+#define _VIRTUAL_TEXTURE_SYSTEM_H
+
+#include <d3d11.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "abertay_framework.h"
+#include "texture_handle.h"
+#include "virtual_texture_cache.h"
+#include "virtual_texture_cook.h"
+#include "buffer_types.h"
+
+class Model;
+namespace sz {
+  class ConstBufManager;
+  class ShaderManager;
+}
+
+namespace sz {
+
+class VirtualTextureSystem {
+public:
+  // Ctor; the feedback pass is rendered at feedback_w * feedback_h
+  VirtualTextureSystem(ID3D11Device *device, HWND hwnd,
+    ConstBufManager &buf_man, ShaderManager *sha_man,
+    UInt32 feedback_w, UInt32 feedback_h);
+
+  // Dtor
+  ~VirtualTextureSystem();
+
+  // Disable copy ctor and assignment operator
+  VirtualTextureSystem(const VirtualTextureSystem &) = delete;
+  VirtualTextureSystem &operator=(const VirtualTextureSystem &) = delete;
+
+  // Cook a PNG file into a virtual texture and return its ID, or
+  // kNoVirtualTexture if it could not be loaded. Adding the same file
+  // twice returns the same ID.
+  UInt32 AddTexture(ID3D11Device *device, ID3D11DeviceContext *dev_context,
+    const std::string &filename);
+
+  // Add the diffuse textures of all the materials of a model, and free
+  // those which were cooked from the texture manager, as the lit shaders
+  // sample the virtual textures instead
+  void AddModelTextures(ID3D11Device *device,
+    ID3D11DeviceContext *dev_context, Model &model);
+
+  // Virtual texture of a file, from the CRC of its name
+  UInt32 GetTexture(UInt32 name_crc) const;
+
+  // Parameters of the VirtualTextureBuffer for a texture, for the feedback
+  // pass or for sampling; kNoVirtualTexture gives those of no texture
+  void GetShaderParameters(UInt32 texture, bool feedback,
+    VirtualTextureBufferType &params) const;
+
+  // Indirection table of a texture, to be sampled with SampleVirtual
+  inline ID3D11ShaderResourceView *indirection_view(UInt32 texture) const {
+    return textures_[texture].indirection_view;
+  }
+
+  // The physical page cache
+  inline TextureHandle cache_texture() const {
+    return cache_handle_;
+  }
+
+  // Set the feedback target; draws in between have to use the feedback
+  // shader, with GetShaderParameters for each texture
+  void BeginFeedbackPass(ID3D11DeviceContext *dev_context);
+
+  // Queue the read back of the feedback target
+  void EndFeedbackPass(ID3D11DeviceContext *dev_context);
+
+  // Read back the oldest feedback, if the GPU is done with it, and stream
+  // in the pages it asks for
+  void Update(ID3D11DeviceContext *dev_context);
+
+  // Maximum number of pages copied to the cache per update
+  inline void set_max_loads(UInt32 v) {
+    max_loads_ = v;
+  }
+  inline UInt32 max_loads() const {
+    return max_loads_;
+  }
+
+  // Added to the mip the feedback asks for; the feedback target is smaller
+  // than the screen, so it should be -log2(screen width / feedback width)
+  inline void set_mip_bias(float v) {
+    mip_bias_ = v;
+  }
+
+  // Counters of the last update which read feedback
+  inline const VtStats &stats() const {
+    return stats_;
+  }
+  inline UInt32 texture_count() const {
+    return page_table_.texture_count();
+  }
+  inline UInt32 feedback_w() const {
+    return feedback_w_;
+  }
+  inline UInt32 feedback_h() const {
+    return feedback_h_;
+  }
+
+private:
+  struct TextureData {
+    UInt32 name_crc;
+    VtTileSource source;
+    ID3D11Texture2D *indirection;
+    ID3D11ShaderResourceView *indirection_view;
+  };
+
+  // Copy pages from their sources into the cache
+  void UploadPages(ID3D11DeviceContext *dev_context,
+    const std::vector<VtPageLoad> &loads);
+
+  // Upload the indirection tables which changed
+  void UploadIndirection(ID3D11DeviceContext *dev_context);
+
+  // Number of staging textures feedback is read back through; reading the
+  // oldest one gives the GPU this many frames to finish writing it
+  static const UInt32 kReadbackLatency = 3;
+
+  // Slots of the cache per side
+  static const UInt32 kCacheSlots = 16;
+
+  VtPageTable page_table_;
+  VtFeedbackAnalyser analyser_;
+  std::vector<TextureData> textures_;
+  // CRC of the file name to the ID of the texture cooked from it
+  std::unordered_map<UInt32, UInt32> texture_ids_;
+
+  // Physical cache
+  ID3D11Texture2D *cache_;
+  TextureHandle cache_handle_;
+
+  // Feedback target and its read back ring
+  UInt32 feedback_w_, feedback_h_;
+  ID3D11Texture2D *feedback_;
+  ID3D11RenderTargetView *feedback_view_;
+  ID3D11Texture2D *feedback_depth_;
+  ID3D11DepthStencilView *feedback_depth_view_;
+  D3D11_VIEWPORT feedback_viewport_;
+  ID3D11Texture2D *staging_[kReadbackLatency];
+  // Whether a staging texture holds a copy not read yet
+  bool staging_pending_[kReadbackLatency];
+  UInt32 staging_next_;
+
+  // Reused between frames to avoid allocations
+  std::vector<VtPage> feedback_data_;
+  std::vector<VtPageRequest> requests_;
+  std::vector<VtPageLoad> loads_;
+
+  UInt32 frame_;
+  UInt32 max_loads_;
+  float mip_bias_;
+  VtStats stats_;
+
+}; // class VirtualTextureSystem
+
+} // namespace sz
+
+#endif
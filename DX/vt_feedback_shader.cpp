@@ -0,0 +1,103 @@
+// vt feedback shader.cpp
+#include "vt_feedback_shader.h"
+#include "state_cache.h"
+#include "buffer_resource_manager.h"
+#include "Material.h"
+#include <cassert>
+
+VtFeedbackShader::VtFeedbackShader(ID3D11Device* device, HWND hwnd,
+    sz::ConstBufManager &buf_man) : BaseShader(device, hwnd),
+    vt_buf_(nullptr) {
+  InitShader(buf_man, L"../shaders/vt_feedback_vs.hlsl",
+    L"../shaders/vt_feedback_ps.hlsl");
+}
+
+
+VtFeedbackShader::~VtFeedbackShader() {
+  // Release the layout.
+  if (m_layout)
+  {
+    m_layout->Release();
+    m_layout = 0;
+  }
+
+  //Release base shader components
+  BaseShader::~BaseShader();
+}
+
+
+void VtFeedbackShader::InitShader(sz::ConstBufManager &buf_man,
+  WCHAR* vsFilename, WCHAR* psFilename) {
+  D3D11_BUFFER_DESC matrixBufferDesc;
+  D3D11_BUFFER_DESC vtBufferDesc;
+  D3D11_INPUT_ELEMENT_DESC polygon_layout[2];
+
+  // Create the vertex input layout description.
+  // Only the positions and the texture coordinates of the vertices are read.
+  polygon_layout[0].SemanticName = "POSITION";
+  polygon_layout[0].SemanticIndex = 0;
+  polygon_layout[0].Format = DXGI_FORMAT_R32G32B32_FLOAT;
+  polygon_layout[0].InputSlot = 0;
+  polygon_layout[0].AlignedByteOffset = 0;
+  polygon_layout[0].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+  polygon_layout[0].InstanceDataStepRate = 0;
+
+  polygon_layout[1].SemanticName = "TEXCOORD";
+  polygon_layout[1].SemanticIndex = 0;
+  polygon_layout[1].Format = DXGI_FORMAT_R32G32_FLOAT;
+  polygon_layout[1].InputSlot = 0;
+  polygon_layout[1].AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
+  polygon_layout[1].InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
+  polygon_layout[1].InstanceDataStepRate = 0;
+
+  // Load (+ compile) shader files
+  loadVertexShader(polygon_layout, 2, vsFilename);
+  loadPixelShader(psFilename);
+
+  // Setup the description of the dynamic matrix constant buffer that is in the vertex shader.
+  matrixBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+  matrixBufferDesc.ByteWidth = sizeof(sz::MatrixBufferType);
+  matrixBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  matrixBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+  matrixBufferDesc.MiscFlags = 0;
+  matrixBufferDesc.StructureByteStride = 0;
+
+  m_matrixBuffer = buf_man.CreateD3D11ConstBuffer("mvp_buffer",
+    matrixBufferDesc, m_device);
+  assert(m_matrixBuffer != nullptr);
+
+  // Setup the description of the virtual texture buffer of the pixel shader
+  vtBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+  vtBufferDesc.ByteWidth = sizeof(sz::VirtualTextureBufferType);
+  vtBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  vtBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+  vtBufferDesc.MiscFlags = 0;
+  vtBufferDesc.StructureByteStride = 0;
+
+  vt_buf_ = buf_man.CreateD3D11ConstBuffer("virtual_texture_buffer",
+    vtBufferDesc, m_device);
+  assert(vt_buf_ != nullptr);
+}
+
+
+void VtFeedbackShader::SetShaderParameters(ID3D11DeviceContext* deviceContext, 
+    const XMMATRIX &world, const XMMATRIX &view, const XMMATRIX &projection,
+    const sz::Material &mat) {
+  // Write the matrices, or the entry of the draw in its transform batch
+  WriteMatrixConstants(m_matrixBuffer, world, view, projection);
+  sz::StateCache::Inst()->VSSetConstantBuffers(0, 1, &m_matrixBuffer);
+}
+
+void VtFeedbackShader::SetVirtualTexture(ID3D11DeviceContext* deviceContext,
+  const sz::VirtualTextureBufferType &params) {
+  HRESULT result;
+  D3D11_MAPPED_SUBRESOURCE mapped_resource;
+
+  result = sz::StateCache::Inst()->Map(vt_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0,
+    &mapped_resource);
+  *(sz::VirtualTextureBufferType*)mapped_resource.pData = params;
+  sz::StateCache::Inst()->Unmap(vt_buf_, 0);
+
+  // Same slot as VirtualTextureBuffer in virtual_texture.hlsl
+  sz::StateCache::Inst()->PSSetConstantBuffers(4, 1, &vt_buf_);
+}
@@ -0,0 +1,41 @@
+// Virtual texturing feedback shader
+// Renders, for each pixel, the virtual texture page it wants
+#ifndef _VT_FEEDBACK_SHADER_H
+#define _VT_FEEDBACK_SHADER_H
+
+#include "BaseShader.h"
+
+using namespace std;
+using namespace DirectX;
+
+namespace sz {
+  class ConstBufManager;
+  class Material;
+}
+
+class VtFeedbackShader : public BaseShader {
+public:
+  // Ctor
+  VtFeedbackShader(ID3D11Device* device, HWND hwnd,
+    sz::ConstBufManager &buf_man);
+
+  // Dtor
+  ~VtFeedbackShader();
+
+  void SetShaderParameters(ID3D11DeviceContext* deviceContext, 
+    const XMMATRIX &world, const XMMATRIX &view, const XMMATRIX &projection,
+    const sz::Material &mat);
+
+  // Set the virtual texture the following draws sample
+  void SetVirtualTexture(ID3D11DeviceContext* deviceContext,
+    const sz::VirtualTextureBufferType &params);
+
+private:
+  void InitShader(sz::ConstBufManager &buf_man, WCHAR*, WCHAR*);
+
+private:
+  ID3D11Buffer* vt_buf_;
+
+}; // class VtFeedbackShader
+
+#endif
@@ -1,6 +1,7 @@
 
 // texture shader.cpp
 #include "waves_vertex_deform_shaderh.h"
+#include "state_cache.h"
 #include "Texture.h"
 
 
@@ -72,8 +73,10 @@ void WavesVertexDeformShader::InitShader(sz::ConstBufManager &buf_man,
   samplerDesc.MinLOD = 0;
   samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
-  // Create the texture sampler state.
-  m_device->CreateSamplerState(&samplerDesc, &m_sampleState);
+  // Get the texture sampler state; shaders with the same description
+  // share it
+  m_sampleState = sz::StateCache::Inst()->GetSamplerState(m_device,
+    samplerDesc);
 
   // Setup light buffer
   // Setup the description of the light dynamic constant buffer that is in the pixel shader.
@@ -109,7 +112,7 @@ void WavesVertexDeformShader::InitShader(sz::ConstBufManager &buf_man,
   D3D11_BUFFER_DESC mat_buff_desc;
   // Setup material buffer
   mat_buff_desc.Usage = D3D11_USAGE_DYNAMIC;
-  mat_buff_desc.ByteWidth = sizeof(MaterialBufferType);
+  mat_buff_desc.ByteWidth = sizeof(sz::MaterialBufferType);
   mat_buff_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
   mat_buff_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
   mat_buff_desc.MiscFlags = 0;
@@ -141,65 +144,26 @@ void WavesVertexDeformShader::SetShaderParameters(ID3D11DeviceContext* deviceCon
   const XMMATRIX &projectionMatrix, const sz::Material &mat) {
   HRESULT result;
   D3D11_MAPPED_SUBRESOURCE mapped_resource;
-  MatrixBufferType* data_ptr;
   unsigned int bufferNumber;
-  XMMATRIX tworld, tview, tproj;
 
 
-  // Transpose the matrices to prepare them for the shader.
-  tworld = XMMatrixTranspose(worldMatrix);
-  tview = XMMatrixTranspose(viewMatrix);
-  tproj = XMMatrixTranspose(projectionMatrix);
-
-  // Lock the constant buffer so it can be written to.
-  result = deviceContext->Map(m_matrixBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
-
-  // Get a pointer to the data in the constant buffer.
-  data_ptr = (MatrixBufferType*)mapped_resource.pData;
-
-  // Copy the matrices into the constant buffer.
-  data_ptr->world = tworld;// worldMatrix;
-  data_ptr->view = tview;
-  data_ptr->projection = tproj;
-
-  // Unlock the constant buffer.
-  deviceContext->Unmap(m_matrixBuffer, 0);
+  // Write the matrices, or the entry of the draw in its transform batch
+  WriteMatrixConstants(m_matrixBuffer, worldMatrix, viewMatrix,
+    projectionMatrix);
 
   // Set the position of the constant buffer in the vertex shader.
   bufferNumber = 0;
 
   // Now set the constant buffer in the vertex shader with the updated values.
-  deviceContext->VSSetConstantBuffers(bufferNumber, 1, &m_matrixBuffer);
+  sz::StateCache::Inst()->VSSetConstantBuffers(bufferNumber, 1,
+    &m_matrixBuffer);
 
-  // Assign the material data
-  MaterialBufferType *mat_buff_ptr;
-  result = deviceContext->Map(material_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0,
-    &mapped_resource);
-  // Get a ptr to the data in the constant buffer
-  mat_buff_ptr = (MaterialBufferType *)mapped_resource.pData;
-  // Set its data
-  mat_buff_ptr->ambient = XMFLOAT4(mat.ambient[0], mat.ambient[1],
-    mat.ambient[2], mat.dissolve);
-  mat_buff_ptr->diffuse = XMFLOAT4(mat.diffuse[0], mat.diffuse[1],
-    mat.diffuse[2], mat.dissolve);
-  mat_buff_ptr->specular = XMFLOAT4(mat.specular[0], mat.specular[1],
-    mat.specular[2], mat.dissolve);
-  mat_buff_ptr->transmittance = XMFLOAT4(mat.transmittance[0], 
-    mat.transmittance[1], mat.transmittance[2], 1.f);
-  mat_buff_ptr->emission = XMFLOAT4(mat.emission[0], mat.emission[1],
-    mat.emission[2], mat.dissolve);
-  mat_buff_ptr->shininess = mat.shininess;
-  mat_buff_ptr->ior = mat.ior;
-  mat_buff_ptr->dissolve = mat.dissolve;
-  mat_buff_ptr->illum = mat.illum;
-  // Unlock the constant buffer
-  deviceContext->Unmap(material_buf_, 0);
-  // Set the constant buffer index in the pixel shader
-  deviceContext->PSSetConstantBuffers(1, 1, &material_buf_);
-
-  ID3D11ShaderResourceView * texture = Texture::Inst()->GetTexture(mat.diffuse_texname.c_str());
+  // Bind the constants of the material
+  SetMaterialConstants(material_buf_, mat);
+
+  ID3D11ShaderResourceView * texture = Texture::Inst()->GetTexture(mat.diffuse_texture);
   // Set shader texture resource in the pixel shader.
-  deviceContext->PSSetShaderResources(0, 1, &texture);
+  sz::StateCache::Inst()->PSSetShaderResources(0, 1, &texture);
 }
 
 void WavesVertexDeformShader::SetShaderFrameParameters(
@@ -212,7 +176,8 @@ void WavesVertexDeformShader::SetShaderFrameParameters(
   unsigned int bufferNumber;
   
   // Send light data to pixel shader
-  result = deviceContext->Map(m_lightBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
+  result = sz::StateCache::Inst()->Map(m_lightBuffer, 0,
+    D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource);
   light_ptr = (LightBufferType*)mapped_resource.pData;
   for (unsigned int i = 0; i < lights.size(); i++) {
     light_ptr[i].diffuse = lights[i].GetDiffuseColour();
@@ -229,30 +194,30 @@ void WavesVertexDeformShader::SetShaderFrameParameters(
     light_ptr[i].spot_cutoff = lights[i].spot_cutoff();
     light_ptr[i].spot_exponent = lights[i].spot_exponent();
   }
-  deviceContext->Unmap(m_lightBuffer, 0);
+  sz::StateCache::Inst()->Unmap(m_lightBuffer, 0);
   bufferNumber = 0;
-  deviceContext->PSSetConstantBuffers(bufferNumber, 1, &m_lightBuffer);
-  deviceContext->VSSetConstantBuffers(2, 1, &m_lightBuffer);
+  sz::StateCache::Inst()->PSSetConstantBuffers(bufferNumber, 1, &m_lightBuffer);
+  sz::StateCache::Inst()->VSSetConstantBuffers(2, 1, &m_lightBuffer);
 
   // Send camera data to vertex shader
-  result = deviceContext->Map(m_camBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0,
-    &mapped_resource);
+  result = sz::StateCache::Inst()->Map(m_camBuffer, 0, D3D11_MAP_WRITE_DISCARD,
+    0, &mapped_resource);
   camPtr = (CamBufferType*)mapped_resource.pData;
   camPtr->camPos = cam->GetPosition();
-  deviceContext->Unmap(m_camBuffer, 0);
+  sz::StateCache::Inst()->Unmap(m_camBuffer, 0);
   bufferNumber = 1;
-  deviceContext->VSSetConstantBuffers(bufferNumber, 1, &m_camBuffer);
+  sz::StateCache::Inst()->VSSetConstantBuffers(bufferNumber, 1, &m_camBuffer);
    
   // Assign time data
-  result = deviceContext->Map(time_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0,
+  result = sz::StateCache::Inst()->Map(time_buf_, 0, D3D11_MAP_WRITE_DISCARD, 0,
     &mapped_resource);
   TimeAmpFreqBufferType *time_buff_ptr = (TimeAmpFreqBufferType *)mapped_resource.pData;
   time_buff_ptr->time = time;
   time_buff_ptr->amplitude = 1.5f;
   time_buff_ptr->speed = 10.f;
-  deviceContext->Unmap(time_buf_, 0);
+  sz::StateCache::Inst()->Unmap(time_buf_, 0);
   size_t size = sizeof(*time_buff_ptr);
-  deviceContext->VSSetConstantBuffers(3, 1, &time_buf_);
+  sz::StateCache::Inst()->VSSetConstantBuffers(3, 1, &time_buf_);
 
 }
 
@@ -262,7 +227,7 @@ void WavesVertexDeformShader::SetShaderFrameParameters(
     size_t base_vertex)
 {
   // Set the sampler state in the pixel shader.
-  deviceContext->PSSetSamplers(0, 1, &m_sampleState);
+  sz::StateCache::Inst()->PSSetSamplers(0, 1, &m_sampleState);
 
   // Base render function.
   BaseShader::Render(deviceContext, index_count, index_start, base_vertex);
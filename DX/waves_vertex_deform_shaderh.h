@@ -43,18 +43,6 @@ private:
     float padding;
   };
 
-  struct MaterialBufferType {
-    XMFLOAT4 ambient;
-    XMFLOAT4 diffuse;
-    XMFLOAT4 specular;
-    XMFLOAT4 transmittance;
-    XMFLOAT4 emission;
-    float shininess;
-    float ior;      // index of refraction
-    float dissolve; // 1 == opaque; 0 == fully transparent
-    int illum;
-  };
-
   // Buffer which contains time, amplitude and frequency to be used 
   // to displace the vertices using a sine function
   struct TimeAmpFreqBufferType {
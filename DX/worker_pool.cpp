@@ -0,0 +1,101 @@
+#include "worker_pool.h"
+
+namespace sz {
+
+WorkerPool::WorkerPool(UInt32 thread_count) :
+    threads_(),
+    tasks_(nullptr),
+    batch_(0),
+    finished_(0),
+    active_(0),
+    quit_(false) {
+  next_task_ = 0;
+
+  threads_.reserve(thread_count);
+  for (UInt32 i = 0; i < thread_count; ++i) {
+    threads_.push_back(std::thread(&WorkerPool::WorkerMain, this));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  work_ready_.notify_all();
+
+  for (std::thread &thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkerPool::Run(const std::vector<Task> &tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_ = &tasks;
+    next_task_ = 0;
+    finished_ = 0;
+    active_ = thread_count();
+    ++batch_;
+  }
+  work_ready_.notify_all();
+
+  RunTasks(tasks);
+
+  // Workers must be done with the batch too, as the tasks belong to the
+  // caller
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_done_.wait(lock, [this, &tasks] {
+    return finished_ == tasks.size() && active_ == 0;
+  });
+  tasks_ = nullptr;
+}
+
+void WorkerPool::WorkerMain() {
+  UInt32 batch = 0;
+
+  for (;;) {
+    const std::vector<Task> *tasks = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_ready_.wait(lock, [this, batch] {
+        return quit_ || batch_ != batch;
+      });
+      if (quit_) {
+        return;
+      }
+      batch = batch_;
+      tasks = tasks_;
+    }
+
+    RunTasks(*tasks);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --active_;
+    }
+    work_done_.notify_all();
+  }
+}
+
+void WorkerPool::RunTasks(const std::vector<Task> &tasks) {
+  UInt32 finished = 0;
+  for (UInt32 i = next_task_++; i < tasks.size(); i = next_task_++) {
+    tasks[i]();
+    ++finished;
+  }
+
+  if (finished > 0) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      finished_ += finished;
+    }
+    work_done_.notify_all();
+  }
+}
+
+} // namespace sz
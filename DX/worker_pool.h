@@ -0,0 +1,72 @@
+//  Pool of worker threads
+//  * The threads are started once and wait for work, so that running tasks
+//    every frame does not pay for creating threads
+//  * Run hands out a batch of tasks and returns once all of them finished;
+//    the calling thread runs tasks too
+//  * Tasks are picked in order but may finish in any order, so whatever has
+//    to happen in order is left to the caller, after Run
+
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "abertay_framework.h"
+
+namespace sz {
+
+class WorkerPool {
+public:
+  typedef std::function<void()> Task;
+
+  // Ctor; starts thread_count threads, which may be 0
+  explicit WorkerPool(UInt32 thread_count);
+
+  // Dtor; waits for the threads to quit
+  ~WorkerPool();
+
+  // Run all the tasks and wait for them to finish
+  void Run(const std::vector<Task> &tasks);
+
+  inline UInt32 thread_count() const {
+    return static_cast<UInt32>(threads_.size());
+  }
+
+  // Disable ctors
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+private:
+  // Loop of the worker threads
+  void WorkerMain();
+
+  // Run tasks of the current batch until there are none left to pick
+  void RunTasks(const std::vector<Task> &tasks);
+
+  std::vector<std::thread> threads_;
+
+  // Guard everything below but next_task_
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable work_done_;
+
+  // Current batch, and how many times Run was called
+  const std::vector<Task> *tasks_;
+  UInt32 batch_;
+  // Tasks finished, and workers which still have to see the batch
+  UInt32 finished_;
+  UInt32 active_;
+  bool quit_;
+
+  // Next task to be picked
+  std::atomic<UInt32> next_task_;
+
+}; // class WorkerPool
+
+} // namespace sz
+
+#endif
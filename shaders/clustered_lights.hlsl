@@ -0,0 +1,231 @@
+// Clustered lighting helpers, included by the lit pixel shaders after their
+// sampler. The layouts match ClusterLightType, ClusterBufferType and
+// DrawLightBufferType in DX/buffer_types.h
+
+// Lights which may have a shadow map
+#define L_NUM 4
+
+#define CLUSTER_LIGHT_DIRECTIONAL 0
+#define CLUSTER_LIGHT_POINT 1
+#define CLUSTER_LIGHT_SPOT 2
+
+// Lights a draw may be given its own list of; a multiple of 4
+#define DRAW_LIGHTS_MAX 8
+// Count of the draws which read the lists of their clusters, and offset of
+// the lists of the draws
+#define DRAW_LIGHTS_NONE 0xFFFFFFFF
+
+// A light with a shadow map slot
+struct LightType {
+  float4 diffuse;
+  float4 ambient;
+  float4 direction;
+  float4 specular;
+  float4 attenuation;
+  float4 position;
+  // Determines which light is active
+  uint active;
+  float range;
+  float specular_power;
+  float spot_cutoff;
+  float spot_exponent;
+  // Whether the shadow map of the light was rendered this frame
+  uint shadow_map;
+  float2 padding;
+  matrix view_matrix;
+  matrix proj_matrix;
+};
+
+// A light in the lists of the clusters
+struct ClusterLight {
+  float4 diffuse;
+  float4 ambient;
+  float4 specular;
+  float3 position;
+  float range;
+  float3 direction;
+  float spot_cos_cutoff;
+  float3 attenuation;
+  float spot_exponent;
+  uint kind;
+  // Shadow map of the light, or L_NUM if it has none
+  uint shadow_slot;
+  float2 padding;
+};
+
+// Const buffer for the lights with a shadow map slot
+cbuffer LightBuffer : register(b0) {
+  LightType lights[L_NUM];
+};
+
+cbuffer ClusterBuffer : register(b2) {
+  // 1 / size of the tiles in pixels
+  float cluster_tile_scale;
+  // slice = log(depth) * slice_scale + slice_bias
+  float cluster_slice_scale;
+  float cluster_slice_bias;
+  uint cluster_slice_count;
+  uint cluster_tiles_x;
+  uint cluster_tiles_y;
+  // View space depth = depth_a / (depth_b - depth in the buffer)
+  float cluster_depth_a;
+  float cluster_depth_b;
+};
+
+// Lights picked for the draw, as indices into cluster_lights
+cbuffer DrawLightBuffer : register(b3) {
+  uint draw_light_count;
+  uint3 draw_light_padding;
+  uint4 draw_light_indices[DRAW_LIGHTS_MAX / 4];
+};
+
+// Tile of the shadow map of each light in the atlas: scale in x, top left
+// corner in yz, and half a texel of the tile in w
+cbuffer ShadowAtlasBuffer : register(b5) {
+  float4 shadow_tiles[L_NUM];
+};
+
+// Shadow maps of all the lights, as tiles
+Texture2D shadow_atlas : register(t4);
+StructuredBuffer<ClusterLight> cluster_lights : register(t8);
+// Offset and count of the list of each cluster
+Buffer<uint2> cluster_grid : register(t9);
+Buffer<uint> cluster_light_indices : register(t10);
+
+// Offset and count of the list of the cluster a pixel lies in
+uint2 ClusterOfPixel(float4 sv_position) {
+  uint2 tile = min(uint2(sv_position.xy * cluster_tile_scale),
+    uint2(cluster_tiles_x - 1, cluster_tiles_y - 1));
+  float depth = cluster_depth_a / (cluster_depth_b - sv_position.z);
+  float slice = log(depth) * cluster_slice_scale + cluster_slice_bias;
+  uint s = min((uint)max(slice, 0.f), cluster_slice_count - 1);
+
+  return cluster_grid[(s * cluster_tiles_y + tile.y) * cluster_tiles_x +
+    tile.x];
+}
+
+// Offset and count of the list of lights of a pixel: that of the draw, if
+// it was given one, or that of the pixel's cluster
+uint2 LightListOfPixel(float4 sv_position) {
+  if (draw_light_count != DRAW_LIGHTS_NONE) {
+    return uint2(DRAW_LIGHTS_NONE, draw_light_count);
+  }
+
+  return ClusterOfPixel(sv_position);
+}
+
+// Light n of a list, as an index into cluster_lights
+uint LightOfList(uint2 list, uint n) {
+  if (list.x == DRAW_LIGHTS_NONE) {
+    return draw_light_indices[n >> 2][n & 3];
+  }
+
+  return cluster_light_indices[list.x + n];
+}
+
+// 0 if the pixel is in the shadow of the light, 1 otherwise
+float ClusterShadow(ClusterLight light,
+  float4 lightview_position[L_NUM]) {
+  // Bias for shawdowing
+  float bias = 0.001f;
+  uint slot = light.shadow_slot;
+
+  if (slot >= L_NUM || lights[slot].shadow_map == 0) {
+    return 1.f;
+  }
+
+  // Calculate the projected texture coordinates
+  float4 position = lightview_position[slot];
+  float2 proj_tex_coord;
+  proj_tex_coord.x = position.x / position.w / 2.f + 0.5f;
+  proj_tex_coord.y = -position.y / position.w / 2.f + 0.5f;
+  if ((saturate(proj_tex_coord.x) != proj_tex_coord.x) ||
+    (saturate(proj_tex_coord.y) != proj_tex_coord.y)) {
+    return 1.f;
+  }
+
+  // Into the tile of the light, kept half a texel inside it so that
+  // filtering does not reach the tiles next to it
+  float4 tile = shadow_tiles[slot];
+  if (tile.x == 0.f) {
+    return 1.f;
+  }
+  proj_tex_coord = clamp(proj_tex_coord, tile.w, 1.f - tile.w);
+  float sample_depth = shadow_atlas.Sample(SampleType,
+    tile.yz + proj_tex_coord * tile.x).r;
+
+  // Calculate depth at this pixel
+  float light_depth = position.z / position.w - bias;
+
+  return light_depth > sample_depth ? 0.f : 1.f;
+}
+
+// Contribution of a light to a pixel; the normal and view direction are
+// normalised and in world space, and the colours are those of the material
+// at the pixel. Only spot lights cast shadows, as before.
+float4 ShadeClusterLight(ClusterLight light, float3 world_pos, float3 normal,
+  float3 view_dir, float4 ambient_colour, float4 diffuse_colour,
+  float4 specular_colour, float shininess,
+  float4 lightview_position[L_NUM]) {
+  // Vector from the light to the fragment
+  float3 calc_light_dir;
+  // How much the pixel is influenced by light
+  float light_intensity = 0.f;
+  // Falloff factor for point lights
+  float falloff = 1.f;
+  // The spotlight effect in case the light is spotlight
+  float spot_effect = 1.f;
+
+  if (light.kind == CLUSTER_LIGHT_DIRECTIONAL) {
+    calc_light_dir = light.direction;
+    light_intensity = saturate(dot(normal, -calc_light_dir));
+  }
+  else {
+    float3 pixel_to_light_vec = light.position - world_pos;
+    float dist = length(pixel_to_light_vec);
+
+    // If the pixel is too far away from the light source
+    if (dist > light.range) {
+      return float4(0.f, 0.f, 0.f, 0.f);
+    }
+
+    pixel_to_light_vec /= dist;
+    calc_light_dir = -pixel_to_light_vec;
+    light_intensity = saturate(dot(pixel_to_light_vec, normal));
+    falloff = light.attenuation.x + light.attenuation.y * dist +
+      light.attenuation.z * dist * dist;
+
+    if (light.kind == CLUSTER_LIGHT_SPOT) {
+      float cos_directions = max(dot(calc_light_dir, light.direction), 0.f);
+
+      // If the pixel lies within the cone of illumination
+      if (cos_directions > light.spot_cos_cutoff) {
+        spot_effect = pow(cos_directions, light.spot_exponent) *
+          ClusterShadow(light, lightview_position);
+      }
+      else {
+        spot_effect = 0.f;
+      }
+    }
+  }
+
+  // If the light is not striking the front of the pixel
+  if (light_intensity <= 0.f) {
+    return float4(0.f, 0.f, 0.f, 0.f);
+  }
+
+  float4 final_amb_contribution = light.ambient * ambient_colour;
+  float4 final_diff_contribution = saturate(light.diffuse * light_intensity *
+    diffuse_colour);
+
+  // Determine the amount of specular light based on the reflection vector,
+  // the viewing direction and the specular power
+  float3 reflection = reflect(calc_light_dir, normal);
+  float specular_intensity = pow(saturate(dot(reflection, view_dir)),
+    shininess);
+  float4 final_spec_contribution = saturate(specular_intensity *
+    light.specular * specular_colour);
+
+  return (final_amb_contribution + final_diff_contribution +
+    final_spec_contribution) / falloff * spot_effect;
+}
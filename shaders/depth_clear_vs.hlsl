@@ -0,0 +1,8 @@
+// Clears the depth of the viewport, e.g. of one tile of the shadow atlas:
+// one triangle over all of it, at the far plane, drawn without depth test
+
+float4 main(uint vertex_id : SV_VertexID) : SV_POSITION {
+  // (-1, 1), (3, 1) and (-1, -3), clockwise
+  float2 uv = float2((vertex_id << 1) & 2, vertex_id & 2);
+  return float4(uv.x * 2.f - 1.f, 1.f - uv.y * 2.f, 1.f, 1.f);
+}
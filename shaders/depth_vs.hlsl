@@ -2,15 +2,17 @@ cbuffer MatrixBuffer : register(b0) {
     matrix worldMatrix;
     matrix viewMatrix;
     matrix projectionMatrix;
+    // Product of the matrices above
+    matrix worldViewProjMatrix;
 };
 
 struct InputType {
     float4 position : POSITION;
 };
 
+// Only the depth is written, by the rasteriser; there is no pixel shader
 struct OutputType {
     float4 position : SV_POSITION;
-    float4 depthPosition : TEXCOORD0;
 };
 
 OutputType main(InputType input) {
@@ -20,12 +22,7 @@ OutputType main(InputType input) {
     input.position.w = 1.0f;
 
     // Calculate the position of the vertex against the world, view, and projection matrices.
-    output.position = mul(input.position, worldMatrix);
-    output.position = mul(output.position, viewMatrix);
-    output.position = mul(output.position, projectionMatrix);
+    output.position = mul(input.position, worldViewProjMatrix);
 
-    // Store the position value in a second input value for depth value calculations.
-    output.depthPosition = output.position;
-	
     return output;
 }
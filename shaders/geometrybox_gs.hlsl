@@ -1,5 +1,6 @@
 // Size of box can be increased using the traditional
-// scaling of the worldmatrix
+// scaling of the worldmatrix, which comes from the vertex shader so that
+// boxes can be instanced
 
 cbuffer MatrixBuffer : register(b0) {
   matrix worldMatrix;
@@ -9,10 +10,16 @@ cbuffer MatrixBuffer : register(b0) {
 
 struct InputType {
   float4 position : POSITION;
+  float4 world0 : WORLD0;
+  float4 world1 : WORLD1;
+  float4 world2 : WORLD2;
+  float4 world3 : WORLD3;
+  float4 tint : TINT;
 };
 
 struct OutputType {
   float4 position : SV_POSITION;
+  float4 tint : TINT;
 };
 
 
@@ -75,10 +82,14 @@ void main(point InputType input[1], inout TriangleStream<OutputType> triStream)
   // Change the position vector to be 4 units for proper matrix calculations.
   input[0].position.w = 1.0f;
 
+  float4x4 world = float4x4(input[0].world0, input[0].world1,
+    input[0].world2, input[0].world3);
+  output.tint = input[0].tint;
+
   // Create cube around the point
   for(int i = 0; i < 36; i++) {
     output.position = input[0].position + g_positions[i];
-    output.position = mul(output.position, worldMatrix);
+    output.position = mul(output.position, world);
     output.position = mul(output.position, viewMatrix);
     output.position = mul(output.position, projectionMatrix);
   
@@ -0,0 +1,33 @@
+// Instanced variant of geometrybox_vs: the world matrix and the tint of
+// each box come from the instance buffer
+
+struct InputType {
+  float4 position : POSITION;
+  float4 world0 : INSTANCE_WORLD0;
+  float4 world1 : INSTANCE_WORLD1;
+  float4 world2 : INSTANCE_WORLD2;
+  float4 world3 : INSTANCE_WORLD3;
+  float4 params : INSTANCE_PARAMS;
+};
+
+struct OutputType {
+  float4 position : POSITION;
+  float4 world0 : WORLD0;
+  float4 world1 : WORLD1;
+  float4 world2 : WORLD2;
+  float4 world3 : WORLD3;
+  float4 tint : TINT;
+};
+
+OutputType main(InputType input) {
+  OutputType output;
+
+  output.position = input.position;
+  output.world0 = input.world0;
+  output.world1 = input.world1;
+  output.world2 = input.world2;
+  output.world3 = input.world3;
+  output.tint = input.params;
+
+  return output;
+}
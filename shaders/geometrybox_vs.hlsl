@@ -1,9 +1,34 @@
+cbuffer MatrixBuffer : register(b0) {
+  matrix worldMatrix;
+  matrix viewMatrix;
+  matrix projectionMatrix;
+};
+
 struct InputType {
     float4 position : POSITION;
 };
 
-InputType main(InputType input) {
+struct OutputType {
+  float4 position : POSITION;
+  // Rows of the world matrix, as the instanced variant reads them
+  float4 world0 : WORLD0;
+  float4 world1 : WORLD1;
+  float4 world2 : WORLD2;
+  float4 world3 : WORLD3;
+  float4 tint : TINT;
+};
+
+OutputType main(InputType input) {
+  OutputType output;
+
 	// No vertices to process so Vertex shader pass values onto next stage.
 	// You could manipulate the points in the mesh before passing them on.
-	return input;
+  output.position = input.position;
+  output.world0 = worldMatrix[0];
+  output.world1 = worldMatrix[1];
+  output.world2 = worldMatrix[2];
+  output.world3 = worldMatrix[3];
+  output.tint = float4(1.f, 1.f, 1.f, 1.f);
+
+  return output;
 }
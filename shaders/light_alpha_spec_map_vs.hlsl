@@ -19,7 +19,9 @@ struct LightType {
   float specular_power;
   float spot_cutoff;
   float spot_exponent;
-  float3 padding;
+  // Whether the shadow map of the light was rendered this frame
+  uint shadow_map;
+  float2 padding;
   matrix view_matrix;
   matrix proj_matrix;
 };
@@ -28,6 +30,10 @@ cbuffer MatrixBuffer : register(b0) {
   matrix worldMatrix;
   matrix viewMatrix;
   matrix projectionMatrix;
+  // Products of the matrices above, and of the world matrix with those
+  // of each light
+  matrix worldViewProjMatrix;
+  matrix worldLightViewProjMatrix[L_NUM];
 
 };
 
@@ -56,7 +62,6 @@ struct OutputType
     // How does the suffix modify the type?
     float3 viewDir: TEXCOORD1;
     float4 world_pos : TEXCOORD2;
-    float3 pixel_to_light_vec[L_NUM] : TEXCOORD3;
     float4 lightview_position[L_NUM] : TEXCOORD11;
 };
 
@@ -70,14 +75,9 @@ OutputType main(InputType input)
     // Calculate the position of the vertex in world coordinates
     float4 world_pos = mul(input.position, worldMatrix);
 
-    // Calculate the vector from the pixel in world coordinates to the lights
+    // Calculate the position of the vertex as seen from the lights
     for (uint i = 0; i < L_NUM; ++i) {
-      output.pixel_to_light_vec[i] = lights[i].position.xyz - world_pos.xyz;
-      
-      // Calculate the position of the vertex as seen from the light
-      output.lightview_position[i] = mul(input.position, worldMatrix);
-      output.lightview_position[i] = mul(output.lightview_position[i], lights[i].view_matrix);
-      output.lightview_position[i] = mul(output.lightview_position[i], lights[i].proj_matrix);
+      output.lightview_position[i] = mul(input.position, worldLightViewProjMatrix[i]);
     }
     
     // Determine the viewing direction based on the position of the camera and
@@ -85,9 +85,7 @@ OutputType main(InputType input)
     output.viewDir = normalize(camPos.xyz - world_pos.xyz);
     
     // Calculate the position of the vertex against the world, view, and projection matrices.
-    output.position = mul(input.position, worldMatrix);
-    output.position = mul(output.position, viewMatrix);
-    output.position = mul(output.position, projectionMatrix);
+    output.position = mul(input.position, worldViewProjMatrix);
 
     output.world_pos = world_pos;
     
@@ -20,7 +20,9 @@ struct LightType {
   float specular_power;
   float spot_cutoff;
   float spot_exponent;
-  float3 padding;
+  // Whether the shadow map of the light was rendered this frame
+  uint shadow_map;
+  float2 padding;
   matrix view_matrix;
   matrix proj_matrix;
 };
@@ -60,7 +62,6 @@ struct OutputType {
     // How does the suffix modify the type?
     float3 viewDir: TEXCOORD1;
     float4 world_pos : TEXCOORD2;
-    float3 pixel_to_light_vec[L_NUM] : TEXCOORD3;
     float4 lightview_position[L_NUM] : TEXCOORD11;
 };
 
@@ -96,11 +97,8 @@ OutputType main(ConstantOutputType input_const, float3 uvwCoord : SV_DomainLocat
   // Calculate the position of the vertex in world coordinates
   float4 world_pos = mul(input.position, worldMatrix);
 
-  // Calculate the vector from the pixel in world coordinates to the lights
+  // Calculate the position of the vertex as seen from the lights
   for (uint i = 0; i < L_NUM; ++i) {
-    output.pixel_to_light_vec[i] = lights[i].position.xyz - world_pos.xyz;
-    
-    // Calculate the position of the vertex as seen from the light
     output.lightview_position[i] = mul(input.position, worldMatrix);
     output.lightview_position[i] = mul(output.lightview_position[i], lights[i].view_matrix);
     output.lightview_position[i] = mul(output.lightview_position[i], lights[i].proj_matrix);
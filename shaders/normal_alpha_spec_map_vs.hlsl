@@ -19,7 +19,9 @@ struct LightType {
   float specular_power;
   float spot_cutoff;
   float spot_exponent;
-  float3 padding;
+  // Whether the shadow map of the light was rendered this frame
+  uint shadow_map;
+  float2 padding;
   matrix view_matrix;
   matrix proj_matrix;
 };
@@ -28,6 +30,10 @@ cbuffer MatrixBuffer : register(b0) {
   matrix worldMatrix;
   matrix viewMatrix;
   matrix projectionMatrix;
+  // Products of the matrices above, and of the world matrix with those
+  // of each light
+  matrix worldViewProjMatrix;
+  matrix worldLightViewProjMatrix[L_NUM];
 
 };
 
@@ -49,82 +55,51 @@ struct InputType {
 };
 
 struct OutputType {
-  float4 position : SV_POSITION;
-  float2 tex : TEXCOORD0;
-  float3 normal : NORMAL;
-  float3 tangent : TANGENT;
-  float3 tangent_view_dir : TEXCOORD1;
-  float3 tangent_pixel_to_light_vec[L_NUM] : TEXCOORD2;
-  float3 pixel_to_light_vec[L_NUM] : TEXCOORD6;
-  float3 tangent_light_dir[L_NUM] : TEXCOORD11;
-  float4 lightview_position[L_NUM] : TEXCOORD16;
+    float4 position : SV_POSITION;
+    float2 tex : TEXCOORD0;
+    // Tangent frame in world space
+    float3 normal : NORMAL;
+    float3 tangent : TANGENT;
+    float3 bitangent : BINORMAL;
+    float3 view_dir : TEXCOORD1;
+    float4 world_pos : TEXCOORD2;
+    float4 lightview_position[L_NUM] : TEXCOORD3;
 };
 
-OutputType main(InputType input)
-{
-  OutputType output;
-  
-  // Change the position vector to be 4 units for proper matrix calculations.
-  input.position.w = 1.0f;
-
-  output.tangent = normalize(input.tangent.xyz);
-
-  // Calculate the bitangent B = (N x T) * T.w
-  float3 bitangent = cross(input.normal, input.tangent.xyz) * input.tangent.w;
-
-  // Transform tangent, bitangent and normal into world space
-  float3 tangent_worldspace = normalize(mul(input.tangent.xyz, (float3x3)worldMatrix));
-  float3 bitangent_worldspace = normalize(mul(bitangent, (float3x3)worldMatrix));
-  float3 normal_worldspace = normalize(mul(input.normal, (float3x3)worldMatrix));
-
-  // Calculate the position of the vertex in world coordinates
-  float4 world_pos = mul(input.position, worldMatrix);
-  
-  // Transform the view direction into tangent space
-  output.tangent_view_dir = cam_pos - world_pos.xyz;
-  output.tangent_view_dir = normalize(float3(
-    dot(tangent_worldspace, output.tangent_view_dir),
-    dot(bitangent_worldspace, output.tangent_view_dir),
-    dot(normal_worldspace, output.tangent_view_dir)));
-   
-  // Calculate the vector from the pixel in world coordinates to the lights
-  // and then transform it into tangent space;
-  // Also transform the direction of the light to tangent space
-  for (uint i = 0; i < L_NUM; ++i) {
-    output.tangent_pixel_to_light_vec[i] = lights[i].position.xyz - world_pos.xyz;
-    output.pixel_to_light_vec[i] = output.tangent_pixel_to_light_vec[i];
-    output.tangent_pixel_to_light_vec[i] = 
-    normalize(
-    float4(dot(tangent_worldspace, output.tangent_pixel_to_light_vec[i].xyz),
-    dot(bitangent_worldspace, output.tangent_pixel_to_light_vec[i].xyz),
-    dot(normal_worldspace, output.tangent_pixel_to_light_vec[i].xyz),
-    1.f));
+OutputType main(InputType input) {
+    OutputType output;
     
-    output.tangent_light_dir[i] =
-    normalize(float4(dot(tangent_worldspace, lights[i].direction.xyz),
-    dot(bitangent_worldspace, lights[i].direction.xyz),
-    dot(normal_worldspace, lights[i].direction.xyz),
-    1.f));
-      
-    // Calculate the position of the vertex as seen from the light
-    output.lightview_position[i] = mul(input.position, worldMatrix);
-    output.lightview_position[i] = mul(output.lightview_position[i], lights[i].view_matrix);
-    output.lightview_position[i] = mul(output.lightview_position[i], lights[i].proj_matrix);
-  }
-
-  // Calculate the position of the vertex against the world, view, and projection matrices.
-  output.position = mul(input.position, worldMatrix);
-  output.position = mul(output.position, viewMatrix);
-  output.position = mul(output.position, projectionMatrix);
-  
-  // Store the texture coordinates for the pixel shader.
-  output.tex = input.tex;
-
-  // Calculate the normal vector against the world matrix only.
-  output.normal = normal_worldspace;
-	
-  //// Normalize the normal vector.
-  //output.normal = normalize(output.normal);
-
-  return output;
+    // Change the position vector to be 4 units for proper matrix calculations.
+    input.position.w = 1.0f;
+
+    // Calculate the bitangent B = (N x T) * T.w
+    float3 bitangent = cross(input.normal, input.tangent.xyz) * input.tangent.w;
+
+    // Transform tangent, bitangent and normal into world space; the pixel
+    // shader takes the normal of the map from tangent to world space, where
+    // it lights the pixel
+    output.tangent = normalize(mul(input.tangent.xyz, (float3x3)worldMatrix));
+    output.bitangent = normalize(mul(bitangent, (float3x3)worldMatrix));
+    output.normal = normalize(mul(input.normal, (float3x3)worldMatrix));
+
+    // Calculate the position of the vertex in world coordinates
+    float4 world_pos = mul(input.position, worldMatrix);
+    output.world_pos = world_pos;
+
+    // Determine the viewing direction based on the position of the camera and
+    // the world position of the vertex, and then normalise it
+    output.view_dir = normalize(cam_pos - world_pos.xyz);
+
+    // Calculate the position of the vertex as seen from the lights
+    for (uint i = 0; i < L_NUM; ++i) {
+      output.lightview_position[i] = mul(input.position, worldLightViewProjMatrix[i]);
+    }
+
+    // Calculate the position of the vertex against the world, view, and projection matrices.
+    output.position = mul(input.position, worldViewProjMatrix);
+    
+    // Store the texture coordinates for the pixel shader.
+    output.tex = input.tex;
+
+    return output;
 }
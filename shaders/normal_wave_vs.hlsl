@@ -19,7 +19,9 @@ struct LightType {
   float specular_power;
   float spot_cutoff;
   float spot_exponent;
-  float3 padding;
+  // Whether the shadow map of the light was rendered this frame
+  uint shadow_map;
+  float2 padding;
   matrix view_matrix;
   matrix proj_matrix;
 };
@@ -28,6 +30,10 @@ cbuffer MatrixBuffer : register(b0) {
   matrix worldMatrix;
   matrix viewMatrix;
   matrix projectionMatrix;
+  // Products of the matrices above, and of the world matrix with those
+  // of each light
+  matrix worldViewProjMatrix;
+  matrix worldLightViewProjMatrix[L_NUM];
 
 };
 
@@ -106,15 +112,11 @@ OutputType main(InputType input) {
     1.f));
       
     // Calculate the position of the vertex as seen from the light
-    output.lightview_position[i] = mul(input.position, worldMatrix);
-    output.lightview_position[i] = mul(output.lightview_position[i], lights[i].view_matrix);
-    output.lightview_position[i] = mul(output.lightview_position[i], lights[i].proj_matrix);
+    output.lightview_position[i] = mul(input.position, worldLightViewProjMatrix[i]);
   }
 
   // Calculate the position of the vertex against the world, view, and projection matrices.
-  output.position = mul(input.position, worldMatrix);
-  output.position = mul(output.position, viewMatrix);
-  output.position = mul(output.position, projectionMatrix);
+  output.position = mul(input.position, worldViewProjMatrix);
   
   // Store the texture coordinates for the pixel shader.
   output.tex = input.tex;
@@ -5,6 +5,8 @@ cbuffer MatrixBuffer : register(b0) {
     matrix worldMatrix;
     matrix viewMatrix;
     matrix projectionMatrix;
+    // Product of the matrices above
+    matrix worldViewProjMatrix;
 };
 
 struct InputType {
@@ -26,9 +28,7 @@ OutputType main(InputType input) {
   input.position.w = 1.0f;
 
   // Calculate the position of the vertex against the world, view, and projection matrices.
-  output.position = mul(input.position, worldMatrix);
-  output.position = mul(output.position, viewMatrix);
-  output.position = mul(output.position, projectionMatrix);
+  output.position = mul(input.position, worldViewProjMatrix);
 
 	// Store the texture coordinates for the pixel shader.
   output.tex = input.tex;
@@ -0,0 +1,78 @@
+// Virtual texturing helpers, included by the shaders which use virtual
+// textures. The layouts match DX/virtual_texture_cache.h
+
+static const float kVtTileSize = 128.0f;
+static const float kVtTileBorder = 4.0f;
+static const float kVtPaddedTileSize = 136.0f;
+
+cbuffer VirtualTextureBuffer : register(b4) {
+  // Size of mip 0 in tiles, and number of mips
+  float2 vt_tiles;
+  float vt_mip_count;
+  // Texture ID + 1, as written in the feedback
+  uint vt_feedback_id;
+  // Size of the physical cache in texels
+  float2 vt_cache_size;
+  // Added to the mip, e.g. to account for a lower resolution feedback pass
+  float vt_mip_bias;
+  float vt_padding;
+};
+
+// Indirection table of the texture and the physical cache, for the lit
+// shaders to sample diffuse colours from
+Texture2D<uint4> vt_indirection : register(t5);
+Texture2D vt_cache : register(t6);
+
+// Mip of the virtual texture wanted at uv
+float VtMipLevel(float2 uv) {
+  float2 texels = uv * vt_tiles * kVtTileSize;
+  float2 dx = ddx(texels);
+  float2 dy = ddy(texels);
+  float d = max(dot(dx, dx), dot(dy, dy));
+
+  return clamp(0.5f * log2(max(d, 1e-8f)) + vt_mip_bias, 0.0f,
+    vt_mip_count - 1.0f);
+}
+
+// Number of tiles per side at a mip
+float2 VtTilesAtMip(uint mip) {
+  return max(floor(vt_tiles / exp2(mip)), 1.0f);
+}
+
+// Page wanted at uv, packed as VtPage
+uint VtFeedback(float2 uv) {
+  uint mip = (uint)VtMipLevel(uv);
+  uint2 tile = (uint2)(frac(uv) * VtTilesAtMip(mip));
+
+  return (vt_feedback_id << 20) | (mip << 16) | (tile.y << 8) | tile.x;
+}
+
+// Sample a virtual texture through its indirection table; pages which are
+// not resident fall back to the closest coarser resident one
+float4 SampleVirtual(Texture2D<uint4> indirection, Texture2D cache,
+  SamplerState cache_sampler, float2 uv) {
+  uint mip = (uint)VtMipLevel(uv);
+  uint4 entry = indirection.Load(int3(frac(uv) * VtTilesAtMip(mip), mip));
+  if (entry.w == 0) {
+    return float4(0.0f, 0.0f, 0.0f, 1.0f);
+  }
+
+  // Position within the page which is actually mapped
+  float2 in_tile = frac(frac(uv) * VtTilesAtMip(entry.z));
+  float2 texel = entry.xy * kVtPaddedTileSize + kVtTileBorder +
+    in_tile * kVtTileSize;
+
+  return cache.SampleLevel(cache_sampler, texel / vt_cache_size, 0);
+}
+
+// Diffuse colour of a lit shader: from the virtual texture of the draw if it
+// has one, or else from its own texture. Without a VirtualTextureBuffer
+// bound the ID reads as 0.
+float4 SampleDiffuse(Texture2D diffuse, SamplerState diffuse_sampler,
+  float2 uv) {
+  if (vt_feedback_id != 0) {
+    return SampleVirtual(vt_indirection, vt_cache, diffuse_sampler, uv);
+  }
+
+  return diffuse.Sample(diffuse_sampler, uv);
+}
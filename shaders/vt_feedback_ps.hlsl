@@ -0,0 +1,14 @@
+// Virtual texturing feedback pixel shader
+// Writes the page of the virtual texture each pixel wants, which the CPU
+// reads back to decide which pages to stream in
+
+#include "virtual_texture.hlsl"
+
+struct InputType {
+  float4 position : SV_POSITION;
+  float2 tex : TEXCOORD0;
+};
+
+uint main(InputType input) : SV_TARGET {
+  return VtFeedback(input.tex);
+}
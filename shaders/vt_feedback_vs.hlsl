@@ -0,0 +1,33 @@
+// Virtual texturing feedback vertex shader
+// Transforms geometry and passes on texture coordinates only
+
+cbuffer MatrixBuffer : register(b0) {
+  matrix worldMatrix;
+  matrix viewMatrix;
+  matrix projectionMatrix;
+  // Product of the matrices above
+  matrix worldViewProjMatrix;
+};
+
+struct InputType {
+  float4 position : POSITION;
+  float2 tex : TEXCOORD0;
+};
+
+struct OutputType {
+  float4 position : SV_POSITION;
+  float2 tex : TEXCOORD0;
+};
+
+OutputType main(InputType input) {
+  OutputType output;
+
+  // Change the position vector to be 4 units for proper matrix calculations.
+  input.position.w = 1.0f;
+
+  output.position = mul(input.position, worldViewProjMatrix);
+
+  output.tex = input.tex;
+
+  return output;
+}
@@ -19,7 +19,9 @@ struct LightType {
   float specular_power;
   float spot_cutoff;
   float spot_exponent;
-  float3 padding;
+  // Whether the shadow map of the light was rendered this frame
+  uint shadow_map;
+  float2 padding;
   matrix view_matrix;
   matrix proj_matrix;
 };
@@ -29,6 +31,8 @@ cbuffer MatrixBuffer : register(cb0)
     matrix worldMatrix;
     matrix viewMatrix;
     matrix projectionMatrix;
+    // Product of the matrices above
+    matrix worldViewProjMatrix;
 };
 
 cbuffer CamBuffer : register(cb1) {
@@ -93,9 +97,7 @@ OutputType main(InputType input)
     output.viewDir = normalize(camPos.xyz - output.worldPos.xyz);
 
     // Calculate the position of the vertex against the world, view, and projection matrices.
-    output.position = mul(input.position, worldMatrix);
-    output.position = mul(output.position, viewMatrix);
-    output.position = mul(output.position, projectionMatrix);
+    output.position = mul(input.position, worldViewProjMatrix);
     
     // Store the texture coordinates for the pixel shader.
     output.tex = input.tex;
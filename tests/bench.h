@@ -0,0 +1,56 @@
+//  Timing of the benchmarks
+//  * A benchmark runs its work for a number of repetitions and reports the
+//    best time, which is the least disturbed by the rest of the machine
+//  * Results are kept in a volatile sink, so that the work is not optimised
+//    away
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include "abertay_framework.h"
+
+namespace sz {
+namespace bench {
+
+// Seconds since an arbitrary point
+inline double Now() {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Keep a result alive
+inline void Keep(UInt64 value) {
+  static volatile UInt64 sink = 0;
+  sink = sink + value;
+}
+
+// Best time of repetitions of work, in seconds
+template <typename Work>
+double Best(UInt32 repetitions, Work work) {
+  double best = 0.;
+  for (UInt32 i = 0; i < repetitions; ++i) {
+    double start = Now();
+    work();
+    double time = Now() - start;
+    if (i == 0 || time < best) {
+      best = time;
+    }
+  }
+
+  return best;
+}
+
+// Print the rate at which items were processed
+inline void Report(const char *name, double seconds, double items,
+  const char *unit) {
+  printf("%-40s %10.3f ms %12.2f M%s/s %10.2f ns/%s\n", name,
+    seconds * 1000., items / seconds / 1000000., unit,
+    seconds * 1000000000. / items, unit);
+}
+
+} // namespace bench
+} // namespace sz
+
+#endif
@@ -0,0 +1,9 @@
+//  Texture.h includes the WIC texture loader, which only exists on Windows;
+//  none of the code under test uses it
+
+#ifndef _COMPAT_WICTEXTURELOADER_H
+#define _COMPAT_WICTEXTURELOADER_H
+
+#include "d3d11.h"
+
+#endif
@@ -0,0 +1,348 @@
+//  D3D11 types for building the core modules off Windows
+//  * Descriptions, enums and the interfaces the modules under test use
+//  * Methods of the interfaces do nothing, or fail with E_NOTIMPL, unless a
+//    test overrides them; no GPU is ever touched
+//  * Reference counting is left to the objects tests make
+
+#ifndef _COMPAT_D3D11_H
+#define _COMPAT_D3D11_H
+
+#include "windows.h"
+#include "dxgi.h"
+
+#define D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT 128
+#define D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT 14
+#define D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT 16
+#define D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT 32
+#define D3D11_REQ_CONSTANT_BUFFER_ELEMENT_COUNT 4096
+#define D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT 8
+#define D3D11_FLOAT32_MAX 3.402823466e+38f
+
+enum D3D11_USAGE {
+  D3D11_USAGE_DEFAULT = 0,
+  D3D11_USAGE_IMMUTABLE = 1,
+  D3D11_USAGE_DYNAMIC = 2,
+  D3D11_USAGE_STAGING = 3
+};
+
+enum D3D11_BIND_FLAG {
+  D3D11_BIND_VERTEX_BUFFER = 0x1,
+  D3D11_BIND_INDEX_BUFFER = 0x2,
+  D3D11_BIND_CONSTANT_BUFFER = 0x4,
+  D3D11_BIND_SHADER_RESOURCE = 0x8,
+  D3D11_BIND_RENDER_TARGET = 0x20,
+  D3D11_BIND_DEPTH_STENCIL = 0x40
+};
+
+enum D3D11_CPU_ACCESS_FLAG {
+  D3D11_CPU_ACCESS_WRITE = 0x10000,
+  D3D11_CPU_ACCESS_READ = 0x20000
+};
+
+enum D3D11_RESOURCE_MISC_FLAG {
+  D3D11_RESOURCE_MISC_GENERATE_MIPS = 0x1
+};
+
+enum D3D11_MAP {
+  D3D11_MAP_READ = 1,
+  D3D11_MAP_WRITE = 2,
+  D3D11_MAP_READ_WRITE = 3,
+  D3D11_MAP_WRITE_DISCARD = 4,
+  D3D11_MAP_WRITE_NO_OVERWRITE = 5
+};
+
+enum D3D11_MAP_FLAG {
+  D3D11_MAP_FLAG_DO_NOT_WAIT = 0x100000
+};
+
+enum D3D11_PRIMITIVE_TOPOLOGY {
+  D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED = 0,
+  D3D11_PRIMITIVE_TOPOLOGY_POINTLIST = 1,
+  D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4,
+  D3D11_PRIMITIVE_TOPOLOGY_3_CONTROL_POINT_PATCHLIST = 35
+};
+
+enum D3D11_RESOURCE_DIMENSION {
+  D3D11_RESOURCE_DIMENSION_UNKNOWN = 0,
+  D3D11_RESOURCE_DIMENSION_BUFFER = 1,
+  D3D11_RESOURCE_DIMENSION_TEXTURE1D = 2,
+  D3D11_RESOURCE_DIMENSION_TEXTURE2D = 3,
+  D3D11_RESOURCE_DIMENSION_TEXTURE3D = 4
+};
+
+enum D3D11_SRV_DIMENSION {
+  D3D11_SRV_DIMENSION_UNKNOWN = 0,
+  D3D11_SRV_DIMENSION_BUFFER = 1,
+  D3D11_SRV_DIMENSION_TEXTURE2D = 4,
+  D3D11_SRV_DIMENSION_TEXTURE2DARRAY = 5
+};
+
+enum D3D11_FILTER {
+  D3D11_FILTER_MIN_MAG_MIP_POINT = 0,
+  D3D11_FILTER_MIN_MAG_MIP_LINEAR = 0x15,
+  D3D11_FILTER_ANISOTROPIC = 0x55
+};
+
+enum D3D11_TEXTURE_ADDRESS_MODE {
+  D3D11_TEXTURE_ADDRESS_WRAP = 1,
+  D3D11_TEXTURE_ADDRESS_MIRROR = 2,
+  D3D11_TEXTURE_ADDRESS_CLAMP = 3,
+  D3D11_TEXTURE_ADDRESS_BORDER = 4
+};
+
+enum D3D11_COMPARISON_FUNC {
+  D3D11_COMPARISON_NEVER = 1,
+  D3D11_COMPARISON_LESS = 2,
+  D3D11_COMPARISON_EQUAL = 3,
+  D3D11_COMPARISON_LESS_EQUAL = 4,
+  D3D11_COMPARISON_GREATER = 5,
+  D3D11_COMPARISON_NOT_EQUAL = 6,
+  D3D11_COMPARISON_GREATER_EQUAL = 7,
+  D3D11_COMPARISON_ALWAYS = 8
+};
+
+enum D3D11_BLEND {
+  D3D11_BLEND_ZERO = 1,
+  D3D11_BLEND_ONE = 2,
+  D3D11_BLEND_SRC_ALPHA = 5,
+  D3D11_BLEND_INV_SRC_ALPHA = 6
+};
+
+enum D3D11_BLEND_OP {
+  D3D11_BLEND_OP_ADD = 1
+};
+
+enum D3D11_FILL_MODE {
+  D3D11_FILL_WIREFRAME = 2,
+  D3D11_FILL_SOLID = 3
+};
+
+enum D3D11_CULL_MODE {
+  D3D11_CULL_NONE = 1,
+  D3D11_CULL_FRONT = 2,
+  D3D11_CULL_BACK = 3
+};
+
+struct D3D11_BUFFER_DESC {
+  UINT ByteWidth;
+  D3D11_USAGE Usage;
+  UINT BindFlags;
+  UINT CPUAccessFlags;
+  UINT MiscFlags;
+  UINT StructureByteStride;
+};
+
+struct D3D11_TEXTURE2D_DESC {
+  UINT Width;
+  UINT Height;
+  UINT MipLevels;
+  UINT ArraySize;
+  DXGI_FORMAT Format;
+  DXGI_SAMPLE_DESC SampleDesc;
+  D3D11_USAGE Usage;
+  UINT BindFlags;
+  UINT CPUAccessFlags;
+  UINT MiscFlags;
+};
+
+struct D3D11_SUBRESOURCE_DATA {
+  const void *pSysMem;
+  UINT SysMemPitch;
+  UINT SysMemSlicePitch;
+};
+
+struct D3D11_MAPPED_SUBRESOURCE {
+  void *pData;
+  UINT RowPitch;
+  UINT DepthPitch;
+};
+
+struct D3D11_TEX2D_SRV {
+  UINT MostDetailedMip;
+  UINT MipLevels;
+};
+
+struct D3D11_TEX2D_ARRAY_SRV {
+  UINT MostDetailedMip;
+  UINT MipLevels;
+  UINT FirstArraySlice;
+  UINT ArraySize;
+};
+
+struct D3D11_SHADER_RESOURCE_VIEW_DESC {
+  DXGI_FORMAT Format;
+  D3D11_SRV_DIMENSION ViewDimension;
+  union {
+    D3D11_TEX2D_SRV Texture2D;
+    D3D11_TEX2D_ARRAY_SRV Texture2DArray;
+  };
+};
+
+struct D3D11_SAMPLER_DESC {
+  D3D11_FILTER Filter;
+  D3D11_TEXTURE_ADDRESS_MODE AddressU;
+  D3D11_TEXTURE_ADDRESS_MODE AddressV;
+  D3D11_TEXTURE_ADDRESS_MODE AddressW;
+  FLOAT MipLODBias;
+  UINT MaxAnisotropy;
+  D3D11_COMPARISON_FUNC ComparisonFunc;
+  FLOAT BorderColor[4];
+  FLOAT MinLOD;
+  FLOAT MaxLOD;
+};
+
+struct D3D11_RENDER_TARGET_BLEND_DESC {
+  BOOL BlendEnable;
+  D3D11_BLEND SrcBlend;
+  D3D11_BLEND DestBlend;
+  D3D11_BLEND_OP BlendOp;
+  D3D11_BLEND SrcBlendAlpha;
+  D3D11_BLEND DestBlendAlpha;
+  D3D11_BLEND_OP BlendOpAlpha;
+  UINT8 RenderTargetWriteMask;
+};
+
+struct D3D11_BLEND_DESC {
+  BOOL AlphaToCoverageEnable;
+  BOOL IndependentBlendEnable;
+  D3D11_RENDER_TARGET_BLEND_DESC RenderTarget[8];
+};
+
+struct D3D11_RASTERIZER_DESC {
+  D3D11_FILL_MODE FillMode;
+  D3D11_CULL_MODE CullMode;
+  BOOL FrontCounterClockwise;
+  INT DepthBias;
+  FLOAT DepthBiasClamp;
+  FLOAT SlopeScaledDepthBias;
+  BOOL DepthClipEnable;
+  BOOL ScissorEnable;
+  BOOL MultisampleEnable;
+  BOOL AntialiasedLineEnable;
+};
+
+struct D3D11_VIEWPORT {
+  FLOAT TopLeftX;
+  FLOAT TopLeftY;
+  FLOAT Width;
+  FLOAT Height;
+  FLOAT MinDepth;
+  FLOAT MaxDepth;
+};
+
+struct D3D11_BOX {
+  UINT left;
+  UINT top;
+  UINT front;
+  UINT right;
+  UINT bottom;
+  UINT back;
+};
+
+struct IUnknown {
+  virtual ~IUnknown() {}
+  virtual unsigned long AddRef() {
+    return 1;
+  }
+  virtual unsigned long Release() {
+    return 0;
+  }
+};
+
+struct ID3D11Device;
+
+struct ID3D11DeviceChild : IUnknown {
+};
+
+struct ID3D11Resource : ID3D11DeviceChild {
+  virtual void GetType(D3D11_RESOURCE_DIMENSION *dimension) {
+    *dimension = D3D11_RESOURCE_DIMENSION_UNKNOWN;
+  }
+};
+
+struct ID3D11Buffer : ID3D11Resource {
+  void GetType(D3D11_RESOURCE_DIMENSION *dimension) {
+    *dimension = D3D11_RESOURCE_DIMENSION_BUFFER;
+  }
+  virtual void GetDesc(D3D11_BUFFER_DESC *desc) {
+    ZeroMemory(desc, sizeof(*desc));
+  }
+};
+
+struct ID3D11Texture2D : ID3D11Resource {
+  void GetType(D3D11_RESOURCE_DIMENSION *dimension) {
+    *dimension = D3D11_RESOURCE_DIMENSION_TEXTURE2D;
+  }
+  virtual void GetDesc(D3D11_TEXTURE2D_DESC *desc) {
+    ZeroMemory(desc, sizeof(*desc));
+  }
+};
+
+struct ID3D11View : ID3D11DeviceChild {
+};
+struct ID3D11ShaderResourceView : ID3D11View {
+};
+struct ID3D11RenderTargetView : ID3D11View {
+};
+struct ID3D11DepthStencilView : ID3D11View {
+};
+
+struct ID3D11InputLayout : ID3D11DeviceChild {
+};
+struct ID3D11VertexShader : ID3D11DeviceChild {
+};
+struct ID3D11HullShader : ID3D11DeviceChild {
+};
+struct ID3D11DomainShader : ID3D11DeviceChild {
+};
+struct ID3D11GeometryShader : ID3D11DeviceChild {
+};
+struct ID3D11PixelShader : ID3D11DeviceChild {
+};
+struct ID3D11SamplerState : ID3D11DeviceChild {
+};
+struct ID3D11BlendState : ID3D11DeviceChild {
+};
+struct ID3D11RasterizerState : ID3D11DeviceChild {
+};
+struct ID3D11DepthStencilState : ID3D11DeviceChild {
+};
+
+struct ID3D11DeviceContext : ID3D11DeviceChild {
+  virtual void UpdateSubresource(ID3D11Resource *resource, UINT subresource,
+    const D3D11_BOX *box, const void *data, UINT row_pitch,
+    UINT depth_pitch) {
+  }
+  virtual void GenerateMips(ID3D11ShaderResourceView *view) {
+  }
+};
+
+struct ID3D11Device : IUnknown {
+  virtual HRESULT CreateBuffer(const D3D11_BUFFER_DESC *desc,
+    const D3D11_SUBRESOURCE_DATA *data, ID3D11Buffer **buffer) {
+    return E_NOTIMPL;
+  }
+  virtual HRESULT CreateTexture2D(const D3D11_TEXTURE2D_DESC *desc,
+    const D3D11_SUBRESOURCE_DATA *data, ID3D11Texture2D **texture) {
+    return E_NOTIMPL;
+  }
+  virtual HRESULT CreateShaderResourceView(ID3D11Resource *resource,
+    const D3D11_SHADER_RESOURCE_VIEW_DESC *desc,
+    ID3D11ShaderResourceView **view) {
+    return E_NOTIMPL;
+  }
+  virtual HRESULT CreateSamplerState(const D3D11_SAMPLER_DESC *desc,
+    ID3D11SamplerState **state) {
+    return E_NOTIMPL;
+  }
+  virtual HRESULT CreateBlendState(const D3D11_BLEND_DESC *desc,
+    ID3D11BlendState **state) {
+    return E_NOTIMPL;
+  }
+  virtual HRESULT CreateRasterizerState(const D3D11_RASTERIZER_DESC *desc,
+    ID3D11RasterizerState **state) {
+    return E_NOTIMPL;
+  }
+};
+
+#endif
@@ -0,0 +1,445 @@
+//  DirectXMath for building the core modules off Windows
+//  * The subset of the library the modules under test and the tests use,
+//    with the same types, layout and conventions (row vectors, left handed)
+//  * SSE where it is as simple as scalar code, so that benchmarks are in the
+//    same ballpark as with the real library
+
+#ifndef _COMPAT_DIRECTXMATH_H
+#define _COMPAT_DIRECTXMATH_H
+
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace DirectX {
+
+const float XM_PI = 3.141592654f;
+const float XM_2PI = 6.283185307f;
+const float XM_PIDIV2 = 1.570796327f;
+const float XM_PIDIV4 = 0.785398163f;
+
+typedef __m128 XMVECTOR;
+typedef const XMVECTOR FXMVECTOR;
+typedef const XMVECTOR GXMVECTOR;
+typedef const XMVECTOR HXMVECTOR;
+typedef const XMVECTOR &CXMVECTOR;
+
+struct XMMATRIX {
+  XMVECTOR r[4];
+};
+typedef const XMMATRIX &FXMMATRIX;
+typedef const XMMATRIX &CXMMATRIX;
+
+struct XMFLOAT2 {
+  float x;
+  float y;
+
+  XMFLOAT2() {}
+  XMFLOAT2(float _x, float _y) :
+    x(_x),
+    y(_y) {}
+};
+
+struct XMFLOAT3 {
+  float x;
+  float y;
+  float z;
+
+  XMFLOAT3() {}
+  XMFLOAT3(float _x, float _y, float _z) :
+    x(_x),
+    y(_y),
+    z(_z) {}
+};
+
+struct XMFLOAT4 {
+  float x;
+  float y;
+  float z;
+  float w;
+
+  XMFLOAT4() {}
+  XMFLOAT4(float _x, float _y, float _z, float _w) :
+    x(_x),
+    y(_y),
+    z(_z),
+    w(_w) {}
+};
+
+struct alignas(16) XMFLOAT4A : public XMFLOAT4 {
+  XMFLOAT4A() {}
+  XMFLOAT4A(float _x, float _y, float _z, float _w) :
+    XMFLOAT4(_x, _y, _z, _w) {}
+};
+
+struct XMFLOAT4X4 {
+  union {
+    struct {
+      float _11, _12, _13, _14;
+      float _21, _22, _23, _24;
+      float _31, _32, _33, _34;
+      float _41, _42, _43, _44;
+    };
+    float m[4][4];
+  };
+
+  XMFLOAT4X4() {}
+};
+
+// Vectors
+
+inline XMVECTOR XMVectorSet(float x, float y, float z, float w) {
+  return _mm_setr_ps(x, y, z, w);
+}
+
+inline XMVECTOR XMVectorZero() {
+  return _mm_setzero_ps();
+}
+
+inline XMVECTOR XMVectorReplicate(float value) {
+  return _mm_set1_ps(value);
+}
+
+inline float XMVectorGetX(FXMVECTOR v) {
+  return _mm_cvtss_f32(v);
+}
+
+inline float XMVectorGetY(FXMVECTOR v) {
+  return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+}
+
+inline float XMVectorGetZ(FXMVECTOR v) {
+  return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+
+inline float XMVectorGetW(FXMVECTOR v) {
+  return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+
+inline XMVECTOR XMVectorSetW(FXMVECTOR v, float w) {
+  // z, w of the result from (z of v, w)
+  XMVECTOR zw = _mm_shuffle_ps(v, _mm_set_ss(w), _MM_SHUFFLE(0, 0, 2, 2));
+  return _mm_shuffle_ps(v, zw, _MM_SHUFFLE(2, 0, 1, 0));
+}
+
+inline XMVECTOR XMVectorSplatX(FXMVECTOR v) {
+  return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+}
+
+inline XMVECTOR XMVectorSplatY(FXMVECTOR v) {
+  return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+}
+
+inline XMVECTOR XMVectorSplatZ(FXMVECTOR v) {
+  return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+}
+
+inline XMVECTOR XMVectorSplatW(FXMVECTOR v) {
+  return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+inline XMVECTOR XMVectorAdd(FXMVECTOR a, FXMVECTOR b) {
+  return _mm_add_ps(a, b);
+}
+
+inline XMVECTOR XMVectorSubtract(FXMVECTOR a, FXMVECTOR b) {
+  return _mm_sub_ps(a, b);
+}
+
+inline XMVECTOR XMVectorMultiply(FXMVECTOR a, FXMVECTOR b) {
+  return _mm_mul_ps(a, b);
+}
+
+inline XMVECTOR XMVectorMultiplyAdd(FXMVECTOR a, FXMVECTOR b, FXMVECTOR c) {
+  return _mm_add_ps(_mm_mul_ps(a, b), c);
+}
+
+inline XMVECTOR XMVectorScale(FXMVECTOR v, float scale) {
+  return _mm_mul_ps(v, _mm_set1_ps(scale));
+}
+
+inline XMVECTOR XMVectorNegate(FXMVECTOR v) {
+  return _mm_sub_ps(_mm_setzero_ps(), v);
+}
+
+inline XMVECTOR XMVectorAbs(FXMVECTOR v) {
+  return _mm_max_ps(v, _mm_sub_ps(_mm_setzero_ps(), v));
+}
+
+inline XMVECTOR XMVectorMin(FXMVECTOR a, FXMVECTOR b) {
+  return _mm_min_ps(a, b);
+}
+
+inline XMVECTOR XMVectorMax(FXMVECTOR a, FXMVECTOR b) {
+  return _mm_max_ps(a, b);
+}
+
+inline XMVECTOR XMVector3Dot(FXMVECTOR a, FXMVECTOR b) {
+  float x[4], y[4];
+  _mm_storeu_ps(x, a);
+  _mm_storeu_ps(y, b);
+  return _mm_set1_ps(x[0] * y[0] + x[1] * y[1] + x[2] * y[2]);
+}
+
+inline XMVECTOR XMVector4Dot(FXMVECTOR a, FXMVECTOR b) {
+  float x[4], y[4];
+  _mm_storeu_ps(x, a);
+  _mm_storeu_ps(y, b);
+  return _mm_set1_ps(x[0] * y[0] + x[1] * y[1] + x[2] * y[2] + x[3] * y[3]);
+}
+
+inline XMVECTOR XMVector3Length(FXMVECTOR v) {
+  return _mm_sqrt_ps(XMVector3Dot(v, v));
+}
+
+inline XMVECTOR XMVector3Normalize(FXMVECTOR v) {
+  XMVECTOR length = XMVector3Length(v);
+  if (XMVectorGetX(length) == 0.f) {
+    return v;
+  }
+  return _mm_div_ps(v, length);
+}
+
+inline XMVECTOR XMVector3Cross(FXMVECTOR a, FXMVECTOR b) {
+  float x[4], y[4];
+  _mm_storeu_ps(x, a);
+  _mm_storeu_ps(y, b);
+  return _mm_setr_ps(x[1] * y[2] - x[2] * y[1], x[2] * y[0] - x[0] * y[2],
+    x[0] * y[1] - x[1] * y[0], 0.f);
+}
+
+inline XMVECTOR XMPlaneNormalize(FXMVECTOR plane) {
+  XMVECTOR length = XMVector3Length(plane);
+  if (XMVectorGetX(length) == 0.f) {
+    return plane;
+  }
+  return _mm_div_ps(plane, length);
+}
+
+inline XMVECTOR XMVector4Transform(FXMVECTOR v, FXMMATRIX m) {
+  XMVECTOR result = _mm_mul_ps(XMVectorSplatX(v), m.r[0]);
+  result = _mm_add_ps(result, _mm_mul_ps(XMVectorSplatY(v), m.r[1]));
+  result = _mm_add_ps(result, _mm_mul_ps(XMVectorSplatZ(v), m.r[2]));
+  return _mm_add_ps(result, _mm_mul_ps(XMVectorSplatW(v), m.r[3]));
+}
+
+inline XMVECTOR XMVector3Transform(FXMVECTOR v, FXMMATRIX m) {
+  XMVECTOR result = _mm_mul_ps(XMVectorSplatX(v), m.r[0]);
+  result = _mm_add_ps(result, _mm_mul_ps(XMVectorSplatY(v), m.r[1]));
+  result = _mm_add_ps(result, _mm_mul_ps(XMVectorSplatZ(v), m.r[2]));
+  return _mm_add_ps(result, m.r[3]);
+}
+
+inline XMVECTOR XMVector3TransformCoord(FXMVECTOR v, FXMMATRIX m) {
+  XMVECTOR result = XMVector3Transform(v, m);
+  return _mm_div_ps(result, XMVectorSplatW(result));
+}
+
+inline XMVECTOR XMVector3TransformNormal(FXMVECTOR v, FXMMATRIX m) {
+  XMVECTOR result = _mm_mul_ps(XMVectorSplatX(v), m.r[0]);
+  result = _mm_add_ps(result, _mm_mul_ps(XMVectorSplatY(v), m.r[1]));
+  return _mm_add_ps(result, _mm_mul_ps(XMVectorSplatZ(v), m.r[2]));
+}
+
+// Loads and stores
+
+inline XMVECTOR XMLoadFloat3(const XMFLOAT3 *source) {
+  return _mm_setr_ps(source->x, source->y, source->z, 0.f);
+}
+
+inline XMVECTOR XMLoadFloat4(const XMFLOAT4 *source) {
+  return _mm_loadu_ps(&source->x);
+}
+
+inline void XMStoreFloat3(XMFLOAT3 *destination, FXMVECTOR v) {
+  float f[4];
+  _mm_storeu_ps(f, v);
+  destination->x = f[0];
+  destination->y = f[1];
+  destination->z = f[2];
+}
+
+inline void XMStoreFloat4(XMFLOAT4 *destination, FXMVECTOR v) {
+  _mm_storeu_ps(&destination->x, v);
+}
+
+inline void XMStoreFloat4A(XMFLOAT4A *destination, FXMVECTOR v) {
+  _mm_store_ps(&destination->x, v);
+}
+
+inline XMMATRIX XMLoadFloat4x4(const XMFLOAT4X4 *source) {
+  XMMATRIX m;
+  for (int i = 0; i < 4; ++i) {
+    m.r[i] = _mm_loadu_ps(source->m[i]);
+  }
+  return m;
+}
+
+inline void XMStoreFloat4x4(XMFLOAT4X4 *destination, FXMMATRIX m) {
+  for (int i = 0; i < 4; ++i) {
+    _mm_storeu_ps(destination->m[i], m.r[i]);
+  }
+}
+
+// Matrices
+
+inline XMMATRIX XMMatrixSet(float m00, float m01, float m02, float m03,
+  float m10, float m11, float m12, float m13, float m20, float m21,
+  float m22, float m23, float m30, float m31, float m32, float m33) {
+  XMMATRIX m;
+  m.r[0] = _mm_setr_ps(m00, m01, m02, m03);
+  m.r[1] = _mm_setr_ps(m10, m11, m12, m13);
+  m.r[2] = _mm_setr_ps(m20, m21, m22, m23);
+  m.r[3] = _mm_setr_ps(m30, m31, m32, m33);
+  return m;
+}
+
+inline XMMATRIX XMMatrixIdentity() {
+  return XMMatrixSet(1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f,
+    0.f, 0.f, 0.f, 0.f, 1.f);
+}
+
+inline XMMATRIX XMMatrixTranspose(FXMMATRIX m) {
+  XMMATRIX result = m;
+  _MM_TRANSPOSE4_PS(result.r[0], result.r[1], result.r[2], result.r[3]);
+  return result;
+}
+
+inline XMMATRIX XMMatrixMultiply(FXMMATRIX a, CXMMATRIX b) {
+  XMMATRIX result;
+  for (int i = 0; i < 4; ++i) {
+    result.r[i] = XMVector4Transform(a.r[i], b);
+  }
+  return result;
+}
+
+inline XMMATRIX XMMatrixMultiplyTranspose(FXMMATRIX a, CXMMATRIX b) {
+  return XMMatrixTranspose(XMMatrixMultiply(a, b));
+}
+
+inline XMMATRIX operator*(FXMMATRIX a, CXMMATRIX b) {
+  return XMMatrixMultiply(a, b);
+}
+
+// Gauss-Jordan elimination in double precision; the determinant is not
+// computed
+inline XMMATRIX XMMatrixInverse(XMVECTOR *determinant, FXMMATRIX m) {
+  double a[4][8];
+  float f[4][4];
+  for (int i = 0; i < 4; ++i) {
+    _mm_storeu_ps(f[i], m.r[i]);
+    for (int j = 0; j < 4; ++j) {
+      a[i][j] = f[i][j];
+      a[i][j + 4] = i == j ? 1. : 0.;
+    }
+  }
+
+  for (int c = 0; c < 4; ++c) {
+    int pivot = c;
+    for (int r = c + 1; r < 4; ++r) {
+      if (fabs(a[r][c]) > fabs(a[pivot][c])) {
+        pivot = r;
+      }
+    }
+    for (int j = 0; j < 8; ++j) {
+      double t = a[c][j];
+      a[c][j] = a[pivot][j];
+      a[pivot][j] = t;
+    }
+    double d = a[c][c];
+    for (int j = 0; j < 8; ++j) {
+      a[c][j] /= d;
+    }
+    for (int r = 0; r < 4; ++r) {
+      if (r == c) {
+        continue;
+      }
+      double k = a[r][c];
+      for (int j = 0; j < 8; ++j) {
+        a[r][j] -= k * a[c][j];
+      }
+    }
+  }
+
+  if (determinant != nullptr) {
+    *determinant = _mm_setzero_ps();
+  }
+  XMMATRIX result;
+  for (int i = 0; i < 4; ++i) {
+    result.r[i] = _mm_setr_ps(static_cast<float>(a[i][4]),
+      static_cast<float>(a[i][5]), static_cast<float>(a[i][6]),
+      static_cast<float>(a[i][7]));
+  }
+  return result;
+}
+
+inline XMMATRIX XMMatrixTranslation(float x, float y, float z) {
+  return XMMatrixSet(1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f,
+    0.f, x, y, z, 1.f);
+}
+
+inline XMMATRIX XMMatrixScaling(float x, float y, float z) {
+  return XMMatrixSet(x, 0.f, 0.f, 0.f, 0.f, y, 0.f, 0.f, 0.f, 0.f, z, 0.f,
+    0.f, 0.f, 0.f, 1.f);
+}
+
+inline XMMATRIX XMMatrixRotationY(float angle) {
+  float c = cosf(angle);
+  float s = sinf(angle);
+  return XMMatrixSet(c, 0.f, -s, 0.f, 0.f, 1.f, 0.f, 0.f, s, 0.f, c, 0.f,
+    0.f, 0.f, 0.f, 1.f);
+}
+
+inline XMMATRIX XMMatrixLookToLH(FXMVECTOR eye, FXMVECTOR direction,
+  FXMVECTOR up) {
+  XMVECTOR z = XMVector3Normalize(direction);
+  XMVECTOR x = XMVector3Normalize(XMVector3Cross(up, z));
+  XMVECTOR y = XMVector3Cross(z, x);
+  XMVECTOR neg_eye = XMVectorNegate(eye);
+
+  XMMATRIX m;
+  m.r[0] = XMVectorSetW(x, XMVectorGetX(XMVector3Dot(x, neg_eye)));
+  m.r[1] = XMVectorSetW(y, XMVectorGetX(XMVector3Dot(y, neg_eye)));
+  m.r[2] = XMVectorSetW(z, XMVectorGetX(XMVector3Dot(z, neg_eye)));
+  m.r[3] = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+  return XMMatrixTranspose(m);
+}
+
+inline XMMATRIX XMMatrixLookAtLH(FXMVECTOR eye, FXMVECTOR focus,
+  FXMVECTOR up) {
+  return XMMatrixLookToLH(eye, XMVectorSubtract(focus, eye), up);
+}
+
+inline XMMATRIX XMMatrixPerspectiveFovLH(float fov_y, float aspect,
+  float near_z, float far_z) {
+  float height = 1.f / tanf(fov_y * 0.5f);
+  float width = height / aspect;
+  float range = far_z / (far_z - near_z);
+  return XMMatrixSet(width, 0.f, 0.f, 0.f, 0.f, height, 0.f, 0.f, 0.f, 0.f,
+    range, 1.f, 0.f, 0.f, -range * near_z, 0.f);
+}
+
+inline XMMATRIX XMMatrixPerspectiveOffCenterLH(float left, float right,
+  float bottom, float top, float near_z, float far_z) {
+  float near2 = near_z + near_z;
+  float width = 1.f / (right - left);
+  float height = 1.f / (top - bottom);
+  float range = far_z / (far_z - near_z);
+  return XMMatrixSet(near2 * width, 0.f, 0.f, 0.f, 0.f, near2 * height, 0.f,
+    0.f, -(left + right) * width, -(top + bottom) * height, range, 1.f, 0.f,
+    0.f, -range * near_z, 0.f);
+}
+
+inline XMMATRIX XMMatrixOrthographicLH(float width, float height,
+  float near_z, float far_z) {
+  float range = 1.f / (far_z - near_z);
+  return XMMatrixSet(2.f / width, 0.f, 0.f, 0.f, 0.f, 2.f / height, 0.f, 0.f,
+    0.f, 0.f, range, 0.f, 0.f, 0.f, -range * near_z, 1.f);
+}
+
+inline float XMConvertToRadians(float degrees) {
+  return degrees * (XM_PI / 180.f);
+}
+
+} // namespace DirectX
+
+#endif
@@ -0,0 +1,74 @@
+//  Windows types for building the core modules off Windows
+//  * Only what the modules under test and their headers use
+//  * MessageBox reports to stderr instead of showing a window
+
+#ifndef _COMPAT_WINDOWS_H
+#define _COMPAT_WINDOWS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <iostream>
+#include <mm_malloc.h>
+
+typedef long HRESULT;
+typedef int BOOL;
+typedef int INT;
+typedef unsigned int UINT;
+typedef unsigned char UINT8;
+typedef unsigned char BYTE;
+typedef uint64_t UINT64;
+typedef float FLOAT;
+typedef long LONG;
+typedef unsigned long DWORD;
+typedef size_t SIZE_T;
+typedef wchar_t WCHAR;
+typedef const char *LPCSTR;
+typedef const wchar_t *LPCWSTR;
+typedef void *HWND;
+typedef void *HINSTANCE;
+
+struct GUID {
+  uint32_t data1;
+  uint16_t data2;
+  uint16_t data3;
+  uint8_t data4[8];
+};
+typedef GUID IID;
+typedef const GUID &REFGUID;
+typedef const GUID &REFIID;
+
+struct RECT {
+  LONG left;
+  LONG top;
+  LONG right;
+  LONG bottom;
+};
+
+#define S_OK ((HRESULT)0L)
+#define S_FALSE ((HRESULT)1L)
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+
+#define TRUE 1
+#define FALSE 0
+#define MB_OK 0
+#define CALLBACK
+#define WINAPI
+#define __declspec(x)
+
+#define ZeroMemory(p, n) memset((p), 0, (n))
+#define _aligned_malloc(size, alignment) _mm_malloc(size, alignment)
+#define _aligned_free(p) _mm_free(p)
+
+inline int MessageBox(HWND, LPCWSTR text, LPCWSTR caption, UINT) {
+  fwprintf(stderr, L"%ls: %ls\n", caption, text);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,208 @@
+// Allocations of the constant ring: alignment, running full and starting
+// over each frame, and threads allocating at once
+#include "constant_ring.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "recording_backend.h"
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+// Constant buffer backends can ask the description of
+struct ConstantBuffer : ID3D11Buffer {
+  UINT byte_width;
+
+  void GetDesc(D3D11_BUFFER_DESC *desc) {
+    ZeroMemory(desc, sizeof(*desc));
+    desc->ByteWidth = byte_width;
+    desc->BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  }
+};
+
+// Device which creates the buffer of the ring
+struct TestDevice : ID3D11Device {
+  ConstantBuffer ring_buffer;
+
+  TestDevice() {
+    ring_buffer.byte_width = 0;
+  }
+  HRESULT CreateBuffer(const D3D11_BUFFER_DESC *desc,
+    const D3D11_SUBRESOURCE_DATA *data, ID3D11Buffer **buffer) {
+    ring_buffer.byte_width = desc->ByteWidth;
+    *buffer = &ring_buffer;
+    return S_OK;
+  }
+};
+
+void TestAlignment() {
+  // The size is rounded up, as each allocation is
+  TestDevice device;
+  ConstantRing ring(&device, 1000);
+  CHECK(ring.size() == 1024);
+  CHECK(device.ring_buffer.byte_width == 1024);
+  CHECK(ring.buffer() == &device.ring_buffer);
+  CHECK(reinterpret_cast<size_t>(ring.data(0)) % kConstantRingAlignment ==
+    0);
+
+  CHECK(ring.Allocate(1) == 0);
+  CHECK(ring.Allocate(256) == 256);
+  CHECK(ring.Allocate(257) == 512);
+  CHECK(ring.used() == 1024);
+
+  // Constant buffers bound from an offset start on 16 constants
+  ConstantRing large(nullptr, 64 * 1024);
+  const UInt32 sizes[] = { 16, 64, 100, 192, 240, 256, 300, 1024, 4000 };
+  for (UInt32 size : sizes) {
+    UInt32 offset = large.Allocate(size);
+    CHECK(offset != kNoConstantRingOffset);
+    CHECK(offset % kConstantRingAlignment == 0);
+    CHECK(offset % (16 * 16) == 0);
+  }
+  CHECK(large.used() % kConstantRingAlignment == 0);
+}
+
+void TestFullRing() {
+  ConstantRing ring(nullptr, 4 * kConstantRingAlignment);
+
+  // A full ring fails allocations, however many, and counts them; the head
+  // runs past the end but the ring reports it full
+  for (UInt32 i = 0; i < 4; ++i) {
+    CHECK(ring.Allocate(200) == i * kConstantRingAlignment);
+  }
+  CHECK(ring.Allocate(1) == kNoConstantRingOffset);
+  CHECK(ring.Allocate(200) == kNoConstantRingOffset);
+  CHECK(ring.failed_count() == 2);
+  CHECK(ring.used() == ring.size());
+
+  // An allocation larger than what is left fails, though smaller ones after
+  // it would have fitted, so that the head only grows
+  ring.Reset();
+  CHECK(ring.Allocate(3 * kConstantRingAlignment) == 0);
+  CHECK(ring.Allocate(2 * kConstantRingAlignment) == kNoConstantRingOffset);
+  CHECK(ring.Allocate(kConstantRingAlignment) == kNoConstantRingOffset);
+  CHECK(ring.failed_count() == 2);
+
+  // The next frame starts over from the beginning
+  ring.Reset();
+  CHECK(ring.used() == 0);
+  CHECK(ring.failed_count() == 0);
+  CHECK(ring.Allocate(100) == 0);
+  CHECK(ring.Allocate(100) == kConstantRingAlignment);
+}
+
+void TestFree() {
+  ConstantRing ring(nullptr, 4096);
+  UInt32 first = ring.Allocate(100);
+  UInt32 second = ring.Allocate(300);
+
+  // Only the last allocation can be given back
+  CHECK(!ring.Free(first, 100));
+  CHECK(ring.Free(second, 300));
+  CHECK(ring.used() == kConstantRingAlignment);
+  CHECK(ring.Free(first, 100));
+  CHECK(ring.used() == 0);
+  CHECK(ring.Allocate(64) == 0);
+}
+
+void TestUpload() {
+  // What was allocated reaches the buffer with one map
+  TestDevice device;
+  ConstantRing ring(&device, 4096);
+  UInt32 offset = ring.Allocate(64);
+  memset(ring.data(offset), 7, 64);
+  offset = ring.Allocate(64);
+  memset(ring.data(offset), 8, 64);
+
+  // A deferred backend keeps the mapped bytes
+  RecordingBackend backend;
+  RecordingBackend *deferred = static_cast<RecordingBackend *>(
+    backend.CreateDeferred());
+  ring.Upload(deferred);
+  CHECK(deferred->count(kGfxMap) == 1);
+  CHECK(deferred->count(kGfxUnmap) == 1);
+  const GfxCommand &map = deferred->commands()[0];
+  CHECK(map.object == &device.ring_buffer);
+  CHECK(map.a == 0 && map.b == D3D11_MAP_WRITE_DISCARD);
+  CHECK(map.payload_size == ring.size());
+  CHECK(map.payload[0] == 7 && map.payload[63] == 7);
+  CHECK(map.payload[kConstantRingAlignment] == 8);
+  delete deferred;
+
+  // Nothing allocated, nothing mapped
+  ring.Reset();
+  ring.Upload(&backend);
+  CHECK(backend.count(kGfxMap) == 0);
+}
+
+void TestThreads() {
+  // Threads allocate ranges of several sizes at once, and fill them with
+  // their own bytes; the ranges never overlap, and the ring holds what each
+  // thread wrote. The ring is too small for all of them, so some fail.
+  const UInt32 thread_count = 8;
+  const UInt32 allocations = 2000;
+  ConstantRing ring(nullptr, 1024 * 1024);
+  std::vector<std::vector<std::pair<UInt32, UInt32> > > ranges(
+    thread_count);
+  std::vector<UInt32> failed(thread_count, 0);
+  std::vector<std::thread> threads;
+  for (UInt32 t = 0; t < thread_count; ++t) {
+    threads.push_back(std::thread([&, t] {
+      for (UInt32 i = 0; i < allocations; ++i) {
+        UInt32 size = 16 + (i * 37 + t * 101) % 600;
+        UInt32 offset = ring.Allocate(size);
+        if (offset == kNoConstantRingOffset) {
+          ++failed[t];
+          continue;
+        }
+        memset(ring.data(offset), static_cast<int>(t + 1), size);
+        ranges[t].push_back(std::make_pair(offset, size));
+      }
+    }));
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  UInt32 failed_count = 0;
+  std::vector<std::pair<UInt32, UInt32> > all;
+  for (UInt32 t = 0; t < thread_count; ++t) {
+    failed_count += failed[t];
+    for (const std::pair<UInt32, UInt32> &range : ranges[t]) {
+      CHECK(range.first % kConstantRingAlignment == 0);
+      CHECK(range.first + range.second <= ring.size());
+      const UInt8 *bytes = static_cast<const UInt8 *>(
+        ring.data(range.first));
+      bool kept = true;
+      for (UInt32 i = 0; i < range.second; ++i) {
+        kept = kept && bytes[i] == t + 1;
+      }
+      CHECK(kept);
+      all.push_back(range);
+    }
+  }
+  CHECK(failed_count > 0);
+  CHECK(ring.failed_count() == failed_count);
+  CHECK(ring.used() == ring.size());
+
+  std::sort(all.begin(), all.end());
+  for (size_t i = 1; i < all.size(); ++i) {
+    CHECK(all[i - 1].first + all[i - 1].second <= all[i].first);
+  }
+}
+
+} // namespace
+
+int main() {
+  TestAlignment();
+  TestFullRing();
+  TestFree();
+  TestUpload();
+  TestThreads();
+
+  return sz::test::Finish("constant_ring");
+}
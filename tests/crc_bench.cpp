@@ -0,0 +1,61 @@
+// Throughput of the table driven CRC against the bit at a time one, on
+// names as the renderer hashes them and on file contents
+#include "crc.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "crc_reference.h"
+
+using namespace sz::bench;
+
+int main() {
+  // Texture paths of a model
+  std::vector<std::string> names;
+  for (int i = 0; i < 1000; ++i) {
+    names.push_back("../res/sponza/textures/sponza_material_" +
+      std::to_string(i) + "_diff.png");
+  }
+  size_t name_bytes = 0;
+  for (const std::string &name : names) {
+    name_bytes += name.size();
+  }
+
+  // A texture file
+  std::vector<char> file(4 << 20);
+  for (size_t i = 0; i < file.size(); ++i) {
+    file[i] = static_cast<char>(rand());
+  }
+
+  const UInt32 repetitions = 10;
+  const double names_hashed = static_cast<double>(names.size()) * 100.;
+  double time = Best(repetitions, [&] {
+    for (int r = 0; r < 100; ++r) {
+      for (const std::string &name : names) {
+        Keep(reference::CRC::GetICRC(name.c_str()));
+      }
+    }
+  });
+  Report("names, bit at a time", time, names_hashed, "name");
+  time = Best(repetitions, [&] {
+    for (int r = 0; r < 100; ++r) {
+      for (const std::string &name : names) {
+        Keep(abfw::CRC::GetICRC(name.c_str()));
+      }
+    }
+  });
+  Report("names, tables", time, names_hashed, "name");
+  printf("%-40s %10.1f bytes\n", "mean name", static_cast<double>(name_bytes) /
+    static_cast<double>(names.size()));
+
+  time = Best(repetitions, [&] {
+    Keep(reference::CRC::GetCRC(file.data(), file.size()));
+  });
+  Report("file, bit at a time", time, static_cast<double>(file.size()), "B");
+  time = Best(repetitions, [&] {
+    Keep(abfw::CRC::GetCRC(file.data(), file.size()));
+  });
+  Report("file, tables", time, static_cast<double>(file.size()), "B");
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+//  The CRC as it was first implemented, a bit at a time, which the table
+//  driven one in crc.cpp has to match: names hashed by either have to stay
+//  the same, as they are stored in the model files
+
+#ifndef _CRC_REFERENCE_H
+#define _CRC_REFERENCE_H
+
+#include <cctype>
+#include <cstring>
+#include "abertay_framework.h"
+
+namespace reference
+{
+  class CRC
+  {
+  public:
+    static UInt32 GetCRC(const char* string)
+    {
+      CRC crc;
+      if(string)
+        crc.Update(string, static_cast<int>(strlen(string)));
+      return crc.GetU32();
+    }
+
+    static UInt32 GetICRC(const char* string)
+    {
+      CRC crc;
+      if(string)
+        crc.Update(string, static_cast<int>(strlen(string)), true);
+      return crc.GetU32();
+    }
+
+    static UInt32 GetCRC(const void* buffer, size_t length)
+    {
+      CRC crc;
+      crc.Update(static_cast<const char *>(buffer), static_cast<int>(length));
+      return crc.GetU32();
+    }
+
+    CRC(UInt32 _r=~0) : r(_r)
+    {
+    }
+
+  private:
+    // R := R*X^(-1)
+    void Clk(int i)
+    {
+      r ^= i;
+      if (1 & r)
+        r = ((r^gf) >> 1) | 0x80000000;
+      else
+        r >>= 1;
+    }
+
+    // A byte at a time, bit by bit, lsb first
+    void Update(const char *buffer, int len, bool toUpper = false)
+    {
+      while (len--)
+      {
+        int bitcnt, byte = *buffer++;
+        if(toUpper)
+          byte = std::toupper(byte);
+        for (bitcnt=0; bitcnt < 8; bitcnt++)
+        {
+          Clk(byte & 1);
+          byte >>= 1;
+        }
+      }
+    }
+
+    inline UInt32 GetU32() { return ~r; }
+
+    enum{gf=0xdb710641};
+    UInt32 r;
+  };
+}
+
+#endif
@@ -0,0 +1,80 @@
+// The table driven CRC gives the same hashes as the bit at a time one it
+// replaced, at run time and at compile time
+#include "crc.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "crc_reference.h"
+#include "test.h"
+
+namespace {
+
+// Hashes of literal names are usable as constants, and are worked out by
+// the compiler: CRC-32 of "123456789" is the standard check value, and the
+// name hash is that of the upper case name
+static ABFW_CONSTEXPR_VAR UInt32 kCheck = abfw::CRC::ConstCRC("123456789");
+static_assert(kCheck == 0xCBF43926, "CRC-32 check value");
+static ABFW_CONSTEXPR_VAR UInt32 kTextureShader =
+  abfw::CRC::ConstICRC("texture_shader");
+static_assert(kTextureShader == 0xB41E148B, "CRC-32 of TEXTURE_SHADER");
+
+// Random string of length bytes, none of them 0
+std::string RandomString(int length) {
+  std::string s;
+  for (int i = 0; i < length; ++i) {
+    s += static_cast<char>(rand() % 255 + 1);
+  }
+  return s;
+}
+
+void TestStrings() {
+  CHECK(abfw::CRC::GetCRC("") == reference::CRC::GetCRC(""));
+  CHECK(abfw::CRC::GetCRC(static_cast<const char *>(nullptr)) ==
+    reference::CRC::GetCRC(static_cast<const char *>(nullptr)));
+  CHECK(kTextureShader == reference::CRC::GetICRC("texture_shader"));
+  CHECK(abfw::CRC::GetICRC("../res/sponza/Textures/Lion.png") ==
+    abfw::CRC::GetICRC("../RES/SPONZA/textures/lion.PNG"));
+
+  // Every length up to and past the 8 bytes a step of the tables takes
+  int mismatches = 0;
+  for (int n = 0; n < 20000; ++n) {
+    std::string s = RandomString(n % 41);
+    const char *str = s.c_str();
+    UInt32 crc = reference::CRC::GetCRC(str);
+    UInt32 icrc = reference::CRC::GetICRC(str);
+    mismatches += abfw::CRC::GetCRC(str) != crc;
+    mismatches += abfw::CRC::GetICRC(str) != icrc;
+    mismatches += abfw::CRC::ConstCRC(str) != crc;
+    mismatches += abfw::CRC::ConstICRC(str) != icrc;
+  }
+  CHECK(mismatches == 0);
+}
+
+void TestBuffers() {
+  // Buffers hold zeros too, and start at any alignment
+  std::vector<char> buffer(4096 + 16);
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] = static_cast<char>(rand() % 4 == 0 ? 0 : rand());
+  }
+
+  int mismatches = 0;
+  for (size_t offset = 0; offset < 8; ++offset) {
+    for (size_t length = 0; length < 64; ++length) {
+      mismatches += abfw::CRC::GetCRC(&buffer[offset], length) !=
+        reference::CRC::GetCRC(&buffer[offset], length);
+    }
+    mismatches += abfw::CRC::GetCRC(&buffer[offset], 4096) !=
+      reference::CRC::GetCRC(&buffer[offset], 4096);
+  }
+  CHECK(mismatches == 0);
+}
+
+} // namespace
+
+int main() {
+  srand(1);
+  TestStrings();
+  TestBuffers();
+
+  return sz::test::Finish("crc");
+}
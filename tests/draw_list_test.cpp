@@ -0,0 +1,128 @@
+// Radix sort of DrawList against std::stable_sort of the same keys, and
+// the order the opaque and alpha keys give
+#include "draw_list.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+// Key with random bits above the index bits
+DrawKey RandomKey() {
+  DrawKey key = 0;
+  for (int i = 0; i < 4; ++i) {
+    key = (key << 16) ^ static_cast<DrawKey>(rand() & 0xFFFF);
+  }
+  return key & ~static_cast<DrawKey>((1 << kDrawKeyIndexBits) - 1);
+}
+
+// Draws are told apart by their instance_start, the order they were added
+DrawItem Item(UInt32 i) {
+  DrawItem item = { nullptr, nullptr, nullptr, nullptr, i, 0 };
+  return item;
+}
+
+// Sorts keys with the draw list and with std::stable_sort; true if the
+// draws and keys come out in the same order
+bool SortsLikeStableSort(DrawList &list, const std::vector<DrawKey> &keys) {
+  list.Clear();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    list.Add(keys[i], Item(static_cast<UInt32>(i)));
+  }
+  list.Sort();
+
+  std::vector<UInt32> order(keys.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = static_cast<UInt32>(i);
+  }
+  std::stable_sort(order.begin(), order.end(), [&keys](UInt32 a, UInt32 b) {
+    return keys[a] < keys[b];
+  });
+
+  if (list.size() != keys.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (list.item(i).instance_start != order[i] ||
+      list.key(i) != keys[order[i]]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TestRandomKeys() {
+  DrawList list;
+  // Sizes around the cases the sort treats apart, and large lists
+  const size_t sizes[] = { 0, 1, 2, 3, 100, 2049, 50000 };
+  for (size_t n : sizes) {
+    std::vector<DrawKey> keys(n);
+    for (DrawKey &key : keys) {
+      key = RandomKey();
+    }
+    CHECK(SortsLikeStableSort(list, keys));
+  }
+}
+
+void TestDuplicateKeys() {
+  // Few distinct keys, so that most draws tie and keep their order
+  DrawList list;
+  std::vector<DrawKey> distinct(7);
+  for (DrawKey &key : distinct) {
+    key = RandomKey();
+  }
+  std::vector<DrawKey> keys(10000);
+  for (DrawKey &key : keys) {
+    key = distinct[rand() % distinct.size()];
+  }
+  CHECK(SortsLikeStableSort(list, keys));
+
+  // All keys equal, so that every digit is skipped
+  std::vector<DrawKey> same(1000, distinct[0]);
+  CHECK(SortsLikeStableSort(list, same));
+
+  // Keys which only differ in one digit, so that the others are skipped
+  // and the result lands in the scratch buffer
+  for (UInt32 digit = 0; digit < 4; ++digit) {
+    for (DrawKey &key : keys) {
+      key = static_cast<DrawKey>(rand() & 0x7FF) <<
+        (kDrawKeyIndexBits + digit * 11);
+    }
+    CHECK(SortsLikeStableSort(list, keys));
+  }
+}
+
+void TestKeyOrder() {
+  // Opaque draws come first, grouped by shader, then material, then front
+  // to back; alpha draws come back to front whatever their state
+  DrawList list;
+  list.Add(MakeAlphaDrawKey(1, 1, 5.f), Item(0));
+  list.Add(MakeOpaqueDrawKey(2, 1, 1.f), Item(1));
+  list.Add(MakeOpaqueDrawKey(1, 2, 1.f), Item(2));
+  list.Add(MakeOpaqueDrawKey(1, 1, 10.f), Item(3));
+  list.Add(MakeOpaqueDrawKey(1, 1, 2.f), Item(4));
+  list.Add(MakeAlphaDrawKey(0, 0, 20.f), Item(5));
+  list.Add(MakeOpaqueDrawKey(1, 1, -3.f), Item(6));
+  list.Sort();
+
+  const UInt32 expected[] = { 6, 4, 3, 2, 1, 5, 0 };
+  for (size_t i = 0; i < list.size(); ++i) {
+    CHECK(list.item(i).instance_start == expected[i]);
+  }
+  CHECK(GetDrawPass(list.key(0)) == kDrawPassOpaque);
+  CHECK(GetDrawPass(list.key(list.size() - 1)) == kDrawPassAlpha);
+}
+
+} // namespace
+
+int main() {
+  srand(3);
+  TestRandomKeys();
+  TestDuplicateKeys();
+  TestKeyOrder();
+
+  return sz::test::Finish("draw_list");
+}
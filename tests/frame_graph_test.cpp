@@ -0,0 +1,249 @@
+// Culling, ordering and target allocation of the frame graph, with fake
+// RenderTextures
+#include "frame_graph.h"
+#include <string>
+#include <vector>
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+// Pooled targets the graph created and destroyed; only their addresses
+// matter to it
+struct Targets {
+  UInt32 created;
+  UInt32 destroyed;
+
+  Targets() :
+    created(0),
+    destroyed(0) {}
+};
+
+FrameGraph *NewGraph(Targets &targets) {
+  return new FrameGraph(
+    [&targets](const RenderTextureDesc &desc, UInt32 serial) {
+      ++targets.created;
+      return reinterpret_cast<RenderTexture *>((serial + 1) * 16);
+    },
+    [&targets](RenderTexture *target) {
+      ++targets.destroyed;
+    });
+}
+
+const RenderTextureDesc kColour(64, 64, DXGI_FORMAT_R8G8B8A8_UNORM,
+  DXGI_FORMAT_UNKNOWN, false);
+const RenderTextureDesc kDepth(64, 64, DXGI_FORMAT_UNKNOWN,
+  DXGI_FORMAT_D32_FLOAT, true);
+
+void TestCullAndSort() {
+  Targets targets;
+  FrameGraph *graph = NewGraph(targets);
+  std::string ran;
+
+  // Declared after the pass which reads it, yet runs first
+  FrameResource back_buffer = graph->ImportTarget("back buffer", nullptr);
+  FrameResource scene = graph->CreateTarget("scene", kColour);
+  FrameResource shadow = graph->CreateTarget("shadow", kDepth);
+  FrameResource unused = graph->CreateTarget("unused", kColour);
+  FramePass present = graph->AddPass("present", [&ran] { ran += "p"; });
+  graph->Read(present, scene);
+  graph->Write(present, back_buffer);
+  FramePass debug = graph->AddPass("debug", [&ran] { ran += "d"; });
+  graph->Read(debug, shadow);
+  graph->Write(debug, unused);
+  FramePass main = graph->AddPass("main", [&ran] { ran += "m"; });
+  graph->Read(main, shadow);
+  graph->Write(main, scene);
+  FramePass shadows = graph->AddPass("shadows", [&ran] { ran += "s"; });
+  graph->Write(shadows, shadow);
+
+  CHECK(graph->Compile());
+  // Nothing reads what the debug pass writes
+  CHECK(graph->culled(debug));
+  CHECK(graph->culled_count() == 1);
+  CHECK(graph->target(unused) == nullptr);
+  CHECK(graph->order().size() == 3);
+  CHECK(graph->order()[0] == shadows);
+  CHECK(graph->order()[1] == main);
+  CHECK(graph->order()[2] == present);
+  graph->Execute();
+  CHECK(ran == "smp");
+
+  // Passes which do not depend on each other keep the order they were
+  // declared in
+  graph->Reset();
+  back_buffer = graph->ImportTarget("back buffer", nullptr);
+  FramePass a = graph->AddPass("a", [] {});
+  FramePass b = graph->AddPass("b", [] {});
+  graph->Write(a, back_buffer);
+  graph->Write(b, graph->ImportTarget("other", nullptr));
+  CHECK(graph->Compile());
+  CHECK(graph->order().size() == 2);
+  CHECK(graph->order()[0] == a && graph->order()[1] == b);
+
+  delete graph;
+}
+
+void TestInvalid() {
+  Targets targets;
+  FrameGraph *graph = NewGraph(targets);
+
+  // A target written twice
+  FrameResource back_buffer = graph->ImportTarget("back buffer", nullptr);
+  FrameResource scene = graph->CreateTarget("scene", kColour);
+  FramePass first = graph->AddPass("first", [] {});
+  FramePass second = graph->AddPass("second", [] {});
+  graph->Write(first, scene);
+  graph->Write(second, scene);
+  graph->Read(second, scene);
+  graph->Write(second, back_buffer);
+  CHECK(!graph->Compile());
+  CHECK(graph->order().empty());
+
+  // A transient target read but never written
+  graph->Reset();
+  back_buffer = graph->ImportTarget("back buffer", nullptr);
+  scene = graph->CreateTarget("scene", kColour);
+  FramePass present = graph->AddPass("present", [] {});
+  graph->Read(present, scene);
+  graph->Write(present, back_buffer);
+  CHECK(!graph->Compile());
+
+  // which is fine for imported ones, as they keep their contents
+  graph->Reset();
+  back_buffer = graph->ImportTarget("back buffer", nullptr);
+  FrameResource cached = graph->ImportTarget("cached shadow", nullptr);
+  present = graph->AddPass("present", [] {});
+  graph->Read(present, cached);
+  graph->Write(present, back_buffer);
+  CHECK(graph->Compile());
+
+  // Passes which wait for each other
+  graph->Reset();
+  back_buffer = graph->ImportTarget("back buffer", nullptr);
+  FrameResource x = graph->CreateTarget("x", kColour);
+  FrameResource y = graph->CreateTarget("y", kColour);
+  first = graph->AddPass("first", [] {});
+  second = graph->AddPass("second", [] {});
+  graph->Read(first, y);
+  graph->Write(first, x);
+  graph->Read(second, x);
+  graph->Write(second, y);
+  graph->Write(second, back_buffer);
+  CHECK(!graph->Compile());
+  CHECK(graph->order().empty());
+
+  // No targets were created for the invalid graphs
+  CHECK(targets.created == 0);
+
+  delete graph;
+}
+
+void TestAliasing() {
+  Targets targets;
+  FrameGraph *graph = NewGraph(targets);
+
+  // A chain of passes, each reading what the one before wrote
+  FrameResource back_buffer = graph->ImportTarget("back buffer", nullptr);
+  FrameResource t[3] = {
+    graph->CreateTarget("t0", kColour),
+    graph->CreateTarget("t1", kColour),
+    graph->CreateTarget("t2", kColour)
+  };
+  FrameResource depth = graph->CreateTarget("depth", kDepth);
+  FramePass passes[4];
+  for (int i = 0; i < 4; ++i) {
+    passes[i] = graph->AddPass("pass", [] {});
+  }
+  graph->Write(passes[0], t[0]);
+  graph->Write(passes[0], depth);
+  graph->Read(passes[1], t[0]);
+  graph->Write(passes[1], t[1]);
+  graph->Read(passes[2], t[1]);
+  graph->Write(passes[2], t[2]);
+  graph->Read(passes[3], t[2]);
+  graph->Read(passes[3], depth);
+  graph->Write(passes[3], back_buffer);
+  CHECK(graph->Compile());
+
+  // t0 is free once t2 is written; t1 overlaps both. Targets of other
+  // formats are never shared.
+  CHECK(graph->target(t[0]) == graph->target(t[2]));
+  CHECK(graph->target(t[1]) != graph->target(t[0]));
+  CHECK(graph->target(depth) != graph->target(t[0]) &&
+    graph->target(depth) != graph->target(t[1]));
+  CHECK(graph->transient_count() == 4);
+  CHECK(graph->physical_count() == 3);
+  CHECK(graph->transient_bytes() == 4 * 64 * 64 * 4);
+  CHECK(graph->physical_bytes() == 3 * 64 * 64 * 4);
+  CHECK(targets.created == 3);
+  CHECK(graph->pooled_bytes() == graph->physical_bytes());
+
+  delete graph;
+  CHECK(targets.destroyed == 3);
+}
+
+// Declare a frame which uses a target of the given size
+void DeclareFrame(FrameGraph &graph, int size) {
+  graph.Reset();
+  FrameResource back_buffer = graph.ImportTarget("back buffer", nullptr);
+  FrameResource scene = graph.CreateTarget("scene",
+    RenderTextureDesc(size, size, DXGI_FORMAT_R8G8B8A8_UNORM,
+    DXGI_FORMAT_D32_FLOAT, false));
+  FramePass main = graph.AddPass("main", [] {});
+  graph.Write(main, scene);
+  FramePass present = graph.AddPass("present", [] {});
+  graph.Read(present, scene);
+  graph.Write(present, back_buffer);
+}
+
+void TestPool() {
+  Targets targets;
+  FrameGraph *graph = NewGraph(targets);
+
+  // Frames which need the same target reuse it
+  for (int frame = 0; frame < 10; ++frame) {
+    DeclareFrame(*graph, 64);
+    CHECK(graph->Compile());
+  }
+  CHECK(targets.created == 1);
+  RenderTexture *first = graph->target(1);
+
+  // Once the size changes, the old target is kept for a while, in case it
+  // is needed again, then released
+  DeclareFrame(*graph, 128);
+  CHECK(graph->Compile());
+  CHECK(targets.created == 2);
+  CHECK(graph->target(1) != first);
+  for (int frame = 1; frame < 59; ++frame) {
+    DeclareFrame(*graph, 128);
+    CHECK(graph->Compile());
+  }
+  CHECK(targets.destroyed == 0);
+  DeclareFrame(*graph, 64);
+  CHECK(graph->Compile());
+  CHECK(graph->target(1) == first);
+  CHECK(targets.created == 2);
+
+  for (int frame = 0; frame < 60; ++frame) {
+    DeclareFrame(*graph, 64);
+    CHECK(graph->Compile());
+  }
+  CHECK(targets.destroyed == 1);
+  CHECK(graph->pooled_bytes() == 64 * 64 * 8);
+
+  delete graph;
+  CHECK(targets.destroyed == 2);
+}
+
+} // namespace
+
+int main() {
+  TestCullAndSort();
+  TestInvalid();
+  TestAliasing();
+  TestPool();
+
+  return sz::test::Finish("frame_graph");
+}
@@ -0,0 +1,200 @@
+// Binning of lights into clusters: every point a light reaches finds it in
+// the list of its cluster, whether or not the slices were binned on workers
+#include "light_clusters.h"
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "test.h"
+#include "worker_pool.h"
+
+using namespace sz;
+
+namespace {
+
+const UInt32 kWidth = 1280;
+const UInt32 kHeight = 720;
+const float kNear = 0.1f;
+const float kFar = 500.f;
+// Scales of a 16:9 projection with a vertical field of view of 0.8
+const float kScaleY = 1.f / tanf(0.4f);
+const float kScaleX = kScaleY * kHeight / kWidth;
+
+float Random(float low, float high) {
+  return low + (high - low) * (rand() / static_cast<float>(RAND_MAX));
+}
+
+void SetUp(LightClusters &clusters) {
+  clusters.SetProjection(kScaleX, kScaleY, kNear, kFar);
+}
+
+// Cluster of a view space point, as the shaders find it; false if the
+// point is off the screen
+bool ClusterOf(const LightClusters &clusters, float x, float y, float z,
+  UInt32 &cluster) {
+  float ndc_x = x * kScaleX / z;
+  float ndc_y = y * kScaleY / z;
+  if (z < kNear || z > kFar || fabsf(ndc_x) >= 1.f || fabsf(ndc_y) >= 1.f) {
+    return false;
+  }
+  UInt32 tile_x = static_cast<UInt32>((ndc_x + 1.f) * 0.5f * kWidth) /
+    kClusterTileSize;
+  UInt32 tile_y = static_cast<UInt32>((1.f - ndc_y) * 0.5f * kHeight) /
+    kClusterTileSize;
+  cluster = clusters.cluster_index(tile_x, tile_y, clusters.slice_of(z));
+  return true;
+}
+
+bool Listed(const LightClusters &clusters, UInt32 cluster, UInt32 light) {
+  UInt32 offset = clusters.grid()[cluster * 2];
+  UInt32 count = clusters.grid()[cluster * 2 + 1];
+  for (UInt32 i = 0; i < count; ++i) {
+    if (clusters.indices()[offset + i] == light) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Lights spread over the view, most of them small
+std::vector<ClusterSphere> RandomLights(UInt32 count) {
+  std::vector<ClusterSphere> spheres(count);
+  for (ClusterSphere &sphere : spheres) {
+    sphere.z = Random(-5.f, 200.f);
+    sphere.x = Random(-1.2f, 1.2f) * fabsf(sphere.z) / kScaleX;
+    sphere.y = Random(-1.2f, 1.2f) * fabsf(sphere.z) / kScaleY;
+    sphere.radius = Random(0.f, 1.f) < 0.9f ? Random(0.2f, 5.f) :
+      Random(5.f, 40.f);
+  }
+
+  return spheres;
+}
+
+void TestSlices() {
+  LightClusters clusters(kWidth, kHeight, 1024);
+  SetUp(clusters);
+  CHECK(clusters.tiles_x() == 20 && clusters.tiles_y() == 12);
+  CHECK(clusters.cluster_count() == 20 * 12 * kClusterSlices);
+
+  // Everything nearer than kClusterNearDepth is in the first slice, the
+  // far plane in the last one
+  CHECK(clusters.slice_of(kNear) == 0);
+  CHECK(clusters.slice_of(kClusterNearDepth * 0.99f) == 0);
+  CHECK(clusters.slice_of(kClusterNearDepth * 1.01f) == 1);
+  CHECK(clusters.slice_of(kFar) == kClusterSlices - 1);
+  CHECK(clusters.slice_of(kFar * 10.f) == kClusterSlices - 1);
+  UInt32 last = 0;
+  for (float z = kNear; z < kFar; z *= 1.01f) {
+    UInt32 slice = clusters.slice_of(z);
+    CHECK(slice == last || slice == last + 1);
+    last = slice;
+  }
+}
+
+void TestNoLightMissed() {
+  srand(11);
+  std::vector<ClusterSphere> spheres = RandomLights(300);
+  LightClusters clusters(kWidth, kHeight, 1 << 20);
+  SetUp(clusters);
+  clusters.Build(spheres.data(), static_cast<UInt32>(spheres.size()),
+    nullptr);
+  CHECK(clusters.overflow_count() == 0);
+
+  // Points within each light's sphere, on the screen
+  UInt32 missed = 0, points = 0;
+  for (UInt32 l = 0; l < spheres.size(); ++l) {
+    const ClusterSphere &s = spheres[l];
+    for (int i = 0; i < 200; ++i) {
+      float dx = Random(-1.f, 1.f), dy = Random(-1.f, 1.f);
+      float dz = Random(-1.f, 1.f);
+      if (dx * dx + dy * dy + dz * dz > 1.f) {
+        continue;
+      }
+      UInt32 cluster;
+      if (!ClusterOf(clusters, s.x + dx * s.radius, s.y + dy * s.radius,
+        s.z + dz * s.radius, cluster)) {
+        continue;
+      }
+      ++points;
+      missed += !Listed(clusters, cluster, l);
+    }
+  }
+  CHECK(points > 10000);
+  CHECK(missed == 0);
+
+  // Lists are in the order of the lights
+  for (UInt32 c = 0; c < clusters.cluster_count(); ++c) {
+    UInt32 offset = clusters.grid()[c * 2];
+    UInt32 count = clusters.grid()[c * 2 + 1];
+    for (UInt32 i = 1; i < count; ++i) {
+      CHECK(clusters.indices()[offset + i - 1] <
+        clusters.indices()[offset + i]);
+    }
+  }
+
+  // A small light only reaches the clusters around it
+  ClusterSphere small = { 0.f, 0.f, 50.f, 1.f };
+  clusters.Build(&small, 1, nullptr);
+  UInt32 reached = 0;
+  for (UInt32 c = 0; c < clusters.cluster_count(); ++c) {
+    reached += clusters.grid()[c * 2 + 1];
+  }
+  CHECK(reached > 0 && reached <= 8);
+  CHECK(clusters.index_count() == reached);
+}
+
+void TestWorkers() {
+  srand(12);
+  std::vector<ClusterSphere> spheres = RandomLights(500);
+  LightClusters alone(kWidth, kHeight, 1 << 20);
+  LightClusters shared(kWidth, kHeight, 1 << 20);
+  SetUp(alone);
+  SetUp(shared);
+  WorkerPool workers(3);
+  alone.Build(spheres.data(), static_cast<UInt32>(spheres.size()), nullptr);
+  shared.Build(spheres.data(), static_cast<UInt32>(spheres.size()),
+    &workers);
+
+  CHECK(alone.grid() == shared.grid());
+  CHECK(alone.index_count() == shared.index_count());
+  CHECK(std::equal(alone.indices().begin(),
+    alone.indices().begin() + alone.index_count(),
+    shared.indices().begin()));
+  CHECK(alone.max_cluster_count() == shared.max_cluster_count());
+}
+
+void TestDirectionalAndOverflow() {
+  LightClusters clusters(kWidth, kHeight, 8000);
+  SetUp(clusters);
+
+  // Lights with a negative radius reach every cluster
+  ClusterSphere spheres[2] = {
+    { 0.f, 0.f, 0.f, -1.f }, { 0.f, 0.f, 20.f, 2.f }
+  };
+  clusters.Build(spheres, 2, nullptr);
+  for (UInt32 c = 0; c < clusters.cluster_count(); ++c) {
+    CHECK(Listed(clusters, c, 0));
+  }
+  CHECK(clusters.max_cluster_count() == 2);
+  CHECK(clusters.overflow_count() == 0);
+
+  // Clusters which do not fit lose the lights at the end of their list
+  spheres[1].radius = -1.f;
+  clusters.Build(spheres, 2, nullptr);
+  CHECK(clusters.index_count() == 8000);
+  CHECK(clusters.overflow_count() == 2 * clusters.cluster_count() - 8000);
+  UInt32 last = clusters.cluster_count() - 1;
+  CHECK(clusters.grid()[last * 2 + 1] == 0);
+  CHECK(clusters.grid()[1] == 2);
+}
+
+} // namespace
+
+int main() {
+  TestSlices();
+  TestNoLightMissed();
+  TestWorkers();
+  TestDirectionalAndOverflow();
+
+  return sz::test::Finish("light_clusters");
+}
@@ -0,0 +1,201 @@
+// Per-draw light selection: ranking against a plain computation of the
+// scores, ties, range and spot cones
+#include "light_selector.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+ClusterLightType PointLight(float x, float y, float z, float range) {
+  // Every member is set, as XMFLOAT4 and friends do not zero themselves
+  ClusterLightType light;
+  light.diffuse = XMFLOAT4(1.f, 1.f, 1.f, 1.f);
+  light.ambient = XMFLOAT4(0.f, 0.f, 0.f, 0.f);
+  light.specular = XMFLOAT4(0.f, 0.f, 0.f, 0.f);
+  light.position = XMFLOAT3(x, y, z);
+  light.range = range;
+  light.direction = XMFLOAT3(0.f, 0.f, 1.f);
+  light.spot_cos_cutoff = 0.f;
+  light.attenuation = XMFLOAT3(1.f, 0.f, 0.01f);
+  light.spot_exponent = 0.f;
+  light.kind = kClusterLightPoint;
+  light.shadow_slot = 0;
+  light.padding = XMFLOAT2(0.f, 0.f);
+  return light;
+}
+
+ClusterLightType SpotLight(float dir_x, float dir_y, float cos_cutoff) {
+  ClusterLightType light = PointLight(0.f, 0.f, 0.f, 100.f);
+  light.direction = XMFLOAT3(dir_x, dir_y, 0.f);
+  light.spot_cos_cutoff = cos_cutoff;
+  light.kind = kClusterLightSpot;
+  return light;
+}
+
+// Score of a point light for a box, worked out one light at a time
+float Score(const ClusterLightType &light, const XMFLOAT3 &centre,
+  const XMFLOAT3 &extents) {
+  float dx = std::max(fabsf(centre.x - light.position.x) - extents.x, 0.f);
+  float dy = std::max(fabsf(centre.y - light.position.y) - extents.y, 0.f);
+  float dz = std::max(fabsf(centre.z - light.position.z) - extents.z, 0.f);
+  float dist = sqrtf(dx * dx + dy * dy + dz * dz);
+  if (dist > light.range) {
+    return 0.f;
+  }
+  float intensity = std::max(std::max(light.diffuse.x, light.diffuse.y),
+    light.diffuse.z);
+  return intensity / (light.attenuation.x + light.attenuation.y * dist +
+    light.attenuation.z * dist * dist);
+}
+
+// Whether a light is one of those a selection picked
+bool Picked(const UInt32 *indices, UInt32 count, UInt32 light) {
+  return std::find(indices, indices + count, light) != indices + count;
+}
+
+void TestRanking() {
+  // Lights of random colours, places and ranges, some of which is not a
+  // multiple of 4
+  std::vector<ClusterLightType> lights;
+  UInt32 seed = 7;
+  auto random = [&seed](float scale) {
+    seed = seed * 1664525u + 1013904223u;
+    return static_cast<float>(seed >> 8) / 16777216.f * scale;
+  };
+  for (UInt32 i = 0; i < 203; ++i) {
+    ClusterLightType light = PointLight(random(200.f) - 100.f,
+      random(40.f), random(200.f) - 100.f, 10.f + random(50.f));
+    light.diffuse = XMFLOAT4(random(1.f), random(1.f), random(1.f), 1.f);
+    lights.push_back(light);
+  }
+  LightSelector selector;
+  selector.SetLights(lights.data(), static_cast<UInt32>(lights.size()));
+  CHECK(selector.light_count() == 203);
+
+  for (UInt32 box = 0; box < 50; ++box) {
+    XMFLOAT3 centre(random(200.f) - 100.f, random(40.f),
+      random(200.f) - 100.f);
+    XMFLOAT3 extents(random(10.f), random(10.f), random(10.f));
+    UInt32 indices[kMaxDrawLights];
+    UInt32 reached = 0;
+    UInt32 count = selector.Select(centre, extents, indices, &reached);
+
+    // The strongest lights, by the plain scores
+    std::vector<std::pair<float, UInt32>> scores;
+    for (UInt32 i = 0; i < lights.size(); ++i) {
+      float score = Score(lights[i], centre, extents);
+      if (score > 0.f) {
+        scores.push_back(std::make_pair(-score, i));
+      }
+    }
+    std::sort(scores.begin(), scores.end());
+    CHECK(reached == scores.size());
+    CHECK(count == std::min<UInt32>(reached, kMaxDrawLights));
+    for (UInt32 i = 0; i < count && i < scores.size(); ++i) {
+      CHECK(Picked(indices, count, scores[i].second));
+    }
+    for (UInt32 i = 1; i < count; ++i) {
+      CHECK(indices[i - 1] < indices[i]);
+    }
+  }
+}
+
+void TestTies() {
+  // As strong as each other: the first lights win
+  std::vector<ClusterLightType> lights(12, PointLight(0.f, 5.f, 0.f, 50.f));
+  // and a stronger one at the end
+  lights.push_back(PointLight(0.f, 1.f, 0.f, 50.f));
+  LightSelector selector;
+  selector.SetLights(lights.data(), static_cast<UInt32>(lights.size()));
+
+  UInt32 indices[kMaxDrawLights];
+  UInt32 reached = 0;
+  UInt32 count = selector.Select(XMFLOAT3(0.f, 0.f, 0.f),
+    XMFLOAT3(1.f, 1.f, 1.f), indices, &reached);
+  CHECK(reached == 13);
+  CHECK(count == kMaxDrawLights);
+  for (UInt32 i = 0; i + 1 < kMaxDrawLights; ++i) {
+    CHECK(indices[i] == i);
+  }
+  CHECK(indices[kMaxDrawLights - 1] == 12);
+}
+
+void TestRangeAndDirectional() {
+  std::vector<ClusterLightType> lights;
+  lights.push_back(PointLight(20.f, 0.f, 0.f, 18.5f));
+  lights.push_back(PointLight(20.f, 0.f, 0.f, 19.5f));
+  ClusterLightType directional = PointLight(1000.f, 0.f, 0.f, 0.f);
+  directional.kind = kClusterLightDirectional;
+  lights.push_back(directional);
+  // No intensity
+  ClusterLightType dark = PointLight(0.f, 0.f, 0.f, 50.f);
+  dark.diffuse = XMFLOAT4(0.f, 0.f, 0.f, 1.f);
+  lights.push_back(dark);
+  LightSelector selector;
+  selector.SetLights(lights.data(), static_cast<UInt32>(lights.size()));
+
+  // The range is to the nearest point of the box, 19 away
+  UInt32 indices[kMaxDrawLights];
+  UInt32 reached = 0;
+  UInt32 count = selector.Select(XMFLOAT3(0.f, 0.f, 0.f),
+    XMFLOAT3(1.f, 1.f, 1.f), indices, &reached);
+  CHECK(count == 2 && reached == 2);
+  CHECK(indices[0] == 1 && indices[1] == 2);
+
+  // The reached count is optional
+  CHECK(selector.Select(XMFLOAT3(0.f, 0.f, 0.f), XMFLOAT3(1.f, 1.f, 1.f),
+    indices, nullptr) == 2);
+}
+
+void TestCones() {
+  // Cones of 30 degrees along x, and one wider than a half sphere
+  const float cos_30 = cosf(30.f * 3.14159265f / 180.f);
+  std::vector<ClusterLightType> lights;
+  lights.push_back(SpotLight(1.f, 0.f, cos_30));
+  lights.push_back(SpotLight(-1.f, 0.f, cos_30));
+  lights.push_back(SpotLight(-1.f, 0.f, -0.5f));
+  LightSelector selector;
+  selector.SetLights(lights.data(), static_cast<UInt32>(lights.size()));
+
+  UInt32 indices[kMaxDrawLights];
+  UInt32 reached = 0;
+
+  // Inside the first cone and behind the second; the wide one has no cone
+  // and reaches everywhere in its range
+  UInt32 count = selector.Select(XMFLOAT3(10.f, 3.f, 0.f),
+    XMFLOAT3(0.1f, 0.1f, 0.1f), indices, &reached);
+  CHECK(count == 2 && indices[0] == 0 && indices[1] == 2);
+
+  // The centre is 35 degrees off, but the box reaches into the cone
+  count = selector.Select(XMFLOAT3(10.f, 7.f, 0.f),
+    XMFLOAT3(1.f, 1.f, 1.f), indices, &reached);
+  CHECK(count == 2 && indices[0] == 0);
+  count = selector.Select(XMFLOAT3(10.f, 7.f, 0.f),
+    XMFLOAT3(0.01f, 0.01f, 0.01f), indices, &reached);
+  CHECK(count == 1 && reached == 1 && indices[0] == 2);
+
+  // Boxes around the light are lit by every cone
+  count = selector.Select(XMFLOAT3(0.5f, 0.f, 0.f),
+    XMFLOAT3(1.f, 1.f, 1.f), indices, &reached);
+  CHECK(count == 3);
+
+  // Only the second cone reaches behind the lights
+  count = selector.Select(XMFLOAT3(-10.f, 3.f, 0.f),
+    XMFLOAT3(0.1f, 0.1f, 0.1f), indices, &reached);
+  CHECK(count == 2 && indices[0] == 1 && indices[1] == 2);
+}
+
+} // namespace
+
+int main() {
+  TestRanking();
+  TestTies();
+  TestRangeAndDirectional();
+  TestCones();
+
+  return sz::test::Finish("light_selector");
+}
@@ -0,0 +1,63 @@
+// Frustum culling throughput of MeshBounds, against testing the boxes one
+// by one with BoxInFrustum
+#include "mesh_bounds.h"
+#include <cstdlib>
+#include <vector>
+#include "bench.h"
+
+using namespace sz;
+using namespace sz::bench;
+
+namespace {
+
+float Random(float low, float high) {
+  return low + (high - low) * (rand() / static_cast<float>(RAND_MAX));
+}
+
+} // namespace
+
+int main() {
+  // Boxes scattered over a scene much larger than the view, so that about
+  // a tenth of them are visible
+  const UInt32 count = 100000;
+  MeshBounds bounds;
+  std::vector<XMFLOAT3> centres, extents;
+  srand(7);
+  for (UInt32 i = 0; i < count; ++i) {
+    XMFLOAT3 centre(Random(-500.f, 500.f), Random(-50.f, 50.f),
+      Random(-500.f, 500.f));
+    XMFLOAT3 extent(Random(0.1f, 8.f), Random(0.1f, 8.f), Random(0.1f, 8.f));
+    bounds.Add(centre, extent);
+    centres.push_back(centre);
+    extents.push_back(extent);
+  }
+
+  XMMATRIX to_clip = XMMatrixMultiply(
+    XMMatrixLookToLH(XMVectorSet(0.f, 0.f, -100.f, 1.f),
+      XMVectorSet(0.f, 0.f, 1.f, 0.f), XMVectorSet(0.f, 1.f, 0.f, 0.f)),
+    XMMatrixPerspectiveFovLH(0.8f, 16.f / 9.f, 0.1f, 400.f));
+  std::vector<UInt8> visible(count);
+  const UInt32 reps = 100;
+
+  UInt64 seen = 0;
+  double time = Best(5, [&] {
+    for (UInt32 r = 0; r < reps; ++r) {
+      seen = bounds.Cull(to_clip, 0, count, visible.data());
+    }
+    Keep(seen);
+  });
+  Report("cull, 4 boxes at once", time, static_cast<double>(reps) * count,
+    "box");
+
+  time = Best(5, [&] {
+    UInt64 boxes_seen = 0;
+    for (UInt32 i = 0; i < count; ++i) {
+      boxes_seen += BoxInFrustum(to_clip, centres[i], extents[i]);
+    }
+    Keep(boxes_seen);
+  });
+  Report("BoxInFrustum, one at a time", time, count, "box");
+  printf("%-40s %10.1f %%\n", "visible", 100. * seen / count);
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+// Culling of MeshBounds four boxes at a time agrees with testing them one
+// by one
+#include "mesh_bounds.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+float Random(float low, float high) {
+  return low + (high - low) * (rand() / static_cast<float>(RAND_MAX));
+}
+
+void TestSingleBoxes() {
+  XMMATRIX to_clip = XMMatrixPerspectiveFovLH(1.f, 1.f, 1.f, 100.f);
+  XMFLOAT3 extents(1.f, 1.f, 1.f);
+  CHECK(BoxInFrustum(to_clip, XMFLOAT3(0.f, 0.f, 10.f), extents));
+  CHECK(!BoxInFrustum(to_clip, XMFLOAT3(0.f, 0.f, -10.f), extents));
+  CHECK(!BoxInFrustum(to_clip, XMFLOAT3(0.f, 0.f, 110.f), extents));
+  // Straddling the near plane
+  CHECK(BoxInFrustum(to_clip, XMFLOAT3(0.f, 0.f, 0.5f), extents));
+  CHECK(!BoxInFrustum(to_clip, XMFLOAT3(50.f, 0.f, 10.f), extents));
+  CHECK(SphereInFrustum(to_clip, XMFLOAT3(0.f, 0.f, 10.f), 1.f));
+  CHECK(!SphereInFrustum(to_clip, XMFLOAT3(0.f, 0.f, -10.f), 1.f));
+
+  // A box moved by a transform bounds the moved corners
+  XMFLOAT3 centre, moved;
+  TransformBox(XMFLOAT3(1.f, 0.f, 0.f), XMFLOAT3(1.f, 2.f, 3.f),
+    XMMatrixMultiply(XMMatrixRotationY(XM_PIDIV2),
+      XMMatrixTranslation(0.f, 5.f, 0.f)), centre, moved);
+  CHECK(fabsf(centre.y - 5.f) < 1e-5f && fabsf(centre.z + 1.f) < 1e-5f);
+  CHECK(fabsf(moved.x - 3.f) < 1e-5f && fabsf(moved.z - 1.f) < 1e-5f);
+}
+
+void TestCullMatchesBoxes() {
+  // Not a multiple of 4, so that the last group is padded
+  const UInt32 count = 1003;
+  MeshBounds bounds;
+  std::vector<XMFLOAT3> centres, extents;
+  srand(3);
+  for (UInt32 i = 0; i < count; ++i) {
+    XMFLOAT3 centre(Random(-60.f, 60.f), Random(-10.f, 10.f),
+      Random(-60.f, 60.f));
+    XMFLOAT3 extent(Random(0.1f, 4.f), Random(0.1f, 4.f), Random(0.1f, 4.f));
+    CHECK(bounds.Add(centre, extent) == i);
+    centres.push_back(centre);
+    extents.push_back(extent);
+  }
+  CHECK(bounds.size() == count);
+
+  std::vector<UInt8> visible(count);
+  for (UInt32 v = 0; v < 8; ++v) {
+    XMMATRIX to_clip = XMMatrixMultiply(
+      XMMatrixMultiply(XMMatrixTranslation(0.f, 0.f, v * 5.f),
+        XMMatrixRotationY(v * 0.8f)),
+      XMMatrixPerspectiveFovLH(0.8f, 16.f / 9.f, 0.1f, 50.f));
+
+    // Ranges which start and end inside groups leave the rest alone
+    UInt32 begin = v * 3, end = count - v * 5;
+    memset(visible.data(), 2, count);
+    UInt32 seen = bounds.Cull(to_clip, begin, end, visible.data());
+    UInt32 expected = 0;
+    for (UInt32 i = 0; i < count; ++i) {
+      if (i < begin || i >= end) {
+        CHECK(visible[i] == 2);
+        continue;
+      }
+      bool in = BoxInFrustum(to_clip, centres[i], extents[i]);
+      expected += in;
+      CHECK(visible[i] == (in ? 1 : 0));
+    }
+    CHECK(seen == expected);
+    CHECK(seen > 0 && seen < end - begin);
+  }
+}
+
+} // namespace
+
+int main() {
+  TestSingleBoxes();
+  TestCullMatchesBoxes();
+
+  return sz::test::Finish("mesh_bounds");
+}
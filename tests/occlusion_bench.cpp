@@ -0,0 +1,107 @@
+// Accuracy and cost of the occlusion culler: how many of the boxes which
+// ray casts find hidden it culls, how fast it rasterises occluders, alone
+// and on workers, and how fast it tests boxes against the hierarchy
+#include "occlusion_culler.h"
+#include <thread>
+#include "bench.h"
+#include "occlusion_scene.h"
+#include "worker_pool.h"
+
+using namespace sz;
+using namespace sz::bench;
+using namespace sz::test;
+
+namespace {
+
+// Occluder of a mesh of walls
+void AddWallsTo(OcclusionCuller &culler, const OccluderMesh &walls) {
+  culler.AddOccluder(walls.positions.data(),
+    static_cast<UInt32>(walls.positions.size()), walls.indices.data(),
+    static_cast<UInt32>(walls.indices.size()));
+}
+
+} // namespace
+
+int main() {
+  srand(7);
+  const XMMATRIX to_clip = XMMatrixPerspectiveFovLH(0.9f, 2.f, 0.1f, 500.f);
+  const XMFLOAT3 eye(0.f, 0.f, 0.f);
+
+  OccluderMesh walls;
+  AddWalls(walls, 60);
+  OcclusionCuller culler(256, 128);
+  AddWallsTo(culler, walls);
+  culler.Render(to_clip, nullptr);
+
+  UInt32 in_view_count = 0, hidden = 0, culled = 0, wrong = 0;
+  for (UInt32 i = 0; i < 4000; ++i) {
+    XMFLOAT3 centre(Random(-70.f, 70.f), Random(-8.f, 10.f),
+      Random(5.f, 160.f));
+    XMFLOAT3 extents(Random(0.2f, 3.f), Random(0.2f, 3.f),
+      Random(0.2f, 3.f));
+    bool in_view;
+    bool visible = walls.IsVisible(to_clip, eye, centre, extents, in_view);
+    if (!in_view) {
+      continue;
+    }
+    bool occluded = culler.IsOccluded(to_clip, centre, extents);
+    ++in_view_count;
+    hidden += !visible;
+    culled += occluded;
+    wrong += occluded && visible;
+  }
+  printf("%-40s %u in view, %u hidden, %u culled (%.1f %% of hidden), "
+    "%u wrongly\n", "accuracy, 256x128", in_view_count, hidden, culled,
+    100. * culled / hidden, wrong);
+
+  // Rasterising a lot of occluders
+  OccluderMesh many;
+  AddWalls(many, 2000);
+  OcclusionCuller big(256, 128);
+  AddWallsTo(big, many);
+  unsigned cores = std::thread::hardware_concurrency();
+  WorkerPool workers(cores > 1 ? cores - 1 : 1);
+  const UInt32 frames = 50;
+
+  double time = Best(5, [&] {
+    for (UInt32 f = 0; f < frames; ++f) {
+      big.Render(to_clip, nullptr);
+    }
+    Keep(static_cast<UInt64>(big.depth(0, 128, 64) * 1e6f));
+  });
+  Report("render, one thread", time,
+    static_cast<double>(frames) * big.triangle_count(), "tri");
+
+  time = Best(5, [&] {
+    for (UInt32 f = 0; f < frames; ++f) {
+      big.Render(to_clip, &workers);
+    }
+    Keep(static_cast<UInt64>(big.depth(0, 128, 64) * 1e6f));
+  });
+  char name[64];
+  snprintf(name, sizeof(name), "render, %u workers", workers.thread_count());
+  Report(name, time, static_cast<double>(frames) * big.triangle_count(),
+    "tri");
+
+  // Testing boxes
+  const UInt32 count = 100000;
+  std::vector<XMFLOAT3> centres, extents;
+  for (UInt32 i = 0; i < count; ++i) {
+    centres.push_back(XMFLOAT3(Random(-70.f, 70.f), Random(-8.f, 10.f),
+      Random(5.f, 160.f)));
+    extents.push_back(XMFLOAT3(Random(0.2f, 3.f), Random(0.2f, 3.f),
+      Random(0.2f, 3.f)));
+  }
+  UInt64 occluded = 0;
+  time = Best(5, [&] {
+    occluded = 0;
+    for (UInt32 i = 0; i < count; ++i) {
+      occluded += big.IsOccluded(to_clip, centres[i], extents[i]);
+    }
+    Keep(occluded);
+  });
+  Report("box tests", time, count, "box");
+  printf("%-40s %10.1f %%\n", "occluded", 100. * occluded / count);
+
+  return 0;
+}
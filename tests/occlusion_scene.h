@@ -0,0 +1,146 @@
+// Occluders made of boxes, and ray casts against their triangles to tell
+// which boxes are really hidden, for the occlusion culler's test and bench
+
+#ifndef _OCCLUSION_SCENE_H
+#define _OCCLUSION_SCENE_H
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <directxmath.h>
+#include "abertay_framework.h"
+
+namespace sz {
+namespace test {
+
+using namespace DirectX;
+
+inline float Random(float low, float high) {
+  return low + (high - low) * (rand() / static_cast<float>(RAND_MAX));
+}
+
+// Occluders, as one indexed triangle list
+struct OccluderMesh {
+  std::vector<XMFLOAT3> positions;
+  std::vector<UInt32> indices;
+
+  // Add the 12 triangles of a box, given by centre and half extents
+  void AddBox(const XMFLOAT3 &centre, const XMFLOAT3 &extents) {
+    UInt32 base = static_cast<UInt32>(positions.size());
+    for (int i = 0; i < 8; ++i) {
+      positions.push_back(XMFLOAT3(
+        centre.x + ((i & 1) ? extents.x : -extents.x),
+        centre.y + ((i & 2) ? extents.y : -extents.y),
+        centre.z + ((i & 4) ? extents.z : -extents.z)));
+    }
+    const UInt32 faces[6][4] = {
+      { 0, 1, 3, 2 }, { 4, 5, 7, 6 }, { 0, 1, 5, 4 },
+      { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 3, 7, 5 }
+    };
+    for (const UInt32 *face : faces) {
+      const UInt32 corners[6] = {
+        face[0], face[1], face[2], face[0], face[2], face[3]
+      };
+      for (UInt32 corner : corners) {
+        indices.push_back(base + corner);
+      }
+    }
+  }
+
+  // Whether the segment from origin to origin + direction, ends excluded,
+  // crosses a triangle
+  bool Blocks(const XMFLOAT3 &origin, const XMFLOAT3 &direction) const {
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      if (SegmentHits(origin, direction, positions[indices[i]],
+        positions[indices[i + 1]], positions[indices[i + 2]])) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // Whether any point of a box in the view of to_clip can be seen from the
+  // eye; points are sampled on a grid of each face. Boxes with no point in
+  // view are reported as not in view.
+  bool IsVisible(const XMMATRIX &to_clip, const XMFLOAT3 &eye,
+    const XMFLOAT3 &centre, const XMFLOAT3 &extents, bool &in_view) const {
+    in_view = false;
+    for (int face = 0; face < 6; ++face) {
+      for (int sample = 0; sample < 64; ++sample) {
+        float point[3];
+        int axis = face / 2;
+        point[axis] = (face & 1) ? 1.f : -1.f;
+        point[(axis + 1) % 3] = ((sample % 8) + 0.5f) / 4.f - 1.f;
+        point[(axis + 2) % 3] = ((sample / 8) + 0.5f) / 4.f - 1.f;
+        XMFLOAT3 p(centre.x + point[0] * extents.x,
+          centre.y + point[1] * extents.y, centre.z + point[2] * extents.z);
+
+        XMFLOAT4 clip;
+        XMStoreFloat4(&clip,
+          XMVector4Transform(XMVectorSet(p.x, p.y, p.z, 1.f), to_clip));
+        if (clip.w <= 0.f || fabsf(clip.x) > clip.w ||
+          fabsf(clip.y) > clip.w || clip.z < 0.f || clip.z > clip.w) {
+          continue;
+        }
+        in_view = true;
+
+        if (!Blocks(eye, XMFLOAT3(p.x - eye.x, p.y - eye.y, p.z - eye.z))) {
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+private:
+  // Moller-Trumbore, in doubles, with triangles slightly grown so that
+  // rays through shared edges are not let through
+  static bool SegmentHits(const XMFLOAT3 &o, const XMFLOAT3 &d,
+    const XMFLOAT3 &a, const XMFLOAT3 &b, const XMFLOAT3 &c) {
+    const double tolerance = 1e-6;
+    double e1[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+    double e2[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+    double p[3] = {
+      d.y * e2[2] - d.z * e2[1], d.z * e2[0] - d.x * e2[2],
+      d.x * e2[1] - d.y * e2[0]
+    };
+    double det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+    if (fabs(det) < 1e-12) {
+      return false;
+    }
+
+    double inv_det = 1. / det;
+    double t[3] = { o.x - a.x, o.y - a.y, o.z - a.z };
+    double u = (t[0] * p[0] + t[1] * p[1] + t[2] * p[2]) * inv_det;
+    if (u < -tolerance || u > 1. + tolerance) {
+      return false;
+    }
+    double q[3] = {
+      t[1] * e1[2] - t[2] * e1[1], t[2] * e1[0] - t[0] * e1[2],
+      t[0] * e1[1] - t[1] * e1[0]
+    };
+    double v = (d.x * q[0] + d.y * q[1] + d.z * q[2]) * inv_det;
+    if (v < -tolerance || u + v > 1. + tolerance) {
+      return false;
+    }
+    double s = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+
+    return s > 1e-6 && s < 0.999;
+  }
+};
+
+// Walls and pillars in front of the eye, as in an indoor scene
+inline void AddWalls(OccluderMesh &mesh, UInt32 count) {
+  for (UInt32 i = 0; i < count; ++i) {
+    mesh.AddBox(
+      XMFLOAT3(Random(-60.f, 60.f), Random(-2.f, 6.f), Random(10.f, 120.f)),
+      XMFLOAT3(Random(0.5f, 8.f), Random(1.f, 10.f), Random(0.3f, 3.f)));
+  }
+}
+
+} // namespace test
+} // namespace sz
+
+#endif
@@ -0,0 +1,107 @@
+// The occlusion culler culls boxes which are hidden, checked with ray casts
+// against the occluders
+#include "occlusion_culler.h"
+#include "occlusion_scene.h"
+#include "test.h"
+#include "worker_pool.h"
+
+using namespace sz;
+using namespace sz::test;
+
+namespace {
+
+XMMATRIX ToClip() {
+  return XMMatrixPerspectiveFovLH(0.9f, 2.f, 0.1f, 500.f);
+}
+
+void TestWall() {
+  OccluderMesh wall;
+  wall.AddBox(XMFLOAT3(0.f, 0.f, 20.f), XMFLOAT3(10.f, 10.f, 0.5f));
+  OcclusionCuller culler(256, 128);
+  culler.AddOccluder(wall.positions.data(),
+    static_cast<UInt32>(wall.positions.size()), wall.indices.data(),
+    static_cast<UInt32>(wall.indices.size()));
+  CHECK(culler.triangle_count() == 12);
+  culler.Render(ToClip(), nullptr);
+
+  // The front of the wall is at w = 19.5; the levels above keep the
+  // farthest depth, which is empty at the edges of the screen
+  float depth = culler.depth(0, 128, 64);
+  CHECK(fabsf(depth - 1.f / 19.5f) < 1e-4f);
+  CHECK(culler.depth(0, 0, 0) == 0.f);
+  UInt32 top = culler.level_count() - 1;
+  CHECK(culler.depth(top, 0, 0) == 0.f);
+
+  XMFLOAT3 small(1.f, 1.f, 1.f);
+  CHECK(culler.IsOccluded(ToClip(), XMFLOAT3(0.f, 0.f, 40.f), small));
+  // In front of the wall, sticking out of it, or crossing the near plane
+  CHECK(!culler.IsOccluded(ToClip(), XMFLOAT3(0.f, 0.f, 10.f), small));
+  CHECK(!culler.IsOccluded(ToClip(), XMFLOAT3(25.f, 0.f, 40.f), small));
+  CHECK(!culler.IsOccluded(ToClip(), XMFLOAT3(0.f, 0.f, 0.f), small));
+  // Wholly off the screen is for frustum culling to decide
+  CHECK(!culler.IsOccluded(ToClip(), XMFLOAT3(0.f, 0.f, -40.f), small));
+
+  // Nothing is occluded once the occluders are gone
+  culler.ClearOccluders();
+  culler.Render(ToClip(), nullptr);
+  CHECK(!culler.IsOccluded(ToClip(), XMFLOAT3(0.f, 0.f, 40.f), small));
+}
+
+void TestConservative() {
+  srand(7);
+  OccluderMesh walls;
+  AddWalls(walls, 60);
+  OcclusionCuller culler(256, 128);
+  culler.AddOccluder(walls.positions.data(),
+    static_cast<UInt32>(walls.positions.size()), walls.indices.data(),
+    static_cast<UInt32>(walls.indices.size()));
+
+  // The same buffer whether or not the work is shared
+  WorkerPool workers(3);
+  culler.Render(ToClip(), nullptr);
+  std::vector<float> alone(culler.width() * culler.height());
+  for (UInt32 y = 0; y < culler.height(); ++y) {
+    for (UInt32 x = 0; x < culler.width(); ++x) {
+      alone[y * culler.width() + x] = culler.depth(0, x, y);
+    }
+  }
+  culler.Render(ToClip(), &workers);
+  UInt32 different = 0;
+  for (UInt32 y = 0; y < culler.height(); ++y) {
+    for (UInt32 x = 0; x < culler.width(); ++x) {
+      different += alone[y * culler.width() + x] != culler.depth(0, x, y);
+    }
+  }
+  CHECK(different == 0);
+
+  // Some hidden boxes are culled. Boxes which rays from the eye reach are
+  // not, but for a few seen only through gaps between occluders narrower
+  // than a pixel.
+  UInt32 wrong = 0, culled = 0;
+  const XMFLOAT3 eye(0.f, 0.f, 0.f);
+  for (UInt32 i = 0; i < 1000; ++i) {
+    XMFLOAT3 centre(Random(-70.f, 70.f), Random(-8.f, 10.f),
+      Random(5.f, 160.f));
+    XMFLOAT3 extents(Random(0.2f, 3.f), Random(0.2f, 3.f),
+      Random(0.2f, 3.f));
+    bool in_view;
+    bool visible = walls.IsVisible(ToClip(), eye, centre, extents, in_view);
+    if (!in_view) {
+      continue;
+    }
+    bool occluded = culler.IsOccluded(ToClip(), centre, extents);
+    culled += occluded;
+    wrong += occluded && visible;
+  }
+  CHECK(culled > 100);
+  CHECK(wrong * 100 <= culled);
+}
+
+} // namespace
+
+int main() {
+  TestWall();
+  TestConservative();
+
+  return sz::test::Finish("occlusion");
+}
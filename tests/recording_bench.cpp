@@ -0,0 +1,145 @@
+// Cost on the CPU of the command stream of a frame the size of Sponza's
+// main pass, through the state cache into recording backends: counted
+// only, kept, and recorded into command lists on threads then executed
+#include "state_cache.h"
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "command_list.h"
+#include "recording_backend.h"
+
+using namespace sz;
+using namespace sz::bench;
+
+namespace {
+
+const UInt32 kDraws = 400;
+const UInt32 kMaterials = 25;
+const UInt32 kShaders = 6;
+const UInt32 kLists = 4;
+
+template <typename T>
+T *Fake(size_t id) {
+  return reinterpret_cast<T *>(id * 16);
+}
+
+// Constant buffer of the size of a matrix buffer, which deferred maps ask
+// the size of
+struct ConstantBuffer : ID3D11Buffer {
+  void GetDesc(D3D11_BUFFER_DESC *desc) {
+    ZeroMemory(desc, sizeof(*desc));
+    desc->ByteWidth = 192;
+    desc->BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  }
+};
+
+// Draws begin to end of the frame, sorted by shader then material as the
+// draw list sorts them, as the shaders issue their commands
+void RecordDraws(UInt32 begin, UInt32 end, ConstantBuffer &matrices) {
+  StateCache *cache = StateCache::Inst();
+  ID3D11Buffer *buffer = &matrices;
+  for (UInt32 i = begin; i < end; ++i) {
+    UInt32 shader = i * kShaders / kDraws;
+    UInt32 material = i * kMaterials / kDraws;
+
+    cache->IASetInputLayout(Fake<ID3D11InputLayout>(1 + shader));
+    cache->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    cache->VSSetShader(Fake<ID3D11VertexShader>(10 + shader));
+    cache->PSSetShader(Fake<ID3D11PixelShader>(20 + shader));
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (cache->Map(&matrices, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) ==
+      S_OK) {
+      float *m = static_cast<float *>(mapped.pData);
+      for (UInt32 f = 0; f < 48; ++f) {
+        m[f] = static_cast<float>(i + f);
+      }
+      cache->Unmap(&matrices, 0);
+    }
+    cache->VSSetConstantBuffers(0, 1, &buffer);
+
+    ID3D11ShaderResourceView *views[3] = {
+      Fake<ID3D11ShaderResourceView>(100 + material * 3),
+      Fake<ID3D11ShaderResourceView>(101 + material * 3),
+      Fake<ID3D11ShaderResourceView>(102 + material * 3)
+    };
+    cache->PSSetShaderResources(0, 3, views);
+    ID3D11SamplerState *sampler = Fake<ID3D11SamplerState>(30);
+    cache->PSSetSamplers(0, 1, &sampler);
+    cache->DrawIndexed(3 * (100 + i % 900), i * 300, 0);
+  }
+}
+
+} // namespace
+
+int main() {
+  ConstantBuffer matrices[kLists];
+  RecordingBackend backend;
+  StateCache *cache = StateCache::Inst();
+  cache->set_backend(&backend);
+
+  const UInt32 frames = 200;
+  const double draws = static_cast<double>(frames) * kDraws;
+
+  backend.set_keep_commands(false);
+  double time = Best(5, [&] {
+    for (UInt32 f = 0; f < frames; ++f) {
+      backend.Reset();
+      cache->BeginFrame();
+      RecordDraws(0, kDraws, matrices[0]);
+    }
+    Keep(backend.count(kGfxDrawIndexed));
+  });
+  Report("frame, counted", time, draws, "draw");
+
+  backend.set_keep_commands(true);
+  time = Best(5, [&] {
+    for (UInt32 f = 0; f < frames; ++f) {
+      backend.Reset();
+      cache->BeginFrame();
+      RecordDraws(0, kDraws, matrices[0]);
+    }
+    Keep(backend.commands().size());
+  });
+  Report("frame, kept", time, draws, "draw");
+  printf("%-40s %10u commands, %u binds filtered\n", "per frame",
+    static_cast<UInt32>(backend.commands().size()),
+    cache->frame_stats().filtered);
+
+  // Parts of the frame recorded on threads, then executed in order
+  std::vector<CommandList *> lists;
+  for (UInt32 l = 0; l < kLists; ++l) {
+    lists.push_back(new CommandList(&backend));
+  }
+  backend.set_keep_commands(false);
+  time = Best(5, [&] {
+    for (UInt32 f = 0; f < frames; ++f) {
+      backend.Reset();
+      cache->BeginFrame();
+      std::vector<std::thread> threads;
+      for (UInt32 l = 0; l < kLists; ++l) {
+        threads.push_back(std::thread([&, l] {
+          lists[l]->Begin();
+          RecordDraws(l * kDraws / kLists, (l + 1) * kDraws / kLists,
+            matrices[l]);
+          lists[l]->End();
+        }));
+      }
+      for (std::thread &thread : threads) {
+        thread.join();
+      }
+      for (CommandList *list : lists) {
+        list->Execute();
+      }
+    }
+    Keep(backend.count(kGfxDrawIndexed));
+  });
+  Report("frame, 4 lists on threads + execute", time, draws, "draw");
+
+  for (CommandList *list : lists) {
+    delete list;
+  }
+  StateCache::ResetInst();
+
+  return 0;
+}
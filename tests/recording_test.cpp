@@ -0,0 +1,393 @@
+// The recording backend counts and keeps commands, and command lists
+// recorded on other threads replay them unchanged on the main backend
+#include "recording_backend.h"
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "command_list.h"
+#include "frame_graph.h"
+#include "state_cache.h"
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+template <typename T>
+T *Fake(size_t id) {
+  return reinterpret_cast<T *>(id * 16);
+}
+
+struct ConstantBuffer : ID3D11Buffer {
+  void GetDesc(D3D11_BUFFER_DESC *desc) {
+    ZeroMemory(desc, sizeof(*desc));
+    desc->ByteWidth = 64;
+    desc->BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  }
+};
+
+// Draws of a pass, with a constant buffer written for each
+void RecordPass(GfxBackend &backend, ConstantBuffer &buffer, UInt32 draws) {
+  ID3D11ShaderResourceView *views[2] = {
+    Fake<ID3D11ShaderResourceView>(1), Fake<ID3D11ShaderResourceView>(2)
+  };
+  backend.PSSetShader(Fake<ID3D11PixelShader>(3));
+  backend.PSSetShaderResources(4, 2, views);
+  for (UInt32 i = 0; i < draws; ++i) {
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    CHECK(backend.Map(&buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) ==
+      S_OK);
+    memset(mapped.pData, static_cast<int>(i), 64);
+    backend.Unmap(&buffer, 0);
+    backend.DrawIndexedInstanced(36, 2, 0, 0, i);
+  }
+}
+
+void TestCounts() {
+  RecordingBackend backend;
+  ConstantBuffer buffer;
+  RecordPass(backend, buffer, 10);
+  CHECK(backend.count(kGfxSetShader) == 1);
+  CHECK(backend.count(kGfxMap) == 10);
+  CHECK(backend.count(kGfxDrawIndexedInstanced) == 10);
+  CHECK(backend.primitive_vertex_count() == 720);
+  CHECK(backend.commands().size() == 32);
+
+  // Arrays are kept with their command
+  const GfxCommand &views = backend.commands()[1];
+  CHECK(views.type == kGfxSetShaderResources);
+  CHECK(views.a == 4 && views.b == 2);
+  CHECK(views.payload_size == 2 * sizeof(ID3D11ShaderResourceView *));
+
+  // Counting alone keeps nothing
+  backend.Reset();
+  backend.set_keep_commands(false);
+  RecordPass(backend, buffer, 10);
+  CHECK(backend.count(kGfxMap) == 10);
+  CHECK(backend.commands().empty());
+
+  // Immediate maps read back zeros, whatever was written before
+  D3D11_MAPPED_SUBRESOURCE mapped;
+  CHECK(backend.Map(&buffer, 0, D3D11_MAP_READ, 0, &mapped) == S_OK);
+  CHECK(static_cast<UInt8 *>(mapped.pData)[10] == 0);
+}
+
+void TestReplay() {
+  RecordingBackend backend;
+  GfxBackend *deferred = backend.CreateDeferred();
+  ConstantBuffer buffer;
+  RecordPass(*deferred, buffer, 5);
+  D3D11_MAPPED_SUBRESOURCE mapped;
+  CHECK(deferred->Map(&buffer, 0, D3D11_MAP_WRITE_DISCARD,
+    D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped) == S_OK);
+  deferred->Unmap(&buffer, 0);
+
+  // Deferred maps keep what was written, as the replay needs it
+  const RecordingBackend &recording =
+    *static_cast<RecordingBackend *>(deferred);
+  const GfxCommand &map = recording.commands()[2];
+  CHECK(map.type == kGfxMap);
+  CHECK(map.payload_size == 64 && map.payload[63] == 0);
+  CHECK(map.c == 0);
+  CHECK(deferred->Map(&buffer, 0, D3D11_MAP_READ, 0, &mapped) == E_FAIL);
+  std::vector<GfxCommand> recorded = recording.commands();
+  CHECK(recorded[recorded.size() - 2].type == kGfxMap &&
+    recorded[recorded.size() - 2].c == D3D11_MAP_FLAG_DO_NOT_WAIT);
+
+  backend.ExecuteDeferred(deferred);
+  CHECK(recording.commands().empty());
+  CHECK(backend.commands().size() == recorded.size());
+  for (size_t i = 0; i < recorded.size() &&
+    i < backend.commands().size(); ++i) {
+    const GfxCommand &a = recorded[i], &b = backend.commands()[i];
+    CHECK(a.type == b.type && a.stage == b.stage && a.object == b.object);
+    if (a.type != kGfxMap) {
+      CHECK(a.a == b.a && a.b == b.b);
+    }
+    else {
+      // Map flags go through to the backend the list is replayed on
+      CHECK(a.c == b.c);
+    }
+  }
+  CHECK(backend.primitive_vertex_count() == 360);
+
+  delete deferred;
+}
+
+void TestCommandLists() {
+  RecordingBackend backend;
+  StateCache::Inst()->set_backend(&backend);
+  StateCache::Inst()->BeginFrame();
+
+  // Recorded in any order on threads, executed in the order of the lists
+  CommandList first(&backend), second(&backend);
+  CHECK(first.valid() && second.valid());
+  std::thread record_second([&] {
+    second.Begin();
+    StateCache::Inst()->DrawIndexed(6, 0, 0);
+    StateCache::Inst()->PSSetShader(Fake<ID3D11PixelShader>(9));
+    second.End();
+  });
+  record_second.join();
+  std::thread record_first([&] {
+    first.Begin();
+    StateCache::Inst()->PSSetShader(Fake<ID3D11PixelShader>(8));
+    StateCache::Inst()->PSSetShader(Fake<ID3D11PixelShader>(8));
+    first.End();
+  });
+  record_first.join();
+
+  first.Execute();
+  second.Execute();
+  CHECK(backend.commands().size() == 3);
+  CHECK(backend.commands()[0].object == Fake<ID3D11PixelShader>(8));
+  CHECK(backend.commands()[1].type == kGfxDrawIndexed);
+  CHECK(backend.commands()[2].object == Fake<ID3D11PixelShader>(9));
+
+  // The main cache counts the binds of the lists
+  StateCache::Inst()->BeginFrame();
+  CHECK(StateCache::Inst()->frame_stats().issued == 2);
+  CHECK(StateCache::Inst()->frame_stats().filtered == 1);
+  StateCache::ResetInst();
+}
+
+// What the GPU sees of a stream of commands. Binds only matter through the
+// state they leave, so each draw is told by the state it sees, leaving out
+// the resources of stages without a shader; the other commands are told by
+// their own fields. Lists start from the default state, as deferred
+// contexts do.
+class StreamEffects {
+public:
+  void StartList() {
+    state_.clear();
+    shaders_.clear();
+  }
+
+  void Add(const std::vector<GfxCommand> &commands, size_t begin,
+    size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const GfxCommand &command = commands[i];
+      std::string fields = Fields(command);
+      if (command.type < kGfxMap) {
+        state_[std::make_tuple(command.type, command.stage, command.a)] =
+          fields;
+        if (command.type == kGfxSetShader) {
+          shaders_[command.stage] = command.object != nullptr;
+        }
+        continue;
+      }
+      if (command.type == kGfxDraw || command.type == kGfxDrawIndexed ||
+        command.type == kGfxDrawIndexedInstanced) {
+        for (const State::value_type &bound : state_) {
+          UInt32 type = std::get<0>(bound.first);
+          if ((type == kGfxSetConstantBuffers ||
+            type == kGfxSetShaderResources || type == kGfxSetSamplers) &&
+            !shaders_[std::get<1>(bound.first)]) {
+            continue;
+          }
+          fields += " " + bound.second;
+        }
+      }
+      effects_.push_back(fields);
+    }
+  }
+
+  inline const std::vector<std::string> &effects() const {
+    return effects_;
+  }
+
+private:
+  typedef std::map<std::tuple<UInt32, UInt32, UInt32>, std::string> State;
+
+  static std::string Fields(const GfxCommand &command) {
+    std::string fields = std::string(
+      GfxCommandName(command.type)) + "(" +
+      std::to_string(command.stage) + "," +
+      std::to_string(reinterpret_cast<size_t>(command.object)) + "," +
+      std::to_string(reinterpret_cast<size_t>(command.object2)) + "," +
+      std::to_string(command.a) + "," + std::to_string(command.b) + "," +
+      std::to_string(command.c);
+    for (UInt32 i = 0; i < command.payload_size &&
+      command.type != kGfxMap; ++i) {
+      fields += "," + std::to_string(command.payload[i]);
+    }
+    return fields + ")";
+  }
+
+  State state_;
+  // Whether a shader is bound at each stage
+  std::map<UInt32, bool> shaders_;
+  std::vector<std::string> effects_;
+};
+
+// Passes of a frame as the renderer issues them, each setting the state it
+// needs and writing a constant buffer per draw. Some state is the same in
+// several passes, so that binds one thread filters another does not.
+void ShadowPass(ConstantBuffer &buffer) {
+  StateCache *cache = StateCache::Inst();
+  cache->OMSetRenderTargets(0, nullptr, Fake<ID3D11DepthStencilView>(20));
+  D3D11_VIEWPORT viewport = { 0.f, 0.f, 512.f, 512.f, 0.f, 1.f };
+  cache->RSSetViewports(1, &viewport);
+  cache->IASetInputLayout(Fake<ID3D11InputLayout>(21));
+  cache->VSSetShader(Fake<ID3D11VertexShader>(22));
+  cache->PSSetShader(nullptr);
+  ID3D11Buffer *buffers[1] = { &buffer };
+  cache->VSSetConstantBuffers(0, 1, buffers);
+  for (UInt32 i = 0; i < 4; ++i) {
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    cache->Map(&buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+    memset(mapped.pData, static_cast<int>(i), 64);
+    cache->Unmap(&buffer, 0);
+    cache->DrawIndexed(36, 0, i * 24);
+  }
+}
+
+void MainPass(ConstantBuffer &buffer) {
+  StateCache *cache = StateCache::Inst();
+  ID3D11RenderTargetView *targets[1] = { Fake<ID3D11RenderTargetView>(30) };
+  cache->OMSetRenderTargets(1, targets, Fake<ID3D11DepthStencilView>(31));
+  D3D11_VIEWPORT viewport = { 0.f, 0.f, 1280.f, 720.f, 0.f, 1.f };
+  cache->RSSetViewports(1, &viewport);
+  cache->IASetInputLayout(Fake<ID3D11InputLayout>(21));
+  ID3D11SamplerState *samplers[1] = { Fake<ID3D11SamplerState>(32) };
+  cache->PSSetSamplers(0, 1, samplers);
+  ID3D11ShaderResourceView *atlas[1] = {
+    Fake<ID3D11ShaderResourceView>(33)
+  };
+  cache->PSSetShaderResources(4, 1, atlas);
+  ID3D11Buffer *buffers[1] = { &buffer };
+  cache->VSSetConstantBuffers(0, 1, buffers);
+  for (UInt32 i = 0; i < 6; ++i) {
+    // Two materials, each with its shaders and texture
+    cache->VSSetShader(Fake<ID3D11VertexShader>(34 + i / 3));
+    cache->PSSetShader(Fake<ID3D11PixelShader>(36 + i / 3));
+    ID3D11ShaderResourceView *diffuse[1] = {
+      Fake<ID3D11ShaderResourceView>(38 + i / 3)
+    };
+    cache->PSSetShaderResources(0, 1, diffuse);
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    cache->Map(&buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+    memset(mapped.pData, static_cast<int>(i + 10), 64);
+    cache->Unmap(&buffer, 0);
+    cache->DrawIndexed(36, 0, i * 24);
+  }
+}
+
+void FeedbackPass(ConstantBuffer &buffer) {
+  StateCache *cache = StateCache::Inst();
+  ID3D11RenderTargetView *targets[1] = { Fake<ID3D11RenderTargetView>(40) };
+  cache->OMSetRenderTargets(1, targets, Fake<ID3D11DepthStencilView>(41));
+  FLOAT colour[4] = { 0.f, 0.f, 0.f, 0.f };
+  cache->ClearRenderTargetView(targets[0], colour);
+  D3D11_VIEWPORT viewport = { 0.f, 0.f, 160.f, 90.f, 0.f, 1.f };
+  cache->RSSetViewports(1, &viewport);
+  cache->IASetInputLayout(Fake<ID3D11InputLayout>(21));
+  cache->VSSetShader(Fake<ID3D11VertexShader>(22));
+  cache->PSSetShader(Fake<ID3D11PixelShader>(42));
+  ID3D11SamplerState *samplers[1] = { Fake<ID3D11SamplerState>(32) };
+  cache->PSSetSamplers(0, 1, samplers);
+  ID3D11Buffer *buffers[1] = { &buffer };
+  cache->VSSetConstantBuffers(0, 1, buffers);
+  for (UInt32 i = 0; i < 3; ++i) {
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    cache->Map(&buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+    memset(mapped.pData, static_cast<int>(i + 20), 64);
+    cache->Unmap(&buffer, 0);
+    cache->DrawIndexed(36, 0, i * 24);
+  }
+}
+
+// Runs the passes through a frame graph laid out as the renderer's: the
+// VT feedback pass on the main thread, and the shadow and main passes
+// either there too or from lists recorded on two threads. Returns what
+// the GPU sees.
+std::vector<std::string> RunFrame(bool record_lists) {
+  RecordingBackend backend;
+  StateCache::Inst()->set_backend(&backend);
+  StateCache::Inst()->BeginFrame();
+  // The same buffers in both runs, as binds are told by their addresses
+  static ConstantBuffer shadow_buffer, main_buffer, feedback_buffer;
+  CommandList shadow_list(&backend), main_list(&backend);
+  StreamEffects effects;
+
+  // Issues a pass on the main thread, or executes its list
+  auto issue = [&](CommandList *list, void (*pass)(ConstantBuffer &),
+    ConstantBuffer &buffer) {
+    size_t begin = backend.commands().size();
+    if (list != nullptr) {
+      list->Execute();
+      effects.StartList();
+    }
+    else {
+      pass(buffer);
+    }
+    effects.Add(backend.commands(), begin, backend.commands().size());
+  };
+
+  FrameGraph graph(
+    [](const RenderTextureDesc &desc, UInt32 serial) {
+      return static_cast<RenderTexture *>(nullptr);
+    },
+    [](RenderTexture *target) {});
+  FrameResource feedback = graph.ImportTarget("vt_feedback", nullptr);
+  FrameResource atlas = graph.ImportTarget("shadow_atlas", nullptr);
+  FrameResource scene = graph.ImportTarget("scene", nullptr);
+  FramePass pass = graph.AddPass("vt_feedback", [&] {
+    issue(nullptr, FeedbackPass, feedback_buffer);
+  });
+  graph.Write(pass, feedback);
+  pass = graph.AddPass("shadows", [&] {
+    issue(record_lists ? &shadow_list : nullptr, ShadowPass, shadow_buffer);
+  });
+  graph.Write(pass, atlas);
+  pass = graph.AddPass("main", [&] {
+    issue(record_lists ? &main_list : nullptr, MainPass, main_buffer);
+  });
+  graph.Read(pass, atlas);
+  graph.Write(pass, scene);
+  CHECK(graph.Compile());
+
+  // Recorded at the same time, the main pass first, before the graph runs
+  if (record_lists) {
+    std::thread record_main([&] {
+      main_list.Begin();
+      MainPass(main_buffer);
+      main_list.End();
+    });
+    std::thread record_shadows([&] {
+      shadow_list.Begin();
+      ShadowPass(shadow_buffer);
+      shadow_list.End();
+    });
+    record_main.join();
+    record_shadows.join();
+  }
+  graph.Execute();
+  CHECK(backend.count(kGfxDrawIndexed) == 13);
+
+  StateCache::ResetInst();
+  return effects.effects();
+}
+
+void TestFramePasses() {
+  // The stream merged from the lists does to the GPU what the passes do
+  // issued one after the other on the main thread
+  std::vector<std::string> single = RunFrame(false);
+  std::vector<std::string> merged = RunFrame(true);
+  CHECK(single.size() == 4 * 3 + 6 * 3 + 3 * 3 + 1);
+  CHECK(merged == single);
+}
+
+} // namespace
+
+int main() {
+  TestCounts();
+  TestReplay();
+  TestCommandLists();
+  TestFramePasses();
+
+  return sz::test::Finish("recording");
+}
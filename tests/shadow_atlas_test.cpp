@@ -0,0 +1,224 @@
+// Sizes and placement of the tiles of the shadow atlas: rounding, shrink
+// hysteresis, halving and dropping when full, and repacking
+#include "shadow_atlas.h"
+#include <vector>
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+// Tiles lie in the atlas, on a multiple of their size, apart from each
+// other; returns the texels they cover
+UInt64 CheckLayout(const ShadowAtlas &atlas, size_t lights_num) {
+  UInt64 texels = 0;
+  for (size_t i = 0; i < lights_num; ++i) {
+    const ShadowTile &a = atlas.tile(i);
+    if (a.size == 0) {
+      continue;
+    }
+    CHECK((a.size & (a.size - 1)) == 0 && a.size >= atlas.min_tile());
+    CHECK(a.x % a.size == 0 && a.y % a.size == 0);
+    CHECK(a.x + a.size <= atlas.size() && a.y + a.size <= atlas.size());
+    texels += static_cast<UInt64>(a.size) * a.size;
+
+    for (size_t j = 0; j < i; ++j) {
+      const ShadowTile &b = atlas.tile(j);
+      bool apart = b.size == 0 || a.x + a.size <= b.x ||
+        b.x + b.size <= a.x || a.y + a.size <= b.y || b.y + b.size <= a.y;
+      CHECK(apart);
+    }
+  }
+
+  return texels;
+}
+
+void TestSizes() {
+  ShadowAtlas atlas(2048, 128, 4);
+  // Rounded up, no smaller than the minimum, and the largest halved until
+  // they fit
+  float wanted[4] = { 100.f, 300.f, 0.f, 5000.f };
+  CHECK(atlas.Allocate(wanted) == 3);
+  CHECK(atlas.tile(0).size == 128);
+  CHECK(atlas.tile(1).size == 512);
+  CHECK(atlas.tile(2).size == 0);
+  CHECK(atlas.tile(3).size == 1024);
+  CHECK(!atlas.moved(2));
+  CHECK(atlas.dropped_count() == 0);
+  CHECK(atlas.used_texels() == CheckLayout(atlas, 4));
+
+  // Of tiles as large, that of the light which wants the least is halved
+  // first, then the last
+  ShadowAtlas full(2048, 128, 5);
+  float same[5] = { 2000.f, 2000.f, 1900.f, 2000.f, 2000.f };
+  full.Allocate(same);
+  CHECK(full.tile(0).size == 1024);
+  CHECK(full.tile(1).size == 1024);
+  CHECK(full.tile(2).size == 512);
+  CHECK(full.tile(3).size == 1024);
+  CHECK(full.tile(4).size == 512);
+  CHECK(full.used_texels() == CheckLayout(full, 5));
+}
+
+void TestHysteresis() {
+  ShadowAtlas atlas(2048, 128, 1);
+  float wanted = 1000.f;
+  CHECK(atlas.Allocate(&wanted) == 1);
+  ShadowTile first = atlas.tile(0);
+  CHECK(first.size == 1024);
+
+  // A little less keeps the tile where it is
+  wanted = 500.f;
+  CHECK(atlas.Allocate(&wanted) == 0);
+  CHECK(!atlas.moved(0));
+  CHECK(atlas.tile(0).size == 1024);
+  CHECK(atlas.tile(0).x == first.x && atlas.tile(0).y == first.y);
+
+  // Well less shrinks it, and it only grows back once it is too small
+  wanted = 300.f;
+  CHECK(atlas.Allocate(&wanted) == 1);
+  CHECK(atlas.moved(0) && atlas.tile(0).size == 512);
+  wanted = 450.f;
+  CHECK(atlas.Allocate(&wanted) == 0);
+  CHECK(atlas.tile(0).size == 512);
+  wanted = 600.f;
+  CHECK(atlas.Allocate(&wanted) == 1);
+  CHECK(atlas.tile(0).size == 1024);
+
+  // Wanting nothing takes the tile away
+  wanted = 0.f;
+  CHECK(atlas.Allocate(&wanted) == 1);
+  CHECK(atlas.tile(0).size == 0);
+  CHECK(atlas.used_texels() == 0);
+}
+
+void TestDropped() {
+  // 16 tiles of the minimum fit; of 20 lights, those which want the least
+  // go without
+  const size_t lights_num = 20;
+  ShadowAtlas atlas(512, 128, lights_num);
+  float wanted[lights_num];
+  for (size_t i = 0; i < lights_num; ++i) {
+    wanted[i] = 200.f + static_cast<float>((i * 7) % lights_num);
+  }
+  atlas.Allocate(wanted);
+  CHECK(atlas.dropped_count() == 4);
+  CHECK(atlas.used_texels() == 512 * 512);
+  CHECK(CheckLayout(atlas, lights_num) == atlas.used_texels());
+  for (size_t i = 0; i < lights_num; ++i) {
+    bool least = wanted[i] < 204.f;
+    CHECK((atlas.tile(i).size == 0) == least);
+    CHECK(least || atlas.tile(i).size == 128);
+  }
+
+  // They get one back once there is room
+  for (size_t i = 0; i < lights_num; ++i) {
+    if (wanted[i] >= 216.f) {
+      wanted[i] = 0.f;
+    }
+  }
+  atlas.Allocate(wanted);
+  CHECK(atlas.dropped_count() == 0);
+  for (size_t i = 0; i < lights_num; ++i) {
+    CHECK(atlas.tile(i).size == (wanted[i] > 0.f ? 128u : 0u));
+  }
+  CHECK(CheckLayout(atlas, lights_num) == atlas.used_texels());
+}
+
+void TestRepack() {
+  // The atlas full of tiles of 256, then every other one given back, so
+  // that no block of 512 is free
+  const size_t lights_num = 17;
+  ShadowAtlas atlas(1024, 128, lights_num);
+  float wanted[lights_num];
+  for (size_t i = 0; i < 16; ++i) {
+    wanted[i] = 256.f;
+  }
+  wanted[16] = 0.f;
+  atlas.Allocate(wanted);
+  CHECK(CheckLayout(atlas, lights_num) == 1024 * 1024);
+  CHECK(!atlas.repacked());
+
+  for (size_t i = 0; i < 16; ++i) {
+    const ShadowTile &tile = atlas.tile(i);
+    if ((tile.x / 256 + tile.y / 256) % 2 == 0) {
+      wanted[i] = 0.f;
+    }
+  }
+  wanted[16] = 512.f;
+  UInt32 moved = atlas.Allocate(wanted);
+  CHECK(atlas.repacked());
+  CHECK(atlas.tile(16).size == 512);
+  CHECK(atlas.dropped_count() == 0);
+  CHECK(CheckLayout(atlas, lights_num) == 8 * 256 * 256 + 512 * 512);
+  // The given back tiles, the new one, and those which were moved
+  UInt32 changed = 0;
+  for (size_t i = 0; i < lights_num; ++i) {
+    changed += atlas.moved(i) ? 1 : 0;
+  }
+  CHECK(moved == changed && moved > 9);
+}
+
+void TestRandomFrames() {
+  // Lights which come and go and want sizes which wander: whatever the
+  // frame, the tiles fit and the lights without one were left for want of
+  // room
+  const size_t lights_num = 64;
+  ShadowAtlas atlas(2048, 64, lights_num);
+  std::vector<float> wanted(lights_num, 0.f);
+  std::vector<ShadowTile> prev(lights_num);
+  UInt32 seed = 3;
+  auto random = [&seed](UInt32 range) {
+    seed = seed * 1664525u + 1013904223u;
+    return (seed >> 8) % range;
+  };
+  UInt32 repacks = 0;
+
+  for (UInt32 frame = 0; frame < 300; ++frame) {
+    for (size_t i = 0; i < lights_num; ++i) {
+      if (random(10) == 0) {
+        wanted[i] = random(3) == 0 ? 0.f : static_cast<float>(random(2500));
+      } else if (wanted[i] > 0.f) {
+        wanted[i] *= 0.8f + 0.05f * static_cast<float>(random(9));
+      }
+      prev[i] = atlas.tile(i);
+    }
+    UInt32 moved = atlas.Allocate(wanted.data());
+    repacks += atlas.repacked() ? 1 : 0;
+
+    CHECK(atlas.used_texels() <= 2048ull * 2048ull);
+    CHECK(CheckLayout(atlas, lights_num) == atlas.used_texels());
+    UInt32 without = 0, changed = 0;
+    for (size_t i = 0; i < lights_num; ++i) {
+      const ShadowTile &tile = atlas.tile(i);
+      if (wanted[i] > 0.f && tile.size == 0) {
+        ++without;
+      }
+      if (wanted[i] == 0.f) {
+        CHECK(tile.size == 0);
+      }
+      if (atlas.moved(i)) {
+        ++changed;
+      } else {
+        CHECK(tile.size == prev[i].size);
+        CHECK(tile.size == 0 || (tile.x == prev[i].x && tile.y == prev[i].y));
+      }
+    }
+    CHECK(without == atlas.dropped_count());
+    CHECK(moved == changed);
+  }
+  // The frames split the free room up at times
+  CHECK(repacks > 0);
+}
+
+} // namespace
+
+int main() {
+  TestSizes();
+  TestHysteresis();
+  TestDropped();
+  TestRepack();
+  TestRandomFrames();
+
+  return sz::test::Finish("shadow_atlas");
+}
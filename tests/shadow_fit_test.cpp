@@ -0,0 +1,180 @@
+// Fitting of shadow frustums: boxes measured in the view space of the
+// light, the window and planes End gives, and their snapping to steps
+#include "shadow_fit.h"
+#include <cmath>
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+// A light at the origin looking along z, with a cone of 90 degrees from
+// 1 to 101; the window snaps to steps of 1 / 16 and the far plane to
+// steps of 100 / 64
+const float kNear = 1.f;
+const float kFar = 101.f;
+
+XMFLOAT4X4 Identity() {
+  XMFLOAT4X4 view;
+  XMStoreFloat4x4(&view, XMMatrixIdentity());
+  return view;
+}
+
+bool Equal(const ShadowFrustum &a, const ShadowFrustum &b) {
+  return a.left == b.left && a.right == b.right && a.bottom == b.bottom &&
+    a.top == b.top && a.near_z == b.near_z && a.far_z == b.far_z;
+}
+
+void TestNothingToFit() {
+  ShadowFitter fitter;
+  ShadowFrustum frustum = { 1.f, 2.f, 3.f, 4.f, 5.f, 6.f };
+  ShadowFrustum before = frustum;
+
+  // No receivers, or none in the reach of the light: out of the cone,
+  // beyond the far plane or behind the light
+  fitter.Begin(Identity(), 1.f, kNear, kFar);
+  CHECK(!fitter.End(&frustum));
+  fitter.Begin(Identity(), 1.f, kNear, kFar);
+  fitter.AddReceiver(XMFLOAT3(50.f, 0.f, 10.f), XMFLOAT3(1.f, 1.f, 1.f));
+  fitter.AddReceiver(XMFLOAT3(0.f, 0.f, 150.f), XMFLOAT3(1.f, 1.f, 1.f));
+  fitter.AddCaster(XMFLOAT3(0.f, 0.f, 20.f), XMFLOAT3(1.f, 1.f, 1.f));
+  CHECK(!fitter.End(&frustum));
+  CHECK(Equal(frustum, before));
+}
+
+void TestReceivers() {
+  ShadowFitter fitter;
+  ShadowFrustum frustum;
+
+  // From 18 to 22 away, 2 / 18 either side: snapped out to 2 steps of the
+  // window, 14 of the depth range, and 4 steps per doubling of the near
+  // plane
+  fitter.Begin(Identity(), 1.f, kNear, kFar);
+  fitter.AddReceiver(XMFLOAT3(0.f, 0.f, 20.f), XMFLOAT3(2.f, 2.f, 2.f));
+  CHECK(fitter.End(&frustum));
+  CHECK(frustum.left == -0.125f && frustum.right == 0.125f);
+  CHECK(frustum.bottom == -0.125f && frustum.top == 0.125f);
+  CHECK(frustum.near_z == 16.f);
+  CHECK(frustum.far_z == kNear + 14.f * (kFar - kNear) / 64.f);
+  CHECK(ShadowFitter::TexelGain(frustum, 1.f) == 64.f);
+
+  // Moving less than a step keeps the frustum
+  ShadowFrustum moved;
+  fitter.Begin(Identity(), 1.f, kNear, kFar);
+  fitter.AddReceiver(XMFLOAT3(0.01f, -0.01f, 20.05f),
+    XMFLOAT3(2.f, 2.f, 2.f));
+  CHECK(fitter.End(&moved));
+  CHECK(Equal(frustum, moved));
+
+  // A box across the near plane may cover any direction
+  fitter.Begin(Identity(), 1.f, kNear, kFar);
+  fitter.AddReceiver(XMFLOAT3(0.f, 0.f, 20.f), XMFLOAT3(2.f, 2.f, 2.f));
+  fitter.AddReceiver(XMFLOAT3(0.5f, 0.f, 1.f), XMFLOAT3(1.f, 1.f, 1.f));
+  CHECK(fitter.End(&frustum));
+  CHECK(frustum.left == -1.f && frustum.right == 1.f);
+  CHECK(frustum.bottom == -1.f && frustum.top == 1.f);
+  CHECK(frustum.near_z == kNear);
+  CHECK(ShadowFitter::TexelGain(frustum, 1.f) == 1.f);
+
+  // Boxes which reach out of the cone are clamped to it
+  fitter.Begin(Identity(), 1.f, kNear, kFar);
+  fitter.AddReceiver(XMFLOAT3(20.f, 0.f, 20.f), XMFLOAT3(2.f, 2.f, 2.f));
+  CHECK(fitter.End(&frustum));
+  CHECK(frustum.right == 1.f && frustum.left < 1.f);
+}
+
+void TestCasters() {
+  ShadowFitter fitter;
+  ShadowFrustum frustum;
+
+  // Only a caster in front of the receivers' window moves the near plane;
+  // 4.5 snaps down to 4
+  fitter.Begin(Identity(), 1.f, kNear, kFar);
+  fitter.AddReceiver(XMFLOAT3(0.f, 0.f, 20.f), XMFLOAT3(2.f, 2.f, 2.f));
+  fitter.AddCaster(XMFLOAT3(4.f, 0.f, 5.f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+  fitter.AddCaster(XMFLOAT3(0.f, 0.f, 40.f), XMFLOAT3(1.f, 1.f, 1.f));
+  CHECK(fitter.End(&frustum));
+  CHECK(frustum.near_z == 16.f);
+  CHECK(frustum.far_z < 25.f);
+
+  fitter.Begin(Identity(), 1.f, kNear, kFar);
+  fitter.AddReceiver(XMFLOAT3(0.f, 0.f, 20.f), XMFLOAT3(2.f, 2.f, 2.f));
+  fitter.AddCaster(XMFLOAT3(0.f, 0.f, 5.f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+  CHECK(fitter.End(&frustum));
+  CHECK(frustum.near_z == 4.f);
+  // Casters never widen the window
+  CHECK(frustum.left == -0.125f && frustum.right == 0.125f);
+}
+
+void TestLightView() {
+  // A light 50 above the floor looking down: view x is world x, view y is
+  // world z, and the depth is the height under the light
+  XMFLOAT4X4 view = Identity();
+  view._22 = 0.f;
+  view._33 = 0.f;
+  view._23 = -1.f;
+  view._32 = 1.f;
+  view._43 = 50.f;
+
+  ShadowFitter fitter;
+  ShadowFrustum frustum;
+  fitter.Begin(view, 1.f, kNear, kFar);
+  fitter.AddReceiver(XMFLOAT3(8.f, 0.f, -3.f), XMFLOAT3(4.f, 0.1f, 2.f));
+  CHECK(fitter.End(&frustum));
+  // x from 4 to 12, y from -5 to -1, 49.9 to 50.1 away
+  CHECK(frustum.left <= 4.f / 50.1f && frustum.left > 4.f / 50.1f - 0.0625f);
+  CHECK(frustum.right >= 12.f / 49.9f &&
+    frustum.right < 12.f / 49.9f + 0.0625f);
+  CHECK(frustum.bottom <= -5.f / 49.9f &&
+    frustum.bottom > -5.f / 49.9f - 0.0625f);
+  CHECK(frustum.top >= -1.f / 50.1f && frustum.top < -1.f / 50.1f + 0.0625f);
+  CHECK(frustum.near_z <= 49.9f && frustum.near_z > 49.9f / 1.19f);
+  CHECK(frustum.far_z >= 50.1f && frustum.far_z < 50.1f + 100.f / 64.f);
+}
+
+void TestRandomBoxes() {
+  // Whatever the receivers, the frustum holds all of them
+  UInt32 seed = 5;
+  auto random = [&seed](float low, float high) {
+    seed = seed * 1664525u + 1013904223u;
+    return low + (high - low) * static_cast<float>(seed >> 8) / 16777216.f;
+  };
+  ShadowFitter fitter;
+  for (UInt32 frame = 0; frame < 100; ++frame) {
+    fitter.Begin(Identity(), 1.f, kNear, kFar);
+    XMFLOAT3 centres[4], extents[4];
+    for (UInt32 b = 0; b < 4; ++b) {
+      float z = random(10.f, 90.f);
+      centres[b] = XMFLOAT3(random(-0.5f, 0.5f) * z,
+        random(-0.5f, 0.5f) * z, z);
+      extents[b] = XMFLOAT3(random(0.f, 3.f), random(0.f, 3.f),
+        random(0.f, 3.f));
+      fitter.AddReceiver(centres[b], extents[b]);
+    }
+    ShadowFrustum frustum;
+    CHECK(fitter.End(&frustum));
+
+    for (UInt32 b = 0; b < 4; ++b) {
+      for (int corner = 0; corner < 8; ++corner) {
+        float x = centres[b].x + ((corner & 1) ? extents[b].x : -extents[b].x);
+        float y = centres[b].y + ((corner & 2) ? extents[b].y : -extents[b].y);
+        float z = centres[b].z + ((corner & 4) ? extents[b].z : -extents[b].z);
+        CHECK(x / z >= frustum.left && x / z <= frustum.right);
+        CHECK(y / z >= frustum.bottom && y / z <= frustum.top);
+        CHECK(z >= frustum.near_z && z <= frustum.far_z);
+      }
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  TestNothingToFit();
+  TestReceivers();
+  TestCasters();
+  TestLightView();
+  TestRandomBoxes();
+
+  return sz::test::Finish("shadow_fit");
+}
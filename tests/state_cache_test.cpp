@@ -0,0 +1,295 @@
+// Filtering of the state cache, checked on the commands which reach a
+// recording backend
+#include "state_cache.h"
+#include <cstring>
+#include "constant_ring.h"
+#include "recording_backend.h"
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+// Fake objects; only their addresses matter to the cache
+template <typename T>
+T *Fake(size_t id) {
+  return reinterpret_cast<T *>(id * 16);
+}
+
+// Constant buffer the cache can ask the description of
+struct ConstantBuffer : ID3D11Buffer {
+  UINT byte_width;
+
+  void GetDesc(D3D11_BUFFER_DESC *desc) {
+    ZeroMemory(desc, sizeof(*desc));
+    desc->ByteWidth = byte_width;
+    desc->BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+  }
+};
+
+// Sampler which counts its references
+struct CountedSampler : ID3D11SamplerState {
+  unsigned long refs;
+
+  CountedSampler() :
+    refs(1) {}
+  unsigned long AddRef() {
+    return ++refs;
+  }
+  unsigned long Release() {
+    return --refs;
+  }
+};
+
+// Device which creates samplers and the buffer of the constant ring
+struct TestDevice : ID3D11Device {
+  CountedSampler samplers[4];
+  UInt32 sampler_count;
+  ConstantBuffer ring_buffer;
+
+  TestDevice() :
+    sampler_count(0) {
+    ring_buffer.byte_width = 0;
+  }
+  HRESULT CreateSamplerState(const D3D11_SAMPLER_DESC *desc,
+    ID3D11SamplerState **state) {
+    *state = &samplers[sampler_count++];
+    return S_OK;
+  }
+  HRESULT CreateBuffer(const D3D11_BUFFER_DESC *desc,
+    const D3D11_SUBRESOURCE_DATA *data, ID3D11Buffer **buffer) {
+    ring_buffer.byte_width = desc->ByteWidth;
+    *buffer = &ring_buffer;
+    return S_OK;
+  }
+};
+
+// The cache in front of a fresh recording backend, at the start of a frame
+StateCache *BeginTest(RecordingBackend &backend) {
+  backend.set_keep_commands(true);
+  StateCache *cache = StateCache::Inst();
+  cache->set_backend(&backend);
+  cache->BeginFrame();
+  return cache;
+}
+
+void TestRedundantBinds() {
+  RecordingBackend backend;
+  StateCache *cache = BeginTest(backend);
+
+  for (int i = 0; i < 10; ++i) {
+    cache->PSSetShader(Fake<ID3D11PixelShader>(1));
+    cache->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    cache->RSSetState(Fake<ID3D11RasterizerState>(2));
+    cache->OMSetDepthStencilState(Fake<ID3D11DepthStencilState>(3), 1);
+    cache->DrawIndexed(36, 0, 0);
+  }
+  CHECK(backend.count(kGfxSetShader) == 1);
+  CHECK(backend.count(kGfxSetPrimitiveTopology) == 1);
+  CHECK(backend.count(kGfxSetRasterizerState) == 1);
+  CHECK(backend.count(kGfxSetDepthStencilState) == 1);
+  // Commands without state are never filtered
+  CHECK(backend.count(kGfxDrawIndexed) == 10);
+
+  // A different value, or the same one with another stencil reference, is
+  // issued
+  cache->PSSetShader(Fake<ID3D11PixelShader>(4));
+  cache->OMSetDepthStencilState(Fake<ID3D11DepthStencilState>(3), 2);
+  CHECK(backend.count(kGfxSetShader) == 2);
+  CHECK(backend.count(kGfxSetDepthStencilState) == 2);
+
+  cache->BeginFrame();
+  CHECK(cache->frame_stats().issued == 6);
+  CHECK(cache->frame_stats().filtered == 36);
+}
+
+void TestSlotRanges() {
+  RecordingBackend backend;
+  StateCache *cache = BeginTest(backend);
+
+  ID3D11ShaderResourceView *views[4] = {
+    Fake<ID3D11ShaderResourceView>(1), Fake<ID3D11ShaderResourceView>(2),
+    Fake<ID3D11ShaderResourceView>(3), Fake<ID3D11ShaderResourceView>(4)
+  };
+  cache->PSSetShaderResources(0, 4, views);
+
+  // Only the slots which changed are sent, as one range
+  views[1] = Fake<ID3D11ShaderResourceView>(5);
+  views[2] = Fake<ID3D11ShaderResourceView>(6);
+  cache->PSSetShaderResources(0, 4, views);
+  CHECK(backend.count(kGfxSetShaderResources) == 2);
+  const GfxCommand &command = backend.commands().back();
+  CHECK(command.type == kGfxSetShaderResources);
+  CHECK(command.stage == 4);
+  CHECK(command.a == 1 && command.b == 2);
+  CHECK(command.object == views[1]);
+
+  // Stages are apart: the same views on the vertex shader are issued
+  cache->VSSetShaderResources(0, 4, views);
+  CHECK(backend.count(kGfxSetShaderResources) == 3);
+  cache->PSSetShaderResources(2, 2, views + 2);
+  CHECK(backend.count(kGfxSetShaderResources) == 3);
+
+  // Vertex buffers compare strides and offsets too
+  ID3D11Buffer *buffer = Fake<ID3D11Buffer>(7);
+  UINT stride = 32, offset = 0;
+  cache->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+  cache->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+  offset = 64;
+  cache->IASetVertexBuffers(0, 1, &buffer, &stride, &offset);
+  CHECK(backend.count(kGfxSetVertexBuffers) == 2);
+}
+
+void TestInvalidation() {
+  RecordingBackend backend;
+  StateCache *cache = BeginTest(backend);
+
+  // State is unknown at the start of each frame
+  cache->PSSetShader(Fake<ID3D11PixelShader>(1));
+  cache->BeginFrame();
+  cache->PSSetShader(Fake<ID3D11PixelShader>(1));
+  CHECK(backend.count(kGfxSetShader) == 2);
+
+  // and after something else used the context
+  cache->Invalidate();
+  cache->PSSetShader(Fake<ID3D11PixelShader>(1));
+  CHECK(backend.count(kGfxSetShader) == 3);
+
+  // Binding render targets may unbind any view, but slots which held
+  // nothing still do
+  ID3D11ShaderResourceView *views[2] = {
+    Fake<ID3D11ShaderResourceView>(2), nullptr
+  };
+  cache->PSSetShaderResources(0, 2, views);
+  ID3D11RenderTargetView *target = Fake<ID3D11RenderTargetView>(3);
+  cache->OMSetRenderTargets(1, &target, nullptr);
+  CHECK(backend.count(kGfxSetRenderTargets) == 1);
+  cache->PSSetShaderResources(1, 1, &views[1]);
+  CHECK(backend.count(kGfxSetShaderResources) == 1);
+  cache->PSSetShaderResources(0, 1, &views[0]);
+  CHECK(backend.count(kGfxSetShaderResources) == 2);
+
+  // Unbinding only touches the slots which may hold something: at first
+  // those never bound this frame too, then the one bound since
+  cache->PSUnbindShaderResources();
+  CHECK(backend.count(kGfxSetShaderResources) == 3);
+  CHECK(backend.commands().back().a == 0);
+  CHECK(backend.commands().back().b ==
+    D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT);
+  cache->PSUnbindShaderResources();
+  CHECK(backend.count(kGfxSetShaderResources) == 3);
+  cache->PSSetShaderResources(0, 1, &views[0]);
+  cache->PSUnbindShaderResources();
+  CHECK(backend.count(kGfxSetShaderResources) == 5);
+  CHECK(backend.commands().back().a == 0);
+  CHECK(backend.commands().back().b == 1);
+}
+
+void TestBlendFactor() {
+  RecordingBackend backend;
+  StateCache *cache = BeginTest(backend);
+
+  // No factor means all 1s
+  const FLOAT ones[4] = { 1.f, 1.f, 1.f, 1.f };
+  const FLOAT halves[4] = { 0.5f, 0.5f, 0.5f, 0.5f };
+  cache->OMSetBlendState(Fake<ID3D11BlendState>(1), nullptr, 0xFFFFFFFF);
+  cache->OMSetBlendState(Fake<ID3D11BlendState>(1), ones, 0xFFFFFFFF);
+  CHECK(backend.count(kGfxSetBlendState) == 1);
+  cache->OMSetBlendState(Fake<ID3D11BlendState>(1), halves, 0xFFFFFFFF);
+  cache->OMSetBlendState(Fake<ID3D11BlendState>(1), halves, 0x0000FFFF);
+  CHECK(backend.count(kGfxSetBlendState) == 3);
+}
+
+void TestInterning() {
+  TestDevice device;
+  StateCache *cache = StateCache::Inst();
+
+  D3D11_SAMPLER_DESC desc;
+  ZeroMemory(&desc, sizeof(desc));
+  desc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+  desc.MaxLOD = 1000.f;
+  ID3D11SamplerState *a = cache->GetSamplerState(&device, desc);
+  ID3D11SamplerState *b = cache->GetSamplerState(&device, desc);
+  CHECK(a != nullptr && a == b);
+  CHECK(device.sampler_count == 1);
+  // The cache and both callers hold a reference
+  CHECK(device.samplers[0].refs == 3);
+
+  desc.MaxAnisotropy = 4;
+  ID3D11SamplerState *c = cache->GetSamplerState(&device, desc);
+  CHECK(c != a);
+  CHECK(device.sampler_count == 2);
+
+  a->Release();
+  b->Release();
+  c->Release();
+  // The cache keeps its references until it is destroyed
+  StateCache::ResetInst();
+  CHECK(device.samplers[0].refs == 0);
+  CHECK(device.samplers[1].refs == 0);
+}
+
+void TestConstantRing() {
+  TestDevice device;
+  ConstantRing ring(&device, 4096);
+  RecordingBackend backend;
+  StateCache *cache = BeginTest(backend);
+  cache->set_constant_ring(&ring);
+  CHECK(cache->constant_ring() == &ring);
+
+  ConstantBuffer buffer;
+  buffer.byte_width = 64;
+  ID3D11Buffer *bound = &buffer;
+  cache->VSSetConstantBuffers(0, 1, &bound);
+
+  // Writing a bound buffer moves it to a range of the ring, which is bound
+  // from its offset
+  D3D11_MAPPED_SUBRESOURCE mapped;
+  CHECK(cache->Map(&buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) == S_OK);
+  memset(mapped.pData, 7, 64);
+  cache->Unmap(&buffer, 0);
+  CHECK(backend.count(kGfxMap) == 0);
+  CHECK(backend.count(kGfxSetConstantBuffers) == 2);
+  CHECK(backend.commands().back().c == 1);
+  CHECK(backend.commands().back().object == &device.ring_buffer);
+
+  // The same contents again keep the range, and take no room
+  UInt32 used = ring.used();
+  CHECK(cache->Map(&buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) == S_OK);
+  memset(mapped.pData, 7, 64);
+  cache->Unmap(&buffer, 0);
+  CHECK(ring.used() == used);
+  CHECK(backend.count(kGfxSetConstantBuffers) == 2);
+
+  // Other contents take a new range, which is bound again
+  CHECK(cache->Map(&buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) == S_OK);
+  memset(mapped.pData, 8, 64);
+  cache->Unmap(&buffer, 0);
+  CHECK(ring.used() > used);
+  CHECK(backend.count(kGfxSetConstantBuffers) == 3);
+
+  cache->BeginFrame();
+  CHECK(cache->frame_stats().ring_written == 2);
+  CHECK(cache->frame_stats().ring_unchanged == 1);
+
+  // Without a ring, maps reach the backend
+  cache->set_constant_ring(nullptr);
+  CHECK(cache->Map(&buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped) == S_OK);
+  cache->Unmap(&buffer, 0);
+  CHECK(backend.count(kGfxMap) == 1);
+  CHECK(backend.count(kGfxUnmap) == 1);
+}
+
+} // namespace
+
+int main() {
+  TestRedundantBinds();
+  TestSlotRanges();
+  TestInvalidation();
+  TestBlendFactor();
+  TestInterning();
+  TestConstantRing();
+  StateCache::ResetInst();
+
+  return sz::test::Finish("state_cache");
+}
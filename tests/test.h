@@ -0,0 +1,43 @@
+//  Checks of the unit tests
+//  * Each test is a program which returns non zero if a check failed
+//  * CHECK reports a failed condition and carries on, so that a run shows
+//    every failure rather than the first one
+
+#ifndef _TEST_H
+#define _TEST_H
+
+#include <cstdio>
+
+namespace sz {
+namespace test {
+
+// Number of checks which failed in this program
+inline int &failures() {
+  static int count = 0;
+  return count;
+}
+
+// Report the result of the program, to be returned from main
+inline int Finish(const char *name) {
+  if (failures() == 0) {
+    printf("%s: ok\n", name);
+    return 0;
+  }
+
+  printf("%s: %d checks failed\n", name, failures());
+  return 1;
+}
+
+} // namespace test
+} // namespace sz
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+        #condition); \
+      ++sz::test::failures(); \
+    } \
+  } while (0)
+
+#endif
@@ -0,0 +1,109 @@
+// Lookup of textures through generational handles, against the map from
+// name CRCs to views the renderer used before, and the manager's own names
+#include "Texture.h"
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bench.h"
+
+using namespace sz::bench;
+
+namespace {
+
+// Views which free themselves when the manager releases them
+struct BenchView : public ID3D11ShaderResourceView {
+  unsigned long Release() {
+    delete this;
+    return 0;
+  }
+};
+
+struct BenchDevice : public ID3D11Device {
+  ID3D11Texture2D texture;
+
+  HRESULT CreateTexture2D(const D3D11_TEXTURE2D_DESC *desc,
+    const D3D11_SUBRESOURCE_DATA *data, ID3D11Texture2D **texture_out) {
+    *texture_out = &texture;
+    return S_OK;
+  }
+  HRESULT CreateShaderResourceView(ID3D11Resource *resource,
+    const D3D11_SHADER_RESOURCE_VIEW_DESC *desc,
+    ID3D11ShaderResourceView **view) {
+    *view = new BenchView();
+    return S_OK;
+  }
+};
+
+} // namespace
+
+int main() {
+  // Textures of a large scene, each under its path
+  const UInt32 count = 4096;
+  BenchDevice device;
+  D3D11_TEXTURE2D_DESC text_desc = {};
+  D3D11_SHADER_RESOURCE_VIEW_DESC view_desc = {};
+  Texture *textures = Texture::Inst();
+  std::unordered_map<UInt32, ID3D11ShaderResourceView *> by_name;
+  std::vector<UInt32> names;
+  std::vector<TextureHandle> handles;
+  for (UInt32 i = 0; i < count; ++i) {
+    std::string path = "../res/sponza/textures/material_" +
+      std::to_string(i) + "_diff.png";
+    textures->CreateTexture2D(&device, text_desc, view_desc, path);
+    UInt32 crc_val = abfw::CRC::GetICRC(path.c_str());
+    names.push_back(crc_val);
+    handles.push_back(textures->GetHandle(crc_val));
+    by_name[crc_val] = textures->GetTexture(handles.back());
+  }
+
+  // The textures the draws of some frames bind, in the order of a sorted
+  // draw list: runs of the same material, then a jump elsewhere
+  const UInt32 lookups = 100000;
+  std::vector<UInt32> order;
+  srand(7);
+  while (order.size() < lookups) {
+    UInt32 texture = rand() % count;
+    for (int run = rand() % 4; run >= 0 && order.size() < lookups; --run) {
+      order.push_back(texture);
+    }
+  }
+  std::vector<UInt32> order_names(lookups);
+  std::vector<TextureHandle> order_handles(lookups);
+  for (UInt32 i = 0; i < lookups; ++i) {
+    order_names[i] = names[order[i]];
+    order_handles[i] = handles[order[i]];
+  }
+
+  const UInt32 repetitions = 20;
+  double time = Best(repetitions, [&] {
+    UInt64 found = 0;
+    for (UInt32 name : order_names) {
+      found += reinterpret_cast<UInt64>(by_name.find(name)->second);
+    }
+    Keep(found);
+  });
+  Report("unordered_map of name CRCs", time, lookups, "lookup");
+
+  time = Best(repetitions, [&] {
+    UInt64 found = 0;
+    for (UInt32 name : order_names) {
+      found += reinterpret_cast<UInt64>(textures->GetTexture(name));
+    }
+    Keep(found);
+  });
+  Report("Texture, by name CRC", time, lookups, "lookup");
+
+  time = Best(repetitions, [&] {
+    UInt64 found = 0;
+    for (const TextureHandle &handle : order_handles) {
+      found += reinterpret_cast<UInt64>(textures->GetTexture(handle));
+    }
+    Keep(found);
+  });
+  Report("Texture, by handle", time, lookups, "lookup");
+
+  Texture::ResetInst();
+
+  return 0;
+}
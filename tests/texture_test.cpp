@@ -0,0 +1,297 @@
+// Content deduplication of Texture: names whose files, or decoded pixels, are
+// identical share one resident texture
+#include "Texture.h"
+#include <lodepng.h>
+#include "test.h"
+
+namespace {
+
+// Resources which count how many are alive
+struct CountedTexture : public ID3D11Texture2D {
+  static int alive;
+  CountedTexture() {
+    ++alive;
+  }
+  unsigned long Release() {
+    --alive;
+    delete this;
+    return 0;
+  }
+};
+int CountedTexture::alive = 0;
+
+struct CountedView : public ID3D11ShaderResourceView {
+  static int alive;
+  CountedView() {
+    ++alive;
+  }
+  unsigned long Release() {
+    --alive;
+    delete this;
+    return 0;
+  }
+};
+int CountedView::alive = 0;
+
+// Device which creates the counted resources
+struct TestDevice : public ID3D11Device {
+  int textures_created;
+
+  TestDevice() :
+    textures_created(0) {}
+
+  HRESULT CreateTexture2D(const D3D11_TEXTURE2D_DESC *desc,
+    const D3D11_SUBRESOURCE_DATA *data, ID3D11Texture2D **texture) {
+    ++textures_created;
+    *texture = new CountedTexture();
+    return S_OK;
+  }
+  HRESULT CreateShaderResourceView(ID3D11Resource *resource,
+    const D3D11_SHADER_RESOURCE_VIEW_DESC *desc,
+    ID3D11ShaderResourceView **view) {
+    *view = new CountedView();
+    return S_OK;
+  }
+};
+
+// Pixels of a width x height RGBA image, made from a seed
+std::vector<unsigned char> MakePixels(unsigned width, unsigned height,
+  unsigned seed) {
+  std::vector<unsigned char> pixels(width * height * 4);
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    pixels[i] = static_cast<unsigned char>(i * 37 + seed * 101);
+  }
+  return pixels;
+}
+
+// Save pixels as a PNG; a comment makes the file differ without changing
+// the pixels
+void SavePng(const std::string &path, const std::vector<unsigned char> &pixels,
+  unsigned width, unsigned height, const char *comment) {
+  lodepng::State state;
+  if (comment != nullptr) {
+    lodepng_add_text(&state.info_png, "Comment", comment);
+  }
+  std::vector<unsigned char> file;
+  lodepng::encode(file, pixels, width, height, state);
+  lodepng::save_file(file, path);
+}
+
+std::vector<unsigned char> LoadFile(const std::string &path) {
+  std::vector<unsigned char> file;
+  lodepng::load_file(file, path);
+  return file;
+}
+
+// Flips bits of the 4 bytes at pos so that the CRC of data becomes crc.
+// The CRC is affine in the bits of data, so the flips which cancel the
+// difference are found by elimination over the 32 bits' effects.
+void ForgeCrc(std::vector<unsigned char> &data, size_t pos, UInt32 crc) {
+  UInt32 base = abfw::CRC::GetCRC(data.data(), data.size());
+  UInt32 effects[32];
+  UInt32 masks[32];
+  for (UInt32 bit = 0; bit < 32; ++bit) {
+    data[pos + bit / 8] ^= 1 << (bit % 8);
+    effects[bit] = abfw::CRC::GetCRC(data.data(), data.size()) ^ base;
+    masks[bit] = 1u << bit;
+    data[pos + bit / 8] ^= 1 << (bit % 8);
+  }
+  UInt32 row = 0;
+  for (UInt32 col = 0; col < 32 && row < 32; ++col) {
+    UInt32 pivot = row;
+    while (pivot < 32 && !(effects[pivot] >> col & 1)) {
+      ++pivot;
+    }
+    if (pivot == 32) {
+      continue;
+    }
+    std::swap(effects[row], effects[pivot]);
+    std::swap(masks[row], masks[pivot]);
+    for (UInt32 r = 0; r < 32; ++r) {
+      if (r != row && (effects[r] >> col & 1)) {
+        effects[r] ^= effects[row];
+        masks[r] ^= masks[row];
+      }
+    }
+    ++row;
+  }
+  UInt32 wanted = base ^ crc;
+  UInt32 flips = 0;
+  for (UInt32 r = 0; r < row; ++r) {
+    for (UInt32 col = 0; col < 32; ++col) {
+      if (effects[r] == 1u << col && (wanted >> col & 1)) {
+        flips ^= masks[r];
+      }
+    }
+  }
+  for (UInt32 bit = 0; bit < 32; ++bit) {
+    if (flips >> bit & 1) {
+      data[pos + bit / 8] ^= 1 << (bit % 8);
+    }
+  }
+}
+
+void TestFileDuplicates(TestDevice &device, ID3D11DeviceContext &context) {
+  Texture *textures = Texture::Inst();
+  TextureHandle a = textures->LoadTexture(&device, &context, "a.png");
+  TextureHandle copy = textures->LoadTexture(&device, &context, "a_copy.png");
+
+  CHECK(a == copy);
+  CHECK(device.textures_created == 1);
+  CHECK(textures->resident_texture_count() == 1);
+  CHECK(textures->dedup_stats().file_duplicates == 1);
+  CHECK(textures->dedup_stats().bytes_saved > 0);
+  CHECK(textures->GetHandle("a_copy.png") == a);
+
+  // Freeing one name leaves the other resolving to the shared texture
+  textures->FreeTexture("a.png");
+  CHECK(textures->GetTexture(copy) != nullptr);
+  CHECK(textures->resident_texture_count() == 1);
+  textures->FreeTexture("a_copy.png");
+  CHECK(textures->GetTexture(copy) == nullptr);
+  CHECK(textures->resident_texture_count() == 0);
+  CHECK(CountedView::alive == 0);
+
+  Texture::ResetInst();
+}
+
+void TestPixelDuplicates(TestDevice &device, ID3D11DeviceContext &context) {
+  // Two different paths to the same pixels produce one resident texture
+  Texture *textures = Texture::Inst();
+  textures->set_dedup_pixels(true);
+  TextureHandle a = textures->LoadTexture(&device, &context, "a.png");
+  TextureHandle resaved = textures->LoadTexture(&device, &context,
+    "a_resaved.png");
+
+  CHECK(a == resaved);
+  CHECK(device.textures_created == 1);
+  CHECK(textures->resident_texture_count() == 1);
+  CHECK(textures->dedup_stats().uploads == 1);
+  CHECK(textures->dedup_stats().file_duplicates == 0);
+  CHECK(textures->dedup_stats().pixel_duplicates == 1);
+
+  // Other pixels, and the same bytes laid out as another size, do not
+  TextureHandle b = textures->LoadTexture(&device, &context, "b.png");
+  TextureHandle tall = textures->LoadTexture(&device, &context, "tall.png");
+  CHECK(b != a);
+  CHECK(tall != a);
+  CHECK(textures->resident_texture_count() == 3);
+
+  Texture::ResetInst();
+  CHECK(CountedView::alive == 0);
+}
+
+void TestKeyCollisions(TestDevice &device, ID3D11DeviceContext &context) {
+  // Other pixels with the same CRC and size as those of a.png, dimensions
+  // included, still get their own texture
+  Texture *textures = Texture::Inst();
+  textures->set_dedup_pixels(true);
+  TextureHandle a = textures->LoadTexture(&device, &context, "a.png");
+  TextureHandle forged = textures->LoadTexture(&device, &context,
+    "forged.png");
+
+  CHECK(a != forged);
+  CHECK(device.textures_created == 2);
+  CHECK(textures->dedup_stats().pixel_duplicates == 0);
+
+  // Freeing the forged texture leaves the key with a.png
+  textures->FreeTexture("forged.png");
+  TextureHandle resaved = textures->LoadTexture(&device, &context,
+    "a_resaved.png");
+  CHECK(resaved == a);
+
+  Texture::ResetInst();
+  CHECK(CountedView::alive == 0);
+}
+
+void TestFailedLoads(TestDevice &device, ID3D11DeviceContext &context) {
+  // Files which are missing or do not decode register no content, so that
+  // copies of them are not taken for the texture
+  Texture *textures = Texture::Inst();
+  TextureHandle broken = textures->LoadTexture(&device, &context,
+    "broken.png");
+  TextureHandle copy = textures->LoadTexture(&device, &context,
+    "broken_copy.png");
+  TextureHandle missing = textures->LoadTexture(&device, &context,
+    "missing.png");
+  TextureHandle missing_too = textures->LoadTexture(&device, &context,
+    "missing_too.png");
+
+  CHECK(broken != copy);
+  CHECK(missing != missing_too);
+  CHECK(textures->dedup_stats().file_duplicates == 0);
+  CHECK(textures->dedup_stats().uploads == 4);
+
+  Texture::ResetInst();
+}
+
+void TestPixelDuplicatesOff(TestDevice &device,
+  ID3D11DeviceContext &context) {
+  Texture *textures = Texture::Inst();
+  textures->set_dedup_pixels(false);
+  TextureHandle a = textures->LoadTexture(&device, &context, "a.png");
+  TextureHandle resaved = textures->LoadTexture(&device, &context,
+    "a_resaved.png");
+
+  CHECK(a != resaved);
+  CHECK(device.textures_created == 2);
+  CHECK(textures->resident_texture_count() == 2);
+  CHECK(textures->dedup_stats().pixel_duplicates == 0);
+
+  Texture::ResetInst();
+}
+
+} // namespace
+
+int main() {
+  std::vector<unsigned char> a = MakePixels(8, 8, 1);
+  SavePng("a.png", a, 8, 8, nullptr);
+  lodepng::save_file(LoadFile("a.png"), "a_copy.png");
+  SavePng("a_resaved.png", a, 8, 8, "saved again");
+  SavePng("b.png", MakePixels(8, 8, 2), 8, 8, nullptr);
+  SavePng("tall.png", a, 4, 16, nullptr);
+  CHECK(LoadFile("a.png") == LoadFile("a_copy.png"));
+  CHECK(LoadFile("a.png") != LoadFile("a_resaved.png"));
+
+  // Pixels of b forged to hash as those of a, with the dimensions after
+  // them as Texture hashes them
+  std::vector<unsigned char> keyed = a;
+  std::vector<unsigned char> forged = MakePixels(8, 8, 2);
+  unsigned char dims[8] = { 8, 0, 0, 0, 8, 0, 0, 0 };
+  keyed.insert(keyed.end(), dims, dims + 8);
+  forged.insert(forged.end(), dims, dims + 8);
+  ForgeCrc(forged, 0, abfw::CRC::GetCRC(keyed.data(), keyed.size()));
+  CHECK(abfw::CRC::GetCRC(forged.data(), forged.size()) ==
+    abfw::CRC::GetCRC(keyed.data(), keyed.size()));
+  forged.resize(forged.size() - 8);
+  CHECK(forged != a);
+  SavePng("forged.png", forged, 8, 8, nullptr);
+
+  std::vector<unsigned char> broken(64, 0xab);
+  lodepng::save_file(broken, "broken.png");
+  lodepng::save_file(broken, "broken_copy.png");
+
+  ID3D11DeviceContext context;
+  {
+    TestDevice device;
+    TestFileDuplicates(device, context);
+  }
+  {
+    TestDevice device;
+    TestPixelDuplicates(device, context);
+  }
+  {
+    TestDevice device;
+    TestKeyCollisions(device, context);
+  }
+  {
+    TestDevice device;
+    TestFailedLoads(device, context);
+  }
+  {
+    TestDevice device;
+    TestPixelDuplicatesOff(device, context);
+  }
+
+  return sz::test::Finish("texture");
+}
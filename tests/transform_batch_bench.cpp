@@ -0,0 +1,134 @@
+// Cost of working out the matrices of the draws of a pass: the batch,
+// against the same products with DirectXMath's, and against the entries
+// without light matrices which draws outside a batch write. Draws either
+// all have their own world matrix, or share a few, as the meshes of a
+// model do.
+#include "transform_batch.h"
+#include <cstdlib>
+#include <vector>
+#include "bench.h"
+
+using namespace sz;
+using namespace sz::bench;
+
+namespace {
+
+float Random() {
+  return rand() / static_cast<float>(RAND_MAX) * 2.f - 1.f;
+}
+
+// The entries of a batch, with XMMatrixMultiplyTranspose
+void ComputeWithProducts(const std::vector<XMFLOAT4X4> &worlds, UInt32 count,
+  const XMMATRIX &view, const XMMATRIX &projection,
+  const XMMATRIX *lights, MatrixBufferType *entries) {
+  XMMATRIX view_projection = XMMatrixMultiply(view, projection);
+  XMMATRIX view_t = XMMatrixTranspose(view);
+  XMMATRIX projection_t = XMMatrixTranspose(projection);
+  for (UInt32 i = 0; i < count; ++i) {
+    XMMATRIX world = XMLoadFloat4x4(&worlds[i]);
+    MatrixBufferType &entry = entries[i];
+    entry.world = XMMatrixTranspose(world);
+    entry.view = view_t;
+    entry.projection = projection_t;
+    entry.world_view_projection =
+      XMMatrixMultiplyTranspose(world, view_projection);
+    for (UInt32 l = 0; l < kNumLights; ++l) {
+      entry.world_lights_view_projection[l] =
+        XMMatrixMultiplyTranspose(world, lights[l]);
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(3.f, 20.f, -40.f, 1.f),
+    XMVectorSet(0.f, 0.f, 0.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+  XMMATRIX projection = XMMatrixPerspectiveFovLH(0.8f, 16.f / 9.f, 0.1f,
+    400.f);
+  XMMATRIX lights[kNumLights];
+  TransformBatch batch;
+  for (UInt32 l = 0; l < kNumLights; ++l) {
+    lights[l] = XMMatrixMultiply(
+      XMMatrixLookAtLH(XMVectorSet(Random() * 50.f, 40.f, Random() * 50.f,
+        1.f), XMVectorSet(0.f, 0.f, 0.f, 1.f),
+        XMVectorSet(0.f, 1.f, 0.f, 0.f)),
+      XMMatrixPerspectiveFovLH(1.2f, 1.f, 1.f, 200.f));
+    batch.SetLight(l, XMMatrixIdentity(), lights[l]);
+  }
+
+  const UInt32 max_draws = 4096;
+  std::vector<XMFLOAT4X4> worlds(max_draws);
+  for (XMFLOAT4X4 &world : worlds) {
+    XMStoreFloat4x4(&world, XMMatrixMultiply(XMMatrixRotationY(Random()),
+      XMMatrixTranslation(Random() * 100.f, Random() * 10.f,
+        Random() * 100.f)));
+  }
+  MatrixBufferType *entries = static_cast<MatrixBufferType *>(
+    _mm_malloc(sizeof(MatrixBufferType) * max_draws, 16));
+
+  // About Sponza's main pass, and a much larger scene
+  const UInt32 sizes[2] = { 384, max_draws };
+  for (UInt32 draws : sizes) {
+    const UInt32 reps = 2000000 / draws;
+    const double total = static_cast<double>(reps) * draws;
+    char name[64];
+
+    double time = Best(5, [&] {
+      for (UInt32 r = 0; r < reps; ++r) {
+        batch.Begin(view, projection);
+        for (UInt32 i = 0; i < draws; ++i) {
+          batch.Add(XMLoadFloat4x4(&worlds[i]));
+        }
+        batch.Compute();
+        Keep(static_cast<UInt64>(
+          XMVectorGetX(batch.entry(draws - 1).world.r[3])));
+      }
+    });
+    snprintf(name, sizeof(name), "batch, %u draws", draws);
+    Report(name, time, total, "draw");
+
+    time = Best(5, [&] {
+      for (UInt32 r = 0; r < reps; ++r) {
+        ComputeWithProducts(worlds, draws, view, projection, lights, entries);
+        Keep(static_cast<UInt64>(
+          XMVectorGetX(entries[draws - 1].world.r[3])));
+      }
+    });
+    snprintf(name, sizeof(name), "XMMatrixMultiplyTranspose, %u draws",
+      draws);
+    Report(name, time, total, "draw");
+
+    time = Best(5, [&] {
+      for (UInt32 r = 0; r < reps; ++r) {
+        for (UInt32 i = 0; i < draws; ++i) {
+          TransformBatch::ComputeEntry(XMLoadFloat4x4(&worlds[i]), view,
+            projection, batch.lights_view_projection(), entries[i]);
+        }
+        Keep(static_cast<UInt64>(
+          XMVectorGetX(entries[draws - 1].world.r[3])));
+      }
+    });
+    snprintf(name, sizeof(name), "per draw, %u draws", draws);
+    Report(name, time, total, "draw");
+
+    // Runs of 32 draws with the same world
+    time = Best(5, [&] {
+      for (UInt32 r = 0; r < reps; ++r) {
+        batch.Begin(view, projection);
+        for (UInt32 i = 0; i < draws; ++i) {
+          batch.Add(XMLoadFloat4x4(&worlds[i / 32]));
+        }
+        batch.Compute();
+        Keep(static_cast<UInt64>(
+          XMVectorGetX(batch.entry(batch.size() - 1).world.r[3])));
+      }
+    });
+    snprintf(name, sizeof(name), "batch, shared worlds, %u draws", draws);
+    Report(name, time, total, "draw");
+  }
+
+  _mm_free(entries);
+
+  return 0;
+}
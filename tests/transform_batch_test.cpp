@@ -0,0 +1,163 @@
+// Entries of a transform batch, four at a time and one by one, against the
+// products worked out one matrix at a time
+#include "transform_batch.h"
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+float Random() {
+  return rand() / static_cast<float>(RAND_MAX) * 2.f - 1.f;
+}
+
+XMMATRIX RandomWorld() {
+  return XMMatrixMultiply(XMMatrixMultiply(
+    XMMatrixScaling(1.f + Random() * .5f, 1.f + Random() * .5f,
+      1.f + Random() * .5f),
+    XMMatrixRotationY(Random() * 3.f)),
+    XMMatrixTranslation(Random() * 100.f, Random() * 10.f, Random() * 100.f));
+}
+
+// Largest difference between two matrices, relative to the larger element
+float Difference(const XMMATRIX &a, const XMMATRIX &b) {
+  XMFLOAT4X4 x, y;
+  XMStoreFloat4x4(&x, a);
+  XMStoreFloat4x4(&y, b);
+  float largest = 0.f;
+  for (int r = 0; r < 4; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      float d = fabsf(x.m[r][c] - y.m[r][c]) /
+        (1.f + fmaxf(fabsf(x.m[r][c]), fabsf(y.m[r][c])));
+      largest = fmaxf(largest, d);
+    }
+  }
+
+  return largest;
+}
+
+void TestEntries() {
+  srand(5);
+  XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(3.f, 20.f, -40.f, 1.f),
+    XMVectorSet(0.f, 0.f, 0.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+  XMMATRIX projection = XMMatrixPerspectiveFovLH(0.8f, 16.f / 9.f, 0.1f,
+    400.f);
+  XMMATRIX light_view = XMMatrixLookAtLH(XMVectorSet(10.f, 40.f, 5.f, 1.f),
+    XMVectorSet(0.f, 0.f, 0.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+  XMMATRIX light_projection = XMMatrixPerspectiveFovLH(1.2f, 1.f, 1.f,
+    200.f);
+
+  TransformBatch batch;
+  batch.SetLight(1, light_view, light_projection);
+  batch.SetLight(kNumLights, light_view, light_projection);
+
+  // Counts which leave none, some and three draws after the groups of four
+  const UInt32 counts[4] = { 1, 4, 7, 1026 };
+  for (UInt32 count : counts) {
+    std::vector<XMMATRIX> worlds;
+    batch.Begin(view, projection);
+    for (UInt32 i = 0; i < count; ++i) {
+      worlds.push_back(RandomWorld());
+      CHECK(batch.Add(worlds.back()) == i);
+    }
+    batch.Compute();
+    CHECK(batch.size() == count);
+
+    float largest = 0.f;
+    for (UInt32 i = 0; i < count; ++i) {
+      const MatrixBufferType &entry = batch.entry(i);
+      largest = fmaxf(largest,
+        Difference(entry.world, XMMatrixTranspose(worlds[i])));
+      largest = fmaxf(largest,
+        Difference(entry.view, XMMatrixTranspose(view)));
+      largest = fmaxf(largest,
+        Difference(entry.projection, XMMatrixTranspose(projection)));
+      largest = fmaxf(largest, Difference(entry.world_view_projection,
+        XMMatrixTranspose(XMMatrixMultiply(worlds[i],
+          XMMatrixMultiply(view, projection)))));
+      largest = fmaxf(largest, Difference(
+        entry.world_lights_view_projection[1],
+        XMMatrixTranspose(XMMatrixMultiply(worlds[i],
+          XMMatrixMultiply(light_view, light_projection)))));
+      // Lights which were never set have identity matrices
+      largest = fmaxf(largest, Difference(
+        entry.world_lights_view_projection[0],
+        XMMatrixTranspose(worlds[i])));
+    }
+    CHECK(largest < 1e-5f);
+  }
+}
+
+void TestSharing() {
+  TransformBatch batch;
+  batch.Begin(XMMatrixIdentity(), XMMatrixIdentity());
+  XMMATRIX a = XMMatrixTranslation(1.f, 2.f, 3.f);
+  XMMATRIX b = XMMatrixScaling(2.f, 2.f, 2.f);
+
+  // Only draws in a row share an entry
+  CHECK(batch.Add(a) == 0);
+  CHECK(batch.Add(a) == 0);
+  CHECK(batch.Add(b) == 1);
+  CHECK(batch.Add(a) == 2);
+  CHECK(batch.size() == 3);
+
+  // A new batch drops the draws of the last one
+  batch.Begin(XMMatrixIdentity(), XMMatrixIdentity());
+  CHECK(batch.size() == 0);
+  CHECK(batch.Add(b) == 0);
+}
+
+void TestSingleEntry() {
+  XMMATRIX world = XMMatrixTranslation(1.f, 2.f, 3.f);
+  XMMATRIX view = XMMatrixTranslation(0.f, 0.f, 10.f);
+  XMMATRIX projection = XMMatrixPerspectiveFovLH(1.f, 1.f, 1.f, 100.f);
+
+  TransformBatch batch;
+  batch.Begin(view, projection);
+  batch.Add(world);
+  batch.Compute();
+
+  // Without lights, as a batch whose lights were never set
+  MatrixBufferType entry;
+  TransformBatch::ComputeEntry(world, view, projection, nullptr, entry);
+  CHECK(Difference(entry.world_view_projection,
+    batch.entry(0).world_view_projection) < 1e-6f);
+  CHECK(Difference(entry.world, batch.entry(0).world) == 0.f);
+  for (UInt32 l = 0; l < kNumLights; ++l) {
+    CHECK(Difference(entry.world_lights_view_projection[l],
+      batch.entry(0).world_lights_view_projection[l]) < 1e-6f);
+  }
+
+  // With the lights of a batch, the same products as the batch has
+  XMMATRIX light_view = XMMatrixLookAtLH(XMVectorSet(10.f, 40.f, 5.f, 1.f),
+    XMVectorSet(0.f, 0.f, 0.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+  XMMATRIX light_projection = XMMatrixOrthographicLH(50.f, 50.f, 1.f,
+    100.f);
+  batch.SetLight(0, light_view, light_projection);
+  batch.SetLight(2, XMMatrixIdentity(), projection);
+  batch.Begin(view, projection);
+  batch.Add(world);
+  batch.Compute();
+  TransformBatch::ComputeEntry(world, view, projection,
+    batch.lights_view_projection(), entry);
+  for (UInt32 l = 0; l < kNumLights; ++l) {
+    CHECK(Difference(entry.world_lights_view_projection[l],
+      batch.entry(0).world_lights_view_projection[l]) < 1e-6f);
+  }
+  CHECK(Difference(entry.world_lights_view_projection[0],
+    XMMatrixTranspose(XMMatrixMultiply(world,
+      XMMatrixMultiply(light_view, light_projection)))) < 1e-6f);
+}
+
+} // namespace
+
+int main() {
+  TestEntries();
+  TestSharing();
+  TestSingleEntry();
+
+  return sz::test::Finish("transform_batch");
+}
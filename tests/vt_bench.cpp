@@ -0,0 +1,102 @@
+// Cost of virtual texturing on the CPU: analysing a frame of synthetic
+// feedback, updating the page table and its indirection, and cooking tiles
+#include "virtual_texture_cache.h"
+#include "virtual_texture_cook.h"
+#include <vector>
+#include "bench.h"
+
+using namespace sz;
+using namespace sz::bench;
+
+namespace {
+
+const UInt32 kTextures = 64;
+const UInt32 kTiles = 32;
+
+// Feedback of a frame: regions of the screen want pages of one texture, at
+// a mip which grows with the distance, and move as the camera does
+void FillFeedback(std::vector<VtPage> &feedback, UInt32 w, UInt32 frame) {
+  for (size_t i = 0; i < feedback.size(); ++i) {
+    UInt32 x = static_cast<UInt32>(i % w), y = static_cast<UInt32>(i / w);
+    UInt32 texture = (x / 16 + (y / 16) * 7 + frame / 10) % kTextures;
+    UInt32 mip = (y * 3) / (static_cast<UInt32>(feedback.size()) / w);
+    UInt32 tiles = kTiles >> mip;
+    feedback[i] = PackVtPage(texture, mip, (x / 4 + frame) % tiles,
+      (y / 4) % tiles);
+  }
+}
+
+} // namespace
+
+int main() {
+  // Feedback at 1/8 of 1280x720 and of 1920x1080
+  const UInt32 sizes[2][2] = { { 160, 90 }, { 240, 135 } };
+  const UInt32 frames = 200;
+
+  for (const UInt32 *size : sizes) {
+    VtPageTable table(16, 16);
+    for (UInt32 t = 0; t < kTextures; ++t) {
+      UInt32 texture = table.AddTexture(kTiles, kTiles);
+      VtPageLoad load;
+      table.LockPage(PackVtPage(texture, table.mip_count(texture) - 1, 0, 0),
+        load);
+    }
+
+    std::vector<std::vector<VtPage>> feedback(frames,
+      std::vector<VtPage>(size[0] * size[1]));
+    for (UInt32 f = 0; f < frames; ++f) {
+      FillFeedback(feedback[f], size[0], f);
+    }
+
+    VtFeedbackAnalyser analyser;
+    std::vector<VtPageRequest> requests;
+    std::vector<VtPageLoad> loads;
+    UInt32 frame = 1;
+
+    char name[64];
+    double time = Best(5, [&] {
+      for (UInt32 f = 0; f < frames; ++f) {
+        VtStats stats = {};
+        analyser.Analyse(feedback[f].data(), feedback[f].size(), table,
+          requests, stats);
+        Keep(requests.size());
+      }
+    });
+    snprintf(name, sizeof(name), "analyse %ux%u", size[0], size[1]);
+    Report(name, time, static_cast<double>(frames) * size[0] * size[1],
+      "texel");
+
+    time = Best(5, [&] {
+      for (UInt32 f = 0; f < frames; ++f) {
+        VtStats stats = {};
+        analyser.Analyse(feedback[f].data(), feedback[f].size(), table,
+          requests, stats);
+        table.Update(requests, frame++, 16, loads, stats);
+        for (UInt32 t = 0; t < kTextures; ++t) {
+          if (table.IsDirty(t)) {
+            table.BuildIndirection(t);
+          }
+        }
+        Keep(loads.size());
+      }
+    });
+    snprintf(name, sizeof(name), "analyse + update %ux%u", size[0],
+      size[1]);
+    Report(name, time, static_cast<double>(frames) * size[0] * size[1],
+      "texel");
+  }
+
+  // Cooking a texture of the model
+  std::vector<UInt8> image(2048 * 2048 * 4);
+  for (size_t i = 0; i < image.size(); ++i) {
+    image[i] = static_cast<UInt8>(i * 13);
+  }
+  double time = Best(3, [&] {
+    VtTileSource source;
+    source.Cook(image.data(), 2048, 2048);
+    Keep(source.mip_count());
+  });
+  Report("cook 2048x2048", time, 2048. * 2048., "texel");
+
+  return 0;
+}
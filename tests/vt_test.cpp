@@ -0,0 +1,232 @@
+// Page table management, feedback analysis and tile cooking of virtual
+// textures, on synthetic feedback
+#include "virtual_texture_cache.h"
+#include "virtual_texture_cook.h"
+#include <cstring>
+#include <vector>
+#include "test.h"
+
+using namespace sz;
+
+namespace {
+
+// Request for a page, or nullptr if it was not requested
+const VtPageRequest *FindRequest(const std::vector<VtPageRequest> &requests,
+  VtPage page) {
+  for (const VtPageRequest &request : requests) {
+    if (request.page == page) {
+      return &request;
+    }
+  }
+
+  return nullptr;
+}
+
+// Indirection entry of a page
+UInt32 Entry(const VtPageTable &table, UInt32 texture, UInt32 mip, UInt32 x,
+  UInt32 y) {
+  return table.indirection(texture)[table.indirection_offset(texture, mip) +
+    y * table.tiles_w(texture, mip) + x];
+}
+
+void TestPacking() {
+  VtPage page = PackVtPage(5, 3, 200, 17);
+  CHECK(VtPageTexture(page) == 5);
+  CHECK(VtPageMip(page) == 3);
+  CHECK(VtPageX(page) == 200);
+  CHECK(VtPageY(page) == 17);
+  CHECK(page != kVtNoPage);
+  CHECK(VtParentPage(page) == PackVtPage(5, 4, 100, 8));
+}
+
+void TestAnalyserCountsTexels() {
+  VtPageTable table(4, 4);
+  UInt32 texture = table.AddTexture(8, 4);
+  VtPage wide = PackVtPage(texture, 0, 1, 1);
+  VtPage scattered = PackVtPage(texture, 0, 6, 2);
+
+  // One run of 50 texels, and 10 texels broken up by empty ones
+  std::vector<VtPage> feedback(50, wide);
+  for (int i = 0; i < 10; ++i) {
+    feedback.push_back(scattered);
+    feedback.push_back(kVtNoPage);
+  }
+
+  VtFeedbackAnalyser analyser;
+  std::vector<VtPageRequest> requests;
+  VtStats stats = {};
+  analyser.Analyse(feedback.data(), feedback.size(), table, requests, stats);
+
+  CHECK(stats.feedback_texels == feedback.size());
+  const VtPageRequest *wide_request = FindRequest(requests, wide);
+  const VtPageRequest *scattered_request = FindRequest(requests, scattered);
+  CHECK(wide_request != nullptr && wide_request->count == 50);
+  CHECK(scattered_request != nullptr && scattered_request->count == 10);
+  // The page more texels want comes first
+  CHECK(wide_request < scattered_request);
+
+  // Ancestors add up the texels of their children
+  const VtPageRequest *root = FindRequest(requests,
+    PackVtPage(texture, table.mip_count(texture) - 1, 0, 0));
+  CHECK(root != nullptr && root->count == 60);
+}
+
+void TestAnalyserOrder() {
+  VtPageTable table(4, 4);
+  UInt32 texture = table.AddTexture(8, 4);
+  CHECK(texture == 0);
+  CHECK(table.mip_count(texture) == 4);
+
+  std::vector<VtPage> feedback(100, PackVtPage(texture, 0, 7, 3));
+  feedback.push_back(PackVtPage(texture, 0, 0, 0));
+  // Pages of textures or tiles which do not exist, e.g. stale feedback
+  feedback.push_back(PackVtPage(9, 0, 0, 0));
+  feedback.push_back(PackVtPage(texture, 0, 8, 0));
+
+  VtFeedbackAnalyser analyser;
+  std::vector<VtPageRequest> requests;
+  VtStats stats = {};
+  analyser.Analyse(feedback.data(), feedback.size(), table, requests, stats);
+
+  // (7, 3) and (0, 0) at mip 0, and their ancestors, which meet at mip 3
+  CHECK(requests.size() == 7);
+  CHECK(stats.pages_requested == 7);
+  CHECK(FindRequest(requests, PackVtPage(9, 0, 0, 0)) == nullptr);
+  for (size_t i = 1; i < requests.size(); ++i) {
+    CHECK(VtPageMip(requests[i - 1].page) >= VtPageMip(requests[i].page));
+  }
+  CHECK(VtPageMip(requests[0].page) == 3);
+}
+
+void TestPageTable() {
+  VtPageTable table(4, 4);
+  UInt32 texture = table.AddTexture(8, 4);
+  VtPage root = PackVtPage(texture, 3, 0, 0);
+
+  // Every entry falls back to the locked coarsest page
+  VtPageLoad lock;
+  CHECK(table.LockPage(root, lock));
+  CHECK(!table.LockPage(root, lock));
+  table.BuildIndirection(texture);
+  CHECK(!table.IsDirty(texture));
+  UInt32 root_entry = lock.slot_x | (lock.slot_y << 8) | (3 << 16) | (1 << 24);
+  for (UInt32 entry : table.indirection(texture)) {
+    CHECK(entry == root_entry);
+  }
+
+  VtPage fine = PackVtPage(texture, 0, 7, 3);
+  std::vector<VtPage> feedback(10, fine);
+  VtFeedbackAnalyser analyser;
+  std::vector<VtPageRequest> requests;
+  std::vector<VtPageLoad> loads;
+  VtStats stats = {};
+  analyser.Analyse(feedback.data(), feedback.size(), table, requests, stats);
+  table.Update(requests, 1, 100, loads, stats);
+
+  // The page and two ancestors are loaded; the root already was
+  CHECK(loads.size() == 3);
+  CHECK(stats.pages_resident == 1);
+  CHECK(table.IsResident(fine));
+  CHECK(table.IsDirty(texture));
+  table.BuildIndirection(texture);
+  CHECK(((Entry(table, texture, 0, 7, 3) >> 16) & 0xFF) == 0);
+  // Its neighbour falls back to the parent they share
+  CHECK(((Entry(table, texture, 0, 6, 3) >> 16) & 0xFF) == 1);
+}
+
+void TestEviction() {
+  // The root and 3 more pages fit
+  VtPageTable table(2, 2);
+  UInt32 texture = table.AddTexture(4, 4);
+  VtPageLoad lock;
+  CHECK(table.LockPage(PackVtPage(texture, 2, 0, 0), lock));
+
+  VtFeedbackAnalyser analyser;
+  std::vector<VtPageRequest> requests;
+  std::vector<VtPageLoad> loads;
+
+  // Frame 1 wants a page at mip 1 and one at mip 0 below it
+  VtPage old_page = PackVtPage(texture, 0, 0, 0);
+  std::vector<VtPage> feedback(1, old_page);
+  VtStats stats = {};
+  analyser.Analyse(feedback.data(), feedback.size(), table, requests, stats);
+  table.Update(requests, 1, 100, loads, stats);
+  CHECK(loads.size() == 2);
+
+  // Frame 2 wants pages elsewhere: the free slot goes first, then the least
+  // recently used one
+  feedback.assign(1, PackVtPage(texture, 0, 3, 3));
+  stats = VtStats();
+  analyser.Analyse(feedback.data(), feedback.size(), table, requests, stats);
+  table.Update(requests, 2, 100, loads, stats);
+  CHECK(loads.size() == 2);
+  CHECK(stats.pages_evicted == 1);
+  CHECK(table.IsResident(PackVtPage(texture, 2, 0, 0)));
+  CHECK(table.IsResident(PackVtPage(texture, 0, 3, 3)));
+
+  // Pages used in the frame are never evicted, so the rest is deferred
+  feedback.clear();
+  for (UInt32 y = 0; y < 4; ++y) {
+    for (UInt32 x = 0; x < 4; ++x) {
+      feedback.push_back(PackVtPage(texture, 0, x, y));
+    }
+  }
+  stats = VtStats();
+  analyser.Analyse(feedback.data(), feedback.size(), table, requests, stats);
+  table.Update(requests, 3, 100, loads, stats);
+  CHECK(stats.pages_resident + stats.pages_loaded == table.slot_count());
+  CHECK(stats.pages_deferred ==
+    stats.pages_requested - table.slot_count());
+
+  // Loads per update are bounded
+  VtPageTable budget_table(4, 4);
+  budget_table.AddTexture(4, 4);
+  stats = VtStats();
+  analyser.Analyse(feedback.data(), feedback.size(), budget_table, requests,
+    stats);
+  budget_table.Update(requests, 1, 2, loads, stats);
+  CHECK(loads.size() == 2);
+  CHECK(stats.pages_deferred == stats.pages_requested - 2);
+}
+
+void TestCook() {
+  // Sizes are rounded to a power of 2 number of tiles
+  std::vector<UInt8> image(300 * 200 * 4);
+  for (size_t i = 0; i < image.size(); ++i) {
+    image[i] = static_cast<UInt8>(i * 7);
+  }
+  VtTileSource source;
+  CHECK(source.Cook(image.data(), 300, 200));
+  CHECK(source.tiles_w() == 4);
+  CHECK(source.tiles_h() == 2);
+  CHECK(source.mip_count() == 3);
+
+  // Tiles hold the image at their position, and replicate its edges in
+  // their borders
+  std::vector<UInt8> square(256 * 256 * 4);
+  for (size_t i = 0; i < square.size(); ++i) {
+    square[i] = static_cast<UInt8>(i % 251);
+  }
+  VtTileSource square_source;
+  CHECK(square_source.Cook(square.data(), 256, 256));
+  const UInt8 *tile = square_source.GetTile(0, 1, 0);
+  CHECK(tile != nullptr);
+  CHECK(memcmp(tile + (kVtTileBorder * kVtPaddedTileSize + kVtTileBorder) * 4,
+    &square[128 * 4], 4) == 0);
+  CHECK(memcmp(tile, &square[(128 - kVtTileBorder) * 4], 4) == 0);
+  CHECK(square_source.GetTile(1, 0, 0) != nullptr);
+  CHECK(square_source.GetTile(2, 0, 0) == nullptr);
+}
+
+} // namespace
+
+int main() {
+  TestPacking();
+  TestAnalyserCountsTexels();
+  TestAnalyserOrder();
+  TestPageTable();
+  TestEviction();
+  TestCook();
+
+  return sz::test::Finish("vt");
+}